@@ -0,0 +1,197 @@
+/*
+  GR_Align.h
+  Timestamps for samples, and lining up the sensor streams by them. The three streams all run on different clocks. The accelerometer
+  arrives from the ADC's DMA buffer about 16 samples at a time, the DPS310 has its own 64Hz timer, and the battery rides in the ADC
+  pattern. The time a sample is read (or the time of the log tick that reports it) can be 20ms or more after it was taken.
+
+    GR_SampleClock  Works out when each sample of a fixed rate stream was taken when the stream is only ever read in chunks. The
+                    sample count times the period, anchored to the logger clock.
+    GR_HoldBack     Holds a slow stream's readings back until the fast stream's time has passed them. Then the filter sees every
+                    measurement in time order, and each one goes into the full rate record it was taken closest to.
+    GR_Track        The last few readings of one stream with their times, to read the stream at any time in between
+                    (interpolated, or the nearest reading).
+    commonUs()      The newest time every stream has a reading for, so a record made from all of them describes one moment.
+
+  Everything takes and returns logger clock micros() (GR_Clock); wall clock time is an offset on top of that, kept by the caller
+  (see io_wallOffsetUs in main.cpp). Nothing in here touches hardware, so it all runs on a host (tools/GraphiteAlignTest.cpp).
+
+  Part of the Graphite Flight Data Logger project, GPL-3.0 (see LICENSE)
+*/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/// @brief Acquisition times for a stream sampled at a fixed rate by hardware and read in chunks (the ADC's DMA buffer). Sample n was
+///        taken at anchor + n * period. The anchor comes from the reads: a sample can't have been taken after the read that handed it
+///        over, so each read bounds the anchor from above, and the lowest bound seen is the read that caught its chunk the moment it
+///        landed. The anchor is allowed to creep later at slewPpm, so a sample clock slightly slower than nominal (or drift between
+///        the two clocks) gets followed instead of building up. A read that says samples are much later than that means some were
+///        lost (the buffer overflowed), so it starts over from there
+class GR_SampleClock {
+  public:
+    struct Config {
+      uint32_t periodNs;  // Nominal sample period
+      uint32_t slewPpm;   // How fast the anchor may move later (ppm of elapsed time)
+      uint32_t resyncUs;  // A read this much later than the anchor allows means samples were lost: re-anchor on it
+    };
+
+    /// @brief The ADC's DMA stream: 4kHz per channel, 500ppm, and 50ms (a few DMA chunks, well past any read delay)
+    static Config defaults() { return {250000, 500, 50000}; }
+
+    GR_SampleClock(Config config = defaults()) : config_(config) { reset(); }
+
+    void setConfig(const Config& config) { config_ = config; }
+    const Config& config() const { return config_; }
+
+    /// @brief Forget the anchor (the stream restarted, its count went back to 0)
+    void reset() {
+      started_ = false;
+      anchorNs_ = 0;
+      lastReadUs_ = 0;
+      lagUs_ = 0;
+      resyncs_ = 0;
+    }
+
+    /// @brief A read handed over samples up to count - 1 (count = samples since the stream started)
+    /// @param readUs clock micros() right after the read
+    void update(uint64_t readUs, uint64_t count) {
+      if (count == 0) return;
+      int64_t bound = int64_t(readUs) * 1000 - int64_t(count - 1) * config_.periodNs;
+      if (!started_) {
+        anchorNs_ = bound;
+        started_ = true;
+      } else {
+        anchorNs_ += int64_t(readUs - lastReadUs_) * config_.slewPpm / 1000;
+        if (bound < anchorNs_) anchorNs_ = bound;
+        else if (bound - anchorNs_ > int64_t(config_.resyncUs) * 1000) { anchorNs_ = bound; resyncs_++; }
+      }
+      lastReadUs_ = readUs;
+      lagUs_ = uint32_t((bound - anchorNs_) / 1000);
+    }
+
+    /// @brief When sample n was taken (clock micros()). Only good for samples an update() has covered
+    uint64_t timeUs(uint64_t n) const { return uint64_t((anchorNs_ + int64_t(n) * config_.periodNs) / 1000); }
+
+    bool started() const { return started_; }
+    /// @brief How long the last read's newest sample had been waiting, going by the anchor (us)
+    uint32_t lagUs() const { return lagUs_; }
+    /// @brief Times it had to start over because samples went missing
+    uint32_t resyncs() const { return resyncs_; }
+
+  private:
+    Config config_;
+    bool started_;
+    int64_t anchorNs_;     // When sample 0 was taken (clock ns)
+    uint64_t lastReadUs_;
+    uint32_t lagUs_;
+    uint32_t resyncs_;
+};
+
+/// @brief Readings from a slow stream (baro, battery), held until the fast one (the accelerometer) gets past their time. Fixed size;
+///        if the fast stream stops, the oldest reading makes room (counted), and the caller should let them go on a timeout instead
+///        (pop() with an upToUs that isn't the fast stream's)
+template <typename T, size_t N>
+class GR_HoldBack {
+  static_assert(N > 0, "GR_HoldBack needs room for a reading");
+
+  public:
+    GR_HoldBack() { reset(); }
+
+    void reset() { head_ = count_ = 0; dropped_ = 0; }
+
+    /// @brief Queue a reading taken at timeUs (in time order)
+    void push(uint64_t timeUs, const T& v) {
+      if (count_ == N) { head_ = (head_ + 1) % N; count_--; dropped_++; }
+      size_t i = (head_ + count_) % N;
+      timeUs_[i] = timeUs;
+      buf_[i] = v;
+      count_++;
+    }
+
+    /// @brief Take the oldest reading if it was taken at or before upToUs
+    bool pop(uint64_t upToUs, uint64_t& timeUs, T& v) {
+      if (!count_ || timeUs_[head_] > upToUs) return false;
+      timeUs = timeUs_[head_];
+      v = buf_[head_];
+      head_ = (head_ + 1) % N;
+      count_--;
+      return true;
+    }
+
+    size_t size() const { return count_; }
+    /// @brief Readings pushed out by newer ones before anything took them
+    uint32_t dropped() const { return dropped_; }
+
+  private:
+    T buf_[N];
+    uint64_t timeUs_[N];
+    size_t head_, count_;
+    uint32_t dropped_;
+};
+
+/// @brief The last N readings of one stream with their times. T needs += and * float (a number, or a small struct of them, like
+///        GR_BaroSample)
+template <typename T, size_t N>
+class GR_Track {
+  static_assert(N > 0, "GR_Track needs at least one reading");
+
+  public:
+    GR_Track() { reset(); }
+
+    void reset() { next_ = count_ = 0; }
+
+    /// @brief Add a reading. One that isn't newer than the newest is dropped (the stream went backwards)
+    void push(uint64_t timeUs, const T& v) {
+      if (count_ && timeUs <= newestUs()) return;
+      timeUs_[next_] = timeUs;
+      buf_[next_] = v;
+      next_ = (next_ + 1) % N;
+      if (count_ < N) count_++;
+    }
+
+    bool empty() const { return count_ == 0; }
+    size_t size() const { return count_; }
+    /// @brief Time of the newest reading (0 if there isn't one)
+    uint64_t newestUs() const { return count_ ? timeUs_[idx(0)] : 0; }
+    const T& newest() const { return buf_[idx(0)]; }
+
+    /// @brief The stream at timeUs: a straight line between the readings either side of it (interpolate), or whichever of the two
+    ///        is nearer. Before the oldest or after the newest reading it holds that reading. T{} if there aren't any
+    T at(uint64_t timeUs, bool interpolate = true) const {
+      if (!count_) return T{};
+      size_t i = 0; // Age of the newest reading at or before timeUs
+      while (i < count_ && timeUs_[idx(i)] > timeUs) i++;
+      if (i == 0) return buf_[idx(0)];             // After the newest
+      if (i == count_) return buf_[idx(count_ - 1)]; // Before the oldest
+      const size_t a = idx(i), b = idx(i - 1);
+      uint64_t span = timeUs_[b] - timeUs_[a], into = timeUs - timeUs_[a];
+      if (!interpolate) return into * 2 < span ? buf_[a] : buf_[b];
+      float f = float(into) / float(span);
+      T v = buf_[a] * (1 - f);
+      v += buf_[b] * f;
+      return v;
+    }
+
+  private:
+    /// @brief Index of the reading age places back from the newest
+    size_t idx(size_t age) const { return (next_ + 2 * N - 1 - age) % N; }
+
+    T buf_[N];
+    uint64_t timeUs_[N];
+    size_t next_, count_;
+};
+
+namespace GR_Align {
+  /// @brief The newest time every stream has a reading at or after: the oldest of their newest reading times. A stream without a
+  ///        reading in the last staleUs (stopped, or not started yet) is left out, so one quiet sensor can't hold the rest back
+  /// @param newestUs each stream's GR_Track::newestUs() (0 = no readings)
+  /// @return nowUs if every stream is left out
+  inline uint64_t commonUs(uint64_t nowUs, uint64_t staleUs, const uint64_t * newestUs, size_t n) {
+    uint64_t t = nowUs;
+    for (size_t i = 0; i < n; i++) {
+      uint64_t s = newestUs[i];
+      if (s && s + staleUs >= nowUs && s < t) t = s;
+    }
+    return t;
+  }
+}
@@ -0,0 +1,107 @@
+/*
+  GR_Altitude.h
+  Fast barometric altitude: replaces the per-sample pow() in the logger's altitude formula with a table of cubic segments.
+
+  The formula (see the altitude calculation notes in main.cpp):
+    altM = ((cal_pAtSea / pressPa)^cal_magicExp - 1) * tempK / cal_lapseRate
+  Only the ((pAtSea / p)^exp - 1) part is expensive, and it only depends on pressure + the cal values, so that's what the table
+  holds. Segments are spaced geometrically (GR_ALT_TABLE_BITS segments per octave of pressure, indexed straight off the float's
+  exponent + top mantissa bits, so no log() and no search) and each one is a cubic Hermite fit with exact values and slopes at
+  both ends. Lookup = a few integer ops + 3 multiply-adds.
+
+  build() regenerates the table (call it again whenever cal_pAtSea, cal_magicExp or cal_lapseRate change). It also works out
+  an error bound for every segment (fit error measured against the exact formula in double, plus the worst case float rounding
+  of the lookup), so maxErrorM() holds across the whole table range (GR_ALT_P_MIN..GR_ALT_P_MAX, which covers 0-30km with room
+  to spare). The bound is ~11cm (conservative, mostly the rounding allowance); the real error is ~1cm, same as float pow().
+  Pressures outside the table fall back to the exact formula.
+
+  Part of the Graphite Flight Data Logger project, GPL-3.0 (see LICENSE)
+*/
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#ifndef GR_ALT_TABLE_BITS
+  #define GR_ALT_TABLE_BITS 4   // Segments per octave = 2^bits. 4 -> 16 segments per octave, 128 total, 2KB
+#endif
+#define GR_ALT_OCTAVE_MIN 9     // Table covers 2^9 = 512 Pa (~37km in a standard atmosphere)...
+#define GR_ALT_OCTAVE_MAX 17    // ...to 2^17 = 131072 Pa (below sea level)
+#define GR_ALT_P_MIN 512.0f
+#define GR_ALT_P_MAX 131072.0f
+#define GR_ALT_SEGMENTS ((GR_ALT_OCTAVE_MAX - GR_ALT_OCTAVE_MIN) << GR_ALT_TABLE_BITS)
+#define GR_ALT_CHECK_POINTS 16  // Points per segment build() checks the fit at
+#define GR_ALT_CHECK_TEMP_K 330.0f // Hottest air we'd ever fly in (57C); maxErrorM() is for this temperature (worst case)
+
+class GR_AltitudeTable {
+  public:
+    GR_AltitudeTable() {}
+
+    /// @brief (Re)generate the table for a set of calibration values. Takes a few ms (does the pow()s up front), so never call it
+    ///        on the sampling task; build a second table and swap them instead
+    void build(float pAtSea, float lapseRate, float magicExp) {
+      pAtSea_ = pAtSea;
+      magicExp_ = magicExp;
+      invLapse_ = 1.0f / lapseRate;
+      double worst = 0;
+      for (int i = 0; i < GR_ALT_SEGMENTS; i++) {
+        double p0 = segmentStart(i), p1 = segmentStart(i + 1), h = p1 - p0;
+        double f0 = exact(p0), f1 = exact(p1), d0 = slope(p0) * h, d1 = slope(p1) * h;
+        // Hermite cubic in s = t / h, then scaled back to t = p - p0 so lookup doesn't need a divide
+        double c2 = 3 * (f1 - f0) - 2 * d0 - d1;
+        double c3 = 2 * (f0 - f1) + d0 + d1;
+        coef_[i][0] = float(f0);
+        coef_[i][1] = float(d0 / h);
+        coef_[i][2] = float(c2 / (h * h));
+        coef_[i][3] = float(c3 / (h * h * h));
+        // Error bound for this segment = fit error + float rounding. The fit error is smooth, so it's measured (double math on the
+        // float coefficients) at a handful of points with 10% margin; the rounding is bounded analytically: Horner's 6 roundings
+        // on the sum of the term magnitudes, plus 3 more for the * tempK * invLapse at the end
+        const float * c = coef_[i];
+        double fit = 0, mag = fabs(c[0]) + fabs(c[1]) * h + fabs(c[2]) * h * h + fabs(c[3]) * h * h * h;
+        for (int k = 0; k <= GR_ALT_CHECK_POINTS; k++) {
+          double t = h * k / GR_ALT_CHECK_POINTS;
+          double err = fabs(c[0] + t * (c[1] + t * (double(c[2]) + t * c[3])) - exact(p0 + t));
+          if (err > fit) fit = err;
+        }
+        double bound = 1.1 * fit + 6 * FLT_EPSILON * mag + 3 * FLT_EPSILON * (fabs(f0) > fabs(f1) ? fabs(f0) : fabs(f1));
+        if (bound > worst) worst = bound;
+      }
+      maxErrorM_ = float(worst * GR_ALT_CHECK_TEMP_K / lapseRate);
+    }
+
+    /// @brief Barometric altitude (m), same math as the logger's pow() formula
+    float altitudeM(float pressPa, float tempC) const { return ratio(pressPa) * (tempC + 273.15f) * invLapse_; }
+
+    /// @brief (pAtSea / pressPa)^magicExp - 1, from the table
+    float ratio(float pressPa) const {
+      if (!(pressPa >= GR_ALT_P_MIN && pressPa < GR_ALT_P_MAX)) return powf(pAtSea_ / pressPa, magicExp_) - 1; // Off the table (or NaN)
+      uint32_t bits;
+      memcpy(&bits, &pressPa, sizeof(bits));
+      uint32_t key = bits >> (23 - GR_ALT_TABLE_BITS);                   // Exponent + top mantissa bits
+      uint32_t i = key - (uint32_t(127 + GR_ALT_OCTAVE_MIN) << GR_ALT_TABLE_BITS);
+      uint32_t startBits = key << (23 - GR_ALT_TABLE_BITS);
+      float p0;
+      memcpy(&p0, &startBits, sizeof(p0));
+      float t = pressPa - p0;                                            // Exact (same binade)
+      const float * c = coef_[i];
+      return c[0] + t * (c[1] + t * (c[2] + t * c[3]));
+    }
+
+    /// @brief Worst case altitude error of the table vs the exact formula anywhere in GR_ALT_P_MIN..GR_ALT_P_MAX (m)
+    float maxErrorM() const { return maxErrorM_; }
+
+  private:
+    static double segmentStart(int i) {
+      int octave = GR_ALT_OCTAVE_MIN + (i >> GR_ALT_TABLE_BITS);
+      int frac = i & ((1 << GR_ALT_TABLE_BITS) - 1);
+      return ldexp(1.0 + double(frac) / (1 << GR_ALT_TABLE_BITS), octave);
+    }
+    double exact(double p) const { return pow(double(pAtSea_) / p, double(magicExp_)) - 1; }
+    double slope(double p) const { return -double(magicExp_) / p * pow(double(pAtSea_) / p, double(magicExp_)); }
+
+    float coef_[GR_ALT_SEGMENTS][4] = {};
+    float pAtSea_ = 101325, magicExp_ = 0.190266435664f, invLapse_ = 1 / 0.0065f;
+    float maxErrorM_ = 0;
+};
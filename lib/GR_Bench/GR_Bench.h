@@ -0,0 +1,127 @@
+/*
+  GR_Bench.h
+  Micro-benchmark runner for the hot paths, the same on the logger and on the dev box (see src/bench/).
+
+  Kernels are registered in one table (an array of GR_BenchKernel) with a name, how many calls make up one timed sample (batch),
+  how many samples to take, and setup() / run() / teardown() functions that get the caller's context. GR_Bench::run() warms a
+  kernel up, times every sample with the cycle counter GR_Perf.h uses (CPU cycles on the ESP32, the steady clock on the host),
+  sorts the samples and reports per-call min / median / p90 / p99 / max / mean in ns.
+
+  Results are JSON lines, one object per kernel after a header line saying where it ran, e.g.
+
+    {"bench":"graphite","version":1,"target":"esp32s3","cyclesPerUs":240,"unit":"ns"}
+    {"name":"alt.table","batch":32,"samples":512,"min":101.2,"p50":104.1,"p90":105.0,"p99":118.3,"max":460.7,"mean":105.2}
+
+  so two runs can be diffed (tools/bench_compare.py) or just kept next to the commit they came from. Percentiles are nearest-rank
+  over the samples, so they're exact (unlike GR_Perf's histograms), and each sample is a whole batch: pick a batch big enough that
+  the two counter reads disappear into it, but small enough that one sample still sees the occasional slow call (interrupts,
+  cache misses, the card doing housekeeping). That's the tail the p99 / max are there to show.
+
+  Part of the Graphite Flight Data Logger project, GPL-3.0 (see LICENSE)
+*/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <GR_Perf.h>
+
+#define GR_BENCH_VERSION 1          // Bump if the output format changes
+#define GR_BENCH_MAX_SAMPLES 1024   // Most samples one kernel can take
+#define GR_BENCH_WARMUP 8           // Untimed batches before the timed ones (caches, branch predictors, lazy init)
+
+/// @brief One benchmarked kernel
+template <typename Ctx>
+struct GR_BenchKernel {
+  const char * name;          // "area.what", sorted by area in the output so runs line up when diffed
+  uint16_t batch;             // Calls per timed sample
+  uint16_t samples;           // Timed samples (<= GR_BENCH_MAX_SAMPLES)
+  bool (*setup)(Ctx& ctx);    // Called once before timing (NULL = nothing to do). Return false to skip the kernel (no hardware)
+  void (*run)(Ctx& ctx);      // One call
+  void (*teardown)(Ctx& ctx); // Called once after timing (NULL = nothing to do)
+};
+
+/// @brief Prints one line of output (no newline at the end)
+typedef void (*GR_BenchPrint)(const char * line);
+
+namespace GR_Bench {
+  struct Result {
+    const char * name;
+    uint16_t batch, samples;
+    bool skipped;
+    float minNs, p50Ns, p90Ns, p99Ns, maxNs, meanNs;  // Per call
+  };
+
+  inline float cyclesToNs(uint32_t cycles, uint16_t batch) { return cycles * (1000.0f / GR_PERF_CYCLES_PER_US) / batch; }
+
+  /// @brief Nearest-rank percentile of sorted samples
+  inline uint32_t percentile(const uint32_t * sorted, size_t n, float p) {
+    size_t rank = size_t(p * n + 0.999999f);
+    if (rank < 1) rank = 1;
+    if (rank > n) rank = n;
+    return sorted[rank - 1];
+  }
+
+  /// @brief Time one kernel
+  /// @param scratch room for GR_BENCH_MAX_SAMPLES samples
+  template <typename Ctx>
+  Result run(const GR_BenchKernel<Ctx>& k, Ctx& ctx, uint32_t * scratch) {
+    Result r = {};
+    r.name = k.name;
+    r.batch = k.batch ? k.batch : 1;
+    r.samples = k.samples < GR_BENCH_MAX_SAMPLES ? k.samples : GR_BENCH_MAX_SAMPLES;
+    if (k.setup && !k.setup(ctx)) { r.skipped = true; return r; }
+    for (int w = 0; w < GR_BENCH_WARMUP; w++) for (uint16_t b = 0; b < r.batch; b++) k.run(ctx);
+    uint64_t total = 0;
+    for (uint16_t s = 0; s < r.samples; s++) {
+      uint32_t start = GR_perfCycles();
+      for (uint16_t b = 0; b < r.batch; b++) k.run(ctx);
+      scratch[s] = GR_perfCycles() - start;
+      total += scratch[s];
+    }
+    std::sort(scratch, scratch + r.samples);
+    r.minNs = cyclesToNs(scratch[0], r.batch);
+    r.p50Ns = cyclesToNs(percentile(scratch, r.samples, 0.50f), r.batch);
+    r.p90Ns = cyclesToNs(percentile(scratch, r.samples, 0.90f), r.batch);
+    r.p99Ns = cyclesToNs(percentile(scratch, r.samples, 0.99f), r.batch);
+    r.maxNs = cyclesToNs(scratch[r.samples - 1], r.batch);
+    r.meanNs = float(total) * (1000.0f / GR_PERF_CYCLES_PER_US) / (float(r.samples) * r.batch);
+    if (k.teardown) k.teardown(ctx);
+    return r;
+  }
+
+  /// @brief The header line
+  inline size_t header(const char * target, char * out, size_t max) {
+    int n = snprintf(out, max, "{\"bench\":\"graphite\",\"version\":%d,\"target\":\"%s\",\"cyclesPerUs\":%d,\"unit\":\"ns\"}", GR_BENCH_VERSION,
+                     target, GR_PERF_CYCLES_PER_US);
+    return n < 0 ? 0 : size_t(n) < max ? size_t(n) : max - 1;
+  }
+
+  /// @brief One kernel's line
+  inline size_t json(const Result& r, char * out, size_t max) {
+    int n = r.skipped ? snprintf(out, max, "{\"name\":\"%s\",\"skipped\":true}", r.name)
+                      : snprintf(out, max, "{\"name\":\"%s\",\"batch\":%u,\"samples\":%u,\"min\":%.1f,\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,"
+                                 "\"max\":%.1f,\"mean\":%.1f}", r.name, r.batch, r.samples, r.minNs, r.p50Ns, r.p90Ns, r.p99Ns, r.maxNs, r.meanNs);
+    return n < 0 ? 0 : size_t(n) < max ? size_t(n) : max - 1;
+  }
+
+  /// @brief Run every kernel in the table whose name starts with filter (NULL / "" = all) and print the results
+  /// @return kernels run (not counting skipped ones)
+  template <typename Ctx>
+  size_t runAll(const GR_BenchKernel<Ctx> * table, size_t count, Ctx& ctx, const char * target, const char * filter, GR_BenchPrint print) {
+    static uint32_t scratch[GR_BENCH_MAX_SAMPLES];
+    char line[256];
+    size_t ran = 0;
+    header(target, line, sizeof(line));
+    print(line);
+    for (size_t i = 0; i < count; i++) {
+      if (filter && *filter && strncmp(table[i].name, filter, strlen(filter)) != 0) continue;
+      Result r = run(table[i], ctx, scratch);
+      json(r, line, sizeof(line));
+      print(line);
+      ran += !r.skipped;
+    }
+    return ran;
+  }
+}
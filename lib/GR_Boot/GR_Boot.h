@@ -0,0 +1,78 @@
+/*
+  GR_Boot.h
+  Boot stage timings: how long each step of setup() (and the network bring-up that runs after it on its own task) took, and when it
+  started, so "how long until we're logging again" after a reset is a number instead of a guess. Shown at /boot and printed to debug.
+
+    io_BootStage stage("sensors"); // In main.cpp: times into io_boot from here to the end of the block
+    ...
+    if (failed) stage.fail();
+
+  Times are us since boot, from whatever clock the caller passes in (the ESP32's esp_timer starts counting as the app starts, so
+  the ROM + bootloader time before that isn't in here).
+
+  Threading: stages can be started and finished from any number of tasks at once (each one gets its own slot); readers may see a
+  stage that hasn't finished yet (us == 0). Once MaxStages are used up, further stages aren't recorded.
+
+  Part of the Graphite Flight Data Logger project, GPL-3.0 (see LICENSE)
+*/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <atomic>
+
+template <size_t MaxStages>
+class GR_BootTimeline {
+  public:
+    struct Stage {
+      const char * name;  // String literal
+      uint32_t startUs;   // Since boot
+      uint32_t us;        // How long it took (0 = still running)
+      bool ok;            // false if it failed (the stage says how in the debug output)
+    };
+
+    /// @brief Start timing a stage
+    /// @return its slot, for finish() (-1 if there's no room left)
+    int start(const char * name, uint32_t nowUs) {
+      size_t i = count_.fetch_add(1, std::memory_order_relaxed);
+      if (i >= MaxStages) { count_.store(MaxStages, std::memory_order_relaxed); return -1; }
+      stages_[i] = {name, nowUs, 0, true};
+      return int(i);
+    }
+
+    /// @brief Stop timing a stage
+    void finish(int slot, uint32_t nowUs, bool ok = true) {
+      if (slot < 0) return;
+      Stage& s = stages_[slot];
+      uint32_t us = nowUs - s.startUs;
+      s.ok = ok;
+      s.us = us ? us : 1; // 0 means still running
+    }
+
+    size_t count() const { size_t n = count_.load(std::memory_order_relaxed); return n < MaxStages ? n : MaxStages; }
+    const Stage& stage(size_t i) const { return stages_[i]; }
+
+    /// @brief The stages as a JSON array: [{"name":"sensors","atMs":12.3,"ms":45.6,"ok":true},...] ("ms":null while still running)
+    /// @return length written (not counting the terminator). Cut short (but still terminated) if it doesn't fit
+    size_t json(char * out, size_t max) const {
+      size_t len = 0;
+      auto put = [&](int n) { if (n > 0) len += size_t(n); if (len >= max) len = max ? max - 1 : 0; };
+      put(snprintf(out, max, "["));
+      bool first = true;
+      for (size_t i = 0; i < count(); i++) {
+        const Stage& s = stages_[i];
+        if (!s.name) continue; // Slot taken, not filled in yet
+        char took[16] = "null";
+        if (s.us) snprintf(took, sizeof(took), "%.1f", s.us / 1000.0);
+        put(snprintf(out + len, max - len, "%s{\"name\":\"%s\",\"atMs\":%.1f,\"ms\":%s,\"ok\":%s}", first ? "" : ",", s.name, s.startUs / 1000.0,
+                     took, s.ok ? "true" : "false"));
+        first = false;
+      }
+      put(snprintf(out + len, max - len, "]"));
+      return len;
+    }
+
+  private:
+    Stage stages_[MaxStages] = {};
+    std::atomic<size_t> count_{0};
+};
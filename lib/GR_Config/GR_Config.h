@@ -0,0 +1,409 @@
+/*
+  GR_Config.h
+  Configuration registry: every setting is one line in a table (key, type, default, range, description) pointing at the global
+  it lives in, and the whole lot is loaded / saved as one binary blob in NVS instead of a key per setting.
+
+    int ld_accelSamples;
+    const GR_ConfigItem io_configItems[] = {
+      GR_CONFIG_INT(ld_accelSamples, "ld_accelN", 30, 1, 1000, "samples", 0, "Launch: consecutive accelerometer samples over ld_accelG"),
+      ...
+    };
+    GR_Config io_config(io_configItems, sizeof(io_configItems) / sizeof(io_configItems[0]));
+    ...
+    prefs.begin("config");
+    io_config.load(prefs);
+
+  The GR_CONFIG_* macros only take a variable of the right type (int, float, char[]), so a setting can't be read as one type and
+  written as another.
+
+  Blob (GR_CONFIG_BLOB_VERSION 1, little-endian): a 12 byte header (magic "GC", version, 0, entry count, payload length, FNV-1a 32 of the
+  payload) then one entry per setting: key length, key, type, value length, value (int32 / float / string without terminator).
+  Entries are matched by key when loading, so settings can be added, removed or reordered between firmware versions without losing
+  the others: new ones get their default, ones the table doesn't have any more are dropped the next time it's saved. A value that's
+  out of range (or the wrong type) is replaced by its default. If there's no blob yet, load() picks up the old one-key-per-setting
+  values (with the same keys) and moves them into a blob.
+
+  schemaHash() is a hash of the keys + types, written into the flight log header so a log says which config layout it was flown with.
+
+  Not thread safe: load / save / set while nothing else is reading the settings (setup(), or a handler holding the state lock while
+  disarmed).
+
+  Part of the Graphite Flight Data Logger project, GPL-3.0 (see LICENSE)
+*/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <GR_Prefs.h>
+
+// Setting types
+#define GR_CFG_INT    1
+#define GR_CFG_FLOAT  2
+#define GR_CFG_STRING 3
+
+// Setting flags
+#define GR_CFG_SECRET 0x01  // Value is never sent to the web page or written to the flight log (passwords)
+#define GR_CFG_REBOOT 0x02  // Only takes effect after a restart (WiFi settings)
+
+#define GR_CONFIG_BLOB_VERSION 1
+#define GR_CONFIG_BLOB_KEY "cfg"    // NVS key the blob is stored under (in whatever namespace the caller opened)
+#define GR_CONFIG_BLOB_MAX 1024     // Biggest blob (bytes)
+#define GR_CONFIG_HEADER_SIZE 12
+
+/// @brief One setting. Use the GR_CONFIG_* macros to make these
+struct GR_ConfigItem {
+  const char * key;      // NVS / JSON / log name (at most GR_PREFS_KEY_MAX chars)
+  uint8_t type;          // GR_CFG_*
+  uint8_t flags;         // GR_CFG_SECRET etc.
+  void * value;          // The variable it lives in
+  uint16_t size;         // Strings: buffer size (terminator included)
+  double def, min, max;  // Numbers: default + allowed range. Strings: allowed length range
+  const char * defStr;   // Strings: default
+  const char * unit;     // For the setup page ("" = none)
+  const char * desc;
+};
+
+#define GR_CONFIG_INT(var, key, def, min, max, unit, flags, desc) {key, GR_CFG_INT, flags, GR_Config::intRef(var), sizeof(int), def, min, max, NULL, unit, desc}
+#define GR_CONFIG_FLOAT(var, key, def, min, max, unit, flags, desc) {key, GR_CFG_FLOAT, flags, GR_Config::floatRef(var), sizeof(float), def, min, max, NULL, unit, desc}
+#define GR_CONFIG_STRING(var, key, def, minLen, flags, desc) {key, GR_CFG_STRING, flags, GR_Config::stringRef(var), sizeof(var), 0, minLen, sizeof(var) - 1, def, "", desc}
+
+class GR_Config {
+  public:
+    // Only accept a variable of the right type (see the macros above)
+    static void * intRef(int& v) { return &v; }
+    static void * floatRef(float& v) { return &v; }
+    template <size_t N> static void * stringRef(char (&v)[N]) { return v; }
+
+    static uint32_t fnv1a32(const void * data, size_t len, uint32_t h = 2166136261u) {
+      for (size_t i = 0; i < len; i++) h = (h ^ static_cast<const uint8_t *>(data)[i]) * 16777619u;
+      return h;
+    }
+
+    static const char * typeName(uint8_t type) {
+      switch (type) {
+        case GR_CFG_INT:    return "int";
+        case GR_CFG_FLOAT:  return "float";
+        case GR_CFG_STRING: return "string";
+        default:            return "unknown";
+      }
+    }
+
+    /// @brief Where load() got the values from
+    enum Source : uint8_t { FromBlob, FromKeys, FromDefaults };
+
+    /// @brief What load() / fromBlob() did
+    struct LoadStats {
+      Source source;
+      uint16_t loaded;     // Settings that came from storage
+      uint16_t defaulted;  // Settings storage didn't have (new ones), left at their default
+      uint16_t rejected;   // Settings storage had but out of range / wrong type, set to their default
+      bool badBlob;        // There was a blob but it was corrupt / from a newer format (everything fell back to keys or defaults)
+      bool saved;          // load() wrote the blob back (first boot, migration, or the table changed)
+    };
+
+    GR_Config(const GR_ConfigItem * items, size_t count) : items_(items), count_(count) {}
+
+    size_t count() const { return count_; }
+    const GR_ConfigItem& item(size_t i) const { return items_[i]; }
+    const GR_ConfigItem * find(const char * key) const {
+      for (size_t i = 0; i < count_; i++) if (!strcmp(items_[i].key, key)) return &items_[i];
+      return NULL;
+    }
+
+    /// @brief Hash of every key + type, in table order (changes when settings are added / removed / retyped)
+    uint32_t schemaHash() const {
+      uint32_t h = fnv1a32(NULL, 0);
+      for (size_t i = 0; i < count_; i++) {
+        h = fnv1a32(items_[i].key, strlen(items_[i].key) + 1, h);
+        h = fnv1a32(&items_[i].type, 1, h);
+      }
+      return h;
+    }
+
+    /// @brief Set every setting to its default
+    void setDefaults() { for (size_t i = 0; i < count_; i++) setDefault(items_[i]); }
+
+    /// @brief Number settings as a double (0 for strings)
+    static double number(const GR_ConfigItem& it) {
+      if (it.type == GR_CFG_INT) return *static_cast<const int *>(it.value);
+      if (it.type == GR_CFG_FLOAT) return *static_cast<const float *>(it.value);
+      return 0;
+    }
+
+    /// @brief Does this setting go in the flight log? (numbers only, never secrets: the WiFi strings don't affect a flight)
+    static bool loggable(const GR_ConfigItem& it) { return it.type != GR_CFG_STRING && !(it.flags & GR_CFG_SECRET); }
+
+    /// @brief Load everything from prefs (already begin()'d): the blob if there is one, else the old per-setting keys, else defaults.
+    ///        Writes the blob back if it didn't have exactly the table's settings (and removes the old keys once they're in it)
+    LoadStats load(GR_Prefs& prefs) {
+      LoadStats st = {};
+      uint8_t buf[GR_CONFIG_BLOB_MAX];
+      size_t len = prefs.getBytesLength(GR_CONFIG_BLOB_KEY);
+      if (len) {
+        if (len <= sizeof(buf) && prefs.getBytes(GR_CONFIG_BLOB_KEY, buf, sizeof(buf)) == len && fromBlob(buf, len, st)) {
+          if (st.defaulted || st.rejected || st.loaded != count_ || blobCount_ != count_) st.saved = save(prefs);
+          return st;
+        }
+        st = LoadStats();
+        st.badBlob = true;
+      }
+      setDefaults();
+      st.source = FromDefaults;
+      for (size_t i = 0; i < count_; i++) {
+        const GR_ConfigItem& it = items_[i];
+        if (!prefs.isKey(it.key)) { st.defaulted++; continue; }
+        if (loadKey(prefs, it)) st.loaded++; else st.rejected++;
+        st.source = FromKeys;
+      }
+      st.saved = save(prefs);
+      if (st.saved && st.source == FromKeys) for (size_t i = 0; i < count_; i++) prefs.remove(items_[i].key);
+      return st;
+    }
+
+    /// @brief Write every setting to prefs as one blob
+    bool save(GR_Prefs& prefs) const {
+      uint8_t buf[GR_CONFIG_BLOB_MAX];
+      size_t len = toBlob(buf, sizeof(buf));
+      return len && prefs.putBytes(GR_CONFIG_BLOB_KEY, buf, len) == len;
+    }
+
+    /// @brief Serialize every setting
+    /// @return blob length (0 if it doesn't fit in max)
+    size_t toBlob(uint8_t * out, size_t max) const {
+      if (max < GR_CONFIG_HEADER_SIZE) return 0;
+      size_t len = GR_CONFIG_HEADER_SIZE;
+      for (size_t i = 0; i < count_; i++) {
+        const GR_ConfigItem& it = items_[i];
+        size_t keyLen = strlen(it.key);
+        size_t valueLen = it.type == GR_CFG_STRING ? strnlen(static_cast<const char *>(it.value), it.size - 1) : 4;
+        if (keyLen > 255 || valueLen > 255 || len + 3 + keyLen + valueLen > max) return 0;
+        out[len++] = uint8_t(keyLen);
+        memcpy(out + len, it.key, keyLen);
+        len += keyLen;
+        out[len++] = it.type;
+        out[len++] = uint8_t(valueLen);
+        memcpy(out + len, it.value, valueLen);
+        len += valueLen;
+      }
+      size_t payload = len - GR_CONFIG_HEADER_SIZE;
+      uint32_t check = fnv1a32(out + GR_CONFIG_HEADER_SIZE, payload);
+      out[0] = 'G'; out[1] = 'C';
+      out[2] = GR_CONFIG_BLOB_VERSION;
+      out[3] = 0;
+      put16(out + 4, uint16_t(count_));
+      put16(out + 6, uint16_t(payload));
+      memcpy(out + 8, &check, 4);
+      return len;
+    }
+
+    /// @brief Load settings from a blob. Settings it doesn't have are set to their default
+    /// @return false if it isn't a blob this version can read (nothing's changed then)
+    bool fromBlob(const uint8_t * in, size_t len, LoadStats& st) {
+      st = LoadStats();
+      st.source = FromBlob;
+      if (len < GR_CONFIG_HEADER_SIZE || in[0] != 'G' || in[1] != 'C' || in[2] == 0 || in[2] > GR_CONFIG_BLOB_VERSION || in[3]) return false;
+      size_t payload = get16(in + 6);
+      uint32_t check;
+      memcpy(&check, in + 8, 4);
+      if (GR_CONFIG_HEADER_SIZE + payload != len || fnv1a32(in + GR_CONFIG_HEADER_SIZE, payload) != check) return false;
+      // Check it all parses before touching anything
+      size_t entries = 0;
+      for (size_t pos = GR_CONFIG_HEADER_SIZE; pos < len; entries++) {
+        if (pos + 3 > len || pos + 3 + in[pos] > len || pos + 3 + in[pos] + in[pos + in[pos] + 2] > len) return false;
+        pos += 3 + in[pos] + in[pos + in[pos] + 2];
+      }
+      if (entries != get16(in + 4)) return false;
+      blobCount_ = entries;
+      setDefaults();
+      bool seen[GR_CONFIG_BLOB_MAX / 4] = {};
+      for (size_t pos = GR_CONFIG_HEADER_SIZE; pos < len; ) {
+        char key[256];
+        size_t keyLen = in[pos];
+        memcpy(key, in + pos + 1, keyLen);
+        key[keyLen] = 0;
+        uint8_t type = in[pos + 1 + keyLen];
+        size_t valueLen = in[pos + 2 + keyLen];
+        const uint8_t * value = in + pos + 3 + keyLen;
+        pos += 3 + keyLen + valueLen;
+        const GR_ConfigItem * it = find(key);
+        if (!it) continue; // Not a setting any more
+        size_t index = size_t(it - items_);
+        if (index < sizeof(seen) && seen[index]) continue;
+        if (index < sizeof(seen)) seen[index] = true;
+        if (loadValue(*it, type, value, valueLen)) st.loaded++; else st.rejected++;
+      }
+      st.defaulted = uint16_t(count_ - st.loaded - st.rejected);
+      return true;
+    }
+
+    /// @brief Set one setting from text (a form field / command line)
+    /// @return false if there's no such setting, the text doesn't parse, or it's out of range (the setting isn't changed then)
+    bool set(const char * key, const char * text) {
+      const GR_ConfigItem * it = find(key);
+      return it && text && parse(*it, text, true);
+    }
+    /// @brief Would set() take it? (so a form with several fields can be checked before any of them are changed)
+    bool check(const char * key, const char * text) const {
+      const GR_ConfigItem * it = find(key);
+      return it && text && parse(*it, text, false);
+    }
+
+    /// @brief The schema + current values as JSON, for the setup page:
+    ///        {"schema":"1a2b3c4d","items":[{"key":"ld_accelG","type":"float","value":3,"default":3,"min":1.5,"max":100,"unit":"g",
+    ///        "reboot":false,"desc":"..."},...]}. Secret values are left out ("secret":true instead of "value")
+    /// @return length written (not counting the terminator), 0 if it didn't fit
+    size_t json(char * out, size_t max) const {
+      size_t len = 0;
+      if (!put(out, max, len, "{\"schema\":\"%08lx\",\"items\":[", (unsigned long)schemaHash())) return 0;
+      for (size_t i = 0; i < count_; i++) {
+        const GR_ConfigItem& it = items_[i];
+        if (!put(out, max, len, "%s{\"key\":\"%s\",\"type\":\"%s\",", i ? "," : "", it.key, typeName(it.type))) return 0;
+        if (it.flags & GR_CFG_SECRET) {
+          if (!put(out, max, len, "\"secret\":true,")) return 0;
+        } else if (it.type == GR_CFG_STRING) {
+          if (!put(out, max, len, "\"value\":") || !putString(out, max, len, static_cast<const char *>(it.value)) || !put(out, max, len, ",")) return 0;
+        } else {
+          if (!put(out, max, len, "\"value\":%.7g,", number(it))) return 0;
+        }
+        if (it.type == GR_CFG_STRING) {
+          if (!put(out, max, len, "\"minLen\":%d,\"maxLen\":%d,", int(it.min), int(it.max))) return 0;
+          if (!(it.flags & GR_CFG_SECRET) && (!put(out, max, len, "\"default\":") || !putString(out, max, len, it.defStr) || !put(out, max, len, ","))) return 0;
+        } else if (!put(out, max, len, "\"default\":%.7g,\"min\":%.7g,\"max\":%.7g,", it.def, it.min, it.max)) {
+          return 0;
+        }
+        if (!put(out, max, len, "\"unit\":") || !putString(out, max, len, it.unit ? it.unit : "") ||
+            !put(out, max, len, ",\"reboot\":%s,\"desc\":", it.flags & GR_CFG_REBOOT ? "true" : "false") ||
+            !putString(out, max, len, it.desc ? it.desc : "") || !put(out, max, len, "}")) return 0;
+      }
+      return put(out, max, len, "]}") ? len : 0;
+    }
+
+  private:
+    static void put16(uint8_t * p, uint16_t v) { p[0] = uint8_t(v); p[1] = uint8_t(v >> 8); }
+    static uint16_t get16(const uint8_t * p) { return uint16_t(p[0] | (p[1] << 8)); }
+    static bool trailingSpace(const char * p) { while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++; return *p == 0; }
+
+    static bool parse(const GR_ConfigItem& it, const char * text, bool apply) {
+      char * end;
+      switch (it.type) {
+        case GR_CFG_INT: {
+          long v = strtol(text, &end, 10);
+          if (end == text || !trailingSpace(end) || v < it.min || v > it.max) return false;
+          if (apply) *static_cast<int *>(it.value) = int(v);
+          return true;
+        }
+        case GR_CFG_FLOAT: {
+          double v = strtod(text, &end);
+          if (end == text || !trailingSpace(end) || !(v >= it.min && v <= it.max)) return false;
+          if (apply) *static_cast<float *>(it.value) = float(v);
+          return true;
+        }
+        case GR_CFG_STRING: {
+          size_t len = strlen(text);
+          if (len < it.min || len > it.max || len >= it.size) return false;
+          if (apply) memcpy(it.value, text, len + 1);
+          return true;
+        }
+      }
+      return false;
+    }
+
+    static void setDefault(const GR_ConfigItem& it) {
+      switch (it.type) {
+        case GR_CFG_INT: *static_cast<int *>(it.value) = int(it.def); break;
+        case GR_CFG_FLOAT: *static_cast<float *>(it.value) = float(it.def); break;
+        case GR_CFG_STRING: {
+          char * s = static_cast<char *>(it.value);
+          strncpy(s, it.defStr ? it.defStr : "", it.size - 1);
+          s[it.size - 1] = 0;
+          break;
+        }
+      }
+    }
+
+    /// @brief One value from a blob entry (ints and floats convert to each other, in case a setting changed type)
+    static bool loadValue(const GR_ConfigItem& it, uint8_t type, const uint8_t * value, size_t len) {
+      if (it.type == GR_CFG_STRING) {
+        if (type != GR_CFG_STRING || len < it.min || len > it.max || len >= it.size) return false;
+        memcpy(it.value, value, len);
+        static_cast<char *>(it.value)[len] = 0;
+        return true;
+      }
+      if ((type != GR_CFG_INT && type != GR_CFG_FLOAT) || len != 4) return false;
+      int32_t i;
+      float f;
+      memcpy(&i, value, 4);
+      memcpy(&f, value, 4);
+      return setNumber(it, type == GR_CFG_INT ? double(i) : double(f));
+    }
+
+    /// @brief One value from its own NVS key (the old layout). wi_channel used to be stored as a float, so ints fall back to that
+    static bool loadKey(GR_Prefs& prefs, const GR_ConfigItem& it) {
+      switch (it.type) {
+        case GR_CFG_INT: {
+          int32_t v = prefs.getInt(it.key, INT32_MIN);
+          return setNumber(it, v != INT32_MIN ? double(v) : double(prefs.getFloat(it.key, NAN)));
+        }
+        case GR_CFG_FLOAT: return setNumber(it, prefs.getFloat(it.key, NAN));
+        case GR_CFG_STRING: {
+          char buf[256];
+          if (!prefs.getString(it.key, buf, sizeof(buf))) return false;
+          size_t len = strlen(buf);
+          if (len < it.min || len > it.max || len >= it.size) return false;
+          memcpy(it.value, buf, len + 1);
+          return true;
+        }
+      }
+      return false;
+    }
+
+    static bool setNumber(const GR_ConfigItem& it, double v) {
+      if (!(v >= it.min && v <= it.max)) return false; // NaN fails too
+      if (it.type == GR_CFG_INT) {
+        if (v != double(int(v))) return false;
+        *static_cast<int *>(it.value) = int(v);
+      } else {
+        *static_cast<float *>(it.value) = float(v);
+      }
+      return true;
+    }
+
+    template <typename... Args>
+    static bool put(char * out, size_t max, size_t& len, const char * fmt, Args... args) {
+      int n = snprintf(out + len, max - len, fmt, args...);
+      if (n < 0 || size_t(n) >= max - len) return false;
+      len += size_t(n);
+      return true;
+    }
+    static bool put(char * out, size_t max, size_t& len, const char * s) { return put(out, max, len, "%s", s); }
+
+    /// @brief A JSON string (quoted, with " \ and control characters escaped)
+    static bool putString(char * out, size_t max, size_t& len, const char * s) {
+      if (len + 1 >= max) return false;
+      out[len++] = '"';
+      for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+          if (len + 2 >= max) return false;
+          out[len++] = '\\';
+          out[len++] = char(c);
+        } else if (c < 0x20) {
+          if (!put(out, max, len, "\\u%04x", c)) return false;
+        } else {
+          if (len + 1 >= max) return false;
+          out[len++] = char(c);
+        }
+      }
+      if (len + 1 >= max) return false;
+      out[len++] = '"';
+      out[len] = 0;
+      return true;
+    }
+
+    const GR_ConfigItem * items_;
+    size_t count_;
+    size_t blobCount_ = 0;
+};
@@ -0,0 +1,308 @@
+/*
+  GR_DPS310.h
+  DPS310 barometer driver running the sensor in background mode with its FIFO: the sensor measures pressure + temperature on its
+  own timer and queues the results (32 deep), and readBuffered() empties the queue in one burst of 3 byte reads once a measurement
+  is due. The old way polled MEAS_CFG twice and read both result registers for every sample, at the default 100kHz.
+
+    GR_DPS310Comp  The datasheet's compensation (section 4.9): calibration coefficients from their packed registers, scale factors,
+                   and raw results to C / Pa. Temperature terms are worked out once per temperature result and pressures go through
+                   a cubic in batches, since a FIFO burst has several pressures for every temperature. No hardware, so it's checked
+                   on a host against the datasheet (tools/GraphiteDPS310Test.cpp).
+    GR_DPS310      The GR_BaroSensor, on a GR_I2CBus (SensorHAL_ESP.h for the logger's Wire, native/FakeDPS310.h for a host).
+
+  Timestamps: FIFO results don't carry a time, but background mode measures at a fixed rate, so a GR_SampleClock (GR_Align.h) counts
+  pressure results and anchors them on the drains, the same as the ADC's DMA stream. Each is stamped at the middle of its measurement.
+  The sensor's timer isn't the logger's crystal, so the clock is allowed to drift a lot more than the ADC's.
+
+  Register map, FIFO and the compensation are from the Infineon DPS310 datasheet v1.1 (sections 4.9, 6.1, 7).
+
+  Part of the Graphite Flight Data Logger project, GPL-3.0 (see LICENSE)
+*/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <GR_SensorHAL.h>
+#include <GR_Align.h>
+
+#define GR_DPS310_ADDR 0x77         // I2C address with SDO high (Adafruit breakout default)
+#define GR_DPS310_ID 0x10           // PROD_ID: product 0, revision 1
+
+// Registers
+#define GR_DPS310_PSR_B2 0x00       // Pressure result (3 bytes, MSB first). The FIFO is read from here
+#define GR_DPS310_TMP_B2 0x03       // Temperature result (3 bytes)
+#define GR_DPS310_PRS_CFG 0x06      // PM_RATE (bits 6:4), PM_PRC (3:0)
+#define GR_DPS310_TMP_CFG 0x07      // TMP_EXT (7), TMP_RATE (6:4), TMP_PRC (3:0)
+#define GR_DPS310_MEAS_CFG 0x08     // Ready flags (7:4), MEAS_CTRL (2:0)
+#define GR_DPS310_CFG_REG 0x09      // T_SHIFT (3), P_SHIFT (2), FIFO_EN (1)
+#define GR_DPS310_RESET 0x0C        // FIFO_FLUSH (7), SOFT_RST (3:0)
+#define GR_DPS310_PROD_ID 0x0D
+#define GR_DPS310_COEF 0x10         // Calibration coefficients, 18 bytes
+#define GR_DPS310_COEF_SRCE 0x28    // TMP_COEF_SRCE (7): the temperature sensor the coefficients are for
+
+// Bits
+#define GR_DPS310_COEF_RDY 0x80
+#define GR_DPS310_SENSOR_RDY 0x40
+#define GR_DPS310_TMP_RDY 0x20
+#define GR_DPS310_PRS_RDY 0x10
+#define GR_DPS310_MEAS_CONT 0x07    // MEAS_CTRL: background, pressure + temperature
+#define GR_DPS310_TMP_EXT 0x80
+#define GR_DPS310_T_SHIFT 0x08      // Needed when temperature oversampling > 8
+#define GR_DPS310_P_SHIFT 0x04      // Needed when pressure oversampling > 8
+#define GR_DPS310_FIFO_EN 0x02
+#define GR_DPS310_FIFO_FLUSH 0x80
+#define GR_DPS310_SOFT_RST 0x09
+
+#define GR_DPS310_COEF_BYTES 18
+#define GR_DPS310_FIFO_DEPTH 32
+#define GR_DPS310_FIFO_EMPTY 0x800000  // What a FIFO read returns when there's nothing in it
+#define GR_DPS310_READY_MS 100         // Wait this long at most for the sensor + coefficients after a reset (datasheet: 40ms)
+
+/// @brief Calibration coefficients, as read from the sensor (two's complement, 12 / 20 / 16 bits)
+struct GR_DPS310Coefs {
+  int32_t c0, c1, c00, c10, c01, c11, c20, c21, c30;
+};
+
+/// @brief The datasheet's compensation (section 4.9), split so a burst of pressures shares the temperature terms:
+///          Tcomp = c0 / 2 + c1 * Traw_sc
+///          Pcomp = c00 + Praw_sc * (c10 + Praw_sc * (c20 + Praw_sc * c30)) + Traw_sc * c01 + Traw_sc * Praw_sc * (c11 + Praw_sc * c21)
+///        with Xraw_sc = Xraw / kX (the scale factor for that oversampling). Grouped by powers of Praw_sc that's a cubic whose
+///        coefficients only change with the temperature: a + x * (b + x * (c + x * c30))
+class GR_DPS310Comp {
+  public:
+    /// @brief Two's complement of the low bits of v
+    static int32_t signExtend(uint32_t v, int bits) { return int32_t(v << (32 - bits)) >> (32 - bits); }
+
+    /// @brief A 3 byte result (MSB first)
+    static int32_t raw24(const uint8_t * b) { return signExtend(uint32_t(b[0]) << 16 | uint32_t(b[1]) << 8 | b[2], 24); }
+
+    /// @brief Unpack the coefficients from registers 0x10..0x21 (datasheet table 18)
+    static GR_DPS310Coefs decode(const uint8_t * b) {
+      GR_DPS310Coefs c;
+      c.c0 = signExtend(uint32_t(b[0]) << 4 | b[1] >> 4, 12);
+      c.c1 = signExtend(uint32_t(b[1] & 0x0F) << 8 | b[2], 12);
+      c.c00 = signExtend(uint32_t(b[3]) << 12 | uint32_t(b[4]) << 4 | b[5] >> 4, 20);
+      c.c10 = signExtend(uint32_t(b[5] & 0x0F) << 16 | uint32_t(b[6]) << 8 | b[7], 20);
+      c.c01 = signExtend(uint32_t(b[8]) << 8 | b[9], 16);
+      c.c11 = signExtend(uint32_t(b[10]) << 8 | b[11], 16);
+      c.c20 = signExtend(uint32_t(b[12]) << 8 | b[13], 16);
+      c.c21 = signExtend(uint32_t(b[14]) << 8 | b[15], 16);
+      c.c30 = signExtend(uint32_t(b[16]) << 8 | b[17], 16);
+      return c;
+    }
+
+    /// @brief log2 of a rate / oversampling setting, which is what the config registers take. -1 if it's not 1, 2, 4 ... 128
+    static int code(uint32_t v) {
+      for (int i = 0; i < 8; i++) if (v == (1u << i)) return i;
+      return -1;
+    }
+
+    /// @brief Scale factor kP / kT for an oversampling rate (datasheet table 9), 0 if it isn't one
+    static uint32_t scaleFactor(uint32_t oversample) {
+      static const uint32_t k[8] = {524288, 1572864, 3670016, 7864320, 253952, 516096, 1040384, 2088960};
+      int i = code(oversample);
+      return i < 0 ? 0 : k[i];
+    }
+
+    /// @brief How long one measurement takes at an oversampling rate (datasheet table 16, ms)
+    static float measureMs(uint32_t oversample) {
+      static const float ms[8] = {3.6f, 5.2f, 8.4f, 14.8f, 27.6f, 53.2f, 104.4f, 206.8f};
+      int i = code(oversample);
+      return i < 0 ? 0 : ms[i];
+    }
+
+    void begin(const GR_DPS310Coefs& c, uint32_t prsOversample, uint32_t tmpOversample) {
+      c_ = c;
+      invKP_ = 1.0f / float(scaleFactor(prsOversample));
+      invKT_ = 1.0f / float(scaleFactor(tmpOversample));
+      c30_ = float(c.c30);
+      hasTemp_ = false;
+    }
+
+    /// @brief A temperature result: the temperature, and the pressure terms that depend on it
+    void setTemperature(int32_t raw) {
+      float t = float(raw) * invKT_;
+      tempC_ = float(c_.c0) * 0.5f + float(c_.c1) * t;
+      a_ = float(c_.c00) + t * float(c_.c01);
+      b_ = float(c_.c10) + t * float(c_.c11);
+      cc_ = float(c_.c20) + t * float(c_.c21);
+      hasTemp_ = true;
+    }
+
+    bool hasTemperature() const { return hasTemp_; }
+    float tempC() const { return tempC_; }
+
+    /// @brief One pressure result (Pa), at the last setTemperature()
+    float pressurePa(int32_t raw) const {
+      float x = float(raw) * invKP_;
+      return a_ + x * (b_ + x * (cc_ + x * c30_));
+    }
+
+    /// @brief n pressure results (Pa), all at the last setTemperature()
+    void pressurePa(const int32_t * raw, float * out, size_t n) const {
+      const float a = a_, b = b_, c = cc_, d = c30_, k = invKP_;
+      for (size_t i = 0; i < n; i++) {
+        float x = float(raw[i]) * k;
+        out[i] = a + x * (b + x * (c + x * d));
+      }
+    }
+
+  private:
+    GR_DPS310Coefs c_ = {};
+    float invKP_ = 0, invKT_ = 0, c30_ = 0;
+    float tempC_ = 0, a_ = 0, b_ = 0, cc_ = 0;
+    bool hasTemp_ = false;
+};
+
+/// @brief DPS310 in background mode with the FIFO on. Only ever used from one task (the sampling task, after begin() in setup())
+class GR_DPS310 : public GR_BaroSensor {
+  public:
+    struct Config {
+      uint8_t prsRate;        // Pressure measurements per second (1, 2, 4 ... 128)
+      uint8_t prsOversample;  // Samples per pressure measurement (1, 2, 4 ... 128): less noise, longer measurements
+      uint8_t tmpRate;        // Temperature measurements per second
+      uint8_t tmpOversample;
+      uint8_t burst;          // Empty the FIFO once this many pressure results should be waiting (1 = as soon as each one's due)
+    };
+
+    /// @brief 64Hz pressure at 8x (0.4 Pa RMS, about 3cm) and the temperature 4 times a second: 96% of the sensor's time, the most
+    ///        it can fit at 64Hz. Drained as each pressure comes in, so the filter gets it within a sampler period of it being ready
+    static Config defaults() { return {64, 8, 4, 1, 1}; }
+
+    /// @brief Whether the sensor has time for all those measurements (rate x measurement time, pressure + temperature, within
+    ///        a second), and every setting is one it takes
+    static bool fits(const Config& c) {
+      if (GR_DPS310Comp::code(c.prsRate) < 0 || GR_DPS310Comp::code(c.tmpRate) < 0 || !c.burst) return false;
+      if (!GR_DPS310Comp::scaleFactor(c.prsOversample) || !GR_DPS310Comp::scaleFactor(c.tmpOversample)) return false;
+      return c.prsRate * GR_DPS310Comp::measureMs(c.prsOversample) + c.tmpRate * GR_DPS310Comp::measureMs(c.tmpOversample) <= 1000;
+    }
+
+    GR_DPS310(GR_I2CBus& bus, GR_Clock& clock, uint8_t addr = GR_DPS310_ADDR) : bus_(bus), clock_(clock), addr_(addr) {}
+
+    /// @brief Reset the sensor, read its coefficients and start background measurements into the FIFO. Blocks for ~50ms
+    /// @return false if it isn't there (or isn't a DPS310), didn't come ready, or config doesn't fit()
+    bool begin(const Config& config = defaults()) {
+      if (!fits(config)) return false;
+      config_ = config;
+      uint8_t id;
+      if (!bus_.readRegs(addr_, GR_DPS310_PROD_ID, &id, 1) || id != GR_DPS310_ID) return false;
+      if (!bus_.writeReg(addr_, GR_DPS310_RESET, GR_DPS310_SOFT_RST)) return false;
+      uint8_t meas = 0;
+      for (uint32_t waited = 0; waited <= GR_DPS310_READY_MS; waited += 5) {
+        clock_.sleepMs(5);
+        const uint8_t ready = GR_DPS310_SENSOR_RDY | GR_DPS310_COEF_RDY;
+        if (bus_.readRegs(addr_, GR_DPS310_MEAS_CFG, &meas, 1) && (meas & ready) == ready) break;
+      }
+      if (!(meas & GR_DPS310_COEF_RDY)) return false;
+      uint8_t coef[GR_DPS310_COEF_BYTES], srce;
+      if (!bus_.readRegs(addr_, GR_DPS310_COEF, coef, sizeof(coef))) return false;
+      if (!bus_.readRegs(addr_, GR_DPS310_COEF_SRCE, &srce, 1)) return false;
+      comp_.begin(GR_DPS310Comp::decode(coef), config.prsOversample, config.tmpOversample);
+
+      // Some parts have a fuse bit problem that reads the temperature wrong; this is Infineon's fix (their reference driver),
+      // harmless on ones without it
+      static const uint8_t fix[5][2] = {{0x0E, 0xA5}, {0x0F, 0x96}, {0x62, 0x02}, {0x0E, 0x00}, {0x0F, 0x00}};
+      for (int i = 0; i < 5; i++) if (!bus_.writeReg(addr_, fix[i][0], fix[i][1])) return false;
+
+      uint8_t prsCfg = uint8_t(GR_DPS310Comp::code(config.prsRate) << 4 | GR_DPS310Comp::code(config.prsOversample));
+      uint8_t tmpCfg = uint8_t((srce & GR_DPS310_TMP_EXT) | GR_DPS310Comp::code(config.tmpRate) << 4 | GR_DPS310Comp::code(config.tmpOversample));
+      uint8_t cfg = uint8_t((config.tmpOversample > 8 ? GR_DPS310_T_SHIFT : 0) | (config.prsOversample > 8 ? GR_DPS310_P_SHIFT : 0) | GR_DPS310_FIFO_EN);
+      if (!bus_.writeReg(addr_, GR_DPS310_PRS_CFG, prsCfg) || !bus_.writeReg(addr_, GR_DPS310_TMP_CFG, tmpCfg) ||
+          !bus_.writeReg(addr_, GR_DPS310_CFG_REG, cfg) || !bus_.writeReg(addr_, GR_DPS310_RESET, GR_DPS310_FIFO_FLUSH))
+        return false;
+
+      // The sensor's timer can be a couple of % off nominal. A drain that empties the FIFO is less than a period after its newest
+      // result (the next one would be there otherwise), so more than two periods late means results were lost (the FIFO overflowed)
+      GR_SampleClock::Config clk = {uint32_t(1000000000UL / config.prsRate), 20000, uint32_t(2000000UL / config.prsRate)};
+      prsClock_.setConfig(clk);
+      prsClock_.reset();
+      prsCount_ = 0;
+      halfMeasureUs_ = uint32_t(GR_DPS310Comp::measureMs(config.prsOversample) * 500);
+      earlyUs_ = 250000 / config.prsRate;
+      lastUs_ = stampUs_ = 0;
+      return bus_.writeReg(addr_, GR_DPS310_MEAS_CFG, GR_DPS310_MEAS_CONT);
+    }
+
+    const Config& config() const { return config_; }
+
+    /// @brief True once a pressure result could be waiting (going by the rate and the results so far); doesn't touch the bus. Starts
+    ///        looking a quarter period early: the timestamps are only as good as the earliest drain that finds a result, so some
+    ///        have to come before the clock says it's there
+    bool available() override {
+      return !prsClock_.started() || clock_.micros() + earlyUs_ >= prsClock_.timeUs(prsCount_ + config_.burst - 1);
+    }
+
+    /// @brief One measurement (the oldest waiting). readBuffered() is the one to use, this empties the FIFO a result at a time
+    bool read(float& tempC, float& pressPa) override {
+      GR_BaroReading r;
+      if (readFifo(&r, 1) != 1) return false;
+      tempC = r.tempC;
+      pressPa = r.pressPa;
+      lastUs_ = r.timeUs;
+      return true;
+    }
+    uint64_t sampleUs() override { return lastUs_; }
+
+    /// @brief Empty the FIFO (up to max pressure results) if a result's due
+    size_t readBuffered(GR_BaroReading * out, size_t max) override { return available() ? readFifo(out, max) : 0; }
+
+    /// @brief Pressure results that came before the first temperature one (so couldn't be compensated), and failed reads
+    uint32_t dropped() const { return dropped_; }
+    uint32_t errors() const { return errors_; }
+    /// @brief Times the pressure count lost track of the sensor (the FIFO overflowed)
+    uint32_t resyncs() const { return prsClock_.resyncs(); }
+
+  private:
+    /// @brief Pop results until the FIFO's empty or max pressures are out, compensating the pressures between each pair of
+    ///        temperatures in one go
+    size_t readFifo(GR_BaroReading * out, size_t max) {
+      if (max > GR_DPS310_FIFO_DEPTH) max = GR_DPS310_FIFO_DEPTH;
+      int32_t raw[GR_DPS310_FIFO_DEPTH];
+      float pa[GR_DPS310_FIFO_DEPTH];
+      size_t n = 0, done = 0;
+      uint64_t first = prsCount_, before = prsCount_;
+      bool emptied = false;
+      for (int pops = 0; n < max && pops <= GR_DPS310_FIFO_DEPTH; pops++) {
+        uint8_t b[3];
+        if (!bus_.readRegs(addr_, GR_DPS310_PSR_B2, b, 3)) { errors_++; break; }
+        uint32_t v = uint32_t(b[0]) << 16 | uint32_t(b[1]) << 8 | b[2];
+        if (v == GR_DPS310_FIFO_EMPTY) { emptied = true; break; }
+        if (v & 1) { // Pressure results have the low bit set, temperatures clear
+          prsCount_++;
+          if (comp_.hasTemperature()) raw[n++] = GR_DPS310Comp::signExtend(v, 24);
+          else { dropped_++; first++; }
+        } else {
+          finish(raw, pa, out, done, n);
+          comp_.setTemperature(GR_DPS310Comp::signExtend(v, 24));
+        }
+      }
+      finish(raw, pa, out, done, n);
+      // Only a drain that got everything says how recent the newest result is
+      if (prsCount_ > before && (emptied || !prsClock_.started())) prsClock_.update(clock_.micros(), prsCount_);
+      for (size_t i = 0; i < n; i++) { // Middle of the measurement, never going backwards
+        uint64_t t = prsClock_.timeUs(first + i) - halfMeasureUs_;
+        out[i].timeUs = t > stampUs_ ? t : stampUs_ + 1;
+        stampUs_ = out[i].timeUs;
+      }
+      return n;
+    }
+
+    /// @brief Compensate pressures done..n (all at the current temperature)
+    void finish(const int32_t * raw, float * pa, GR_BaroReading * out, size_t& done, size_t n) {
+      if (n == done) return;
+      comp_.pressurePa(raw + done, pa + done, n - done);
+      for (size_t i = done; i < n; i++) { out[i].pressPa = pa[i]; out[i].tempC = comp_.tempC(); }
+      done = n;
+    }
+
+    GR_I2CBus& bus_;
+    GR_Clock& clock_;
+    uint8_t addr_;
+    Config config_ = defaults();
+    GR_DPS310Comp comp_;
+    GR_SampleClock prsClock_;
+    uint64_t prsCount_ = 0;         // Pressure results popped since begin()
+    uint32_t halfMeasureUs_ = 0;    // Results are queued at the end of their measurement
+    uint32_t earlyUs_ = 0;
+    uint64_t lastUs_ = 0, stampUs_ = 0;
+    uint32_t dropped_ = 0, errors_ = 0;
+};
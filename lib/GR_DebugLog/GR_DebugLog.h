@@ -0,0 +1,197 @@
+/*
+  GR_DebugLog.h
+  Deferred debug output. Producers don't format or print anything: each message is packed into one (or a few) 16 byte binary
+  records (a type, the newline flag, and the raw argument: a pointer to a string literal, the number, or a chunk of a copied string)
+  and queued in a GR_RingBuffer. A low priority task calls drain() later to turn the records into text and hand them to the
+  output (Serial on the logger). So a debug message costs the producer the same few hundred ns whether Serial is a fast USB port,
+  a slow UART or not being read at all.
+
+  If the queue is full the whole message is dropped (never half of one) and counted; drain() prints how many were lost the next
+  time it gets a chance.
+
+  Multiple tasks can log: pushes are serialized by Lock (a critical section on the logger, anything with lock() / unlock() on a PC),
+  so messages come out in exactly the order they went in. Only one task may call drain().
+
+  String literals are stored by pointer (they live forever); any other string is copied into the records, up to GR_DEBUG_MAX_CHARS.
+  Send anything bigger a line at a time (it would take most of the queue as one message anyway, and get dropped whole).
+
+  Part of the Graphite Flight Data Logger project, GPL-3.0 (see LICENSE)
+*/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <type_traits>
+#include <atomic>
+#include <GR_RingBuffer.h>
+
+#define GR_DEBUG_PAYLOAD 12       // Bytes of argument per record
+#define GR_DEBUG_DRAIN_BATCH 16   // Records drain() pops at a time
+#ifndef GR_DEBUG_MAX_CHARS
+  #define GR_DEBUG_MAX_CHARS 2048 // Longest copied string; longer ones are cut off (128 records, an eighth of the logger's queue)
+#endif
+
+// Record types
+#define GR_DBG_LITERAL 1  // const char * to a string literal
+#define GR_DBG_CHARS   2  // Copied string chunk (len bytes)
+#define GR_DBG_INT     3  // int64_t
+#define GR_DBG_UINT    4  // uint64_t
+#define GR_DBG_FLOAT   5  // double, printed with prec decimals
+#define GR_DBG_CHAR    6  // One character
+
+#define GR_DBG_NEWLINE 0x01  // flags: end the line after this record (println)
+#define GR_DBG_MORE    0x02  // flags: more GR_DBG_CHARS records of the same string follow
+
+struct GR_DebugRecord {
+  uint8_t type;
+  uint8_t flags;
+  uint8_t prec;  // Decimals (GR_DBG_FLOAT)
+  uint8_t len;   // Bytes used in data (GR_DBG_CHARS)
+  uint8_t data[GR_DEBUG_PAYLOAD];
+};
+static_assert(sizeof(GR_DebugRecord) == 16, "GR_DebugRecord should pack into 16 bytes");
+
+/// @brief Lock for when there's only ever one producer (or the caller serializes pushes itself)
+struct GR_DebugNoLock {
+  void lock() {}
+  void unlock() {}
+};
+
+/// @tparam Capacity records in the queue (power of 2)
+template <size_t Capacity, typename Lock = GR_DebugNoLock>
+class GR_DebugLog {
+  public:
+    // Producer side (any task) -----------------------------------------------------------------------------------------------------
+
+    /// @brief Queue a string. literal = true if it's a string literal (stored by pointer instead of copied)
+    bool put(const char * s, bool newline, bool literal = false) {
+      if (!s) s = "(null)";
+      if (literal) {
+        GR_DebugRecord r = make(GR_DBG_LITERAL, newline);
+        memcpy(r.data, &s, sizeof(s));
+        return push(&r, 1, nullptr, 0);
+      }
+      size_t len = 0;
+      while (len < GR_DEBUG_MAX_CHARS && s[len]) len++; // Not strnlen(): GCC warns when the bound's bigger than a char array passed in
+      return push(nullptr, 0, s, len, newline);
+    }
+    bool put(char * s, bool newline, bool literal = false) { return put(static_cast<const char *>(s), newline, literal); }
+
+    bool put(char c, bool newline) {
+      GR_DebugRecord r = make(GR_DBG_CHAR, newline);
+      r.data[0] = uint8_t(c);
+      return push(&r, 1, nullptr, 0);
+    }
+    bool put(bool b, bool newline) { return put(uint64_t(b), newline); }
+
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value && !std::is_same<T, char>::value, bool>::type
+    put(T v, bool newline) {
+      GR_DebugRecord r = make(GR_DBG_INT, newline);
+      int64_t x = v;
+      memcpy(r.data, &x, sizeof(x));
+      return push(&r, 1, nullptr, 0);
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value && !std::is_same<T, bool>::value, bool>::type
+    put(T v, bool newline) {
+      GR_DebugRecord r = make(GR_DBG_UINT, newline);
+      uint64_t x = v;
+      memcpy(r.data, &x, sizeof(x));
+      return push(&r, 1, nullptr, 0);
+    }
+
+    bool put(double v, bool newline, uint8_t prec) {
+      GR_DebugRecord r = make(GR_DBG_FLOAT, newline);
+      r.prec = prec;
+      memcpy(r.data, &v, sizeof(v));
+      return push(&r, 1, nullptr, 0);
+    }
+
+    // Consumer side (one task) -----------------------------------------------------------------------------------------------------
+
+    /// @brief Format queued records and pass the text to out(const char *, size_t), oldest first
+    /// @param maxRecords stop after this many (keeps one drain() call short)
+    /// @return records drained
+    template <typename Out>
+    size_t drain(Out&& out, size_t maxRecords = Capacity) {
+      uint32_t dropped = dropped_.load(std::memory_order_relaxed);
+      if (dropped != droppedReported_ && !midString_) { // Done here (not by the producer) so it comes out in line with everything else
+        char msg[64];
+        int n = snprintf(msg, sizeof(msg), "[WARN]: %lu debug messages dropped\r\n", (unsigned long)(dropped - droppedReported_));
+        droppedReported_ = dropped;
+        out(msg, size_t(n));
+      }
+      GR_DebugRecord batch[GR_DEBUG_DRAIN_BATCH];
+      size_t total = 0, n;
+      while (total < maxRecords && (n = ring_.popBatch(batch, maxRecords - total < GR_DEBUG_DRAIN_BATCH ? maxRecords - total : GR_DEBUG_DRAIN_BATCH)) > 0) {
+        for (size_t i = 0; i < n; i++) format(batch[i], out);
+        midString_ = batch[n - 1].flags & GR_DBG_MORE; // Don't split a string with the dropped warning next time
+        total += n;
+      }
+      return total;
+    }
+
+    /// @brief Messages thrown away because the queue was full
+    uint32_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+    /// @brief Records waiting to be drained
+    size_t pending() const { return ring_.size(); }
+    static constexpr size_t capacity() { return Capacity; }
+
+  private:
+    static GR_DebugRecord make(uint8_t type, bool newline) {
+      GR_DebugRecord r;
+      r.type = type;
+      r.flags = newline ? GR_DBG_NEWLINE : 0;
+      r.prec = 0;
+      r.len = 0;
+      return r;
+    }
+
+    /// @brief Queue n prebuilt records, or a string split into GR_DBG_CHARS records. All or nothing
+    bool push(const GR_DebugRecord * recs, size_t n, const char * chars, size_t len, bool newline = false) {
+      size_t chunks = chars ? (len + GR_DEBUG_PAYLOAD - 1) / GR_DEBUG_PAYLOAD : 0;
+      if (chars && chunks == 0) chunks = 1; // Empty string still carries the newline
+      lock_.lock();
+      if (Capacity - ring_.size() < n + chunks) { // Only producers push (under the lock), so free space can only grow from here
+        dropped_.store(dropped_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        lock_.unlock();
+        return false;
+      }
+      for (size_t i = 0; i < n; i++) ring_.push(recs[i]);
+      for (size_t c = 0; c < chunks; c++) {
+        GR_DebugRecord r = make(GR_DBG_CHARS, newline && c + 1 == chunks);
+        if (c + 1 < chunks) r.flags |= GR_DBG_MORE;
+        size_t k = len - c * GR_DEBUG_PAYLOAD;
+        r.len = uint8_t(k < GR_DEBUG_PAYLOAD ? k : GR_DEBUG_PAYLOAD);
+        memcpy(r.data, chars + c * GR_DEBUG_PAYLOAD, r.len);
+        ring_.push(r);
+      }
+      lock_.unlock();
+      return true;
+    }
+
+    template <typename Out>
+    static void format(const GR_DebugRecord& r, Out& out) {
+      char buf[48];
+      int n = 0;
+      switch (r.type) {
+        case GR_DBG_LITERAL: { const char * s; memcpy(&s, r.data, sizeof(s)); out(s, strlen(s)); break; }
+        case GR_DBG_CHARS: out(reinterpret_cast<const char *>(r.data), r.len); break;
+        case GR_DBG_CHAR: out(reinterpret_cast<const char *>(r.data), 1); break;
+        case GR_DBG_INT: { int64_t v; memcpy(&v, r.data, sizeof(v)); n = snprintf(buf, sizeof(buf), "%lld", (long long)v); break; }
+        case GR_DBG_UINT: { uint64_t v; memcpy(&v, r.data, sizeof(v)); n = snprintf(buf, sizeof(buf), "%llu", (unsigned long long)v); break; }
+        case GR_DBG_FLOAT: { double v; memcpy(&v, r.data, sizeof(v)); n = snprintf(buf, sizeof(buf), "%.*f", int(r.prec), v); break; }
+      }
+      if (n > 0) out(buf, size_t(n) < sizeof(buf) ? size_t(n) : sizeof(buf) - 1);
+      if (r.flags & GR_DBG_NEWLINE) out("\r\n", 2); // Same line ending as Serial.println()
+    }
+
+    GR_RingBuffer<GR_DebugRecord, Capacity> ring_;
+    Lock lock_;
+    std::atomic<uint32_t> dropped_{0};  // Written under the lock
+    uint32_t droppedReported_ = 0;  // Consumer only
+    bool midString_ = false;        // Consumer only
+};
@@ -0,0 +1,230 @@
+/*
+  GR_Estimator.h
+  Altitude / vertical velocity / vertical acceleration Kalman filter, plus the apogee and landing detection that runs off it.
+
+  State x = [h, v, a] (m, m/s, m/s^2, up is positive), constant acceleration model with white jerk process noise. The two
+  sensors are fused at their own rates: every measurement first predicts the state forward to its own timestamp, then does a
+  scalar update (both sensors measure one state directly, so there's no matrix inverse anywhere):
+    updateAccel(): a = specific force along the rocket's up axis - 1g    (1kHz)
+    updateBaro():  h = barometric altitude                               (~64Hz)
+  Everything is fixed size floats on the stack, no heap. The process noise matrix only depends on dt, so it's cached and only
+  recomputed when dt changes (the accelerometer's dt is nearly always the same).
+
+  Transonic pressure spikes are rejected by an innovation gate on the baro update (see Config::baroGate).
+
+  Part of the Graphite Flight Data Logger project, GPL-3.0 (see LICENSE)
+*/
+#pragma once
+#include <stdint.h>
+#include <math.h>
+
+#ifndef GR_GRAVITY
+  #define GR_GRAVITY 9.80665f  // m/s^2
+#endif
+
+class GR_AltitudeKF {
+  public:
+    struct Config {
+      float jerkNoise;   // Process noise: white jerk spectral density ((m/s^3)^2 / Hz). Bigger = trusts the model less
+      float accelNoise;  // Accelerometer measurement noise (m/s^2, 1 sigma)
+      float baroNoise;   // Barometric altitude measurement noise (m, 1 sigma)
+      float baroGate;    // Reject baro samples more than this many sigma from the prediction (0 = never reject)
+    };
+
+    static Config defaults() { return {100.0f, 3.0f, 0.5f, 6.0f}; }
+
+    GR_AltitudeKF(Config config = defaults()) : config_(config) { reset(); }
+
+    void setConfig(Config config) { config_ = config; cachedDt_ = -1; }
+    const Config& config() const { return config_; }
+
+    /// @brief Forget the state. The next baro sample re-initializes it
+    void reset() {
+      for (int i = 0; i < 3; i++) { x_[i] = 0; for (int j = 0; j < 3; j++) P_[i][j] = 0; }
+      init_ = false;
+      lastUs_ = 0;
+      cachedDt_ = -1;
+      baroRejects_ = 0;
+    }
+
+    /// @brief Pick the state back up after a stretch with no samples at all (a reset mid-flight, see GR_Resume.h): coasts the state from
+    ///        savedUs forward to nowUs under gravity alone, and widens the uncertainty enough to cover anything from 10g of thrust to
+    ///        the drag of a fast coast over that time, so the first baro samples after it aren't gated out
+    void restore(uint64_t savedUs, float altM, float velocity, uint64_t nowUs) {
+      reset();
+      float dt = nowUs > savedUs ? (nowUs - savedUs) * 1e-6f : 0;
+      x_[0] = altM + velocity * dt - 0.5f * GR_GRAVITY * dt * dt;
+      x_[1] = velocity - GR_GRAVITY * dt;
+      float velSigma = 2 + 10 * GR_GRAVITY * dt, altSigma = config_.baroNoise + velSigma * dt;
+      P_[0][0] = altSigma * altSigma; P_[1][1] = velSigma * velSigma; P_[2][2] = 10 * GR_GRAVITY * 10 * GR_GRAVITY;
+      lastUs_ = nowUs;
+      init_ = true;
+    }
+
+    /// @brief Feed one accelerometer sample
+    /// @param upAccel specific force along the up axis (m/s^2, reads +1g sitting on the pad). Gravity is taken out here
+    void updateAccel(uint64_t timeUs, float upAccel) {
+      if (!init_) return; // Need a baro sample to anchor the altitude first
+      predict(timeUs);
+      update(2, upAccel - GR_GRAVITY, config_.accelNoise * config_.accelNoise, 0);
+    }
+
+    /// @brief Feed one barometric altitude sample (m, any reference)
+    /// @return false if it was rejected by the innovation gate
+    bool updateBaro(uint64_t timeUs, float altM) {
+      if (!init_) {
+        x_[0] = altM; x_[1] = 0; x_[2] = 0;
+        P_[0][0] = config_.baroNoise * config_.baroNoise; P_[1][1] = 1; P_[2][2] = 1;
+        lastUs_ = timeUs;
+        init_ = true;
+        return true;
+      }
+      predict(timeUs);
+      if (!update(0, altM, config_.baroNoise * config_.baroNoise, config_.baroGate)) { baroRejects_++; return false; }
+      return true;
+    }
+
+    bool ready() const { return init_; }
+    float altitude() const { return x_[0]; }
+    float velocity() const { return x_[1]; }
+    float acceleration() const { return x_[2]; }
+    /// @brief 1 sigma uncertainty of the altitude / velocity estimate
+    float altitudeSigma() const { return sqrtf(P_[0][0]); }
+    float velocitySigma() const { return sqrtf(P_[1][1]); }
+    uint32_t baroRejects() const { return baroRejects_; }
+    uint64_t timeUs() const { return lastUs_; }
+
+  private:
+    /// @brief x = F x, P = F P F' + Q for dt since the last measurement
+    void predict(uint64_t timeUs) {
+      if (timeUs <= lastUs_) return; // Same timestamp (or out of order), nothing to predict
+      float dt = (timeUs - lastUs_) * 1e-6f;
+      lastUs_ = timeUs;
+      if (dt != cachedDt_) cacheQ(dt);
+      const float dt2 = halfDt2_;
+
+      x_[0] += x_[1] * dt + x_[2] * dt2;
+      x_[1] += x_[2] * dt;
+
+      // F P F' with F = [1 dt dt^2/2; 0 1 dt; 0 0 1], expanded by hand (FP first, then (FP) F')
+      float a[3][3];
+      for (int j = 0; j < 3; j++) {
+        a[0][j] = P_[0][j] + dt * P_[1][j] + dt2 * P_[2][j];
+        a[1][j] = P_[1][j] + dt * P_[2][j];
+        a[2][j] = P_[2][j];
+      }
+      for (int i = 0; i < 3; i++) {
+        P_[i][0] = a[i][0] + dt * a[i][1] + dt2 * a[i][2] + Q_[i][0];
+        P_[i][1] = a[i][1] + dt * a[i][2] + Q_[i][1];
+        P_[i][2] = a[i][2] + Q_[i][2];
+      }
+    }
+
+    /// @brief Scalar measurement of state i
+    /// @param gate reject if the innovation is more than gate sigma out (0 = off)
+    bool update(int i, float z, float r, float gate) {
+      float y = z - x_[i];
+      float s = P_[i][i] + r;
+      if (gate > 0 && y * y > gate * gate * s) return false;
+      float k[3] = {P_[0][i] / s, P_[1][i] / s, P_[2][i] / s};
+      for (int j = 0; j < 3; j++) x_[j] += k[j] * y;
+      float row[3] = {P_[i][0], P_[i][1], P_[i][2]};
+      for (int a = 0; a < 3; a++)
+        for (int b = a; b < 3; b++) P_[a][b] = P_[b][a] = P_[a][b] - k[a] * row[b]; // Keep P exactly symmetric
+      return true;
+    }
+
+    void cacheQ(float dt) {
+      float q = config_.jerkNoise, dt2 = dt * dt, dt3 = dt2 * dt;
+      Q_[0][0] = q * dt3 * dt2 / 20; Q_[0][1] = q * dt2 * dt2 / 8; Q_[0][2] = q * dt3 / 6;
+      Q_[1][1] = q * dt3 / 3;        Q_[1][2] = q * dt2 / 2;
+      Q_[2][2] = q * dt;
+      Q_[1][0] = Q_[0][1]; Q_[2][0] = Q_[0][2]; Q_[2][1] = Q_[1][2];
+      halfDt2_ = dt2 / 2;
+      cachedDt_ = dt;
+    }
+
+    Config config_;
+    float x_[3];
+    float P_[3][3];
+    float Q_[3][3];
+    float cachedDt_, halfDt2_;
+    uint64_t lastUs_;
+    bool init_;
+    uint32_t baroRejects_;
+};
+
+// Apogee + landing detection -----------------------------------------------------------------------------------------------------
+
+#define GR_FLIGHT_EVT_NONE   0
+#define GR_FLIGHT_EVT_APOGEE 1
+#define GR_FLIGHT_EVT_LANDED 2
+
+/// @brief Watches the filter after launch. Apogee = velocity stays <= 0 for apogeeSamples updates in a row (timestamped at the
+///        first one). Landed = |velocity| stays under landedSpeed for landedMs (timestamped at the start of that stretch)
+class GR_ApogeeLandingDetect {
+  public:
+    struct Config {
+      uint16_t apogeeSamples;  // Consecutive non-positive velocity estimates for apogee
+      uint32_t lockoutMs;      // No apogee decisions this soon after launch (motor burn + burnout transients)
+      float landedSpeed;       // |v| below this (m/s) counts as stopped
+      uint32_t landedMs;       // ...for this long
+    };
+
+    struct Event {
+      uint8_t type;            // GR_FLIGHT_EVT_*
+      uint64_t timeUs;         // When it happened (start of the run that confirmed it)
+      float altM;              // Filter altitude at that moment
+    };
+
+    static Config defaults() { return {20, 1500, 2.0f, 5000}; }
+
+    GR_ApogeeLandingDetect(Config config = defaults()) : config_(config) { reset(0); }
+
+    void setConfig(Config config) { config_ = config; }
+
+    /// @brief Start watching (call at launch / T0)
+    void reset(uint64_t launchUs) {
+      launchUs_ = launchUs;
+      apogee_ = landed_ = Event();
+      run_ = 0; runStartUs_ = 0; runAltM_ = 0;
+    }
+
+    /// @brief Pick up after a reset mid-flight (see GR_Resume.h) with the launch time and events from before it
+    void restore(uint64_t launchUs, const Event& apogee, const Event& landed) {
+      reset(launchUs);
+      apogee_ = apogee;
+      landed_ = landed;
+    }
+
+    /// @brief Feed the filter state after each update
+    /// @return the event this update confirmed (GR_FLIGHT_EVT_NONE most of the time)
+    uint8_t onEstimate(uint64_t timeUs, float altM, float velocity) {
+      if (landed_.type) return GR_FLIGHT_EVT_NONE;
+      if (!apogee_.type) {
+        if (timeUs - launchUs_ < uint64_t(config_.lockoutMs) * 1000) return GR_FLIGHT_EVT_NONE;
+        if (velocity > 0) { run_ = 0; return GR_FLIGHT_EVT_NONE; }
+        if (run_++ == 0) { runStartUs_ = timeUs; runAltM_ = altM; }
+        if (run_ < config_.apogeeSamples) return GR_FLIGHT_EVT_NONE;
+        apogee_ = {GR_FLIGHT_EVT_APOGEE, runStartUs_, runAltM_};
+        run_ = 0;
+        return GR_FLIGHT_EVT_APOGEE;
+      }
+      if (fabsf(velocity) >= config_.landedSpeed) { run_ = 0; return GR_FLIGHT_EVT_NONE; }
+      if (run_++ == 0) { runStartUs_ = timeUs; runAltM_ = altM; }
+      if (timeUs - runStartUs_ < uint64_t(config_.landedMs) * 1000) return GR_FLIGHT_EVT_NONE;
+      landed_ = {GR_FLIGHT_EVT_LANDED, runStartUs_, runAltM_};
+      return GR_FLIGHT_EVT_LANDED;
+    }
+
+    const Event& apogee() const { return apogee_; }
+    const Event& landed() const { return landed_; }
+
+  private:
+    Config config_;
+    uint64_t launchUs_;
+    Event apogee_, landed_;
+    uint32_t run_;
+    uint64_t runStartUs_;
+    float runAltM_;
+};
@@ -0,0 +1,105 @@
+/*
+  GR_Filter.h
+  Streaming decimating FIR low-pass filter (plus the helpers to design one).
+
+  Used on the accelerometer: the ADC runs continuously at several kHz per axis, and each axis goes through a GR_DecimatingFIR that
+  low-passes it (so motor vibration above the output Nyquist doesn't alias into the data) and drops the rate by Decimation.
+  The filter only does the multiply-accumulate on the samples it actually outputs, so it costs Taps MACs per *output* sample.
+
+  Checked against the logger's design (DC gain, symmetry, impulse response, attenuation where it aliases): tools/GraphiteFilterTest.cpp
+
+  Part of the Graphite Flight Data Logger project, GPL-3.0 (see LICENSE)
+*/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+namespace GR_FIR {
+
+  /// @brief Design a windowed-sinc (Blackman window) low-pass filter with unity DC gain. Not for the hot path; call once at startup
+  /// @param h output coefficients (taps of them)
+  /// @param taps filter length
+  /// @param cutoff cutoff frequency as a fraction of the input sample rate (0 - 0.5)
+  inline void designLowPass(float * h, size_t taps, float cutoff) {
+    const double pi = 3.14159265358979323846;
+    double mid = (taps - 1) / 2.0;
+    double sum = 0;
+    for (size_t i = 0; i < taps; i++) {
+      double n = i - mid;
+      double sinc = (n == 0) ? 2 * cutoff : sin(2 * pi * cutoff * n) / (pi * n);
+      double window = (taps == 1) ? 1 : 0.42 - 0.5 * cos(2 * pi * i / (taps - 1)) + 0.08 * cos(4 * pi * i / (taps - 1));
+      h[i] = float(sinc * window);
+      sum += h[i];
+    }
+    for (size_t i = 0; i < taps; i++) h[i] = float(h[i] / sum);
+  }
+
+  /// @brief Magnitude response of a filter at one frequency (fraction of the sample rate). For checking a design, not the hot path
+  inline float magnitude(const float * h, size_t taps, float freq) {
+    const double pi = 3.14159265358979323846;
+    double re = 0, im = 0;
+    for (size_t i = 0; i < taps; i++) {
+      re += h[i] * cos(2 * pi * freq * i);
+      im -= h[i] * sin(2 * pi * freq * i);
+    }
+    return float(sqrt(re * re + im * im));
+  }
+}
+
+/// @tparam Taps filter length
+/// @tparam Decimation output one sample for every Decimation input samples
+template <size_t Taps, size_t Decimation>
+class GR_DecimatingFIR {
+  static_assert(Taps > 0 && Decimation > 0, "GR_DecimatingFIR needs at least one tap and a decimation of at least 1");
+
+  public:
+    GR_DecimatingFIR() { for (size_t i = 0; i < Taps; i++) coeffs_[i] = (i == 0) ? 1.0f : 0.0f; reset(); }
+    explicit GR_DecimatingFIR(const float * h) { setCoeffs(h); }
+
+    /// @brief Load new coefficients (h[0] applies to the newest sample) and clear the history
+    void setCoeffs(const float * h) {
+      for (size_t i = 0; i < Taps; i++) coeffs_[i] = h[Taps - 1 - i]; // Stored reversed so the dot product walks oldest -> newest
+      reset();
+    }
+
+    /// @brief Clear the history (output ramps up from 0 again) and restart the decimation phase
+    void reset() {
+      for (size_t i = 0; i < 2 * Taps; i++) hist_[i] = 0;
+      pos_ = 0;
+      phase_ = 0;
+    }
+
+    /// @brief Clear the history to a constant value, so the output starts at that value instead of ramping up from 0
+    void prime(float x) {
+      for (size_t i = 0; i < 2 * Taps; i++) hist_[i] = x;
+      pos_ = 0;
+      phase_ = 0;
+    }
+
+    /// @brief Feed one input sample
+    /// @param out set to the new output sample when this returns true
+    /// @return true on every Decimation-th input (when an output sample is ready)
+    bool push(float x, float& out) {
+      // Each sample is stored twice, Taps apart, so the last Taps samples are always contiguous at hist_[pos_ .. pos_+Taps-1]
+      hist_[pos_] = x;
+      hist_[pos_ + Taps] = x;
+      if (++pos_ == Taps) pos_ = 0;
+      if (++phase_ < Decimation) return false;
+      phase_ = 0;
+      const float * w = hist_ + pos_;
+      float acc = 0;
+      for (size_t i = 0; i < Taps; i++) acc += coeffs_[i] * w[i];
+      out = acc;
+      return true;
+    }
+
+    /// @brief Delay through the filter, in input samples (linear phase filters only)
+    static constexpr float groupDelay() { return (Taps - 1) / 2.0f; }
+
+  private:
+    float coeffs_[Taps];
+    float hist_[2 * Taps];
+    size_t pos_;
+    size_t phase_;
+};
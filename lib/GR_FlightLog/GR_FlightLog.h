@@ -0,0 +1,332 @@
+/*
+  GR_FlightLog.h
+  Binary flight log format (version 2).
+
+  A log file is one GR_LogHeader followed by any number of fixed size GR_LogRecords. Everything is little-endian (which both the
+  ESP32 and any PC we'd decode on are, so structs are written / read as-is). Records are 32 bytes so 16 of them fit exactly in
+  one 512 byte SD sector.
+
+  Records only hold what the sensors actually measured (raw ADC counts, pressure, temperature); derived values like altitude,
+  g's, F/K and ft are recomputed by the decoder from the calibration constants stored in the header. That keeps float formatting
+  off the logger entirely.
+
+  Layout changes MUST bump GR_LOG_VERSION. Decoders check the version and use headerSize / recordSize from the header, so
+  fields can be appended to the end of either struct without breaking old decoders. New record types don't need a bump either:
+  decoders skip types they don't know.
+
+  Packed logs (version 2, packBlock != 0 in the header) hold the same records delta + varint coded into blocks instead, see
+  GR_LogPack.h; read them through GR_LogUnpacker there, which reads plain ones too. Plain logs are still written as version 1 (their
+  layout didn't change), so older decoders keep reading those and refuse the packed ones.
+
+  Right after the header come the settings the flight was flown with (GR_REC_CONFIG, one per number setting in the logger's config
+  registry, see GR_Config.h; the header says how many and which registry layout), then the samples and events.
+
+  Decoder: tools/GraphiteLogDecode.cpp. Round trip checks (records through formatCsv and back): tools/GraphiteFlightLogTest.cpp
+
+  Part of the Graphite Flight Data Logger project, GPL-3.0 (see LICENSE)
+*/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__)
+  #error "GR_FlightLog structs are written as-is and assume a little-endian machine"
+#endif
+
+#define GR_LOG_MAGIC "GRLG"
+#define GR_LOG_VERSION 2      // 2: packed logs (packBlock). Plain logs are written as version 1
+
+// Record types
+#define GR_REC_PAD    0  // All zeros: what GR_LogWriter fills the rest of a sector with when it syncs / closes part way through one. Skip it
+#define GR_REC_SAMPLE 1
+#define GR_REC_EVENT  2
+#define GR_REC_CONFIG 3
+
+// Sample record flags (which fields hold a new measurement in this record)
+#define GR_SAMPLE_ACCEL 0x01
+#define GR_SAMPLE_BARO  0x02
+#define GR_SAMPLE_BATT  0x04
+
+// Event codes
+#define GR_EVT_ARMED     1
+#define GR_EVT_DISARMED  2
+#define GR_EVT_LAUNCH    3
+#define GR_EVT_APOGEE    4
+#define GR_EVT_LANDED    5
+#define GR_EVT_SHUTDOWN  6
+#define GR_EVT_LOG_FULL  7
+#define GR_EVT_OVERFLOW  8   // iArg = number of records dropped
+#define GR_EVT_HISTORY   9   // Pre-launch history follows (iArg = number of records). Its timestamps go back before the records just ahead of it
+#define GR_EVT_RESUMED   10  // The logger reset mid-flight and carried on, in the same file if it could (iArg = reset reason,
+                             // esp_reset_reason_t on the logger; fArg = ms from boot to logging again). Whatever it had in RAM or hadn't
+                             // synced to the card before the reset is missing
+#define GR_EVT_PHASE     11  // Flight phase change (iArg = the new GR_PHASE_*, see GR_FlightPhase.h; fArg = seconds spent in the one before)
+#define GR_EVT_WALL_CLOCK 12 // Ties the log's clock to the date: at this record's time the wall clock (GMT) read exactly iArg seconds since
+                             // the epoch (good until 2038). fArg = 1 if it had been set from a phone, 0 if it's the power on default
+
+#pragma pack(push, 1)
+
+/// @brief File header. Calibration constants are copied in when the log is opened so the decoder can reproduce the logger's math
+struct GR_LogHeader {
+  char magic[4];          // GR_LOG_MAGIC
+  uint16_t version;       // GR_LOG_VERSION
+  uint16_t headerSize;    // sizeof(GR_LogHeader)
+  uint16_t recordSize;    // sizeof(GR_LogRecord)
+  uint16_t packBlock;     // Records are packed into blocks of this many bytes (GR_LogPack.h); 0 = plain records. Version 2+
+  uint64_t startUs;       // Logger micros() when the log was opened
+  float cal_pAtSea;       // Sea level pressure (Pa)
+  float cal_lapseRate;    // Temperature lapse rate
+  float cal_magicExp;     // Barometric formula exponent
+  int16_t cal_zeroXAccel; // Accelerometer zero points (raw ADC counts)
+  int16_t cal_zeroYAccel;
+  int16_t cal_zeroZAccel;
+  int16_t reserved1;
+  float cal_xAccelCoef;   // Accelerometer raw to g coefficients
+  float cal_yAccelCoef;
+  float cal_zAccelCoef;
+  uint32_t configSchema;  // GR_Config::schemaHash() of the logger's settings (0 in logs from before config records)
+  uint16_t configCount;   // GR_REC_CONFIG records after the header
+  uint8_t reserved2[6];   // Pads the header to 64 bytes
+};
+
+/// @brief One log entry. type selects which member of the union is valid
+struct GR_LogRecord {
+  uint64_t timeUs;        // Logger micros() when the data was acquired
+  uint8_t type;           // GR_REC_*
+  uint8_t flags;          // GR_SAMPLE_* for sample records
+  union {
+    struct {
+      uint16_t xAccel, yAccel, zAccel;  // Raw ADXL377 ADC counts
+      float pressPa;                    // DPS310 pressure (Pa)
+      float tempC;                      // DPS310 temperature (C)
+      uint16_t battRaw;                 // Raw battery divider ADC counts
+      uint8_t reserved[6];
+    } sample;
+    struct {
+      uint16_t code;                    // GR_EVT_*
+      uint16_t reserved0;
+      int32_t iArg;                     // Event specific
+      float fArg;                       // Event specific
+      uint8_t reserved[10];
+    } event;
+    struct {
+      char key[16];                     // Setting name (terminated unless it's all 16 chars)
+      uint8_t isFloat;                  // 1: fValue, 0: iValue
+      uint8_t reserved;
+      union {
+        int32_t iValue;
+        float fValue;
+      };
+    } config;
+  };
+};
+
+#pragma pack(pop)
+
+static_assert(sizeof(GR_LogHeader) == 64, "GR_LogHeader layout changed; bump GR_LOG_VERSION and fix the size");
+static_assert(sizeof(GR_LogRecord) == 32, "GR_LogRecord layout changed; bump GR_LOG_VERSION and fix the size");
+
+namespace GR_FlightLog {
+
+  /// @brief Fill in a header (magic / version / sizes); the caller sets the calibration constants
+  /// @param packBlock GR_PACK_BLOCK for a packed log, 0 for plain records
+  inline GR_LogHeader makeHeader(uint64_t startUs, uint16_t packBlock = 0) {
+    GR_LogHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, GR_LOG_MAGIC, 4);
+    h.version = packBlock ? GR_LOG_VERSION : 1;
+    h.packBlock = packBlock;
+    h.headerSize = sizeof(GR_LogHeader);
+    h.recordSize = sizeof(GR_LogRecord);
+    h.startUs = startUs;
+    return h;
+  }
+
+  /// @brief Check a header read back from a file
+  /// @return false if it isn't a Graphite log, or it's a version / layout we can't read
+  inline bool checkHeader(const GR_LogHeader& h) {
+    if (memcmp(h.magic, GR_LOG_MAGIC, 4) != 0) return false;
+    if (h.version == 0 || h.version > GR_LOG_VERSION) return false;
+    if (h.packBlock && (h.version < 2 || h.packBlock < 2 * sizeof(GR_LogRecord))) return false; // Room for a block header (32) and then some
+    return h.headerSize >= sizeof(GR_LogHeader) && h.recordSize >= sizeof(GR_LogRecord);
+  }
+
+  inline GR_LogRecord makeSample(uint64_t timeUs, uint8_t flags, uint16_t x, uint16_t y, uint16_t z, float pressPa, float tempC, uint16_t battRaw) {
+    GR_LogRecord r;
+    memset(&r, 0, sizeof(r));
+    r.timeUs = timeUs;
+    r.type = GR_REC_SAMPLE;
+    r.flags = flags;
+    r.sample.xAccel = x; r.sample.yAccel = y; r.sample.zAccel = z;
+    r.sample.pressPa = pressPa;
+    r.sample.tempC = tempC;
+    r.sample.battRaw = battRaw;
+    return r;
+  }
+
+  inline GR_LogRecord makeEvent(uint64_t timeUs, uint16_t code, int32_t iArg = 0, float fArg = 0) {
+    GR_LogRecord r;
+    memset(&r, 0, sizeof(r));
+    r.timeUs = timeUs;
+    r.type = GR_REC_EVENT;
+    r.event.code = code;
+    r.event.iArg = iArg;
+    r.event.fArg = fArg;
+    return r;
+  }
+
+  /// @brief A GR_EVT_WALL_CLOCK event, stamped at the last whole wall clock second at or before nowUs
+  /// @param wallOffsetUs wall clock (us since the epoch) minus logger micros()
+  inline GR_LogRecord makeWallClock(uint64_t nowUs, int64_t wallOffsetUs, bool synced) {
+    int64_t s = (int64_t(nowUs) + wallOffsetUs) / 1000000;
+    return makeEvent(uint64_t(s * 1000000 - wallOffsetUs), GR_EVT_WALL_CLOCK, int32_t(s), synced ? 1.0f : 0.0f);
+  }
+
+  inline GR_LogRecord makeConfig(uint64_t timeUs, const char * key, bool isFloat, int32_t iValue, float fValue) {
+    GR_LogRecord r;
+    memset(&r, 0, sizeof(r));
+    r.timeUs = timeUs;
+    r.type = GR_REC_CONFIG;
+    memcpy(r.config.key, key, strnlen(key, sizeof(r.config.key)));
+    r.config.isFloat = isFloat;
+    if (isFloat) r.config.fValue = fValue;
+    else r.config.iValue = iValue;
+    return r;
+  }
+
+  /// @brief A config record's key as a terminated string
+  inline void configKey(const GR_LogRecord& r, char (&out)[sizeof(GR_LogRecord::config.key) + 1]) {
+    memcpy(out, r.config.key, sizeof(r.config.key));
+    out[sizeof(r.config.key)] = 0;
+  }
+
+  inline const char * eventName(uint16_t code) {
+    switch (code) {
+      case GR_EVT_ARMED:    return "armed";
+      case GR_EVT_DISARMED: return "disarmed";
+      case GR_EVT_LAUNCH:   return "launch";
+      case GR_EVT_APOGEE:   return "apogee";
+      case GR_EVT_LANDED:   return "landed";
+      case GR_EVT_SHUTDOWN: return "shutdown";
+      case GR_EVT_LOG_FULL: return "log_full";
+      case GR_EVT_OVERFLOW: return "overflow";
+      case GR_EVT_HISTORY:  return "history";
+      case GR_EVT_RESUMED:  return "resumed";
+      case GR_EVT_PHASE:    return "phase";
+      case GR_EVT_WALL_CLOCK: return "wall_clock";
+      default:              return "unknown";
+    }
+  }
+
+  // Derived values (same math as the logger, see the altitude calculation notes in main.cpp) ---------------------------------
+
+  inline float altitudeM(const GR_LogHeader& h, float pressPa, float tempC) {
+    return (powf(h.cal_pAtSea / pressPa, h.cal_magicExp) - 1) * (tempC + 273.15f) / h.cal_lapseRate;
+  }
+
+  inline float accelG(float raw, int16_t zero, float coef) { return (raw - zero) * coef; }
+
+  // CSV formatting -------------------------------------------------------------------------------------------------------------
+  // Hand rolled instead of snprintf so decoding runs at disk speed (and so the logger can stream CSV without pulling in printf)
+
+  /// @brief Write an unsigned integer. Returns pointer past the last char written
+  inline char * putU64(char * p, uint64_t v) {
+    char tmp[20]; int n = 0;
+    do { tmp[n++] = char('0' + v % 10); v /= 10; } while (v);
+    while (n) *p++ = tmp[--n];
+    return p;
+  }
+
+  inline char * putI64(char * p, int64_t v) {
+    if (v < 0) { *p++ = '-'; return putU64(p, uint64_t(-(v + 1)) + 1); }
+    return putU64(p, uint64_t(v));
+  }
+
+  /// @brief Write a float with a fixed number of decimals (0-6). NaN / inf are written as "nan"
+  inline char * putFixed(char * p, float v, int decimals) {
+    static const uint32_t pow10[] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+    if (v != v || v > 9e15f || v < -9e15f) { memcpy(p, "nan", 3); return p + 3; }
+    if (decimals < 0) decimals = 0;
+    if (decimals > 6) decimals = 6;
+    int64_t scaled = llroundf(v * pow10[decimals]);  // Note: float has ~7 significant digits, more decimals than that is noise anyway
+    if (scaled < 0) { *p++ = '-'; scaled = -scaled; }
+    p = putU64(p, uint64_t(scaled) / pow10[decimals]);
+    if (decimals) {
+      *p++ = '.';
+      uint32_t frac = uint32_t(uint64_t(scaled) % pow10[decimals]);
+      for (int i = decimals - 1; i >= 0; i--) { p[i] = char('0' + frac % 10); frac /= 10; }
+      p += decimals;
+    }
+    return p;
+  }
+
+  /// @brief CSV header line matching formatCsv()
+  inline const char * csvHeader() {
+    return "time_s,type,xAccelRaw,yAccelRaw,zAccelRaw,xAccelG,yAccelG,zAccelG,pressPa,tempC,altM,altFt,battRaw,event,eventArg\n";
+  }
+
+  /// @brief Longest line formatCsv() can produce
+  #define GR_LOG_CSV_MAX_LINE 256
+
+  /// @brief Format one record as a CSV line (time relative to the header's startUs)
+  /// @param out buffer of at least GR_LOG_CSV_MAX_LINE chars
+  /// @return number of chars written (0 for GR_REC_PAD and record types we don't know, which should be skipped)
+  inline size_t formatCsv(const GR_LogHeader& h, const GR_LogRecord& r, char * out) {
+    char * p = out;
+    int64_t relUs = int64_t(r.timeUs - h.startUs);
+    if (relUs < 0 && relUs > -1000000) *p++ = '-'; // -0.5s would otherwise come out as 0.500000
+    p = putI64(p, relUs / 1000000); *p++ = '.';
+    int64_t fracUs = relUs % 1000000; if (fracUs < 0) fracUs = -fracUs;
+    for (int i = 5; i >= 0; i--) { p[i] = char('0' + fracUs % 10); fracUs /= 10; }
+    p += 6; *p++ = ',';
+
+    if (r.type == GR_REC_SAMPLE) {
+      memcpy(p, "sample,", 7); p += 7;
+      if (r.flags & GR_SAMPLE_ACCEL) {
+        p = putU64(p, r.sample.xAccel); *p++ = ',';
+        p = putU64(p, r.sample.yAccel); *p++ = ',';
+        p = putU64(p, r.sample.zAccel); *p++ = ',';
+        p = putFixed(p, accelG(r.sample.xAccel, h.cal_zeroXAccel, h.cal_xAccelCoef), 3); *p++ = ',';
+        p = putFixed(p, accelG(r.sample.yAccel, h.cal_zeroYAccel, h.cal_yAccelCoef), 3); *p++ = ',';
+        p = putFixed(p, accelG(r.sample.zAccel, h.cal_zeroZAccel, h.cal_zAccelCoef), 3); *p++ = ',';
+      } else {
+        memcpy(p, ",,,,,,", 6); p += 6;
+      }
+      if (r.flags & GR_SAMPLE_BARO) {
+        float altM = altitudeM(h, r.sample.pressPa, r.sample.tempC);
+        p = putFixed(p, r.sample.pressPa, 2); *p++ = ',';
+        p = putFixed(p, r.sample.tempC, 2); *p++ = ',';
+        p = putFixed(p, altM, 2); *p++ = ',';
+        p = putFixed(p, altM * 3.280839895f, 2); *p++ = ',';
+      } else {
+        memcpy(p, ",,,,", 4); p += 4;
+      }
+      if (r.flags & GR_SAMPLE_BATT) p = putU64(p, r.sample.battRaw);
+      memcpy(p, ",,\n", 3); p += 3;
+    } else if (r.type == GR_REC_EVENT) {
+      memcpy(p, "event,,,,,,,,,,,,", 17); p += 17;
+      const char * name = eventName(r.event.code);
+      size_t len = strlen(name);
+      memcpy(p, name, len); p += len; *p++ = ',';
+      p = putI64(p, r.event.iArg); *p++ = '\n';
+    } else if (r.type == GR_REC_CONFIG) { // Key + value in the event columns
+      memcpy(p, "config,,,,,,,,,,,,", 18); p += 18;
+      char key[sizeof(r.config.key) + 1];
+      configKey(r, key);
+      size_t len = strlen(key);
+      memcpy(p, key, len); p += len; *p++ = ',';
+      if (r.config.isFloat) { // ~7 significant digits, which is all a float has
+        float mag = fabsf(r.config.fValue);
+        p = putFixed(p, r.config.fValue, mag >= 1e5f ? 1 : mag >= 1e4f ? 2 : mag >= 1e3f ? 3 : mag >= 100 ? 4 : mag >= 10 ? 5 : 6);
+      } else {
+        p = putI64(p, r.config.iValue);
+      }
+      *p++ = '\n';
+    } else {
+      return 0;
+    }
+    return size_t(p - out);
+  }
+}
@@ -0,0 +1,314 @@
+/*
+  GR_LogPack.h
+  Packed flight logs: the same GR_LogRecords, delta + varint coded so a full rate flight takes a fraction of the card (and of the
+  download). Optional; the logger packs when the log_pack setting is on.
+
+  A packed log (header packBlock != 0) is the GR_LogHeader, zeros up to the first packBlock boundary, then blocks of packBlock bytes
+  (GR_PACK_BLOCK = one SD sector on the logger, so a block never straddles a resume point). Each block starts with a GR_PackBlock
+  header, which doubles as a keyframe: it holds the time and every sample field as they were just before the block's first record,
+  and each record in the block is coded against the one before it. So any block can be decoded on its own (seek to dataStart() + k *
+  packBlock), nothing's lost past a bad block, and a reader can find a time from the block headers alone.
+
+  Records in a block, one after the other until `records` of them (the rest of the block is zeros):
+    tag 0x80 | flags | GR_PACK_D*    Sample record: flags are its GR_SAMPLE_* bits. Then the time, then a delta for each field the tag
+                                     says changed, in this order: x, y, z (one bit for all three), pressure, temperature, battery
+    tag GR_PACK_TAG_RECORD           Anything else (events, settings, samples with flags or reserved bytes we don't code): the
+                                     GR_LogRecord as-is, 32 bytes. Only its time is carried on to the next record
+  Times are the zigzag varint of (this record's time - the last one's), so the pre-launch history going back in time costs a few bytes
+  once. Sample fields are zigzag varint deltas of the raw counts, and of pressure + temperature's float bit patterns (exact, and
+  small between readings close together). A field that didn't change takes nothing, so the repeated baro / battery values riding
+  along on the 1kHz accelerometer records are free. Decoding gives back exactly the records that went in (reserved bytes are zero).
+
+  Packing one record is a fixed amount of work and at most GR_PACK_MAX_RECORD bytes, plus a block handed back every so often; no
+  loops that depend on the data. The decoder checks every length against the block, so garbage reads as a short block, not a crash.
+
+  Decoder: tools/GraphiteLogDecode.cpp (and everything else that reads logs, through GR_LogUnpacker). tools/GraphiteLogPack.cpp packs
+  and unpacks existing logs and reports the ratio + speed.
+
+  Part of the Graphite Flight Data Logger project, GPL-3.0 (see LICENSE)
+*/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "GR_FlightLog.h"
+
+#define GR_PACK_BLOCK 512       // Block size the logger packs into (what a log used is in its header)
+#define GR_PACK_MAGIC "GP"
+#define GR_PACK_MAX_RECORD 33   // Most bytes one packed record takes (a verbatim one: tag + 32; a sample is at most 1+10+3*3+5+5+3)
+
+// Tags
+#define GR_PACK_TAG_END    0x00 // Nothing more in the block (what the zero padding reads as)
+#define GR_PACK_TAG_RECORD 0x01 // A GR_LogRecord follows as-is
+#define GR_PACK_TAG_SAMPLE 0x80 // | the record's GR_SAMPLE_* flags | which fields have a delta:
+#define GR_PACK_DACCEL     0x08 //   x, y, z
+#define GR_PACK_DPRESS     0x10 //   pressure
+#define GR_PACK_DTEMP      0x20 //   temperature
+#define GR_PACK_DBATT      0x40 //   battery
+
+#pragma pack(push, 1)
+
+/// @brief Start of every block: how much is in it, plus the keyframe its first record is coded against
+struct GR_PackBlock {
+  char magic[2];          // GR_PACK_MAGIC
+  uint16_t records;       // Records in this block
+  uint16_t bytes;         // Header + packed records (the rest of the block is zeros)
+  uint16_t reserved;
+  uint64_t timeUs;        // Time of the record before this block's first one (0 at the start of a log)
+  uint16_t xAccel, yAccel, zAccel, battRaw; // Latest sample fields, as of that record
+  float pressPa, tempC;
+};
+
+#pragma pack(pop)
+
+static_assert(sizeof(GR_PackBlock) == 32, "GR_PackBlock layout changed; that's a new log version");
+
+#define GR_PACK_MIN_RECORDS ((GR_PACK_BLOCK - sizeof(GR_PackBlock)) / GR_PACK_MAX_RECORD) // Fewest records a block can hold (14)
+
+namespace GR_LogPack {
+
+  /// @brief Where the records (plain logs) or blocks (packed) start in a log file
+  inline uint64_t dataStart(const GR_LogHeader& h) {
+    return h.packBlock ? (uint64_t(h.headerSize) + h.packBlock - 1) / h.packBlock * h.packBlock : h.headerSize;
+  }
+
+  /// @brief What a log is read in: a record (plain logs) or a block (packed). GR_LogUnpacker takes one at a time
+  inline size_t unitBytes(const GR_LogHeader& h) { return h.packBlock ? h.packBlock : h.recordSize; }
+
+  inline uint64_t zigzag(int64_t v) { return (uint64_t(v) << 1) ^ uint64_t(v >> 63); }
+  inline int64_t unzigzag(uint64_t v) { return int64_t(v >> 1) ^ -int64_t(v & 1); }
+
+  /// @brief Write v 7 bits at a time, low bits first (at most 10 bytes). Returns pointer past the last byte written
+  inline uint8_t * putVarint(uint8_t * p, uint64_t v) {
+    while (v >= 0x80) { *p++ = uint8_t(v) | 0x80; v >>= 7; }
+    *p++ = uint8_t(v);
+    return p;
+  }
+
+  /// @brief Read a putVarint() value, not past end
+  /// @return false if it runs past end or is longer than a uint64_t
+  inline bool getVarint(const uint8_t *& p, const uint8_t * end, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      if (p >= end) return false;
+      uint8_t b = *p++;
+      v |= uint64_t(b & 0x7f) << shift;
+      if (!(b & 0x80)) return true;
+    }
+    return false;
+  }
+
+  /// @brief The sample fields records are coded against (floats as their bit patterns, which is what the deltas are of)
+  struct State {
+    uint64_t timeUs;
+    uint16_t x, y, z, batt;
+    uint32_t press, temp;
+
+    void reset() { memset(this, 0, sizeof(*this)); }
+    void toBlock(GR_PackBlock& b) const {
+      b.timeUs = timeUs;
+      b.xAccel = x; b.yAccel = y; b.zAccel = z; b.battRaw = batt;
+      memcpy(&b.pressPa, &press, 4); memcpy(&b.tempC, &temp, 4);
+    }
+    void fromBlock(const GR_PackBlock& b) {
+      timeUs = b.timeUs;
+      x = b.xAccel; y = b.yAccel; z = b.zAccel; batt = b.battRaw;
+      memcpy(&press, &b.pressPa, 4); memcpy(&temp, &b.tempC, 4);
+    }
+  };
+}
+
+/// @brief Packs records into blocks. Not thread safe; one per log, on the task that appends to it
+class GR_LogPacker {
+  public:
+    struct Stats {
+      uint32_t records;   // Records packed
+      uint32_t verbatim;  // ...of which went in as-is (GR_PACK_TAG_RECORD)
+      uint32_t blocks;    // Blocks handed back
+    };
+
+    /// @brief Start a new log (or carry on after a resume, at a block boundary): empty block, everything coded from zero
+    void reset() {
+      state_.reset();
+      cur_ = 0;
+      used_ = 0;
+      records_ = 0;
+      stats_ = Stats();
+    }
+
+    /// @brief Pack a record
+    /// @return a finished block (GR_PACK_BLOCK bytes) to write out, when r didn't fit in the one being packed (r starts the next
+    ///         one); NULL otherwise. It stays valid until the next block is handed back
+    const uint8_t * add(const GR_LogRecord& r) {
+      uint8_t tmp[GR_PACK_MAX_RECORD];
+      GR_LogPack::State before = state_;
+      size_t len = encode(r, tmp);
+      const uint8_t * done = NULL;
+      if (records_ && used_ + len > GR_PACK_BLOCK) done = finish();
+      if (!records_) start(before);
+      memcpy(block_[cur_] + used_, tmp, len);
+      used_ += len;
+      records_++;
+      stats_.records++;
+      return done;
+    }
+
+    /// @brief Finish the block being packed early (closing the log)
+    /// @return it (zero padded to GR_PACK_BLOCK bytes), or NULL if it's empty
+    const uint8_t * flush() { return records_ ? finish() : NULL; }
+
+    /// @brief True if there are records in the block being packed (they're in the file once that block is)
+    bool pending() const { return records_ != 0; }
+
+    /// @brief How many records add() can take for sure with only bytes of room for the blocks it hands back
+    static size_t recordsFor(size_t bytes) {
+      return bytes < GR_PACK_BLOCK ? 0 : (bytes / GR_PACK_BLOCK - 1) * GR_PACK_MIN_RECORDS + 1;
+    }
+
+    const Stats& stats() const { return stats_; }
+
+  private:
+    /// @brief Code r against state_ (and move state_ on to it)
+    size_t encode(const GR_LogRecord& r, uint8_t * out) {
+      static const uint8_t zeros[sizeof(r.sample.reserved)] = {};
+      GR_LogPack::State& s = state_;
+      uint8_t * p = out + 1;
+      if (r.type != GR_REC_SAMPLE || (r.flags & ~(GR_SAMPLE_ACCEL | GR_SAMPLE_BARO | GR_SAMPLE_BATT)) ||
+          memcmp(r.sample.reserved, zeros, sizeof(zeros)) != 0) {
+        out[0] = GR_PACK_TAG_RECORD;
+        memcpy(p, &r, sizeof(r));
+        s.timeUs = r.timeUs;
+        stats_.verbatim++;
+        return 1 + sizeof(r);
+      }
+      uint32_t press, temp;
+      memcpy(&press, &r.sample.pressPa, 4);
+      memcpy(&temp, &r.sample.tempC, 4);
+      uint8_t tag = GR_PACK_TAG_SAMPLE | r.flags;
+      p = GR_LogPack::putVarint(p, GR_LogPack::zigzag(int64_t(r.timeUs - s.timeUs)));
+      if (r.sample.xAccel != s.x || r.sample.yAccel != s.y || r.sample.zAccel != s.z) {
+        tag |= GR_PACK_DACCEL;
+        p = GR_LogPack::putVarint(p, GR_LogPack::zigzag(int32_t(r.sample.xAccel) - s.x));
+        p = GR_LogPack::putVarint(p, GR_LogPack::zigzag(int32_t(r.sample.yAccel) - s.y));
+        p = GR_LogPack::putVarint(p, GR_LogPack::zigzag(int32_t(r.sample.zAccel) - s.z));
+      }
+      if (press != s.press) { tag |= GR_PACK_DPRESS; p = GR_LogPack::putVarint(p, GR_LogPack::zigzag(int32_t(press - s.press))); }
+      if (temp != s.temp) { tag |= GR_PACK_DTEMP; p = GR_LogPack::putVarint(p, GR_LogPack::zigzag(int32_t(temp - s.temp))); }
+      if (r.sample.battRaw != s.batt) { tag |= GR_PACK_DBATT; p = GR_LogPack::putVarint(p, GR_LogPack::zigzag(int32_t(r.sample.battRaw) - s.batt)); }
+      out[0] = tag;
+      s.timeUs = r.timeUs;
+      s.x = r.sample.xAccel; s.y = r.sample.yAccel; s.z = r.sample.zAccel; s.batt = r.sample.battRaw;
+      s.press = press; s.temp = temp;
+      return size_t(p - out);
+    }
+
+    /// @brief New block, keyframed from the state its first record was coded against
+    void start(const GR_LogPack::State& key) {
+      memset(block_[cur_], 0, GR_PACK_BLOCK);
+      GR_PackBlock& b = header();
+      memcpy(b.magic, GR_PACK_MAGIC, 2);
+      key.toBlock(b);
+      used_ = sizeof(GR_PackBlock);
+    }
+
+    const uint8_t * finish() {
+      GR_PackBlock& b = header();
+      b.records = uint16_t(records_);
+      b.bytes = uint16_t(used_);
+      const uint8_t * done = block_[cur_];
+      cur_ ^= 1;
+      used_ = 0;
+      records_ = 0;
+      stats_.blocks++;
+      return done;
+    }
+
+    GR_PackBlock& header() { return *reinterpret_cast<GR_PackBlock *>(block_[cur_]); }
+
+    alignas(4) uint8_t block_[2][GR_PACK_BLOCK]; // The one being packed + the last one handed back
+    int cur_ = 0;
+    size_t used_ = 0, records_ = 0;
+    GR_LogPack::State state_ = {};
+    Stats stats_ = {};
+};
+
+/// @brief Reads the records back out of a log, one unit (GR_LogPack::unitBytes()) at a time, packed or not:
+///
+///    GR_LogUnpacker u;
+///    for each unit from GR_LogPack::dataStart(h) on:
+///      if (u.begin(h, unit)) while (u.next(r)) ...
+///
+///  Plain logs' units are single records, which come straight back out (type 0 padding included; skip types you don't know)
+class GR_LogUnpacker {
+  public:
+    /// @brief Start on a unit. unit must stay put until the last next()
+    /// @return false if there's nothing in it to read (a packed block that's zeros, or isn't a block at all)
+    bool begin(const GR_LogHeader& h, const uint8_t * unit) {
+      left_ = 0;
+      if (!h.packBlock) {
+        memcpy(&single_, unit, sizeof(single_)); // recordSize may be bigger than ours if a newer logger appended fields
+        left_ = 1;
+        p_ = NULL;
+        return true;
+      }
+      GR_PackBlock b;
+      memcpy(&b, unit, sizeof(b));
+      if (memcmp(b.magic, GR_PACK_MAGIC, 2) != 0 || b.bytes < sizeof(b) || b.bytes > h.packBlock) return false;
+      state_.fromBlock(b);
+      p_ = unit + sizeof(b);
+      end_ = unit + b.bytes;
+      left_ = b.records;
+      return left_ != 0;
+    }
+
+    /// @brief The next record in the unit
+    /// @return false once they're all out (or the rest of the block doesn't make sense)
+    bool next(GR_LogRecord& r) {
+      if (!left_) return false;
+      left_--;
+      if (!p_) { r = single_; return true; }
+      if (!decode(r)) { left_ = 0; return false; }
+      return true;
+    }
+
+    /// @brief Drop whatever's left of the unit (next() returns false until the next begin())
+    void clear() { left_ = 0; }
+
+  private:
+    bool decode(GR_LogRecord& r) {
+      GR_LogPack::State& s = state_;
+      if (p_ >= end_) return false;
+      uint8_t tag = *p_++;
+      if (tag == GR_PACK_TAG_RECORD) {
+        if (end_ - p_ < ptrdiff_t(sizeof(r))) return false;
+        memcpy(&r, p_, sizeof(r));
+        p_ += sizeof(r);
+        s.timeUs = r.timeUs;
+        return true;
+      }
+      if (!(tag & GR_PACK_TAG_SAMPLE)) return false; // GR_PACK_TAG_END, or something a newer logger wrote
+      uint64_t v;
+      if (!GR_LogPack::getVarint(p_, end_, v)) return false;
+      s.timeUs += uint64_t(GR_LogPack::unzigzag(v));
+      if (tag & GR_PACK_DACCEL) {
+        uint16_t * axis[3] = {&s.x, &s.y, &s.z};
+        for (uint16_t * a : axis) {
+          if (!GR_LogPack::getVarint(p_, end_, v)) return false;
+          *a = uint16_t(*a + GR_LogPack::unzigzag(v));
+        }
+      }
+      if (tag & GR_PACK_DPRESS) { if (!GR_LogPack::getVarint(p_, end_, v)) return false; s.press += uint32_t(GR_LogPack::unzigzag(v)); }
+      if (tag & GR_PACK_DTEMP) { if (!GR_LogPack::getVarint(p_, end_, v)) return false; s.temp += uint32_t(GR_LogPack::unzigzag(v)); }
+      if (tag & GR_PACK_DBATT) { if (!GR_LogPack::getVarint(p_, end_, v)) return false; s.batt = uint16_t(s.batt + GR_LogPack::unzigzag(v)); }
+      float pressPa, tempC;
+      memcpy(&pressPa, &s.press, 4);
+      memcpy(&tempC, &s.temp, 4);
+      r = GR_FlightLog::makeSample(s.timeUs, tag & (GR_SAMPLE_ACCEL | GR_SAMPLE_BARO | GR_SAMPLE_BATT), s.x, s.y, s.z, pressPa, tempC, s.batt);
+      return true;
+    }
+
+    GR_LogRecord single_;
+    GR_LogPack::State state_ = {};
+    const uint8_t * p_ = NULL, * end_ = NULL;
+    size_t left_ = 0;
+};
@@ -0,0 +1,195 @@
+/*
+  GR_FlightPhase.h
+  Flight phase state machine: which part of the flight we're in, and what the logger should be doing about it (how often each
+  sensor's read, what goes in the log and how often, radio + CPU). The flags the logger already keeps drive it:
+
+    IDLE ---armed---> ARMED ---launched---> BOOST ---burnout---> COAST ---apogee---> DESCENT ---landed---> LANDED ---tailMs---> SHUTDOWN
+      ^                                                                                                                            |
+      +------------------------------------------------ disarmed (from anywhere) -------------------------------------------------+
+
+  Burnout is the only one it decides itself: the filter's vertical acceleration (GR_AltitudeKF::acceleration(), gravity taken out)
+  at or below burnoutMs2 for burnoutMs, or boostMaxMs after launch, whichever comes first. A flag that skips ahead (apogee before
+  burnout was seen) skips the phases in between; nothing goes backwards short of disarming.
+
+  update() is called from one task with a clock and the flags, so the whole thing runs on a host with a simulated clock (see
+  tools/GraphiteFlightPhaseTest.cpp). Each call makes at most one transition, and says so, for the caller to log (GR_EVT_PHASE).
+  settings() hands back the current phase's entry in the config table; its address only changes on a transition, so another task
+  can be handed the pointer and pick the change up on its next look (see io_phaseSettings in main.cpp).
+
+  Part of the Graphite Flight Data Logger project, GPL-3.0 (see LICENSE)
+*/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <GR_Sampler.h>
+#include <GR_FlightLog.h>
+
+// Phases (also logged as the iArg of the GR_EVT_PHASE event)
+#define GR_PHASE_IDLE     0  // Disarmed
+#define GR_PHASE_ARMED    1  // On the pad, waiting for launch
+#define GR_PHASE_BOOST    2  // Launch to burnout
+#define GR_PHASE_COAST    3  // Burnout to apogee
+#define GR_PHASE_DESCENT  4  // Apogee to landing
+#define GR_PHASE_LANDED   5  // Landed, logging the tail end
+#define GR_PHASE_SHUTDOWN 6  // Tail's done, log closed
+#define GR_PHASE_COUNT    7
+
+// GR_PhaseSettings::radio
+#define GR_RADIO_OFF 0   // WiFi stopped (the AP comes back when a phase wants it on)
+#define GR_RADIO_LOW 1   // Lowest Tx power (phones within a few metres still get the status page)
+#define GR_RADIO_ON  2   // Tx power from the config (wi_power)
+
+/// @brief What the logger does in one phase
+struct GR_PhaseSettings {
+  GR_Sampler::Rates rates;  // Sensor read + log tick periods. Log ticks make the averaged records (status page, and the log while rawEvery is 0)
+  uint16_t rawEvery;        // Log every rawEvery'th full rate record (1 = all, 1kHz); ones with a baro or battery reading are always kept.
+                            // 0 = log the averaged records instead
+  uint8_t radio;            // GR_RADIO_*
+  uint16_t cpuMHz;          // CPU clock (0 = leave it alone; the logger won't go below 80, see io_applyPower())
+};
+
+class GR_FlightPhase {
+  public:
+    struct Config {
+      GR_PhaseSettings phases[GR_PHASE_COUNT];  // Indexed by GR_PHASE_*
+      float burnoutMs2;     // Filter vertical acceleration (m/s^2, gravity taken out) at or below this means the motor's out...
+      uint32_t burnoutMs;   // ...once it's stayed there this long
+      uint32_t boostMaxMs;  // Coast after this long whatever the acceleration says (longer than any motor we'd fly)
+      uint32_t tailMs;      // Landed -> shutdown
+    };
+
+    /// @brief What drives it: the logger's flags, and the filter's vertical acceleration
+    struct Inputs {
+      bool armed, launched, apogee, landed;
+      float accelMs2;
+    };
+
+    /// @brief One phase change (update()'s return)
+    struct Transition {
+      uint8_t from, to;     // GR_PHASE_*
+      uint64_t timeUs;      // When
+      uint64_t inPhaseUs;   // How long it had been in the one it left
+    };
+
+    /// @brief Full rates whenever armed (launch detection + the pre-launch history need every sample), the log at 10Hz on the pad
+    ///        and after landing and at 1kHz in the air (500Hz under the chute), radio turned down in flight, 60s tail, 80MHz once
+    ///        it's all over. The accelerometer period stays at 5ms throughout: on the logger that's how often the ADC's DMA buffer
+    ///        gets emptied, not the sample rate (always 1kHz)
+    static Config defaults() {
+      Config c = {};
+      //                                  accel / alt / batt / log tick (us)    raw  radio         cpu
+      c.phases[GR_PHASE_IDLE]     = {{5000, 5000,   5000,   20000},  0, GR_RADIO_ON,  240};
+      c.phases[GR_PHASE_ARMED]    = {{5000, 5000,   5000,  100000},  0, GR_RADIO_ON,  240};
+      c.phases[GR_PHASE_BOOST]    = {{5000, 5000,   5000,   20000},  1, GR_RADIO_LOW, 240};
+      c.phases[GR_PHASE_COAST]    = {{5000, 5000,   5000,   20000},  1, GR_RADIO_LOW, 240};
+      c.phases[GR_PHASE_DESCENT]  = {{5000, 5000,   5000,   20000},  2, GR_RADIO_LOW, 240};
+      c.phases[GR_PHASE_LANDED]   = {{5000, 5000,   5000,  100000},  0, GR_RADIO_ON,  240};
+      c.phases[GR_PHASE_SHUTDOWN] = {{5000, 20000, 100000, 100000},  0, GR_RADIO_ON,   80};
+      c.burnoutMs2 = 0;
+      c.burnoutMs = 100;
+      c.boostMaxMs = 10000;
+      c.tailMs = 60000;
+      return c;
+    }
+
+    GR_FlightPhase(Config config = defaults()) : config_(config) { reset(0); }
+
+    /// @brief Change the table / thresholds. Takes effect from the next update() (settings() of the current phase included)
+    void setConfig(const Config& config) { config_ = config; }
+    const Config& config() const { return config_; }
+
+    /// @brief Back to IDLE
+    void reset(uint64_t nowUs) {
+      phase_ = GR_PHASE_IDLE;
+      enteredUs_ = nowUs;
+      burnoutUs_ = 0;
+    }
+
+    /// @brief Pick the phase up from the flags after a reset mid-flight (see GR_Resume.h), without a transition. Launched but not
+    ///        at apogee comes back as BOOST (burnout's found again within burnoutMs if the motor's out); the landed tail starts over
+    void restore(uint64_t nowUs, const Inputs& in) {
+      reset(nowUs);
+      phase_ = target(nowUs, in);
+    }
+
+    /// @brief Feed the flags (every drain, or at least every few ms while launched: burnout's timed off these calls)
+    /// @return true if the phase changed; last() says from what
+    bool update(uint64_t nowUs, const Inputs& in) {
+      uint8_t next = target(nowUs, in);
+      if (next == phase_) return false;
+      last_ = {phase_, next, nowUs, nowUs - enteredUs_};
+      phase_ = next;
+      enteredUs_ = nowUs;
+      burnoutUs_ = 0;
+      return true;
+    }
+
+    uint8_t phase() const { return phase_; }
+    const GR_PhaseSettings& settings() const { return config_.phases[phase_]; }
+    const GR_PhaseSettings& settings(uint8_t phase) const { return config_.phases[phase]; }
+    /// @brief When the current phase started
+    uint64_t enteredUs() const { return enteredUs_; }
+    /// @brief The last transition update() made
+    const Transition& last() const { return last_; }
+
+    static const char * name(uint8_t phase) {
+      switch (phase) {
+        case GR_PHASE_IDLE:     return "idle";
+        case GR_PHASE_ARMED:    return "armed";
+        case GR_PHASE_BOOST:    return "boost";
+        case GR_PHASE_COAST:    return "coast";
+        case GR_PHASE_DESCENT:  return "descent";
+        case GR_PHASE_LANDED:   return "landed";
+        case GR_PHASE_SHUTDOWN: return "shutdown";
+        default:                return "unknown";
+      }
+    }
+
+  private:
+    /// @brief Where the flags (and burnout / the tail timer) say we should be
+    uint8_t target(uint64_t nowUs, const Inputs& in) {
+      if (!in.armed) return GR_PHASE_IDLE;
+      if (!in.launched) return GR_PHASE_ARMED;
+      if (in.landed) {
+        if (phase_ == GR_PHASE_SHUTDOWN) return GR_PHASE_SHUTDOWN;
+        if (phase_ == GR_PHASE_LANDED && nowUs - enteredUs_ >= uint64_t(config_.tailMs) * 1000) return GR_PHASE_SHUTDOWN;
+        return GR_PHASE_LANDED;
+      }
+      if (in.apogee) return GR_PHASE_DESCENT;
+      if (phase_ == GR_PHASE_COAST) return GR_PHASE_COAST;
+      if (phase_ != GR_PHASE_BOOST) return GR_PHASE_BOOST;
+      if (nowUs - enteredUs_ >= uint64_t(config_.boostMaxMs) * 1000) return GR_PHASE_COAST;
+      if (in.accelMs2 > config_.burnoutMs2) { burnoutUs_ = 0; return GR_PHASE_BOOST; }
+      if (!burnoutUs_) burnoutUs_ = nowUs ? nowUs : 1;
+      return nowUs - burnoutUs_ >= uint64_t(config_.burnoutMs) * 1000 ? GR_PHASE_COAST : GR_PHASE_BOOST;
+    }
+
+    Config config_;
+    uint8_t phase_;
+    uint64_t enteredUs_;
+    uint64_t burnoutUs_;  // Start of the run at or below burnoutMs2 (0 = not in one)
+    Transition last_ = {};
+};
+
+/// @brief Thins out full rate records to every Nth one (GR_PhaseSettings::rawEvery), keeping any that carry a baro or battery reading
+///        so none of those are lost. The count carries on across calls
+class GR_RawDecimator {
+  public:
+    /// @brief Drop the records that don't make the cut, in place
+    /// @return how many are left (at the front of r)
+    size_t apply(GR_LogRecord * r, size_t n, uint16_t every) {
+      if (every <= 1) { count_ = 0; return every ? n : 0; }
+      size_t kept = 0;
+      for (size_t i = 0; i < n; i++) {
+        bool keep = ++count_ >= every || (r[i].flags & (GR_SAMPLE_BARO | GR_SAMPLE_BATT));
+        if (count_ >= every) count_ = 0;
+        if (keep) r[kept++] = r[i];
+      }
+      return kept;
+    }
+
+    void reset() { count_ = 0; }
+
+  private:
+    uint16_t count_ = 0;
+};
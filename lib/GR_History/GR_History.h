@@ -0,0 +1,121 @@
+/*
+  GR_History.h
+  Pre-trigger history: a circular buffer that always holds the newest N records, then gets frozen at a trigger (launch detection)
+  so its contents can be flushed into the flight log ahead of the live data, oldest first, with their original timestamps.
+
+  The storage is handed in by the caller (attach()), so it can live in PSRAM and is allocated exactly once; push() never allocates.
+
+  Threading (one writer task, one reader task):
+    writer: push(), freeze(), reset()
+    reader: state(), frozenCount(), read(), markDrained(), acknowledgeReset()  - only touches the data once state() == Frozen
+  freeze() publishes the buffer to the reader (release); after that the writer leaves it alone. reset() on a frozen history only asks
+  for one (ResetPending), since the reader may be part way through a read(): the reader empties it when it's done with it
+  (acknowledgeReset()), and the writer's push()es are ignored until then. Whoever empties it is the only one touching it at the time.
+
+  Checked on a host (wrap / freeze ordering, and a writer resetting under a reader thread): tools/GraphiteHistoryTest.cpp
+
+  Part of the Graphite Flight Data Logger project, GPL-3.0 (see LICENSE)
+*/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+template <typename T>
+class GR_History {
+  public:
+    enum State : uint8_t {
+      Recording = 0,  // Writer is overwriting the oldest records
+      Frozen = 1,     // Trigger happened; reader may read the contents
+      Drained = 2,    // Reader has flushed everything
+      ResetPending = 3 // Writer reset() a frozen history; waiting for the reader to acknowledgeReset()
+    };
+
+    GR_History() : buf_(nullptr), capacity_(0), head_(0), count_(0), state_(Recording) {}
+
+    /// @brief Hand over the storage (capacity records). Call once, before anything else touches the history
+    void attach(T * storage, size_t capacity) {
+      buf_ = storage;
+      capacity_ = storage ? capacity : 0;
+      head_ = 0;
+      count_ = 0;
+      state_.store(Recording, std::memory_order_release);
+    }
+
+    // Writer side -----------------------------------------------------------
+
+    /// @brief Add a record, overwriting the oldest once full. Ignored unless Recording
+    void push(const T& item) {
+      if (capacity_ == 0 || state_.load(std::memory_order_acquire) != Recording) return; // acquire: sees the reader's acknowledgeReset()
+      buf_[head_] = item;
+      if (++head_ == capacity_) head_ = 0;
+      if (count_ < capacity_) count_++;
+    }
+
+    /// @brief Stop recording and hand the contents to the reader
+    void freeze() {
+      if (state_.load(std::memory_order_relaxed) != Recording) return;
+      state_.store(Frozen, std::memory_order_release);
+    }
+
+    /// @brief Empty the history and start recording again. If it's frozen the reader might be reading it, so this only asks the reader to
+    ///        (ResetPending), and recording starts again once it has
+    void reset() {
+      uint8_t s = state_.load(std::memory_order_acquire);
+      if (s == ResetPending) return; // Already asked
+      if (s == Frozen && state_.compare_exchange_strong(s, ResetPending, std::memory_order_acq_rel)) return;
+      clear(); // Recording, or Drained (the reader's done with it for good): nobody else is looking
+    }
+
+    // Reader side -----------------------------------------------------------
+
+    State state() const { return State(state_.load(std::memory_order_acquire)); }
+
+    /// @brief Number of records captured at the moment of the freeze
+    size_t frozenCount() const { return state() == Frozen ? count_ : 0; }
+
+    /// @brief Copy frozen records out in time order
+    /// @param from index of the first record to copy (0 = oldest)
+    /// @return number of records copied (0 once from >= frozenCount())
+    size_t read(size_t from, T * out, size_t max) const {
+      if (state() != Frozen || from >= count_) return 0;
+      size_t n = count_ - from;
+      if (n > max) n = max;
+      size_t oldest = (count_ == capacity_) ? head_ : 0; // Once wrapped, the oldest record is the one about to be overwritten
+      size_t idx = oldest + from;
+      if (idx >= capacity_) idx -= capacity_;
+      for (size_t i = 0; i < n; i++) {
+        out[i] = buf_[idx];
+        if (++idx == capacity_) idx = 0;
+      }
+      return n;
+    }
+
+    /// @brief Reader is done with the frozen contents
+    void markDrained() {
+      uint8_t expected = Frozen;
+      state_.compare_exchange_strong(expected, Drained, std::memory_order_acq_rel);
+    }
+
+    /// @brief Reader is done with the contents the writer asked to reset(): empty the history and let the writer record again.
+    ///        Does nothing unless state() == ResetPending
+    void acknowledgeReset() {
+      if (state_.load(std::memory_order_acquire) == ResetPending) clear();
+    }
+
+    size_t capacity() const { return capacity_; }
+
+  private:
+    /// @brief Only from whichever side has the history to itself (see reset())
+    void clear() {
+      head_ = 0;
+      count_ = 0;
+      state_.store(Recording, std::memory_order_release);
+    }
+
+    T * buf_;
+    size_t capacity_;
+    size_t head_;   // Next slot to write
+    size_t count_;  // Valid records (<= capacity_)
+    std::atomic<uint8_t> state_;
+};
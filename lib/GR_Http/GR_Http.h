@@ -0,0 +1,422 @@
+/*
+  GR_Http.h
+  The hardware independent half of the logger's web server: what a request and a response look like to a handler, a router that
+  maps paths to handlers, an incremental HTTP/1.1 request parser, ETag / 304 helpers for pre-gzipped assets (GR_HttpAsset) and a
+  Range header parser (resumable log downloads, see GR_LogDownload.h).
+
+  The socket side lives elsewhere and just adapts to these: on the logger it's esp_http_server (src/HttpServer_ESP.h, which does
+  its own parsing), on a PC it's a poll() server (src/native/HttpServer_Posix.h, which uses GR_HttpParser). Either way a handler
+  looks like:
+
+    void wi_sendPerf(const GR_HttpRequest& req, GR_HttpResponse& res) {
+      ...
+      res.send(200, "application/json", json);
+    }
+
+  Handlers must answer every request (the router sends a 500 if one doesn't) and must never wait on anything slow: both servers
+  run all their connections on one task, so a handler that blocks holds up every other client.
+
+  Part of the Graphite Flight Data Logger project, GPL-3.0 (see LICENSE)
+*/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+
+#ifndef GR_HTTP_MAX_ROUTES
+  #define GR_HTTP_MAX_ROUTES 24     // Routes a GR_HttpRouter can hold
+#endif
+#ifndef GR_HTTP_MAX_REQUEST
+  #define GR_HTTP_MAX_REQUEST 2048  // Biggest request GR_HttpParser accepts (request line + headers + body)
+#endif
+
+// Methods (bit flags, so a route can accept several)
+#define GR_HTTP_GET     0x01
+#define GR_HTTP_POST    0x02
+#define GR_HTTP_HEAD    0x04
+#define GR_HTTP_PUT     0x08
+#define GR_HTTP_DELETE  0x10
+#define GR_HTTP_OPTIONS 0x20
+#define GR_HTTP_ANY     0xFF
+
+#define GR_HTTP_ETAG_LEN 19 // "0123456789abcdef" with the quotes, plus a terminator
+
+namespace GR_Http {
+  /// @brief Method flag for a method name ("GET" -> GR_HTTP_GET), 0 if we don't know it
+  inline uint8_t method(const char * s, size_t len) {
+    static const struct { const char * name; uint8_t flag; } methods[] = {
+      {"GET", GR_HTTP_GET}, {"POST", GR_HTTP_POST}, {"HEAD", GR_HTTP_HEAD}, {"PUT", GR_HTTP_PUT}, {"DELETE", GR_HTTP_DELETE},
+      {"OPTIONS", GR_HTTP_OPTIONS}};
+    for (auto& m : methods) if (strlen(m.name) == len && !memcmp(m.name, s, len)) return m.flag;
+    return 0;
+  }
+
+  /// @brief Status line text for a status code ("200 OK")
+  inline const char * status(int code) {
+    switch (code) {
+      case 200: return "200 OK";
+      case 204: return "204 No Content";
+      case 206: return "206 Partial Content";
+      case 304: return "304 Not Modified";
+      case 400: return "400 Bad Request";
+      case 404: return "404 Not Found";
+      case 405: return "405 Method Not Allowed";
+      case 409: return "409 Conflict";
+      case 411: return "411 Length Required";
+      case 413: return "413 Payload Too Large";
+      case 414: return "414 URI Too Long";
+      case 416: return "416 Range Not Satisfiable";
+      case 431: return "431 Request Header Fields Too Large";
+      case 501: return "501 Not Implemented";
+      case 503: return "503 Service Unavailable";
+      default: return code < 400 ? "200 OK" : "500 Internal Server Error";
+    }
+  }
+
+  /// @brief Decode a %XX / '+' escaped query value into out (always terminated)
+  /// @return decoded length
+  inline size_t urlDecode(const char * s, size_t len, char * out, size_t max) {
+    if (!max) return 0;
+    size_t n = 0;
+    for (size_t i = 0; i < len && n + 1 < max; i++) {
+      char c = s[i];
+      if (c == '+') c = ' ';
+      else if (c == '%' && i + 2 < len) {
+        char hex[3] = {s[i + 1], s[i + 2], 0};
+        char * end;
+        long v = strtol(hex, &end, 16);
+        if (end == hex + 2) { c = char(v); i += 2; }
+      }
+      out[n++] = c;
+    }
+    out[n] = 0;
+    return n;
+  }
+}
+
+/// @brief A file served straight out of flash, already gzipped (tools/web_assets.py generates a table of these from data/)
+struct GR_HttpAsset {
+  const char * path;    // "/status.html"
+  const char * type;    // Content-Type
+  const char * etag;    // Strong ETag, quotes included (FNV-1a 64 of gz, see GR_Http::etag())
+  const uint8_t * gz;
+  size_t gzLen;
+  size_t len;           // Size once the browser's unzipped it (minified)
+};
+
+/// @brief One request, as the handler sees it. The server owns all the strings; they're only valid during the handler call
+class GR_HttpRequest {
+  public:
+    uint8_t method = 0;       // GR_HTTP_GET etc. (0 = something we don't know)
+    const char * path = "";   // Without the query string
+    const char * query = "";  // Everything after the '?', "" if there wasn't one
+    const char * body = "";   // Always terminated (the server adds one), bodyLen doesn't count it
+    size_t bodyLen = 0;
+    const char * headers = "";  // Raw "Name: value\r\n" lines (host server only; the logger's server looks them up itself)
+
+    virtual ~GR_HttpRequest() {}
+
+    /// @brief Copy a header's value into out (case insensitive name)
+    /// @return false if the request didn't have it (or it didn't fit)
+    virtual bool header(const char * name, char * out, size_t max) const {
+      size_t nameLen = strlen(name);
+      for (const char * line = headers; *line; ) {
+        const char * eol = strstr(line, "\r\n");
+        if (!eol) eol = line + strlen(line);
+        if (size_t(eol - line) > nameLen && line[nameLen] == ':' && !strncasecmp(line, name, nameLen)) {
+          const char * v = line + nameLen + 1;
+          while (v < eol && (*v == ' ' || *v == '\t')) v++;
+          size_t len = size_t(eol - v);
+          if (len >= max) return false;
+          memcpy(out, v, len);
+          out[len] = 0;
+          return true;
+        }
+        line = *eol ? eol + 2 : eol;
+      }
+      return false;
+    }
+
+    /// @brief Decode query argument name into out ("" for "?name" with no value)
+    /// @return false if there's no such argument
+    bool arg(const char * name, char * out, size_t max) const {
+      size_t nameLen = strlen(name);
+      for (const char * a = query; *a; ) {
+        const char * end = strchr(a, '&');
+        if (!end) end = a + strlen(a);
+        const char * eq = (const char *)memchr(a, '=', size_t(end - a));
+        const char * keyEnd = eq ? eq : end;
+        if (size_t(keyEnd - a) == nameLen && !memcmp(a, name, nameLen)) {
+          if (eq) GR_Http::urlDecode(eq + 1, size_t(end - eq - 1), out, max);
+          else if (max) out[0] = 0;
+          return true;
+        }
+        a = *end ? end + 1 : end;
+      }
+      return false;
+    }
+    bool hasArg(const char * name) const { char c; return arg(name, &c, 1); }
+};
+
+/// @brief How a handler answers. Either send() the whole thing, begin() / write()... / end() to stream it (chunked), stream()
+///        to keep the connection for server pushes, or detach() it and answer from somewhere else
+class GR_HttpResponse {
+  public:
+    virtual ~GR_HttpResponse() {}
+
+    /// @brief Add a header (before send() / begin()). name and value must stay valid until the response has been sent
+    virtual void header(const char * name, const char * value) = 0;
+    /// @brief Send a complete response with a body
+    virtual bool send(int status, const char * type, const char * body, size_t len) = 0;
+    /// @brief Start a response whose body is sent in pieces with write()
+    virtual bool begin(int status, const char * type) = 0;
+    virtual bool write(const void * data, size_t len) = 0;
+    virtual bool end() = 0;
+    /// @brief Answer with a body that never ends (e.g. text/event-stream): the headers go out now and the connection stays open
+    ///        after the handler returns, for the server's push() to add to
+    /// @return id to push() to, -1 if this server can't do that (nothing has been sent)
+    virtual int stream(int /*status*/, const char * /*type*/) { return -1; }
+    /// @brief Take the connection over entirely (nothing has been sent): the caller writes the whole response, status line and all,
+    ///        straight to the socket (from any task, blocking is fine) and hands it back with the server's release() when it's done.
+    ///        For long downloads that shouldn't hold up the server's task
+    /// @return socket, -1 if this server can't do that (or it's already handed one out)
+    virtual int detach() { return -1; }
+
+    bool send(int status, const char * type, const char * body) { return send(status, type, body, strlen(body)); }
+    /// @brief true once send() or begin() has been called
+    bool started() const { return started_; }
+
+  protected:
+    bool started_ = false;
+};
+
+typedef void (*GR_HttpHandler)(const GR_HttpRequest& req, GR_HttpResponse& res);
+
+namespace GR_Http {
+  /// @brief FNV-1a 64, chainable (pass the last result back in as hash to carry on over the next piece)
+  inline uint64_t fnv1a64(const void * data, size_t len, uint64_t hash = 0xcbf29ce484222325ull) {
+    const uint8_t * p = (const uint8_t *)data;
+    for (size_t i = 0; i < len; i++) hash = (hash ^ p[i]) * 0x100000001b3ull;
+    return hash;
+  }
+
+  /// @brief Strong ETag for a content hash: "\"0123456789abcdef\"" (out needs GR_HTTP_ETAG_LEN)
+  inline void etag(uint64_t hash, char * out) {
+    static const char hex[] = "0123456789abcdef";
+    out[0] = '"';
+    for (int i = 0; i < 16; i++) out[1 + i] = hex[(hash >> (60 - 4 * i)) & 0xF];
+    out[17] = '"';
+    out[18] = 0;
+  }
+
+  /// @brief Does an If-None-Match value ("*", or a list of tags, weak or not) match etag? (weak comparison, RFC 9110 13.1.2)
+  inline bool etagMatches(const char * ifNoneMatch, const char * etag) {
+    size_t etagLen = strlen(etag);
+    for (const char * p = ifNoneMatch; *p; ) {
+      while (*p == ' ' || *p == '\t' || *p == ',') p++;
+      if (*p == '*') return true;
+      if (p[0] == 'W' && p[1] == '/') p += 2;
+      const char * end = p;
+      while (*end && *end != ',') end++;
+      const char * last = end;
+      while (last > p && (last[-1] == ' ' || last[-1] == '\t')) last--;
+      if (size_t(last - p) == etagLen && !memcmp(p, etag, etagLen)) return true;
+      p = end;
+    }
+    return false;
+  }
+
+  /// @brief true if the request's If-None-Match says the client already has etag (answer with notModified())
+  inline bool fresh(const GR_HttpRequest& req, const char * etag) {
+    char v[128];
+    return req.header("If-None-Match", v, sizeof(v)) && etagMatches(v, etag);
+  }
+
+  /// @brief 304 for a request fresh() said yes to. etag / cacheControl must outlive the response (literals / globals)
+  inline void notModified(GR_HttpResponse& res, const char * type, const char * etag, const char * cacheControl) {
+    res.header("ETag", etag);
+    res.header("Cache-Control", cacheControl);
+    res.send(304, type, "", 0);
+  }
+
+  /// @brief Answer with an asset: 304 if the client's copy is current, else the gzipped bytes. Every browser takes gzip, so
+  ///        there's no identity fallback (curl needs --compressed)
+  inline void sendAsset(const GR_HttpRequest& req, GR_HttpResponse& res, const GR_HttpAsset& a, const char * cacheControl) {
+    if (fresh(req, a.etag)) return notModified(res, a.type, a.etag, cacheControl);
+    res.header("ETag", a.etag);
+    res.header("Cache-Control", cacheControl);
+    res.header("Content-Encoding", "gzip");
+    res.send(200, a.type, (const char *)a.gz, a.gzLen);
+  }
+
+  /// @brief Parse a Range header value against a body of size bytes. Only single ranges ("bytes=500-999", "bytes=500-", "bytes=-500");
+  ///        anything else (several ranges, other units, junk) is ignored, which RFC 9110 allows: the answer is just the whole body
+  /// @return 1 with first / last (inclusive) set, 0 to ignore it and send everything, -1 if it can't be satisfied (416)
+  inline int parseRange(const char * v, uint64_t size, uint64_t& first, uint64_t& last) {
+    auto number = [](const char *& p, uint64_t& out) {
+      if (*p < '0' || *p > '9') return false;
+      out = 0;
+      for (; *p >= '0' && *p <= '9'; p++) {
+        if (out > (UINT64_MAX - 9) / 10) return false;
+        out = out * 10 + uint64_t(*p - '0');
+      }
+      return true;
+    };
+    while (*v == ' ') v++;
+    if (strncasecmp(v, "bytes=", 6) != 0 || strchr(v, ',')) return 0;
+    const char * p = v + 6;
+    while (*p == ' ') p++;
+    uint64_t a = 0, b = 0;
+    bool hasA = number(p, a);
+    if (*p++ != '-') return 0;
+    bool hasB = number(p, b);
+    while (*p == ' ') p++;
+    if (*p || (!hasA && !hasB) || (hasA && hasB && b < a)) return 0;
+    if (!hasA) { // Suffix: the last b bytes
+      if (b == 0 || size == 0) return -1;
+      first = b >= size ? 0 : size - b;
+      last = size - 1;
+      return 1;
+    }
+    if (a >= size) return -1;
+    first = a;
+    last = hasB && b < size ? b : size - 1;
+    return 1;
+  }
+
+  /// @return the asset for path, nullptr if there isn't one
+  inline const GR_HttpAsset * findAsset(const GR_HttpAsset * assets, size_t count, const char * path) {
+    for (size_t i = 0; i < count; i++) if (!strcmp(assets[i].path, path)) return &assets[i];
+    return nullptr;
+  }
+}
+
+/// @brief Exact path -> handler table. Wrong method gets a 405, unknown path goes to the not found handler (or a plain 404)
+class GR_HttpRouter {
+  public:
+    /// @return false if the table's full
+    bool on(const char * path, GR_HttpHandler handler, uint8_t methods = GR_HTTP_ANY) {
+      if (count_ >= GR_HTTP_MAX_ROUTES) return false;
+      routes_[count_++] = {path, handler, methods};
+      return true;
+    }
+    void onNotFound(GR_HttpHandler handler) { notFound_ = handler; }
+
+    /// @brief Run the handler for req. Makes sure something gets sent even if the handler forgets
+    void dispatch(const GR_HttpRequest& req, GR_HttpResponse& res) const {
+      bool pathFound = false;
+      for (size_t i = 0; i < count_; i++) {
+        const Route& r = routes_[i];
+        if (strcmp(r.path, req.path) != 0) continue;
+        pathFound = true;
+        if (!(r.methods & req.method)) continue; // Same path might be registered again for another method
+        r.handler(req, res);
+        if (!res.started()) res.send(500, "text/plain", "No response");
+        return;
+      }
+      if (pathFound) res.send(405, "text/plain", "Method not allowed");
+      else if (notFound_) notFound_(req, res);
+      if (!res.started()) res.send(404, "text/plain", "Page / data not found");
+    }
+
+    size_t routes() const { return count_; }
+
+  private:
+    struct Route { const char * path; GR_HttpHandler handler; uint8_t methods; };
+    Route routes_[GR_HTTP_MAX_ROUTES];
+    size_t count_ = 0;
+    GR_HttpHandler notFound_ = nullptr;
+};
+
+/// @brief Incremental HTTP/1.x request parser (one connection's worth). Read socket data into space(), commit() it, then parse().
+///        Handles keep-alive and pipelining (bytes after the current request are kept for the next one). Bodies need a Content-Length
+class GR_HttpParser {
+  public:
+    enum Result { NeedMore, Ready, Failed };
+
+    char * space() { return buf_ + len_; }
+    size_t spaceLeft() const { return GR_HTTP_MAX_REQUEST - len_; }
+    void commit(size_t n) { len_ += n; }
+    size_t buffered() const { return len_; }
+
+    /// @brief Try to parse a request out of what's been committed so far
+    /// @return Ready: request() is valid until next(). Failed: errorStatus() says why (answer it and close the connection)
+    Result parse() {
+      if (ready_) return Ready;
+      buf_[len_] = 0;
+      char * hdrEnd = strstr(buf_, "\r\n\r\n");
+      if (!hdrEnd) {
+        if (len_ >= GR_HTTP_MAX_REQUEST) return fail(431);
+        return NeedMore;
+      }
+      char * sp1 = (char *)memchr(buf_, ' ', size_t(hdrEnd - buf_));
+      char * sp2 = sp1 ? (char *)memchr(sp1 + 1, ' ', size_t(hdrEnd - sp1 - 1)) : nullptr;
+      char * eol = strstr(buf_, "\r\n");
+      if (!sp1 || !sp2 || sp2 > eol || strncmp(sp2 + 1, "HTTP/1.", 7) != 0) return fail(400);
+      bool http10 = sp2[8] == '0';
+
+      size_t bodyLen = 0;
+      req_.headers = eol == hdrEnd ? "" : eol + 2; // No headers at all if the request line's "\r\n" is the start of the blank line
+      *hdrEnd = 0; // Temporarily, so header() stops at the end of the headers
+      char v[24];
+      if (req_.header("Transfer-Encoding", v, sizeof(v))) { *hdrEnd = '\r'; return fail(411); }
+      if (req_.header("Content-Length", v, sizeof(v))) {
+        char * end;
+        unsigned long n = strtoul(v, &end, 10);
+        if (end == v || *end) { *hdrEnd = '\r'; return fail(400); }
+        bodyLen = n;
+      }
+      keepAlive_ = !http10;
+      if (req_.header("Connection", v, sizeof(v))) keepAlive_ = !strcasecmp(v, "keep-alive") || (!http10 && strcasecmp(v, "close") != 0);
+      *hdrEnd = '\r';
+
+      size_t bodyStart = size_t(hdrEnd - buf_) + 4;
+      if (bodyLen > GR_HTTP_MAX_REQUEST - bodyStart) return fail(413);
+      if (len_ < bodyStart + bodyLen) return NeedMore;
+
+      // Got it all: cut the pieces apart in place
+      used_ = bodyStart + bodyLen;
+      saved_ = buf_[used_]; // First byte of a pipelined request (or the terminator); the body's terminator goes here for now
+      buf_[used_] = 0;
+      req_.method = GR_Http::method(buf_, size_t(sp1 - buf_));
+      *sp2 = 0;
+      char * q = strchr(sp1 + 1, '?');
+      if (q) *q = 0;
+      req_.path = sp1 + 1;
+      req_.query = q ? q + 1 : "";
+      if (eol != hdrEnd) hdrEnd[2] = 0; // Headers keep their last "\r\n"
+      req_.body = buf_ + bodyStart;
+      req_.bodyLen = bodyLen;
+      ready_ = true;
+      return Ready;
+    }
+
+    const GR_HttpRequest& request() const { return req_; }
+    bool keepAlive() const { return keepAlive_; }
+    int errorStatus() const { return error_; }
+
+    /// @brief Done with the current request; keep anything after it (pipelined requests)
+    void next() {
+      if (!ready_) return;
+      buf_[used_] = saved_;
+      memmove(buf_, buf_ + used_, len_ - used_);
+      len_ -= used_;
+      used_ = 0;
+      ready_ = false;
+      req_ = GR_HttpRequest();
+    }
+
+    void reset() { len_ = used_ = 0; ready_ = false; error_ = 0; req_ = GR_HttpRequest(); }
+
+  private:
+    Result fail(int status) { error_ = status; return Failed; }
+
+    char buf_[GR_HTTP_MAX_REQUEST + 1];  // +1 for a terminator
+    size_t len_ = 0, used_ = 0;
+    char saved_ = 0;
+    bool ready_ = false, keepAlive_ = true;
+    int error_ = 0;
+    GR_HttpRequest req_;
+};
@@ -0,0 +1,142 @@
+/*
+  GR_LaunchDetect.h
+  Streaming launch detector. Feed it every accelerometer and altimeter sample as it arrives (while armed); it decides on the spot,
+  no buffering and no look-back.
+
+  Two independent triggers, whichever fires first wins:
+    Acceleration: |a| > accelG for accelSamples consecutive accelerometer samples
+    Altitude:     altitude > pad baseline + altRiseM for altSamples consecutive altimeter samples
+  A single sample back under the threshold restarts that trigger's count (debounce), so handling bumps on the pad don't launch us.
+
+  Latency guarantee: once the rocket is really moving, the detector fires on exactly the accelSamples'th (or altSamples'th)
+  sample of the run, never later. T0 is the timestamp of the first sample of that run (the actual start of the motor burn),
+  not the moment we decided.
+
+  The pad baseline is the average of the first baseSamples altimeter samples after reset(), then follows slow pressure drift
+  while the altitude is well under the trigger (below half of altRiseM), so weather changes while sitting on the pad don't
+  creep up on the threshold. The altitude trigger stays off until the baseline is ready.
+
+  Part of the Graphite Flight Data Logger project, GPL-3.0 (see LICENSE)
+*/
+#pragma once
+#include <stdint.h>
+
+// Trigger reasons (also logged as the iArg of the GR_EVT_LAUNCH event)
+#define GR_LAUNCH_NONE  0
+#define GR_LAUNCH_ACCEL 1
+#define GR_LAUNCH_ALT   2
+
+#define GR_LAUNCH_DRIFT_SHIFT 12  // Baseline drift tracking: baseline moves 1/4096 of the way to each new pad sample (~1 min at 64Hz)
+
+class GR_LaunchDetect {
+  public:
+    struct Config {
+      float accelG;           // Acceleration magnitude threshold (g). 1g is sitting still, so this has to be well above 1
+      uint16_t accelSamples;  // Consecutive accelerometer samples above accelG needed to trigger
+      float altRiseM;         // Altitude above the pad baseline needed to trigger (m)
+      uint16_t altSamples;    // Consecutive altimeter samples above altRiseM needed to trigger
+      uint16_t baseSamples;   // Altimeter samples averaged into the pad baseline before the altitude trigger is live
+    };
+
+    struct Result {
+      uint8_t reason;         // GR_LAUNCH_*
+      uint64_t t0Us;          // Timestamp of the first sample of the run that triggered
+      uint64_t detectUs;      // Timestamp of the sample that completed the run
+    };
+
+    /// @brief 3g for 30 samples (30ms at 1kHz), or 30m (~100ft) above the pad for 5 altimeter samples (~80ms at 64Hz)
+    static Config defaults() { return {3.0f, 30, 30.0f, 5, 64}; }
+
+    GR_LaunchDetect(Config config = defaults()) { setConfig(config); }
+
+    /// @brief Change the thresholds (also does reset())
+    void setConfig(Config config) {
+      config_ = config;
+      if (config_.accelSamples < 1) config_.accelSamples = 1;
+      if (config_.altSamples < 1) config_.altSamples = 1;
+      if (config_.baseSamples < 1) config_.baseSamples = 1;
+      accelG2_ = config_.accelG * config_.accelG;
+      reset();
+    }
+    const Config& config() const { return config_; }
+
+    /// @brief Forget everything (call when arming); the pad baseline starts over
+    void reset() {
+      result_ = Result();
+      accelRun_ = 0; altRun_ = 0;
+      accelRunStart_ = 0; altRunStart_ = 0;
+      baseSum_ = 0; baseCount_ = 0; baseline_ = 0;
+    }
+
+    /// @brief Feed one accelerometer sample (g, any calibration)
+    /// @return true if this sample triggered the launch (only ever returns true once until reset())
+    bool onAccel(uint64_t timeUs, float gx, float gy, float gz) {
+      if (result_.reason) return false;
+      if (gx * gx + gy * gy + gz * gz > accelG2_) { // Squared so there's no sqrt per sample
+        if (accelRun_++ == 0) accelRunStart_ = timeUs;
+        if (accelRun_ >= config_.accelSamples) return trigger(GR_LAUNCH_ACCEL, accelRunStart_, timeUs);
+      } else {
+        accelRun_ = 0;
+      }
+      return false;
+    }
+
+    /// @brief Feed one altimeter sample (m, any reference; only the rise above the pad counts)
+    /// @return true if this sample triggered the launch
+    bool onAlt(uint64_t timeUs, float altM) {
+      if (result_.reason) return false;
+      if (baseCount_ < config_.baseSamples) { // Still collecting the pad baseline
+        baseSum_ += altM;
+        if (++baseCount_ == config_.baseSamples) baseline_ = float(baseSum_ / baseCount_);
+        return false;
+      }
+      float rise = altM - baseline_;
+      if (rise > config_.altRiseM) {
+        if (altRun_++ == 0) altRunStart_ = timeUs;
+        if (altRun_ >= config_.altSamples) return trigger(GR_LAUNCH_ALT, altRunStart_, timeUs);
+      } else {
+        altRun_ = 0;
+        if (rise < config_.altRiseM / 2) baseline_ += (altM - baseline_) / float(1 << GR_LAUNCH_DRIFT_SHIFT);
+      }
+      return false;
+    }
+
+    /// @brief Put back a decision made before a reset (see GR_Resume.h): the launch result (if it had triggered) and the pad baseline
+    void restore(const Result& result, float baselineM) {
+      reset();
+      result_ = result;
+      baseline_ = baselineM;
+      baseCount_ = config_.baseSamples;
+    }
+
+    bool triggered() const { return result_.reason != GR_LAUNCH_NONE; }
+    const Result& result() const { return result_; }
+    /// @brief Pad altitude the altitude trigger is measured from (0 until baseSamples have come in)
+    float baselineM() const { return baseline_; }
+    bool baselineReady() const { return baseCount_ >= config_.baseSamples; }
+
+    static const char * reasonName(uint8_t reason) {
+      switch (reason) {
+        case GR_LAUNCH_ACCEL: return "accel";
+        case GR_LAUNCH_ALT:   return "altitude";
+        default:              return "none";
+      }
+    }
+
+  private:
+    bool trigger(uint8_t reason, uint64_t t0Us, uint64_t detectUs) {
+      result_.reason = reason;
+      result_.t0Us = t0Us;
+      result_.detectUs = detectUs;
+      return true;
+    }
+
+    Config config_;
+    float accelG2_;
+    Result result_;
+    uint16_t accelRun_, altRun_;          // Consecutive samples over each threshold
+    uint64_t accelRunStart_, altRunStart_;
+    double baseSum_;
+    uint16_t baseCount_;
+    float baseline_;
+};
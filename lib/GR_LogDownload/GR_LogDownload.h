@@ -0,0 +1,351 @@
+/*
+  GR_LogDownload.h
+  Flight log downloads: the response to "GET /download?file=Flight_....grl[&format=csv]" worked out from the log file alone, as the
+  raw bytes or converted to CSV on the fly (GR_FlightLog::formatCsv(), the same lines GraphiteLogDecode writes), with HTTP Range
+  support so a download that died halfway (phone wandered off, AP dropped out) picks up where it stopped instead of starting over.
+
+  Nothing here touches a socket or a file system. The caller opens the file behind a GR_LogSource, then:
+
+    GR_LogDownloadJob job;                       // On the server task, while the request is still valid
+    int err = job.parse(req);                    // 0, or a status to answer with
+    ...
+    int status = dl.begin(job, &source);         // Anywhere (it reads the file, so not on the server task)
+    send(dl.head(buf, sizeof(buf)));             // Status line + headers (+ the body, for errors)
+    while ((n = dl.read(buf, sizeof(buf))) > 0) send(buf, n);
+
+  Raw downloads are the file as it is. CSV downloads need their total length up front (for Content-Length and Content-Range), which
+  means formatting the whole file once; that pass also keeps a CSV offset every few records (GR_DL_CSV_CHECKPOINTS of them), so a
+  Range request into the middle of the CSV only has to seek to the nearest checkpoint and format forward from there. The sizes are
+  kept for the most recent file, so resuming (or downloading it again) skips straight to the data. Packed logs (GR_LogPack.h) work
+  the same way a block at a time: checkpoints are at block starts, since a block is the smallest thing that decodes on its own.
+
+  Validators: a strong ETag made from the file name, size and log header (logs never change once they're closed, and the logger
+  refuses downloads while one's open), different for raw and CSV. If-Range is honoured, so a resume against a different file
+  gets the whole thing rather than a spliced one.
+
+  GR_LogDownload is about 13KB (mostly the CSV checkpoints and a read buffer); keep one around (a global) rather than one per
+  download. Not thread safe.
+
+  Part of the Graphite Flight Data Logger project, GPL-3.0 (see LICENSE)
+*/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <GR_Http.h>
+#include <GR_FlightLog.h>
+#include <GR_LogPack.h>
+
+#define GR_DL_NAME_MAX 48           // Longest log file name (no path), terminator included
+#define GR_DL_CSV_CHECKPOINTS 1024  // CSV offsets kept per file; a resume formats at most units / this many units it throws away
+#define GR_DL_READ_BUF 4096         // CSV: log records (or packed blocks) are read this many bytes at a time
+#define GR_DL_HEAD_MAX 512          // Biggest head() (headers + an error body)
+#define GR_DL_SECTOR 512            // Raw reads are kept aligned to this
+
+// Formats
+#define GR_DL_RAW 0
+#define GR_DL_CSV 1
+
+/// @brief Read only, random access view of one log file
+class GR_LogSource {
+  public:
+    virtual ~GR_LogSource() {}
+    virtual uint64_t size() = 0;
+    virtual bool seek(uint64_t pos) = 0;
+    /// @return bytes read (less than len only at the end of the file, or on an error)
+    virtual size_t read(void * buf, size_t len) = 0;
+};
+
+/// @brief Everything a download needs from the request, copied out of it so it can be handed to another task
+struct GR_LogDownloadJob {
+  char name[GR_DL_NAME_MAX] = "";  // File name, no path ("Flight_2024-05-01_12-00-00.grl")
+  uint8_t format = GR_DL_RAW;
+  char range[64] = "";             // Range header ("" if there wasn't one, or it was too long to be a single range)
+  char ifRange[64] = "";           // If-Range header
+  int id = -1;                     // For the caller (the socket it's answering on)
+
+  /// @brief ?file= (required) and ?format=raw|csv, plus the Range / If-Range headers
+  /// @return 0, or the status to answer with (400: no file, or a name that isn't a plain *.grl file name)
+  int parse(const GR_HttpRequest& req) {
+    char fmt[8];
+    if (!req.arg("file", name, sizeof(name)) || !validName(name)) return 400;
+    format = GR_DL_RAW;
+    if (req.arg("format", fmt, sizeof(fmt))) {
+      if (!strcmp(fmt, "csv")) format = GR_DL_CSV;
+      else if (strcmp(fmt, "raw") != 0) return 400;
+    }
+    if (!req.header("Range", range, sizeof(range))) range[0] = 0;
+    if (!req.header("If-Range", ifRange, sizeof(ifRange))) ifRange[0] = 0;
+    return 0;
+  }
+
+  /// @brief A log file name we're willing to open: no directories, no "..", ends in .grl
+  static bool validName(const char * s) {
+    size_t len = strlen(s);
+    if (len < 5 || len >= GR_DL_NAME_MAX || strcmp(s + len - 4, ".grl") != 0 || s[0] == '.') return false;
+    for (size_t i = 0; i < len; i++) {
+      char c = s[i];
+      if (c == '/' || c == '\\' || c < ' ' || c == '"' || c == ':') return false;
+    }
+    return true;
+  }
+};
+
+class GR_LogDownload {
+  public:
+    /// @brief Work out the response to job from the file behind src (nullptr: there isn't one). Reads the log header, and the whole
+    ///        file the first time a CSV is asked for. src must stay open until the last read()
+    /// @return the status: 200, 206, 404, 400 (not a log we can convert), 416, 500 (read error)
+    int begin(const GR_LogDownloadJob& job, GR_LogSource * src) {
+      src_ = src;
+      format_ = job.format;
+      failed_ = indexed_ = false;
+      sent_ = 0;
+      strcpy(name_, job.name);
+      if (!src) return fail(404, "No such log");
+
+      uint64_t fileSize = src->size();
+      memset(&header_, 0, sizeof(header_));
+      bool isLog = fileSize >= sizeof(header_) && src->seek(0) && src->read(&header_, sizeof(header_)) == sizeof(header_) &&
+                   GR_FlightLog::checkHeader(header_) && GR_LogPack::dataStart(header_) <= fileSize &&
+                   GR_LogPack::unitBytes(header_) <= GR_DL_READ_BUF;
+      uint64_t hash = GR_Http::fnv1a64(name_, strlen(name_));
+      hash = GR_Http::fnv1a64(&fileSize, sizeof(fileSize), hash);
+      hash = GR_Http::fnv1a64(&header_, sizeof(header_), hash);
+
+      if (format_ == GR_DL_CSV) {
+        if (!isLog) return fail(400, "Not a Graphite log this version can convert");
+        unitBytes_ = GR_LogPack::unitBytes(header_);
+        units_ = (fileSize - GR_LogPack::dataStart(header_)) / unitBytes_;
+        hash = GR_Http::fnv1a64("csv", 3, hash);
+        if (index_.key != hash || !index_.valid) {
+          if (!buildIndex(hash)) return fail(500, "Couldn't read the log");
+        }
+        total_ = index_.total;
+      } else {
+        total_ = fileSize;
+      }
+      GR_Http::etag(hash, etag_);
+
+      // Range, unless If-Range says the client's partial copy is of something else (it only ever gets our ETags, so exact match)
+      first_ = 0;
+      last_ = total_ ? total_ - 1 : 0;
+      status_ = 200;
+      if (job.range[0] && (!job.ifRange[0] || !strcmp(job.ifRange, etag_))) {
+        int r = GR_Http::parseRange(job.range, total_, first_, last_);
+        if (r < 0) return fail(416, "Range not satisfiable");
+        if (r > 0) status_ = 206;
+      }
+      if (!total_) { length_ = 0; return status_; }
+      length_ = last_ - first_ + 1;
+      if (!(format_ == GR_DL_CSV ? seekCsv(first_) : src_->seek(first_))) return fail(500, "Couldn't read the log");
+      return status_;
+    }
+
+    /// @brief Status line and headers for begin()'s answer (Connection: close; the body follows). Errors include their (short) body
+    /// @return length, 0 if max is too small (GR_DL_HEAD_MAX always fits)
+    size_t head(char * out, size_t max) const {
+      int n;
+      if (status_ >= 400) {
+        char range[40] = "";
+        if (status_ == 416) snprintf(range, sizeof(range), "Content-Range: bytes */%llu\r\n", (unsigned long long)total_);
+        n = snprintf(out, max, "HTTP/1.1 %s\r\nContent-Type: text/plain\r\nContent-Length: %u\r\n%sConnection: close\r\n\r\n%s",
+                     GR_Http::status(status_), unsigned(strlen(error_)), range, error_);
+      } else {
+        char range[80] = "";
+        if (status_ == 206) snprintf(range, sizeof(range), "Content-Range: bytes %llu-%llu/%llu\r\n", (unsigned long long)first_,
+                                     (unsigned long long)last_, (unsigned long long)total_);
+        size_t base = strlen(name_) - 4; // Without the .grl
+        n = snprintf(out, max, "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %llu\r\n%sAccept-Ranges: bytes\r\nETag: %s\r\n"
+                     "Cache-Control: no-cache\r\nContent-Disposition: attachment; filename=\"%.*s.%s\"\r\nConnection: close\r\n\r\n",
+                     GR_Http::status(status_), format_ == GR_DL_CSV ? "text/csv" : "application/octet-stream",
+                     (unsigned long long)length_, range, etag_, int(base), name_, format_ == GR_DL_CSV ? "csv" : "grl");
+      }
+      return n > 0 && size_t(n) < max ? size_t(n) : 0;
+    }
+
+    /// @brief Next piece of the body (up to max bytes; raw reads go straight from the file into out)
+    /// @return bytes, 0 once it's all been read (or the file couldn't be read, see failed())
+    size_t read(uint8_t * out, size_t max) {
+      if (status_ >= 300 || failed_ || sent_ >= length_) return 0;
+      uint64_t left = length_ - sent_;
+      if (max > left) max = size_t(left);
+      size_t n = 0;
+      if (format_ == GR_DL_RAW) {
+        // A range that starts mid sector gets a short first read, so every read after it starts on a sector boundary (SdFat
+        // reads those straight into out instead of through its one sector cache)
+        size_t misaligned = size_t((first_ + sent_) % GR_DL_SECTOR);
+        if (misaligned && max > GR_DL_SECTOR - misaligned) max = GR_DL_SECTOR - misaligned;
+        n = src_->read(out, max);
+      } else {
+        while (n < max) {
+          if (linePos_ == lineLen_) {
+            lineLen_ = nextLine(line_);
+            linePos_ = 0;
+            if (!lineLen_) break;
+          }
+          size_t take = lineLen_ - linePos_;
+          if (take > max - n) take = max - n;
+          memcpy(out + n, line_ + linePos_, take);
+          linePos_ += take;
+          n += take;
+        }
+      }
+      if (n < max) failed_ = true; // Ran out of file before Content-Length (it changed, or the card's unhappy)
+      sent_ += n;
+      return n;
+    }
+
+    int status() const { return status_; }
+    const char * etag() const { return etag_; }
+    /// @brief Body bytes (after the head)
+    uint64_t length() const { return length_; }
+    /// @brief Size of the whole thing (raw file / CSV) the body's a range of
+    uint64_t total() const { return total_; }
+    uint64_t first() const { return first_; }
+    /// @brief true if a read came up short; the client got less than Content-Length and knows it
+    bool failed() const { return failed_; }
+    /// @brief true if begin() had to format the whole file to size the CSV (i.e. it wasn't the last file converted)
+    bool indexed() const { return indexed_; }
+
+  private:
+    int fail(int status, const char * msg) {
+      status_ = status;
+      error_ = msg;
+      length_ = 0;
+      return status;
+    }
+
+    // CSV ----------------------------------------------------------------------------------------------------------------------
+
+    /// @brief Move to unit k: a record, or a block in a packed log (units_ is how many there are)
+    bool seekUnit(uint64_t k) {
+      unit_ = k;
+      bufPos_ = bufLen_ = 0;
+      unpack_.clear();
+      return src_->seek(GR_LogPack::dataStart(header_) + k * unitBytes_);
+    }
+
+    /// @brief Load the next unit from the file (through buf_) into unpack_. A packed block that doesn't decode just has no records
+    /// @return false at the end of the file (or if it couldn't be read)
+    bool nextUnit() {
+      if (bufPos_ == bufLen_) {
+        if (unit_ >= units_) return false;
+        uint64_t want = GR_DL_READ_BUF / unitBytes_;
+        if (want > units_ - unit_) want = units_ - unit_;
+        size_t got = src_->read(buf_, size_t(want) * unitBytes_);
+        bufLen_ = got / unitBytes_ * unitBytes_;
+        bufPos_ = 0;
+        if (!bufLen_) { unit_ = units_; return false; }
+      }
+      if (!unpack_.begin(header_, buf_ + bufPos_)) unpack_.clear();
+      bufPos_ += unitBytes_;
+      unit_++;
+      return true;
+    }
+
+    /// @brief Next record from the file
+    bool nextRecord(GR_LogRecord& r) {
+      while (!unpack_.next(r))
+        if (!nextUnit()) return false;
+      return true;
+    }
+
+    /// @brief Next CSV line (the header line, then one per record we know how to format)
+    /// @return length, 0 at the end
+    size_t nextLine(char * out) {
+      if (!headerDone_) {
+        headerDone_ = true;
+        size_t len = strlen(GR_FlightLog::csvHeader());
+        memcpy(out, GR_FlightLog::csvHeader(), len);
+        return len;
+      }
+      GR_LogRecord r;
+      while (nextRecord(r)) {
+        size_t len = GR_FlightLog::formatCsv(header_, r, out);
+        if (len) return len;
+      }
+      return 0;
+    }
+
+    /// @brief Format the whole file once, noting where every stride'th unit starts in the CSV
+    bool buildIndex(uint64_t key) {
+      index_.valid = false;
+      index_.key = key;
+      index_.stride = units_ / GR_DL_CSV_CHECKPOINTS + 1;
+      index_.count = 0;
+      uint64_t pos = strlen(GR_FlightLog::csvHeader());
+      if (!seekUnit(0)) return false;
+      GR_LogRecord r;
+      char line[GR_LOG_CSV_MAX_LINE];
+      for (uint64_t k = 0; k < units_; k++) {
+        if (k % index_.stride == 0) index_.offsets[index_.count++] = pos;
+        if (!nextUnit()) return false;
+        while (unpack_.next(r)) pos += GR_FlightLog::formatCsv(header_, r, line);
+      }
+      index_.total = pos;
+      index_.valid = true;
+      indexed_ = true;
+      return true;
+    }
+
+    /// @brief Get ready to produce the CSV from byte pos on
+    bool seekCsv(uint64_t pos) {
+      size_t hdrLen = strlen(GR_FlightLog::csvHeader());
+      lineLen_ = linePos_ = 0;
+      if (pos < hdrLen) { // Still in the header line
+        headerDone_ = false;
+        lineLen_ = nextLine(line_);
+        linePos_ = size_t(pos);
+        return seekUnit(0);
+      }
+      // Last checkpoint at or before pos, then format (and drop) whole lines until the one pos is in
+      size_t lo = 0, hi = index_.count;
+      while (hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+        if (index_.offsets[mid] <= pos) lo = mid;
+        else hi = mid;
+      }
+      headerDone_ = true;
+      if (!seekUnit(uint64_t(lo) * index_.stride)) return false;
+      uint64_t at = index_.offsets[lo];
+      for (;;) {
+        lineLen_ = nextLine(line_);
+        if (!lineLen_) return false;
+        if (at + lineLen_ > pos) break;
+        at += lineLen_;
+      }
+      linePos_ = size_t(pos - at);
+      return true;
+    }
+
+    struct CsvIndex {
+      uint64_t key = 0;     // ETag hash of the file it's for
+      bool valid = false;
+      uint64_t total = 0;   // CSV length
+      uint64_t stride = 1;  // Units (records, or packed blocks) between checkpoints
+      size_t count = 0;
+      uint64_t offsets[GR_DL_CSV_CHECKPOINTS]; // CSV offset of unit i * stride
+    };
+
+    GR_LogSource * src_ = nullptr;
+    uint8_t format_ = GR_DL_RAW;
+    char name_[GR_DL_NAME_MAX] = "";
+    GR_LogHeader header_;
+    char etag_[GR_HTTP_ETAG_LEN] = "";
+    int status_ = 0;
+    const char * error_ = "";
+    uint64_t total_ = 0, first_ = 0, last_ = 0, length_ = 0, sent_ = 0;
+    bool failed_ = false, indexed_ = false;
+    // CSV state
+    uint64_t units_ = 0, unit_ = 0;
+    size_t unitBytes_ = sizeof(GR_LogRecord);
+    bool headerDone_ = false;
+    uint8_t buf_[GR_DL_READ_BUF];
+    size_t bufPos_ = 0, bufLen_ = 0;
+    GR_LogUnpacker unpack_;
+    char line_[GR_LOG_CSV_MAX_LINE];
+    size_t lineLen_ = 0, linePos_ = 0;
+    CsvIndex index_;
+};
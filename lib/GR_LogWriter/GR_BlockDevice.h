@@ -0,0 +1,33 @@
+/*
+  GR_BlockDevice.h
+  Storage interface used by GR_LogWriter: one preallocated log file that's written sequentially in whole 512 byte sectors.
+  After a reset mid-flight the same file can be reopened and written from where the last sync() left off (GR_LogWriter::resume()).
+
+  Implementations: ESP_SdBlockDevice (SdFat on the logger's SD card, src/SDCard_ESP.h) and FakeBlockDevice (a regular file,
+  src/native/FakeBlockDevice.h).
+
+  Part of the Graphite Flight Data Logger project, GPL-3.0 (see LICENSE)
+*/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#define GR_SECTOR_SIZE 512
+
+class GR_BlockDevice {
+  public:
+    virtual ~GR_BlockDevice() {}
+    /// @brief Free space left on the card (bytes)
+    virtual uint64_t freeBytes() = 0;
+    /// @brief Create a new file and preallocate preallocBytes of contiguous space for it, so writes never have to touch the FAT
+    virtual bool create(const char * name, uint64_t preallocBytes) = 0;
+    /// @brief Write len bytes at the end of the file. len is always a multiple of GR_SECTOR_SIZE
+    virtual bool write(const uint8_t * buf, size_t len) = 0;
+    /// @brief Commit the file's size (directory entry) to the card, so everything written so far can be reopened after a reset
+    virtual bool sync() = 0;
+    /// @brief Reopen a log file that was never closed (the logger reset while writing it) to carry on at offset, which is a multiple of
+    ///        GR_SECTOR_SIZE and no further than the last sync(). Anything that was written past offset gets written over
+    virtual bool reopen(const char * name, uint64_t offset) = 0;
+    /// @brief Trim the file down to what was actually written and close it
+    virtual bool close() = 0;
+};
@@ -0,0 +1,243 @@
+/*
+  GR_LogWriter.h
+  Double (or more) buffered, sector aligned log file writer.
+
+  The producer (whoever calls append()) copies bytes into the active buffer. When a buffer fills up it's queued for the writer
+  task, which calls service() to write it to the GR_BlockDevice in one multi-sector write, then hands the buffer back. The
+  producer never waits on the SD card; if every buffer is still waiting to be written, the data is dropped and counted.
+
+  The log file is preallocated in begin(), so the card never has to allocate clusters in the middle of a flight (that's where
+  the multi-ms stalls come from). Once the preallocated space is used up, full() goes true and append() refuses more data. With
+  reserveTail() set, that happens early enough to leave room for useTail() + a few closing records (a "log full" event, say).
+
+  With syncEvery() set, the writer task also commits the file size to the card every so often, and synced() says how much of the
+  file would survive a reset. Save that somewhere that outlives the reset (see GR_Resume.h) and resume() picks the same file back up
+  from there; whatever was still in the buffers, or written after the last sync, is lost.
+
+  Threading: begin(), resume(), append() and end() must all be called from the same task (the producer); service() from one other
+  task. synced() can be read from anywhere. end() only closes the file once every buffer is back from the writer task, so it never
+  closes under a write; if the writer's stuck, the file stays open (isOpen() says no) and the next end() or begin() finishes the job.
+
+  Part of the Graphite Flight Data Logger project, GPL-3.0 (see LICENSE)
+*/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <GR_SensorHAL.h>
+#include <GR_RingBuffer.h>
+#include "GR_BlockDevice.h"
+
+/// @tparam BufferBytes size of each buffer (must be a multiple of GR_SECTOR_SIZE; bigger = fewer, longer writes)
+/// @tparam BufferCount number of buffers (2 = double buffered; more = more slack for a slow card)
+template <size_t BufferBytes, size_t BufferCount>
+class GR_LogWriter {
+  static_assert(BufferBytes % GR_SECTOR_SIZE == 0, "GR_LogWriter buffers must be whole sectors");
+  static_assert(BufferCount >= 2 && (BufferCount & (BufferCount - 1)) == 0, "GR_LogWriter buffer count must be a power of two >= 2");
+
+  public:
+    struct Stats {
+      uint32_t writes;        // Buffers written
+      uint32_t writeErrors;   // Buffers the device failed to write
+      uint32_t maxWriteUs;    // Worst case time for one buffer write (us)
+      uint32_t lastWriteUs;   // Time the most recent buffer write took (us)
+      uint64_t totalWriteUs;  // Total time spent writing (us), for the average
+      uint64_t bytesWritten;  // Bytes the device accepted
+      uint64_t bytesDropped;  // Bytes thrown away because no buffer was free (or the file was full)
+    };
+
+    GR_LogWriter(GR_BlockDevice& dev, GR_Clock& clock) : dev_(dev), clock_(clock) {
+      for (size_t b = 0; b < BufferCount; b++) free_.push(GR_RingIndex(b)); // The only time the producer pushes onto free_
+    }
+
+    /// @brief Check there's room for a log of preallocBytes, then create + preallocate it
+    /// @param reserveBytes extra free space to leave on the card on top of the log itself
+    /// @return false if there isn't enough room or the file couldn't be created (check spaceShort() to tell which)
+    bool begin(const char * name, uint64_t preallocBytes, uint64_t reserveBytes = 0) {
+      if (closing_) end(0); // An earlier end() that gave up waiting
+      if (open_) return false;
+      preallocBytes -= preallocBytes % BufferBytes; // Whole buffers only
+      spaceShort_ = dev_.freeBytes() < preallocBytes + reserveBytes;
+      if (spaceShort_ || preallocBytes == 0) return false;
+      if (!dev_.create(name, preallocBytes)) return false;
+      start(preallocBytes, 0);
+      return true;
+    }
+
+    /// @brief Pick up a log file that was left open by a reset, at offset (synced() from before the reset; rounded down to a sector)
+    /// @param preallocBytes what the file was begin()'d with
+    /// @return false if the file couldn't be reopened there (start a new one instead)
+    bool resume(const char * name, uint64_t preallocBytes, uint64_t offset) {
+      if (closing_) end(0);
+      if (open_) return false;
+      preallocBytes -= preallocBytes % BufferBytes;
+      offset -= offset % GR_SECTOR_SIZE;
+      if (offset >= preallocBytes || !dev_.reopen(name, offset)) return false;
+      start(preallocBytes, offset);
+      return true;
+    }
+
+    /// @brief Have the writer task sync() the file after every bytes written (0 = never; end() still does)
+    void syncEvery(uint64_t bytes) { syncBytes_ = bytes; }
+
+    /// @brief Keep the last bytes of every file back from append() (rounded up to a whole buffer), for after full(): see useTail()
+    void reserveTail(size_t bytes) { tailBytes_ = bytes; }
+
+    /// @brief Once full(), let append() have the reserved tail for the last few records, then end() the file
+    void useTail() {
+      if (!open_ || tailUsed_) return;
+      tailUsed_ = true;
+      isFull_ = queued_ + BufferBytes > capacity_;
+    }
+
+    /// @brief Copy bytes into the log. Never blocks
+    /// @return false if (some of) the data had to be dropped
+    bool append(const void * data, size_t len) {
+      if (!open_ || closing_ || isFull_) { stats_.bytesDropped += len; return false; }
+      const uint8_t * src = static_cast<const uint8_t *>(data);
+      while (len) {
+        if (active_ < 0 && !grabBuffer()) { stats_.bytesDropped += len; return false; }
+        size_t n = BufferBytes - fill_;
+        if (n > len) n = len;
+        memcpy(buf_[active_] + fill_, src, n);
+        fill_ += n; src += n; len -= n;
+        if (fill_ == BufferBytes) submit();
+        if (isFull_ && len) { stats_.bytesDropped += len; return false; }
+      }
+      return true;
+    }
+
+    /// @brief Write out whatever's queued (call from the writer task)
+    /// @return true if a buffer was written (call again), false if there was nothing to do
+    bool service() {
+      GR_RingIndex b;
+      if (!full_.pop(b)) return false;
+      uint64_t start = clock_.micros();
+      bool ok = dev_.write(buf_[b], lengths_[b]);
+      if (ok) {
+        written_ += lengths_[b];
+        if (syncBytes_ && written_ - syncedAt_ >= syncBytes_ && dev_.sync()) { // Counted in the write's time, it's part of the job
+          syncedAt_ = written_;
+          syncedSectors_ = uint32_t(written_ / GR_SECTOR_SIZE);
+        }
+      }
+      uint32_t took = uint32_t(clock_.micros() - start);
+      if (ok) { stats_.writes++; stats_.bytesWritten += lengths_[b]; }
+      else stats_.writeErrors++;
+      stats_.lastWriteUs = took;
+      stats_.totalWriteUs += took;
+      if (took > stats_.maxWriteUs) stats_.maxWriteUs = took;
+      free_.push(b);
+      return true;
+    }
+
+    /// @brief Queue the partially filled buffer for writing (zero padded to a whole sector)
+    void flush() {
+      if (!open_ || active_ < 0 || fill_ == 0) return;
+      size_t padded = (fill_ + GR_SECTOR_SIZE - 1) / GR_SECTOR_SIZE * GR_SECTOR_SIZE;
+      memset(buf_[active_] + fill_, 0, padded - fill_); // Zero padding reads back as GR_REC_PAD records, which decoders skip
+      fill_ = padded;
+      submit();
+    }
+
+    /// @brief flush(), wait for the writer task to write everything (including the one it's in the middle of), then close the file.
+    ///        timeoutMs bounds the wait in case the writer task is stuck on a dead card
+    /// @return false if it timed out (the file's left open for the writer task, see the top) or the close failed
+    bool end(uint32_t timeoutMs = 2000) {
+      if (!open_) return false;
+      flush();
+      closing_ = true; // No more appends
+      uint32_t start = clock_.millis();
+      while (!idle() && clock_.millis() - start < timeoutMs) clock_.sleepMs(1);
+      if (!idle()) return false;
+      closing_ = false;
+      open_ = false;
+      return dev_.close();
+    }
+
+    /// @brief True while a log is open for appending (false once end() has been called, even if it's still waiting on the writer task)
+    bool isOpen() const { return open_ && !closing_; }
+    /// @brief True once the preallocated file is used up (close it and stop logging)
+    bool full() const { return isFull_; }
+    /// @brief True if the last begin() failed because the card didn't have enough free space
+    bool spaceShort() const { return spaceShort_; }
+    /// @brief Bytes append() can take right now without dropping anything (producer side; use it to pace bulk appends)
+    size_t writable() const {
+      if (!open_ || closing_ || isFull_) return 0;
+      size_t n = free_.size() * BufferBytes + (active_ >= 0 ? BufferBytes - fill_ : 0);
+      uint64_t left = limit() - queued_; // Don't promise more than fits in the preallocated file
+      return n > left ? size_t(left) : n;
+    }
+    /// @brief Bytes appended so far, i.e. where the next append() lands in the file (producer side). Once synced() gets past this,
+    ///        everything before it is safe
+    uint64_t appended() const { return queued_ + fill_; }
+    /// @brief Bytes of the file that are on the card and would be there after a reset (what resume() wants)
+    uint64_t synced() const { return uint64_t(syncedSectors_) * GR_SECTOR_SIZE; }
+    /// @brief Buffers waiting for the writer task
+    size_t pending() const { return full_.size(); }
+    const Stats& stats() const { return stats_; }
+    uint32_t avgWriteUs() const { return stats_.writes ? uint32_t(stats_.totalWriteUs / stats_.writes) : 0; }
+
+  private:
+    typedef uint8_t GR_RingIndex;
+
+    /// @brief True when the writer task has handed every buffer back (nothing queued or being written)
+    bool idle() const { return free_.size() + (active_ >= 0 ? 1 : 0) == BufferCount; }
+
+    /// @brief Start over for a file that's open, with offset bytes already in it. Only ever called with no file open, so the writer task
+    ///        is idle() and the buffers are all back; the rings stay as they are (each keeps its one producer and one consumer)
+    void start(uint64_t preallocBytes, uint64_t offset) {
+      if (active_ < 0) grabBuffer();
+      fill_ = 0;
+      capacity_ = preallocBytes;
+      tailUsed_ = false;
+      queued_ = offset;
+      written_ = syncedAt_ = offset;
+      syncedSectors_ = uint32_t(offset / GR_SECTOR_SIZE);
+      isFull_ = queued_ + BufferBytes > limit();
+      stats_ = Stats();
+      open_ = true;
+    }
+
+    bool grabBuffer() {
+      GR_RingIndex b;
+      if (!free_.pop(b)) return false;
+      active_ = b;
+      fill_ = 0;
+      return true;
+    }
+
+    void submit() {
+      lengths_[active_] = fill_;
+      queued_ += fill_;
+      full_.push(GR_RingIndex(active_));
+      active_ = -1;
+      fill_ = 0;
+      if (queued_ + BufferBytes > limit()) isFull_ = true; // Next buffer wouldn't fit in the preallocated file (bar the tail)
+    }
+
+    /// @brief How far append() can fill the file: all of it, less the reserved tail until useTail()
+    uint64_t limit() const { return tailUsed_ || tailBytes_ >= capacity_ ? capacity_ : capacity_ - tailBytes_; }
+
+    GR_BlockDevice& dev_;
+    GR_Clock& clock_;
+    alignas(GR_CACHE_LINE) uint8_t buf_[BufferCount][BufferBytes]; // Cache line aligned so the SD driver can DMA straight out of them
+    size_t lengths_[BufferCount];
+    GR_RingBuffer<GR_RingIndex, BufferCount> full_;  // Producer -> writer task: buffers ready to write
+    GR_RingBuffer<GR_RingIndex, BufferCount> free_;  // Writer task -> producer: buffers ready to fill
+    int active_ = -1;       // Buffer the producer is filling (-1 = none)
+    size_t fill_ = 0;       // Bytes used in the active buffer
+    uint64_t capacity_ = 0; // Preallocated file size
+    uint64_t queued_ = 0;   // Bytes handed to the writer task so far
+    uint64_t written_ = 0;  // Bytes in the file (writer task only)
+    uint64_t syncedAt_ = 0; // written_ at the last sync() (writer task only)
+    uint64_t syncBytes_ = 0;
+    size_t tailBytes_ = 0;  // reserveTail()
+    bool tailUsed_ = false; // useTail() since start()
+    volatile uint32_t syncedSectors_ = 0; // synced() in sectors, so any task can read it in one go
+    bool open_ = false;
+    bool closing_ = false;  // end() is waiting for the writer task to finish before it closes the file
+    bool isFull_ = false;
+    bool spaceShort_ = false;
+    Stats stats_ = Stats();
+};
@@ -0,0 +1,292 @@
+/*
+  GR_Perf.h
+  Hot path latency probes. Each probe is a named histogram of how many CPU cycles a piece of code took, fed by a scoped timer:
+
+    GR_PERF_PROBE(io_perfLogTick, "logTick");   // Once, at file scope
+    ...
+    void onLogTick() {
+      GR_PERF_SCOPE(io_perfLogTick);            // Times from here to the end of the enclosing block
+      ...
+
+  Cost when enabled: two cycle counter reads, a count-leading-zeros and a handful of loads/stores (no locks, no atomic read-modify-writes).
+  When GR_PERF_ENABLE isn't defined the macros expand to nothing, so the probes can stay in the code for flights.
+
+  Histograms are log-linear: GR_PERF_SUB_BUCKETS buckets per power of two, so any percentile read back is within ~1/GR_PERF_SUB_BUCKETS
+  (12%) of the real value, over the whole range from 1 cycle to 2^32. Min / max / total are exact.
+
+  Rates (GR_PERF_RATE / GR_PERF_RATE_RECORD) are for things where the interesting number is throughput rather than latency, like
+  log downloads: each finished transfer's bytes and wall time (us), reported as last / best / overall KB/s.
+
+  CPU clock: the ESP32's cycle counter runs at whatever the CPU clock is, and the logger changes that with the flight phase. Tell
+  GR_PerfClock::setMHz() when it does; measurements are scaled to GR_PERF_CYCLES_PER_US cycles per us as they're recorded, so a
+  histogram stays in one unit across the change (/perf says what the clock is now).
+
+  Threading: every probe must only ever be recorded from one task (each probe here belongs to whichever task runs that code).
+  Readers (json(), teleplot()) can run on any task; they may see a sample half recorded (count bumped, total not yet) but never
+  block the writer. The ESP32's cycle counter is per core, which is fine since all our tasks are pinned.
+
+  Part of the Graphite Flight Data Logger project, GPL-3.0 (see LICENSE)
+*/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <atomic>
+
+#ifndef GR_PERF_CYCLES_PER_US
+  #if defined(ESP_PLATFORM)
+    #define GR_PERF_CYCLES_PER_US 240     // XIAO ESP32S3 runs at 240MHz
+  #else
+    #define GR_PERF_CYCLES_PER_US 1000    // Host: the "cycle" counter is the steady clock in ns
+  #endif
+#endif
+#define GR_PERF_SUB_BITS 3                // log2(GR_PERF_SUB_BUCKETS)
+#define GR_PERF_SUB_BUCKETS (1 << GR_PERF_SUB_BITS)
+#define GR_PERF_BUCKETS ((32 - GR_PERF_SUB_BITS + 1) * GR_PERF_SUB_BUCKETS)
+
+#if defined(ESP_PLATFORM)
+  #include <esp_cpu.h>
+  static inline uint32_t GR_perfCycles() { return esp_cpu_get_ccount(); }
+#else
+  #include <chrono>
+  static inline uint32_t GR_perfCycles() {
+    return uint32_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+  }
+#endif
+
+/// @brief What the cycle counter is running at right now. A measurement that was under way when it changed gets scaled by the new
+///        clock (off by the ratio, that once)
+class GR_PerfClock {
+  public:
+    /// @brief The CPU clock just changed to mhz (the cycle counter's rate)
+    static void setMHz(uint32_t mhz) {
+      if (!mhz) return;
+      mhz_().store(mhz, std::memory_order_relaxed);
+      scale_().store(uint32_t((uint64_t(GR_PERF_CYCLES_PER_US) << 16) / mhz), std::memory_order_relaxed);
+    }
+    static uint32_t mhz() { return mhz_().load(std::memory_order_relaxed); }
+
+    /// @brief Cycles at the current clock -> cycles at GR_PERF_CYCLES_PER_US (saturates at 2^32 - 1). Free at the usual clock
+    static uint32_t toRef(uint32_t cycles) {
+      uint32_t scale = scale_().load(std::memory_order_relaxed); // 16.16 fixed point
+      if (scale == 1u << 16) return cycles;
+      uint64_t v = (uint64_t(cycles) * scale) >> 16;
+      return v > UINT32_MAX ? UINT32_MAX : uint32_t(v);
+    }
+
+  private:
+    static std::atomic<uint32_t>& mhz_() { static std::atomic<uint32_t> m(GR_PERF_CYCLES_PER_US); return m; }
+    static std::atomic<uint32_t>& scale_() { static std::atomic<uint32_t> s(1u << 16); return s; }
+};
+
+class GR_PerfProbe {
+  public:
+    /// @param name shows up in the JSON / Teleplot output. Must be a string literal (or otherwise outlive the probe)
+    GR_PerfProbe(const char * name) : name_(name), next_(head()) { head() = this; reset(); }
+
+    /// @brief Record one measurement (cycles at the current clock, see GR_PerfClock). Only call from the probe's own task
+    void record(uint32_t cycles) {
+      cycles = GR_PerfClock::toRef(cycles);
+      uint32_t b = bucket(cycles);
+      hist_[b].store(hist_[b].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      total_ += cycles;
+      if (cycles < min_.load(std::memory_order_relaxed)) min_.store(cycles, std::memory_order_relaxed);
+      if (cycles > max_.load(std::memory_order_relaxed)) max_.store(cycles, std::memory_order_relaxed);
+      count_.store(count_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /// @brief Forget everything recorded so far (racy vs a concurrent record(), which just means one sample may be off)
+    void reset() {
+      for (auto& h : hist_) h.store(0, std::memory_order_relaxed);
+      total_ = 0;
+      min_.store(UINT32_MAX, std::memory_order_relaxed);
+      max_.store(0, std::memory_order_relaxed);
+      count_.store(0, std::memory_order_release);
+    }
+
+    const char * name() const { return name_; }
+    uint32_t count() const { return count_.load(std::memory_order_acquire); }
+    float minUs() const { return count() ? min_.load(std::memory_order_relaxed) / float(GR_PERF_CYCLES_PER_US) : 0; }
+    float maxUs() const { return max_.load(std::memory_order_relaxed) / float(GR_PERF_CYCLES_PER_US); }
+    float meanUs() const { uint32_t n = count(); return n ? total_ / float(n) / GR_PERF_CYCLES_PER_US : 0; }
+
+    /// @brief Approximate percentile (p = 0..1), from the histogram (midpoint of the bucket it falls in, clamped to min / max)
+    float percentileUs(float p) const {
+      uint64_t n = 0;
+      for (auto& h : hist_) n += h.load(std::memory_order_relaxed);
+      if (n == 0) return 0;
+      uint64_t rank = uint64_t(p * (n - 1)) + 1, seen = 0;
+      for (uint32_t b = 0; b < GR_PERF_BUCKETS; b++) {
+        seen += hist_[b].load(std::memory_order_relaxed);
+        if (seen < rank) continue;
+        float lo = bucketStart(b), hi = b + 1 < GR_PERF_BUCKETS ? bucketStart(b + 1) : 4294967296.0f;
+        float v = (lo + hi) / 2, mn = float(min_.load(std::memory_order_relaxed)), mx = float(max_.load(std::memory_order_relaxed));
+        if (v < mn) v = mn;
+        if (v > mx) v = mx;
+        return v / GR_PERF_CYCLES_PER_US;
+      }
+      return maxUs();
+    }
+
+    GR_PerfProbe * next() const { return next_; }
+    /// @brief First probe in the list of every probe in the program (most recently constructed first)
+    static GR_PerfProbe *& head() { static GR_PerfProbe * h = nullptr; return h; }
+
+    /// @brief Histogram bucket for a value: the first GR_PERF_SUB_BUCKETS values get one each, after that GR_PERF_SUB_BUCKETS per power of 2
+    static uint32_t bucket(uint32_t v) {
+      if (v < GR_PERF_SUB_BUCKETS) return v;
+      uint32_t msb = 31 - __builtin_clz(v);
+      uint32_t shift = msb - GR_PERF_SUB_BITS;
+      return ((shift + 1) << GR_PERF_SUB_BITS) + ((v >> shift) & (GR_PERF_SUB_BUCKETS - 1));
+    }
+    /// @brief Smallest value that lands in bucket b
+    static float bucketStart(uint32_t b) {
+      if (b < GR_PERF_SUB_BUCKETS) return float(b);
+      uint32_t shift = (b >> GR_PERF_SUB_BITS) - 1;
+      return float(uint64_t(GR_PERF_SUB_BUCKETS + (b & (GR_PERF_SUB_BUCKETS - 1))) << shift);
+    }
+
+  private:
+    const char * name_;
+    GR_PerfProbe * next_;
+    std::atomic<uint32_t> hist_[GR_PERF_BUCKETS];
+    volatile uint64_t total_;  // Not atomic: 64 bit atomics aren't lock-free on the ESP32. A reader can catch it torn (mean off for one read)
+    std::atomic<uint32_t> min_, max_, count_;
+};
+
+/// @brief Times from construction to the end of the scope into a probe
+class GR_PerfScope {
+  public:
+    GR_PerfScope(GR_PerfProbe& probe) : probe_(probe), start_(GR_perfCycles()) {}
+    ~GR_PerfScope() { probe_.record(GR_perfCycles() - start_); }
+  private:
+    GR_PerfProbe& probe_;
+    uint32_t start_;
+};
+
+/// @brief Sustained throughput of something that moves bytes a transfer at a time (log downloads): bytes over wall time, per transfer
+///        and in total. Same threading rules as a probe (one task records, anyone reads)
+class GR_PerfRate {
+  public:
+    /// @param name as for GR_PerfProbe
+    GR_PerfRate(const char * name) : name_(name), next_(head()) { head() = this; reset(); }
+
+    /// @brief Record one finished (or abandoned) transfer: bytes moved in us microseconds
+    void record(uint64_t bytes, uint64_t us) {
+      if (!us) us = 1;
+      float kBps = bytes * (1e6f / 1024.0f) / us;
+      last_ = kBps;
+      if (kBps > best_) best_ = kBps;
+      bytes_ += bytes;
+      us_ += us;
+      count_.store(count_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    void reset() {
+      bytes_ = 0;
+      us_ = 0;
+      last_ = best_ = 0;
+      count_.store(0, std::memory_order_release);
+    }
+
+    const char * name() const { return name_; }
+    uint32_t count() const { return count_.load(std::memory_order_acquire); }
+    uint64_t bytes() const { return bytes_; }
+    float seconds() const { return us_ / 1e6f; }
+    /// @brief Over every transfer so far (total bytes / total time), in KB/s
+    float meanKBps() const { uint64_t us = us_; return us ? bytes_ * (1e6f / 1024.0f) / us : 0; }
+    float lastKBps() const { return last_; }
+    float bestKBps() const { return best_; }
+
+    GR_PerfRate * next() const { return next_; }
+    static GR_PerfRate *& head() { static GR_PerfRate * h = nullptr; return h; }
+
+  private:
+    const char * name_;
+    GR_PerfRate * next_;
+    volatile uint64_t bytes_, us_;  // Not atomic, see GR_PerfProbe::total_
+    volatile float last_, best_;
+    std::atomic<uint32_t> count_;
+};
+
+namespace GR_Perf {
+  /// @brief Every probe (and rate) as JSON: {"enabled":true,"cyclesPerUs":240,"cpuMHz":80,"probes":[{"name":..,"count":..,"minUs":..,
+  ///        "meanUs":..,"p50Us":..,"p90Us":..,"p99Us":..,"maxUs":..},...],"rates":[{"name":..,"count":..,"bytes":..,"seconds":..,
+  ///        "meanKBps":..,"lastKBps":..,"bestKBps":..},...]}
+  ///        cyclesPerUs is what every time was converted at, cpuMHz the clock now (measurements taken at another were scaled to it)
+  /// @return length written (not counting the terminator). Output is cut short (but still terminated) if it doesn't fit
+  inline size_t json(char * out, size_t max) {
+    size_t len = 0;
+    auto put = [&](int n) { if (n > 0) len += size_t(n); if (len >= max) len = max ? max - 1 : 0; };
+#ifdef GR_PERF_ENABLE
+    put(snprintf(out, max, "{\"enabled\":true,\"cyclesPerUs\":%d,\"cpuMHz\":%lu,\"probes\":[", GR_PERF_CYCLES_PER_US,
+                 (unsigned long)GR_PerfClock::mhz()));
+    for (const GR_PerfProbe * p = GR_PerfProbe::head(); p; p = p->next()) {
+      put(snprintf(out + len, max - len, "%s{\"name\":\"%s\",\"count\":%lu,\"minUs\":%.2f,\"meanUs\":%.2f,\"p50Us\":%.2f,\"p90Us\":%.2f,"
+                   "\"p99Us\":%.2f,\"maxUs\":%.2f}", p == GR_PerfProbe::head() ? "" : ",", p->name(), (unsigned long)p->count(),
+                   p->minUs(), p->meanUs(), p->percentileUs(0.5f), p->percentileUs(0.9f), p->percentileUs(0.99f), p->maxUs()));
+    }
+    put(snprintf(out + len, max - len, "],\"rates\":["));
+    for (const GR_PerfRate * r = GR_PerfRate::head(); r; r = r->next()) {
+      put(snprintf(out + len, max - len, "%s{\"name\":\"%s\",\"count\":%lu,\"bytes\":%llu,\"seconds\":%.2f,\"meanKBps\":%.1f,\"lastKBps\":%.1f,"
+                   "\"bestKBps\":%.1f}", r == GR_PerfRate::head() ? "" : ",", r->name(), (unsigned long)r->count(),
+                   (unsigned long long)r->bytes(), r->seconds(), r->meanKBps(), r->lastKBps(), r->bestKBps()));
+    }
+    put(snprintf(out + len, max - len, "]}"));
+#else
+    put(snprintf(out, max, "{\"enabled\":false,\"probes\":[],\"rates\":[]}"));
+#endif
+    return len;
+  }
+
+  /// @brief Every probe's mean / p99 / max in Teleplot's ">name:value" format, one per line
+  /// @return length written (not counting the terminator)
+  inline size_t teleplot(char * out, size_t max) {
+    size_t len = 0;
+    if (max) out[0] = 0;
+#ifdef GR_PERF_ENABLE
+    for (const GR_PerfProbe * p = GR_PerfProbe::head(); p; p = p->next()) {
+      if (!p->count()) continue;
+      int n = snprintf(out + len, max - len, ">perf.%s.mean(us):%.2f\n>perf.%s.p99(us):%.2f\n>perf.%s.max(us):%.2f\n", p->name(), p->meanUs(),
+                       p->name(), p->percentileUs(0.99f), p->name(), p->maxUs());
+      if (n > 0) len += size_t(n);
+      if (len >= max) { len = max ? max - 1 : 0; return len; }
+    }
+    for (const GR_PerfRate * r = GR_PerfRate::head(); r; r = r->next()) {
+      if (!r->count()) continue;
+      int n = snprintf(out + len, max - len, ">perf.%s.last(KB/s):%.1f\n>perf.%s.mean(KB/s):%.1f\n", r->name(), r->lastKBps(), r->name(),
+                       r->meanKBps());
+      if (n > 0) len += size_t(n);
+      if (len >= max) { len = max ? max - 1 : 0; break; }
+    }
+#endif
+    return len;
+  }
+
+  /// @brief Reset every probe and rate
+  inline void resetAll() {
+    for (GR_PerfProbe * p = GR_PerfProbe::head(); p; p = p->next()) p->reset();
+    for (GR_PerfRate * r = GR_PerfRate::head(); r; r = r->next()) r->reset();
+  }
+}
+
+#ifdef GR_PERF_ENABLE
+  #define GR_PERF_CAT2(a, b) a##b
+  #define GR_PERF_CAT(a, b) GR_PERF_CAT2(a, b)
+  /// @brief Define a probe (file scope)
+  #define GR_PERF_PROBE(id, name) GR_PerfProbe id(name)
+  /// @brief Time the rest of the enclosing scope into probe id
+  #define GR_PERF_SCOPE(id) GR_PerfScope GR_PERF_CAT(grPerfScope_, __LINE__)(id)
+  /// @brief Record a measurement taken some other way (cycles)
+  #define GR_PERF_RECORD(id, cycles) (id).record(cycles)
+  /// @brief Define a throughput rate (file scope)
+  #define GR_PERF_RATE(id, name) GR_PerfRate id(name)
+  /// @brief Record one transfer into rate id
+  #define GR_PERF_RATE_RECORD(id, bytes, us) (id).record(bytes, us)
+#else
+  #define GR_PERF_PROBE(id, name)
+  #define GR_PERF_SCOPE(id)
+  #define GR_PERF_RECORD(id, cycles)
+  #define GR_PERF_RATE(id, name)
+  #define GR_PERF_RATE_RECORD(id, bytes, us)
+#endif
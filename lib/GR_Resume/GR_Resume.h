@@ -0,0 +1,103 @@
+/*
+  GR_Resume.h
+  What the logger needs to carry on with a flight after it resets in the middle of one (brownout, watchdog, crash): armed / launched /
+  apogee / landed, the decisions behind them, and where the log file's up to. The logger keeps two copies in memory that survives a
+  reset but not a power cycle (RTC_NOINIT on the ESP32) and re-saves them in turn as things change, so a reset halfway through a save
+  still leaves the other one; setup() checks them first thing, and if the newest is armed, skips straight to sensors + logging (see
+  the boot notes in main.cpp).
+
+  Nothing in here touches hardware. The record is sealed with a checksum, so whatever's in that memory after a power cycle (or a
+  firmware with a different layout) just reads as "nothing to resume".
+
+  Part of the Graphite Flight Data Logger project, GPL-3.0 (see LICENSE)
+*/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define GR_RESUME_MAGIC 0x53525247u   // "GRRS"
+#define GR_RESUME_VERSION 2
+#define GR_RESUME_NAME_MAX 48         // Log file path, with the terminator
+#define GR_RESUME_MAX_GAP_US 60000000 // A wall clock gap longer than this (60s) across a reset means the wall clock's wrong, not the reset
+
+// GR_ResumeState::logged: flight events that are on the card (before logOffset). Ones that aren't get logged again after the reset
+#define GR_RESUME_LOGGED_LAUNCH 0x01
+#define GR_RESUME_LOGGED_APOGEE 0x02
+#define GR_RESUME_LOGGED_LANDED 0x04
+
+struct GR_ResumeState {
+  uint32_t magic;         // GR_RESUME_MAGIC
+  uint16_t version;       // GR_RESUME_VERSION
+  uint16_t size;          // sizeof(GR_ResumeState)
+  uint8_t armed, launched, apogee, landed;
+  uint8_t launchReason;   // GR_LAUNCH_* (GR_LaunchDetect::Result)
+  uint8_t timeSynced;     // The wall clock had been set from a phone
+  uint16_t resumes;       // How many times this flight has already been resumed
+  uint64_t savedUs;       // Logger clock at the last save
+  int64_t wallUs;         // Wall clock at the last save (us since the epoch), to tell how long the reset took
+  uint64_t launchT0Us, launchDetectUs;
+  float baselineM;        // Launch detector's pad baseline
+  float apogeeM, landedM; // GR_ApogeeLandingDetect events (filter altitude)
+  float altM, velocity;   // GR_AltitudeKF state at savedUs (once launched)
+  uint32_t seq;           // Bumped every save; of the copies kept (see newest()), the highest valid one wins
+  uint64_t apogeeUs, landedUs;
+  uint64_t logPrealloc;   // What the log file was begin()'d with (0 = no log open)
+  uint64_t logOffset;     // GR_LogWriter::synced()
+  char logName[GR_RESUME_NAME_MAX];
+  uint32_t logPackBlock;  // Block size if the log's packed (GR_LogPack.h; resume at a block boundary), 0 if not
+  uint32_t logged;        // GR_RESUME_LOGGED_*
+  uint32_t check;         // checksum() of everything above
+};
+
+class GR_Resume {
+  public:
+    /// @brief FNV-1a over everything but the check field
+    static uint32_t checksum(const GR_ResumeState& s) {
+      const uint8_t * p = reinterpret_cast<const uint8_t *>(&s);
+      uint32_t h = 2166136261u;
+      for (size_t i = 0; i < offsetof(GR_ResumeState, check); i++) { h ^= p[i]; h *= 16777619u; }
+      return h;
+    }
+
+    /// @brief Fill in the magic, version, size and checksum (after setting everything else)
+    static void seal(GR_ResumeState& s) {
+      s.magic = GR_RESUME_MAGIC;
+      s.version = GR_RESUME_VERSION;
+      s.size = sizeof(GR_ResumeState);
+      s.check = checksum(s);
+    }
+
+    /// @brief True if s was sealed by this layout and hasn't been touched since
+    static bool valid(const GR_ResumeState& s) {
+      return s.magic == GR_RESUME_MAGIC && s.version == GR_RESUME_VERSION && s.size == sizeof(GR_ResumeState) && s.check == checksum(s) &&
+             memchr(s.logName, 0, sizeof(s.logName));
+    }
+
+    /// @brief The newest valid record of n copies, or NULL if there isn't one
+    static const GR_ResumeState * newest(const GR_ResumeState * copies, size_t n) {
+      const GR_ResumeState * best = NULL;
+      for (size_t i = 0; i < n; i++)
+        if (valid(copies[i]) && (!best || int32_t(copies[i].seq - best->seq) > 0)) best = &copies[i];
+      return best;
+    }
+
+    /// @brief Nothing to resume
+    static void clear(GR_ResumeState& s) { memset(&s, 0, sizeof(s)); }
+
+    /// @brief What the logger clock should read now, so timestamps carry on from before the reset instead of starting over at 0
+    /// @param wallNowUs wall clock now (survives the reset on the ESP32)
+    /// @param bootUs time since this boot: the fallback when the wall clock didn't survive (then the reset's own length is lost)
+    static uint64_t clockNow(const GR_ResumeState& s, int64_t wallNowUs, uint64_t bootUs) {
+      int64_t gap = wallNowUs - s.wallUs;
+      if (gap < int64_t(bootUs) || gap > GR_RESUME_MAX_GAP_US) gap = int64_t(bootUs);
+      return s.savedUs + uint64_t(gap);
+    }
+
+    /// @brief Copy a log file name in (cut short if it's too long; it's only ever one of ours)
+    static void setName(GR_ResumeState& s, const char * name) {
+      size_t n = strnlen(name, sizeof(s.logName) - 1);
+      memcpy(s.logName, name, n);
+      s.logName[n] = 0;
+    }
+};
@@ -0,0 +1,92 @@
+/*
+  GR_RingBuffer.h
+  Fixed capacity, wait-free single-producer / single-consumer ring buffer.
+
+  Used to hand sample records from the sampling task (producer, core 1) to the task that logs / serves them (consumer, core 0)
+  without locks, without malloc, and without either side ever waiting on the other. If the consumer falls behind the newest
+  records are dropped (push() returns false) and counted in overflows(), rather than blocking the sampling task.
+
+  Rules:
+    - Exactly one task may call push(), and exactly one (other) task may call pop() / popBatch().
+    - Capacity must be a power of two. One slot is NOT wasted; all Capacity slots are usable.
+    - T should be a small trivially copyable struct (it gets copied in and out).
+
+  Checked on a host with a producer and a consumer thread (tools/GraphiteRingBufferTest.cpp).
+
+  Part of the Graphite Flight Data Logger project, GPL-3.0 (see LICENSE)
+*/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <type_traits>
+
+#ifndef GR_CACHE_LINE
+  #define GR_CACHE_LINE 64  // Keeps the producer and consumer indices off each other's cache lines (ESP32-S3 lines are 32 bytes, 64 covers both)
+#endif
+
+template <typename T, size_t Capacity>
+class GR_RingBuffer {
+  static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "GR_RingBuffer capacity must be a power of two");
+  static_assert(std::is_trivially_copyable<T>::value, "GR_RingBuffer records must be trivially copyable");
+
+  public:
+    GR_RingBuffer() : head_(0), overflows_(0), tail_(0) {}
+
+    // Producer side ---------------------------------------------------------
+
+    /// @brief Add a record. Never blocks
+    /// @return false (and the record is dropped + counted as an overflow) if the buffer is full
+    bool push(const T& item) {
+      uint32_t head = head_.load(std::memory_order_relaxed);
+      if (head - tail_.load(std::memory_order_acquire) >= Capacity) {
+        overflows_.store(overflows_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); // Only the producer writes this
+        return false;
+      }
+      buf_[head & (Capacity - 1)] = item;
+      head_.store(head + 1, std::memory_order_release);
+      return true;
+    }
+
+    // Consumer side ---------------------------------------------------------
+
+    /// @brief Take the oldest record
+    /// @return false if the buffer was empty
+    bool pop(T& item) {
+      uint32_t tail = tail_.load(std::memory_order_relaxed);
+      if (tail == head_.load(std::memory_order_acquire)) return false;
+      item = buf_[tail & (Capacity - 1)];
+      tail_.store(tail + 1, std::memory_order_release);
+      return true;
+    }
+
+    /// @brief Take up to maxItems of the oldest records in one go (cheaper than calling pop() in a loop; one index update per batch)
+    /// @return number of records copied to out
+    size_t popBatch(T* out, size_t maxItems) {
+      uint32_t tail = tail_.load(std::memory_order_relaxed);
+      size_t n = head_.load(std::memory_order_acquire) - tail;
+      if (n > maxItems) n = maxItems;
+      for (size_t i = 0; i < n; i++) {
+        out[i] = buf_[(tail + i) & (Capacity - 1)];
+      }
+      tail_.store(tail + n, std::memory_order_release);
+      return n;
+    }
+
+    // Either side -----------------------------------------------------------
+
+    /// @brief Records currently waiting (a snapshot; may be stale by the time you use it)
+    size_t size() const { return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire); }
+    bool empty() const { return size() == 0; }
+    static constexpr size_t capacity() { return Capacity; }
+    /// @brief Total records dropped because the buffer was full
+    uint32_t overflows() const { return overflows_.load(std::memory_order_relaxed); }
+    /// @brief Total records ever pushed successfully
+    uint32_t pushed() const { return head_.load(std::memory_order_relaxed); }
+
+  private:
+    alignas(GR_CACHE_LINE) std::atomic<uint32_t> head_;      // Written by the producer only
+    std::atomic<uint32_t> overflows_;                         // Written by the producer only
+    alignas(GR_CACHE_LINE) std::atomic<uint32_t> tail_;      // Written by the consumer only
+    alignas(GR_CACHE_LINE) T buf_[Capacity];
+};
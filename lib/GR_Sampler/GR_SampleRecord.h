@@ -0,0 +1,55 @@
+/*
+  GR_SampleRecord.h
+  One set of sensor readings lined up on one time, as produced by the sampling task every log tick and handed to the consumers
+  (web status, SD logging) through a GR_RingBuffer. Also the raw accelerometer + altimeter samples the sampling task keeps to work
+  them out from (see GR_Track in GR_Align.h).
+
+  Only the raw measurements are stored; everything else (F, K, ft, volts, g, m/s^2) is worked out when a consumer asks for it.
+
+  Part of the Graphite Flight Data Logger project, GPL-3.0 (see LICENSE)
+*/
+#pragma once
+#include <stdint.h>
+
+#ifndef GR_GRAVITY
+  #define GR_GRAVITY 9.80665f  // m/s^2
+#endif
+#define GR_FT_PER_M 3.280839895f
+
+/// @brief One filtered accelerometer sample (raw ADC counts, as floats so it can be interpolated)
+struct GR_AccelSample {
+  float x, y, z;
+
+  GR_AccelSample& operator+=(const GR_AccelSample& o) { x += o.x; y += o.y; z += o.z; return *this; }
+  GR_AccelSample operator*(float k) const { return {x * k, y * k, z * k}; }
+};
+
+/// @brief One altimeter sample
+struct GR_BaroSample {
+  float tempC;    // DPS310 temperature (C)
+  float pressPa;  // DPS310 pressure (Pa)
+  float altM;     // Barometric altitude (m)
+
+  GR_BaroSample& operator+=(const GR_BaroSample& o) { tempC += o.tempC; pressPa += o.pressPa; altM += o.altM; return *this; }
+  GR_BaroSample& operator-=(const GR_BaroSample& o) { tempC -= o.tempC; pressPa -= o.pressPa; altM -= o.altM; return *this; }
+  GR_BaroSample operator*(float k) const { return {tempC * k, pressPa * k, altM * k}; }
+};
+
+struct GR_SampleRecord {
+  uint64_t timeUs;                        // Clock micros() the readings below are all for (a little before the record was made)
+  float xAccelRaw, yAccelRaw, zAccelRaw;  // Raw ADXL377 ADC counts (filtered)
+  float tempC;                            // DPS310 temperature (C)
+  float pressPa;                          // DPS310 pressure (Pa)
+  float altM;                             // Barometric altitude (m)
+  float battRaw;                          // Raw battery divider ADC counts
+
+  float tempF() const { return tempC * 1.8f + 32; }
+  float tempK() const { return tempC + 273.15f; }
+  float altFt() const { return altM * GR_FT_PER_M; }
+  /// @brief Battery voltage: divided by 2 on the board, 3.3V reference, 12 bit ADC
+  float battV() const { return battRaw * 2 * 3.3f / 4096; }
+
+  /// @brief Acceleration (g / m/s^2) from raw counts using a calibration zero point + coefficient (cal_zero*Accel / cal_*AccelCoef)
+  static float accelG(float raw, float zero, float coef) { return (raw - zero) * coef; }
+  static float accelMs2(float raw, float zero, float coef) { return accelG(raw, zero, coef) * GR_GRAVITY; }
+};
@@ -0,0 +1,189 @@
+/*
+  GR_Sampler.h
+  Sensor acquisition scheduling, independent of where it runs.
+
+  On the logger this is driven by io_samplingTask (pinned to core 1, see main.cpp) so web server traffic on core 0 can't
+  stall it. On the native build it's driven by a fake clock and fake sensors (see src/native/main.cpp).
+
+  The sampler only decides *when* each sensor is read and hands the raw values to a GR_SampleSink; what happens to the
+  samples afterwards (alignment, calibration, logging) is the sink's business. Every sample goes to the sink with the time it was
+  taken: the sensor's own idea of that if it has one (GR_AccelTriple::timeUs, sampleUs()), otherwise the time it was read. Samples
+  from a streaming sensor come in bursts, so the times run behind the clock and the streams don't arrive in time order between
+  them (see GR_Align.h).
+
+  Scheduling: every channel (accel, baro, batt, log tick) has a period in us and a deadline. poll() releases every channel whose
+  deadline has passed and moves its deadline forward by whole periods (deadline += period, never deadline = now + period), so
+  time spent doing the work or waking up late never adds up into drift. If a channel fell more than a period behind, the
+  periods it missed are skipped (counted as missed deadlines) instead of being run back to back to catch up. poll() returns the
+  next deadline and the caller sleeps until then with GR_Clock::sleepUntilUs() (a one-shot hardware timer on the logger).
+
+  Per channel it also keeps a histogram of how late each release was vs its deadline (jitter) and how many periods were missed.
+
+  Part of the Graphite Flight Data Logger project, GPL-3.0 (see LICENSE)
+*/
+#pragma once
+#include <stdint.h>
+#include <GR_SensorHAL.h>
+
+#ifndef GR_ACCEL_BURST
+  #define GR_ACCEL_BURST 16  // Max accelerometer samples pulled from a streaming sensor per readBuffered() call
+#endif
+#ifndef GR_BARO_BURST
+  #define GR_BARO_BURST 8    // Max barometer measurements pulled from a sensor's FIFO per readBuffered() call
+#endif
+#define GR_JITTER_BUCKETS 12   // Lateness histogram buckets: <16us, <32us, <64us ... doubling ... <16ms, and >=16ms
+#define GR_JITTER_MIN_US 16    // Upper edge of the first bucket
+#define GR_MISS_BUCKETS 5      // Missed period histogram: 1, 2, 3, 4 and 5+ periods skipped in one go
+
+// Channels (index into Stats::ch)
+#define GR_CH_ACCEL 0
+#define GR_CH_BARO  1
+#define GR_CH_BATT  2
+#define GR_CH_LOG   3
+#define GR_CH_COUNT 4
+
+/// @brief Receives raw samples from GR_Sampler. All callbacks run on the sampling task, keep them short!
+///        timeUs is when the sample was taken (clock micros()); in order within each stream, not across them
+class GR_SampleSink {
+  public:
+    virtual ~GR_SampleSink() {}
+    virtual void onAccel(uint64_t timeUs, int x, int y, int z) = 0;
+    virtual void onBaro(uint64_t timeUs, float tempC, float pressPa) = 0;
+    virtual void onBatt(uint64_t timeUs, int raw) = 0;
+    /// @brief Called every logUs, after that tick's samples have been collected (timeUs = now)
+    virtual void onLogTick(uint64_t timeUs) = 0;
+};
+
+class GR_Sampler {
+  public:
+    /// @brief Sample / log periods in us
+    struct Rates {
+      uint32_t accelUs;
+      uint32_t altUs;
+      uint32_t battUs;
+      uint32_t logUs;
+    };
+
+    /// @brief Release timing for one channel
+    struct Channel {
+      uint32_t releases;                     // Times the channel ran
+      uint32_t missed;                       // Deadlines skipped because the previous release was more than a period late
+      uint32_t maxLateUs;                    // Latest release vs its deadline
+      uint32_t lateHist[GR_JITTER_BUCKETS];  // Lateness histogram (see bucketUs())
+      uint32_t missHist[GR_MISS_BUCKETS];    // How many periods were skipped at once (1, 2, ... GR_MISS_BUCKETS or more)
+    };
+
+    /// @brief Per-sensor sample counters (handy for checking the sample rate holds up) + per channel timing
+    struct Stats {
+      uint32_t accelSamples;
+      uint32_t altSamples;
+      uint32_t battSamples;
+      uint32_t logTicks;
+      uint32_t maxPollUs;  // Longest time a single poll() took to run (us)
+      Channel ch[GR_CH_COUNT];
+    };
+
+    GR_Sampler(GR_Clock& clock, GR_AccelSensor& accel, GR_BaroSensor& baro, GR_BattSensor& batt, GR_SampleSink& sink, Rates rates)
+      : clock_(clock), accel_(accel), baro_(baro), batt_(batt), sink_(sink), rates_(rates), stats_() {
+      reset();
+    }
+
+    /// @brief Restart all deadlines from now (call when the sampling task starts, so setup() time doesn't count as missed samples)
+    void reset() {
+      uint64_t now = clock_.micros();
+      for (int i = 0; i < GR_CH_COUNT; i++) next_[i] = now + period(i);
+    }
+
+    /// @brief Change the sample / log periods. Takes effect at each channel's next release
+    void setRates(Rates rates) { rates_ = rates; }
+    Rates rates() const { return rates_; }
+    const Stats& stats() const { return stats_; }
+    /// @brief Zero the counters + histograms (the schedule carries on)
+    void clearStats() { stats_ = Stats(); }
+
+    /// @brief Read every sensor that's due, then fire the log tick if it's due
+    /// @return time (clock micros()) the next channel is due; sleep until then
+    uint64_t poll() {
+      uint64_t start = clock_.micros();
+
+      if (release(GR_CH_ACCEL, start)) { // Collect accelerometer sample(s)
+        GR_AccelTriple buf[GR_ACCEL_BURST];
+        size_t n;
+        do { // Streaming sensors may have several samples waiting
+          n = accel_.readBuffered(buf, GR_ACCEL_BURST);
+          uint64_t readUs = clock_.micros();
+          for (size_t i = 0; i < n; i++) sink_.onAccel(buf[i].timeUs ? buf[i].timeUs : readUs, buf[i].x, buf[i].y, buf[i].z);
+          stats_.accelSamples += n;
+        } while (n == GR_ACCEL_BURST);
+      }
+
+      if (release(GR_CH_BARO, clock_.micros())) { // Check the altimeter; it only hands over new data
+        GR_BaroReading buf[GR_BARO_BURST];
+        size_t n;
+        do {
+          n = baro_.readBuffered(buf, GR_BARO_BURST);
+          for (size_t i = 0; i < n; i++) sink_.onBaro(stamp(buf[i].timeUs), buf[i].tempC, buf[i].pressPa);
+          stats_.altSamples += n;
+        } while (n == GR_BARO_BURST);
+      }
+
+      if (release(GR_CH_BATT, clock_.micros())) {
+        int raw = batt_.readRaw();
+        sink_.onBatt(stamp(batt_.sampleUs()), raw);
+        stats_.battSamples++;
+      }
+
+      uint64_t tickUs = clock_.micros();
+      if (release(GR_CH_LOG, tickUs)) {
+        sink_.onLogTick(tickUs);
+        stats_.logTicks++;
+      }
+
+      uint64_t now = clock_.micros();
+      if (now - start > stats_.maxPollUs) stats_.maxPollUs = uint32_t(now - start);
+      uint64_t due = next_[0];
+      for (int i = 1; i < GR_CH_COUNT; i++) if (next_[i] < due) due = next_[i];
+      return due;
+    }
+
+    /// @brief Upper edge (us) of lateness histogram bucket i (the last bucket has no upper edge, returns 0)
+    static uint32_t bucketUs(int i) { return i < GR_JITTER_BUCKETS - 1 ? uint32_t(GR_JITTER_MIN_US) << i : 0; }
+
+  private:
+    /// @brief A sensor's sample time, or now if it doesn't know
+    uint64_t stamp(uint64_t sampleUs) { return sampleUs ? sampleUs : clock_.micros(); }
+
+    uint32_t period(int ch) const {
+      uint32_t p = ch == GR_CH_ACCEL ? rates_.accelUs : ch == GR_CH_BARO ? rates_.altUs : ch == GR_CH_BATT ? rates_.battUs : rates_.logUs;
+      return p > 0 ? p : 1;
+    }
+
+    /// @brief If channel ch is due at now: record how late it is, move its deadline to the next period boundary after now
+    bool release(int ch, uint64_t now) {
+      if (now < next_[ch]) return false;
+      Channel& c = stats_.ch[ch];
+      uint64_t late = now - next_[ch];
+      uint64_t p = period(ch);
+      uint64_t skipped = late / p;  // Whole periods we've missed entirely
+      next_[ch] += (skipped + 1) * p;
+      c.releases++;
+      if (late > c.maxLateUs) c.maxLateUs = late > UINT32_MAX ? UINT32_MAX : uint32_t(late);
+      int b = 0;
+      while (b < GR_JITTER_BUCKETS - 1 && late >= bucketUs(b)) b++;
+      c.lateHist[b]++;
+      if (skipped) {
+        c.missed += uint32_t(skipped);
+        c.missHist[skipped < GR_MISS_BUCKETS ? skipped - 1 : GR_MISS_BUCKETS - 1]++;
+      }
+      return true;
+    }
+
+    GR_Clock& clock_;
+    GR_AccelSensor& accel_;
+    GR_BaroSensor& baro_;
+    GR_BattSensor& batt_;
+    GR_SampleSink& sink_;
+    Rates rates_;
+    Stats stats_;
+    uint64_t next_[GR_CH_COUNT];  // Next deadline per channel (clock micros())
+};
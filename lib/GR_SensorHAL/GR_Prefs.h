@@ -0,0 +1,45 @@
+/*
+  GR_Prefs.h
+  Key / value config storage interface (the subset of Arduino-ESP32's Preferences the logger uses), so the config load / save code
+  doesn't care whether it's talking to the NVS partition or a file on a dev box.
+
+  Implementations: ESP_Prefs (Preferences / NVS, src/SensorHAL_ESP.h) and FilePrefs (a text file, src/native/FilePrefs.h).
+  Same semantics as Preferences: getX() returns the default if the key's missing (or holds something else), putX() returns the
+  number of bytes stored (0 = failed). Keys are at most GR_PREFS_KEY_MAX chars, like NVS.
+
+  Part of the Graphite Flight Data Logger project, GPL-3.0 (see LICENSE)
+*/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#define GR_PREFS_KEY_MAX 15  // NVS key length limit
+
+class GR_Prefs {
+  public:
+    virtual ~GR_Prefs() {}
+    /// @brief Open (or create) a namespace. Must be called before anything else
+    virtual bool begin(const char * name) = 0;
+    /// @brief Remove every key in the namespace
+    virtual bool clear() = 0;
+    virtual bool isKey(const char * key) = 0;
+    /// @brief Remove one key (true if it's gone, whether or not it was there)
+    virtual bool remove(const char * key) = 0;
+    /// @brief Entries left for new keys (NVS only has so many; the file version just says something big)
+    virtual size_t freeEntries() = 0;
+
+    virtual int32_t getInt(const char * key, int32_t def = 0) = 0;
+    virtual size_t putInt(const char * key, int32_t value) = 0;
+    virtual float getFloat(const char * key, float def = 0) = 0;
+    virtual size_t putFloat(const char * key, float value) = 0;
+    /// @brief Copy a string value into out (terminated)
+    /// @return length copied, counting the terminator (0 if the key's missing or it doesn't fit in max, like Preferences)
+    virtual size_t getString(const char * key, char * out, size_t max) = 0;
+    virtual size_t putString(const char * key, const char * value) = 0;
+    /// @brief Blobs (config structs and the like)
+    /// @return bytes copied into out (0 if the key's missing or the blob is bigger than max)
+    virtual size_t getBytes(const char * key, void * out, size_t max) = 0;
+    virtual size_t putBytes(const char * key, const void * value, size_t len) = 0;
+    /// @brief Size of a stored blob (0 if missing)
+    virtual size_t getBytesLength(const char * key) = 0;
+};
@@ -0,0 +1,144 @@
+/*
+  GR_SensorHAL.h
+  Hardware abstraction interfaces for the clock and sensors used by the sampling logic.
+
+  Nothing in here knows about Arduino, FreeRTOS or the ESP32; the board specific implementations live in src/SensorHAL_ESP.h
+  and the fake sensors for the native (Linux) build live in src/native/. Anything that only talks to sensors through these
+  interfaces can be built and run on a dev box without the logger attached.
+
+  The rest of the hardware goes through interfaces next to the code that uses them: config storage is GR_Prefs.h (in this
+  library), the SD card is GR_BlockDevice (GR_LogWriter) for writing logs and GR_LogSource (GR_LogDownload) for reading them.
+
+  Part of the Graphite Flight Data Logger project, GPL-3.0 (see LICENSE)
+*/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/// @brief Monotonic time source
+class GR_Clock {
+  public:
+    virtual ~GR_Clock() {}
+    /// @brief Milliseconds since boot (wraps like Arduino millis())
+    virtual uint32_t millis() = 0;
+    /// @brief Microseconds since boot (64 bit, doesn't wrap in any flight we'll ever do)
+    virtual uint64_t micros() = 0;
+    /// @brief Block the calling task for (at least) ms milliseconds. Implementations must give up the CPU, never busy wait
+    virtual void sleepMs(uint32_t ms) = 0;
+    /// @brief Block the calling task until micros() >= deadlineUs (returns straight away if that's already passed). The default
+    ///        rounds up to whole ms with sleepMs(); clocks with a hardware timer should override it for us resolution
+    virtual void sleepUntilUs(uint64_t deadlineUs) {
+      uint64_t now = micros();
+      if (deadlineUs > now) sleepMs(uint32_t((deadlineUs - now + 999) / 1000));
+    }
+};
+
+/// @brief One accelerometer sample (ADC counts)
+struct GR_AccelTriple {
+  int x, y, z;
+  uint64_t timeUs;  // When it was taken (clock micros()); 0 = when it was read, GR_Sampler fills that in
+};
+
+/// @brief 3 axis accelerometer returning raw ADC counts
+class GR_AccelSensor {
+  public:
+    virtual ~GR_AccelSensor() {}
+    /// @brief Read one raw sample from each axis (the latest, for streaming sensors)
+    virtual void read(int& x, int& y, int& z) = 0;
+    /// @brief Copy out every sample collected since the last call, oldest first. Streaming sensors (e.g. the ADC in DMA mode)
+    ///        override this; polled sensors just return one fresh read()
+    /// @return number of samples written to out (<= max)
+    virtual size_t readBuffered(GR_AccelTriple * out, size_t max) {
+      if (max == 0) return 0;
+      read(out->x, out->y, out->z);
+      out->timeUs = 0;
+      return 1;
+    }
+};
+
+/// @brief One barometer measurement
+struct GR_BaroReading {
+  float tempC, pressPa;
+  uint64_t timeUs;  // When it was taken (clock micros()); 0 = when it was read, GR_Sampler fills that in
+};
+
+/// @brief Barometric pressure + temperature sensor (DPS310)
+class GR_BaroSensor {
+  public:
+    virtual ~GR_BaroSensor() {}
+    /// @brief True if the sensor has a new temperature or pressure measurement ready
+    virtual bool available() = 0;
+    /// @brief Read the latest measurement
+    /// @param tempC temperature (C)
+    /// @param pressPa pressure (Pa)
+    /// @return false if the read failed
+    virtual bool read(float& tempC, float& pressPa) = 0;
+    /// @brief When the measurement the last read() returned was taken (clock micros()). 0 = don't know, take it as when it was read
+    virtual uint64_t sampleUs() { return 0; }
+    /// @brief Copy out every measurement waiting, oldest first. Sensors with a FIFO override this to empty it in one go; polled
+    ///        ones hand over one read() if available()
+    /// @return number of measurements written to out (<= max)
+    virtual size_t readBuffered(GR_BaroReading * out, size_t max) {
+      if (max == 0 || !available() || !read(out->tempC, out->pressPa)) return 0;
+      out->timeUs = sampleUs();
+      return 1;
+    }
+};
+
+/// @brief Battery voltage divider ADC
+class GR_BattSensor {
+  public:
+    virtual ~GR_BattSensor() {}
+    /// @brief Read the raw 12 bit ADC value of the battery voltage divider
+    virtual int readRaw() = 0;
+    /// @brief When the last readRaw() value was converted (clock micros()). 0 = don't know, take it as when it was read
+    virtual uint64_t sampleUs() { return 0; }
+};
+
+/// @brief I2C bus master, register style: every transfer starts by writing the register address
+class GR_I2CBus {
+  public:
+    virtual ~GR_I2CBus() {}
+    /// @brief Read n bytes from device addr starting at register reg (address written, repeated start, then the read)
+    /// @return false if the device didn't answer or the transfer came up short
+    virtual bool readRegs(uint8_t addr, uint8_t reg, uint8_t * buf, size_t n) = 0;
+    /// @brief Write one register
+    virtual bool writeReg(uint8_t addr, uint8_t reg, uint8_t value) = 0;
+    /// @brief SCL frequency (Hz)
+    virtual uint32_t clockHz() = 0;
+};
+
+/// @brief Passes everything through to another bus, counting transfers and how long they held the bus. The time is worked out from
+///        the bits on the wire (9 per byte with the ACK, plus start / repeated start / stop) at the bus clock, so it's the same on
+///        the logger and on a fake bus; the driver's own overhead on top of that isn't in it
+class GR_I2CMeter : public GR_I2CBus {
+  public:
+    GR_I2CMeter(GR_I2CBus& bus) : bus_(bus) {}
+    bool readRegs(uint8_t addr, uint8_t reg, uint8_t * buf, size_t n) override {
+      count(30 + 9 * n); // S, address + W, register, Sr, address + R, n bytes, P
+      return bus_.readRegs(addr, reg, buf, n);
+    }
+    bool writeReg(uint8_t addr, uint8_t reg, uint8_t value) override {
+      count(29); // S, address + W, register, value, P
+      return bus_.writeReg(addr, reg, value);
+    }
+    uint32_t clockHz() override { return bus_.clockHz(); }
+
+    uint32_t transfers() const { return transfers_; }
+    uint64_t bytes() const { return bytes_; }
+    /// @brief Time the bus was busy (us)
+    uint64_t busUs() const { return busNs_ / 1000; }
+    void reset() { transfers_ = 0; bytes_ = 0; busNs_ = 0; }
+
+  private:
+    void count(uint32_t bits) {
+      uint32_t hz = bus_.clockHz();
+      transfers_++;
+      bytes_ += bits / 9;
+      busNs_ += hz ? uint64_t(bits) * 1000000000ULL / hz : 0;
+    }
+
+    GR_I2CBus& bus_;
+    uint32_t transfers_ = 0;
+    uint64_t bytes_ = 0, busNs_ = 0;
+};
@@ -0,0 +1,180 @@
+/*
+  GR_Telemetry.h
+  Live telemetry frames for the status pages, streamed as Server-Sent Events (one "data:{...}\n\n" JSON object per frame).
+
+  Values are quantized to integers before anything else happens (GR_TelemetryField::decimals says how many decimal places each
+  field keeps), so "changed" means changed at the precision the page shows. Each client gets the whole set of fields in its
+  first frame and only the fields that changed after that; the page merges them into what it already has:
+
+    data:{"t":1717000000123,"ax":1984.5,"ay":1991.0,"az":2003.5,"p":98212.4,...}
+    data:{"t":1717000000323,"ax":1985.0,"p":98212.6}
+
+  Frames are written into one preallocated buffer with integer formatting only (no printf("%f"), which can malloc on newlib),
+  so pushing a frame never touches the heap.
+
+  GR_TelemetryHub keeps up to MaxClients subscribers, each with its own frame period. It's not thread safe: add(), remove() and
+  push() must all be called from the same task (on the logger, the HTTP server's task). count() can be read from anywhere.
+
+  Part of the Graphite Flight Data Logger project, GPL-3.0 (see LICENSE)
+*/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <atomic>
+
+#ifndef GR_TLM_MAX_FRAME
+  #define GR_TLM_MAX_FRAME 512      // Biggest frame (bytes); a full frame that doesn't fit is dropped, see GR_TelemetryEncoder::encode()
+#endif
+
+/// @brief One telemetry field: its JSON key and how many decimal places it keeps
+struct GR_TelemetryField {
+  const char * key;
+  uint8_t decimals;
+};
+
+namespace GR_Telemetry {
+  /// @brief Round v to an integer count of 10^-decimals
+  inline int64_t quantize(double v, uint8_t decimals) {
+    static const double scale[] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+    if (decimals > 6) decimals = 6;
+    if (!(v == v)) return 0; // NaN (sensor not read yet)
+    return (int64_t)llround(v * scale[decimals]);
+  }
+
+  /// @brief Write q / 10^decimals as a JSON number ("-12.05"). Needs up to 22 bytes
+  /// @return length written
+  inline size_t formatFixed(int64_t q, uint8_t decimals, char * out) {
+    char digits[24];
+    size_t n = 0;
+    uint64_t u = q < 0 ? 0 - (uint64_t)q : (uint64_t)q;
+    do { digits[n++] = char('0' + u % 10); u /= 10; } while (u);
+    while (n <= decimals) digits[n++] = '0'; // At least one digit in front of the point
+    size_t len = 0;
+    if (q < 0) out[len++] = '-';
+    while (n) {
+      if (n == decimals) out[len++] = '.';
+      out[len++] = digits[--n];
+    }
+    return len;
+  }
+}
+
+/// @brief Works out one client's frames: everything the first time, only what changed after that
+template <size_t Fields>
+class GR_TelemetryEncoder {
+  public:
+    /// @brief Next frame for values (quantized, one per field)
+    /// @return frame length, 0 if nothing changed (or it didn't fit in max)
+    size_t encode(const GR_TelemetryField * fields, const int64_t * values, char * out, size_t max) {
+      size_t len = 0;
+      if (!append(out, max, len, "data:{", 6)) return 0;
+      bool first = true;
+      for (size_t i = 0; i < Fields; i++) {
+        if (primed_ && values[i] == last_[i]) continue;
+        size_t keyLen = strlen(fields[i].key);
+        if (len + keyLen + 26 > max) return 0; // ,"key": + number
+        if (!first) out[len++] = ',';
+        out[len++] = '"';
+        memcpy(out + len, fields[i].key, keyLen);
+        len += keyLen;
+        out[len++] = '"';
+        out[len++] = ':';
+        len += GR_Telemetry::formatFixed(values[i], fields[i].decimals, out + len);
+        first = false;
+      }
+      if (first) return 0;
+      if (!append(out, max, len, "}\n\n", 3)) return 0;
+      memcpy(last_, values, sizeof(last_));
+      primed_ = true;
+      return len;
+    }
+
+    /// @brief Next frame sends everything again
+    void reset() { primed_ = false; }
+
+  private:
+    static bool append(char * out, size_t max, size_t& len, const char * s, size_t n) {
+      if (len + n > max) return false;
+      memcpy(out + len, s, n);
+      len += n;
+      return true;
+    }
+
+    int64_t last_[Fields];
+    bool primed_ = false;
+};
+
+/// @brief Sends a frame to one subscriber. Returning false drops the subscriber (it's gone, or too far behind to keep up)
+typedef bool (*GR_TelemetrySend)(int id, const char * frame, size_t len);
+
+/// @brief Subscribers + the shared frame buffer. Call push() with fresh values as often as the fastest client might want them
+template <size_t Fields, size_t MaxClients>
+class GR_TelemetryHub {
+  public:
+    GR_TelemetryHub(const GR_TelemetryField (&fields)[Fields]) : fields_(fields) {}
+
+    /// @brief Subscribe id (a socket, as far as the server's concerned), sending it a frame at most every periodMs
+    /// @return false if there's no room. Subscribing an id that's already here just restarts it
+    bool add(int id, uint32_t periodMs, uint32_t nowMs) {
+      Client * c = find(id);
+      if (!c) c = find(-1);
+      if (!c) return false;
+      if (c->id < 0) count_.fetch_add(1, std::memory_order_relaxed);
+      c->id = id;
+      c->periodMs = periodMs;
+      c->dueMs = nowMs;
+      c->encoder.reset();
+      return true;
+    }
+
+    void remove(int id) {
+      Client * c = find(id);
+      if (!c) return;
+      c->id = -1;
+      count_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    /// @brief Send a frame to every client that's due one
+    /// @param values quantized, one per field (see GR_Telemetry::quantize())
+    /// @return frames sent
+    size_t push(const int64_t * values, uint32_t nowMs, GR_TelemetrySend send) {
+      size_t sent = 0;
+      for (Client& c : clients_) {
+        if (c.id < 0 || int32_t(nowMs - c.dueMs) < 0) continue;
+        // Keep to the period on average, but don't try to catch up after a stall
+        c.dueMs = nowMs - c.dueMs >= c.periodMs ? nowMs + c.periodMs : c.dueMs + c.periodMs;
+        size_t len = c.encoder.encode(fields_, values, frame_, sizeof(frame_));
+        if (!len) continue;
+        bytes_ += len;
+        if (send(c.id, frame_, len)) { sent++; frames_++; }
+        else remove(c.id);
+      }
+      return sent;
+    }
+
+    size_t count() const { return count_.load(std::memory_order_relaxed); }
+    bool full() const { return count() >= MaxClients; }
+    uint32_t frames() const { return frames_; }
+    uint64_t bytes() const { return bytes_; }
+
+  private:
+    struct Client {
+      int id = -1;
+      uint32_t periodMs = 0, dueMs = 0;
+      GR_TelemetryEncoder<Fields> encoder;
+    };
+
+    Client * find(int id) {
+      for (Client& c : clients_) if (c.id == id) return &c;
+      return nullptr;
+    }
+
+    const GR_TelemetryField * fields_;
+    Client clients_[MaxClients];
+    std::atomic<size_t> count_{0};
+    char frame_[GR_TLM_MAX_FRAME];
+    uint32_t frames_ = 0;
+    uint64_t bytes_ = 0;
+};
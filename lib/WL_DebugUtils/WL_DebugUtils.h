@@ -4,82 +4,97 @@
   Shorthand debug message functions to speed the debugging process.
   (Yes, it's poor form to have everything in the header file--that's fine because c++ doesn't care)
 
-  The debugMode int must be defined prior to using any of these functions
-    int debugMode = 1;
+  The debug level is set at compile time with WL_DEBUG_LEVEL (in platformio.ini's build_flags, defaults to 1 if it's not there):
+    0 = Off, 1 = General, 2 = Verbose
+  debugMode is a constant copy of it, so `if (debugMode > 0)` checks still work (and get compiled out like everything else).
 
-  debugMsg() accepts all types that Serial.print() does.
-
-    
-  TODO: It sure would be lovely if this project were running on c++17 or higher;
-        then I could use <type_traits> with if constxpr (std::is_floating_point<Type>::value) to detect float and double types instead of manual type overloading 
+  debugMsg(value, minLevel = 1, ln = true, decPrecision = 8) accepts strings, String, numbers, bools, chars and IPAddress.
+    - Messages above WL_DEBUG_LEVEL don't generate any code at all (the arguments aren't even evaluated).
+    - Messages that are enabled don't print anything straight away; they get packed into binary records and queued (see
+      GR_DebugLog.h), and a low priority task (started by debugStart()) formats them and writes them to Serial. So a debug message
+      never waits on the serial port. If the queue fills up, whole messages are dropped and a warning says how many.
+    - String literals are queued by pointer, anything else is copied.
 
   Written by Will's Lab, distributed freely without any license
 */
-extern int debugMode; // You should define this as a number somewhere in your main code file!
+#pragma once
+#include <IPAddress.h>
+#include <GR_DebugLog.h>
 
-/// @brief Start a serial connection (Serial.begin) if debugMode is >= 0. IMPORTANT: int debugMode must be declared globally prior to calling debugStart
-/// @param baud Serial connection speed. Default: 9600
-void debugStart(int baud = 9600) {
-  if (debugMode > 0) {
-    Serial.begin(baud);
-  }
-}
+#ifndef WL_DEBUG_LEVEL
+  #define WL_DEBUG_LEVEL 1
+#endif
+#ifndef WL_DEBUG_QUEUE
+  #define WL_DEBUG_QUEUE 1024       // Records in the debug queue (16 bytes each, must be a power of 2)
+#endif
+#define WL_DEBUG_TASK_STACK 3072    // Drain task stack size (bytes)
+#define WL_DEBUG_TASK_PRIORITY 1    // Drain task priority (as low as it goes without being the idle task)
+#define WL_DEBUG_TASK_POLL_MS 5     // How long the drain task sleeps when there's nothing to print
+#define WL_DEBUG_DRAIN_RECORDS 64   // Max records the drain task formats before giving other tasks a turn
 
-/// @brief Close the debug serial connection if debugMode is >=0
-void debugStop() {
-  if (debugMode > 0) {
-    Serial.end();
-  }
-}
-
-/// @brief Send a debug message to Serial depending on debugMode
-/// @tparam Type 
-/// @param txtIn variable or text to be sent (may be any type that's supported by Serial.print)
-/// @param minLevel minimum debug level required for this message to be sent. Default: 1
-/// @param ln if true, use Serial.println, else use Serial.print. Default: true
-template <typename Type>
-void debugMsg(Type txtIn, int minLevel = 1, bool ln = true) {
-  if ((debugMode > 0) && (debugMode >= minLevel)) {
-    if (ln) {
-      Serial.println(txtIn);
-    } else {
-      Serial.print(txtIn);
-    }
-  }
-}
+constexpr int debugMode = WL_DEBUG_LEVEL;
 
+/// @brief Serializes producers on both cores (a FreeRTOS critical section; only held for the few us it takes to copy a message in)
+struct WL_DebugLock {
+  portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+  void lock() { portENTER_CRITICAL_SAFE(&mux); }
+  void unlock() { portEXIT_CRITICAL_SAFE(&mux); }
+};
 
-// Special cases for float and double types:
+inline GR_DebugLog<WL_DEBUG_QUEUE, WL_DebugLock> WL_debugQueue; // Every task's debug messages, in the order they were sent
+inline GR_DebugLog<WL_DEBUG_QUEUE, WL_DebugLock>& WL_debugLog() { return WL_debugQueue; }
 
+// What each type gets queued as. literal is worked out by debugMsg() from the argument's spelling
+inline void WL_debugPut(const char * s, bool ln, int, bool literal) { WL_debugLog().put(s, ln, literal); }
+inline void WL_debugPut(char * s, bool ln, int, bool) { WL_debugLog().put(s, ln, false); }
+inline void WL_debugPut(const String& s, bool ln, int, bool) { WL_debugLog().put(s.c_str(), ln, false); }
+inline void WL_debugPut(const IPAddress& ip, bool ln, int, bool) { WL_debugLog().put(ip.toString().c_str(), ln, false); }
+inline void WL_debugPut(char c, bool ln, int, bool) { WL_debugLog().put(c, ln); }
+inline void WL_debugPut(bool b, bool ln, int, bool) { WL_debugLog().put(b, ln); }
+inline void WL_debugPut(float v, bool ln, int decPrecision, bool) { WL_debugLog().put(double(v), ln, uint8_t(decPrecision)); }
+inline void WL_debugPut(double v, bool ln, int decPrecision, bool) { WL_debugLog().put(v, ln, uint8_t(decPrecision)); }
+template <typename Type>
+inline typename std::enable_if<std::is_integral<Type>::value>::type WL_debugPut(Type v, bool ln, int, bool) { WL_debugLog().put(v, ln); }
 
-/// @brief Send a debug message to Serial depending on debugMode
-/// @tparam Type 
-/// @param txtIn variable or text to be sent (may be any type that's supported by Serial.print)
-/// @param minLevel minimum debug level required for this message to be sent. Default: 1
-/// @param ln if true, use Serial.println, else use Serial.print. Default: true
+/// @brief Send a debug message to Serial if WL_DEBUG_LEVEL >= minLevel (queued, printed later by the debug task)
+/// @param txtIn variable or text to be sent
+/// @param minLevel minimum debug level required for this message to be sent (must be a constant). Default: 1
+/// @param ln if true, end the line (like Serial.println), else don't (Serial.print). Default: true
 /// @param decPrecision decimal precision for printing float / double types. Default: 8
-void debugMsg(float txtIn, int minLevel = 1, bool ln = true, int decPrecision = 8) {
-  if ((debugMode > 0) && (debugMode >= minLevel)) {
-    if (ln) {
-      Serial.println(txtIn, decPrecision);
-    } else {
-      Serial.print(txtIn, decPrecision);
-    }
+#define debugMsg(...) WL_DEBUG_PICK(__VA_ARGS__, WL_DEBUG_MSG4, WL_DEBUG_MSG3, WL_DEBUG_MSG2, WL_DEBUG_MSG1, )(__VA_ARGS__)
+#define WL_DEBUG_PICK(_1, _2, _3, _4, NAME, ...) NAME
+#define WL_DEBUG_MSG1(txtIn) WL_DEBUG_MSG4(txtIn, 1, true, 8)
+#define WL_DEBUG_MSG2(txtIn, minLevel) WL_DEBUG_MSG4(txtIn, minLevel, true, 8)
+#define WL_DEBUG_MSG3(txtIn, minLevel, ln) WL_DEBUG_MSG4(txtIn, minLevel, ln, 8)
+#define WL_DEBUG_MSG4(txtIn, minLevel, ln, decPrecision) do { \
+    if constexpr (WL_DEBUG_LEVEL > 0 && WL_DEBUG_LEVEL >= (minLevel)) WL_debugPut(txtIn, ln, decPrecision, (#txtIn)[0] == '"'); \
+  } while (0)
+
+/// @brief Drain task: formats queued messages and writes them to Serial
+inline void WL_debugTask(void *) {
+  for (;;) {
+    size_t n = WL_debugLog().drain([](const char * s, size_t len) { Serial.write(reinterpret_cast<const uint8_t *>(s), len); },
+                                   WL_DEBUG_DRAIN_RECORDS);
+    if (n < WL_DEBUG_DRAIN_RECORDS) vTaskDelay(pdMS_TO_TICKS(WL_DEBUG_TASK_POLL_MS));
+    else taskYIELD();
   }
 }
 
-/// @brief Send a debug message to Serial depending on debugMode
-/// @tparam Type 
-/// @param txtIn variable or text to be sent (may be any type that's supported by Serial.print)
-/// @param minLevel minimum debug level required for this message to be sent. Default: 1
-/// @param ln if true, use Serial.println, else use Serial.print. Default: true
-/// @param decPrecision decimal precision for printing float / double types. Default: 8
-void debugMsg(double txtIn, int minLevel = 1, bool ln = true, int decPrecision = 8) {
-  if ((debugMode > 0) && (debugMode >= minLevel)) {
-    if (ln) {
-      Serial.println(txtIn, decPrecision);
-    } else {
-      Serial.print(txtIn, decPrecision);
-    }
+/// @brief Start a serial connection (Serial.begin) and the debug drain task if WL_DEBUG_LEVEL > 0
+/// @param baud Serial connection speed. Default: 9600
+inline void debugStart(int baud = 9600) {
+  if (debugMode > 0) {
+    Serial.begin(baud);
+    static TaskHandle_t task = NULL;
+    if (!task) xTaskCreate(WL_debugTask, "wl_debug", WL_DEBUG_TASK_STACK, NULL, WL_DEBUG_TASK_PRIORITY, &task); // Either core, whichever is free
   }
-}
\ No newline at end of file
+}
+
+/// @brief Print whatever's still queued, then close the debug serial connection if WL_DEBUG_LEVEL > 0
+inline void debugStop() {
+  if (debugMode > 0) {
+    while (WL_debugLog().pending()) vTaskDelay(pdMS_TO_TICKS(WL_DEBUG_TASK_POLL_MS));
+    Serial.flush();
+    Serial.end();
+  }
+}
@@ -0,0 +1,148 @@
+/* AdcDMA_ESP.h
+    ADC1 in continuous (DMA) mode for the ADXL377 axes + battery divider, with a decimating low-pass filter per accelerometer axis
+
+    The ADC hardware walks the channel pattern (x, y, z, battery) at io_accelDMAHz per channel and DMAs the conversions into a ring
+    buffer in the IDF driver; no CPU involvement and no millis() jitter. readBuffered() (called by GR_Sampler on the sampling task)
+    drains that buffer and runs each axis through a GR_DecimatingFIR, handing back the filtered, decimated samples.
+
+    Timestamps: there's no interrupt per conversion to stamp, and the buffer's drained a DMA chunk (~4ms) at a time, so the read
+    time says little about when a sample was taken. The conversions are evenly spaced though, so each gets the time of its frame
+    (one pass over the pattern) from a GR_SampleClock, counting frames since begin() and anchored on the reads. Filtered samples
+    are stamped with the filter's group delay taken off, so they line up with what the filter's centered on.
+
+    Note: once ADC1 is in continuous mode analogRead() can't be used on ADC1 pins anymore, hence the battery channel riding along
+    in the pattern (ESP_BattFromDMA below). Uses the ESP-IDF 4.4 adc_digi driver (Arduino-ESP32 2.x).
+*/
+#include <Arduino.h>
+#include <driver/adc.h>
+#include <GR_SensorHAL.h>
+#include <GR_Filter.h>
+#include <GR_Align.h>
+
+template <size_t Taps, size_t Decimation>
+class ESP_AccelDMA : public GR_AccelSensor {
+  public:
+    /// @param clock what the samples are timestamped in
+    /// @param xCh, yCh, zCh, battCh ADC1 channels (not GPIO numbers!)
+    ESP_AccelDMA(GR_Clock& clock, adc1_channel_t xCh, adc1_channel_t yCh, adc1_channel_t zCh, adc1_channel_t battCh)
+      : clock_(clock), ch_{xCh, yCh, zCh, battCh} {}
+
+    /// @brief Design the filters and start continuous conversions
+    /// @param hzPerChannel conversion rate for each channel (the filtered output rate is this / Decimation)
+    /// @param cutoff filter cutoff as a fraction of hzPerChannel (keep it under 0.5 / Decimation to avoid aliasing)
+    bool begin(uint32_t hzPerChannel, float cutoff) {
+      float h[Taps];
+      GR_FIR::designLowPass(h, Taps, cutoff);
+      for (int a = 0; a < 3; a++) filters_[a].setCoeffs(h);
+      GR_SampleClock::Config clk = GR_SampleClock::defaults();
+      clk.periodNs = 1000000000UL / hzPerChannel;
+      frameClock_.setConfig(clk);
+      frameClock_.reset();
+      framesRead_ = framesSeen_ = 0;
+      delayUs_ = uint32_t((Taps - 1) * 500000ULL / hzPerChannel); // Linear phase FIR: (Taps - 1) / 2 input samples
+
+      adc_digi_init_config_t init = {};
+      init.max_store_buf_size = 4096;  // ~64ms of conversions at 4 channels x 4kHz x 4 bytes (64KB/s); GR_Sampler drains it every few ms
+      init.conv_num_each_intr = 256;   // Bytes per DMA chunk: 64 conversions, ~4ms
+      init.adc1_chan_mask = 0;
+      for (int i = 0; i < 4; i++) init.adc1_chan_mask |= BIT(ch_[i]);
+      init.adc2_chan_mask = 0;
+      if (adc_digi_initialize(&init) != ESP_OK) return false;
+
+      adc_digi_pattern_config_t pattern[4] = {};
+      for (int i = 0; i < 4; i++) {
+        pattern[i].atten = ADC_ATTEN_DB_11;  // Full 0-3.1V range, same as analogRead()
+        pattern[i].channel = ch_[i];
+        pattern[i].unit = 0;                 // ADC1
+        pattern[i].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+      }
+      adc_digi_configuration_t cfg = {};
+      cfg.conv_limit_en = false;
+      cfg.pattern_num = 4;
+      cfg.adc_pattern = pattern;
+      cfg.sample_freq_hz = hzPerChannel * 4;
+      cfg.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+      cfg.format = ADC_DIGI_OUTPUT_FORMAT_TYPE2;
+      if (adc_digi_controller_configure(&cfg) != ESP_OK) return false;
+      return adc_digi_start() == ESP_OK;
+    }
+
+    void read(int& x, int& y, int& z) override { x = latest_.x; y = latest_.y; z = latest_.z; }
+
+    size_t readBuffered(GR_AccelTriple * out, size_t max) override {
+      size_t n = 0;
+      while (n < max) {
+        // Finish any conversions left over from the last DMA read before grabbing more
+        if (rawPos_ >= rawLen_) {
+          uint32_t got = 0;
+          if (adc_digi_read_bytes(raw_, sizeof(raw_), &got, 0) != ESP_OK || got == 0) break; // Nothing waiting
+          rawPos_ = 0;
+          rawLen_ = got;
+          uint64_t readUs = clock_.micros();
+          for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= got; i += SOC_ADC_DIGI_RESULT_BYTES) // Frames in this chunk
+            if (((adc_digi_output_data_t *)&raw_[i])->type2.channel == ch_[0]) framesRead_++;
+          frameClock_.update(readUs, framesRead_);
+        }
+        for (; rawPos_ + SOC_ADC_DIGI_RESULT_BYTES <= rawLen_ && n < max; rawPos_ += SOC_ADC_DIGI_RESULT_BYTES) {
+          adc_digi_output_data_t * p = (adc_digi_output_data_t *)&raw_[rawPos_];
+          int v = p->type2.data;
+          int ch = p->type2.channel;
+          if (ch == ch_[0]) framesSeen_++; // A new frame starts with x
+          if (ch == ch_[3]) { battRaw_ = v; battUs_ = frameUs(); continue; }
+          int axis = (ch == ch_[0]) ? 0 : (ch == ch_[1]) ? 1 : (ch == ch_[2]) ? 2 : -1;
+          if (axis < 0) continue;
+          float f;
+          if (!filters_[axis].push(float(v), f)) continue;
+          pending_[axis] = int(f + 0.5f);
+          pendingMask_ |= 1 << axis;
+          if (pendingMask_ == 0x7) { // All three axes have a new filtered sample
+            latest_.x = pending_[0]; latest_.y = pending_[1]; latest_.z = pending_[2];
+            uint64_t t = frameUs() - delayUs_;
+            latest_.timeUs = t > lastUs_ ? t : lastUs_ + 1; // The anchor can step back a little when a read lands early
+            lastUs_ = latest_.timeUs;
+            out[n++] = latest_;
+            pendingMask_ = 0;
+          }
+        }
+      }
+      return n;
+    }
+
+    /// @brief Latest raw battery divider reading from the DMA stream
+    int battRaw() const { return battRaw_; }
+    /// @brief When battRaw() was converted (clock micros())
+    uint64_t battUs() const { return battUs_; }
+    /// @brief Frames clock: how long the newest conversions sat in the buffer before being read, and times it lost some (overflow)
+    uint32_t lagUs() const { return frameClock_.lagUs(); }
+    uint32_t resyncs() const { return frameClock_.resyncs(); }
+
+  private:
+    /// @brief When the frame being worked through was converted
+    uint64_t frameUs() const { return framesSeen_ ? frameClock_.timeUs(framesSeen_ - 1) : 0; }
+
+    GR_Clock& clock_;
+    adc1_channel_t ch_[4];
+    GR_DecimatingFIR<Taps, Decimation> filters_[3];
+    uint8_t raw_[256 * SOC_ADC_DIGI_RESULT_BYTES];
+    uint32_t rawPos_ = 0, rawLen_ = 0;
+    int pending_[3] = {0, 0, 0};
+    uint8_t pendingMask_ = 0;
+    GR_AccelTriple latest_ = {0, 0, 0, 0};
+    volatile int battRaw_ = 0;
+    volatile uint64_t battUs_ = 0;
+    GR_SampleClock frameClock_;
+    uint64_t framesRead_ = 0, framesSeen_ = 0; // Frames handed over by the DMA reads / worked through so far
+    uint32_t delayUs_ = 0;
+    uint64_t lastUs_ = 0;
+};
+
+/// @brief Battery reading taken from the accelerometer's DMA stream (see the note at the top)
+template <typename AccelDMA>
+class ESP_BattFromDMA : public GR_BattSensor {
+  public:
+    ESP_BattFromDMA(AccelDMA& dma) : dma_(dma) {}
+    int readRaw() override { return dma_.battRaw(); }
+    uint64_t sampleUs() override { return dma_.battUs(); }
+  private:
+    AccelDMA& dma_;
+};
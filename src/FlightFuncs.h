@@ -0,0 +1,310 @@
+/* FlightFuncs.h
+    The flight pipeline around the libraries: io_SampleHandler (on the sampling task: filter, launch / apogee / landing detection, the
+    pre-launch history and the full rate records) and io_drainSamples() / io_drainRaw() (on wi_serverTask: events, flight phases and
+    everything queued up going into the log).
+
+    main.cpp and the native flight sim (src/native/FlightSim.h) both include this, so the sim flies the same code the logger does.
+    Uses main.cpp's globals (the flags, dat_ tracks, io_ detectors / queues / history, the cal_ values), the log functions in LogFuncs.h,
+    io_takeAltTable(), io_saveResume(), debugMsg() and millis(), so include it after all of those (same deal as WebFuncs.h). Nothing in
+    here can touch the ESP32 directly; anything that has to goes in main.cpp, with a stand-in in FlightSim.h.
+*/
+#include <GR_Sampler.h>
+#include <GR_SampleRecord.h>
+#include <GR_Align.h>
+#include <GR_RingBuffer.h>
+#include <GR_FlightLog.h>
+#include <GR_History.h>
+#include <GR_LaunchDetect.h>
+#include <GR_Estimator.h>
+#include <GR_FlightPhase.h>
+#include <GR_Perf.h>
+
+// Processes raw samples from io_sampler. Everything in here runs on the sampling task!
+class io_SampleHandler : public GR_SampleSink {
+  public:
+    void onAccel(uint64_t timeUs, int x, int y, int z) override {
+      GR_PERF_SCOPE(io_perfAccel);
+      // Samples arrive already low-pass filtered + decimated (see AdcDMA_ESP.h) and stamped with when they were taken, ~4 at a time (a ~4ms DMA chunk)
+      dat_accel.push(timeUs, {float(x), float(y), float(z)});
+      bool armed = !cal_accelCalMode && checkArmed();
+      releaseHeld(timeUs, armed); // Baro / battery readings from before this sample go first, so the filter sees everything in time order
+      if (armed) {
+        GR_PERF_SCOPE(io_perfDetect);
+        float g[3] = {GR_SampleRecord::accelG(x, cal_zeroXAccel, cal_xAccelCoef), GR_SampleRecord::accelG(y, cal_zeroYAccel, cal_yAccelCoef),
+                      GR_SampleRecord::accelG(z, cal_zeroZAccel, cal_zAccelCoef)};
+        if (!flag_launched && io_launchDetect.onAccel(timeUs, g[0], g[1], g[2])) launched();
+        io_altKF.updateAccel(timeUs, io_accelUpSign * g[io_accelUpAxis] * GR_GRAVITY);
+        if (flag_launched) checkFlightEvents(timeUs);
+        recordRaw(timeUs, x, y, z);
+      }
+
+      // Calibrate the accelerometer if needed
+      if (cal_accelCalMode) {
+        if (!cal_accelCalStarted) { // If calibration mode was just started
+          cal_accelCalStarted = 1; // Set started flag 
+          cal_accelCalTimer = millis();
+          // Clear +/- 1g calibration values
+          cal_n1gXAccell = x; cal_n1gYAccell = y; cal_n1gZAccell = z;
+          cal_p1gXAccell = x; cal_p1gYAccell = y; cal_p1gZAccell = z;
+        }
+        if (millis() - cal_accelCalTimer > cal_accelCalTimeout) { // Turn off calibration after 10 sec
+          cal_accelCalMode = 0;
+        }
+        // If the current measured value is beyond one of the limits, save that as the new limit
+        if (x < cal_n1gXAccell) cal_n1gXAccell = x;
+        if (y < cal_n1gYAccell) cal_n1gYAccell = y;
+        if (z < cal_n1gZAccell) cal_n1gZAccell = z;
+        if (x > cal_p1gXAccell) cal_p1gXAccell = x;
+        if (y > cal_p1gYAccell) cal_p1gYAccell = y;
+        if (z > cal_p1gZAccell) cal_p1gZAccell = z;
+        debugMsg("x,y,z min values: ",2,0); 
+        debugMsg(cal_n1gXAccell,2,0); debugMsg(",",2,0); debugMsg(cal_n1gYAccell,2,0); debugMsg(",",2,0); debugMsg(cal_n1gZAccell,2,1);
+        debugMsg("x,y,z max values: ",2,0); 
+        debugMsg(cal_p1gXAccell,2,0); debugMsg(",",2,0); debugMsg(cal_p1gYAccell,2,0); debugMsg(",",2,0); debugMsg(cal_p1gZAccell,2,1); 
+      }
+      if (!cal_accelCalMode && cal_accelCalStarted) { // If calibration mode was just turned off
+        cal_accelCalStarted = 0; // Clear the started flag
+        // Calculate new coefficients and zero values
+        cal_xAccelCoef = float(2) / (cal_p1gXAccell - cal_n1gXAccell); 
+        cal_yAccelCoef = float(2) / (cal_p1gYAccell - cal_n1gYAccell); 
+        cal_zAccelCoef = float(2) / (cal_p1gZAccell - cal_n1gZAccell); 
+        cal_zeroXAccel = cal_p1gXAccell - ((cal_p1gXAccell - cal_n1gXAccell) / 2);
+        cal_zeroYAccel = cal_p1gYAccell - ((cal_p1gYAccell - cal_n1gYAccell) / 2);
+        cal_zeroZAccel = cal_p1gZAccell - ((cal_p1gZAccell - cal_n1gZAccell) / 2);
+        //Todo: report calibration data to web interface w/ confirm option, if confirmed save to Preferences
+
+        debugMsg("Final x,y,z min values: ",2,0); 
+        debugMsg(cal_n1gXAccell,2,0); debugMsg(",",2,0); debugMsg(cal_n1gYAccell,2,0); debugMsg(",",2,0); debugMsg(cal_n1gZAccell,2,1);
+        debugMsg("Final x,y,z max values: ",2,0); 
+        debugMsg(cal_p1gXAccell,2,0); debugMsg(",",2,0); debugMsg(cal_p1gYAccell,2,0); debugMsg(",",2,0); debugMsg(cal_p1gZAccell,2,1); 
+        debugMsg("x,y,z Coefficients: ",2,0); 
+        debugMsg(cal_xAccelCoef,2,0); debugMsg(", ",2,0); debugMsg(cal_yAccelCoef,2,0); debugMsg(", ",2,0); debugMsg(cal_zAccelCoef,2,1); 
+        debugMsg("x,y,z zero values: ",2,0); 
+        debugMsg(cal_zeroXAccel,2,0); debugMsg(",",2,0); debugMsg(cal_zeroYAccel,2,0); debugMsg(",",2,0); debugMsg(cal_zeroZAccel,2,1); 
+      }
+    }
+
+    void onBaro(uint64_t timeUs, float tempC, float pressPa) override {
+      // Performance: this used to take approx 1.3ms, mostly the pow() in the altitude formula (now a table lookup, see GR_Altitude.h)
+      GR_PERF_SCOPE(io_perfBaro);
+      GR_BaroSample b = {tempC, pressPa, io_takeAltTable()->altitudeM(pressPa, tempC)};
+      dat_baro.push(timeUs, b);
+      baroHold_.push(timeUs, b); // Filter + full rate record once the accelerometer's caught up with it (releaseHeld())
+    }
+
+    void onBatt(uint64_t timeUs, int raw) override {
+      dat_battRaw.push(timeUs, float(raw)); // Volts are worked out later, only if something asks (GR_SampleRecord::battV())
+      battHold_.push(timeUs, raw);
+    }
+
+    void onLogTick(uint64_t timeUs) override {
+      if (cal_accelCalMode) return; // Don't log while we're calibrating
+      GR_PERF_SCOPE(io_perfLogTick); // Note: includes the Teleplot prints below when debugMode is 2
+      if (timeUs > io_alignHoldMaxUs) releaseHeld(timeUs - io_alignHoldMaxUs, checkArmed()); // In case the accelerometer's stopped
+
+      // Every stream read at the same moment: the newest one they've all got to (each sensor runs on its own clock and turns up late
+      // by a different amount), interpolated between the samples either side of it
+      uint64_t newest[3] = {dat_accel.newestUs(), dat_baro.newestUs(), dat_battRaw.newestUs()};
+      uint64_t t = GR_Align::commonUs(timeUs, io_alignStaleUs, newest, 3);
+      GR_AccelSample accel = dat_accel.at(t, io_logInterp);
+      GR_BaroSample baro = dat_baro.at(t, io_logInterp);
+
+      // Hand the record off to the web server / logging task (drops the record if they've fallen behind, never waits)
+      GR_SampleRecord rec;
+      rec.timeUs = t;
+      rec.xAccelRaw = accel.x; rec.yAccelRaw = accel.y; rec.zAccelRaw = accel.z;
+      rec.tempC = baro.tempC;
+      rec.pressPa = baro.pressPa;
+      rec.altM = baro.altM;
+      rec.battRaw = dat_battRaw.at(t, io_logInterp);
+      io_sampleRing.push(rec);
+
+      // Print to console
+      // debugMsg("[DATA]: DPS310",2,1);
+      debugMsg(">Temp(C): ",2,0); debugMsg(rec.tempC,2,1);
+      debugMsg(">Temp(F): ",2,0); debugMsg(rec.tempF(),2,1);
+      debugMsg(">Temp(K): ",2,0); debugMsg(rec.tempK(),2,1);
+      debugMsg(">Pressure(Pa): ",2,0); debugMsg(rec.pressPa,2,1); 
+      debugMsg(">Altitude(m): ",2,0); debugMsg(rec.altM,2,1); 
+      debugMsg(">Altitude(Ft): ",2,0); debugMsg(rec.altFt(),2,1); 
+      // debugMsg("[DATA]: ADXL377",2,1);
+      debugMsg(">X Accel (raw): ",2,0); debugMsg(rec.xAccelRaw,2,1);
+      // debugMsg(">X Accel (g): ",2,0); debugMsg(GR_SampleRecord::accelG(rec.xAccelRaw, cal_zeroXAccel, cal_xAccelCoef),2,1);
+      // debugMsg(">X Accel (m/s^2): ",2,0); debugMsg(GR_SampleRecord::accelMs2(rec.xAccelRaw, cal_zeroXAccel, cal_xAccelCoef),2,1);
+      debugMsg(">Y Accel (raw): ",2,0); debugMsg(rec.yAccelRaw,2,1);
+      // debugMsg(">Y Accel (g): ",2,0); debugMsg(GR_SampleRecord::accelG(rec.yAccelRaw, cal_zeroYAccel, cal_yAccelCoef),2,1);
+      // debugMsg(">Y Accel (m/s^2): ",2,0); debugMsg(GR_SampleRecord::accelMs2(rec.yAccelRaw, cal_zeroYAccel, cal_yAccelCoef),2,1);
+      debugMsg(">Z Accel (raw): ",2,0); debugMsg(rec.zAccelRaw,2,1);
+      // debugMsg(">Z Accel (g): ",2,0); debugMsg(GR_SampleRecord::accelG(rec.zAccelRaw, cal_zeroZAccel, cal_zAccelCoef),2,1);
+      // debugMsg(">Z Accel (m/s^2): ",2,0); debugMsg(GR_SampleRecord::accelMs2(rec.zAccelRaw, cal_zeroZAccel, cal_zAccelCoef),2,1);
+    }
+
+  private:
+    /// @brief True while armed. On disarm, throws away the history and restarts the launch detector so the next flight starts clean
+    bool checkArmed() {
+      if (flag_armed) { wasArmed_ = 1; return true; }
+      if (wasArmed_) {
+        io_history.reset(); io_launchDetect.reset(); io_altKF.reset(); // History: io_drainRaw() finishes the reset if it's flushing it
+        // wi_disarm() clears these too, but a sample that got past the flag_armed check before it did can set one again after
+        flag_launched = 0; flag_apogee = 0; flag_landed = 0;
+        wasArmed_ = 0;
+      }
+      return false;
+    }
+
+    /// @brief Baro + battery readings taken at or before upToUs: into the launch detector + filter (if armed) and the next full rate
+    ///        record, which is the one for the first accelerometer sample at or after them (within a ms of their own time)
+    void releaseHeld(uint64_t upToUs, bool armed) {
+      uint64_t t;
+      GR_BaroSample b;
+      int raw;
+      while (baroHold_.pop(upToUs, t, b)) {
+        rawPressPa_ = b.pressPa; rawTempC_ = b.tempC; rawFlags_ |= GR_SAMPLE_BARO;
+        if (!armed) continue;
+        if (!flag_launched && io_launchDetect.onAlt(t, b.altM)) launched();
+        io_altKF.updateBaro(t, b.altM);
+      }
+      while (battHold_.pop(upToUs, t, raw)) { rawBatt_ = raw; rawFlags_ |= GR_SAMPLE_BATT; }
+    }
+
+    void launched() {
+      io_flightEvents.reset(io_launchDetect.result().t0Us);
+      flag_launched = 1;
+    }
+
+    /// @brief Apogee / landing decisions off the Kalman filter state (after every accelerometer update, once launched)
+    void checkFlightEvents(uint64_t now) {
+      switch (io_flightEvents.onEstimate(now, io_altKF.altitude(), io_altKF.velocity())) {
+        case GR_FLIGHT_EVT_APOGEE: flag_apogee = 1; break;
+        case GR_FLIGHT_EVT_LANDED: flag_landed = 1; break;
+      }
+    }
+
+    /// @brief Build a full rate record and put it where it belongs: io_history while armed, io_rawRing once launched
+    void recordRaw(uint64_t timeUs, int x, int y, int z) {
+      GR_LogRecord r = GR_FlightLog::makeSample(timeUs, GR_SAMPLE_ACCEL | rawFlags_, uint16_t(x), uint16_t(y), uint16_t(z), 
+                                                rawPressPa_, rawTempC_, uint16_t(rawBatt_));
+      rawFlags_ = 0;
+      if (flag_launched) {
+        io_history.freeze(); // No-op after the first time; hands the history to the web server task for flushing
+        io_rawRing.push(r);
+      } else {
+        io_history.push(r);
+      }
+    }
+
+    GR_HoldBack<GR_BaroSample, io_holdLen> baroHold_; // Readings the accelerometer hasn't caught up with yet
+    GR_HoldBack<int, io_holdLen> battHold_;
+    float rawPressPa_ = 0, rawTempC_ = 0; // Newest baro / battery readings, waiting to go out with the next full rate record
+    int rawBatt_ = 0;
+    uint8_t rawFlags_ = 0;
+    bool wasArmed_ = 0;
+};
+
+/// @brief Once launched: flush the frozen pre-launch history into the log, only as fast as the log buffers free up (so none of it
+///        gets dropped), then log the live full rate records from io_rawRing (as many as the flight phase wants). Called from the web
+///        server task only
+void io_drainRaw() {
+  GR_LogRecord batch[io_drainBatchSize];
+  size_t n;
+  switch (io_history.state()) {
+    case decltype(io_history)::ResetPending: // Disarmed with a frozen history: the sampling task waits for us to be done with it
+      io_history.acknowledgeReset();
+      // fall through
+    case decltype(io_history)::Recording: // Not launched (or just disarmed)
+      io_historyFlushed = 0;
+      io_rawDecimator.reset();
+      return;
+    case decltype(io_history)::Frozen:
+      if (!io_logWriter.isOpen()) { io_history.markDrained(); return; } // Nowhere to put it
+      if (io_historyFlushed == 0) io_logEvent(GR_EVT_HISTORY, io_history.frozenCount());
+      for (size_t room = io_logRoom(); room > 0; room -= n) {
+        n = io_history.read(io_historyFlushed, batch, room < io_drainBatchSize ? room : io_drainBatchSize);
+        if (n == 0) break;
+        io_logAppend(batch, n);
+        io_historyFlushed += n;
+      }
+      if (io_history.state() != decltype(io_history)::Frozen) return; // Disarmed part way through (acknowledged next time round)
+      if (io_historyFlushed < io_history.frozenCount()) return; // Live records wait in io_rawRing until the history is out
+      io_history.markDrained();
+      debugMsg("[EVENT]: Flushed ",1,0); debugMsg((unsigned long)io_historyFlushed,1,0); debugMsg(" pre-launch records to the log");
+      break;
+    case decltype(io_history)::Drained:
+      break;
+  }
+  uint16_t every = io_phase.settings().rawEvery; // The history always goes in at full rate; live records per the phase
+  while ((n = io_rawRing.popBatch(batch, io_drainBatchSize)) > 0) {
+    io_logAppend(batch, io_rawDecimator.apply(batch, n, every));
+  }
+  if (io_rawRing.overflows() != io_rawRingOverflows) {
+    io_logEvent(GR_EVT_OVERFLOW, io_rawRing.overflows() - io_rawRingOverflows);
+    debugMsg("[WARN]: Full rate queue overflowed, records dropped: ",1,0); debugMsg(io_rawRing.overflows() - io_rawRingOverflows);
+    io_rawRingOverflows = io_rawRing.overflows();
+  }
+}
+
+/// @brief Pull everything the sampling task has queued up off io_sampleRing and io_rawRing (called from the web server task only)
+void io_drainSamples() {
+  GR_PERF_SCOPE(io_perfDrain);
+  GR_SampleRecord batch[io_drainBatchSize];
+  size_t n;
+  bool changed = 0; // Something a reset would need to know about
+  if (flag_launched && !io_launchLogged) { // Launch event goes in ahead of the pre-launch history, stamped with T0
+    const GR_LaunchDetect::Result& ld = io_launchDetect.result();
+    io_logEventAt(ld.t0Us, GR_EVT_LAUNCH, ld.reason, (ld.detectUs - ld.t0Us) / 1000.0f);
+    io_launchLogged = 1;
+    io_launchLogEnd = io_logAppended();
+    changed = 1;
+    debugMsg("[EVENT]: Launch detected! Trigger: ",1,0); debugMsg(GR_LaunchDetect::reasonName(ld.reason),1,0); 
+    debugMsg(", decided ",1,0); debugMsg((unsigned long)(ld.detectUs - ld.t0Us),1,0); debugMsg("us after T0");
+  }
+  if (flag_apogee && !io_apogeeLogged) { // fArg = apogee height above the pad (m)
+    const GR_ApogeeLandingDetect::Event& e = io_flightEvents.apogee();
+    io_logEventAt(e.timeUs, GR_EVT_APOGEE, 0, e.altM - io_launchDetect.baselineM());
+    io_apogeeLogged = 1;
+    io_apogeeLogEnd = io_logAppended();
+    changed = 1;
+    debugMsg("[EVENT]: Apogee detected at ",1,0); debugMsg((e.altM - io_launchDetect.baselineM()) * 3.280839895,1,0); debugMsg("ft above the pad");
+  }
+  if (flag_landed && !io_landedLogged) {
+    const GR_ApogeeLandingDetect::Event& e = io_flightEvents.landed();
+    io_logEventAt(e.timeUs, GR_EVT_LANDED, 0, e.altM - io_launchDetect.baselineM());
+    io_landedLogged = 1;
+    io_landedLogEnd = io_logAppended();
+    changed = 1;
+    debugMsg("[EVENT]: Landing detected");
+  }
+  if (!flag_launched) { io_launchLogged = 0; io_apogeeLogged = 0; io_landedLogged = 0; }
+  // Flight phase (burnout comes from the sampling task's filter, at most a sample old)
+  GR_FlightPhase::Inputs phaseIn = {flag_armed, flag_launched, flag_apogee, flag_landed, io_altKF.acceleration()};
+  if (io_phase.update(io_clock.micros(), phaseIn)) { // Log it and hand the new rates to the sampling task
+    const GR_FlightPhase::Transition& t = io_phase.last();
+    io_logEvent(GR_EVT_PHASE, t.to, t.inPhaseUs / 1e6f);
+    io_phaseSettings = &io_phase.settings();
+    debugMsg("[EVENT]: Flight phase: ",1,0); debugMsg(GR_FlightPhase::name(t.to));
+    if (t.to == GR_PHASE_SHUTDOWN) { // Landed tail's done
+      io_logEvent(GR_EVT_SHUTDOWN);
+      io_stopLog();
+      changed = 1; // No log to pick back up
+      debugMsg("[EVENT]: Shut down ",1,0); debugMsg(io_logTailS,1,0); debugMsg("s after landing, log closed");
+    }
+  }
+  bool averaged = io_phase.settings().rawEvery == 0; // Averaged records on the pad and after landing, full rate ones in the air
+  while ((n = io_sampleRing.popBatch(batch, io_drainBatchSize)) > 0) {
+    if (averaged) for (size_t i = 0; i < n; i++) io_logSample(batch[i]);
+    wi_latestSample = batch[n - 1];
+  }
+  io_drainRaw();
+  if (io_logWriter.full()) { // Preallocated log file is used up (bar io_logTailBytes, for this), close it
+    debugMsg("[WARN]: Log file is full, closing it");
+    io_logWriter.useTail();
+    io_logEvent(GR_EVT_LOG_FULL);
+    io_stopLog();
+    changed = 1;
+  }
+  if (io_sampleRing.overflows() != io_sampleRingOverflows) {
+    debugMsg("[WARN]: Sample queue overflowed, records dropped: ",1,0); debugMsg(io_sampleRing.overflows() - io_sampleRingOverflows);
+    io_sampleRingOverflows = io_sampleRing.overflows();
+  }
+  if (changed || (flag_armed && millis() - io_resumeTimer >= io_resumeSaveMs)) io_saveResume(); // Keeps synced() current too
+}
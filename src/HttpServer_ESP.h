@@ -0,0 +1,234 @@
+/* HttpServer_ESP.h
+    Serves a GR_HttpRouter with ESP-IDF's esp_http_server (replaces Arduino's WebServer.h, which could only talk to one client).
+
+    esp_http_server runs its own task: it select()s over every open socket, so several phones can be connected at once and a slow
+    or silent one doesn't stop the others from being answered. Handlers still run one at a time on that task (so they can share
+    static buffers), and they should be quick: while one runs, every other client waits. Bodies are sent as they're produced
+    (send() in one go, write() as chunks) so nothing needs a whole page in RAM.
+
+    When all wi_httpMaxClients sockets are in use, the least recently used one gets closed to make room (lru_purge_enable),
+    which is what you want when a phone wanders out of range without closing its connections.
+
+    Server push (the /events telemetry stream): a handler calls res.stream(), which sends the headers and hands back the socket.
+    The socket stays open after the handler returns and push() adds to it. push() must run on the server task, so other tasks
+    get there with queue(). It never waits: a client whose socket buffer is full gets disconnected rather than holding up the
+    task (its browser reconnects on its own), and onClose() tells whoever was pushing to it that it's gone.
+
+    Handing a connection over (log downloads, which take minutes): a handler calls res.detach() and passes the socket to another task,
+    which writes the whole response with plain blocking send()s (send_wait_timeout applies) and calls release() when it's done. One
+    at a time. The server still has the socket in its session list meanwhile, so if it decides to close it (the client hung up, or
+    it's the least recently used one) the close is put off until release(); either way the socket is closed exactly once, on the
+    server task. The response says Connection: close, so nothing else should arrive on it.
+*/
+#pragma once
+#include <Arduino.h>
+#include <esp_http_server.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <GR_Http.h>
+
+#define ESP_HTTP_MAX_BODY 1024    // Biggest request body we'll read (the config forms are well under this)
+#define ESP_HTTP_MAX_URI 256      // Longest path + query
+#define ESP_HTTP_MAX_HEADERS 8    // Response headers a handler can add (esp_http_server's max_resp_headers)
+#define ESP_HTTP_DETACHED_CLOSED 0x10000 // Added to detached_ once the server has tried to close the detached socket
+
+class ESP_HttpServer {
+  public:
+    ESP_HttpServer(const GR_HttpRouter& router) : router_(router) {}
+
+    /// @brief Start the server task
+    /// @param core / priority / stack for the server task
+    /// @param maxClients sockets open at once (each costs ~1.5KB of lwIP RAM; lwIP's socket limit applies too)
+    bool begin(uint16_t port, uint8_t maxClients, int core, unsigned priority, size_t stack) {
+      httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+      config.server_port = port;
+      config.ctrl_port = port + 1; // Internal control socket (UDP)
+      config.max_open_sockets = maxClients;
+      config.lru_purge_enable = true;
+      config.core_id = core;
+      config.task_priority = priority;
+      config.stack_size = stack;
+      config.max_uri_handlers = 4;
+      config.max_resp_headers = ESP_HTTP_MAX_HEADERS;
+      config.recv_wait_timeout = 5;  // s; a client that stops sending mid-request gets dropped instead of holding its socket
+      config.send_wait_timeout = 5;
+      config.uri_match_fn = httpd_uri_match_wildcard;
+      config.global_user_ctx = this;
+      config.global_user_ctx_free_fn = [](void *) {}; // It's us, not something httpd_stop() should free()
+      config.close_fn = onSocketClose;
+      if (httpd_start(&handle_, &config) != ESP_OK) return false;
+
+      // Everything goes through one wildcard handler per method and the router takes it from there
+      const httpd_method_t methods[] = {HTTP_GET, HTTP_POST, HTTP_DELETE};
+      for (httpd_method_t m : methods) {
+        httpd_uri_t uri = {};
+        uri.uri = "/*";
+        uri.method = m;
+        uri.handler = onRequest;
+        uri.user_ctx = this;
+        if (httpd_register_uri_handler(handle_, &uri) != ESP_OK) { end(); return false; }
+      }
+      return true;
+    }
+
+    void end() {
+      if (handle_) httpd_stop(handle_);
+      handle_ = NULL;
+    }
+
+    uint32_t requests() const { return requests_; }
+
+    /// @brief Called (on the server task) whenever a socket closes, so streams can be forgotten
+    void onClose(void (*fn)(int id)) { onClose_ = fn; }
+
+    /// @brief Run fn(arg) on the server task (from any task)
+    bool queue(httpd_work_fn_t fn, void * arg) { return handle_ && httpd_queue_work(handle_, fn, arg) == ESP_OK; }
+
+    /// @brief Add to a stream() response. Server task only (see queue())
+    /// @return false if it couldn't all be sent right away, in which case the connection is being closed
+    bool push(int id, const char * data, size_t len) {
+      if (!handle_) return false;
+      if (httpd_socket_send(handle_, id, data, len, MSG_DONTWAIT) == int(len)) return true;
+      httpd_sess_trigger_close(handle_, id); // Half a frame went out (or none); the client will reconnect and start clean
+      return false;
+    }
+
+    /// @brief Done with a detach()ed socket (from any task): it gets closed on the server task
+    void release(int id) {
+      if (!queue(onRelease, this)) { // Server's gone, nothing else will close it
+        detached_ = -1;
+        close(id);
+      }
+    }
+
+  private:
+    class Request : public GR_HttpRequest {
+      public:
+        Request(httpd_req_t * req) : req_(req) {}
+        bool header(const char * name, char * out, size_t max) const override {
+          return httpd_req_get_hdr_value_str(req_, name, out, max) == ESP_OK;
+        }
+      private:
+        httpd_req_t * req_;
+    };
+
+    class Response : public GR_HttpResponse {
+      public:
+        Response(httpd_req_t * req) : req_(req) {}
+        using GR_HttpResponse::send;
+        void header(const char * name, const char * value) override { httpd_resp_set_hdr(req_, name, value); }
+        bool send(int status, const char * type, const char * body, size_t len) override {
+          if (started_) return false;
+          head(status, type);
+          return httpd_resp_send(req_, body, ssize_t(len)) == ESP_OK;
+        }
+        bool begin(int status, const char * type) override {
+          if (started_) return false;
+          head(status, type);
+          return true;
+        }
+        bool write(const void * data, size_t len) override {
+          if (!len) return true;
+          return ok_ = ok_ && httpd_resp_send_chunk(req_, (const char *)data, ssize_t(len)) == ESP_OK;
+        }
+        bool end() override { return ok_ = ok_ && httpd_resp_send_chunk(req_, NULL, 0) == ESP_OK; }
+        int detach() override {
+          ESP_HttpServer * self = (ESP_HttpServer *)req_->user_ctx;
+          if (started_ || self->detached_ >= 0) return -1; // Only the server task hands sockets out, so no race here
+          started_ = true;
+          self->detached_ = httpd_req_to_sockfd(req_);
+          return self->detached_;
+        }
+        int stream(int status, const char * type) override {
+          if (started_) return -1;
+          started_ = true;
+          // Raw, since httpd_resp_* always finish the response. No Content-Length / chunking: the body ends when the socket does
+          char head[160];
+          int n = snprintf(head, sizeof(head), "HTTP/1.1 %s\r\nContent-Type: %s\r\nCache-Control: no-store\r\n\r\n",
+                           GR_Http::status(status), type);
+          if (n <= 0 || size_t(n) >= sizeof(head) || httpd_send(req_, head, size_t(n)) != n) return -1;
+          return httpd_req_to_sockfd(req_);
+        }
+      private:
+        void head(int status, const char * type) {
+          started_ = true;
+          httpd_resp_set_status(req_, GR_Http::status(status)); // Both are string literals, so they outlive the response
+          httpd_resp_set_type(req_, type);
+        }
+        httpd_req_t * req_;
+        bool ok_ = true;
+    };
+
+    static uint8_t method(int m) {
+      switch (m) {
+        case HTTP_GET: return GR_HTTP_GET;
+        case HTTP_POST: return GR_HTTP_POST;
+        case HTTP_DELETE: return GR_HTTP_DELETE;
+        default: return 0;
+      }
+    }
+
+    /// @brief Every request lands here (on the server task), gets turned into a GR_HttpRequest and handed to the router
+    static esp_err_t onRequest(httpd_req_t * req) {
+      ESP_HttpServer * self = (ESP_HttpServer *)req->user_ctx;
+      self->requests_++;
+      Request r(req);
+      Response res(req);
+      if (strlcpy(self->uri_, req->uri, sizeof(self->uri_)) >= sizeof(self->uri_)) {
+        res.send(414, "text/plain", "URI too long");
+        return ESP_OK;
+      }
+      char * q = strchr(self->uri_, '?');
+      if (q) *q = 0;
+      r.method = method(req->method);
+      r.path = self->uri_;
+      r.query = q ? q + 1 : "";
+
+      // Body (POSTs): read it all before the handler runs, it's small
+      if (req->content_len > ESP_HTTP_MAX_BODY) {
+        res.send(413, "text/plain", "Request too large");
+        return ESP_OK;
+      }
+      size_t got = 0;
+      while (got < req->content_len) {
+        int n = httpd_req_recv(req, self->body_ + got, req->content_len - got);
+        if (n <= 0) return ESP_FAIL; // Client went away or stalled for recv_wait_timeout; ESP_FAIL makes the server close the socket
+        got += size_t(n);
+      }
+      self->body_[got] = 0;
+      r.body = self->body_;
+      r.bodyLen = got;
+
+      self->router_.dispatch(r, res);
+      return ESP_OK;
+    }
+
+    /// @brief Set as close_fn, which makes closing the socket our job
+    static void onSocketClose(httpd_handle_t hd, int fd) {
+      ESP_HttpServer * self = (ESP_HttpServer *)httpd_get_global_user_ctx(hd);
+      if (self && self->detached_ == fd) { // Still being written to by whoever detach()ed it; release() closes it
+        self->detached_ = fd + ESP_HTTP_DETACHED_CLOSED;
+        return;
+      }
+      if (self && self->onClose_) self->onClose_(fd);
+      close(fd);
+    }
+
+    /// @brief release(), on the server task (so it can't cross paths with onSocketClose())
+    static void onRelease(void * arg) {
+      ESP_HttpServer * self = (ESP_HttpServer *)arg;
+      int fd = self->detached_;
+      self->detached_ = -1;
+      if (fd >= ESP_HTTP_DETACHED_CLOSED) close(fd - ESP_HTTP_DETACHED_CLOSED); // The server's already forgotten it
+      else if (fd >= 0) httpd_sess_trigger_close(self->handle_, fd); // Ends up in onSocketClose(), which closes it for real now
+    }
+
+    const GR_HttpRouter& router_;
+    httpd_handle_t handle_ = NULL;
+    uint32_t requests_ = 0;
+    void (*onClose_)(int id) = NULL;
+    volatile int detached_ = -1; // Socket handed out by detach() (+ ESP_HTTP_DETACHED_CLOSED once the server's tried to close it), -1 if none
+    // Only the server task touches these, one request at a time
+    char uri_[ESP_HTTP_MAX_URI];
+    char body_[ESP_HTTP_MAX_BODY + 1];
+};
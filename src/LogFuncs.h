@@ -0,0 +1,166 @@
+/* LogFuncs.h
+    Functions for writing the binary flight log (see lib/GR_FlightLog/GR_FlightLog.h for the format) to the SD card
+
+    Records are appended by the web server task (as it drains io_sampleRing) into io_logWriter's buffers; io_logWriterTask writes
+    full buffers to the card in the background, so neither the sampling task nor the web server ever waits on the SD card.
+    With log_pack on, records go through io_logPacker first and io_logWriter gets whole packed blocks (see GR_LogPack.h).
+*/
+#include <Arduino.h>
+#include <GR_FlightLog.h>
+#include <GR_LogPack.h>
+
+static_assert(GR_PACK_BLOCK % GR_SECTOR_SIZE == 0, "Packed blocks have to line up with the sectors a resume picks the log back up at");
+
+/// @brief Mount the SD card (setup(), and again from /armForLaunch if it wasn't there at boot)
+/// @return io_sdReady
+bool io_mountSD() {
+  if (io_sdReady) return true;
+  io_SdLock sdLock;
+  io_sdReady = sd.begin(SdSpiConfig(p_SDCS, DEDICATED_SPI, SD_SCK_MHZ(io_SDSpeedMHz)));
+  return io_sdReady;
+}
+
+/// @brief Append records to the log, packed if it's a packed log (no-op if no log is open)
+void io_logAppend(const GR_LogRecord * r, size_t n) {
+  if (!io_logWriter.isOpen()) return;
+  if (!io_logPacking) { io_logWriter.append(r, n * sizeof(GR_LogRecord)); return; }
+  for (size_t i = 0; i < n; i++) {
+    const uint8_t * block = io_logPacker.add(r[i]);
+    if (block) io_logWriter.append(block, GR_PACK_BLOCK);
+  }
+}
+
+/// @brief How many records io_logAppend() can take right now without dropping any (to pace bulk appends)
+size_t io_logRoom() {
+  size_t bytes = io_logWriter.writable();
+  return io_logPacking ? GR_LogPacker::recordsFor(bytes) : bytes / sizeof(GR_LogRecord);
+}
+
+/// @brief Where the log reaches with everything appended so far in it, counting the block being packed. Once io_logWriter.synced()
+///        gets here, it's all on the card
+uint64_t io_logAppended() { return io_logWriter.appended() + (io_logPacking && io_logPacker.pending() ? GR_PACK_BLOCK : 0); }
+
+/// @brief Create + preallocate a new log file and write the header. Called when the logger is armed
+/// @return false if there's no SD card, not enough space (io_logWriter.spaceShort()), or the file couldn't be created
+bool io_startLog() {
+  if (!io_sdReady) {
+    debugMsg("[ERROR]: Can't start log file, no SD card");
+    return false;
+  }
+  unsigned long performanceTimer = millis();
+  time_t wallS = time_t(io_wallAt(io_clock.micros()) / 1000000);
+  struct tm wall;
+  char name[40];
+  strftime(name, sizeof(name), "/Flight_%Y-%m-%d_%H-%M-%S.grl", gmtime_r(&wallS, &wall)); // Note: FAT doesn't allow ':' in file names
+  if (!io_logWriter.begin(name, uint64_t(io_logPreallocMB) << 20, uint64_t(io_logReserveMB) << 20)) {
+    debugMsg(io_logWriter.spaceShort() ? "[WARN]: Not enough free space on SD card for a new log file" : "[ERROR]: Failed to create log file");
+    return false;
+  }
+  strlcpy(io_logName, name, sizeof(io_logName)); // For io_saveResume()
+
+  io_logPacking = io_logPack;
+  io_logPacker.reset();
+  GR_LogHeader h = GR_FlightLog::makeHeader(io_clock.micros(), io_logPacking ? GR_PACK_BLOCK : 0);
+  h.cal_pAtSea = cal_pAtSea;
+  h.cal_lapseRate = cal_lapseRate;
+  h.cal_magicExp = cal_magicExp;
+  h.cal_zeroXAccel = cal_zeroXAccel; h.cal_zeroYAccel = cal_zeroYAccel; h.cal_zeroZAccel = cal_zeroZAccel;
+  h.cal_xAccelCoef = cal_xAccelCoef; h.cal_yAccelCoef = cal_yAccelCoef; h.cal_zAccelCoef = cal_zAccelCoef;
+  h.configSchema = io_config.schemaHash();
+  for (size_t i = 0; i < io_config.count(); i++) h.configCount += GR_Config::loggable(io_config.item(i));
+  io_logWriter.append(&h, sizeof(h));
+  if (io_logPacking) { // Blocks start on a block boundary
+    static const uint8_t zeros[GR_PACK_BLOCK] = {};
+    io_logWriter.append(zeros, size_t(GR_LogPack::dataStart(h) - sizeof(h)));
+  }
+  for (size_t i = 0; i < io_config.count(); i++) { // The settings this flight was flown with
+    const GR_ConfigItem& it = io_config.item(i);
+    if (!GR_Config::loggable(it)) continue;
+    double v = GR_Config::number(it);
+    GR_LogRecord r = GR_FlightLog::makeConfig(h.startUs, it.key, it.type == GR_CFG_FLOAT, int32_t(v), float(v));
+    io_logAppend(&r, 1);
+  }
+  GR_LogRecord wall = GR_FlightLog::makeWallClock(h.startUs, io_wallOffsetUs, time_synced); // What the timestamps are in real time
+  io_logAppend(&wall, 1);
+
+  performanceTimer = millis() - performanceTimer;
+  debugMsg("[EVENT]: Started ",1,0); debugMsg(io_logPacking ? "packed " : "",1,0); debugMsg("log file ",1,0); debugMsg(name,1,0); debugMsg(" in ",1,0); debugMsg(performanceTimer,1,0); debugMsg("ms");
+  return true;
+}
+
+/// @brief Append an event record with a specific timestamp to the log (no-op if no log is open)
+void io_logEventAt(uint64_t timeUs, uint16_t code, int32_t iArg = 0, float fArg = 0) {
+  GR_LogRecord r = GR_FlightLog::makeEvent(timeUs, code, iArg, fArg);
+  io_logAppend(&r, 1);
+}
+
+/// @brief Append an event record (stamped now) to the log (no-op if no log is open)
+void io_logEvent(uint16_t code, int32_t iArg = 0, float fArg = 0) { io_logEventAt(io_clock.micros(), code, iArg, fArg); }
+
+/// @brief Pick up the log file from before a reset mid-flight where it left off (see GR_Resume.h), or start a new one if that doesn't work
+///        out. Then log a resumed event. Called from setup(), before the writer task starts
+/// @return false if there's no log open at all
+bool io_resumeLog(const GR_ResumeState& from) {
+  if (!io_sdReady) {
+    debugMsg("[ERROR]: Can't pick the log back up, no SD card");
+    return false;
+  }
+  unsigned long performanceTimer = millis();
+  // Nothing synced yet means the header's gone too, so that's a new file as well. A packed log carries on from the last whole block,
+  // in a new one
+  uint64_t offset = from.logPackBlock ? from.logOffset - from.logOffset % from.logPackBlock : from.logOffset;
+  if (from.logPrealloc && offset && io_logWriter.resume(from.logName, from.logPrealloc, offset)) {
+    strlcpy(io_logName, from.logName, sizeof(io_logName));
+    io_logPacking = from.logPackBlock != 0;
+    io_logPacker.reset();
+    performanceTimer = millis() - performanceTimer;
+    debugMsg("[EVENT]: Picked log file ",1,0); debugMsg(from.logName,1,0); debugMsg(" back up at ",1,0); 
+    debugMsg((unsigned long)(io_logWriter.synced() / 1024),1,0); debugMsg("KB in ",1,0); debugMsg(performanceTimer,1,0); debugMsg("ms");
+  } else {
+    if (from.logOffset) { debugMsg("[ERROR]: Couldn't reopen log file ",1,0); debugMsg(from.logName,1,0); debugMsg(", starting a new one"); }
+    if (!io_startLog()) return false;
+    io_launchLogged = 0; io_apogeeLogged = 0; io_landedLogged = 0; // None of the flight's events are in this one
+  }
+  io_logEvent(GR_EVT_RESUMED, io_resetReason, esp_timer_get_time() / 1000.0f);
+  return true;
+}
+
+/// @brief Append a sample record to the log (no-op if no log is open)
+void io_logSample(const GR_SampleRecord& s) {
+  uint16_t battRaw = uint16_t(s.battRaw + 0.5f); // The log stores raw counts
+  GR_LogRecord r = GR_FlightLog::makeSample(s.timeUs, GR_SAMPLE_ACCEL | GR_SAMPLE_BARO | GR_SAMPLE_BATT,
+                                            uint16_t(s.xAccelRaw + 0.5f), uint16_t(s.yAccelRaw + 0.5f), uint16_t(s.zAccelRaw + 0.5f),
+                                            s.pressPa, s.tempC, battRaw);
+  io_logAppend(&r, 1);
+}
+
+/// @brief Flush and close the log file (no-op if no log is open)
+void io_stopLog() {
+  if (!io_logWriter.isOpen()) return;
+  io_logName[0] = 0;
+  const uint8_t * block = io_logPacking ? io_logPacker.flush() : NULL;
+  if (block) io_logWriter.append(block, GR_PACK_BLOCK);
+  if (!io_logWriter.end()) debugMsg("[ERROR]: Log file didn't close cleanly, data may be missing");
+  const auto& st = io_logWriter.stats();
+  debugMsg("[EVENT]: Log file closed. ",1,0); debugMsg((unsigned long)(st.bytesWritten / 1024),1,0); debugMsg("KB written in ",1,0); 
+  debugMsg(st.writes,1,0); debugMsg(" writes, ",1,0); debugMsg((unsigned long)(st.bytesDropped),1,0); debugMsg(" bytes dropped");
+  debugMsg("  Write latency (us): avg ",1,0); debugMsg(io_logWriter.avgWriteUs(),1,0); debugMsg(", worst ",1,0); debugMsg(st.maxWriteUs);
+  if (io_logPacking && io_logPacker.stats().blocks) { // Records since the log was started / picked back up
+    const auto& ps = io_logPacker.stats();
+    debugMsg("  Packed ",1,0); debugMsg(ps.records,1,0); debugMsg(" records into ",1,0); debugMsg(ps.blocks,1,0); debugMsg(" blocks (",1,0);
+    debugMsg(float(ps.records) * sizeof(GR_LogRecord) / (float(ps.blocks) * GR_PACK_BLOCK),1,0,2); debugMsg("x)");
+  }
+}
+
+/// @brief Background SD card writer task (pinned to io_logWriterCore). Writes full buffers from io_logWriter as they come in
+void io_logWriterTask(void * param) {
+  for (;;) {
+#ifdef GR_PERF_ENABLE
+    uint32_t start = GR_perfCycles();
+    if (io_logWriter.service()) { GR_PERF_RECORD(io_perfLogWrite, GR_perfCycles() - start); continue; } // Only count calls that actually wrote something
+#else
+    if (io_logWriter.service()) continue;
+#endif
+    vTaskDelay(pdMS_TO_TICKS(io_logWriterPollMs));
+  }
+}
@@ -0,0 +1,97 @@
+/* SDCard_ESP.h
+    SdFat implementation of GR_BlockDevice for the XIAO ESP32S3 Sense's SD card slot
+
+    The log file is preallocated as one contiguous run of clusters (FsFile::preAllocate), so writing it is just multi-sector
+    writes straight to the card with no FAT / directory updates in between. close() truncates the file to what was written.
+    sync() writes the directory entry (one sector) so the file size on the card keeps up, which is what lets reopen() seek back to
+    the end of it after a reset.
+
+    ESP_SdLogSource is the read side, for log downloads (GR_LogDownload.h).
+*/
+#include <Arduino.h>
+#include <SdFat.h>
+#include <GR_BlockDevice.h>
+#include <GR_LogDownload.h>
+
+class ESP_SdBlockDevice : public GR_BlockDevice {
+  public:
+    ESP_SdBlockDevice(SdFs& sd) : sd_(sd) {}
+
+    uint64_t freeBytes() override {
+      int32_t clusters = sd_.freeClusterCount(); // Note: this scans the FAT on FAT32 cards, so it's slow-ish (only called when arming)
+      if (clusters < 0) return 0;
+      return uint64_t(clusters) * sd_.bytesPerCluster();
+    }
+
+    bool create(const char * name, uint64_t preallocBytes) override {
+      if (!file_.open(name, O_RDWR | O_CREAT | O_TRUNC)) return false;
+      if (!file_.preAllocate(preallocBytes) || !file_.sync()) { // sync: the directory entry has to be on the card for reopen() to find it
+        file_.close();
+        sd_.remove(name);
+        return false;
+      }
+      return true;
+    }
+
+    bool sync() override { return file_.sync(); }
+
+    bool reopen(const char * name, uint64_t offset) override {
+      if (file_.isOpen()) return false;
+      if (!file_.open(name, O_RDWR)) return false;
+      if (file_.fileSize() < offset || !file_.seekSet(offset)) { // Can't seek past the size the last sync() left on the card
+        file_.close();
+        return false;
+      }
+      return true;
+    }
+
+    bool write(const uint8_t * buf, size_t len) override {
+      // Whole, sector aligned writes to a preallocated file go straight to the card as one multi-sector transfer (no cache copy)
+      return file_.write(buf, len) == len;
+    }
+
+    bool close() override {
+      bool ok = file_.truncate(); // Drop the unused part of the preallocation
+      return file_.close() && ok;
+    }
+
+  private:
+    SdFs& sd_;
+    FsFile file_;
+};
+
+/// @brief A closed log file on the SD card, read for a download. SdFat isn't thread safe, so every call holds lock (shared with
+///        anything else that uses the card while the logger's disarmed, see io_SdLock in main.cpp)
+class ESP_SdLogSource : public GR_LogSource {
+  public:
+    ESP_SdLogSource(SdFs& sd, SemaphoreHandle_t lock) : sd_(sd), lock_(lock) {}
+    ~ESP_SdLogSource() { close(); }
+
+    bool open(const char * path) {
+      Lock l(lock_);
+      return file_.open(&sd_, path, O_RDONLY) && !file_.isDir();
+    }
+    void close() {
+      Lock l(lock_);
+      if (file_.isOpen()) file_.close();
+    }
+
+    uint64_t size() override { Lock l(lock_); return file_.fileSize(); }
+    bool seek(uint64_t pos) override { Lock l(lock_); return file_.seekSet(pos); }
+    size_t read(void * buf, size_t len) override {
+      // Whole sectors from a sector boundary on go straight from the card into buf (one multi-sector read), skipping SdFat's cache
+      Lock l(lock_);
+      int n = file_.read(buf, len);
+      return n > 0 ? size_t(n) : 0;
+    }
+
+  private:
+    struct Lock {
+      Lock(SemaphoreHandle_t m) : m_(m) { xSemaphoreTake(m_, portMAX_DELAY); }
+      ~Lock() { xSemaphoreGive(m_); }
+      SemaphoreHandle_t m_;
+    };
+    SdFs& sd_;
+    SemaphoreHandle_t lock_;
+    FsFile file_;
+};
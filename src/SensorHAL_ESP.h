@@ -0,0 +1,112 @@
+/* SensorHAL_ESP.h
+    ESP32 / Arduino implementations of the GR_SensorHAL interfaces (clock, I2C bus) and GR_Prefs (NVS). The ADXL377 + battery ADC
+    are in AdcDMA_ESP.h, and the DPS310 driver (lib/GR_DPS310) runs on the I2C bus here
+
+    Included from main.cpp after the IO defines. The fake versions for the native build are in native/FakeSensors.h, native/FakeDPS310.h,
+    native/FilePrefs.h and native/TraceReplay.h
+*/
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <Wire.h>
+#include <Preferences.h>
+#include <GR_SensorHAL.h>
+#include <GR_Prefs.h>
+
+#define ESP_CLOCK_SPIN_US 50  // Waits shorter than this are spun out instead of arming the timer (timer dispatch costs about that much)
+
+class ESP_Clock : public GR_Clock {
+  public:
+    uint32_t millis() override { return ::millis(); }
+    uint64_t micros() override { return esp_timer_get_time() + baseUs_; }
+    /// @brief Make micros() read nowUs from here on (a resumed flight carries on from its pre-reset timestamps, see GR_Resume.h).
+    ///        Only before the sampling task starts; millis() stays time since boot
+    void setMicros(uint64_t nowUs) { baseUs_ = int64_t(nowUs) - esp_timer_get_time(); }
+    void sleepMs(uint32_t ms) override {
+      TickType_t ticks = pdMS_TO_TICKS(ms);
+      vTaskDelay(ticks > 0 ? ticks : 1); // Always block for at least a tick, otherwise the lower priority tasks on this core never run
+    }
+    /// @brief us resolution sleep: arms a one-shot esp_timer (hardware systimer) that wakes this task with a task notification.
+    ///        Only one task should use this at a time (it's the sampling task's; everything else sticks to sleepMs())
+    void sleepUntilUs(uint64_t deadlineUs) override {
+      int64_t wait = int64_t(deadlineUs - micros());
+      if (wait <= 0) return;
+      if (wait > ESP_CLOCK_SPIN_US) {
+        if (!timer_) {
+          esp_timer_create_args_t args = {};
+          args.callback = wake;
+          args.arg = this;
+          args.dispatch_method = ESP_TIMER_TASK;
+          args.name = "io_clockWake";
+          if (esp_timer_create(&args, &timer_) != ESP_OK) { timer_ = NULL; sleepMs(uint32_t((wait + 999) / 1000)); return; }
+        }
+        waiter_ = xTaskGetCurrentTaskHandle();
+        ulTaskNotifyTake(pdTRUE, 0); // Clear any stale wakeup
+        if (esp_timer_start_once(timer_, wait - ESP_CLOCK_SPIN_US / 2) == ESP_OK) {
+          ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait / 1000 + 10)); // Timeout is only a backstop in case the timer never fires
+          esp_timer_stop(timer_); // No-op if it already fired
+        }
+      }
+      while (int64_t(deadlineUs - micros()) > 0) {} // Spin out the last few us
+    }
+  private:
+    static void wake(void * arg) { xTaskNotifyGive(static_cast<ESP_Clock*>(arg)->waiter_); }
+    esp_timer_handle_t timer_ = NULL;
+    TaskHandle_t volatile waiter_ = NULL;
+    int64_t baseUs_ = 0;
+};
+
+/// @brief GR_I2CBus on an Arduino TwoWire (the ESP32-S3's I2C controller tops out at 800kHz, so no Fm+ 1MHz)
+class ESP_I2CBus : public GR_I2CBus {
+  public:
+    ESP_I2CBus(TwoWire& wire) : wire_(wire) {}
+    bool begin(int sda, int scl, uint32_t hz) {
+      if (!wire_.begin(sda, scl, hz)) return false;
+      hz_ = wire_.getClock();
+      return true;
+    }
+    /// @brief Change the SCL frequency (what the controller actually got is what clockHz() says after)
+    void setClock(uint32_t hz) {
+      wire_.setClock(hz);
+      hz_ = wire_.getClock();
+    }
+    uint32_t clockHz() override { return hz_; }
+    bool readRegs(uint8_t addr, uint8_t reg, uint8_t * buf, size_t n) override {
+      wire_.beginTransmission(addr);
+      wire_.write(reg);
+      if (wire_.endTransmission(false) != 0) return false; // Repeated start
+      if (wire_.requestFrom(uint16_t(addr), n) != n) return false;
+      for (size_t i = 0; i < n; i++) buf[i] = uint8_t(wire_.read());
+      return true;
+    }
+    bool writeReg(uint8_t addr, uint8_t reg, uint8_t value) override {
+      wire_.beginTransmission(addr);
+      wire_.write(reg);
+      wire_.write(value);
+      return wire_.endTransmission() == 0;
+    }
+  private:
+    TwoWire& wire_;
+    uint32_t hz_ = 100000;
+};
+
+/// @brief GR_Prefs on the NVS partition (thin pass-through to Preferences)
+class ESP_Prefs : public GR_Prefs {
+  public:
+    ESP_Prefs(Preferences& prefs) : prefs_(prefs) {}
+    bool begin(const char * name) override { return prefs_.begin(name); }
+    bool clear() override { return prefs_.clear(); }
+    bool isKey(const char * key) override { return prefs_.isKey(key); }
+    bool remove(const char * key) override { return !prefs_.isKey(key) || prefs_.remove(key); }
+    size_t freeEntries() override { return prefs_.freeEntries(); }
+    int32_t getInt(const char * key, int32_t def = 0) override { return prefs_.getInt(key, def); }
+    size_t putInt(const char * key, int32_t value) override { return prefs_.putInt(key, value); }
+    float getFloat(const char * key, float def = 0) override { return prefs_.getFloat(key, def); }
+    size_t putFloat(const char * key, float value) override { return prefs_.putFloat(key, value); }
+    size_t getString(const char * key, char * out, size_t max) override { return prefs_.getString(key, out, max); }
+    size_t putString(const char * key, const char * value) override { return prefs_.putString(key, value); }
+    size_t getBytes(const char * key, void * out, size_t max) override { return prefs_.getBytes(key, out, max); }
+    size_t putBytes(const char * key, const void * value, size_t len) override { return prefs_.putBytes(key, value, len); }
+    size_t getBytesLength(const char * key) override { return prefs_.getBytesLength(key); }
+  private:
+    Preferences& prefs_;
+};
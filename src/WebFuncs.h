@@ -1,68 +1,150 @@
 /* WebFuncs.cpp
     Functions for sending and processing web server data
 
-    Web pages are stored as raw string literals in the web/webpage_name.h files for cleanliness. 
+    Web pages come from data/, minified + gzipped by tools/web_assets.py at build time. The small ones (all of them, so far) are built
+    into the firmware (WebAssets.h), anything bigger goes in SPIFFS; wi_sendFile() looks in both.
+
+    These are the handlers wi_router sends requests to (see GR_Http.h). They run on the HTTP server's own task (see HttpServer_ESP.h),
+    one at a time, so they can share static buffers. Anything they touch that wi_serverTask also uses (the log, the flags,
+    wi_latestSample) has to be done holding wi_StateLock.
+
+    Log downloads are the exception to "handlers are quick": wi_sendDownload() hands the socket over to wi_downloadTask (see the note by
+    wi_downloadChunk in main.cpp).
 */
 #include <Arduino.h>
-#include <WebServer.h>
+#include <GR_Http.h>
+#include <time.h>       // mktime() / strftime() for the wall clock
+#include <esp_timer.h>  // esp_timer_get_time() for download throughput
+#include <GR_LogDownload.h>
+#include "WebAssets.h"  // data/ minified + gzipped into the firmware (generated by tools/web_assets.py, see platformio.ini)
+
+#define wi_fileChunk 1024         // Files are streamed to the client this many bytes at a time
+#define wi_maxFiles 16            // SPIFFS files wi_indexFiles() keeps ETags for
+#define wi_cachePage "no-cache"   // Pages: the browser asks every time, but it's a bodiless 304 unless the page changed (and / is
+                                  // a different page armed vs not, so it mustn't just keep one)
+#define wi_cacheStatic "max-age=86400" // style.css, favicon.ico
+
+void wi_NotFound(const GR_HttpRequest& req, GR_HttpResponse& res) {
+    res.send(404, "text/plain", "Page / data not found");
+    debugMsg("[EVENT]: Web Server sent 404 page for ",1,0); debugMsg(req.path);
+}
+
+/// @brief What wi_sendFile() needs to know about a SPIFFS file without opening it
+struct wi_FileTag {
+  char path[32];  // Without the .gz
+  char etag[GR_HTTP_ETAG_LEN];
+  bool gz;        // Stored as path + ".gz" (from data_build/, see tools/web_assets.py)
+};
+wi_FileTag wi_fileTags[wi_maxFiles];
+size_t wi_fileTagCount = 0;
+
+/// @brief Work out an ETag for every file in SPIFFS (a hash of its contents). Once, in setup(); the files never change while we're running.
+///        Hashing them (rather than the build step writing ETags into the firmware) means reuploading just the filesystem image can't leave
+///        browsers with stale pages
+void wi_indexFiles() {
+  static uint8_t buf[wi_fileChunk];
+  File root = SPIFFS.open("/");
+  if (!root) return;
+  for (File f = root.openNextFile(); f && wi_fileTagCount < wi_maxFiles; f = root.openNextFile()) {
+    if (f.isDirectory()) continue;
+    wi_FileTag& t = wi_fileTags[wi_fileTagCount];
+    const char * path = f.path();
+    size_t len = strlen(path);
+    t.gz = len > 3 && !strcmp(path + len - 3, ".gz");
+    if (t.gz) len -= 3;
+    if (len >= sizeof(t.path)) continue;
+    memcpy(t.path, path, len);
+    t.path[len] = 0;
+    uint64_t hash = GR_Http::fnv1a64(NULL, 0);
+    size_t n;
+    while ((n = f.read(buf, sizeof(buf))) > 0) hash = GR_Http::fnv1a64(buf, n, hash);
+    GR_Http::etag(hash, t.etag);
+    wi_fileTagCount++;
+  }
+}
 
-void wi_NotFound(WebServer& server) {
-    server.send(404, "text/plain", "Page / data not found");
-    debugMsg("[EVENT]: Web Server sent 404 page");
+/// @brief Send a page / file: out of flash if the build step embedded it (WebAssets.h), else streamed from SPIFFS (gzipped if there's a .gz).
+///        Either way with an ETag, and a bodiless 304 if the browser's copy is already current
+/// @return false if there's no such file (a 500 has been sent)
+bool wi_sendFile(const GR_HttpRequest& req, GR_HttpResponse& res, const char * fileName, const char * type) {
+  const char * cache = strcmp(type, "text/html") ? wi_cacheStatic : wi_cachePage;
+  const GR_HttpAsset * asset = GR_Http::findAsset(wi_assets, wi_assetCount, fileName);
+  if (asset) {
+    GR_Http::sendAsset(req, res, *asset, cache);
+    return true;
+  }
+  const wi_FileTag * tag = NULL;
+  for (size_t i = 0; i < wi_fileTagCount && !tag; i++) if (!strcmp(wi_fileTags[i].path, fileName)) tag = &wi_fileTags[i];
+  if (!tag) {
+    res.send(500, "text/plain", "File not found");
+    debugMsg("[ERROR]: No such file ",1,0); debugMsg(fileName);
+    return false;
+  }
+  if (GR_Http::fresh(req, tag->etag)) {
+    GR_Http::notModified(res, type, tag->etag, cache);
+    return true;
+  }
+  char path[sizeof(tag->path) + 3];
+  snprintf(path, sizeof(path), tag->gz ? "%s.gz" : "%s", tag->path);
+  File page = SPIFFS.open(path, "r");
+  if (!page) {
+    res.send(500, "text/plain", "File not found");
+    debugMsg("[ERROR]: Couldn't open file ",1,0); debugMsg(path);
+    return false;
+  }
+  static uint8_t buf[wi_fileChunk]; // static: handlers run one at a time, and this is too big for the server task's stack
+  res.header("ETag", tag->etag);
+  res.header("Cache-Control", cache);
+  if (tag->gz) res.header("Content-Encoding", "gzip");
+  res.begin(200, type);
+  size_t n;
+  while ((n = page.read(buf, sizeof(buf))) > 0) {
+    if (!res.write(buf, n)) break; // Client went away
+  }
+  res.end();
+  page.close();
+  return true;
 }
 
-void wi_sendStatus(WebServer& server) {
-  // If the logger is armed, send the armed version status page. 
-  // Having two different page versions is important because we don't want any scripts on the page requesting data from us if the logger is armed, because we need
-  // as much RTOS headroom as possible to execute our launch detection logic reliably. Else we might mis the launch event by a few (or dozens of ) milliseconds
+void wi_sendStatus(const GR_HttpRequest& req, GR_HttpResponse& res) {
+  GR_PERF_SCOPE(wi_perfStatus);
+  // If the logger is armed, send the armed version status page.
+  // The armed page has no controls besides disarm (so nobody can reconfigure / change pages mid-countdown); its live readout comes from
+  // the same /events stream as the normal page, which is cheap enough to keep going while armed (one small frame per client per period,
+  // sent from the HTTP server task on core 0, nowhere near the sampling task)
   debugMsg("[EVENT]: Client requested status page");
   unsigned long performanceTimer = millis();
   if (!flag_armed) { // Send non-armed status page
-    File page = SPIFFS.open("/status.html", "r");
-    if (!page) { 
-      server.send(500, "text/plain", "File not found");
-      debugMsg("[ERROR]: Couldn't open html file");
-    } else {
-      server.sendHeader("Cache-Control", "max-age=86400"); 
-      server.streamFile(page, "text/html");
-      page.close();
+    if (wi_sendFile(req, res, "/status.html", "text/html")) {
       performanceTimer = millis() - performanceTimer;
       debugMsg("[EVENT]: WebServer sent non-armed status page to client in ",1,0); debugMsg(performanceTimer,1,0); debugMsg("ms\n\n");
     }
   } else { // Send armed status page
-    File page = SPIFFS.open("/statusArmed.html", "r");
-    if (!page) {
-      server.send(500, "text/plain", "File not found");
-      debugMsg("[ERROR]: Couldn't open html file");
-    } else {
-      server.sendHeader("Cache-Control", "max-age=86400"); 
-      server.streamFile(page, "text/html");
-      page.close();
+    if (wi_sendFile(req, res, "/statusArmed.html", "text/html")) {
       performanceTimer = millis() - performanceTimer;
       debugMsg("[EVENT]: WebServer sent armed status page to client in ",1,0); debugMsg(performanceTimer,1,0); debugMsg("ms\n\n");
     }
-    
   }
 }
 
 // For sending pages other than the status page
-void wi_sendPage(WebServer& server, const char * fileName) { 
-  if (!flag_armed) { // Only send the page if we aren't armed
-    debugMsg("[EVENT]: Client requested a page: ",1,0); debugMsg(fileName);
-    unsigned long performanceTimer = millis();
-    File page = SPIFFS.open(fileName, "r");
-    if (!page) {
-      server.send(500, "text/plain", "File not found");
-      debugMsg("[ERROR]: Couldn't open html file");
-    } else {
-      server.sendHeader("Cache-Control", "max-age=86400"); 
-      server.streamFile(page, "text/html");
-      page.close();
-    }
-    performanceTimer = millis() - performanceTimer;
-    debugMsg("[EVENT]: WebServer sent",1,0); debugMsg(fileName,1,0); debugMsg(" to client in ",1,0); debugMsg(performanceTimer,1,0); debugMsg("ms\n\n");
+void wi_sendPage(const GR_HttpRequest& req, GR_HttpResponse& res, const char * fileName) {
+  GR_PERF_SCOPE(wi_perfPage);
+  if (flag_armed) { // Only send the page if we aren't armed
+    res.send(409, "text/plain", "Logger is armed");
+    return;
   }
+  debugMsg("[EVENT]: Client requested a page: ",1,0); debugMsg(fileName);
+  unsigned long performanceTimer = millis();
+  wi_sendFile(req, res, fileName, "text/html");
+  performanceTimer = millis() - performanceTimer;
+  debugMsg("[EVENT]: WebServer sent",1,0); debugMsg(fileName,1,0); debugMsg(" to client in ",1,0); debugMsg(performanceTimer,1,0); debugMsg("ms\n\n");
 }
+void wi_sendSetup(const GR_HttpRequest& req, GR_HttpResponse& res) { wi_sendPage(req, res, "/setup.html"); }
+void wi_sendLogs(const GR_HttpRequest& req, GR_HttpResponse& res) { wi_sendPage(req, res, "/logs.html"); }
+void wi_sendDocs(const GR_HttpRequest& req, GR_HttpResponse& res) { wi_sendPage(req, res, "/docs.html"); }
+void wi_sendStyle(const GR_HttpRequest& req, GR_HttpResponse& res) { wi_sendFile(req, res, "/style.css", "text/css"); }
+void wi_sendIcon(const GR_HttpRequest& req, GR_HttpResponse& res) { wi_sendFile(req, res, "/favicon.ico", "image/x-icon"); }
 
 
 
@@ -70,105 +152,365 @@ void wi_sendPage(WebServer& server, const char * fileName) {
 // Page interaction request functions
 
 
-/// @brief Sync the internal RTC on the ESP32 with a time argument from the client (see data/status.html for corresponding js)
-/// @param server WebServer object
-void wi_syncTime(WebServer& server) {
-  if (flag_armed) return; // Don't execute if we're armed for launch
-  String clientTime = server.arg("plain");
+/// @brief Set the wall clock from a time argument from the client (see data/status.html for corresponding js)
+void wi_syncTime(const GR_HttpRequest& req, GR_HttpResponse& res) {
+  GR_PERF_SCOPE(wi_perfSyncTime);
+  wi_StateLock lock; // The log file name comes from the wall clock
+  if (flag_armed) { // Don't execute if we're armed for launch
+    res.send(409, "text/plain", "Logger is armed");
+    return;
+  }
+  String clientTime = req.body;
   debugMsg("[EVENT]: Time sync sent from client:");
   debugMsg(clientTime);
 
-  // Extract date and time from client arg, formatted as: "01/05/2024 22:00:38 GMT-0500 (Eastern Standard Time)" 
+  // Extract date and time from client arg, formatted as: "01/05/2024 22:00:38 GMT-0500 (Eastern Standard Time)"
   // IMPORTANT: Month and day MUST have leading zeros (this is non-standard for js .toLocaleDateString()!
-  time_month = clientTime.substring(0, 2).toInt(); 
-  time_day = clientTime.substring(3, 5).toInt();   
-  time_year = clientTime.substring(6, 10).toInt(); 
-  time_hr = clientTime.substring(11, 13).toInt();  
-  time_min = clientTime.substring(14, 16).toInt(); 
-  time_sec = clientTime.substring(17, 19).toInt(); 
+  time_month = clientTime.substring(0, 2).toInt();
+  time_day = clientTime.substring(3, 5).toInt();
+  time_year = clientTime.substring(6, 10).toInt();
+  time_hr = clientTime.substring(11, 13).toInt();
+  time_min = clientTime.substring(14, 16).toInt();
+  time_sec = clientTime.substring(17, 19).toInt();
   time_zone = clientTime.substring(20, 28);
   // debugMsg(time_month,1,0); debugMsg(" | ",1,0); debugMsg(time_day,1,0); debugMsg(" | ",1,0); debugMsg(time_year,1,0); debugMsg(" | ",1,0);
   // debugMsg(time_hr,1,0); debugMsg(" | ",1,0); debugMsg(time_min,1,0); debugMsg(" | ",1,0); debugMsg(time_sec,1,0); debugMsg(" | ",1,0); debugMsg(time_zone);
-  
-  //TODO: Add some logic to verify if the time string we parsed above makes sense or if it's likely corrupt (rtc.setTime doesn't return anything or we could use that)
-  //TODO: Store in RTC with ESP implementation instead of ESP32Time lib https://docs.espressif.com/projects/esp-idf/en/latest/esp32/api-reference/system/system_time.html
-  rtc.setTime(time_sec,time_min,time_hr,time_day,time_month,time_year,0);
+
+  //TODO: Add some logic to verify if the time string we parsed above makes sense or if it's likely corrupt
+  // The client's local time, kept as if it were GMT (no TZ is set, so mktime() / gmtime_r() don't shift it), same as it always was
+  struct tm t = {};
+  t.tm_year = time_year - 1900; t.tm_mon = time_month - 1; t.tm_mday = time_day;
+  t.tm_hour = time_hr; t.tm_min = time_min; t.tm_sec = time_sec;
+  io_setWallClock(int64_t(mktime(&t)) * 1000000); // Just an offset on io_clock: sample timestamps don't move, see io_wallAt()
   time_synced = 1;
-  
+
   if (true) { // For now, we always set the RTC correctly!
-    server.send(200, "text/plain", "success");
+    res.send(200, "text/plain", "success");
   } else {
-    server.send(400, "text/plain", "failed");
+    res.send(400, "text/plain", "failed");
   }
-  
+
   if (debugMode < 1) return; // The rest of this is just debug stuff
   char clientTimeStr[200];
-  sprintf(clientTimeStr, "(DD/MM/YYYY HH:MM:SS ZONE): %02d/%02d/%04d %02d:%02d:%02d %s", time_day,time_month,time_year,time_hr,time_min,time_sec,time_zone);
+  sprintf(clientTimeStr, "(DD/MM/YYYY HH:MM:SS ZONE): %02d/%02d/%04d %02d:%02d:%02d %s", time_day,time_month,time_year,time_hr,time_min,time_sec,time_zone.c_str());
 
   debugMsg("  Translated to: ",1,0); debugMsg(clientTimeStr);
-  debugMsg("  and internal RTC set to: ",1,0); debugMsg(rtc.getDateTime(),1,0); debugMsg(":",1,0); debugMsg(rtc.getMillis());
+  int64_t wallUs = io_wallAt(io_clock.micros());
+  time_t wallS = time_t(wallUs / 1000000);
+  struct tm wall;
+  char wallStr[32];
+  strftime(wallStr, sizeof(wallStr), "%Y-%m-%d %H:%M:%S", gmtime_r(&wallS, &wall));
+  debugMsg("  and wall clock set to: ",1,0); debugMsg(wallStr,1,0); debugMsg(".",1,0); debugMsg(int(wallUs % 1000000 / 1000));
 }
 
-void wi_updateStatus(WebServer& server) {
-  if (flag_armed) return; // Don't execute if we're armed
-  debugMsg("[EVENT]: Client requested statusUpdate XML data");
-  unsigned long performanceTimer = millis();
+/// @brief Subscribe to the live telemetry stream (Server-Sent Events, see GR_Telemetry.h). ?ms= sets the frame period
+void wi_sendEvents(const GR_HttpRequest& req, GR_HttpResponse& res) {
+  GR_PERF_SCOPE(wi_perfEvents);
+  char arg[12];
+  unsigned long periodMs = wi_telemetryDefaultMs;
+  if (req.arg("ms", arg, sizeof(arg))) periodMs = constrain(strtoul(arg, NULL, 10), wi_telemetryMinMs, wi_telemetryMaxMs);
+  if (wi_telemetry.full()) {
+    res.send(503, "text/plain", "Too many live feeds"); // EventSource tries again by itself
+    return;
+  }
+  int id = res.stream(200, "text/event-stream");
+  if (id < 0) {
+    res.send(500, "text/plain", "Can't stream");
+    return;
+  }
+  wi_telemetry.add(id, periodMs, millis()); // Can't fail, we checked full() and nothing else adds
+  debugMsg("[EVENT]: Client subscribed to live telemetry every ",1,0); debugMsg(periodMs,1,0); debugMsg("ms");
+}
 
-  String xml = "<data>";
-  xml += "<time>" + rtc.getTime() + ":" + String(rtc.getMillis()) + "</time>";
-  xml += "<date>" + rtc.getDate() + "</date>";
-  xml += "<xAccel>" + String(dat_xAccelRaw) + "</xAccel>";
-  xml += "<yAccel>" + String(dat_yAccelRaw) + "</yAccel>";
-  xml += "<zAccel>" + String(dat_zAccelRaw) + "</zAccel>";
-  xml += "<pressPa>" + String(dat_pressPa) + "</pressPa>";
-  xml += "<tempC>" + String(dat_tempC) + "</tempC>";
-  xml += "<tempF>" + String(dat_tempF) + "</tempF>";
-  xml += "<altM>" + String(dat_altMBaro) + "</altM>";
-  xml += "<altFt>" + String(dat_altFtBaro) + "</altFt>";
-  xml += "<battV>" + String(dat_battV) + "</battV>";
-  xml += "<launchDetectAltFt>" + String("dummy") + "</launchDetectAltFt>";
-  xml += "<launchDetectXAccel>" + String("dummy") + "</launchDetectXAccel>";
-  xml += "<launchDetectYAccel>" + String("dummy") + "</launchDetectYAccel>";
-  xml += "<launchDetectZAccel>" + String("dummy") + "</launchDetectZAccel>";
-  xml += "<flightLoggingTimeout>" + String("dummy") + "</flightLoggingTimeout>";
-  xml += "<landedLoggingTimeout>" + String("dummy") + "</landedLoggingTimeout>";
-  xml += "</data>";
-
-  server.send(200, "text/xml", xml);
+bool wi_telemetryFrame(int id, const char * frame, size_t len) { return wi_server.push(id, frame, len); }
+void wi_telemetryClosed(int id) { wi_telemetry.remove(id); }
 
-  performanceTimer = millis() - performanceTimer;
-  debugMsg("[EVENT]: WebServer sent statusUpdate XML data to client in ",1,0); debugMsg(performanceTimer,1,0); debugMsg("ms\n\n");
+/// @brief Send every subscriber that's due one its next telemetry frame. Queued onto the HTTP server task by wi_serverTask
+void wi_pushTelemetry(void * arg) {
+  GR_PERF_SCOPE(wi_perfTelemetry);
+  wi_telemetryQueued = 0;
+  GR_SampleRecord dat;
+  {
+    wi_StateLock lock; // wi_serverTask writes wi_latestSample
+    dat = wi_latestSample;
+  }
+  int64_t v[wi_tlmFieldCount];
+  v[wi_tlmTime] = io_wallAt(dat.timeUs) / 1000; // When the sample was taken, not when it's sent
+  v[wi_tlmX] = GR_Telemetry::quantize(dat.xAccelRaw, wi_tlmFields[wi_tlmX].decimals);
+  v[wi_tlmY] = GR_Telemetry::quantize(dat.yAccelRaw, wi_tlmFields[wi_tlmY].decimals);
+  v[wi_tlmZ] = GR_Telemetry::quantize(dat.zAccelRaw, wi_tlmFields[wi_tlmZ].decimals);
+  v[wi_tlmPress] = GR_Telemetry::quantize(dat.pressPa, wi_tlmFields[wi_tlmPress].decimals);
+  v[wi_tlmTempC] = GR_Telemetry::quantize(dat.tempC, wi_tlmFields[wi_tlmTempC].decimals);
+  v[wi_tlmAltM] = GR_Telemetry::quantize(dat.altM, wi_tlmFields[wi_tlmAltM].decimals);
+  v[wi_tlmBatt] = GR_Telemetry::quantize(dat.battV(), wi_tlmFields[wi_tlmBatt].decimals);
+  v[wi_tlmState] = (time_synced ? wi_tlmStateSynced : 0) | (flag_armed ? wi_tlmStateArmed : 0) | (flag_launched ? wi_tlmStateLaunched : 0) |
+                   (flag_apogee ? wi_tlmStateApogee : 0) | (flag_landed ? wi_tlmStateLanded : 0);
+  v[wi_tlmLdAltFt] = GR_Telemetry::quantize(ld_altFt, wi_tlmFields[wi_tlmLdAltFt].decimals);
+  v[wi_tlmLdAltN] = ld_altSamples;
+  v[wi_tlmLdG] = GR_Telemetry::quantize(ld_accelG, wi_tlmFields[wi_tlmLdG].decimals);
+  v[wi_tlmLdGN] = ld_accelSamples;
+  wi_telemetry.push(v, millis(), wi_telemetryFrame);
 }
 
-void wi_armForLaunch(WebServer& server) {
+void wi_armForLaunch(const GR_HttpRequest& req, GR_HttpResponse& res) {
+  GR_PERF_SCOPE(wi_perfArm);
   debugMsg("[EVENT]: Client sent arm command");
-  if (flag_armed) return; // Don't execute if we're already armed
-  if (!time_synced) { // Don't arm if the time hasn't been synced
-    server.send(400, "text/plain", "Time not synced");
+  wi_StateLock lock; // Opens the log, which wi_serverTask writes to
+  if (flag_armed) { // Don't execute if we're already armed (e.g. another phone got there first)
+    res.send(409, "text/plain", "Already armed");
+  } else if (!time_synced) { // Don't arm if the time hasn't been synced
+    res.send(400, "text/plain", "Time not synced");
+  } else if (wi_downloadActive) { // The log writer can't share the SD card with a download
+    res.send(409, "text/plain", "Log download in progress");
   } else {
-    if (!true) {
-      //TODO: add check to verify there's >n space on SD card to create a new logfile
-
-      server.send(200, "text/plain", "SD Card Full");
+    if (!io_sdReady && io_mountSD()) debugMsg("[EVENT]: SD card mounted"); // Wasn't there at boot (or wasn't seated right)
+    if (!io_startLog()) { // Creates + preallocates the log file, fails if the card's missing or short on space
+      res.send(200, "text/plain", io_logWriter.spaceShort() ? "SD Card Full" : "SD Card Error");
     } else {
-      //TODO: add other arming code here (switch to fast logging speed, enable launch detection logic)
+      // Note: launch detection + the pre-launch history start on the sampling task as soon as flag_armed is set
 
-      flag_armed = true; 
-      server.send(200, "text/plain", "success");
+      io_logEvent(GR_EVT_ARMED);
+      flag_launched = false; flag_apogee = false; flag_landed = false; // In case the sampling task hasn't seen the last disarm yet
+      flag_armed = true;
+      io_saveResume(); // From here on a reset picks the flight back up (see GR_Resume.h)
+      res.send(200, "text/plain", "success");
       debugMsg("[EVENT]: Logger is armed for launch!");
     }
   }
 }
 
-void wi_disarm(WebServer& server) {
+/// @brief Latency probe results as JSON (see GR_Perf.h). ?reset=1 clears them after sending
+void wi_sendPerf(const GR_HttpRequest& req, GR_HttpResponse& res) {
+  GR_PERF_SCOPE(wi_perfPerf);
+  static char json[io_perfJsonBytes]; // static: too big for the server task's stack
+  GR_Perf::json(json, sizeof(json));
+  res.header("Cache-Control", "no-store");
+  res.send(200, "application/json", json);
+  if (req.hasArg("reset")) GR_Perf::resetAll();
+}
+
+/// @brief Boot stage timings (see GR_Boot.h) and why we last reset, as JSON:
+///        {"reset":"brownout","resumes":1,"resumeMs":212,"stages":[{"name":"config","atMs":3.1,"ms":8.4,"ok":true},...]}
+///        resumes = times the flight under way has been picked back up after a reset, resumeMs = how long that took this time (boot to
+///        logging again, 0 if this boot didn't)
+void wi_sendBoot(const GR_HttpRequest& req, GR_HttpResponse& res) {
+  GR_PERF_SCOPE(wi_perfBoot);
+  static char json[wi_bootJsonBytes]; // static: too big for the server task's stack
+  int len = snprintf(json, sizeof(json), "{\"reset\":\"%s\",\"resumes\":%u,\"resumeMs\":%lu,\"stages\":", io_resetReasonName(io_resetReason),
+                     unsigned(io_resumeCount), (unsigned long)io_resumeMs);
+  if (len > 0 && size_t(len) + 2 < sizeof(json)) {
+    len += io_boot.json(json + len, sizeof(json) - len - 1);
+    json[len++] = '}';
+    json[len] = 0;
+  }
+  res.header("Cache-Control", "no-store");
+  res.send(200, "application/json", json);
+}
+
+/// @brief Next key=value pair out of a form encoded body / query string (URL decoded)
+/// @param fits cleared if the key or value was cut short to fit
+/// @return false at the end of the form
+bool wi_nextFormField(const char *& pos, char * key, size_t keyMax, char * value, size_t valueMax, bool& fits) {
+  while (*pos == '&') pos++;
+  if (!*pos) return false;
+  const char * end = strchr(pos, '&');
+  if (!end) end = pos + strlen(pos);
+  const char * eq = (const char *)memchr(pos, '=', size_t(end - pos));
+  const char * keyEnd = eq ? eq : end;
+  size_t keyLen = GR_Http::urlDecode(pos, size_t(keyEnd - pos), key, keyMax);
+  size_t valueLen = GR_Http::urlDecode(eq ? eq + 1 : end, eq ? size_t(end - eq - 1) : 0, value, valueMax);
+  fits = keyLen + 1 < keyMax && valueLen + 1 < valueMax;
+  pos = end;
+  return true;
+}
+
+/// @brief GET: every setting with its range + current value as JSON (see GR_Config::json(), the setup page builds its form from it).
+///        POST (form encoded, "ld_accelG=4&ld_altFt=150"): change settings, save them to NVS and put them into effect. Only while
+///        disarmed. Every field is checked before anything's changed, so a bad one means none of them are; the WiFi ones take effect
+///        after a restart
+void wi_config(const GR_HttpRequest& req, GR_HttpResponse& res) {
+  GR_PERF_SCOPE(wi_perfConfig);
+  static char json[wi_configJsonBytes]; // static: too big for the server task's stack
+  wi_StateLock lock; // The sampling task reads the launch detection settings once armed, so they can only change while we aren't
+  if (req.method == GR_HTTP_POST) {
+    if (flag_armed) {
+      res.send(409, "text/plain", "Logger is armed");
+      return;
+    }
+    const char * form = req.bodyLen ? req.body : req.query;
+    char key[GR_PREFS_KEY_MAX + 2], value[72];
+    bool fits;
+    int fields = 0;
+    for (const char * pos = form; wi_nextFormField(pos, key, sizeof(key), value, sizeof(value), fits); fields++) {
+      if (!fits || !io_config.check(key, value)) {
+        snprintf(json, sizeof(json), "Bad value for %s", key);
+        res.send(400, "text/plain", json);
+        return;
+      }
+    }
+    for (const char * pos = form; wi_nextFormField(pos, key, sizeof(key), value, sizeof(value), fits); ) io_config.set(key, value);
+    if (!io_config.save(prefs)) {
+      res.send(500, "text/plain", "Couldn't save to NVS");
+      return;
+    }
+    io_applyConfig();
+    debugMsg("[EVENT]: Client changed ",1,0); debugMsg(fields,1,0); debugMsg(" setting(s)");
+  }
+  if (!io_config.json(json, sizeof(json))) {
+    res.send(500, "text/plain", "Config too big for wi_configJsonBytes");
+    return;
+  }
+  res.header("Cache-Control", "no-store");
+  res.send(200, "application/json", json);
+}
+
+void wi_disarm(const GR_HttpRequest& req, GR_HttpResponse& res) {
+  GR_PERF_SCOPE(wi_perfDisarm);
   debugMsg("[EVENT]: Client sent disarm command");
-  if (!flag_armed) return; // Don't execute if we're not armed
+  wi_StateLock lock; // Closes the log, which wi_serverTask writes to
+  if (!flag_armed) { // Don't execute if we're not armed
+    res.send(409, "text/plain", "Not armed");
+    return;
+  }
   if (true) { // For now there's nothing that would stop us from disarming
-    server.send(200, "text/plain", "success");
-    flag_armed = false; 
-    //TODO: Add function call to close current log file here
+    res.send(200, "text/plain", "success");
+    flag_armed = false;
+    flag_launched = false;
+    flag_apogee = false;
+    flag_landed = false;
+    io_logEvent(GR_EVT_DISARMED);
+    io_stopLog();
+    io_resumeCount = 0;
+    io_saveResume(); // Nothing to pick back up now
     debugMsg("[EVENT]: Logger has been disarmed by client");
   } else {
-    server.send(400, "text/plain", "dummy error reason");
+    res.send(400, "text/plain", "dummy error reason");
   }
-}
\ No newline at end of file
+}
+
+/// @brief The flight logs on the SD card as JSON: [{"name":"Flight_2024-05-01_12-00-00.grl","size":123456},...]
+void wi_sendLogList(const GR_HttpRequest& req, GR_HttpResponse& res) {
+  GR_PERF_SCOPE(wi_perfLogList);
+  static char json[wi_logListBytes]; // static: too big for the server task's stack
+  size_t len = 0;
+  {
+    wi_StateLock lock; // Keeps anyone from arming (and the log writer from starting on the card) while we're in the directory
+    if (flag_armed) {
+      res.send(409, "text/plain", "Logger is armed");
+      return;
+    }
+    if (!io_sdReady) {
+      res.send(503, "text/plain", "No SD card");
+      return;
+    }
+    io_SdLock sdLock; // A download might be reading the card
+    FsFile dir, f;
+    if (!dir.open(&sd, "/", O_RDONLY)) {
+      res.send(500, "text/plain", "Couldn't read the SD card");
+      return;
+    }
+    json[len++] = '[';
+    char name[GR_DL_NAME_MAX];
+    while (f.openNext(&dir, O_RDONLY)) {
+      if (!f.isDir() && f.getName(name, sizeof(name)) && GR_LogDownloadJob::validName(name)) {
+        int n = snprintf(json + len, sizeof(json) - len, "%s{\"name\":\"%s\",\"size\":%llu}", len > 1 ? "," : "", name,
+                         (unsigned long long)f.fileSize());
+        if (n <= 0 || size_t(n) >= sizeof(json) - len - 1) { // Leave room for the ']'
+          f.close();
+          debugMsg("[WARN]: Too many log files to list them all");
+          break;
+        }
+        len += size_t(n);
+      }
+      f.close();
+    }
+    dir.close();
+    json[len++] = ']';
+  }
+  res.header("Cache-Control", "no-store");
+  res.send(200, "application/json", json, len);
+}
+
+/// @brief Download a flight log: ?file=<name>.grl[&format=csv], with Range / If-Range (see GR_LogDownload.h). Checks the request and
+///        passes the socket to wi_downloadTask, which does the rest
+void wi_sendDownload(const GR_HttpRequest& req, GR_HttpResponse& res) {
+  static GR_LogDownloadJob job; // static: handlers run one at a time
+  if (job.parse(req)) {
+    res.send(400, "text/plain", "Expected ?file=<name>.grl and optionally &format=csv");
+    return;
+  }
+  {
+    wi_StateLock lock; // Arming checks wi_downloadActive under the same lock, so the two can't both happen
+    if (flag_armed) {
+      res.send(409, "text/plain", "Logger is armed");
+      return;
+    }
+    if (!io_sdReady) {
+      res.send(503, "text/plain", "No SD card");
+      return;
+    }
+    if (wi_downloadActive || (job.id = res.detach()) < 0) {
+      res.header("Retry-After", "10");
+      res.send(503, "text/plain", "Another download is running");
+      return;
+    }
+    wi_downloadActive = 1;
+  }
+  if (xQueueSend(wi_downloadQueue, &job, 0) != pdTRUE) { // Can't happen (one at a time, and the queue holds one), but don't leak the socket
+    wi_server.release(job.id);
+    wi_downloadActive = 0;
+  }
+}
+
+/// @brief Send all of data on a socket we own (blocks, up to the server's send_wait_timeout at a time)
+bool wi_sendAll(int fd, const uint8_t * data, size_t len) {
+  while (len) {
+    int n = send(fd, data, len, 0);
+    if (n <= 0) return false;
+    data += n;
+    len -= size_t(n);
+  }
+  return true;
+}
+
+/// @brief Log download task (pinned to wi_downloadCore): answers the downloads wi_sendDownload() queues, one at a time
+void wi_downloadTask(void * param) {
+  static GR_LogDownloadJob job;
+  static uint8_t buf[wi_downloadChunk]; // The head and every piece of the body go out of here
+  static ESP_SdLogSource file(sd, io_sdMutex);
+  char path[GR_DL_NAME_MAX + 1];
+  for (;;) {
+    if (xQueueReceive(wi_downloadQueue, &job, portMAX_DELAY) != pdTRUE) continue;
+    int64_t startUs = esp_timer_get_time();
+    snprintf(path, sizeof(path), "/%s", job.name);
+    int status = wi_download.begin(job, file.open(path) ? &file : NULL);
+    if (wi_download.indexed()) {
+      debugMsg("[EVENT]: Sized the CSV for ",1,0); debugMsg(job.name,1,0); debugMsg(" in ",1,0);
+      debugMsg((unsigned long)((esp_timer_get_time() - startUs) / 1000),1,0); debugMsg("ms");
+    }
+    bool ok = wi_sendAll(job.id, buf, wi_download.head((char *)buf, sizeof(buf)));
+    startUs = esp_timer_get_time(); // Throughput counts the body only
+    uint64_t sent = 0;
+    while (ok) {
+      size_t n;
+      {
+        GR_PERF_SCOPE(wi_perfDownloadRead);
+        n = wi_download.read(buf, sizeof(buf));
+      }
+      if (!n) break;
+      ok = wi_sendAll(job.id, buf, n);
+      if (ok) sent += n;
+    }
+    file.close();
+    int64_t us = esp_timer_get_time() - startUs;
+    if (status < 300) GR_PERF_RATE_RECORD(wi_perfDownloadRate, sent, uint64_t(us));
+    wi_server.release(job.id);
+    wi_downloadActive = 0;
+
+    debugMsg("[EVENT]: Download of ",1,0); debugMsg(job.name,1,0); debugMsg(job.format == GR_DL_CSV ? " (csv)" : " (raw)",1,0);
+    debugMsg(": status ",1,0); debugMsg(status,1,0); debugMsg(", ",1,0); debugMsg((unsigned long)(sent / 1024),1,0); debugMsg("KB in ",1,0);
+    debugMsg((unsigned long)(us / 1000),1,0); debugMsg("ms",1,0);
+    if (wi_download.failed()) debugMsg(", SD card read failed",1,0);
+    debugMsg(ok || status >= 300 ? "" : ", client went away");
+  }
+}
@@ -0,0 +1,277 @@
+/* BenchKernels.h
+    The benchmark table: every hot path GR_Bench times, on the logger and on the dev box (src/bench/main.cpp runs it on both).
+
+    To add one: write a run() (and a setup() if it needs state set up, or hardware) and add a line to benchKernels[]. Names are
+    "area.what"; keep each area together so the output diffs cleanly. State lives in BenchContext, and anything a kernel works out
+    goes into ctx.sink so the compiler can't throw the work away.
+
+    Uses the io_ defaults #defined in bench/main.cpp, include it after them.
+*/
+#pragma once
+#include <stdint.h>
+#include <math.h>
+#include <GR_Bench.h>
+#include <GR_SensorHAL.h>
+#include <GR_Sampler.h>
+#include <GR_SampleRecord.h>
+#include <GR_Align.h>
+#include <GR_DPS310.h>
+#include <GR_Filter.h>
+#include <GR_Altitude.h>
+#include <GR_LaunchDetect.h>
+#include <GR_Estimator.h>
+#include <GR_FlightLog.h>
+#include <GR_LogPack.h>
+#include <GR_RingBuffer.h>
+#include <GR_BlockDevice.h>
+#include <GR_Telemetry.h>
+
+#define BENCH_SD_SAMPLES 128   // io_logBufferBytes card writes timed (1MB + warmup gets written to bench.grl, then it's closed)
+#define BENCH_SD_FILE "bench.grl"
+
+// Same fields as main.cpp's wi_tlmFields
+enum { bench_tlmFieldCount = 13 };
+static const GR_TelemetryField benchTlmFields[bench_tlmFieldCount] = {
+  {"t", 0}, {"ax", 1}, {"ay", 1}, {"az", 1}, {"p", 1}, {"tc", 2}, {"am", 2}, {"bv", 2}, {"s", 0}, {"ldaf", 1}, {"ldan", 0}, {"ldg", 2}, {"ldgn", 0}};
+
+struct BenchContext {
+  // Filled in by the entry point; NULL skips the kernels that need it
+  GR_AccelSensor * accel = NULL;
+  GR_BlockDevice * card = NULL;
+
+  volatile float sink = 0;  // Kernel results end up here
+  uint32_t rng = 12345;     // Input values, so nothing gets constant folded
+  uint64_t timeUs = 0;
+
+  GR_DecimatingFIR<io_accelFIRTaps, io_accelDecimation> fir[3];
+  GR_LaunchDetect launchDetect;
+  GR_AltitudeKF altKF;
+  GR_AltitudeTable altTable;
+  GR_DPS310Comp dpsComp;
+  GR_SampleClock frameClock;
+  uint64_t frames = 0;
+  GR_Track<GR_AccelSample, io_accelTrackLen> accelTrack;
+  GR_Track<GR_BaroSample, io_baroTrackLen> baroTrack;
+  GR_Track<float, io_battTrackLen> battTrack;
+  GR_RingBuffer<GR_LogRecord, io_rawRingSize> rawRing;
+  GR_LogPacker packer;
+  GR_LogUnpacker unpacker;
+  GR_LogHeader packHeader;
+  uint8_t packed[GR_PACK_BLOCK];
+  GR_TelemetryEncoder<bench_tlmFieldCount> tlm;
+  int64_t tlmValues[bench_tlmFieldCount];
+  char tlmFrame[GR_TLM_MAX_FRAME];
+  alignas(4) uint8_t block[io_logBufferBytes];
+
+  /// @brief Pseudo-random 0..range-1
+  uint32_t next(uint32_t range) {
+    rng = rng * 1664525u + 1013904223u;
+    return (rng >> 8) % range;
+  }
+  /// @brief A 12 bit ADC count around zero (a still accelerometer, give or take)
+  int adc(int zero) { return zero + int(next(17)) - 8; }
+  float pressPa() { return 98000.0f + next(2000); }
+};
+
+// Accelerometer -----------------------------------------------------------------------------------------------------------------
+
+static bool benchAccelReadSetup(BenchContext& ctx) { return ctx.accel != NULL; }
+/// @brief What GR_Sampler does each accelerometer period (5ms, GR_FlightPhase::defaults()): drain whatever the sensor has (on the logger: DMA buffer + FIR)
+static void benchAccelRead(BenchContext& ctx) {
+  GR_AccelTriple buf[GR_ACCEL_BURST];
+  ctx.sink += ctx.accel->readBuffered(buf, GR_ACCEL_BURST);
+}
+
+static bool benchAccelFilterSetup(BenchContext& ctx) {
+  float h[io_accelFIRTaps];
+  GR_FIR::designLowPass(h, io_accelFIRTaps, io_accelFIRCutoff);
+  for (int a = 0; a < 3; a++) { ctx.fir[a].setCoeffs(h); ctx.fir[a].reset(); }
+  return true;
+}
+/// @brief One filtered sample: io_accelDecimation conversions per axis through the FIR (ESP_AccelDMA::readBuffered()'s inner loop)
+static void benchAccelFilter(BenchContext& ctx) {
+  static const int zero[3] = {1984, 1984, 1992};
+  float out = 0;
+  for (int i = 0; i < io_accelDecimation; i++) {
+    for (int a = 0; a < 3; a++) ctx.fir[a].push(float(ctx.adc(zero[a])), out);
+  }
+  ctx.sink += out;
+}
+
+static bool benchAccelDetectSetup(BenchContext& ctx) {
+  ctx.launchDetect.setConfig(GR_LaunchDetect::defaults());
+  ctx.launchDetect.reset();
+  ctx.altKF.reset();
+  return true;
+}
+/// @brief io_SampleHandler::onAccel() while armed: calibrate to g, launch detector, Kalman filter predict
+static void benchAccelDetect(BenchContext& ctx) {
+  ctx.timeUs += 1000;
+  float g[3] = {GR_SampleRecord::accelG(ctx.adc(1984), 1984, 0.03f), GR_SampleRecord::accelG(ctx.adc(1984), 1984, 0.03f),
+                GR_SampleRecord::accelG(ctx.adc(2025), 1992, 0.029f)};
+  if (ctx.launchDetect.onAccel(ctx.timeUs, g[0], g[1], g[2])) ctx.launchDetect.reset(); // Shouldn't happen at ~1g, but stay on the pad
+  ctx.altKF.updateAccel(ctx.timeUs, io_accelUpSign * g[io_accelUpAxis] * GR_GRAVITY);
+  ctx.sink += ctx.altKF.altitude();
+}
+
+// Altimeter ---------------------------------------------------------------------------------------------------------------------
+
+static bool benchAltSetup(BenchContext& ctx) {
+  ctx.altTable.build(101325, 0.0059f, 0.190266435664f);
+  return true;
+}
+/// @brief Pressure + temp -> altitude, the way onBaro() does it
+static void benchAltTable(BenchContext& ctx) { ctx.sink += ctx.altTable.altitudeM(ctx.pressPa(), 20.0f); }
+/// @brief The powf() formula the table replaced, for scale
+static void benchAltPowf(BenchContext& ctx) {
+  ctx.sink += (powf(101325 / ctx.pressPa(), 0.190266435664f) - 1) * (20.0f + 273.15f) / 0.0059f;
+}
+/// @brief Kalman filter baro correction (onBaro() while armed)
+static void benchAltKF(BenchContext& ctx) {
+  ctx.timeUs += 15625;
+  ctx.altKF.updateBaro(ctx.timeUs, 150.0f + ctx.next(100) * 0.01f);
+  ctx.sink += ctx.altKF.velocity();
+}
+
+static bool benchAltCompSetup(BenchContext& ctx) {
+  // Typical coefficients (about 25C and 958hPa from raw 157866 / -2517431)
+  static const uint8_t coef[GR_DPS310_COEF_BYTES] = {0x0D, 0x1E, 0xF8, 0x13, 0x80, 0xAF, 0x25, 0x18, 0xF4,
+                                                     0xF3, 0x04, 0xAC, 0xD7, 0x7C, 0x00, 0xE1, 0xFA, 0x74};
+  ctx.dpsComp.begin(GR_DPS310Comp::decode(coef), 8, 1);
+  return true;
+}
+/// @brief A FIFO burst's worth of DPS310 results to C / Pa (GR_DPS310::readFifo()): a temperature, then 16 pressures in one go
+static void benchAltComp(BenchContext& ctx) {
+  int32_t raw[16];
+  float pa[16];
+  ctx.dpsComp.setTemperature(157866 + int32_t(ctx.next(64)));
+  for (int i = 0; i < 16; i++) raw[i] = -2517431 + int32_t(ctx.next(4096));
+  ctx.dpsComp.pressurePa(raw, pa, 16);
+  ctx.sink += pa[0] + pa[15] + ctx.dpsComp.tempC();
+}
+
+// Alignment ---------------------------------------------------------------------------------------------------------------------
+
+static bool benchAlignSetup(BenchContext& ctx) {
+  ctx.frameClock.reset();
+  ctx.frames = 0;
+  ctx.accelTrack.reset(); ctx.baroTrack.reset(); ctx.battTrack.reset();
+  return true;
+}
+/// @brief Timestamps for one DMA chunk (ESP_AccelDMA::readBuffered()): anchor on the read, then stamp its 16 filtered samples
+static void benchAlignStamp(BenchContext& ctx) {
+  ctx.timeUs += 16000 + ctx.next(500);
+  ctx.frames += 64;
+  ctx.frameClock.update(ctx.timeUs, ctx.frames);
+  for (uint64_t f = ctx.frames - 64; f < ctx.frames; f += io_accelDecimation) ctx.sink += float(ctx.frameClock.timeUs(f));
+}
+/// @brief One log tick (20ms): that tick's readings onto the tracks, then every stream read at the time they've all got to
+///        (io_SampleHandler::onLogTick() with log_interp on)
+static void benchAlignLogTick(BenchContext& ctx) {
+  for (int i = 0; i < 20; i++) {
+    ctx.timeUs += 1000;
+    ctx.accelTrack.push(ctx.timeUs, {float(ctx.adc(1984)), float(ctx.adc(1984)), float(ctx.adc(1992))});
+  }
+  ctx.baroTrack.push(ctx.timeUs - ctx.next(15000), {20.0f, ctx.pressPa(), 150.0f});
+  ctx.battTrack.push(ctx.timeUs - ctx.next(4000), float(2296 + ctx.next(8)));
+  uint64_t newest[3] = {ctx.accelTrack.newestUs(), ctx.baroTrack.newestUs(), ctx.battTrack.newestUs()};
+  uint64_t t = GR_Align::commonUs(ctx.timeUs, io_alignStaleUs, newest, 3);
+  ctx.sink += ctx.accelTrack.at(t).z + ctx.baroTrack.at(t).pressPa + ctx.battTrack.at(t);
+}
+
+// Status ------------------------------------------------------------------------------------------------------------------------
+
+static void benchTlmValues(BenchContext& ctx) {
+  for (int i = 0; i < bench_tlmFieldCount; i++) ctx.tlmValues[i] = GR_Telemetry::quantize(1000.0 + ctx.next(100000) * 0.01, benchTlmFields[i].decimals);
+}
+static bool benchStatusSetup(BenchContext& ctx) {
+  benchTlmValues(ctx);
+  ctx.tlm.reset();
+  return true;
+}
+/// @brief A new subscriber's first /events frame (every field)
+static void benchStatusFull(BenchContext& ctx) {
+  ctx.tlmValues[0]++;
+  ctx.tlm.reset();
+  ctx.sink += ctx.tlm.encode(benchTlmFields, ctx.tlmValues, ctx.tlmFrame, sizeof(ctx.tlmFrame));
+}
+/// @brief A typical frame after that: the time + a few sensor fields changed
+static void benchStatusDelta(BenchContext& ctx) {
+  ctx.tlmValues[0] += 200;
+  for (int i = 1; i <= 4; i++) ctx.tlmValues[i] += ctx.next(3);
+  ctx.sink += ctx.tlm.encode(benchTlmFields, ctx.tlmValues, ctx.tlmFrame, sizeof(ctx.tlmFrame));
+}
+
+// Log records -------------------------------------------------------------------------------------------------------------------
+
+/// @brief Pack a full rate record (recordRaw())
+static void benchLogEncode(BenchContext& ctx) {
+  GR_LogRecord r = GR_FlightLog::makeSample(ctx.timeUs += 1000, GR_SAMPLE_ACCEL | GR_SAMPLE_BARO, uint16_t(ctx.adc(1984)), uint16_t(ctx.adc(1984)),
+                                            uint16_t(ctx.adc(1992)), ctx.pressPa(), 20.0f, 2296);
+  ctx.sink += r.sample.pressPa;
+}
+/// @brief A full rate record through the log packer (io_logAppend() with log_pack on; about every 50th one hands back a block)
+static bool benchLogPackSetup(BenchContext& ctx) { ctx.packer.reset(); return true; }
+static void benchLogPack(BenchContext& ctx) {
+  GR_LogRecord r = GR_FlightLog::makeSample(ctx.timeUs += 1000, GR_SAMPLE_ACCEL | GR_SAMPLE_BARO, uint16_t(ctx.adc(1984)), uint16_t(ctx.adc(1984)),
+                                            uint16_t(ctx.adc(1992)), ctx.pressPa(), 20.0f, 2296);
+  ctx.sink += ctx.packer.add(r) != NULL;
+}
+/// @brief Unpack a record (what a download / GraphiteLogDecode does per record of a packed log), round and round one block
+static bool benchLogUnpackSetup(BenchContext& ctx) {
+  ctx.packHeader = GR_FlightLog::makeHeader(0, GR_PACK_BLOCK);
+  ctx.packer.reset();
+  const uint8_t * block = NULL;
+  while (!block) {
+    GR_LogRecord r = GR_FlightLog::makeSample(ctx.timeUs += 1000, GR_SAMPLE_ACCEL | GR_SAMPLE_BARO, uint16_t(ctx.adc(1984)),
+                                              uint16_t(ctx.adc(1984)), uint16_t(ctx.adc(1992)), ctx.pressPa(), 20.0f, 2296);
+    block = ctx.packer.add(r);
+  }
+  memcpy(ctx.packed, block, sizeof(ctx.packed));
+  return ctx.unpacker.begin(ctx.packHeader, ctx.packed);
+}
+static void benchLogUnpack(BenchContext& ctx) {
+  GR_LogRecord r;
+  if (!ctx.unpacker.next(r)) { ctx.unpacker.begin(ctx.packHeader, ctx.packed); ctx.unpacker.next(r); }
+  ctx.sink += r.sample.xAccel;
+}
+/// @brief Hand a record from the sampling task to wi_serverTask: push onto io_rawRing, pop it off the other end
+static void benchLogHandoff(BenchContext& ctx) {
+  GR_LogRecord r = GR_FlightLog::makeEvent(ctx.timeUs += 1000, GR_EVT_OVERFLOW, int32_t(ctx.next(10)));
+  ctx.rawRing.push(r);
+  GR_LogRecord out;
+  if (ctx.rawRing.pop(out)) ctx.sink += out.event.iArg;
+}
+
+// SD card -----------------------------------------------------------------------------------------------------------------------
+
+static bool benchSdSetup(BenchContext& ctx) {
+  if (!ctx.card) return false;
+  for (size_t i = 0; i < sizeof(ctx.block); i++) ctx.block[i] = uint8_t(ctx.next(256));
+  return ctx.card->create(BENCH_SD_FILE, uint64_t(BENCH_SD_SAMPLES + GR_BENCH_WARMUP) * sizeof(ctx.block));
+}
+/// @brief One log buffer to the card (what io_logWriterTask does per buffer), into a preallocated file
+static void benchSdWrite(BenchContext& ctx) { ctx.sink += ctx.card->write(ctx.block, sizeof(ctx.block)); }
+static void benchSdTeardown(BenchContext& ctx) { ctx.card->close(); }
+
+// The table ---------------------------------------------------------------------------------------------------------------------
+
+static const GR_BenchKernel<BenchContext> benchKernels[] = {
+  // name              batch samples setup                  run               teardown
+  {"accel.read",       1,    512,    benchAccelReadSetup,   benchAccelRead,   NULL},
+  {"accel.filter",     16,   512,    benchAccelFilterSetup, benchAccelFilter, NULL},
+  {"accel.detect",     16,   512,    benchAccelDetectSetup, benchAccelDetect, NULL},
+  {"alt.table",        32,   512,    benchAltSetup,         benchAltTable,    NULL},
+  {"alt.powf",         32,   512,    benchAltSetup,         benchAltPowf,     NULL},
+  {"alt.kf",           16,   512,    benchAccelDetectSetup, benchAltKF,       NULL},
+  {"alt.dpsComp",      4,    512,    benchAltCompSetup,     benchAltComp,     NULL},
+  {"align.stamp",      16,   512,    benchAlignSetup,       benchAlignStamp,  NULL},
+  {"align.logTick",    16,   512,    benchAlignSetup,       benchAlignLogTick, NULL},
+  {"status.full",      4,    512,    benchStatusSetup,      benchStatusFull,  NULL},
+  {"status.delta",     4,    512,    benchStatusSetup,      benchStatusDelta, NULL},
+  {"log.encode",       32,   512,    NULL,                  benchLogEncode,   NULL},
+  {"log.pack",         32,   512,    benchLogPackSetup,     benchLogPack,     NULL},
+  {"log.unpack",       32,   512,    benchLogUnpackSetup,   benchLogUnpack,   NULL},
+  {"log.handoff",      32,   512,    NULL,                  benchLogHandoff,  NULL},
+  {"sd.write",         1,    BENCH_SD_SAMPLES, benchSdSetup, benchSdWrite,    benchSdTeardown},
+};
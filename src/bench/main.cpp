@@ -0,0 +1,107 @@
+/* Benchmark entry point (the kernels are in BenchKernels.h, the runner in lib/GR_Bench)
+    On the logger:   pio run -e bench -t upload && pio device monitor
+                     Runs every kernel once at boot and prints the results as JSON lines; send a line with a name prefix
+                     ("alt", "sd.write", or nothing for all of them) to run them again. Needs the SD card in for sd.*
+    On the dev box:  pio run -e native_bench && .pio/build/native_bench/program [name prefix] > bench.jsonl
+
+    Compare two runs with:  python3 tools/bench_compare.py old.jsonl new.jsonl
+    The logger build doesn't start WiFi, the web server or any of the logger's tasks, so the numbers are the kernels on their own
+    (plus whatever interrupts the Arduino core leaves running, which is what the tail is for).
+*/
+#include <stdio.h>
+#include <string.h>
+
+// Same defaults as main.cpp
+#define io_accelDMAHz 4000
+#define io_accelDecimation 4
+#define io_accelFIRTaps 48
+#define io_accelFIRCutoff 0.0875f
+#define io_accelTrackLen 32
+#define io_baroTrackLen 4
+#define io_battTrackLen 4
+#define io_alignStaleUs 100000
+#define io_accelUpAxis 2
+#define io_accelUpSign 1
+#define io_rawRingSize 512
+#define io_logBufferBytes 8192
+
+#include "BenchKernels.h"
+
+static BenchContext ctx; // static: too big for the stack
+
+#if defined(ARDUINO)
+
+#include <Arduino.h>
+#include <SdFat.h>
+#include "../SensorHAL_ESP.h"
+#include "../AdcDMA_ESP.h"
+#include "../SDCard_ESP.h"
+
+// Same pins as main.cpp
+#define p_xAccel A0
+#define p_yAccel A1
+#define p_zAccel A2
+#define p_battSense 10
+#define p_SDCS 21
+#define io_SDSpeedMHz 20
+
+ESP_Clock io_clock;
+ESP_AccelDMA<io_accelFIRTaps, io_accelDecimation> io_accel(io_clock, (adc1_channel_t)digitalPinToAnalogChannel(p_xAccel), (adc1_channel_t)digitalPinToAnalogChannel(p_yAccel),
+                                                           (adc1_channel_t)digitalPinToAnalogChannel(p_zAccel), (adc1_channel_t)digitalPinToAnalogChannel(p_battSense));
+SdFs sd;
+ESP_SdBlockDevice io_card(sd);
+char benchFilter[32];
+size_t benchFilterLen = 0;
+
+static void benchPrint(const char * line) { Serial.println(line); }
+
+static void benchRun(const char * filter) {
+  GR_Bench::runAll(benchKernels, sizeof(benchKernels) / sizeof(benchKernels[0]), ctx, "esp32s3", filter, benchPrint);
+  sd.remove(BENCH_SD_FILE);
+}
+
+void setup() {
+  Serial.begin(pio_monitor_speed);
+  delay(2000); // Give the USB serial port time to show up on the PC
+  if (io_accel.begin(io_accelDMAHz, io_accelFIRCutoff)) ctx.accel = &io_accel;
+  else Serial.println("# ADC DMA didn't start, skipping accel.read");
+  if (sd.begin(SdSpiConfig(p_SDCS, DEDICATED_SPI, SD_SCK_MHZ(io_SDSpeedMHz)))) ctx.card = &io_card;
+  else Serial.println("# No SD card, skipping sd.*");
+  benchRun(NULL);
+}
+
+void loop() {
+  while (Serial.available()) {
+    char c = Serial.read();
+    if (c == '\r') continue;
+    if (c != '\n') {
+      if (benchFilterLen < sizeof(benchFilter) - 1) benchFilter[benchFilterLen++] = c;
+      continue;
+    }
+    benchFilter[benchFilterLen] = 0;
+    benchFilterLen = 0;
+    benchRun(benchFilter);
+  }
+  delay(10);
+}
+
+#else
+
+#include <unistd.h>
+#include "../native/FakeSensors.h"
+#include "../native/FakeBlockDevice.h"
+
+static void benchPrint(const char * line) { puts(line); }
+
+int main(int argc, char ** argv) {
+  FakeClock clock;
+  FakeAccel accel;
+  FakeBlockDevice card(clock);
+  ctx.accel = &accel;
+  ctx.card = &card;
+  size_t ran = GR_Bench::runAll(benchKernels, sizeof(benchKernels) / sizeof(benchKernels[0]), ctx, "native", argc > 1 ? argv[1] : NULL, benchPrint);
+  unlink(BENCH_SD_FILE);
+  return ran ? 0 : 1;
+}
+
+#endif
@@ -15,15 +15,16 @@ Additional contributions by NCSU HPRC Team Members:
 TODO: move and reformat this info into README.md
 
 Misc. Important Notes:
-  - Only one client can be connected to the logger at a time (WebServer.h limitation); if two people try to connect at once things *will* break!
-  - Webpage files must be placed in the /data folder. All contents of this folder must be built into a SPIFFS image and uploaded to the ESP separately via: 
+  - Up to wi_maxStations phones can be connected to the AP (and wi_httpMaxClients sockets open) at once. The web server (esp_http_server, see
+    HttpServer_ESP.h) runs on its own task and answers requests one at a time, so handlers in WebFuncs.h must be quick and never wait on anything.
+  - Webpage files must be placed in the /data folder. Every build runs tools/web_assets.py first (extra_scripts in platformio.ini), which minifies
+    and gzips them: ones that come out small (currently all of them) are compiled into the firmware (src/WebAssets.h, generated), the rest go
+    to data_build/, which is what the SPIFFS image is built from. If anything lands in data_build/, build and upload the image separately via:
     PlatformIO tab > Project Tasks > seeed_xiao_esp32s3 > Platform > Build Filesystem Image, followed by Platform > Upload Filesystem Image
     - Close all serial terminal windows before building or uploading the filesystem image!
-    - Whenever webpages are updated, don't forget to rebuild and reupload SPIFFS filesystem image. 
-    - To conserve space in SPIFFS, please do not add comments or unneeded content to the webpage files. Every byte counts!
-    - If the file system is not present on the ESP32, the web server will not function. 
+    - Comments / whitespace in the webpage files are stripped by the build step, so don't worry about them.
+    - Pages are sent gzipped with an ETag, so a reload is a 304 with no body unless the page changed (see wi_sendFile() in WebFuncs.h)
     - The SPIFFS filesystem structure is flat; any files within subdirectories of the /data folder will simply be moved to the root directory ("/") within SPIFFS.
-    - TODO: graceful failure mode if webpage files not present in SPIFFS
   
 
 Hardware used:
@@ -39,17 +40,49 @@ Hardware used:
   #include <Preferences.h>    // For storing persistent configuration data in ESP32's NVS partition
   #include <Wifi.h>           // Wireless Fidelity dot h
   #include <ESPmDNS.h>        // mDNS for web server; allows connecting with .local domain names instead of IP address (the thing you type into the web browser address bar)
-  #include <WebServer.h>      // For hosting the interface webpages
-  #include <ESP32Time.h>      // For interfacing with the ESP32's internal RTC (TODO: delete this and implement functionality directily)
-  #include <Adafruit_DPS310.h>  // For reading data from the DPS310
+  #include <GR_Http.h>        // Request / response / router used by the web handlers (WebFuncs.h)
+  #include "HttpServer_ESP.h" // esp_http_server glue: serves wi_router to several clients at once on its own task
   #include <WL_DebugUtils.h>  // For debugMsg() functions (Serial.print with added functionality)
+  #include <GR_Sampler.h>     // Sensor acquisition scheduling (runs on io_samplingTask)
+  #include <GR_SampleRecord.h> // Averaged sample record handed from the sampling task to everything else
+  #include <GR_Align.h>        // Sample timestamps + lining the sensor streams up by them (on the sampling task)
+  #include <GR_RingBuffer.h>  // Lock-free queue between the sampling task and the web server / logging task
+  #include "SensorHAL_ESP.h"  // ESP32 implementations of the clock / sensor interfaces used by GR_Sampler
+  #include <GR_DPS310.h>      // DPS310 driver: background measurements into its FIFO, drained in bursts
+  #include "AdcDMA_ESP.h"     // Continuous (DMA) ADC sampling + decimating filter for the ADXL377
+  #include <SPI.h>
+  #include <SdFat.h>          // SD card file system (used instead of SD.h because it can preallocate contiguous files)
+  #include <GR_LogWriter.h>   // Buffered, sector aligned log file writer
+  #include "SDCard_ESP.h"     // SdFat implementation of the block device GR_LogWriter writes to
+  #include <GR_FlightLog.h>   // Binary log record format
+  #include <GR_LogPack.h>     // Packed (delta + varint) logs, when log_pack is on
+  #include <GR_History.h>     // Pre-launch history buffer (in PSRAM)
+  #include <GR_LaunchDetect.h> // Streaming launch detector (runs on the sampling task)
+  #include <GR_Estimator.h>   // Altitude / velocity Kalman filter + apogee and landing detection (runs on the sampling task)
+  #include <GR_FlightPhase.h> // Flight phases: what gets sampled + logged how often, and the radio + CPU clock, in each part of the flight
+  #include <GR_Altitude.h>    // Table based pressure -> altitude (replaces pow() on the sampling task)
+  #include <GR_Perf.h>        // Latency probes (compiled out unless GR_PERF_ENABLE is defined, see platformio.ini)
+  #include <GR_Telemetry.h>   // Live status stream (changed fields only) for the status pages
+  #include <GR_LogDownload.h> // Log downloads (raw or CSV, resumable with Range requests)
+  #include <GR_Config.h>      // Config registry (one table of settings, saved to NVS as one blob)
+  #include <GR_Resume.h>      // What a reset mid-flight needs to pick the flight back up (kept in RTC memory)
+  #include <GR_Boot.h>        // Boot stage timings (/boot)
+  #include <esp_system.h>     // esp_reset_reason()
+  #include <esp_wifi.h>       // esp_wifi_stop() / esp_wifi_start() (phases with the radio off)
+  #include <sys/time.h>       // gettimeofday() / settimeofday() (the system wall clock, which the ESP32 keeps going through a reset)
+  #include <atomic>           // Hand-overs between the tasks that aren't a queue (the altitude table)
 
 // Debug ----------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
   /* Debug notes: 
   - When testing startup behavior, use "Upload and Monitor" in platformio (instead of just "Upload") to ensure no debug messages are missed.
   - Additional debug information (from the ESP32's internal debugging suite) can be printed to serial by changing -DCORE_DEBUG_LEVEL=n in platformio.ini
     Options: 0=None, 1=Error, 2=Warn, 3=Info, 4=Debug, 5=Verbose
-  - IMPORTANT: For safety and maximum performance, set debugMode and wi_devMode to 0 before using the logger in real flights!
+  - IMPORTANT: For safety and maximum performance, set WL_DEBUG_LEVEL (platformio.ini) and wi_devMode to 0 before using the logger in real flights!
+  - debugMsg() doesn't print straight away: messages are queued and a low priority task writes them to Serial (so they never stall the
+    sampling or web server tasks). If a lot of messages get sent in a burst, some may be dropped; you'll get a warning saying how many.
+  - Latency probes (GR_Perf.h) are on when -DGR_PERF_ENABLE is in platformio.ini's build_flags. Results are at /perf (JSON, add ?reset=1 to 
+    clear them) and get printed in Teleplot format once a second when debugMode is 2. Remove the flag and they compile to nothing.
+    Log download throughput (KB/s per download, last / best / overall) is in the same JSON, under "rates".
   Program debug message prefixes:
     [CRITICAL]  - Events that impact the base functionality of the device
     [ERROR]     - Errors that are not being handled gracefully
@@ -61,7 +94,7 @@ Hardware used:
                   >[value]: [data] - format is used for Teleplot (VSCode plugin)
   Status LED Flash patterns:
     If the LED is repeating any flash pattern, the program is currently halted.
-    Short-short       - Waiting for serial connection (runs at startup if debugMode is enabled)
+    Short-short       - Waiting for serial connection (runs at startup if debugMode is enabled, except when picking a flight back up)
     Short-1x long-short  - Failed to load / write Preferences config item(s) from nvs
     Short-2x long-short  - Failed to initialize SPIFFS file system
     Short-3x long-short  - Failed to start wifi softAP during startup
@@ -69,9 +102,14 @@ Hardware used:
     Short-5x long-short  - Failed to start web server during startup
     Short-6x long-short - Unable to establish I2C connection with [TODO FOR NEW ACCELEROMETER]
     Short-7x long-short - Unable to establish I2C connection with to DPS310 in startup
+    Short-8x long-short - Failed to start the sampling, SD writer, housekeeping, network or log download FreeRTOS task (or their locks / queues)
+    Short-9x long-short - Failed to start continuous (DMA) ADC sampling for the ADXL377
+    2x-5x come from the network task (wi_netTask), which starts after sampling + logging: only the network side stops, the LED shows the
+    pattern and sampling / logging carry on. Boot stage timings are at /boot.
   */
-  int debugMode = 1;    // 0 = Off, 1 = General, 2 = Verbose (prints all sensor data to serial in Teleplot format)
-  bool const nvs_clearData = 0; // If true, the configuration data stored in NVS (using Preferences) will be overwritten with the default global variables defined below
+  // Debug level: set WL_DEBUG_LEVEL in platformio.ini (0 = Off, 1 = General, 2 = Verbose: prints all sensor data to serial in Teleplot format).
+  // It's a compile time constant, so messages above it aren't in the build at all (debugMode below is a copy of it, see WL_DebugUtils.h)
+  bool const nvs_clearData = 0; // If true, the configuration data stored in NVS (using Preferences) will be overwritten with the defaults in io_configItems below
   bool wi_devMode = 0;  // If true WiFi will attempt to connect to the network with SSID wi_devHost and password wi_devHostPass, rather than creating it's own AP. Use for development purposes only!
   const char * wi_devHost = "NTest"; // SSID of wifi network to connect to when in dev mode
   const char * wi_devHostPass = "testificate";  // Password of network to connect to when in dev mode
@@ -84,35 +122,91 @@ Hardware used:
   #define p_testAccel D5      // Accelerometer self test pin (Not used)
   #define p_SDA D3            // I2C Data pin (used by DPS310)
   #define p_SCL D4            // I2c Clock pin (used by DPS310)
+  #define p_SDCS 21           // SD card chip select (on the Sense board; SPI uses the default SCK/MISO/MOSI pins)
   #define p_battSense 10      // Analog pin for battery voltage divider (NOT CONNECTED. This GPIO pin isn't broken out on our board; out of usable pins until we switch to an I2C accelerometer)
+  // ADXL377 continuous ADC sampling (see AdcDMA_ESP.h). The ADC runs at io_accelDMAHz per axis and each axis is low-pass filtered and
+  // decimated by io_accelDecimation, so we get io_accelDMAHz / io_accelDecimation (1kHz) clean samples per axis
+  #define io_accelDMAHz 4000          // ADC conversion rate per channel (Hz). 4 channels (x, y, z, battery) so the ADC runs at 4x this
+  #define io_accelDecimation 4        // Filter decimation factor
+  #define io_accelFIRTaps 48          // Filter length (48 MACs per axis per output sample)
+  #define io_accelFIRCutoff 0.0875f   // Filter cutoff as a fraction of io_accelDMAHz (350Hz; output Nyquist is 500Hz)
   #define io_DPS310Address 0x77 // DPS310 I2C Address
+  #define io_i2cHz 800000       // I2C clock: the most the ESP32-S3's controller does (Fm+ 1MHz isn't supported)
+  #define io_i2cFallbackHz 400000 // ...and what to drop to if the DPS310 won't talk at that (long wires, weak pull-ups)
   #define io_USBSerialSpeed pio_monitor_speed // Serial speed imported from platformio.ini
+  #define io_perfJsonBytes 6144       // Buffer for the /perf JSON (~200 bytes per probe or rate)
+  #define wi_configJsonBytes 4096     // Buffer for the /config JSON (~250 bytes per setting)
 
 // Instantiate Classes --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-  ESP32Time rtc(0);     // RTC object (0ms offset for GMT timezone)
-  Preferences prefs;    // Preferences object for accessing NVS config values
-  WebServer server(80); // WebServer object
-  Adafruit_DPS310 dps;  // DPS310 object
+  Preferences nvs;      // NVS config storage...
+  ESP_Prefs prefs(nvs); // ...behind the GR_Prefs interface the config code uses (see SensorHAL_ESP.h; the native build has a file instead)
+  GR_HttpRouter wi_router; // Which handler (WebFuncs.h) each page / request goes to, filled in by setup()
+  ESP_HttpServer wi_server(wi_router); // Web server (started in setup(), runs on its own task)
+  ESP_Clock io_clock;   // Clock + sensor interfaces used by the sampler (see SensorHAL_ESP.h)
+  ESP_AccelDMA<io_accelFIRTaps, io_accelDecimation> io_accel(io_clock, (adc1_channel_t)digitalPinToAnalogChannel(p_xAccel), (adc1_channel_t)digitalPinToAnalogChannel(p_yAccel),
+                                                             (adc1_channel_t)digitalPinToAnalogChannel(p_zAccel), (adc1_channel_t)digitalPinToAnalogChannel(p_battSense));
+  ESP_I2CBus io_i2c(Wire); // I2C bus (DPS310)...
+  GR_I2CMeter io_i2cMeter(io_i2c); // ...counting how long it's busy
+  GR_DPS310 io_baro(io_i2cMeter, io_clock, io_DPS310Address);
+  ESP_BattFromDMA<decltype(io_accel)> io_batt(io_accel); // Battery channel rides along in the accelerometer's DMA pattern
+  SdFs sd;              // SD card file system
+  ESP_SdBlockDevice io_sdDevice(sd);
 
 // Global Variables -----------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
   /* Note: 
       Default values are initialized here but may be overwritten in setup. 
-      Persistent config variables are loaded from the nvs (non-volatile storage) partition in setup() via the Preferences library
+      Persistent config variables (the ones in io_configItems below) are loaded from the nvs (non-volatile storage) partition in setup();
+      their defaults + allowed ranges are in that table, not here
   */
   // WiFi
-  char wi_ssid[61] = "Graphite";    // Wifi network name (max 60 characters)
-  char wi_pass[61] = "allthedata";  // Wifi network password (minimum 8 characters, max 60)
-  char wi_address[61] = "graphite"; // mDNS hostname, creates a local domain name [wi_address].local for accessing the web server (max 60 characters)
-  int wi_channel = 1;                   // What wireless channel to use for the AP
+  char wi_ssid[61];                 // Wifi network name (max 60 characters)
+  char wi_pass[61];                 // Wifi network password (minimum 8 characters, max 60)
+  char wi_address[61];              // mDNS hostname, creates a local domain name [wi_address].local for accessing the web server (max 60 characters)
+  int wi_channel;                   // What wireless channel to use for the AP
   wifi_power_t wi_power = WIFI_POWER_8_5dBm; // WiFi Tx Power setting (see WiFiGeneric.h for possible values)
 
   // Event detection
   bool time_synced = 0;             // Set after the time has been synced from the client device
+  #define io_wallDefaultS 1672531200  // What the wall clock reads at power on until a phone syncs it (2023-01-01 00:00:00)
+  int64_t io_wallOffsetUs = 0;      // Wall clock (us since the epoch, GMT) minus io_clock.micros(): the only wall clock there is. Set by
+                                    // io_setWallClock() (wi_syncTime()); everything's timestamped in io_clock, see io_wallAt()
   bool volatile flag_armed = 0;     // Set when the client arms the 
   bool volatile flag_launched = 0;  // Set when launch has been detected
   bool volatile flag_apogee = 0;    // Set when apogee has been detected
   bool volatile flag_landed = 0;    // Set when landing has been detected
 
+  // Launch detection (see GR_LaunchDetect.h). Thresholds are loaded from NVS in setup()
+  float ld_accelG;                  // Acceleration magnitude (g) that counts as a launch...
+  int ld_accelSamples;              // ...if it holds for this many consecutive accelerometer samples (30 = 30ms at 1kHz)
+  float ld_altFt;                   // Altitude above the pad (ft) that counts as a launch...
+  int ld_altSamples;                // ...if it holds for this many consecutive altimeter samples (~80ms at 64Hz)
+  GR_LaunchDetect io_launchDetect;  // Sampling task only; the result is read by the web server task once flag_launched is set
+  bool io_launchLogged = 0;         // Set once the launch event has been written to the log (web server task only)
+
+  // Log format (see GR_LogPack.h). Loaded from NVS in setup()
+  int io_logPack;                   // Pack new logs (delta + varint, ~4x smaller); takes effect the next time a log's started
+
+  // Apogee + landing detection (see GR_Estimator.h)
+  #define io_accelUpAxis 2            // Accelerometer axis that points at the nose (0 = X, 1 = Y, 2 = Z)
+  #define io_accelUpSign 1            // 1 if that axis reads +1g sitting on the pad, -1 if the board's mounted the other way around
+  GR_AltitudeKF io_altKF;             // Fuses baro altitude + accelerometer while armed (sampling task only)
+  GR_ApogeeLandingDetect io_flightEvents; // Sampling task only; read by the web server task once flag_apogee / flag_landed are set
+  bool io_apogeeLogged = 0, io_landedLogged = 0; // Web server task only
+
+  // Flight phases (see GR_FlightPhase.h)
+  /* Note: io_drainSamples() runs io_phase off the flags above and logs every change (GR_EVT_PHASE). Each phase has its own sensor
+     read / log tick periods, full rate decimation, radio and CPU clock (GR_FlightPhase::defaults()); the sampling task picks the new
+     periods up from io_phaseSettings at its next poll, wi_serverTask sets the radio + CPU clock (io_applyPower()), and nothing gets
+     restarted. The log's closed io_logTailS after landing (shutdown event).
+  */
+  int io_logTailS;                    // Keep logging this long after landing (s). Loaded from NVS in setup()
+  int io_logInterp;                   // 1: log tick records interpolate each stream onto one time, 0: nearest reading. Loaded from NVS in setup()
+  GR_FlightPhase io_phase;            // Web server task (and /config, under wi_StateLock)
+  const GR_PhaseSettings * volatile io_phaseSettings = &io_phase.settings(); // The current phase's settings, for the sampling task
+  GR_RawDecimator io_rawDecimator;    // Thins out the full rate records per the phase's rawEvery (web server task only)
+  uint8_t wi_radio = GR_RADIO_ON;     // What io_applyPower() last set the radio to (wi_netTask starts it at wi_power)
+  #define io_minCpuMHz 80             // Lowest CPU clock io_applyPower() will set: below 80MHz the APB clock (the buses, the ADC) goes down with it
+
   // Webserver
   uint8_t time_hr = 0;              // Time variables used for storing timestamps, acquired via webserver client time sync
   uint8_t time_min = 0;
@@ -126,22 +220,29 @@ Hardware used:
 
   unsigned long io_StatLEDTimer;      // millis() timer for blinking the status LED
   bool io_StatLEDState = 1;           // Status LED state
-  unsigned long io_logQuickTimer = 0;   // millis() timer for logging fast data to the SD card
-  unsigned long io_accelSampleTimer = 0;// millis() timer for logging accelerometer samples
-  unsigned long io_altSampleTimer = 0;  // millis() timer for logging altimeter samples
-  unsigned long io_battSampleTimer = 0; // millis() timer for logging battery voltage samples
-  //Note: io_*Samples * io_*SampleRate must be <= io_logQuickTime to ensure enough samples are collected prior to averaging and logging
-  #define io_logQuickTime 20          // How many ms to wait between logging data in flight
-  #define io_logBackgroundTime 100    // How log to wait between logging data at background rate (when armed / after touchdown, not in-flight)
-  #define io_accelSamples 4           // How many ADXL377 samples to average into each log entry (note: max safe sample rate is 300Hz, or once every ~3ms)
-  #define io_accelSampleRate 5        // How many ms to wait before taking an accelerometer sample
-  uint8_t io_accelCurrentSample = 0;  // Current accelerometer sample, used for storing successive samples to arrays
-  #define io_altSamples 4             // How many DPS310 samples to average into each log entry (note: max safe sample rate is 300Hz, or once every ~3ms)
-  #define io_altSampleRate 5          // How many ms to wait before taking an altimeter sample
-  uint8_t io_altCurrentSample = 0;    // Current altimeter sample, used for storing successive samples to arrays
-  #define io_battSamples 4            // How many battery samples to average into each log entry (max safe sample rate not tested)
-  #define io_battSampleRate 5         // How many ms to wait before taking a battery sample
-  uint8_t io_battCurrentSample = 0;   // Current battery sample, used for storing successive samples to arrays
+  // Note: the sample / log timers live in io_sampler (see GR_Sampler.h), which runs on its own task pinned to io_samplingCore
+  #define io_samplingCore 1           // Core the sampling task is pinned to (the WiFi stack lives on core 0)
+  #define io_samplingPriority (configMAX_PRIORITIES - 2) // Sampling task priority; higher than anything else we run so web traffic can't delay a sample
+  #define io_samplingStack 4096       // Sampling task stack size (bytes)
+  #define wi_serverCore 0             // Core the housekeeping task (wi_serverTask) and the HTTP server task are pinned to
+  #define wi_serverPriority 1         // Housekeeping task priority (same as the Arduino loop task)
+  #define wi_serverStack 8192         // Web server task stack size (bytes)
+  #define wi_httpPort 80              // Web server port
+  #define wi_httpMaxClients 6         // Sockets the web server keeps open at once (browsers open 2-3 each; the oldest gets closed when it runs out)
+  #define wi_httpPriority 1           // HTTP server task priority (same as the housekeeping task, well below sampling)
+  #define wi_httpStack 6144           // HTTP server task stack size (bytes)
+  #define wi_maxStations 4            // Phones that can join the AP at once
+  TaskHandle_t io_samplingTaskHandle = NULL;
+  TaskHandle_t wi_serverTaskHandle = NULL;
+  SemaphoreHandle_t wi_stateMutex = NULL; // Held by wi_serverTask while it drains into the log, and by HTTP handlers that touch the log / flags
+  // Note: how often each sensor's read and how often a log tick lines them up into a record depends on the flight phase (see io_phase).
+  // Every sample carries the time it was taken, and the streams are lined up by those (see GR_Align.h)
+  #define io_accelTrackLen 32         // Accelerometer samples kept for lining the streams up (32ms at 1kHz: a baro period + a DMA chunk)
+  #define io_baroTrackLen 4           // DPS310 samples kept (note: max safe sample rate is 300Hz, or once every ~3ms)
+  #define io_battTrackLen 4           // Battery samples kept
+  #define io_holdLen 8                // Baro / battery readings that can wait for the accelerometer to catch up with them
+  #define io_alignHoldMaxUs 50000     // ...for this long at most (the accelerometer stopped?), then they go to the filter anyway
+  #define io_alignStaleUs 100000      // A stream with nothing newer than this doesn't hold a log tick's record back (holds its last value)
 
   // ADXL377
   bool cal_accelCalMode = 0, cal_accelCalStarted = 0;  // Used by accelerometer calibration routine
@@ -157,32 +258,18 @@ Hardware used:
   double cal_xAccelCoef = 0.03; // X Accelerometer raw to g coefficient (raw value * coef = g value)
   double cal_yAccelCoef = 0.03; // Y Accelerometer raw to g coefficient 
   double cal_zAccelCoef = 0.029; // Z Accelerometer raw to g coefficient 
-  float dat_xAccelRaw, dat_yAccelRaw, dat_zAccelRaw;  // Current measured acceleration
-  int dat_xAccelSamples[io_accelSamples];   //Array to hold raw X acceleration samples
-  int dat_yAccelSamples[io_accelSamples];   //Array to hold raw Y acceleration samples
-  int dat_zAccelSamples[io_accelSamples];   //Array to hold raw Z acceleration samples
-  double dat_xAccelG, dat_yAccelG, dat_zAccelG;  // Calculated g force
-  double dat_xAccelMs2, dat_yAccelMs2, dat_zAccelMs2;  // Calculated m/s^2 force
+  GR_Track<GR_AccelSample, io_accelTrackLen> dat_accel;  // Latest filtered samples (ADC counts) + when they were taken
+  // Note: g / m/s^2 aren't kept anywhere, use GR_SampleRecord::accelG() / accelMs2() with the cal values when you need them
 
   unsigned long cal_accelCalTimer;  // Tracks how long it's been since calibration mode started
   unsigned long cal_accelCalTimeout = 60000;  // How long to wait (ms) before ending calibration mod
 
   // DPS310
-  float dat_tempC;                      // Current measured temperature (C)
-  float dat_tempF;                      // Current measured temperature (F)
-  float dat_tempK;                      // Current measured temperature (K)
-  float dat_pressPa;                    // Current measured Pressure (Pa)
-  float dat_altMBaro;                   // Current calculated barometric altitude (m)
-  float dat_altFtBaro;                  // Current calculated barometric altitude (ft)
-  float dat_tempCSamples[io_altSamples];    // Array to hold temperature (C) samples
-  float dat_tempFSamples[io_altSamples];    // Array to hold temperature (F) samples
-  float dat_tempKSamples[io_altSamples];    // Array to hold temperature (K) samples
-  float dat_pressPaSamples[io_altSamples];  // Array to hold Pressure (Pa) samples
-  float dat_altMBaroSamples[io_altSamples]; // Array to hold calculated barometric altitude (m) samples
-  float dat_altFtBaroSamples[io_altSamples];// Array to hold calculated barometric altitude (ft) samples
-  float cal_lapseRate = 0.0059;         // Temperature lapse rate used in barometric altitude calculation
-  float cal_magicExp = 0.190266435664;  // Exponent from barometric formula used in altitude calculation
-  float cal_pAtSea = 101325;            // Pressure (Pa) at sea level
+  GR_Track<GR_BaroSample, io_baroTrackLen> dat_baro; // Latest altimeter samples (C, Pa, m) + when they were taken
+  // Note: F / K / ft aren't stored, GR_SampleRecord works them out when something asks (they're linear, so interpolating gives the same answer)
+  float cal_lapseRate;                  // Temperature lapse rate used in barometric altitude calculation
+  float cal_magicExp;                   // Exponent from barometric formula used in altitude calculation
+  float cal_pAtSea;                     // Pressure (Pa) at sea level
   /*Altitude calculation info: 
     (I'm not a magician, don't ask me how this shit works)
     Formulas via https://physics.stackexchange.com/questions/333475/how-to-calculate-altitude-from-current-temperature-and-pressure and https://en.wikipedia.org/wiki/Barometric_formula 
@@ -192,12 +279,214 @@ Hardware used:
     - cal_magiExp: RL/GM (universal gas constant * temperature lapse rate / gravitational accel * Air's Molar Mass), equal to 1/5.25578774055 (this *is* calculated using L=.0065)
     - TODO: Add calibration sliders / text boxes in the config menu to adjust magic exp and lapse rate (would be cool if you could enter the current known altitude and have the 
       program work backwards, actually)
+    - The pow() is done with a lookup table on the sampling task (see GR_Altitude.h); call io_rebuildAltTable() after changing any of the 3 cal values above
   */
+  GR_AltitudeTable io_altTables[2];     // Double buffered so the table can be rebuilt while the sampling task is using the other one
+  GR_AltitudeTable * io_altTable = &io_altTables[0]; // The one the sampling task uses (only it changes this once it's running)
+  std::atomic<GR_AltitudeTable *> io_altTableNext(nullptr); // A rebuilt table the sampling task hasn't switched to yet (io_rebuildAltTable())
+
+  // Persistent settings (see GR_Config.h). Everything here is saved to NVS as one blob, shown + edited on the setup page (/config),
+  // and the numbers get written into every flight log after the header. To add a setting, add a line; the key is what it's stored under
+  // (max 15 characters), so don't rename one unless you're OK with it going back to its default
+  const GR_ConfigItem io_configItems[] = {
+    //              variable          key              default          min      max      unit       flags                          description
+    GR_CONFIG_STRING(wi_ssid,         "wi_ssid",       "Graphite",      1,                           GR_CFG_REBOOT,                 "WiFi network name"),
+    GR_CONFIG_STRING(wi_pass,         "wi_pass",       "allthedata",    8,                           GR_CFG_REBOOT | GR_CFG_SECRET, "WiFi password"),
+    GR_CONFIG_STRING(wi_address,      "wi_address",    "graphite",      1,                           GR_CFG_REBOOT,                 "Web address (<this>.local)"),
+    GR_CONFIG_INT(wi_channel,         "wi_channel",    1,               1,       13,      "",        GR_CFG_REBOOT,                 "WiFi channel"),
+    GR_CONFIG_FLOAT(cal_lapseRate,    "cal_lapseRate", 0.0059,          0.001,   0.02,    "K/m",     0,                             "Altimeter: temperature lapse rate"),
+    GR_CONFIG_FLOAT(cal_magicExp,     "cal_magicExp",  0.190266435664,  0.1,     0.3,     "",        0,                             "Altimeter: barometric formula exponent"),
+    GR_CONFIG_FLOAT(cal_pAtSea,       "cal_pAtSea",    101325,          80000,   110000,  "Pa",      0,                             "Altimeter: sea level pressure"),
+    GR_CONFIG_FLOAT(ld_accelG,        "ld_accelG",     3.0,             1.5,     100,     "g",       0,                             "Launch: acceleration"),
+    GR_CONFIG_INT(ld_accelSamples,    "ld_accelN",     30,              1,       1000,    "samples", 0,                             "Launch: for this many accelerometer samples (1kHz)"),
+    GR_CONFIG_FLOAT(ld_altFt,         "ld_altFt",      100,             10,      5000,    "ft",      0,                             "Launch: height above the pad"),
+    GR_CONFIG_INT(ld_altSamples,      "ld_altN",       5,               1,       100,     "samples", 0,                             "Launch: for this many altimeter samples (64Hz)"),
+    GR_CONFIG_INT(io_logPack,         "log_pack",      0,               0,       1,       "",        0,                             "Log: pack samples (~4x smaller, needs a v2 decoder)"),
+    GR_CONFIG_INT(io_logTailS,        "log_tailS",     60,              5,       3600,    "s",       0,                             "Log: keep going this long after landing"),
+    GR_CONFIG_INT(io_logInterp,       "log_interp",    1,               0,       1,       "",        0,                             "Log: interpolate slow records onto one time (0 = nearest reading)"),
+  };
+  GR_Config io_config(io_configItems, sizeof(io_configItems) / sizeof(io_configItems[0]));
 
   // Battery level(s)
-  float dat_battV = 3.00;      //Placeholder for now until we implement battery sensing 
-  float dat_battSamples[io_battSamples];
+  GR_Track<float, io_battTrackLen> dat_battRaw; // Latest raw battery ADC readings + when they were taken (volts are worked out by GR_SampleRecord::battV())
+
+  // Latency probes (see GR_Perf.h). Each one must only be recorded from one task, noted after each
+  GR_PERF_PROBE(io_perfPoll, "sampler.poll");       // Sampling task: one io_sampler.poll() (all the sensor callbacks below included)
+  GR_PERF_PROBE(io_perfAccel, "sampler.accel");     // Sampling task: onAccel() per filtered sample
+  GR_PERF_PROBE(io_perfDetect, "sampler.detect");   // Sampling task: launch detector + Kalman filter + apogee / landing checks per sample
+  GR_PERF_PROBE(io_perfBaro, "sampler.baro");       // Sampling task: onBaro()
+  GR_PERF_PROBE(io_perfLogTick, "sampler.align");   // Sampling task: onLogTick() alignment + record hand-off
+  GR_PERF_PROBE(io_perfDrain, "log.drain");         // Housekeeping (wi_serverTask) task: io_drainSamples()
+  GR_PERF_PROBE(io_perfLogWrite, "log.write");      // Log writer task: one buffer written to the SD card
+  GR_PERF_PROBE(wi_perfStatus, "http.status");      // HTTP server task: handlers from here down
+  GR_PERF_PROBE(wi_perfPage, "http.page");
+  GR_PERF_PROBE(wi_perfEvents, "http.events");
+  GR_PERF_PROBE(wi_perfTelemetry, "http.telemetry");   // HTTP server task: one wi_pushTelemetry() (every subscriber's frame)
+  GR_PERF_PROBE(wi_perfSyncTime, "http.syncTime");
+  GR_PERF_PROBE(wi_perfArm, "http.arm");
+  GR_PERF_PROBE(wi_perfDisarm, "http.disarm");
+  GR_PERF_PROBE(wi_perfPerf, "http.perf");
+  GR_PERF_PROBE(wi_perfLogList, "http.logList");
+  GR_PERF_PROBE(wi_perfConfig, "http.config");
+  GR_PERF_PROBE(wi_perfBoot, "http.boot");
+  GR_PERF_PROBE(wi_perfDownloadRead, "download.read"); // Download task: one chunk read off the card (+ converted, for CSV)
+  GR_PERF_RATE(wi_perfDownloadRate, "download");       // Download task: body bytes / time per download (reported under "rates")
+
+  // Sample hand-off
+  /* Note: The dat_ variables above belong to the sampling task; nothing else should read them.
+     Every log tick the sampling task pushes a GR_SampleRecord into io_sampleRing, and the web server task drains it (io_drainSamples()).
+     Anything outside the sampling task should use wi_latestSample (or the drained records) instead of the dat_ globals.
+  */
+  #define io_sampleRingSize 128       // Records io_sampleRing can hold (must be a power of 2). At the fastest log tick (20ms) that's ~2.5 sec of backlog
+  #define io_drainBatchSize 16        // Max records pulled off io_sampleRing at a time
+  GR_RingBuffer<GR_SampleRecord, io_sampleRingSize> io_sampleRing; // Sampling task -> web server task
+  GR_SampleRecord wi_latestSample = {};  // Most recent record drained from io_sampleRing (written by wi_serverTask, HTTP handlers copy it under wi_StateLock)
+  uint32_t io_sampleRingOverflows = 0;  // Overflow count last reported to debug
+
+  // Live telemetry (/events, see GR_Telemetry.h)
+  /* Note: The status pages subscribe to /events (Server-Sent Events) and get a frame of whatever changed since their last one, every
+     ?ms= milliseconds (wi_telemetryMinMs-wi_telemetryMaxMs). wi_serverTask queues wi_pushTelemetry() onto the HTTP server task every
+     wi_telemetryMinMs while anyone's subscribed; that's the only place frames are built or sent, and all the subscriber bookkeeping
+     happens on that task too, so the hub needs no locking.
+  */
+  #define wi_telemetryClients 4       // Subscribers at once (one per phone; more would just get LRU purged, see HttpServer_ESP.h)
+  #define wi_telemetryDefaultMs 200   // Frame period when the page doesn't ask for one
+  #define wi_telemetryMinMs 20        // No point sending faster than wi_latestSample changes (the fastest log tick)
+  #define wi_telemetryMaxMs 5000
+  #define wi_tlmStateSynced 0x01      // wi_tlmState bits
+  #define wi_tlmStateArmed 0x02
+  #define wi_tlmStateLaunched 0x04
+  #define wi_tlmStateApogee 0x08
+  #define wi_tlmStateLanded 0x10
+  enum { wi_tlmTime, wi_tlmX, wi_tlmY, wi_tlmZ, wi_tlmPress, wi_tlmTempC, wi_tlmAltM, wi_tlmBatt, wi_tlmState,
+         wi_tlmLdAltFt, wi_tlmLdAltN, wi_tlmLdG, wi_tlmLdGN, wi_tlmFieldCount };
+  const GR_TelemetryField wi_tlmFields[wi_tlmFieldCount] = { // Same order as the enum. Units / derived values are worked out by the page
+    {"t", 0},     // RTC time (ms since the epoch, GMT)
+    {"ax", 1}, {"ay", 1}, {"az", 1}, // Raw accelerometer counts
+    {"p", 1},     // Pa
+    {"tc", 2},    // C
+    {"am", 2},    // m
+    {"bv", 2},    // V
+    {"s", 0},     // wi_tlmState* bits
+    {"ldaf", 1}, {"ldan", 0}, {"ldg", 2}, {"ldgn", 0}}; // Launch detect thresholds
+  GR_TelemetryHub<wi_tlmFieldCount, wi_telemetryClients> wi_telemetry(wi_tlmFields);
+  bool volatile wi_telemetryQueued = 0; // Set while a wi_pushTelemetry() is waiting to run on the HTTP server task
+  unsigned long wi_telemetryTimer = 0;  // millis() of the last one queued (wi_serverTask only)
+
+  // SD card logging
+  #define io_SDSpeedMHz 20            // SD card SPI clock
+  #define io_logPreallocMB 64         // Size of the contiguous file preallocated for each flight log (MB). ~35 min of data at the current log rate
+  #define io_logReserveMB 4           // Extra free space that must be left on the card (MB) on top of the log file before we'll arm
+  #define io_logBufferBytes 8192      // Size of each log buffer (bytes; must be a multiple of 512)
+  #define io_logBufferCount 4         // Number of log buffers (power of 2)
+  #define io_logTailBytes (2 * GR_PACK_BLOCK) // Kept free at the end of the log file for the closing records when it fills up (a packed block
+                                      // in progress + the "log full" event in a new one)
+  #define io_logWriterCore 0          // Core the SD writer task is pinned to
+  #define io_logWriterPriority 2      // SD writer task priority (above the web server, below the sampling task)
+  #define io_logWriterStack 4096      // SD writer task stack size (bytes)
+  #define io_logWriterPollMs 2        // How long the writer task sleeps when there's nothing to write
+  bool io_sdReady = 0;                // Set once the SD card has been mounted
+  SemaphoreHandle_t io_sdMutex = NULL; // SdFat isn't thread safe. Held (io_SdLock) by the download task and /logList, which only run
+                                      // disarmed; while armed the log writer task has the card to itself
+  GR_LogWriter<io_logBufferBytes, io_logBufferCount> io_logWriter(io_sdDevice, io_clock);
+  TaskHandle_t io_logWriterTaskHandle = NULL;
+  bool io_logPacking = 0;             // The open log is packed: records go through io_logPacker on their way to io_logWriter
+  GR_LogPacker io_logPacker;          // Packs records into GR_PACK_BLOCK blocks for io_logWriter (see GR_LogPack.h)
+
+  // Full rate records + pre-launch history
+  /* Note: While armed, the sampling task keeps the last io_historySeconds of full rate records (one per filtered accelerometer sample, 
+     with the newest baro / battery readings folded in) in io_history, which lives in PSRAM. When flag_launched gets set, the history is
+     frozen and flushed into the log (oldest first, original timestamps) ahead of the live full rate records, which queue up in
+     io_rawRing until the flush is done. See io_drainRaw().
+  */
+  #define io_historySeconds 5         // Seconds of pre-launch data kept while armed
+  #define io_historyRecords (io_historySeconds * (io_accelDMAHz / io_accelDecimation)) // 5000 records * 32 bytes = 160KB of PSRAM
+  #define io_rawRingSize 512          // Live full rate records io_rawRing can hold (power of 2). ~0.5 sec of slack while the history is flushed
+  GR_History<GR_LogRecord> io_history;  // Storage is allocated from PSRAM once in setup()
+  GR_RingBuffer<GR_LogRecord, io_rawRingSize> io_rawRing; // Sampling task -> web server task, after launch
+  size_t io_historyFlushed = 0;       // History records written to the log so far (web server task only)
+  uint32_t io_rawRingOverflows = 0;   // Overflow count last reported to debug
+
+  // Log downloads (/download, see GR_LogDownload.h)
+  /* Note: Downloads can take minutes (tens of MB over the AP at wi_power), so they don't run on the HTTP server task: the handler
+     checks the request, detach()es the socket and queues it for wi_downloadTask, which reads the card wi_downloadChunk bytes at a time
+     and send()s each piece straight from the same static buffer (lwIP copies it into its send buffer, so the next read overlaps the
+     send). One at a time. Refused while armed, and arming is refused while one's running, so the card never has two users.
+  */
+  #define wi_downloadChunk 8192       // Bytes read from the card and sent per send() (16 sectors)
+  #define wi_downloadCore 0           // Core the download task is pinned to (with the web server)
+  #define wi_downloadPriority 1       // Download task priority (same as the HTTP server, so neither starves the other)
+  #define wi_downloadStack 4096       // Download task stack size (bytes)
+  #define wi_logListBytes 2048        // Buffer for the /logList JSON (~70 bytes per file)
+  GR_LogDownload wi_download;         // Download task only (keeps the CSV sizes of the last file converted, see GR_LogDownload.h)
+  QueueHandle_t wi_downloadQueue = NULL; // HTTP handler -> download task, one GR_LogDownloadJob at a time
+  TaskHandle_t wi_downloadTaskHandle = NULL;
+  bool volatile wi_downloadActive = 0; // Set (under wi_StateLock) while a download's queued or running
+
+  // Boot + picking a flight back up after a reset (see setup() and GR_Resume.h)
+  /* Note: While armed, io_saveResume() keeps what a reset would need to carry on (the flags, the launch / apogee / landing decisions, the
+     log file and how much of it is safely on the card) in io_resume, in RTC memory: that survives brownout, watchdog and crash resets,
+     not a power cycle. setup() looks there first; if a flight was under way it skips the serial wait, brings the sensors up and starts
+     sampling before anything else, then reopens the log where it left off. The network always comes up last, on its own task
+     (wi_netTask), so WiFi / SPIFFS / the web server never hold up a sample.
+     The log writer syncs the file size to the card every io_logSyncBytes, so a reset loses at most that much of the log that was
+     already written, plus whatever was still in the buffers and queues (about a second at full rate, all told).
+  */
+  #define io_logSyncBytes (2 * io_logBufferBytes) // 16KB, ~0.5 sec at full rate. Costs one directory sector write each time
+  #define io_resumeSaveMs 20          // How often the resume record is re-saved while armed (events save it straight away)
+  #define io_resumeBudgetMs 500       // Boot to logging again after a reset mid-flight should take less than this (the resumed event says)
+  #define io_bootStages 12            // Boot stages io_boot can hold (setup() + wi_netTask use 9)
+  #define wi_netCore 0                // Core the network bring-up task is pinned to (with the WiFi stack)
+  #define wi_netPriority 1            // Same as the housekeeping task
+  #define wi_netStack 6144            // Network bring-up task stack size (bytes)
+  #define wi_bootJsonBytes 1536       // Buffer for the /boot JSON (~70 bytes per stage)
+  RTC_NOINIT_ATTR GR_ResumeState io_resume[2]; // Saved to in turn, so a reset halfway through a save leaves the other one
+  uint32_t io_resumeSeq = 0;          // seq of the last io_resume save
+  uint16_t io_resumeCount = 0;        // Times this flight has been picked back up (0 = this boot didn't)
+  unsigned long io_resumeTimer = 0;   // millis() of the last io_resume save
+  uint32_t io_resumeMs = 0;           // Boot to logging again, if this boot picked a flight back up
+  esp_reset_reason_t io_resetReason = ESP_RST_UNKNOWN; // Why we last (re)booted
+  GR_BootTimeline<io_bootStages> io_boot;
+  char io_logName[GR_RESUME_NAME_MAX] = ""; // Log file that's open (io_startLog() / io_resumeLog())
+  uint64_t io_launchLogEnd = 0, io_apogeeLogEnd = 0, io_landedLogEnd = 0; // io_logAppended() just after each event went in, so
+                                      // io_saveResume() can tell if it's on the card yet (housekeeping task only)
+  TaskHandle_t wi_netTaskHandle = NULL;
+  bool volatile wi_netReady = 0;      // Set once wi_netTask has the web server up
+  bool volatile io_ledHalted = 0;     // Set while a halt pattern has the status LED (wi_serverTask leaves it alone then)
 
+  /// @brief Holds wi_stateMutex for as long as it's in scope (anything that touches the log or the flags outside the sampling task)
+  struct wi_StateLock {
+    wi_StateLock() { xSemaphoreTake(wi_stateMutex, portMAX_DELAY); }
+    ~wi_StateLock() { xSemaphoreGive(wi_stateMutex); }
+  };
+  /// @brief Holds io_sdMutex for as long as it's in scope (SD card access that isn't the log writer)
+  struct io_SdLock {
+    io_SdLock() { xSemaphoreTake(io_sdMutex, portMAX_DELAY); }
+    ~io_SdLock() { xSemaphoreGive(io_sdMutex); }
+  };
+  /// @brief Times a boot stage (into io_boot) from here to the end of the block, and prints how long it took
+  struct io_BootStage {
+    io_BootStage(const char * name) : name_(name), slot_(io_boot.start(name, uint32_t(esp_timer_get_time()))) {}
+    ~io_BootStage() {
+      uint32_t now = uint32_t(esp_timer_get_time());
+      io_boot.finish(slot_, now, ok_);
+      if (slot_ < 0) return;
+      debugMsg("  (",1,0); debugMsg(name_,1,0); debugMsg(ok_ ? ": " : " failed: ",1,0); debugMsg((now - io_boot.stage(slot_).startUs) / 1000.0,1,0,1);
+      debugMsg("ms)");
+    }
+    void fail() { ok_ = false; }
+    const char * name_;
+    int slot_;
+    bool ok_ = true;
+  };
+
+void io_applyConfig(); // Below; /config (WebFuncs.h) calls it
+void io_saveResume(); // Below; arming / disarming (WebFuncs.h) call it
+const char * io_resetReasonName(esp_reset_reason_t reason); // Below; /boot (WebFuncs.h) uses it
+void wi_serverTask(void * param); // Below; setup() starts these
+void wi_netTask(void * param);
+
+#include "LogFuncs.h" // SD card log file functions (same deal as WebFuncs.h)
 #include "WebFuncs.h" // Web server functions (we have to include this after all the globals are defined, instntiated, etc. because it uses some fo them)
 
 
@@ -242,6 +531,144 @@ void SPIFFS_ListDir(const char * dirName = "/") {
 }
 
 
+/// @brief Regenerate the altitude lookup table from the current cal_pAtSea / cal_lapseRate / cal_magicExp and hand it to the sampling
+///        task, which switches to it at its next altimeter reading (io_takeAltTable()). Takes a few ms; don't call it from the sampling task.
+///        Never waits on the sampling task, however often it's called: if the last table handed over hasn't been taken yet it's taken
+///        back and rebuilt, and if it has, the sampling task let go of the other one when it switched
+void io_rebuildAltTable() {
+  static GR_AltitudeTable * handedOver = &io_altTables[0]; // The last one built. Starts out as if [0] had been taken, so the first build
+                                                           // (setup(), before the sampling task starts) goes into [1]
+  unsigned long performanceTimer = micros();
+  GR_AltitudeTable * next = handedOver;
+  if (!io_altTableNext.compare_exchange_strong(next, nullptr, std::memory_order_acq_rel, std::memory_order_acquire)) {
+    next = (handedOver == &io_altTables[0]) ? &io_altTables[1] : &io_altTables[0]; // Taken: the other one's free now
+  }
+  next->build(cal_pAtSea, cal_lapseRate, cal_magicExp);
+  handedOver = next;
+  io_altTableNext.store(next, std::memory_order_release);
+  performanceTimer = micros() - performanceTimer;
+  debugMsg("  Altitude table built in ",1,0); debugMsg(performanceTimer,1,0); debugMsg("us, max error ",1,0); debugMsg(next->maxErrorM(),1,0); debugMsg("m");
+}
+
+/// @brief Sampling task: switch to the table io_rebuildAltTable() last handed over, if there's a new one. The one it was using before
+///        is io_rebuildAltTable()'s again once this has switched
+GR_AltitudeTable * io_takeAltTable() {
+  if (io_altTableNext.load(std::memory_order_relaxed)) {
+    GR_AltitudeTable * fresh = io_altTableNext.exchange(nullptr, std::memory_order_acq_rel);
+    if (fresh) io_altTable = fresh; // nullptr if io_rebuildAltTable() took it back to rebuild it again in the meantime
+  }
+  return io_altTable;
+}
+
+/// @brief Put the io_configItems values into effect (everything but the WiFi settings, which need a restart).
+///        Only while disarmed: the sampling task doesn't touch io_launchDetect then
+void io_applyConfig() {
+  io_rebuildAltTable();
+  GR_LaunchDetect::Config ldConfig = GR_LaunchDetect::defaults();
+  ldConfig.accelG = ld_accelG;
+  ldConfig.accelSamples = ld_accelSamples;
+  ldConfig.altRiseM = ld_altFt / 3.280839895;
+  ldConfig.altSamples = ld_altSamples;
+  io_launchDetect.setConfig(ldConfig);
+  GR_FlightPhase::Config phConfig = io_phase.config();
+  phConfig.tailMs = uint32_t(io_logTailS) * 1000;
+  io_phase.setConfig(phConfig);
+}
+
+/// @brief The system's wall clock (us since the epoch, GMT), only for timing a reset: the ESP32 keeps it going through one, not a power
+///        cycle. Everything else goes through io_wallAt()
+int64_t io_wallUs() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return int64_t(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+/// @brief Wall clock (us since the epoch, GMT) at a logger clock time, e.g. a sample's timestamp
+int64_t io_wallAt(uint64_t clockUs) { return int64_t(clockUs) + io_wallOffsetUs; }
+
+/// @brief Set the wall clock to wallNowUs (the system one too, so io_wallUs() agrees with it across a reset)
+void io_setWallClock(int64_t wallNowUs) {
+  io_wallOffsetUs = wallNowUs - int64_t(io_clock.micros());
+  struct timeval tv = {time_t(wallNowUs / 1000000), suseconds_t(wallNowUs % 1000000)};
+  settimeofday(&tv, NULL);
+}
+
+const char * io_resetReasonName(esp_reset_reason_t reason) {
+  switch (reason) {
+    case ESP_RST_POWERON:   return "power on";
+    case ESP_RST_EXT:       return "reset pin";
+    case ESP_RST_SW:        return "software";
+    case ESP_RST_PANIC:     return "crash";
+    case ESP_RST_INT_WDT:
+    case ESP_RST_TASK_WDT:
+    case ESP_RST_WDT:       return "watchdog";
+    case ESP_RST_DEEPSLEEP: return "deep sleep";
+    case ESP_RST_BROWNOUT:  return "brownout";
+    default:                return "unknown";
+  }
+}
+
+/// @brief Put the flight from before a reset back (setup(), before the sampling task starts, so nothing needs locking): the flags, the
+///        launch / apogee / landing decisions, and the clock, so timestamps carry on from the ones already in the log
+void io_restoreFlight(const GR_ResumeState& from) {
+  io_clock.setMicros(GR_Resume::clockNow(from, io_wallUs(), esp_timer_get_time()));
+  GR_LaunchDetect::Result ld = {from.launchReason, from.launchT0Us, from.launchDetectUs};
+  io_launchDetect.restore(ld, from.baselineM);
+  GR_ApogeeLandingDetect::Event apogee = {uint8_t(from.apogee ? GR_FLIGHT_EVT_APOGEE : GR_FLIGHT_EVT_NONE), from.apogeeUs, from.apogeeM};
+  GR_ApogeeLandingDetect::Event landed = {uint8_t(from.landed ? GR_FLIGHT_EVT_LANDED : GR_FLIGHT_EVT_NONE), from.landedUs, from.landedM};
+  io_flightEvents.restore(from.launchT0Us, apogee, landed);
+  if (from.launched) io_altKF.restore(from.savedUs, from.altM, from.velocity, io_clock.micros()); // Coasted across the reset
+  if (from.launched) { io_history.freeze(); io_history.markDrained(); } // The pre-launch history went with the reset (it's in the log)
+  time_synced = from.timeSynced;
+  io_wallOffsetUs = from.wallUs - int64_t(from.savedUs); // Both moved on by the same gap
+  flag_launched = from.launched; flag_apogee = from.apogee; flag_landed = from.landed;
+  // Events that didn't make it to the card before the reset get logged again (io_resumeLog() clears these if it has to start a new file)
+  io_launchLogged = from.logged & GR_RESUME_LOGGED_LAUNCH; io_apogeeLogged = from.logged & GR_RESUME_LOGGED_APOGEE;
+  io_landedLogged = from.logged & GR_RESUME_LOGGED_LANDED;
+  flag_armed = 1;
+  GR_FlightPhase::Inputs phaseIn = {true, bool(from.launched), bool(from.apogee), bool(from.landed), 0};
+  io_phase.restore(io_clock.micros(), phaseIn); // No event for this one, the resumed event says it all
+  io_phaseSettings = &io_phase.settings();
+  io_resumeCount = from.resumes + 1;
+  io_resumeSeq = from.seq;
+}
+
+/// @brief Save what a reset would need to pick the flight back up into io_resume (the older copy). Disarmed, it saves "nothing to
+///        resume". Called under wi_StateLock (the housekeeping task, or a handler that arms / disarms); ~10us, it's only RTC memory
+void io_saveResume() {
+  GR_ResumeState s;
+  GR_Resume::clear(s);
+  if (flag_armed) {
+    s.armed = 1;
+    s.launched = flag_launched; s.apogee = flag_apogee; s.landed = flag_landed;
+    s.timeSynced = time_synced;
+    s.resumes = io_resumeCount;
+    s.savedUs = io_clock.micros();
+    s.wallUs = io_wallUs();
+    s.baselineM = io_launchDetect.baselineM();
+    if (s.launched) {
+      const GR_LaunchDetect::Result& ld = io_launchDetect.result();
+      s.launchReason = ld.reason; s.launchT0Us = ld.t0Us; s.launchDetectUs = ld.detectUs;
+      s.altM = io_altKF.altitude(); s.velocity = io_altKF.velocity(); // The sampling task's, at most a sample old
+    }
+    if (s.apogee) { s.apogeeUs = io_flightEvents.apogee().timeUs; s.apogeeM = io_flightEvents.apogee().altM; }
+    if (s.landed) { s.landedUs = io_flightEvents.landed().timeUs; s.landedM = io_flightEvents.landed().altM; }
+    if (io_logWriter.isOpen()) {
+      s.logPrealloc = uint64_t(io_logPreallocMB) << 20;
+      s.logOffset = io_logWriter.synced();
+      s.logPackBlock = io_logPacking ? GR_PACK_BLOCK : 0;
+      GR_Resume::setName(s, io_logName);
+      s.logged = (io_launchLogged && io_launchLogEnd <= s.logOffset ? GR_RESUME_LOGGED_LAUNCH : 0) |
+                 (io_apogeeLogged && io_apogeeLogEnd <= s.logOffset ? GR_RESUME_LOGGED_APOGEE : 0) |
+                 (io_landedLogged && io_landedLogEnd <= s.logOffset ? GR_RESUME_LOGGED_LANDED : 0);
+    }
+  }
+  s.seq = ++io_resumeSeq;
+  GR_Resume::seal(s);
+  io_resume[s.seq & 1] = s;
+  io_resumeTimer = millis();
+}
+
 // map() but for floats
 float mapf(float num, float fromLow, float fromHigh, float toLow, float toHigh) {
 	return (num - fromLow) * (toHigh - toLow) / (fromHigh - fromLow) + toLow;
@@ -252,6 +679,7 @@ float mapf(float num, float fromLow, float fromHigh, float toLow, float toHigh)
 /// @brief Halt the program (infinite while loop) and play a blink pattern on the status LED. Pattern is: short blink - long blinks - short blink - 1.5sec delay - repeat
 /// @param num Number of long blinks to show
 void LED_HaltPattern(int num = 1) {
+  io_ledHalted = 1; // wi_serverTask (if it's running) stops blinking the LED
   while(1) {
     digitalWrite(LED_BUILTIN,0); delay(80); // On 80ms
     digitalWrite(LED_BUILTIN,1); delay(200); // Of 200ms
@@ -267,442 +695,444 @@ void LED_HaltPattern(int num = 1) {
 
 
 
-// These must exist in main.cpp because I hate myself (But also because server.on() requires a void function with no args but I have to pass the server object as an arg to the wi_ funcs.)
-// And no, a lambda function inline with server.on() doesn't work either. Stupid esoteric nonsense...
-void handleSendStatus() { { wi_sendStatus(server);} }
-void handleSendSetup() { wi_sendPage(server, "/setup.html"); }
-void handleSendLogs() { wi_sendPage(server, "/logs.html"); }
-void handleSendDocs() { wi_sendPage(server, "/docs.html"); }
-void handleUpdateStatus() { wi_updateStatus(server); }
-void handleSyncTime() { wi_syncTime(server); }
-void handleArming() { wi_armForLaunch(server); }
-void handleDisarming() { wi_disarm(server); }
+// Sampling -------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+/* Sensor acquisition runs in io_samplingTask, pinned to io_samplingCore at io_samplingPriority. GR_Sampler decides when each
+   sensor is due and hands the raw values to io_SampleHandler (FlightFuncs.h); everything web related runs in wi_serverTask on the
+   other core, so a slow page load can't hold up a sample anymore.
+*/
+
+#include "FlightFuncs.h" // io_SampleHandler + io_drainSamples() / io_drainRaw() (shared with the native flight sim)
+
+io_SampleHandler io_sampleHandler;
+GR_Sampler io_sampler(io_clock, io_accel, io_baro, io_batt, io_sampleHandler, io_phaseSettings->rates); // Periods in us (the flight phase's)
+
+/// @brief Sensor acquisition task (pinned to io_samplingCore). Sleeps until the next sensor is due (one-shot hardware timer, see
+///        ESP_Clock::sleepUntilUs()), so lower priority tasks on the same core still get to run. Rates follow the flight phase: a new
+///        one takes effect at each channel's next release
+void io_samplingTask(void * param) {
+  const GR_PhaseSettings * applied = io_phaseSettings; // Might have moved since io_sampler was made (a flight picked back up)
+  io_sampler.setRates(applied->rates);
+  io_sampler.reset();
+  for (;;) {
+    const GR_PhaseSettings * phase = io_phaseSettings; // wi_serverTask moves this on a phase change
+    if (phase != applied) { io_sampler.setRates(phase->rates); applied = phase; }
+    uint64_t next;
+    {
+      GR_PERF_SCOPE(io_perfPoll);
+      next = io_sampler.poll();
+    }
+    io_clock.sleepUntilUs(next);
+  }
+}
 
 
 // ----------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 // Setup ----------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 // ----------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 void setup() {
+  /* Boot order. Each stage is timed into io_boot (/boot, and printed to debug):
+       1. Check io_resume: was a flight under way when we reset?
+       2. Serial wait (debug builds, and not when picking a flight back up)
+       3. Config (NVS): the altitude table and launch detector need it
+       4. Sensors: DPS310, ADXL377 continuous ADC, pre-launch history buffer
+       5. Sampling task. When picking a flight back up, its flags / decisions / clock are put back just before
+       6. SD card, and the log reopened where it left off (samples queue up in io_sampleRing / io_rawRing meanwhile)
+       7. Log writer + housekeeping (wi_serverTask) tasks: logging's running again from here
+       8. Network, on its own task in the background (wi_netTask): SPIFFS, WiFi, mDNS, the web server + log download task
+     After a reset mid-flight, 1-7 should take less than io_resumeBudgetMs.
+  */
   // Init pins
   analogReadResolution(12); // Switch to 12-bit analog read resolution for precise reads of analog inputs
   pinMode(LED_BUILTIN,OUTPUT); // Fun note: the XIAO's internal LED is connected to 3V3 (not GND), meaning writing this pin LOW turns it on, and HIGH turns it off
-  pinMode(p_xAccel,INPUT);
-  pinMode(p_yAccel,INPUT);
-  pinMode(p_zAccel,INPUT);
-  pinMode(p_battSense,INPUT);
+  // Note: accelerometer + battery pins are set up by io_accel.begin() (continuous ADC mode), don't pinMode / analogRead them
   
   // Debug
   debugStart(io_USBSerialSpeed); // Start debugging
-  while(debugMode > 0 && !Serial) { // Blink short pattern while waiting for serial
-    // Note: This while loop blocks everything else until a serial connection is found. If needed later, we can swap to FreeRTOS to handle this
-    digitalWrite(LED_BUILTIN,1); delay(100);
-    digitalWrite(LED_BUILTIN,0); delay(50);
+
+  // Were we in the middle of a flight?
+  io_resetReason = esp_reset_reason();
+  const GR_ResumeState * saved = GR_Resume::newest(io_resume, 2);
+  bool resuming = saved && saved->armed && io_resetReason != ESP_RST_POWERON; // RTC memory is junk after power on (checked anyway)
+  GR_ResumeState resumeFrom = {};
+  if (resuming) resumeFrom = *saved;
+  else { GR_Resume::clear(io_resume[0]); GR_Resume::clear(io_resume[1]); }
+
+  if (!resuming) {
+    io_BootStage stage("serial");
+    while(debugMode > 0 && !Serial) { // Blink short pattern while waiting for serial
+      // Note: This while loop blocks everything else until a serial connection is found. Skipped when picking a flight back up
+      digitalWrite(LED_BUILTIN,1); delay(100);
+      digitalWrite(LED_BUILTIN,0); delay(50);
+    }
   }
   unsigned long performanceTimer = millis();
   debugMsg("\n\n\n[INIT]: Starting Logger...\n");
-
-  rtc.setTime(0,0,0,1,1,2023,0);  //Initialize the RTC to 1/1/2023 00:00 and 0 microsec
+  debugMsg("  Reset reason: ",1,0); debugMsg(io_resetReasonName(io_resetReason));
+  if (resuming) {
+    debugMsg("  [WARN]: Reset while armed",1,0); debugMsg(resumeFrom.launched ? " in flight" : "",1,0); 
+    debugMsg(", picking the flight back up (log ",1,0); debugMsg(resumeFrom.logName,1,0); debugMsg(")");
+  } else {
+    io_setWallClock(int64_t(io_wallDefaultS) * 1000000); // Not when resuming: that one's put back from before the reset
+  }
 
   // Load config data from NVS
-  debugMsg("[INIT]: Loading configuration data from NVS...\n");
-  if (!prefs.begin("config")) { // Start Preferences in "config" namespace (or create, if it doesn't exist yet)
-    debugMsg("  [CRITICAL]: Failed to open configuration namespace in NVS partition, program halted.\n");
-    LED_HaltPattern(1); // loop halt pattern on status LED forever
-  }
-  if (nvs_clearData) {  // Create / overwrite all config key values with the global defaults
-    debugMsg("  clearData flag is set: (over)writing all NVS configuration values with defaults...\n");
-    if (!prefs.clear()) { // Clear all key:value pairs from the config namespace
-      debugMsg("  [CRITICAL]: Failed to clear values from NVS! Program halted.\n");
-      LED_HaltPattern(1); // loop halt pattern on status LED forever
-    }
-    prefs.putString("wi_ssid",wi_ssid);
-    prefs.putString("wi_pass",wi_pass);
-    prefs.putString("wi_address",wi_address);
-    prefs.putInt("wi_channel",wi_channel);
-    prefs.putFloat("cal_lapseRate",cal_lapseRate);
-    prefs.putFloat("cal_magicExp",cal_magicExp);
-    prefs.putFloat("cal_pAtSea",cal_pAtSea);
-    debugMsg("  Configuration data (over)written with default values.");
-  } else {
-    // Note: We have isKey checks for each key to ensure each key exists and write it's default value if it doesn't (i.e. fail gracefully)
-    //TODO: These are repetitive; create a loadConfig() function to do the isKey if-else routine
-    if (prefs.isKey("wi_ssid")) {
-      prefs.getString("wi_ssid", wi_ssid, sizeof(wi_ssid));
-    } else {
-      prefs.putString("wi_ssid",wi_ssid);
-    } debugMsg("  WiFi SSID loaded: ",1,0); debugMsg(wi_ssid);
-    if (prefs.isKey("wi_pass")) {
-      prefs.getString("wi_pass", wi_pass, sizeof(wi_pass));
-    } else {
-      prefs.putString("wi_pass",wi_pass);
-    } debugMsg("  WiFi password loaded: ",1,0); debugMsg(wi_pass);
-    if (prefs.isKey("wi_address")) {
-      prefs.getString("wi_address", wi_address, sizeof(wi_address));
-    } else {
-      prefs.putString("wi_address",wi_address);
-    } debugMsg("  WiFi web address loaded: ",1,0); debugMsg(wi_address,1,0); debugMsg(".local");
-    if (prefs.isKey("wi_channel")) {
-      wi_channel = prefs.getFloat("wi_channel",wi_channel);  
-    } else {
-      prefs.putFloat("wi_channel",wi_channel);
-    } debugMsg("  WiFi Channel loaded: ",1,0); debugMsg(wi_channel);
-    if (prefs.isKey("cal_lapseRate")) {
-      cal_lapseRate = prefs.getFloat("cal_lapseRate",cal_lapseRate);
-    } else {
-      prefs.putFloat("cal_lapseRate",cal_lapseRate);
-    } debugMsg("  Altimeter Temperature Lapse Rate loaded: ",1,0); debugMsg(cal_lapseRate);
-    if (prefs.isKey("cal_magicExp")) {
-      cal_magicExp = prefs.getFloat("cal_magicExp",cal_magicExp);
-    } else {
-      prefs.putFloat("cal_magicExp",cal_magicExp);
-    } debugMsg("  Altimeter Magic Exponent loaded: ",1,0); debugMsg(cal_magicExp);
-    if (prefs.isKey("cal_pAtSea")) {
-      cal_pAtSea = prefs.getFloat("cal_pAtSea",cal_pAtSea);
+  {
+    io_BootStage stage("config");
+    debugMsg("[INIT]: Loading configuration data from NVS...\n");
+    if (!prefs.begin("config")) { // Start Preferences in "config" namespace (or create, if it doesn't exist yet)
+      debugMsg(resuming ? "  [CRITICAL]: Failed to open configuration namespace in NVS partition, carrying on with the defaults.\n"
+                        : "  [CRITICAL]: Failed to open configuration namespace in NVS partition, program halted.\n");
+      if (!resuming) LED_HaltPattern(1); // loop halt pattern on status LED forever
+      io_config.setDefaults(); // Mid-flight, carry on with the defaults rather than stop logging
+      stage.fail();
+    } else if (nvs_clearData) {  // Overwrite the stored config with the defaults
+      debugMsg("  clearData flag is set: (over)writing all NVS configuration values with defaults...\n");
+      io_config.setDefaults();
+      if (!prefs.clear() || !io_config.save(prefs)) {
+        debugMsg("  [CRITICAL]: Failed to write default values to NVS! Program halted.\n");
+        LED_HaltPattern(1); // loop halt pattern on status LED forever
+      }
+      debugMsg("  Configuration data (over)written with default values.");
     } else {
-      prefs.putFloat("cal_pAtSea",cal_pAtSea);
-    } debugMsg("  Altimeter Sea Level Pressure loaded: ",1,0); debugMsg(cal_pAtSea);
-  
-    debugMsg("  Finished loading configuration data.");
+      // Missing or out of range settings get their defaults (and are written back), see GR_Config.h
+      unsigned long configTimer = micros();
+      GR_Config::LoadStats loaded = io_config.load(prefs);
+      configTimer = micros() - configTimer;
+      if (loaded.badBlob) debugMsg("  [ERROR]: Stored configuration was corrupt, using defaults");
+      if (loaded.source == GR_Config::FromKeys) debugMsg("  Moved configuration from one NVS key per setting to a single blob");
+      if (loaded.source != GR_Config::FromBlob && !loaded.saved) {
+        debugMsg(resuming ? "  [CRITICAL]: Failed to write configuration to NVS! Carrying on with it unsaved.\n"
+                          : "  [CRITICAL]: Failed to write configuration to NVS! Program halted.\n");
+        if (!resuming) LED_HaltPattern(1); // loop halt pattern on status LED forever
+        stage.fail();
+      }
+      debugMsg("  ",1,0); debugMsg(loaded.loaded,1,0); debugMsg(" settings loaded, ",1,0); debugMsg(loaded.defaulted,1,0); debugMsg(" defaulted, ",1,0);
+      debugMsg(loaded.rejected,1,0); debugMsg(" out of range (set to default) in ",1,0); debugMsg(configTimer,1,0); debugMsg("us");
+    }
+    for (size_t i = 0; i < io_config.count(); i++) { // Print them all
+      const GR_ConfigItem& it = io_config.item(i);
+      debugMsg("    ",1,0); debugMsg(it.key,1,0); debugMsg(": ",1,0);
+      if (it.flags & GR_CFG_SECRET) debugMsg("(hidden)");
+      else if (it.type == GR_CFG_STRING) debugMsg(static_cast<const char *>(it.value));
+      else debugMsg(GR_Config::number(it));
+    }
     debugMsg("  (NVS free entries remaining: ",1,0); debugMsg(prefs.freeEntries(),1,0); debugMsg(")\n");
-  }
 
-  // Init SPIFFS file system
-  debugMsg("[INIT]: Starting SPIFFS...\n");
-  if(!SPIFFS.begin()){
-      debugMsg("[CRITICAL]: Failed to init SPIFFS, program halted");
-      LED_HaltPattern(2); // loop halt pattern on status LED forever
-  } else {
-    debugMsg("  SPIFFS Started.");
-    SPIFFS_ListDir(); // Print the SPIFFS file tree to debug
-    debugMsg("");
+    io_applyConfig(); // Before the sampling task starts, so no locking needed
   }
 
+  // Sensors
+  {
+    io_BootStage stage("sensors");
+    // DPS310 setup (Barometric temp + pressure)
+    debugMsg("[INIT]: Initializing sensors...");
+    io_i2c.begin(p_SDA, p_SCL, io_i2cHz); // Pins are required because we can't use D5 (default) for I2C (hardware bug?)
+    for (int i = 1; i <= 10; i++) { //Try up to 10 times to establish an I2C connection
+      if (i == 5 && io_i2c.clockHz() > io_i2cFallbackHz) io_i2c.setClock(io_i2cFallbackHz); // Halfway: try it slower
+      if (!io_baro.begin()) { // 64Hz pressure at 8x + 4Hz temperature (see GR_DPS310::defaults())
+        debugMsg("  [ERROR]: DPS310 - Failed I2C connection attempt ",1,0);
+        debugMsg(i,1,1);
+      } else {
+        const GR_DPS310::Config& dpsCfg = io_baro.config();
+        debugMsg("  DPS310 - Connected at ",1,0); debugMsg(io_i2c.clockHz(),1,0); debugMsg("Hz, pressure at ",1,0);
+        debugMsg(dpsCfg.prsRate,1,0); debugMsg("Hz (",1,0); debugMsg(dpsCfg.prsOversample,1,0); debugMsg("x), temperature at ",1,0);
+        debugMsg(dpsCfg.tmpRate,1,0); debugMsg("Hz, read from its FIFO");
+        break;
+      }
+      if (i == 10) { // If we've tried 10 times and still haven't connected, something's wrong
+        if (resuming) { // Mid-flight, the accelerometer alone beats nothing (same as the config stage)
+          debugMsg("  [CRITICAL]: Failed to initialize Sensor: DPS310, carrying on without it.");
+          stage.fail();
+          break;
+        }
+        debugMsg("  [CRITICAL]: Failed to initialize Sensor: DPS310, program halted.");
+        LED_HaltPattern(7); // loop halt pattern on status LED forever
+      }
+      delay(1); // Wait but a short moment before attempting the I2C connection again
+    }
 
-  // Wifi setup
-  debugMsg("[INIT]: Starting Wifi...\n");
-  if (wi_devMode) { // If we're in dev mode, connect to the development wifi network instead of starting AP
-    WiFi.mode(WIFI_MODE_STA);
-    WiFi.setHostname("Graphite Test Client");
-    WiFi.begin(wi_devHost,wi_devHostPass);
-    WiFi.setTxPower(wi_power);
-    int timeout = 0;
-    while (WiFi.status() != WL_CONNECTED) {
-      delay(500);
-      debugMsg(".",1,0);
-      timeout++;
-      if (timeout >= 600) { // Stop trying to connect if it's been more than 5 minutes (300000ms / 500 = 600)
-        debugMsg("  [CRITICAL]: Failed to connect to dev wifi network, program halted!");
-        LED_HaltPattern(3); // loop halt pattern on status LED forever
+    // ADXL377 setup (high g 3-axis accelerometer)
+    //TODO: We need some kind of verification that the sensor's alive and working normally; 
+    //      if it's not then we need to stop the program, else junk data from the analog pins might fuck up the launch detection
+    if (!io_accel.begin(io_accelDMAHz, io_accelFIRCutoff)) {
+      if (resuming) { // Mid-flight, the altimeter alone beats nothing
+        debugMsg("  [CRITICAL]: Failed to start continuous ADC sampling for the ADXL377, carrying on without it.");
+        stage.fail();
+      } else {
+        debugMsg("  [CRITICAL]: Failed to start continuous ADC sampling for the ADXL377, program halted.");
+        LED_HaltPattern(9); // loop halt pattern on status LED forever
       }
+    } else {
+      debugMsg("  ADXL377 - Continuous ADC started at ",1,0); debugMsg(io_accelDMAHz,1,0); debugMsg("Hz per axis, filtered output at ",1,0); 
+      debugMsg(io_accelDMAHz / io_accelDecimation,1,0); debugMsg("Hz");
     }
-    debugMsg("\n  Wifi Connected to: ",1,0); debugMsg(WiFi.SSID(),1,0); debugMsg(" with RSSI: ",1,0); debugMsg(WiFi.RSSI()); 
-    debugMsg("  Local IP: ",1,0); debugMsg(WiFi.localIP(),1,0); debugMsg(" with device name: ",1,0); debugMsg(WiFi.getHostname()); 
-    debugMsg("");
-  } else { // Else start the AP like normal
-    WiFi.mode(WIFI_MODE_AP);
-    if (!WiFi.softAP(wi_ssid,wi_pass,1,0,1)) { // Start a softAP on channel 1 with only one client allowed (because WebServer.h can't handle more than one at a time)
-      debugMsg("  [CRITICAL]: Soft AP creation failed, program halted.");
-      LED_HaltPattern(3); // loop halt pattern on status LED forever
+    
+    // Pre-launch history buffer (allocated once, here, and never freed)
+    GR_LogRecord * historyMem = (GR_LogRecord *)ps_malloc(sizeof(GR_LogRecord) * io_historyRecords);
+    if (!historyMem) {
+      debugMsg("  [ERROR]: Couldn't allocate the pre-launch history buffer in PSRAM; logs won't include data from before launch");
+    } else {
+      io_history.attach(historyMem, io_historyRecords);
+      debugMsg("  Pre-launch history: ",1,0); debugMsg(io_historySeconds,1,0); debugMsg(" sec (",1,0); 
+      debugMsg((unsigned long)(sizeof(GR_LogRecord) * io_historyRecords / 1024),1,0); debugMsg("KB PSRAM)");
     }
-    WiFi.setTxPower(wi_power);
-    debugMsg("  Wifi started SSID: ",1,0); debugMsg(WiFi.softAPSSID(),1,0); debugMsg(" and IP: ",1,0); debugMsg(WiFi.softAPIP()); 
-    debugMsg("");
   }
 
-  // WebServer setup
-  debugMsg("[INIT]: Starting Web Server...\n");
-  if (!MDNS.begin(wi_address)) {
-    debugMsg("  [CRITICAL}: Failed to start mDNS Service]");
-    LED_HaltPattern(4); // loop halt pattern on status LED forever
-  } else {
-    MDNS.addService("http", "tcp", 80);
-    debugMsg("  mDNS started, web server available at http://",1,0); debugMsg(wi_address,1,0); debugMsg(".local");
+  // Start sampling (with the flight put back first, if there is one)
+  {
+    io_BootStage stage("sampling");
+    if (resuming) io_restoreFlight(resumeFrom);
+    wi_stateMutex = xSemaphoreCreateMutex(); // Before anything that can take it starts
+    io_sdMutex = xSemaphoreCreateMutex();
+    wi_downloadQueue = xQueueCreate(1, sizeof(GR_LogDownloadJob));
+    if (!wi_stateMutex || !io_sdMutex || !wi_downloadQueue ||
+        xTaskCreatePinnedToCore(io_samplingTask, "io_sampling", io_samplingStack, NULL, io_samplingPriority, &io_samplingTaskHandle, io_samplingCore) != pdPASS) {
+      debugMsg("  [CRITICAL]: Failed to start sampling task, program halted.");
+      LED_HaltPattern(8); // loop halt pattern on status LED forever
+    }
   }
-  // Callbacks to handle client web requests
-  server.serveStatic("/style.css",SPIFFS,"/style.css","max-age=86400");
-  server.serveStatic("/favicon.ico",SPIFFS,"/favicon.ico","max-age=86400");
-  server.on("/", handleSendStatus); // Makes sure the homepage (status page) is sent to the client when they first connect
-  server.on("/status", handleSendStatus);
-  server.on("/setup", handleSendSetup);
-  server.on("/logs", handleSendLogs);
-  server.on("/docs", handleSendDocs);
-  server.on("/updateStatus", handleUpdateStatus);
-  server.on("/syncTime", handleSyncTime);
-  server.on("/armForLaunch", handleArming);
-  server.on("/disarm", handleDisarming);
-  
-  server.onNotFound( []() { wi_NotFound(server); }); // Callback to handle invalid requests from client (404 response);
-  server.begin(); //TODO: this doesn't return anything; find a way to check if server successfully started?
-
-  // DPS310 setup (Barometric temp + pressure)
-  debugMsg("\n\n\n[INIT]: Initializing sensors...");
-  Wire.begin(p_SDA,p_SCL); // This is required because we can't use D5 (default) for I2C (hardware bug?)
-  for (int i = 1; i <= 10; i++) { //Try up to 10 times to establish an I2C connection
-    if (!dps.begin_I2C()) {
-      debugMsg("  [ERROR]: DPS310 - Failed I2C connection attempt ",1,0);
-      debugMsg(i,1,1);
-    } else { 
-      dps.configurePressure(DPS310_64HZ, DPS310_64SAMPLES); // See DPS310 datasheet (PRS_CFG and TMP_CFG register information) for more info on sampling rates
-      dps.configureTemperature(DPS310_64HZ, DPS310_64SAMPLES);
-      debugMsg("  DPS310 - Connected at ",1,0); debugMsg(Wire.getClock(),1,0); debugMsg("Hz");
-      break;
+
+  // SD card setup
+  {
+    io_BootStage stage("sd card");
+    debugMsg("[INIT]: Mounting SD card...");
+    if (!io_mountSD()) {
+      debugMsg("  [ERROR]: SD card mount failed; arming will try it again");
+      stage.fail();
+    } else {
+      if (!resuming) { debugMsg("  SD card mounted, ",1,0); debugMsg((unsigned long)(io_sdDevice.freeBytes() >> 20),1,0); debugMsg("MB free"); } // Slow-ish (scans the FAT)
     }
-    if (i == 10) { // If we've tried 10 times and still haven't connected, something's wrong
-      debugMsg("  [CRITICAL]: Failed to initialize Sensor: DPS310, program halted.");
-      LED_HaltPattern(7); // loop halt pattern on status LED forever
+    io_logWriter.syncEvery(io_logSyncBytes);
+    io_logWriter.reserveTail(io_logTailBytes);
+    if (resuming && !io_resumeLog(resumeFrom)) stage.fail();
+  }
+
+  // Start logging
+  {
+    io_BootStage stage("logging");
+    debugMsg("[INIT]: Starting SD writer and housekeeping tasks...");
+    if (xTaskCreatePinnedToCore(io_logWriterTask, "io_logWriter", io_logWriterStack, NULL, io_logWriterPriority, &io_logWriterTaskHandle, io_logWriterCore) != pdPASS) {
+      debugMsg("  [CRITICAL]: Failed to start SD writer task, program halted.");
+      LED_HaltPattern(8); // loop halt pattern on status LED forever
     }
-    delay(1); // Wait but a short moment before attempting the I2C connection again
+    io_StatLEDTimer = millis(); // Reset the Status LED blink timer
+    if (xTaskCreatePinnedToCore(wi_serverTask, "wi_server", wi_serverStack, NULL, wi_serverPriority, &wi_serverTaskHandle, wi_serverCore) != pdPASS) {
+      debugMsg("  [CRITICAL]: Failed to start housekeeping task, program halted.");
+      LED_HaltPattern(8); // loop halt pattern on status LED forever
+    }
+  }
+  if (resuming) {
+    io_resumeMs = millis();
+    debugMsg("[EVENT]: Flight picked back up ",1,0); debugMsg(io_resumeMs,1,0); debugMsg("ms after the reset (budget ",1,0); debugMsg(io_resumeBudgetMs,1,0); 
+    debugMsg("ms)",1,0); debugMsg(io_resumeMs > io_resumeBudgetMs ? " [WARN]: over budget" : "");
+  }
+
+  // Network (in the background, see wi_netTask())
+  if (xTaskCreatePinnedToCore(wi_netTask, "wi_net", wi_netStack, NULL, wi_netPriority, &wi_netTaskHandle, wi_netCore) != pdPASS) {
+    debugMsg("  [CRITICAL]: Failed to start network task, program halted.");
+    LED_HaltPattern(8); // loop halt pattern on status LED forever (sampling + logging keep going)
   }
 
-  // ADXL377 setup (high g 3-axis accelerometer)
-  //TODO: We need some kind of verification that the sensor's alive and working normally; 
-  //      if it's not then we need to stop the program, else junk data from the analog pins might fuck up the launch detection
-  
   performanceTimer = millis() - performanceTimer;
-  debugMsg("\n[INIT]: Startup finished in ",1,0); debugMsg(performanceTimer,1,0); debugMsg("ms\n\n");
-  
-  io_StatLEDTimer = millis(); // Reset the Status LED blink timer
+  debugMsg("\n[INIT]: Sensors + logging started in ",1,0); debugMsg(performanceTimer,1,0); debugMsg("ms, the network is coming up in the background\n\n");
 }
 
-// ----------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-// Loop -----------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-// ----------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-void loop() {
-
-  // Process Accelerometer Data
-  if (millis() - io_accelSampleTimer >= io_accelSampleRate) { // If it's time to collect an accelerometer sample
-    // Performance: the following calculations take approx 0.2ms to complete
-    // unsigned long performanceTimer = micros();
-    // Calculate data
-    int x = analogRead(p_xAccel);
-    int y = analogRead(p_yAccel);
-    int z = analogRead(p_zAccel);
-
-    // Store the data to sample arrays
-    dat_xAccelSamples[io_accelCurrentSample] = x;
-    dat_yAccelSamples[io_accelCurrentSample] = y;
-    dat_zAccelSamples[io_accelCurrentSample] = z;
-
-    // Increment the current sample number (reset to 0 if we've gone past the max sample array size)
-    io_accelSampleTimer = millis(); // Reset the sample timer
-    io_accelCurrentSample += 1;
-    if (io_accelCurrentSample > (io_accelSamples - 1)) {
-      io_accelCurrentSample = 0;
+/// @brief Brings the network side up once sampling + logging are already running (started at the end of setup()), then exits. A failure
+///        in here halts this task with its LED pattern; sampling and logging carry on regardless
+void wi_netTask(void * param) {
+  // Init SPIFFS file system
+  {
+    io_BootStage stage("spiffs");
+    debugMsg("[INIT]: Starting SPIFFS...\n");
+    if(!SPIFFS.begin()){
+        debugMsg("[CRITICAL]: Failed to init SPIFFS, program halted");
+        LED_HaltPattern(2); // loop halt pattern on status LED forever
+    } else {
+      debugMsg("  SPIFFS Started.");
+      SPIFFS_ListDir(); // Print the SPIFFS file tree to debug
+      wi_indexFiles(); // ETags for anything wi_sendFile() serves out of SPIFFS
+      debugMsg("");
     }
-    // performanceTimer = micros() - performanceTimer;
-    // debugMsg("Accelerometer sample collected in (microsec): ",1,0); debugMsg(performanceTimer);
-
-    // Calibrate the accelerometer if needed
-    if (cal_accelCalMode) {
-      if (!cal_accelCalStarted) { // If calibration mode was just started
-        cal_accelCalStarted = 1; // Set started flag 
-        cal_accelCalTimer = millis();
-        // Clear +/- 1g calibration values
-        cal_n1gXAccell = x; cal_n1gYAccell = y; cal_n1gZAccell = z;
-        cal_p1gXAccell = x; cal_p1gYAccell = y; cal_p1gZAccell = z;
+  }
+
+  // Wifi setup
+  {
+    io_BootStage stage("wifi");
+    debugMsg("[INIT]: Starting Wifi...\n");
+    if (wi_devMode) { // If we're in dev mode, connect to the development wifi network instead of starting AP
+      WiFi.mode(WIFI_MODE_STA);
+      WiFi.setHostname("Graphite Test Client");
+      WiFi.begin(wi_devHost,wi_devHostPass);
+      WiFi.setTxPower(wi_power);
+      int timeout = 0;
+      while (WiFi.status() != WL_CONNECTED) {
+        delay(500);
+        debugMsg(".",1,0);
+        timeout++;
+        if (timeout >= 600) { // Stop trying to connect if it's been more than 5 minutes (300000ms / 500 = 600)
+          debugMsg("  [CRITICAL]: Failed to connect to dev wifi network, program halted!");
+          LED_HaltPattern(3); // loop halt pattern on status LED forever
+        }
       }
-      if (millis() - cal_accelCalTimer > cal_accelCalTimeout) { // Turn off calibration after 10 sec
-        cal_accelCalMode = 0;
+      debugMsg("\n  Wifi Connected to: ",1,0); debugMsg(WiFi.SSID(),1,0); debugMsg(" with RSSI: ",1,0); debugMsg(WiFi.RSSI()); 
+      debugMsg("  Local IP: ",1,0); debugMsg(WiFi.localIP(),1,0); debugMsg(" with device name: ",1,0); debugMsg(WiFi.getHostname()); 
+      debugMsg("");
+    } else { // Else start the AP like normal
+      WiFi.mode(WIFI_MODE_AP);
+      if (!WiFi.softAP(wi_ssid,wi_pass,wi_channel,0,wi_maxStations)) { // Start a softAP on wi_channel with room for wi_maxStations phones
+        debugMsg("  [CRITICAL]: Soft AP creation failed, program halted.");
+        LED_HaltPattern(3); // loop halt pattern on status LED forever
       }
-      // If the current measured value is beyond one of the limits, save that as the new limit
-      if (x < cal_n1gXAccell) cal_n1gXAccell = x;
-      if (y < cal_n1gYAccell) cal_n1gYAccell = y;
-      if (z < cal_n1gZAccell) cal_n1gZAccell = z;
-      if (x > cal_p1gXAccell) cal_p1gXAccell = x;
-      if (y > cal_p1gYAccell) cal_p1gYAccell = y;
-      if (z > cal_p1gZAccell) cal_p1gZAccell = z;
-      debugMsg("x,y,z min values: ",2,0); 
-      debugMsg(cal_n1gXAccell,2,0); debugMsg(",",2,0); debugMsg(cal_n1gYAccell,2,0); debugMsg(",",2,0); debugMsg(cal_n1gZAccell,2,1);
-      debugMsg("x,y,z max values: ",2,0); 
-      debugMsg(cal_p1gXAccell,2,0); debugMsg(",",2,0); debugMsg(cal_p1gYAccell,2,0); debugMsg(",",2,0); debugMsg(cal_p1gZAccell,2,1); 
-    }
-    if (!cal_accelCalMode && cal_accelCalStarted) { // If calibration mode was just turned off
-      cal_accelCalStarted = 0; // Clear the started flag
-      // Calculate new coefficients and zero values
-      cal_xAccelCoef = float(2) / (cal_p1gXAccell - cal_n1gXAccell); 
-      cal_yAccelCoef = float(2) / (cal_p1gYAccell - cal_n1gYAccell); 
-      cal_zAccelCoef = float(2) / (cal_p1gZAccell - cal_n1gZAccell); 
-      cal_zeroXAccel = cal_p1gXAccell - ((cal_p1gXAccell - cal_n1gXAccell) / 2);
-      cal_zeroYAccel = cal_p1gYAccell - ((cal_p1gYAccell - cal_n1gYAccell) / 2);
-      cal_zeroZAccel = cal_p1gZAccell - ((cal_p1gZAccell - cal_n1gZAccell) / 2);
-      //Todo: report calibration data to web interface w/ confirm option, if confirmed save to Preferences
-
-      debugMsg("Final x,y,z min values: ",2,0); 
-      debugMsg(cal_n1gXAccell,2,0); debugMsg(",",2,0); debugMsg(cal_n1gYAccell,2,0); debugMsg(",",2,0); debugMsg(cal_n1gZAccell,2,1);
-      debugMsg("Final x,y,z max values: ",2,0); 
-      debugMsg(cal_p1gXAccell,2,0); debugMsg(",",2,0); debugMsg(cal_p1gYAccell,2,0); debugMsg(",",2,0); debugMsg(cal_p1gZAccell,2,1); 
-      debugMsg("x,y,z Coefficients: ",2,0); 
-      debugMsg(cal_xAccelCoef,2,0); debugMsg(", ",2,0); debugMsg(cal_yAccelCoef,2,0); debugMsg(", ",2,0); debugMsg(cal_zAccelCoef,2,1); 
-      debugMsg("x,y,z zero values: ",2,0); 
-      debugMsg(cal_zeroXAccel,2,0); debugMsg(",",2,0); debugMsg(cal_zeroYAccel,2,0); debugMsg(",",2,0); debugMsg(cal_zeroZAccel,2,1); 
+      WiFi.setTxPower(wi_power);
+      debugMsg("  Wifi started SSID: ",1,0); debugMsg(WiFi.softAPSSID(),1,0); debugMsg(" and IP: ",1,0); debugMsg(WiFi.softAPIP()); 
+      debugMsg("");
     }
   }
-  
-  // Process Altimeter Data
-  sensors_event_t temp_event, pressure_event;
-  if ((millis() - io_altSampleTimer >= io_altSampleRate) && (dps.temperatureAvailable() || dps.pressureAvailable())) { //If it's time to collect an altimeter sample and there's new altimeter data
-    // Performance: the following calculations take approx 1.3ms to complete
-    // unsigned long performanceTimer = micros();
-    // Calculate data
-    dps.getEvents(&temp_event, &pressure_event);
-    dat_tempC = temp_event.temperature;
-    dat_tempK = dat_tempC + 273.15;
-    dat_tempF = dat_tempC * 1.8; dat_tempF += 32;
-    dat_pressPa = pressure_event.pressure * 100;
-    dat_altMBaro = pow((cal_pAtSea/dat_pressPa),cal_magicExp);
-    dat_altMBaro -= 1; dat_altMBaro *= dat_tempK; dat_altMBaro /= cal_lapseRate;
-    dat_altFtBaro = dat_altMBaro * 3.280839895;
-    // Store the data to sample arrays
-    dat_tempCSamples[io_altCurrentSample] = dat_tempC;
-    dat_tempKSamples[io_altCurrentSample] = dat_tempK;
-    dat_tempFSamples[io_altCurrentSample] = dat_tempF;
-    dat_pressPaSamples[io_altCurrentSample] = dat_pressPa;
-    dat_altMBaroSamples[io_altCurrentSample] = dat_altMBaro;
-    dat_altFtBaroSamples[io_altCurrentSample] = dat_altFtBaro;
-    // Increment the current sample number (reset to 0 if we've gone past the max sample array size)
-    io_altSampleTimer = millis(); // Reset the sample timer
-    io_altCurrentSample += 1;
-    if (io_altCurrentSample > (io_altSamples - 1)) {
-      io_altCurrentSample = 0;
-    }
-    // performanceTimer = micros() - performanceTimer;
-    // debugMsg("Altimeter sample collected in (microsec): ",1,0); debugMsg(performanceTimer);
-  }
 
-  // Process Battery Data
-  if (millis() - io_battSampleTimer >= io_battSampleRate) { // If it's time to collect an accelerometer sample
-    // Performance: the following calculations take approx 0.2ms to complete
-    // unsigned long performanceTimer = micros();
-    // Calculate data
-    float v = analogRead(p_battSense);
-    v *= 2;    // Voltage divided by 2, so multiply back
-    v *= 3.3;  // Multiply by ADC reference voltage
-    v /= 4096; // Convert from bits to voltage
-    dat_battSamples[io_battCurrentSample] = v; // Store the sample to the sample array
-
-    // Increment the current sample number (reset to 0 if we've gone past the max sample array size)
-    io_accelSampleTimer = millis(); // Reset the sample timer
-    io_accelCurrentSample += 1;
-    if (io_accelCurrentSample > (io_accelSamples - 1)) {
-      io_accelCurrentSample = 0;
+  // WebServer setup
+  {
+    io_BootStage stage("web server");
+    debugMsg("[INIT]: Starting Web Server...\n");
+    if (!MDNS.begin(wi_address)) {
+      debugMsg("  [CRITICAL}: Failed to start mDNS Service]");
+      LED_HaltPattern(4); // loop halt pattern on status LED forever
+    } else {
+      MDNS.addService("http", "tcp", wi_httpPort);
+      debugMsg("  mDNS started, web server available at http://",1,0); debugMsg(wi_address,1,0); debugMsg(".local");
+    }
+    // Handlers for client web requests (see WebFuncs.h)
+    wi_router.on("/style.css", wi_sendStyle, GR_HTTP_GET);
+    wi_router.on("/favicon.ico", wi_sendIcon, GR_HTTP_GET);
+    wi_router.on("/", wi_sendStatus, GR_HTTP_GET); // Makes sure the homepage (status page) is sent to the client when they first connect
+    wi_router.on("/status", wi_sendStatus, GR_HTTP_GET);
+    wi_router.on("/setup", wi_sendSetup, GR_HTTP_GET);
+    wi_router.on("/logs", wi_sendLogs, GR_HTTP_GET);
+    wi_router.on("/docs", wi_sendDocs, GR_HTTP_GET);
+    wi_router.on("/events", wi_sendEvents, GR_HTTP_GET);
+    wi_router.on("/syncTime", wi_syncTime, GR_HTTP_POST);
+    wi_router.on("/armForLaunch", wi_armForLaunch, GR_HTTP_GET | GR_HTTP_POST);
+    wi_router.on("/disarm", wi_disarm, GR_HTTP_GET | GR_HTTP_POST);
+    wi_router.on("/perf", wi_sendPerf, GR_HTTP_GET);
+    wi_router.on("/boot", wi_sendBoot, GR_HTTP_GET);
+    wi_router.on("/config", wi_config, GR_HTTP_GET | GR_HTTP_POST);
+    wi_router.on("/logList", wi_sendLogList, GR_HTTP_GET);
+    wi_router.on("/download", wi_sendDownload, GR_HTTP_GET);
+    wi_router.onNotFound(wi_NotFound); // Invalid requests from client (404 response)
+    wi_server.onClose(wi_telemetryClosed); // Live telemetry subscribers that hang up
+    if (!wi_server.begin(wi_httpPort, wi_httpMaxClients, wi_serverCore, wi_httpPriority, wi_httpStack)) {
+      debugMsg("  [CRITICAL]: Failed to start web server, program halted.");
+      LED_HaltPattern(5); // loop halt pattern on status LED forever
     }
-    // performanceTimer = micros() - performanceTimer;
-    // debugMsg("Battery sample collected in (microsec): ",1,0); debugMsg(performanceTimer);
+    if (xTaskCreatePinnedToCore(wi_downloadTask, "wi_download", wi_downloadStack, NULL, wi_downloadPriority, &wi_downloadTaskHandle, wi_downloadCore) != pdPASS) {
+      debugMsg("  [CRITICAL]: Failed to start log download task, program halted.");
+      LED_HaltPattern(8); // loop halt pattern on status LED forever
+    }
+    debugMsg("  Web server started (up to ",1,0); debugMsg(wi_httpMaxClients,1,0); debugMsg(" connections)");
   }
+  wi_netReady = 1;
+  debugMsg("[INIT]: Network up ",1,0); debugMsg(millis(),1,0); debugMsg("ms after boot\n");
+  wi_netTaskHandle = NULL;
+  vTaskDelete(NULL);
+}
 
+// ----------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Web Server Task ------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+// ----------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Note: what this task does with the queued samples (io_drainSamples() / io_drainRaw()) is in FlightFuncs.h
 
-  // Calculate data
-  if (millis() - io_logQuickTimer > io_logQuickTime && !cal_accelCalMode) { // If it's time to log data and we're not in calibration mode
-    // Performance: the following logging routine takes approx TODOms to complete
-    unsigned long performanceTimer = micros();
-    io_logQuickTimer = millis(); // Reset the fast data logging timer
+/// @brief Set the CPU clock and the radio to what the flight phase wants, if they aren't already (wi_serverTask, under wi_StateLock).
+///        The radio's left alone until wi_netTask has it up
+/// @note  The CPU clock changes under the sampling task, the ADC's DMA and the log writer, which is fine as long as it stays at
+///        io_minCpuMHz or more: the APB clock stays at 80MHz then, and that's what the I2C + SPI (SD card) bus clocks and the ADC's
+///        sample clock are divided down from. ESP_Clock is esp_timer, which counts on the systimer (off the crystal), so timestamps and
+///        sleepUntilUs() don't move either, and neither does the FreeRTOS tick. The one thing that does count CPU cycles is GR_Perf's
+///        cycle counter, which gets told (GR_PerfClock). The defaults only drop it (to 80MHz) at shutdown anyway
+void io_applyPower() {
+  const GR_PhaseSettings& s = io_phase.settings();
+  if (s.cpuMHz >= io_minCpuMHz && getCpuFrequencyMhz() != s.cpuMHz) {
+    setCpuFrequencyMhz(s.cpuMHz);
+    GR_PerfClock::setMHz(getCpuFrequencyMhz());
+    debugMsg("[EVENT]: CPU clock set to ",1,0); debugMsg(getCpuFrequencyMhz(),1,0); debugMsg("MHz");
+  }
+  uint8_t radio = wi_devMode && s.radio == GR_RADIO_OFF ? GR_RADIO_LOW : s.radio; // The dev network connection wouldn't come back by itself
+  if (!wi_netReady || radio == wi_radio) return;
+  if (radio == GR_RADIO_OFF) {
+    esp_wifi_stop();
+  } else {
+    if (wi_radio == GR_RADIO_OFF) esp_wifi_start(); // Same AP as before, the web server never stopped listening
+    WiFi.setTxPower(radio == GR_RADIO_LOW ? WIFI_POWER_MINUS_1dBm : wi_power);
+  }
+  wi_radio = radio;
+  debugMsg("[EVENT]: Radio ",1,0); debugMsg(radio == GR_RADIO_OFF ? "off" : radio == GR_RADIO_LOW ? "turned down" : "at full power");
+}
 
-    // Average data in accelerometer arrays
-    dat_xAccelRaw = 0; dat_yAccelRaw = 0; dat_zAccelRaw = 0; // Init all values to 0
-    float x = 0, y = 0, z = 0;
-    for (int i=0; i < io_accelSamples; i++) {
-      dat_xAccelRaw += dat_xAccelSamples[i];
-      dat_yAccelRaw += dat_yAccelSamples[i];
-      dat_zAccelRaw += dat_zAccelSamples[i];
-    }
-    dat_xAccelRaw = dat_xAccelRaw / float(io_accelSamples); dat_yAccelRaw = dat_yAccelRaw / float(io_accelSamples); dat_zAccelRaw = dat_zAccelRaw / float(io_accelSamples);
-    // Calculate g force and m/s^2 values
-    // dat_xAccelG = (dat_xAccelRaw - cal_zeroXAccel) * cal_xAccelCoef;
-    // dat_yAccelG = (dat_yAccelRaw - cal_zeroYAccel) * cal_yAccelCoef;
-    // dat_zAccelG = (dat_zAccelRaw - cal_zeroZAccel) * cal_zAccelCoef;
-    dat_xAccelG = mapf(dat_xAccelRaw, 0, 4095, float(-200), float(200));
-    dat_yAccelG = mapf(dat_yAccelRaw, 0, 4095, float(-200), float(200));
-    dat_zAccelG = mapf(dat_zAccelRaw, 0, 4095, float(-200), float(200));
-
-    dat_xAccelMs2 = dat_xAccelG * 9.80665;
-    dat_yAccelMs2 = dat_yAccelG * 9.80665;
-    dat_zAccelMs2 = dat_zAccelG * 9.80665;
-
-    // Average the data in the altimeter arrays
-    dat_tempC = 0; dat_tempF = 0; dat_tempK = 0; dat_pressPa = 0; dat_altMBaro = 0; dat_altFtBaro = 0; // Init all values to 0
-    for (int i=0; i < io_altSamples; i++) {
-      dat_tempC += dat_tempCSamples[i]; 
-      dat_tempF += dat_tempFSamples[i];
-      dat_tempK += dat_tempKSamples[i];
-      dat_pressPa += dat_pressPaSamples[i];
-      dat_altMBaro += dat_altMBaroSamples[i];
-      dat_altFtBaro += dat_altFtBaroSamples[i];
+/// @brief Housekeeping task (pinned to wi_serverCore, alongside the WiFi stack): drains the sampling task's queues into the log and
+///        blinks the LED. Web requests are answered by the HTTP server's own task (see HttpServer_ESP.h)
+void wi_serverTask(void * param) {
+  for (;;) {
+    {
+      wi_StateLock lock; // HTTP handlers can arm / disarm (open / close the log) and read wi_latestSample
+      io_drainSamples();
+      io_applyPower();
     }
-    dat_tempC /= io_altSamples;
-    dat_tempF /= io_altSamples;
-    dat_tempK /= io_altSamples;
-    dat_pressPa /= io_altSamples;
-    dat_altMBaro /= io_altSamples;
-    dat_altFtBaro /= io_altSamples;
-
-    // Average the data in the battery arrays
-    dat_battV = 0; // Init to 0
-    for (int i=0; i < io_battSamples; i++) {
-      dat_battV += dat_battSamples[i];
+
+    // Live telemetry: the frames are built and sent on the HTTP server task (see wi_pushTelemetry()), this just keeps time
+    if (wi_netReady && wi_telemetry.count() && !wi_telemetryQueued && millis() - wi_telemetryTimer >= wi_telemetryMinMs) {
+      wi_telemetryTimer = millis();
+      wi_telemetryQueued = 1;
+      if (!wi_server.queue(wi_pushTelemetry, NULL)) wi_telemetryQueued = 0;
     }
-    dat_battV /= io_battSamples;
-
-    performanceTimer = micros() - performanceTimer;
-    // debugMsg("Fast data calculated in (micros): ",1,0); debugMsg(performanceTimer);
-
-    //TODO: Launch detection logic here if armed
-    //TODO: Apogee detection here if launched
-    //TODO: Landing detection here if launched
-
-    //TODO: SD Card logging here
-      //TODO: Check if SD card is full, close file if true
-      //TODO: Check if armed, then start logging at slow rate
-      //TODO: Check if launched, then start logging at fast rate
-      //TODO: Log other events (apogee, landing)
-      //TODO: Check if flight timeout time has been reached, if true switch to slow logging rate
-      //TODO: If flight timeout reached & post-flight timeout reached, close log file.
-    
-    // Print to console
-    // debugMsg("[DATA]: DPS310",2,1);
-    debugMsg(">Temp(C): ",2,0); debugMsg(dat_tempC,2,1);
-    debugMsg(">Temp(F): ",2,0); debugMsg(dat_tempF,2,1);
-    debugMsg(">Temp(K): ",2,0); debugMsg(dat_tempK,2,1);
-    debugMsg(">Pressure(Pa): ",2,0); debugMsg(dat_pressPa,2,1); 
-    debugMsg(">Altitude(m): ",2,0); debugMsg(dat_altMBaro,2,1); 
-    debugMsg(">Altitude(Ft): ",2,0); debugMsg(dat_altFtBaro,2,1); 
-    // debugMsg("[DATA]: ADXL377",2,1);
-    debugMsg(">X Accel (raw): ",2,0); debugMsg(dat_xAccelRaw,2,1);
-    debugMsg(">X Accel (raw, single): ",2,0); debugMsg(dat_xAccelSamples[3],2,1);
-    // debugMsg(">X Accel (g): ",2,0); debugMsg(dat_xAccelG,2,1);
-    // debugMsg(">X Accel (m/s^2): ",2,0); debugMsg(dat_xAccelMs2,2,1);
-    debugMsg(">Y Accel (raw): ",2,0); debugMsg(dat_yAccelRaw,2,1);
-    debugMsg(">Y Accel (raw, single): ",2,0); debugMsg(dat_yAccelSamples[3],2,1);
-    // debugMsg(">Y Accel (g): ",2,0); debugMsg(dat_yAccelG,2,1);
-    // debugMsg(">Y Accel (m/s^2): ",2,0); debugMsg(dat_yAccelMs2,2,1);
-    debugMsg(">Z Accel (raw): ",2,0); debugMsg(dat_zAccelRaw,2,1);
-    debugMsg(">Z Accel (raw, single): ",2,0); debugMsg(dat_zAccelSamples[3],2,1);
-    // debugMsg(">Z Accel (g): ",2,0); debugMsg(dat_zAccelG,2,1);
-    // debugMsg(">Z Accel (m/s^2): ",2,0); debugMsg(dat_zAccelMs2,2,1);
-  }
+
+    // Blink LED (unless the network task halted with a pattern on it)
+    if (!io_ledHalted && (millis() - io_StatLEDTimer) > 1000) {
+      int switchTime = millis() - io_StatLEDTimer;
     
+      io_StatLEDState = !io_StatLEDState; // Toggle state
+      digitalWrite(LED_BUILTIN,io_StatLEDState); // Write the state to the LED pin
+      // Write a warning to debug if the server task might be taking longer than we expect to execute
+      if (switchTime > 1003) { 
+        debugMsg("[EVENT] Web server task execution may be taking longer than expected! \n  Reason: Status LED turned ",1,0); 
+        if (io_StatLEDState) { 
+          debugMsg("off in ",1,0); 
+        } else {
+        debugMsg("on in ",1,0);
+        } 
+        debugMsg(switchTime,1,0);
+        debugMsg("ms (which should be closer to 1000ms)",1,1);
+      }
 
-  // Do web server stuff
-  server.handleClient();
+      io_StatLEDTimer = millis(); // Reset the state timer
 
-  // Blink LED
-  if ((millis() - io_StatLEDTimer) > 1000) {
-    int switchTime = millis() - io_StatLEDTimer;
-    
-    io_StatLEDState = !io_StatLEDState; // Toggle state
-    digitalWrite(LED_BUILTIN,io_StatLEDState); // Write the state to the LED pin
-    // Write a warning to debug if the main loop might be taking longer than we expect to execute
-    if (switchTime > 1003) { 
-      debugMsg("[EVENT] Main loop execution may be taking longer than expected! \n  Reason: Status LED turned ",1,0); 
-      if (io_StatLEDState) { 
-        debugMsg("off in ",1,0); 
-      } else {
-      debugMsg("on in ",1,0);
-      } 
-      debugMsg(switchTime,1,0);
-      debugMsg("ms (which should be closer to 1000ms)",1,1);
+#ifdef GR_PERF_ENABLE
+      if (debugMode >= 2) { // Latency probes, Teleplot format
+        static char perf[io_perfJsonBytes];
+        size_t len = GR_Perf::teleplot(perf, sizeof(perf));
+        // A line per message: the whole lot (up to io_perfJsonBytes) is more than GR_DEBUG_MAX_CHARS, and half the debug queue
+        for (char * line = perf; line < perf + len;) {
+          char * end = (char *)memchr(line, '\n', size_t(perf + len - line));
+          if (end) *end = 0;
+          debugMsg(line,2,1);
+          line = end ? end + 1 : perf + len;
+        }
+      }
+#endif
+      if (debugMode >= 2) { // I2C bus time over the last blink (the sampling task counts it as it goes, so it's near enough)
+        static uint64_t lastBusUs = 0;
+        uint64_t busUs = io_i2cMeter.busUs();
+        debugMsg(">I2C bus (ms/s): ",2,0); debugMsg((busUs - lastBusUs) / float(switchTime),2,1);
+        lastBusUs = busUs;
+      }
     }
 
-    io_StatLEDTimer = millis(); // Reset the state timer
+    vTaskDelay(1); // Give the idle task a chance to run
   }
-  
-}
\ No newline at end of file
+}
+
+// ----------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Loop -----------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+// ----------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void loop() {
+  // Nothing to do here; sampling runs in io_samplingTask, logging in io_logWriterTask + wi_serverTask (all started by setup()), and
+  // the web server on its own task (started by wi_netTask)
+  vTaskDelete(NULL);
+}
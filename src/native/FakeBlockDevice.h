@@ -0,0 +1,81 @@
+/* FakeBlockDevice.h
+    File-backed GR_BlockDevice for the native build; the "SD card" is a directory on the dev box.
+
+    writeDelayUs simulates a slow card (the time is spent on the FakeClock, so it shows up in GR_LogWriter's latency stats).
+    crash() drops the open file the way a reset would (no close, nothing trimmed), for the flight sim's --reboot.
+*/
+#pragma once
+#include <stdio.h>
+#include <string>
+#include <unistd.h>
+#include <GR_BlockDevice.h>
+#include "FakeSensors.h"
+
+class FakeBlockDevice : public GR_BlockDevice {
+  public:
+    FakeBlockDevice(FakeClock& clock, const char * dir = ".") : clock_(clock), dir_(dir) {}
+    uint64_t sizeBytes = 32ull << 30;  // Pretend card size
+    uint32_t writeDelayUs = 0;         // Simulated time each write takes
+
+    uint64_t freeBytes() override { return sizeBytes - used_; }
+
+    bool create(const char * name, uint64_t preallocBytes) override {
+      if (preallocBytes > freeBytes()) return false;
+      path_ = dir_ + "/" + (name[0] == '/' ? name + 1 : name);
+      f_ = fopen(path_.c_str(), "wb");
+      if (!f_) return false;
+      if (ftruncate(fileno(f_), off_t(preallocBytes)) != 0) { fclose(f_); f_ = NULL; return false; }
+      used_ += preallocBytes;
+      prealloc_ = preallocBytes;
+      written_ = 0;
+      return true;
+    }
+
+    bool write(const uint8_t * buf, size_t len) override {
+      if (!f_ || len % GR_SECTOR_SIZE || written_ + len > prealloc_) return false;
+      clock_.advanceUs(writeDelayUs);
+      if (fwrite(buf, 1, len, f_) != len) return false;
+      written_ += len;
+      return true;
+    }
+
+    bool sync() override { return f_ && fflush(f_) == 0; }
+
+    bool reopen(const char * name, uint64_t offset) override {
+      if (f_) return false;
+      path_ = dir_ + "/" + (name[0] == '/' ? name + 1 : name);
+      f_ = fopen(path_.c_str(), "r+b");
+      if (!f_) return false;
+      if (fseeko(f_, 0, SEEK_END) != 0 || uint64_t(ftello(f_)) < offset || fseeko(f_, off_t(offset), SEEK_SET) != 0) {
+        fclose(f_); f_ = NULL;
+        return false;
+      }
+      written_ = offset; // prealloc_ and used_ still hold what create() set, the card's the same one
+      return true;
+    }
+
+    /// @brief Forget the open file without closing it properly (the logger reset)
+    void crash() {
+      if (f_) fclose(f_);
+      f_ = NULL;
+    }
+
+    bool close() override {
+      if (!f_) return false;
+      fflush(f_);
+      bool ok = ftruncate(fileno(f_), off_t(written_)) == 0;
+      used_ -= prealloc_ - written_;
+      fclose(f_);
+      f_ = NULL;
+      return ok;
+    }
+
+    const std::string& path() const { return path_; }
+
+  private:
+    FakeClock& clock_;
+    std::string dir_;
+    std::string path_;
+    FILE * f_ = NULL;
+    uint64_t used_ = 0, prealloc_ = 0, written_ = 0;
+};
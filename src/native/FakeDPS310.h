@@ -0,0 +1,174 @@
+/* FakeDPS310.h
+    A DPS310 on a fake I2C bus, register for register, for running GR_DPS310 (and the old Adafruit style polling) on the dev box.
+    Background mode measures on its own timer (rateErrorPpm off nominal), queues results in the 32 deep FIFO (results that don't fit
+    are lost, like the real one) or leaves them in the result registers with the ready flags set. Raw results are worked back from
+    pressPa / tempC through the calibration coefficients, so what comes out of the compensation should be what went in.
+
+    Every transfer moves the clock on by its time on the wire (advanceBus), so bus time shows up in the timing the way it would on
+    the logger.
+*/
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <GR_SensorHAL.h>
+#include <GR_DPS310.h>
+#include "FakeSensors.h"
+
+#define FAKE_DPS310_LOG 512  // Pressure results remembered (when each was taken, for checking timestamps)
+
+/// @brief Calibration coefficients the fake has in its registers (typical sizes for the part: 25C and 958hPa come out of raw
+///        temperature 157866 and raw pressure -2517431 at 1x / 8x)
+static const uint8_t fakeDPS310Coefs[GR_DPS310_COEF_BYTES] = {0x0D, 0x1E, 0xF8, 0x13, 0x80, 0xAF, 0x25, 0x18, 0xF4,
+                                                              0xF3, 0x04, 0xAC, 0xD7, 0x7C, 0x00, 0xE1, 0xFA, 0x74};
+
+class FakeDPS310 : public GR_I2CBus {
+  public:
+    float tempC = 20.0f;
+    float pressPa = 101325.0f;
+    double rateErrorPpm = 0;  // The sensor's timer against the clock (+ = measures slower)
+    bool advanceBus = true;   // Move the clock on by each transfer's time on the wire
+
+    FakeDPS310(FakeClock& clock, uint32_t hz = 100000) : clock_(clock), hz_(hz) {
+      memcpy(regs_ + GR_DPS310_COEF, fakeDPS310Coefs, sizeof(fakeDPS310Coefs));
+      coefs_ = GR_DPS310Comp::decode(fakeDPS310Coefs);
+      reset();
+    }
+
+    void setClockHz(uint32_t hz) { hz_ = hz; }
+    uint32_t clockHz() override { return hz_; }
+
+    bool readRegs(uint8_t addr, uint8_t reg, uint8_t * buf, size_t n) override {
+      if (addr != GR_DPS310_ADDR) return false;
+      busTime(30 + 9 * n);
+      measure();
+      if (reg == GR_DPS310_PSR_B2 && (regs_[GR_DPS310_CFG_REG] & GR_DPS310_FIFO_EN)) { // FIFO pop, 3 bytes at a time
+        for (size_t i = 0; i < n; i += 3) {
+          uint32_t v = GR_DPS310_FIFO_EMPTY;
+          if (fifoCount_) { v = fifo_[fifoHead_]; fifoHead_ = (fifoHead_ + 1) % GR_DPS310_FIFO_DEPTH; fifoCount_--; }
+          for (size_t j = 0; j < 3 && i + j < n; j++) buf[i + j] = uint8_t(v >> (16 - 8 * j));
+        }
+        return true;
+      }
+      for (size_t i = 0; i < n; i++) {
+        uint8_t r = uint8_t(reg + i);
+        buf[i] = regs_[r];
+        if (r == GR_DPS310_PSR_B2 + 2) regs_[GR_DPS310_MEAS_CFG] &= ~GR_DPS310_PRS_RDY; // Reading the result clears its flag
+        if (r == GR_DPS310_TMP_B2 + 2) regs_[GR_DPS310_MEAS_CFG] &= ~GR_DPS310_TMP_RDY;
+      }
+      return true;
+    }
+
+    bool writeReg(uint8_t addr, uint8_t reg, uint8_t value) override {
+      if (addr != GR_DPS310_ADDR) return false;
+      busTime(29);
+      measure();
+      if (reg == GR_DPS310_RESET) {
+        if ((value & 0x0F) == GR_DPS310_SOFT_RST) reset();
+        if (value & GR_DPS310_FIFO_FLUSH) fifoHead_ = fifoCount_ = 0;
+        return true;
+      }
+      if (reg == GR_DPS310_MEAS_CFG) {
+        regs_[reg] = uint8_t((regs_[reg] & 0xF0) | (value & 0x07));
+        if ((value & 0x07) == GR_DPS310_MEAS_CONT) start();
+        return true;
+      }
+      regs_[reg] = value;
+      return true;
+    }
+
+    /// @brief Results lost to a full FIFO
+    uint32_t overflowed() const { return overflowed_; }
+    /// @brief Pressure results handed over so far (queued in the FIFO, or put in the result registers), and the middle of result
+    ///        i's measurement (from 0, the last FAKE_DPS310_LOG of them)
+    uint64_t prsResults() const { return prsOut_; }
+    uint64_t prsTakenUs(uint64_t i) const { return prsLog_[i % FAKE_DPS310_LOG] - prsMeasureUs_ / 2; }
+
+    /// @brief Raw results for a temperature / pressure (the compensation run backwards: the temperature's linear, the pressure's a
+    ///        cubic in the raw value, solved by Newton's method from the linear guess)
+    int32_t rawTemp(float c) const { return int32_t(lround((c - coefs_.c0 * 0.5) / coefs_.c1 * kT_)); }
+    int32_t rawPress(float pa, int32_t rawT) const {
+      double t = rawT / kT_;
+      double a = coefs_.c00 + t * coefs_.c01, b = coefs_.c10 + t * coefs_.c11, c = coefs_.c20 + t * coefs_.c21, d = coefs_.c30;
+      double x = (pa - a) / b;
+      for (int i = 0; i < 8; i++) x -= (a + x * (b + x * (c + x * d)) - pa) / (b + x * (2 * c + x * 3 * d));
+      return int32_t(lround(x * kP_));
+    }
+
+  private:
+    void reset() {
+      uint8_t coef[GR_DPS310_COEF_BYTES];
+      memcpy(coef, regs_ + GR_DPS310_COEF, sizeof(coef));
+      memset(regs_, 0, sizeof(regs_));
+      memcpy(regs_ + GR_DPS310_COEF, coef, sizeof(coef));
+      regs_[GR_DPS310_PROD_ID] = GR_DPS310_ID;
+      regs_[GR_DPS310_COEF_SRCE] = GR_DPS310_TMP_EXT;
+      regs_[GR_DPS310_MEAS_CFG] = GR_DPS310_COEF_RDY | GR_DPS310_SENSOR_RDY; // Ready straight away, no 40ms here
+      fifoHead_ = fifoCount_ = 0;
+      running_ = false;
+    }
+
+    /// @brief Background mode from now: pressure measurements back to back at their rate, temperatures slotted in at theirs
+    void start() {
+      uint8_t prs = regs_[GR_DPS310_PRS_CFG], tmp = regs_[GR_DPS310_TMP_CFG];
+      double scale = 1 + rateErrorPpm * 1e-6;
+      prsPeriodUs_ = 1e6 / (1 << (prs >> 4 & 7)) * scale;
+      tmpPeriodUs_ = 1e6 / (1 << (tmp >> 4 & 7)) * scale;
+      prsMeasureUs_ = uint64_t(GR_DPS310Comp::measureMs(1u << (prs & 0x0F)) * 1000 * scale);
+      tmpMeasureUs_ = uint64_t(GR_DPS310Comp::measureMs(1u << (tmp & 0x0F)) * 1000 * scale);
+      kP_ = GR_DPS310Comp::scaleFactor(1u << (prs & 0x0F));
+      kT_ = GR_DPS310Comp::scaleFactor(1u << (tmp & 0x0F));
+      startUs_ = clock_.micros();
+      prsN_ = tmpN_ = prsOut_ = 0;
+      rawT_ = rawTemp(tempC);
+      running_ = true;
+    }
+
+    /// @brief Queue every result finished by now, in the order they finished
+    void measure() {
+      if (!running_) return;
+      uint64_t now = clock_.micros();
+      for (;;) {
+        uint64_t prsDone = startUs_ + uint64_t(prsN_ * prsPeriodUs_) + prsMeasureUs_;
+        uint64_t tmpDone = startUs_ + uint64_t(tmpN_ * tmpPeriodUs_) + tmpMeasureUs_;
+        if (prsDone > now && tmpDone > now) return;
+        if (tmpDone <= prsDone) {
+          rawT_ = rawTemp(tempC);
+          result(uint32_t(rawT_) & 0xFFFFFE, GR_DPS310_TMP_B2, GR_DPS310_TMP_RDY);
+          tmpN_++;
+        } else {
+          if (result((uint32_t(rawPress(pressPa, rawT_)) & 0xFFFFFF) | 1, GR_DPS310_PSR_B2, GR_DPS310_PRS_RDY))
+            prsLog_[prsOut_++ % FAKE_DPS310_LOG] = prsDone;
+          prsN_++;
+        }
+      }
+    }
+
+    /// @brief Hand over a result: false if it was lost
+    bool result(uint32_t v, uint8_t reg, uint8_t flag) {
+      if (regs_[GR_DPS310_CFG_REG] & GR_DPS310_FIFO_EN) {
+        if (fifoCount_ == GR_DPS310_FIFO_DEPTH) { overflowed_++; return false; }
+        fifo_[(fifoHead_ + fifoCount_++) % GR_DPS310_FIFO_DEPTH] = v;
+        return true;
+      }
+      regs_[reg] = uint8_t(v >> 16); regs_[reg + 1] = uint8_t(v >> 8); regs_[reg + 2] = uint8_t(v);
+      regs_[GR_DPS310_MEAS_CFG] |= flag;
+      return true;
+    }
+
+    void busTime(uint32_t bits) { if (advanceBus && hz_) clock_.advanceUs(uint64_t(bits) * 1000000 / hz_); }
+
+    FakeClock& clock_;
+    uint32_t hz_;
+    uint8_t regs_[256] = {};
+    GR_DPS310Coefs coefs_;
+    uint32_t fifo_[GR_DPS310_FIFO_DEPTH];
+    size_t fifoHead_ = 0, fifoCount_ = 0;
+    uint32_t overflowed_ = 0;
+    bool running_ = false;
+    double prsPeriodUs_ = 0, tmpPeriodUs_ = 0, kP_ = 1, kT_ = 1;
+    uint64_t prsMeasureUs_ = 0, tmpMeasureUs_ = 0;
+    uint64_t startUs_ = 0, prsN_ = 0, tmpN_ = 0, prsOut_ = 0;
+    int32_t rawT_ = 0;
+    uint64_t prsLog_[FAKE_DPS310_LOG] = {};
+};
@@ -0,0 +1,87 @@
+/* FakeSensors.h
+    Fake clock and sensors for the native (Linux) build, implementing the same GR_SensorHAL interfaces as SensorHAL_ESP.h
+
+    FakeClock runs on simulated time: sleepMs() / sleepUntilUs() just move the clock forward, so a whole flight's worth of sampling runs in a
+    fraction of a second. Set realTime to actually sleep instead, and speed to run the real time clock faster than real time (1000 = a
+    1000x sped up flight, where every sleep and every host delay is 1000x shorter in simulated time).
+*/
+#pragma once
+#include <stdint.h>
+#include <math.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+#include <GR_SensorHAL.h>
+
+class FakeClock : public GR_Clock {
+  public:
+    bool realTime = false;  // If true, sleepMs() / sleepUntilUs() really sleep (and the clock follows the host's steady clock)
+    double speed = 1;       // Real time only: simulated seconds per host second
+
+    uint32_t millis() override { return uint32_t(micros() / 1000); }
+    uint64_t micros() override {
+      if (!realTime) return nowUs_;
+      return uint64_t(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start_).count() * speed);
+    }
+    void sleepMs(uint32_t ms) override {
+      if (realTime) {
+        std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(ms / speed));
+      } else {
+        nowUs_ += uint64_t(ms) * 1000;
+      }
+    }
+    void sleepUntilUs(uint64_t deadlineUs) override {
+      if (realTime) {
+        std::this_thread::sleep_until(start_ + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                                  std::chrono::duration<double, std::micro>(deadlineUs / speed)));
+      } else if (deadlineUs > nowUs_) {
+        nowUs_ = deadlineUs;
+      }
+    }
+    /// @brief Move simulated time forward without sleeping (simulates time spent doing work)
+    void advanceUs(uint64_t us) { nowUs_ += us; }
+
+  private:
+    uint64_t nowUs_ = 0;
+    std::chrono::steady_clock::time_point start_ = std::chrono::steady_clock::now();
+};
+
+/// @brief ADXL377 sitting still on the bench: zero point plus 1g on Z plus a bit of ADC noise
+class FakeAccel : public GR_AccelSensor {
+  public:
+    int zeroX = 1984, zeroY = 1984, zeroZ = 1992;
+    int noise = 4;  // +/- ADC counts of noise
+    void read(int& x, int& y, int& z) override {
+      x = zeroX + jitter();
+      y = zeroY + jitter();
+      z = zeroZ + 10 + jitter(); // ~1g
+    }
+  private:
+    int jitter() { return noise > 0 ? (rand() % (2 * noise + 1)) - noise : 0; }
+};
+
+/// @brief DPS310 sitting at a fixed altitude. New data is "available" once every periodMs, like the real sensor at 64Hz
+class FakeBaro : public GR_BaroSensor {
+  public:
+    FakeBaro(GR_Clock& clock) : clock_(clock) {}
+    float tempC = 20.0f;
+    float pressPa = 101325.0f;
+    uint32_t periodMs = 15; // ~64Hz
+    bool available() override { return clock_.millis() - lastRead_ >= periodMs; }
+    bool read(float& t, float& p) override {
+      lastRead_ = clock_.millis();
+      t = tempC;
+      p = pressPa;
+      return true;
+    }
+  private:
+    GR_Clock& clock_;
+    uint32_t lastRead_ = 0;
+};
+
+/// @brief Battery divider reading a fixed raw value (~3.7V)
+class FakeBatt : public GR_BattSensor {
+  public:
+    int raw = 2296;
+    int readRaw() override { return raw; }
+};
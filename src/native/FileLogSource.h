@@ -0,0 +1,37 @@
+/* FileLogSource.h
+    stdio GR_LogSource for the native build and tools/GraphiteLogDownload: serves log downloads from a directory on the dev box.
+*/
+#pragma once
+#include <stdio.h>
+#include <string>
+#include <GR_LogDownload.h>
+
+class FileLogSource : public GR_LogSource {
+  public:
+    ~FileLogSource() { close(); }
+
+    /// @brief Open dir/name for reading
+    bool open(const char * dir, const char * name) {
+      close();
+      std::string path = std::string(dir) + "/" + name;
+      f_ = fopen(path.c_str(), "rb");
+      if (!f_) return false;
+      setvbuf(f_, NULL, _IONBF, 0); // The downloader reads in big pieces itself; stdio's buffer would just be an extra copy
+      if (fseeko(f_, 0, SEEK_END) != 0) { close(); return false; }
+      size_ = uint64_t(ftello(f_));
+      return fseeko(f_, 0, SEEK_SET) == 0;
+    }
+
+    void close() {
+      if (f_) fclose(f_);
+      f_ = NULL;
+    }
+
+    uint64_t size() override { return size_; }
+    bool seek(uint64_t pos) override { return f_ && pos <= size_ && fseeko(f_, off_t(pos), SEEK_SET) == 0; }
+    size_t read(void * buf, size_t len) override { return f_ ? fread(buf, 1, len, f_) : 0; }
+
+  private:
+    FILE * f_ = NULL;
+    uint64_t size_ = 0;
+};
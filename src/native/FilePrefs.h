@@ -0,0 +1,130 @@
+/* FilePrefs.h
+    GR_Prefs for the native build: one text file per namespace (<dir>/<namespace>.nvs), one "key type value" line per entry, rewritten
+    on every put (like NVS commits). Strings and blobs are stored hex encoded so anything survives the round trip.
+
+    The logger's settings are one blob (GR_Config.h), so to try other thresholds in the sim use its --set instead of editing the file
+*/
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <GR_Prefs.h>
+
+class FilePrefs : public GR_Prefs {
+  public:
+    /// @param dir where the namespace files go ("" = don't touch the disk, values only live as long as this object)
+    FilePrefs(const char * dir = ".") : dir_(dir) {}
+
+    bool begin(const char * name) override {
+      entries_.clear();
+      if (dir_.empty()) return true;
+      path_ = dir_ + "/" + name + ".nvs";
+      FILE * f = fopen(path_.c_str(), "r");
+      if (!f) return true; // New namespace
+      char line[4096], key[64], type[8];
+      while (fgets(line, sizeof(line), f)) {
+        int used = 0;
+        if (line[0] == '#' || sscanf(line, "%63s %7s %n", key, type, &used) < 2) continue;
+        std::string value = line + used;
+        while (!value.empty() && (value.back() == '\n' || value.back() == '\r')) value.pop_back();
+        entries_[key] = {type[0], value};
+      }
+      fclose(f);
+      return true;
+    }
+
+    bool clear() override { entries_.clear(); return save(); }
+    bool isKey(const char * key) override { return entries_.count(key) > 0; }
+    bool remove(const char * key) override { return !entries_.erase(key) || save(); }
+    size_t freeEntries() override { return 1000; }
+
+    int32_t getInt(const char * key, int32_t def = 0) override {
+      const Entry * e = find(key, 'i');
+      return e ? int32_t(strtol(e->value.c_str(), NULL, 10)) : def;
+    }
+    size_t putInt(const char * key, int32_t value) override { return put(key, 'i', std::to_string(value), sizeof(value)); }
+
+    float getFloat(const char * key, float def = 0) override {
+      const Entry * e = find(key, 'f');
+      return e ? strtof(e->value.c_str(), NULL) : def;
+    }
+    size_t putFloat(const char * key, float value) override {
+      char buf[32];
+      snprintf(buf, sizeof(buf), "%.9g", value); // Enough digits to get the same float back
+      return put(key, 'f', buf, sizeof(value));
+    }
+
+    size_t getString(const char * key, char * out, size_t max) override {
+      const Entry * e = find(key, 's');
+      if (!e) return 0;
+      std::string s = unhex(e->value);
+      if (s.size() + 1 > max) return 0;
+      memcpy(out, s.c_str(), s.size() + 1);
+      return s.size() + 1;
+    }
+    size_t putString(const char * key, const char * value) override { return put(key, 's', hex(value, strlen(value)), strlen(value)); }
+
+    size_t getBytes(const char * key, void * out, size_t max) override {
+      const Entry * e = find(key, 'b');
+      if (!e) return 0;
+      std::string s = unhex(e->value);
+      if (s.size() > max) return 0;
+      memcpy(out, s.data(), s.size());
+      return s.size();
+    }
+    size_t putBytes(const char * key, const void * value, size_t len) override { return put(key, 'b', hex(value, len), len); }
+    size_t getBytesLength(const char * key) override {
+      const Entry * e = find(key, 'b');
+      return e ? e->value.size() / 2 : 0;
+    }
+
+    const std::string& path() const { return path_; }
+
+  private:
+    struct Entry {
+      char type;  // i, f, s, b
+      std::string value;
+    };
+
+    const Entry * find(const char * key, char type) const {
+      auto it = entries_.find(key);
+      return it != entries_.end() && it->second.type == type ? &it->second : NULL;
+    }
+
+    size_t put(const char * key, char type, const std::string& value, size_t len) {
+      if (strlen(key) > GR_PREFS_KEY_MAX) return 0;
+      entries_[key] = {type, value};
+      return save() ? (len ? len : 1) : 0;
+    }
+
+    bool save() {
+      if (dir_.empty()) return true;
+      FILE * f = fopen(path_.c_str(), "w");
+      if (!f) return false;
+      fprintf(f, "# GR_Prefs (native build). key, type (i = int, f = float, s = string, b = blob; s / b are hex), value\n");
+      for (const auto& e : entries_) fprintf(f, "%s %c %s\n", e.first.c_str(), e.second.type, e.second.value.c_str());
+      return fclose(f) == 0;
+    }
+
+    static std::string hex(const void * data, size_t len) {
+      static const char digits[] = "0123456789abcdef";
+      std::string s;
+      for (size_t i = 0; i < len; i++) {
+        uint8_t b = static_cast<const uint8_t *>(data)[i];
+        s += digits[b >> 4];
+        s += digits[b & 15];
+      }
+      return s;
+    }
+
+    static std::string unhex(const std::string& s) {
+      std::string out;
+      for (size_t i = 0; i + 1 < s.size(); i += 2) out += char(strtol(s.substr(i, 2).c_str(), NULL, 16));
+      return out;
+    }
+
+    std::string dir_, path_;
+    std::map<std::string, Entry> entries_;
+};
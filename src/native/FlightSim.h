@@ -0,0 +1,435 @@
+/* FlightSim.h
+    The logger for the native build: main.cpp's globals (same names, same defaults) with the ESP32 swapped out for the fakes, and the
+    flight pipeline itself from FlightFuncs.h, the same io_SampleHandler / io_drainSamples() / io_drainRaw() the logger runs. Around it,
+    stand-ins for what main.cpp, LogFuncs.h and WebFuncs.h do on the logger: the log file, arming, saving + restoring io_resume.
+
+    Differences from the logger, on purpose:
+      - Everything runs on one thread; native/main.cpp takes turns between the sampler, sim_drain() and the log writer in simulated time
+      - The log functions are LogFuncs.h's without the SD card or the writer task: io_startLog() takes the file name, and io_stopLog()
+        writes the last buffers out itself
+      - No web server (sim_arm() stands in for /armForLaunch) and the accelerometer calibration mode never gets turned on
+      - debugMsg() prints the general (level 1) messages with --verbose, stamped with the sim's clock, and nothing otherwise. So no Teleplot
+      - One altitude table: nothing changes the cal values mid flight, so there's nothing to hand over
+      - A reset (sim_powerOn() again) puts everything that lives in RAM back the way it was at power on; io_resume (RTC memory on the
+        logger) and the card are left as they were. The sim's clock just keeps going through it, so there's no io_clock.setMicros() to
+        do in io_restoreFlight(); the wall clock is only ever io_wallOffsetUs (native/main.cpp sets it from the host's, like a phone)
+      - The flight phase's radio + CPU clock settings have nothing to act on here
+
+    Uses the io_ defaults #defined in native/main.cpp, include it after them (same deal as WebFuncs.h in main.cpp).
+*/
+#pragma once
+#include <stdio.h>
+#include <new>
+#include <type_traits>
+#include <GR_Sampler.h>
+#include <GR_SampleRecord.h>
+#include <GR_Align.h>
+#include <GR_RingBuffer.h>
+#include <GR_Altitude.h>
+#include <GR_FlightLog.h>
+#include <GR_LogPack.h>
+#include <GR_History.h>
+#include <GR_LaunchDetect.h>
+#include <GR_Estimator.h>
+#include <GR_LogWriter.h>
+#include <GR_Prefs.h>
+#include <GR_Config.h>
+#include <GR_Resume.h>
+#include <GR_FlightPhase.h>
+#include <GR_Perf.h>
+#include "FakeSensors.h"
+#include "FakeBlockDevice.h"
+
+typedef GR_LogWriter<io_logBufferBytes, io_logBufferCount> LogWriter;
+
+// main.cpp's globals -----------------------------------------------------------------------------------------------------------------
+FakeClock io_clock;
+FakeBlockDevice io_sdDevice(io_clock);
+
+// Event detection
+bool time_synced = 0;
+int64_t io_wallOffsetUs = 0;
+bool volatile flag_armed = 0, flag_launched = 0, flag_apogee = 0, flag_landed = 0;
+float ld_accelG;
+int ld_accelSamples;
+float ld_altFt;
+int ld_altSamples;
+GR_LaunchDetect io_launchDetect;
+bool io_launchLogged = 0;
+int io_logPack;
+GR_AltitudeKF io_altKF;
+GR_ApogeeLandingDetect io_flightEvents;
+bool io_apogeeLogged = 0, io_landedLogged = 0;
+
+// Flight phases
+int io_logTailS;
+int io_logInterp;
+GR_FlightPhase io_phase;
+const GR_PhaseSettings * volatile io_phaseSettings = &io_phase.settings();
+GR_RawDecimator io_rawDecimator;
+
+// ADXL377 (the trace has the zero + coefficient values)
+bool cal_accelCalMode = 0, cal_accelCalStarted = 0;
+int cal_zeroXAccel = 1984, cal_p1gXAccell = 1992, cal_n1gXAccell = 1975;
+int cal_zeroYAccel = 1984, cal_p1gYAccell = 1992, cal_n1gYAccell = 1975;
+int cal_zeroZAccel = 1992, cal_p1gZAccell = 2005, cal_n1gZAccell = 1978;
+double cal_xAccelCoef = 0.03, cal_yAccelCoef = 0.03, cal_zAccelCoef = 0.029;
+GR_Track<GR_AccelSample, io_accelTrackLen> dat_accel;
+unsigned long cal_accelCalTimer;
+unsigned long cal_accelCalTimeout = 60000;
+
+// DPS310
+GR_Track<GR_BaroSample, io_baroTrackLen> dat_baro;
+float cal_lapseRate, cal_magicExp, cal_pAtSea;
+GR_AltitudeTable io_altTable;
+
+// main.cpp's io_configItems, minus the WiFi ones
+const GR_ConfigItem io_configItems[] = {
+  GR_CONFIG_FLOAT(cal_lapseRate,  "cal_lapseRate", 0.0059,         0.001, 0.02,   "K/m",     0, "Altimeter: temperature lapse rate"),
+  GR_CONFIG_FLOAT(cal_magicExp,   "cal_magicExp",  0.190266435664, 0.1,   0.3,    "",        0, "Altimeter: barometric formula exponent"),
+  GR_CONFIG_FLOAT(cal_pAtSea,     "cal_pAtSea",    101325,         80000, 110000, "Pa",      0, "Altimeter: sea level pressure"),
+  GR_CONFIG_FLOAT(ld_accelG,      "ld_accelG",     3.0,            1.5,   100,    "g",       0, "Launch: acceleration"),
+  GR_CONFIG_INT(ld_accelSamples,  "ld_accelN",     30,             1,     1000,   "samples", 0, "Launch: for this many accelerometer samples (1kHz)"),
+  GR_CONFIG_FLOAT(ld_altFt,       "ld_altFt",      100,            10,    5000,   "ft",      0, "Launch: height above the pad"),
+  GR_CONFIG_INT(ld_altSamples,    "ld_altN",       5,              1,     100,    "samples", 0, "Launch: for this many altimeter samples (64Hz)"),
+  GR_CONFIG_INT(io_logPack,       "log_pack",      0,              0,     1,      "",        0, "Log: pack samples (~4x smaller, needs a v2 decoder)"),
+  GR_CONFIG_INT(io_logTailS,      "log_tailS",     60,             5,     3600,   "s",       0, "Log: keep going this long after landing"),
+  GR_CONFIG_INT(io_logInterp,     "log_interp",    1,              0,     1,      "",        0, "Log: interpolate slow records onto one time (0 = nearest reading)"),
+};
+GR_Config io_config(io_configItems, sizeof(io_configItems) / sizeof(io_configItems[0]));
+
+// Battery
+GR_Track<float, io_battTrackLen> dat_battRaw;
+
+// Latency probes (nothing unless it's built with GR_PERF_ENABLE)
+GR_PERF_PROBE(io_perfAccel, "sampler.accel");
+GR_PERF_PROBE(io_perfDetect, "sampler.detect");
+GR_PERF_PROBE(io_perfBaro, "sampler.baro");
+GR_PERF_PROBE(io_perfLogTick, "sampler.align");
+GR_PERF_PROBE(io_perfDrain, "log.drain");
+
+// Sample hand-off
+GR_RingBuffer<GR_SampleRecord, io_sampleRingSize> io_sampleRing;
+GR_SampleRecord wi_latestSample = {};
+uint32_t io_sampleRingOverflows = 0;
+
+// Log file
+LogWriter io_logWriter(io_sdDevice, io_clock);
+bool io_logPacking = 0;
+GR_LogPacker io_logPacker;
+
+// Full rate records + pre-launch history
+GR_History<GR_LogRecord> io_history;
+GR_LogRecord io_historyMem[io_historyRecords]; // PSRAM on the logger
+GR_RingBuffer<GR_LogRecord, io_rawRingSize> io_rawRing;
+size_t io_historyFlushed = 0;
+uint32_t io_rawRingOverflows = 0;
+
+// Picking a flight back up after a reset
+GR_ResumeState io_resume[2] = {}; // RTC memory on the logger: sim_powerOn() leaves it alone
+uint32_t io_resumeSeq = 0;
+uint16_t io_resumeCount = 0;
+unsigned long io_resumeTimer = 0;
+char io_logName[GR_RESUME_NAME_MAX] = "";
+uint64_t io_launchLogEnd = 0, io_apogeeLogEnd = 0, io_landedLogEnd = 0;
+
+// The sim's own ----------------------------------------------------------------------------------------------------------------------
+
+/// @brief When the pipeline decided something (clock time, 0 = didn't happen)
+struct SimDecisions {
+  uint64_t armedUs, t0Us, launchUs, apogeeUs, landedUs, shutdownUs;
+  uint64_t resumedUs;  // Picked back up after a reset (the last time, if more than once)
+  uint8_t launchReason;
+  float apogeeM;  // Filter altitude above the pad baseline at apogee
+};
+
+bool sim_verbose = false;                                 // Print the debug messages (--verbose)
+bool sim_debugMidLine = false;                            // debugMsg() has a line going
+uint64_t sim_armedUs = 0, sim_resumedUs = 0, sim_shutdownUs = 0; // What the flags + detectors don't remember (this boot's)
+
+// What FlightFuncs.h needs from the Arduino core + WL_DebugUtils.h -----------------------------------------------------------------
+
+unsigned long millis() { return io_clock.millis(); }
+
+inline void sim_debugPut(const char * s, int) { fputs(s, stdout); }
+inline void sim_debugPut(bool b, int) { fputs(b ? "true" : "false", stdout); }
+inline void sim_debugPut(double v, int decPrecision) { printf("%.*f", decPrecision, v); }
+template <typename Type>
+inline typename std::enable_if<std::is_integral<Type>::value>::type sim_debugPut(Type v, int) {
+  if (std::is_signed<Type>::value) printf("%lld", (long long)v);
+  else printf("%llu", (unsigned long long)v);
+}
+
+/// @brief WL_DebugUtils.h's debugMsg(): general messages only (minLevel 1), and only with --verbose. Each line starts with the sim's clock
+template <typename Type>
+void debugMsg(const Type& txtIn, int minLevel = 1, bool ln = true, int decPrecision = 8) {
+  if (!sim_verbose || minLevel > 1) return;
+  if (!sim_debugMidLine) printf("  [%9.3f s] ", io_clock.micros() / 1e6);
+  sim_debugPut(txtIn, decPrecision);
+  sim_debugMidLine = !ln;
+  if (ln) printf("\n");
+}
+
+// LogFuncs.h, minus the SD card + writer task ----------------------------------------------------------------------------------------
+
+void io_logAppend(const GR_LogRecord * r, size_t n) {
+  if (!io_logWriter.isOpen()) return;
+  if (!io_logPacking) { io_logWriter.append(r, n * sizeof(GR_LogRecord)); return; }
+  for (size_t i = 0; i < n; i++) {
+    const uint8_t * block = io_logPacker.add(r[i]);
+    if (block) io_logWriter.append(block, GR_PACK_BLOCK);
+  }
+}
+
+size_t io_logRoom() {
+  size_t bytes = io_logWriter.writable();
+  return io_logPacking ? GR_LogPacker::recordsFor(bytes) : bytes / sizeof(GR_LogRecord);
+}
+
+uint64_t io_logAppended() { return io_logWriter.appended() + (io_logPacking && io_logPacker.pending() ? GR_PACK_BLOCK : 0); }
+
+/// @brief Create + preallocate the log file, header, settings and the wall clock (the logger names it after the wall clock instead)
+bool io_startLog(const char * name) {
+  if (!io_logWriter.begin(name, uint64_t(io_logPreallocMB) << 20, uint64_t(io_logReserveMB) << 20)) return false;
+  snprintf(io_logName, sizeof(io_logName), "%s", name);
+  io_logPacking = io_logPack;
+  io_logPacker.reset();
+  GR_LogHeader h = GR_FlightLog::makeHeader(io_clock.micros(), io_logPacking ? GR_PACK_BLOCK : 0);
+  h.cal_pAtSea = cal_pAtSea;
+  h.cal_lapseRate = cal_lapseRate;
+  h.cal_magicExp = cal_magicExp;
+  h.cal_zeroXAccel = cal_zeroXAccel; h.cal_zeroYAccel = cal_zeroYAccel; h.cal_zeroZAccel = cal_zeroZAccel;
+  h.cal_xAccelCoef = cal_xAccelCoef; h.cal_yAccelCoef = cal_yAccelCoef; h.cal_zAccelCoef = cal_zAccelCoef;
+  h.configSchema = io_config.schemaHash();
+  for (size_t i = 0; i < io_config.count(); i++) h.configCount += GR_Config::loggable(io_config.item(i));
+  io_logWriter.append(&h, sizeof(h));
+  if (io_logPacking) {
+    static const uint8_t zeros[GR_PACK_BLOCK] = {};
+    io_logWriter.append(zeros, size_t(GR_LogPack::dataStart(h) - sizeof(h)));
+  }
+  for (size_t i = 0; i < io_config.count(); i++) {
+    const GR_ConfigItem& it = io_config.item(i);
+    if (!GR_Config::loggable(it)) continue;
+    double v = GR_Config::number(it);
+    GR_LogRecord r = GR_FlightLog::makeConfig(h.startUs, it.key, it.type == GR_CFG_FLOAT, int32_t(v), float(v));
+    io_logAppend(&r, 1);
+  }
+  GR_LogRecord wall = GR_FlightLog::makeWallClock(h.startUs, io_wallOffsetUs, time_synced);
+  io_logAppend(&wall, 1);
+  debugMsg("[EVENT]: Started ",1,0); debugMsg(io_logPacking ? "packed " : "",1,0); debugMsg("log file ",1,0); debugMsg(name);
+  return true;
+}
+
+void io_logEventAt(uint64_t timeUs, uint16_t code, int32_t iArg = 0, float fArg = 0) {
+  GR_LogRecord r = GR_FlightLog::makeEvent(timeUs, code, iArg, fArg);
+  io_logAppend(&r, 1);
+}
+
+void io_logEvent(uint16_t code, int32_t iArg = 0, float fArg = 0) { io_logEventAt(io_clock.micros(), code, iArg, fArg); }
+
+/// @brief Pick the log file back up where it left off, or start a new one. Then log a resumed event
+/// @param resetReason, bootMs what goes in the resumed event
+bool io_resumeLog(const GR_ResumeState& from, int32_t resetReason, float bootMs) {
+  uint64_t offset = from.logPackBlock ? from.logOffset - from.logOffset % from.logPackBlock : from.logOffset;
+  if (from.logPrealloc && offset && io_logWriter.resume(from.logName, from.logPrealloc, offset)) {
+    snprintf(io_logName, sizeof(io_logName), "%s", from.logName);
+    io_logPacking = from.logPackBlock != 0;
+    io_logPacker.reset();
+    debugMsg("[EVENT]: Picked log file ",1,0); debugMsg(from.logName,1,0); debugMsg(" back up at ",1,0);
+    debugMsg((unsigned long)(io_logWriter.synced() / 1024),1,0); debugMsg("KB");
+  } else {
+    if (from.logOffset) { debugMsg("[ERROR]: Couldn't reopen log file ",1,0); debugMsg(from.logName,1,0); debugMsg(", starting a new one"); }
+    if (!io_startLog(from.logName)) return false;
+    io_launchLogged = 0; io_apogeeLogged = 0; io_landedLogged = 0;
+  }
+  io_logEvent(GR_EVT_RESUMED, resetReason, bootMs);
+  return true;
+}
+
+void io_logSample(const GR_SampleRecord& s) {
+  GR_LogRecord r = GR_FlightLog::makeSample(s.timeUs, GR_SAMPLE_ACCEL | GR_SAMPLE_BARO | GR_SAMPLE_BATT,
+                                            uint16_t(s.xAccelRaw + 0.5f), uint16_t(s.yAccelRaw + 0.5f), uint16_t(s.zAccelRaw + 0.5f),
+                                            s.pressPa, s.tempC, uint16_t(s.battRaw + 0.5f));
+  io_logAppend(&r, 1);
+}
+
+/// @brief Flush + close the log. On the logger end() waits for the writer task to write the last buffers out; here that has to happen on
+///        this thread
+void io_stopLog() {
+  if (!io_logWriter.isOpen()) return;
+  io_logName[0] = 0;
+  const uint8_t * block = io_logPacking ? io_logPacker.flush() : NULL;
+  if (block) io_logWriter.append(block, GR_PACK_BLOCK);
+  io_logWriter.flush();
+  while (io_logWriter.service()) {}
+  io_logWriter.end();
+  debugMsg("[EVENT]: Log file closed");
+}
+
+// main.cpp's -------------------------------------------------------------------------------------------------------------------------
+
+GR_AltitudeTable * io_takeAltTable() { return &io_altTable; }
+
+/// @brief Put the config into effect (setup(), before the sampling starts)
+void io_applyConfig() {
+  io_altTable.build(cal_pAtSea, cal_lapseRate, cal_magicExp);
+  GR_LaunchDetect::Config ldConfig = GR_LaunchDetect::defaults();
+  ldConfig.accelG = ld_accelG;
+  ldConfig.accelSamples = ld_accelSamples;
+  ldConfig.altRiseM = ld_altFt / 3.280839895;
+  ldConfig.altSamples = ld_altSamples;
+  io_launchDetect.setConfig(ldConfig);
+  GR_FlightPhase::Config phConfig = io_phase.config();
+  phConfig.tailMs = uint32_t(io_logTailS) * 1000;
+  io_phase.setConfig(phConfig);
+}
+
+/// @brief The flight from before a reset (the clock needs no putting back, see the top)
+void io_restoreFlight(const GR_ResumeState& from) {
+  GR_LaunchDetect::Result ld = {from.launchReason, from.launchT0Us, from.launchDetectUs};
+  io_launchDetect.restore(ld, from.baselineM);
+  GR_ApogeeLandingDetect::Event apogee = {uint8_t(from.apogee ? GR_FLIGHT_EVT_APOGEE : GR_FLIGHT_EVT_NONE), from.apogeeUs, from.apogeeM};
+  GR_ApogeeLandingDetect::Event landed = {uint8_t(from.landed ? GR_FLIGHT_EVT_LANDED : GR_FLIGHT_EVT_NONE), from.landedUs, from.landedM};
+  io_flightEvents.restore(from.launchT0Us, apogee, landed);
+  if (from.launched) io_altKF.restore(from.savedUs, from.altM, from.velocity, io_clock.micros());
+  if (from.launched) { io_history.freeze(); io_history.markDrained(); }
+  time_synced = from.timeSynced;
+  io_wallOffsetUs = from.wallUs - int64_t(from.savedUs);
+  flag_launched = from.launched; flag_apogee = from.apogee; flag_landed = from.landed;
+  io_launchLogged = from.logged & GR_RESUME_LOGGED_LAUNCH; io_apogeeLogged = from.logged & GR_RESUME_LOGGED_APOGEE;
+  io_landedLogged = from.logged & GR_RESUME_LOGGED_LANDED;
+  flag_armed = 1;
+  GR_FlightPhase::Inputs phaseIn = {true, bool(from.launched), bool(from.apogee), bool(from.landed), 0};
+  io_phase.restore(io_clock.micros(), phaseIn);
+  io_phaseSettings = &io_phase.settings();
+  io_resumeCount = from.resumes + 1;
+  io_resumeSeq = from.seq;
+}
+
+void io_saveResume() {
+  GR_ResumeState s;
+  GR_Resume::clear(s);
+  if (flag_armed) {
+    s.armed = 1;
+    s.launched = flag_launched; s.apogee = flag_apogee; s.landed = flag_landed;
+    s.timeSynced = time_synced;
+    s.resumes = io_resumeCount;
+    s.savedUs = io_clock.micros();
+    s.wallUs = int64_t(s.savedUs) + io_wallOffsetUs;
+    s.baselineM = io_launchDetect.baselineM();
+    if (s.launched) {
+      const GR_LaunchDetect::Result& ld = io_launchDetect.result();
+      s.launchReason = ld.reason; s.launchT0Us = ld.t0Us; s.launchDetectUs = ld.detectUs;
+      s.altM = io_altKF.altitude(); s.velocity = io_altKF.velocity();
+    }
+    if (s.apogee) { s.apogeeUs = io_flightEvents.apogee().timeUs; s.apogeeM = io_flightEvents.apogee().altM; }
+    if (s.landed) { s.landedUs = io_flightEvents.landed().timeUs; s.landedM = io_flightEvents.landed().altM; }
+    if (io_logWriter.isOpen()) {
+      s.logPrealloc = uint64_t(io_logPreallocMB) << 20;
+      s.logOffset = io_logWriter.synced();
+      s.logPackBlock = io_logPacking ? GR_PACK_BLOCK : 0;
+      GR_Resume::setName(s, io_logName);
+      s.logged = (io_launchLogged && io_launchLogEnd <= s.logOffset ? GR_RESUME_LOGGED_LAUNCH : 0) |
+                 (io_apogeeLogged && io_apogeeLogEnd <= s.logOffset ? GR_RESUME_LOGGED_APOGEE : 0) |
+                 (io_landedLogged && io_landedLogEnd <= s.logOffset ? GR_RESUME_LOGGED_LANDED : 0);
+    }
+  }
+  s.seq = ++io_resumeSeq;
+  GR_Resume::seal(s);
+  io_resume[s.seq & 1] = s;
+  io_resumeTimer = millis();
+}
+
+#include "../FlightFuncs.h"
+
+io_SampleHandler io_sampleHandler;
+
+// What native/main.cpp drives it with -----------------------------------------------------------------------------------------------
+
+/// @brief Back to how it was at power on
+template <typename T>
+static void sim_wipe(T& x) {
+  x.~T();
+  new (&x) T();
+}
+
+/// @brief Power on (again, after a reset): everything in RAM back to how it was at boot, the history's PSRAM attached, the defaults
+///        loaded. io_resume, io_clock and the card carry on
+void sim_powerOn() {
+  sim_wipe(io_sampleHandler);
+  sim_wipe(dat_accel); sim_wipe(dat_baro); sim_wipe(dat_battRaw);
+  sim_wipe(io_launchDetect); sim_wipe(io_altKF); sim_wipe(io_flightEvents);
+  sim_wipe(io_phase); sim_wipe(io_rawDecimator);
+  sim_wipe(io_sampleRing); sim_wipe(io_rawRing); sim_wipe(io_history);
+  sim_wipe(io_logPacker);
+  io_logWriter.~LogWriter();
+  new (&io_logWriter) LogWriter(io_sdDevice, io_clock);
+  io_history.attach(io_historyMem, io_historyRecords);
+  io_phaseSettings = &io_phase.settings();
+  flag_armed = flag_launched = flag_apogee = flag_landed = 0;
+  io_launchLogged = io_apogeeLogged = io_landedLogged = 0;
+  io_launchLogEnd = io_apogeeLogEnd = io_landedLogEnd = 0;
+  io_historyFlushed = 0;
+  io_sampleRingOverflows = io_rawRingOverflows = 0;
+  io_logPacking = 0;
+  io_logName[0] = 0;
+  io_resumeSeq = 0; io_resumeCount = 0; io_resumeTimer = 0;
+  time_synced = 0;
+  io_wallOffsetUs = 0;
+  wi_latestSample = {};
+  cal_accelCalMode = cal_accelCalStarted = 0;
+  sim_armedUs = sim_resumedUs = sim_shutdownUs = 0;
+  io_config.setDefaults();
+}
+
+/// @brief Load the config from NVS (setup()'s routine, same namespace + blob)
+GR_Config::LoadStats sim_loadConfig(GR_Prefs& prefs) {
+  prefs.begin("config");
+  return io_config.load(prefs);
+}
+
+/// @brief wi_armForLaunch(): open the log and arm
+bool sim_arm(const char * name) {
+  if (flag_armed || !io_startLog(name)) return false;
+  io_logEvent(GR_EVT_ARMED);
+  flag_launched = false; flag_apogee = false; flag_landed = false;
+  flag_armed = true;
+  sim_armedUs = io_clock.micros();
+  io_saveResume();
+  debugMsg("[EVENT]: Logger is armed for launch!");
+  return true;
+}
+
+/// @brief setup() after a reset mid-flight (after io_applyConfig()): io_restoreFlight() then io_resumeLog()
+/// @return false if there's no log open at all
+bool sim_resume(const GR_ResumeState& from, int32_t resetReason, float bootMs) {
+  io_restoreFlight(from);
+  sim_resumedUs = io_clock.micros();
+  return io_resumeLog(from, resetReason, bootMs);
+}
+
+/// @brief wi_serverTask's turn: io_drainSamples(), noting when it shut down
+void sim_drain() {
+  io_drainSamples();
+  if (!sim_shutdownUs && io_phase.phase() == GR_PHASE_SHUTDOWN) sim_shutdownUs = io_clock.micros();
+}
+
+bool sim_shutDown() { return sim_shutdownUs != 0; }
+
+/// @brief What this boot's pipeline decided, off the flags + detectors (a resumed flight's come back with io_restoreFlight())
+SimDecisions sim_decisions() {
+  SimDecisions d = {};
+  d.armedUs = sim_armedUs;
+  if (flag_launched) {
+    const GR_LaunchDetect::Result& ld = io_launchDetect.result();
+    d.t0Us = ld.t0Us; d.launchUs = ld.detectUs; d.launchReason = ld.reason;
+  }
+  if (flag_apogee) {
+    d.apogeeUs = io_flightEvents.apogee().timeUs;
+    d.apogeeM = io_flightEvents.apogee().altM - io_launchDetect.baselineM();
+  }
+  if (flag_landed) d.landedUs = io_flightEvents.landed().timeUs;
+  d.shutdownUs = sim_shutdownUs;
+  d.resumedUs = sim_resumedUs;
+  return d;
+}
@@ -0,0 +1,316 @@
+/* HttpServer_Posix.h
+    Non-blocking poll() HTTP server for the native build and tools/GraphiteHttpLoad: serves a GR_HttpRouter over real sockets on
+    the dev box, so the routing / handlers / keep-alive behaviour can be tested with a browser, curl or a load generator.
+
+    Same model as esp_http_server on the logger: one thread, every connection non-blocking, handlers run one at a time. Responses
+    are built in a per-connection buffer and written out as the socket takes them, so a slow (or stalled) client only ever holds
+    up itself. Call poll() in a loop.
+
+    Server push works like it does on the logger: a handler's res.stream() keeps the connection, push() appends to it (between
+    poll()s, on the same thread), a client more than POSIX_HTTP_MAX_BACKLOG behind gets disconnected, and onClose() hears about
+    every connection that goes away.
+
+    A handler can also detach() its connection (long downloads, see GR_LogDownload.h): anything still queued for it is written out
+    first, then the socket is handed over in blocking mode and the server forgets it (no onClose()). Whoever took it writes the
+    whole response and release()s it.
+*/
+#pragma once
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <GR_Http.h>
+
+#define POSIX_HTTP_IDLE_MS 10000  // Connections with nothing going on for this long get closed (a half-sent request counts as nothing)
+#define POSIX_HTTP_MAX_BACKLOG 16384 // Unsent bytes a stream can build up before its client counts as stuck (the logger's socket buffer is ~5.7KB)
+
+class Posix_HttpServer {
+  public:
+    struct Stats {
+      uint64_t accepted = 0;    // Connections accepted
+      uint64_t rejected = 0;    // Connections turned away (503) because maxClients were already open
+      uint64_t requests = 0;    // Requests answered (including errors)
+      uint64_t badRequests = 0; // Requests the parser refused (4xx before reaching the router)
+      uint64_t timeouts = 0;    // Connections closed for being idle
+      uint32_t maxOpen = 0;     // Most connections open at once
+    };
+
+    Posix_HttpServer(const GR_HttpRouter& router, size_t maxClients = 8) : router_(router), maxClients_(maxClients) {}
+    ~Posix_HttpServer() { end(); }
+
+    /// @param port 0 picks a free one (see port())
+    /// @param loopbackOnly listen on 127.0.0.1 only (else every interface, e.g. to try it from a phone on the same network)
+    bool begin(uint16_t port, bool loopbackOnly = true) {
+      signal(SIGPIPE, SIG_IGN); // A client hanging up mid-response is normal, not a reason to die
+      listen_ = socket(AF_INET, SOCK_STREAM, 0);
+      if (listen_ < 0) return false;
+      int one = 1;
+      setsockopt(listen_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+      sockaddr_in addr = {};
+      addr.sin_family = AF_INET;
+      addr.sin_port = htons(port);
+      addr.sin_addr.s_addr = htonl(loopbackOnly ? INADDR_LOOPBACK : INADDR_ANY);
+      socklen_t addrLen = sizeof(addr);
+      if (bind(listen_, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(listen_, 64) != 0 ||
+          getsockname(listen_, (sockaddr *)&addr, &addrLen) != 0) {
+        end();
+        return false;
+      }
+      port_ = ntohs(addr.sin_port);
+      fcntl(listen_, F_SETFL, O_NONBLOCK);
+      return true;
+    }
+
+    void end() {
+      while (!conns_.empty()) close(conns_.size() - 1);
+      if (listen_ >= 0) ::close(listen_);
+      listen_ = -1;
+    }
+
+    /// @brief One turn of the event loop: accept, read, answer complete requests, write what the sockets will take
+    /// @param timeoutMs how long to wait for something to happen
+    void poll(int timeoutMs) {
+      std::vector<pollfd> fds;
+      fds.push_back({listen_, POLLIN, 0});
+      for (auto& c : conns_) fds.push_back({c.fd, short(c.out.size() > c.outPos ? POLLOUT : POLLIN), 0});
+      if (::poll(fds.data(), fds.size(), timeoutMs) < 0) return;
+
+      uint64_t now = nowMs();
+      for (size_t i = conns_.size(); i-- > 0; ) {
+        Conn& c = conns_[i];
+        short ev = fds[i + 1].revents;
+        bool ok = true;
+        if (ev & (POLLERR | POLLNVAL)) ok = false;
+        else if (ev & POLLIN) ok = readFrom(c, now);
+        else if (ev & POLLHUP) ok = false;
+        if (ok && c.out.size() > c.outPos) ok = writeTo(c, now);
+        if (ok && c.closing && c.out.size() == c.outPos) ok = false;
+        if (ok && !c.streaming && now - c.lastMs > POSIX_HTTP_IDLE_MS) { stats_.timeouts++; ok = false; }
+        if (!ok) close(i);
+      }
+      if (fds[0].revents & POLLIN) acceptAll(now);
+    }
+
+    uint16_t port() const { return port_; }
+    size_t openConnections() const { return conns_.size(); }
+    const Stats& stats() const { return stats_; }
+
+    /// @brief Called whenever a connection closes, so streams can be forgotten
+    void onClose(void (*fn)(int id)) { onClose_ = fn; }
+
+    /// @brief Add to a stream() response
+    /// @return false if id isn't an open stream, or its client is too far behind (it gets closed)
+    bool push(int id, const char * data, size_t len) {
+      for (auto& c : conns_) {
+        if (c.fd != id) continue;
+        if (!c.streaming || c.closing) return false;
+        if (c.out.size() - c.outPos + len > POSIX_HTTP_MAX_BACKLOG) {
+          c.out.clear(); // Throw away the backlog, next poll() closes it
+          c.outPos = 0;
+          c.closing = true;
+          return false;
+        }
+        c.out.append(data, len);
+        return true;
+      }
+      return false;
+    }
+
+    /// @brief Done with a detach()ed socket (from any thread)
+    void release(int id) { ::close(id); }
+
+  private:
+    struct Conn {
+      int fd;
+      GR_HttpParser * parser;  // Heap: ~2KB each, and Conns get moved around in the vector
+      std::string out;
+      size_t outPos = 0;
+      bool closing = false;    // Close once out has been written
+      bool streaming = false;  // Answered with stream(): push() adds to it, and it's never idle
+      bool detached = false;   // Handed over with detach(): not ours any more
+      uint64_t lastMs;
+    };
+
+    /// @brief Builds the response straight into the connection's output buffer
+    class Response : public GR_HttpResponse {
+      public:
+        Response(std::string& out, bool keepAlive, Conn * conn = nullptr) : out_(out), conn_(conn), keepAlive_(keepAlive) {}
+        using GR_HttpResponse::send;
+        void header(const char * name, const char * value) override {
+          headers_ += name;
+          headers_ += ": ";
+          headers_ += value;
+          headers_ += "\r\n";
+        }
+        bool send(int status, const char * type, const char * body, size_t len) override {
+          if (started_) return false;
+          char cl[32];
+          snprintf(cl, sizeof(cl), "%zu", len);
+          header("Content-Length", cl);
+          head(status, type);
+          out_.append(body, len);
+          return true;
+        }
+        bool begin(int status, const char * type) override {
+          if (started_) return false;
+          header("Transfer-Encoding", "chunked");
+          head(status, type);
+          chunked_ = true;
+          return true;
+        }
+        bool write(const void * data, size_t len) override {
+          if (!chunked_ || !len) return chunked_;
+          char size[24];
+          snprintf(size, sizeof(size), "%zx\r\n", len);
+          out_ += size;
+          out_.append((const char *)data, len);
+          out_ += "\r\n";
+          return true;
+        }
+        bool end() override {
+          if (!chunked_) return false;
+          out_ += "0\r\n\r\n";
+          chunked_ = false;
+          return true;
+        }
+        int stream(int status, const char * type) override {
+          if (started_ || !conn_) return -1;
+          header("Cache-Control", "no-store");
+          keepAlive_ = true;
+          head(status, type);
+          streaming_ = true;
+          return conn_->fd;
+        }
+        int detach() override {
+          if (started_ || !conn_) return -1;
+          // Earlier (pipelined) responses go first, or they'd be lost / end up after the new owner's
+          int fd = conn_->fd;
+          fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+          while (conn_->out.size() > conn_->outPos) {
+            ssize_t n = ::send(fd, conn_->out.data() + conn_->outPos, conn_->out.size() - conn_->outPos, 0);
+            if (n <= 0) break; // It's gone; the new owner finds out when it writes
+            conn_->outPos += size_t(n);
+          }
+          conn_->out.clear();
+          conn_->outPos = 0;
+          conn_->detached = true;
+          started_ = true;
+          return fd;
+        }
+        bool streaming() const { return streaming_; }
+        bool detached() const { return conn_ && conn_->detached; }
+      private:
+        void head(int status, const char * type) {
+          started_ = true;
+          out_ += "HTTP/1.1 ";
+          out_ += GR_Http::status(status);
+          out_ += "\r\nContent-Type: ";
+          out_ += type;
+          out_ += keepAlive_ ? "\r\nConnection: keep-alive\r\n" : "\r\nConnection: close\r\n";
+          out_ += headers_;
+          out_ += "\r\n";
+        }
+        std::string& out_;
+        std::string headers_;
+        Conn * conn_;
+        bool keepAlive_, chunked_ = false, streaming_ = false;
+    };
+
+    static uint64_t nowMs() {
+      return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void acceptAll(uint64_t now) {
+      for (;;) {
+        int fd = accept(listen_, nullptr, nullptr);
+        if (fd < 0) return;
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (conns_.size() >= maxClients_) {
+          static const char busy[] = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+          if (::send(fd, busy, sizeof(busy) - 1, 0) < 0) {} // Best effort; it's going away either way
+          ::close(fd);
+          stats_.rejected++;
+          continue;
+        }
+        Conn c;
+        c.fd = fd;
+        c.parser = new GR_HttpParser();
+        c.lastMs = now;
+        conns_.push_back(std::move(c));
+        stats_.accepted++;
+        if (conns_.size() > stats_.maxOpen) stats_.maxOpen = uint32_t(conns_.size());
+      }
+    }
+
+    bool readFrom(Conn& c, uint64_t now) {
+      if (c.closing || c.streaming) { // Ignore anything after a Connection: close, or on a stream
+        char junk[256];
+        ssize_t n = recv(c.fd, junk, sizeof(junk), 0);
+        return n > 0 || (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR));
+      }
+      ssize_t n = recv(c.fd, c.parser->space(), c.parser->spaceLeft(), 0);
+      if (n == 0) return false;
+      if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+      c.parser->commit(size_t(n));
+      c.lastMs = now;
+      // Answer everything that's complete (several if the client pipelines)
+      for (;;) {
+        GR_HttpParser::Result r = c.parser->parse();
+        if (r == GR_HttpParser::NeedMore) break;
+        stats_.requests++;
+        if (r == GR_HttpParser::Failed) {
+          stats_.badRequests++;
+          Response res(c.out, false);
+          res.send(c.parser->errorStatus(), "text/plain", GR_Http::status(c.parser->errorStatus()));
+          c.closing = true;
+          break;
+        }
+        bool keepAlive = c.parser->keepAlive();
+        Response res(c.out, keepAlive, &c);
+        router_.dispatch(c.parser->request(), res);
+        c.parser->next();
+        if (res.detached()) return false; // close() lets it go without closing the socket
+        if (res.streaming()) { c.streaming = true; break; } // Nothing after this is a request
+        if (!keepAlive) { c.closing = true; break; }
+      }
+      return true;
+    }
+
+    bool writeTo(Conn& c, uint64_t now) {
+      ssize_t n = ::send(c.fd, c.out.data() + c.outPos, c.out.size() - c.outPos, 0);
+      if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+      c.outPos += size_t(n);
+      c.lastMs = now;
+      if (c.outPos == c.out.size()) { c.out.clear(); c.outPos = 0; }
+      return true;
+    }
+
+    void close(size_t i) {
+      if (!conns_[i].detached) {
+        if (onClose_) onClose_(conns_[i].fd);
+        ::close(conns_[i].fd);
+      }
+      delete conns_[i].parser;
+      conns_.erase(conns_.begin() + i);
+    }
+
+    const GR_HttpRouter& router_;
+    size_t maxClients_;
+    int listen_ = -1;
+    uint16_t port_ = 0;
+    std::vector<Conn> conns_;
+    Stats stats_;
+    void (*onClose_)(int id) = nullptr;
+};
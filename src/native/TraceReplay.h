@@ -0,0 +1,423 @@
+/* TraceReplay.h
+    Flight traces for the native build, played back through the same GR_SensorHAL interfaces the real sensors implement, so the sampler,
+    the detectors and the logger see a flight the way they would on the pad.
+
+    FlightTrace::load() reads a flight log (.grl, as written by the logger, packed or not) or a CSV: GraphiteLogDecode's output works as-is, and so does
+    anything with a time_s column plus some of xAccelRaw / yAccelRaw / zAccelRaw (or xAccelG...), pressPa + tempC (or altM / altFt, turned
+    back into pressure with the calibration values) and battRaw. Missing axes read as 0g. Flight logs hold the logger's background rate
+    averages up to the launch and full rate records from 5 sec before it, so where the two overlap only the full rate ones are kept.
+    Events in the trace (a log's launch / apogee / landing) are kept too, as something to compare the replay's decisions with, and so
+    are the settings the flight was flown with (a log's config records), so it can be replayed with the same thresholds.
+
+    FlightTrace::synthesize() flies a made up flight instead (pad, boost, coast, drogue, main, ground) at the logger's sensor rates with
+    sensor noise, and keeps the true ignition / apogee / touchdown times.
+
+    Trace time 0 plays at whatever clock time the sensors are given. Once the trace runs out the sensors keep repeating its last sample
+    at its last rate (the rocket lying in the field), so landing detection still gets its quiet stretch.
+*/
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <vector>
+#include <GR_SensorHAL.h>
+#include <GR_SampleRecord.h>
+#include <GR_FlightLog.h>
+#include <GR_LogPack.h>
+
+// Synthetic flight (roughly the Pencil Pusher; same noise levels as tools/GraphiteLaunchReplay + GraphiteKalmanBench)
+#define TRACE_ACCEL_US 1000       // Filtered accelerometer rate (1kHz)
+#define TRACE_BARO_US 15625       // DPS310 rate (64Hz)
+#define TRACE_BATT_US 1000        // Battery rides along with the accelerometer
+#define TRACE_PAD_S 10.0          // Time on the pad before ignition
+#define TRACE_GROUND_S 20.0       // Time in the field after touchdown
+#define TRACE_PAD_ALT_M 150.0     // Pad elevation (m above sea level)
+#define TRACE_BOOST_G 8.0         // Thrust / weight
+#define TRACE_BURN_S 1.8          // Motor burn time
+#define TRACE_DRAG_K 0.0012       // Coast drag deceleration = k v^2 (m^-1)
+#define TRACE_DROGUE_VT 25.0      // Descent rate under drogue (m/s)
+#define TRACE_MAIN_VT 6.0         // Descent rate under main (m/s)
+#define TRACE_MAIN_ALT_M 150.0    // Main deploy height above the pad (m)
+#define TRACE_ACCEL_NOISE_G 0.3f  // 1 sigma
+#define TRACE_BARO_NOISE_M 0.5f   // 1 sigma
+#define TRACE_BATT_RAW 2296       // ~3.7V
+#define TRACE_DMA_CHUNK 16        // Accelerometer samples per ADC DMA interrupt (conv_num_each_intr 256 / 4 channels / 4x decimation)
+
+/// @brief One line of a trace. flags say which fields were measured at timeUs
+struct TraceSample {
+  uint64_t timeUs;    // Since the start of the trace
+  uint8_t flags;      // GR_SAMPLE_*
+  uint16_t x, y, z;   // Raw accelerometer counts
+  float pressPa, tempC;
+  uint16_t battRaw;
+  bool fullRate;      // From a full rate record (logs only; background rate records it overlaps get dropped)
+};
+
+struct TraceEvent {
+  uint64_t timeUs;    // Since the start of the trace
+  uint16_t code;      // GR_EVT_*
+  int32_t iArg;
+  float fArg;
+};
+
+class FlightTrace {
+  public:
+    /// @brief What really happened (synthetic flights only), trace time
+    struct Truth {
+      bool known;
+      uint64_t ignitionUs, apogeeUs, landedUs;
+      float apogeeM;  // Above the pad
+    };
+
+    std::vector<TraceSample> samples;  // In time order
+    std::vector<TraceEvent> events;    // Events recorded in the trace, in time order
+    std::vector<std::pair<std::string, std::string>> settings; // Logger settings recorded in the trace (key, value as text for GR_Config::set())
+    GR_LogHeader cal;                  // Calibration the raw values go with (the log's own, or main.cpp's defaults)
+    Truth truth = {};
+    std::string error;                 // Why load() failed
+
+    FlightTrace() {
+      cal = GR_FlightLog::makeHeader(0);
+      cal.cal_pAtSea = 101325; cal.cal_lapseRate = 0.0059f; cal.cal_magicExp = 0.190266435664f;
+      cal.cal_zeroXAccel = 1984; cal.cal_zeroYAccel = 1984; cal.cal_zeroZAccel = 1992;
+      cal.cal_xAccelCoef = 0.03f; cal.cal_yAccelCoef = 0.03f; cal.cal_zAccelCoef = 0.029f;
+    }
+
+    uint64_t durationUs() const { return samples.empty() ? 0 : samples.back().timeUs; }
+    size_t count(uint8_t flag) const {
+      size_t n = 0;
+      for (const TraceSample& s : samples) n += (s.flags & flag) != 0;
+      return n;
+    }
+
+    /// @brief Load a .grl flight log or a CSV (anything that doesn't start with the log magic)
+    bool load(const char * path) {
+      samples.clear(); events.clear(); truth = Truth(); error.clear();
+      FILE * f = fopen(path, "rb");
+      if (!f) { error = "can't open it"; return false; }
+      char magic[4] = {};
+      bool isLog = fread(magic, 1, 4, f) == 4 && memcmp(magic, GR_LOG_MAGIC, 4) == 0;
+      rewind(f);
+      bool ok = isLog ? loadLog(f) : loadCsv(f);
+      fclose(f);
+      if (ok && samples.empty()) { error = "no sensor samples in it"; ok = false; }
+      if (ok) finish();
+      return ok;
+    }
+
+    /// @brief Fly a synthetic flight (see the TRACE_ defines). Same seed, same flight
+    void synthesize(uint32_t seed = 1) {
+      samples.clear(); events.clear(); error.clear();
+      rng_ = 0x9E3779B97F4A7C15ull ^ (uint64_t(seed) << 17);
+      double h = 0, v = 0; // Above the pad
+      bool pastApogee = false, landed = false;
+      truth = {true, uint64_t(TRACE_PAD_S * 1e6), 0, 0, 0};
+      uint64_t endUs = UINT64_MAX;
+      for (uint64_t us = 0; us <= endUs; us += TRACE_ACCEL_US) {
+        double dt = TRACE_ACCEL_US / 1e6, f = GR_GRAVITY; // f = specific force along the up axis (what the accelerometer reads)
+        if (us >= truth.ignitionUs && !landed) {
+          double tb = (us - truth.ignitionUs) / 1e6;
+          double thrust = tb < TRACE_BURN_S ? TRACE_BOOST_G * GR_GRAVITY : 0, drag;
+          if (!pastApogee) {
+            drag = -TRACE_DRAG_K * v * fabs(v);
+          } else { // Under chutes: drag pulls toward the descent rate
+            double vt = h > TRACE_MAIN_ALT_M ? TRACE_DROGUE_VT : TRACE_MAIN_VT;
+            drag = GR_GRAVITY * v * v / (vt * vt);
+          }
+          f = thrust + drag;
+          v += (f - GR_GRAVITY) * dt;
+          h += v * dt;
+          if (!pastApogee && tb > TRACE_BURN_S && v <= 0) { pastApogee = true; truth.apogeeUs = us; truth.apogeeM = float(h); }
+          if (pastApogee && h <= 0) {
+            h = 0; v = 0; f = GR_GRAVITY; landed = true;
+            truth.landedUs = us;
+            endUs = us + uint64_t(TRACE_GROUND_S * 1e6);
+          }
+        }
+        TraceSample s = {};
+        s.timeUs = us;
+        s.fullRate = true;
+        s.flags = GR_SAMPLE_ACCEL;
+        s.x = raw(cal.cal_zeroXAccel, cal.cal_xAccelCoef, gauss() * TRACE_ACCEL_NOISE_G);
+        s.y = raw(cal.cal_zeroYAccel, cal.cal_yAccelCoef, gauss() * TRACE_ACCEL_NOISE_G);
+        s.z = raw(cal.cal_zeroZAccel, cal.cal_zAccelCoef, float(f / GR_GRAVITY) + gauss() * TRACE_ACCEL_NOISE_G);
+        if (us % TRACE_BARO_US < TRACE_ACCEL_US) {
+          s.flags |= GR_SAMPLE_BARO;
+          double altM = TRACE_PAD_ALT_M + h;
+          s.tempC = float(15 - 0.0065 * altM);
+          s.pressPa = pressureAt(altM + gauss() * TRACE_BARO_NOISE_M, s.tempC);
+        }
+        if (us % TRACE_BATT_US < TRACE_ACCEL_US) {
+          s.flags |= GR_SAMPLE_BATT;
+          s.battRaw = uint16_t(TRACE_BATT_RAW + int(gauss() * 2));
+        }
+        samples.push_back(s);
+      }
+    }
+
+    /// @brief Pressure the logger's altitude formula (with this trace's cal values) turns back into altM
+    float pressureAt(double altM, float tempC) const {
+      return float(cal.cal_pAtSea / pow(1 + altM * cal.cal_lapseRate / (tempC + 273.15), 1.0 / cal.cal_magicExp));
+    }
+
+  private:
+    bool loadLog(FILE * f) {
+      GR_LogHeader h;
+      if (fread(&h, sizeof(h), 1, f) != 1 || !GR_FlightLog::checkHeader(h)) { error = "not a log version this build can read"; return false; }
+      cal = h;
+      fseek(f, long(GR_LogPack::dataStart(h)), SEEK_SET);
+      std::vector<uint8_t> buf(GR_LogPack::unitBytes(h));
+      GR_LogUnpacker unit;
+      GR_LogRecord r;
+      bool fullRate = false;
+      while (fread(buf.data(), buf.size(), 1, f) == 1) {
+        if (unit.begin(h, buf.data())) while (unit.next(r)) addRecord(r, fullRate);
+      }
+      return true;
+    }
+
+    /// @brief One of a log's records (fullRate: seen the history marker yet)
+    void addRecord(const GR_LogRecord& r, bool& fullRate) {
+      if (r.type == GR_REC_EVENT) {
+        if (r.event.code == GR_EVT_HISTORY) fullRate = true; // Everything after this is one record per accelerometer sample
+        events.push_back({r.timeUs, r.event.code, r.event.iArg, r.event.fArg});
+      } else if (r.type == GR_REC_CONFIG) {
+        char key[sizeof(r.config.key) + 1], value[32];
+        GR_FlightLog::configKey(r, key);
+        if (r.config.isFloat) snprintf(value, sizeof(value), "%.9g", r.config.fValue);
+        else snprintf(value, sizeof(value), "%d", r.config.iValue);
+        settings.push_back({key, value});
+      } else if (r.type == GR_REC_SAMPLE && (r.flags & (GR_SAMPLE_ACCEL | GR_SAMPLE_BARO | GR_SAMPLE_BATT))) {
+        samples.push_back({r.timeUs, r.flags, r.sample.xAccel, r.sample.yAccel, r.sample.zAccel, r.sample.pressPa, r.sample.tempC,
+                           r.sample.battRaw, fullRate});
+      }
+    }
+
+    bool loadCsv(FILE * f) {
+      char line[1024];
+      std::vector<std::string> names;
+      while (names.empty() && fgets(line, sizeof(line), f)) {
+        if (line[0] != '#' && line[0] != '\n' && line[0] != '\r') names = split(line);
+      }
+      int cTime = column(names, "time_s"), cType = column(names, "type"), cEvent = column(names, "event"), cArg = column(names, "eventArg");
+      int cRaw[3] = {column(names, "xAccelRaw"), column(names, "yAccelRaw"), column(names, "zAccelRaw")};
+      int cG[3] = {column(names, "xAccelG"), column(names, "yAccelG"), column(names, "zAccelG")};
+      int cPress = column(names, "pressPa"), cTemp = column(names, "tempC"), cAltM = column(names, "altM"), cAltFt = column(names, "altFt");
+      int cBatt = column(names, "battRaw");
+      if (cTime < 0) { error = "not a flight log, and not a CSV with a time_s column"; return false; }
+      const int16_t zero[3] = {cal.cal_zeroXAccel, cal.cal_zeroYAccel, cal.cal_zeroZAccel};
+      const float coef[3] = {cal.cal_xAccelCoef, cal.cal_yAccelCoef, cal.cal_zAccelCoef};
+      bool fullRate = false;
+      while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#') continue;
+        std::vector<std::string> v = split(line);
+        std::string t = field(v, cTime);
+        if (t.empty() || t[0] == '-') continue;
+        uint64_t timeUs = uint64_t(llround(strtod(t.c_str(), NULL) * 1e6));
+        if (field(v, cType) == "event") {
+          std::string name = field(v, cEvent);
+          for (uint16_t code = 1; code <= GR_EVT_WALL_CLOCK; code++) {
+            if (name != GR_FlightLog::eventName(code)) continue;
+            if (code == GR_EVT_HISTORY) fullRate = true;
+            events.push_back({timeUs, code, int32_t(strtol(field(v, cArg).c_str(), NULL, 10)), 0});
+          }
+          continue;
+        }
+        if (field(v, cType) == "config") {
+          settings.push_back({field(v, cEvent), field(v, cArg)});
+          continue;
+        }
+        TraceSample s = {};
+        s.timeUs = timeUs;
+        s.fullRate = fullRate;
+        uint16_t * axes[3] = {&s.x, &s.y, &s.z};
+        bool anyAxis = false;
+        for (int i = 0; i < 3; i++) {
+          std::string raw = field(v, cRaw[i]), g = field(v, cG[i]);
+          *axes[i] = uint16_t(zero[i]);
+          if (!raw.empty()) *axes[i] = uint16_t(atoi(raw.c_str()));
+          else if (!g.empty()) *axes[i] = this->raw(zero[i], coef[i], strtof(g.c_str(), NULL));
+          else continue;
+          anyAxis = true;
+        }
+        if (anyAxis) s.flags |= GR_SAMPLE_ACCEL;
+        std::string press = field(v, cPress), temp = field(v, cTemp), altM = field(v, cAltM), altFt = field(v, cAltFt);
+        s.tempC = temp.empty() ? 15.0f : strtof(temp.c_str(), NULL);
+        if (!press.empty()) s.pressPa = strtof(press.c_str(), NULL);
+        else if (!altM.empty()) s.pressPa = pressureAt(strtod(altM.c_str(), NULL), s.tempC);
+        else if (!altFt.empty()) s.pressPa = pressureAt(strtod(altFt.c_str(), NULL) / GR_FT_PER_M, s.tempC);
+        if (s.pressPa > 0) s.flags |= GR_SAMPLE_BARO;
+        std::string batt = field(v, cBatt);
+        if (!batt.empty()) { s.battRaw = uint16_t(atoi(batt.c_str())); s.flags |= GR_SAMPLE_BATT; }
+        if (s.flags) samples.push_back(s);
+      }
+      return true;
+    }
+
+    /// @brief Drop background rate records the full rate ones cover, put everything in time order, start the trace at 0
+    void finish() {
+      uint64_t fullFrom = UINT64_MAX;
+      for (const TraceSample& s : samples) if (s.fullRate && s.timeUs < fullFrom) fullFrom = s.timeUs;
+      samples.erase(std::remove_if(samples.begin(), samples.end(), [&](const TraceSample& s) { return !s.fullRate && s.timeUs >= fullFrom; }),
+                    samples.end());
+      std::stable_sort(samples.begin(), samples.end(), [](const TraceSample& a, const TraceSample& b) { return a.timeUs < b.timeUs; });
+      std::stable_sort(events.begin(), events.end(), [](const TraceEvent& a, const TraceEvent& b) { return a.timeUs < b.timeUs; });
+      uint64_t base = samples.front().timeUs;
+      for (TraceSample& s : samples) s.timeUs -= base;
+      for (TraceEvent& e : events) e.timeUs = e.timeUs > base ? e.timeUs - base : 0;
+    }
+
+    uint16_t raw(int16_t zero, float coef, float g) const {
+      long r = lroundf(zero + g / coef);
+      return uint16_t(r < 0 ? 0 : r > 4095 ? 4095 : r); // 12 bit ADC
+    }
+
+    static std::vector<std::string> split(const char * line) {
+      std::vector<std::string> out(1);
+      for (const char * p = line; *p && *p != '\n' && *p != '\r'; p++) {
+        if (*p == ',') out.emplace_back();
+        else if (*p != ' ' && *p != '"') out.back() += *p;
+      }
+      return out;
+    }
+    static int column(const std::vector<std::string>& names, const char * name) {
+      for (size_t i = 0; i < names.size(); i++) if (names[i] == name) return int(i);
+      return -1;
+    }
+    static std::string field(const std::vector<std::string>& v, int i) { return i >= 0 && size_t(i) < v.size() ? v[i] : std::string(); }
+
+    float gauss() { return sqrtf(-2 * logf(uniform())) * cosf(6.2831853f * uniform()); }
+    float uniform() {
+      rng_ ^= rng_ << 13; rng_ ^= rng_ >> 7; rng_ ^= rng_ << 17;
+      return (uint32_t(rng_ >> 32) + 0.5f) / 4294967296.0f;
+    }
+    uint64_t rng_ = 0x9E3779B97F4A7C15ull;
+};
+
+/// @brief Walks one kind of sample (flag) through a trace in time order
+class TraceCursor {
+  public:
+    TraceCursor(const FlightTrace& trace, uint8_t flag) : trace_(trace), flag_(flag) {
+      // Repeat rate once the trace runs out: the spacing of its last few samples of this kind
+      const std::vector<TraceSample>& s = trace.samples;
+      size_t n = 0, last = 0, first = 0;
+      for (size_t i = s.size(); i-- > 0 && n < 100;) if (s[i].flags & flag) { if (!n++) last = i; first = i; }
+      holdUs_ = n > 1 ? (s[last].timeUs - s[first].timeUs) / (n - 1) : 0;
+      if (holdUs_ == 0) holdUs_ = TRACE_ACCEL_US;
+      skip();
+    }
+
+    /// @brief Next sample of this kind due at or before traceUs (then moves past it); NULL if there isn't one yet
+    const TraceSample * next(uint64_t traceUs) {
+      const std::vector<TraceSample>& s = trace_.samples;
+      if (i_ < s.size()) {
+        if (s[i_].timeUs > traceUs) return NULL;
+        latest_ = &s[i_++];
+        lastUs_ = latest_->timeUs;
+        skip();
+        return latest_;
+      }
+      if (!latest_ || lastUs_ + holdUs_ > traceUs) return NULL; // Ran out: the last sample again, at the same rate
+      lastUs_ += holdUs_;
+      return latest_;
+    }
+
+    /// @brief Skip to the newest sample due at or before traceUs
+    const TraceSample * newest(uint64_t traceUs) {
+      while (next(traceUs)) {}
+      return latest_;
+    }
+
+    bool due(uint64_t traceUs) const {
+      if (i_ < trace_.samples.size()) return trace_.samples[i_].timeUs <= traceUs;
+      return latest_ && lastUs_ + holdUs_ <= traceUs;
+    }
+    const TraceSample * latest() const { return latest_; }
+    /// @brief Trace time of the sample next() / newest() last handed over (its repeats once the trace has run out move on with them)
+    uint64_t latestUs() const { return lastUs_; }
+
+  private:
+    void skip() { while (i_ < trace_.samples.size() && !(trace_.samples[i_].flags & flag_)) i_++; }
+
+    const FlightTrace& trace_;
+    uint8_t flag_;
+    size_t i_ = 0;
+    const TraceSample * latest_ = NULL;
+    uint64_t lastUs_ = 0, holdUs_ = 0;
+};
+
+/// @brief Trace time for a clock: trace time 0 is clock time startUs
+class TraceTime {
+  public:
+    TraceTime(GR_Clock& clock, uint64_t startUs) : clock_(clock), startUs_(startUs) {}
+    uint64_t now() { uint64_t t = clock_.micros(); return t > startUs_ ? t - startUs_ : 0; }
+    uint64_t toClock(uint64_t traceUs) const { return traceUs + startUs_; }
+    uint64_t fromClock(uint64_t clockUs) const { return clockUs > startUs_ ? clockUs - startUs_ : 0; }
+  private:
+    GR_Clock& clock_;
+    uint64_t startUs_;
+};
+
+/// @brief The ADXL377 as a streaming sensor (like ESP_AccelDMA): readBuffered() hands over the trace samples that have come due, stamped
+///        with their trace time, a DMA chunk at a time (so they turn up late and in bursts, the way they do on the logger)
+class ReplayAccel : public GR_AccelSensor {
+  public:
+    size_t chunk = TRACE_DMA_CHUNK;  // Samples per hand over (1 = each one as soon as it's due)
+
+    ReplayAccel(const FlightTrace& trace, TraceTime& time) : cursor_(trace, GR_SAMPLE_ACCEL), time_(time), zero_{trace.cal.cal_zeroXAccel,
+                trace.cal.cal_zeroYAccel, trace.cal.cal_zeroZAccel} {}
+    void read(int& x, int& y, int& z) override {
+      const TraceSample * s = cursor_.newest(time_.now());
+      x = s ? s->x : zero_[0]; y = s ? s->y : zero_[1]; z = s ? s->z : zero_[2];
+    }
+    size_t readBuffered(GR_AccelTriple * out, size_t max) override {
+      uint64_t now = time_.now();
+      const TraceSample * s;
+      while ((s = cursor_.next(now)) != NULL) pending_.push_back({s->x, s->y, s->z, time_.toClock(cursor_.latestUs())});
+      size_t ready = chunk > 1 ? pending_.size() - pending_.size() % chunk : pending_.size();
+      size_t n = std::min(ready, max);
+      std::copy(pending_.begin(), pending_.begin() + n, out);
+      pending_.erase(pending_.begin(), pending_.begin() + n);
+      return n;
+    }
+  private:
+    std::deque<GR_AccelTriple> pending_;  // Due, but their chunk isn't finished yet
+    TraceCursor cursor_;
+    TraceTime& time_;
+    int zero_[3];
+};
+
+/// @brief The DPS310: available() once a new measurement has come due, read() gets the newest (older ones are gone, like the real one)
+class ReplayBaro : public GR_BaroSensor {
+  public:
+    ReplayBaro(const FlightTrace& trace, TraceTime& time) : cursor_(trace, GR_SAMPLE_BARO), time_(time) {}
+    bool available() override { return cursor_.due(time_.now()); }
+    bool read(float& tempC, float& pressPa) override {
+      const TraceSample * s = cursor_.newest(time_.now());
+      if (!s) return false;
+      tempC = s->tempC;
+      pressPa = s->pressPa;
+      return true;
+    }
+    uint64_t sampleUs() override { return time_.toClock(cursor_.latestUs()); }
+  private:
+    TraceCursor cursor_;
+    TraceTime& time_;
+};
+
+class ReplayBatt : public GR_BattSensor {
+  public:
+    ReplayBatt(const FlightTrace& trace, TraceTime& time) : cursor_(trace, GR_SAMPLE_BATT), time_(time) {}
+    int readRaw() override {
+      const TraceSample * s = cursor_.newest(time_.now());
+      return s ? s->battRaw : 0;
+    }
+    uint64_t sampleUs() override { return cursor_.latest() ? time_.toClock(cursor_.latestUs()) : 0; }
+  private:
+    TraceCursor cursor_;
+    TraceTime& time_;
+};
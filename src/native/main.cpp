@@ -0,0 +1,466 @@
+/* Native (Linux) build entry point
+    Build with:  pio run -e native
+
+    Sampler check:  .pio/build/native/program [seconds] [--realtime] [--speed N] [--log] [--slowcard] [--load us]
+    Runs the sampling scheduler (GR_Sampler) against fake sensors so the scheduling logic can be exercised without the logger.
+    Prints how many samples of each sensor were collected vs how many we expected at the configured rates, and each channel's
+    release jitter / missed deadline histograms. Exits with 1 if any channel's release count drifted from its period.
+    --load makes every sensor callback take a random 0..us of (simulated) time, to see the scheduler cope with late releases.
+    --log writes every raw sample to a binary flight log (sim_flight.grl, decode with tools/GraphiteLogDecode) through GR_LogWriter
+    and a file-backed fake SD card, and reports the write latency. --slowcard makes each fake card write take 30ms.
+
+    Flight sim:  .pio/build/native/program --flight [trace.grl|trace.csv] [--arm s] [--realtime] [--speed N] [--seed n] [--nvs dir]
+                 [--set key=value]... [--slowcard] [--reboot s] [--verbose]
+    Plays a flight (a logger's .grl, a CSV, or a synthetic one if no trace is given; see TraceReplay.h) through GR_Sampler and the
+    logger's own pipeline (FlightFuncs.h): launch detection, the Kalman filter, apogee / landing, the flight phases (and their sample /
+    log rates), pre-launch history, the log writer and the shutdown log_tailS after landing. It arms --arm seconds into the trace (default 1), loads its config from <nvs dir>/config.nvs like
+    setup() does (written with the defaults on the first run), then takes the settings the trace was flown with (a log's own), then
+    any --set (e.g. --set ld_accelG=4.5 to try other thresholds, --set log_pack=1 for a packed log; these aren't saved), and writes
+    sim_flight.grl.
+    Prints when each decision was made next to when the trace says it happened (the log's own events, or the synthetic flight's
+    truth), the log writer's throughput and how fast the sim ran, then reads sim_flight.grl back. Exits with 1 if the pipeline didn't
+    get all the way to shutdown, anything was dropped, the log doesn't read back (or its phases go backwards / skip one) or a decision
+    is further off than SIM_TOL_*.
+    Simulated time by default (as fast as it'll go); --realtime plays at flight speed, --speed N at N times flight speed.
+    Everything takes turns on one thread here, so with --slowcard the sampler sits out every card write; 20 of those back to back
+    while the pre-launch history goes out is more than io_rawRingSize can cover, and the sim says so.
+    --reboot resets the logger s seconds into the trace, the way a brownout would: the log file's dropped without being closed, nothing
+    samples for SIM_REBOOT_US, then a fresh pipeline picks the flight back up from the saved resume record (like setup() does from
+    io_resume) and carries on in the same log. Its decisions from before the reset still count, and the log has to have the resumed event.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <chrono>
+#include <memory>
+#include <GR_Sampler.h>
+#include <GR_FlightLog.h>
+#include <GR_LogPack.h>
+#include <GR_LogWriter.h>
+#include <GR_FlightPhase.h>
+#include "FakeSensors.h"
+#include "FakeBlockDevice.h"
+#include "FilePrefs.h"
+#include "TraceReplay.h"
+
+// Same defaults as main.cpp
+#define io_accelTrackLen 32
+#define io_baroTrackLen 4
+#define io_battTrackLen 4
+#define io_holdLen 8
+#define io_alignHoldMaxUs 50000
+#define io_alignStaleUs 100000
+#define io_accelUpAxis 2
+#define io_accelUpSign 1
+#define io_sampleRingSize 128
+#define io_drainBatchSize 16
+#define io_historySeconds 5
+#define io_historyRecords (io_historySeconds * 1000) // io_accelDMAHz / io_accelDecimation = 1kHz
+#define io_rawRingSize 512
+#define io_logPreallocMB 64
+#define io_logReserveMB 4
+#define io_logBufferBytes 8192
+#define io_logBufferCount 4
+#define io_logTailBytes (2 * GR_PACK_BLOCK)
+#define io_logSyncBytes (2 * io_logBufferBytes)
+#define io_resumeSaveMs 20
+
+#include "FlightSim.h" // The logger's globals + FlightFuncs.h, the same flight pipeline main.cpp runs
+
+// Flight sim
+#define SIM_DRAIN_US 1000     // How often the wi_serverTask side (drain + log writer) gets a turn
+#define SIM_TAIL_S 30         // How long to keep going after the trace runs out (on top of log_tailS), waiting for landing / shutdown
+#define SIM_TOL_LAUNCH_S 0.1  // How far each decision may be from the trace's time for it
+#define SIM_TOL_APOGEE_S 1.0
+#define SIM_TOL_LANDED_S 2.0
+#define SIM_LOG_NAME "sim_flight.grl"
+#define SIM_REBOOT_US 300000  // --reboot: reset -> sampling + logging again (io_resumeBudgetMs is 500)
+#define SIM_RESET_REASON 9    // --reboot: what the resumed event says the reset was (ESP_RST_BROWNOUT)
+
+// Counts samples instead of processing them (and logs them raw if there's a log open)
+class CountingSink : public GR_SampleSink {
+  public:
+    CountingSink(FakeClock& clock, LogWriter& log) : clock_(clock), log_(log) {}
+    long accel = 0, baro = 0, batt = 0, logTicks = 0;
+    uint32_t loadUs = 0;  // Max simulated time each callback takes
+    void onAccel(uint64_t timeUs, int x, int y, int z) override {
+      accel++;
+      work();
+      log(GR_FlightLog::makeSample(timeUs, GR_SAMPLE_ACCEL, x, y, z, 0, 0, 0));
+    }
+    void onBaro(uint64_t timeUs, float tempC, float pressPa) override {
+      baro++;
+      work();
+      log(GR_FlightLog::makeSample(timeUs, GR_SAMPLE_BARO, 0, 0, 0, pressPa, tempC, 0));
+    }
+    void onBatt(uint64_t timeUs, int raw) override {
+      batt++;
+      work();
+      log(GR_FlightLog::makeSample(timeUs, GR_SAMPLE_BATT, 0, 0, 0, 0, 0, raw));
+    }
+    void onLogTick(uint64_t) override { logTicks++; work(); }
+  private:
+    void log(const GR_LogRecord& r) { if (log_.isOpen()) log_.append(&r, sizeof(r)); }
+    void work() { if (loadUs && !clock_.realTime) clock_.advanceUs(rand() % (loadUs + 1)); }
+    FakeClock& clock_;
+    LogWriter& log_;
+};
+
+struct Options {
+  uint32_t seconds = 10;
+  bool logging = false;
+  uint32_t loadUs = 0;
+  bool flight = false;
+  const char * trace = NULL;
+  double armS = 1;
+  uint32_t seed = 1;
+  const char * nvsDir = ".";
+  std::vector<const char *> sets;  // --set key=value
+  double rebootS = -1;             // --reboot (-1 = don't)
+  bool verbose = false;
+};
+
+static const GR_Sampler::Rates rates = GR_FlightPhase::defaults().phases[GR_PHASE_IDLE].rates; // What the logger samples at disarmed
+
+static void printLogStats(LogWriter& logWriter, FakeBlockDevice& card, double seconds) {
+  const LogWriter::Stats& st = logWriter.stats();
+  printf("Log: %s, %llu bytes in %u writes (%.1f kB/s), %llu bytes dropped, write latency avg %u us / worst %u us\n", card.path().c_str(),
+         (unsigned long long)st.bytesWritten, st.writes, seconds > 0 ? st.bytesWritten / 1024.0 / seconds : 0.0,
+         (unsigned long long)st.bytesDropped, logWriter.avgWriteUs(), st.maxWriteUs);
+}
+
+static int samplerCheck(FakeClock& clock, FakeBlockDevice& card, const Options& opt) {
+  static LogWriter logWriter(card, clock); // static: the buffers are too big to be polite on the stack
+  if (opt.logging) {
+    if (!logWriter.begin(SIM_LOG_NAME, uint64_t(io_logPreallocMB) << 20)) {
+      printf("Couldn't create log file\n");
+      return 1;
+    }
+    GR_LogHeader h = FlightTrace().cal; // main.cpp's default calibration
+    h.startUs = clock.micros();
+    logWriter.append(&h, sizeof(h));
+  }
+
+  FakeAccel accel;
+  FakeBaro baro(clock);
+  FakeBatt batt;
+  CountingSink sink(clock, logWriter);
+  sink.loadUs = opt.loadUs;
+  GR_Sampler sampler(clock, accel, baro, batt, sink, rates);
+
+  uint64_t start = clock.micros();
+  sampler.reset();
+  while (clock.micros() - start < uint64_t(opt.seconds) * 1000000) {
+    clock.sleepUntilUs(sampler.poll());
+    while (logWriter.service()) {} // On the logger this is io_logWriterTask
+  }
+
+  uint64_t elapsed = clock.micros() - start;
+  const GR_Sampler::Stats& ss = sampler.stats();
+  printf("Sampled for %.3f s (%s time)\n", elapsed / 1e6, clock.realTime ? "real" : "simulated");
+  printf("  accel: %ld samples (expected ~%llu)\n", sink.accel, (unsigned long long)(elapsed / rates.accelUs));
+  printf("  baro:  %ld samples (expected ~%llu)\n", sink.baro, (unsigned long long)(elapsed / (baro.periodMs * 1000)));
+  printf("  batt:  %ld samples (expected ~%llu)\n", sink.batt, (unsigned long long)(elapsed / rates.battUs));
+  printf("  log:   %ld ticks   (expected ~%llu)\n", sink.logTicks, (unsigned long long)(elapsed / rates.logUs));
+  printf("  longest poll: %u us\n", ss.maxPollUs);
+
+  // Every release either ran or was counted as missed, so releases + missed must match elapsed / period exactly (+-1 for the
+  // partial period at the end); anything else means the schedule drifted
+  const char * names[GR_CH_COUNT] = {"accel", "baro", "batt", "log"};
+  const uint32_t periods[GR_CH_COUNT] = {rates.accelUs, rates.altUs, rates.battUs, rates.logUs};
+  bool drifted = false;
+  printf("Release timing (lateness histogram buckets:");
+  for (int b = 0; b < GR_JITTER_BUCKETS; b++) {
+    if (GR_Sampler::bucketUs(b)) printf(" <%u", GR_Sampler::bucketUs(b));
+    else printf(" more");
+  }
+  printf(" us)\n");
+  for (int c = 0; c < GR_CH_COUNT; c++) {
+    const GR_Sampler::Channel& ch = ss.ch[c];
+    long long expected = elapsed / periods[c], got = ch.releases + (long long)ch.missed;
+    bool ok = got >= expected - 1 && got <= expected + 1;
+    drifted |= !ok;
+    printf("  %-5s %u released + %u missed = %lld (expected %lld, %s), max late %u us\n        late:", names[c], ch.releases, ch.missed, got,
+           expected, ok ? "no drift" : "DRIFTED", ch.maxLateUs);
+    for (int b = 0; b < GR_JITTER_BUCKETS; b++) printf(" %u", ch.lateHist[b]);
+    printf("\n        missed 1..%d+ in a row:", GR_MISS_BUCKETS);
+    for (int b = 0; b < GR_MISS_BUCKETS; b++) printf(" %u", ch.missHist[b]);
+    printf("\n");
+  }
+  if (opt.logging) {
+    logWriter.flush();
+    while (logWriter.service()) {}
+    logWriter.end();
+    printLogStats(logWriter, card, elapsed / 1e6);
+  }
+  return drifted ? 1 : 0;
+}
+
+/// @brief Read the sim's log back: header, the settings right after it, events in the order the pipeline should have logged them, nothing dropped.
+///        After --reboot (resumed) it has to have the resumed event, which stands in for armed if the log had to start over. Phases
+///        only ever move forward, and a flight without a reset goes through every one of them
+static bool checkLog(const char * path, const SimDecisions& d, bool resumed) {
+  FILE * f = fopen(path, "rb");
+  GR_LogHeader h;
+  if (!f || fread(&h, sizeof(h), 1, f) != 1 || !GR_FlightLog::checkHeader(h)) {
+    printf("  %s: can't read the header\n", path);
+    if (f) fclose(f);
+    return false;
+  }
+  fseek(f, long(GR_LogPack::dataStart(h)), SEEK_SET);
+  std::vector<uint8_t> buf(GR_LogPack::unitBytes(h));
+  GR_LogUnpacker unit;
+  GR_LogRecord r;
+  long samples = 0, history = -1, settings = 0, records = 0;
+  int64_t wallS = -1;
+  std::vector<uint16_t> events;
+  std::vector<GR_LogRecord> phases;
+  bool ok = true;
+  while (fread(buf.data(), buf.size(), 1, f) == 1) {
+    if (!unit.begin(h, buf.data())) continue;
+    while (unit.next(r)) {
+      records++;
+      if (r.type == GR_REC_CONFIG) {
+        settings++;
+        ok &= !samples && events.empty(); // Before anything else
+      }
+      else if (r.type == GR_REC_SAMPLE) samples++;
+      else if (r.type == GR_REC_EVENT) {
+        events.push_back(r.event.code);
+        if (r.event.code == GR_EVT_HISTORY) history = r.event.iArg;
+        if (r.event.code == GR_EVT_WALL_CLOCK && wallS < 0) wallS = r.event.iArg;
+        if (r.event.code == GR_EVT_PHASE) {
+          ok &= phases.empty() ? r.event.iArg > GR_PHASE_IDLE : r.event.iArg > phases.back().event.iArg;
+          phases.push_back(r);
+        }
+        if (r.event.code == GR_EVT_OVERFLOW || r.event.code == GR_EVT_LOG_FULL) ok = false;
+      }
+    }
+  }
+  long bytes = ftell(f);
+  fclose(f);
+
+  // The flight's events, in order (the history marker and anything else can come in between)
+  static const uint16_t expected[] = {GR_EVT_ARMED, GR_EVT_LAUNCH, GR_EVT_APOGEE, GR_EVT_LANDED, GR_EVT_SHUTDOWN};
+  size_t next = 0, resumes = 0;
+  for (uint16_t code : events) {
+    resumes += code == GR_EVT_RESUMED;
+    if (next == 0 && code == GR_EVT_RESUMED) next++;
+    else if (next < sizeof(expected) / sizeof(expected[0]) && code == expected[next]) next++;
+  }
+  size_t want = d.shutdownUs ? 5 : d.landedUs ? 4 : d.apogeeUs ? 3 : d.launchUs ? 2 : 1;
+  ok &= next >= want && settings == h.configCount && (resumes > 0) == resumed && wallS >= 0;
+  if (!resumed && d.shutdownUs) ok &= phases.size() == GR_PHASE_COUNT - 1; // idle -> armed ... -> shutdown
+  printf("  %s: %ld settings, %ld samples, %zu events (", path, settings, samples, events.size());
+  for (size_t i = 0; i < events.size(); i++) printf("%s%s", i ? " " : "", GR_FlightLog::eventName(events[i]));
+  char wall[32] = "none";
+  time_t wt = time_t(wallS);
+  struct tm tm;
+  if (wallS >= 0 && gmtime_r(&wt, &tm)) strftime(wall, sizeof(wall), "%Y-%m-%d %H:%M:%S", &tm);
+  printf("), %ld records of pre-launch history, wall clock %s\n    phases:", history, wall);
+  for (size_t i = 0; i < phases.size(); i++) { // How long each lasted is in the next one's event
+    printf(" %s", GR_FlightPhase::name(uint8_t(phases[i].event.iArg)));
+    if (i + 1 < phases.size()) printf(" %.2fs", phases[i + 1].event.fArg);
+  }
+  if (h.packBlock) printf(", packed %.2fx", records * double(sizeof(GR_LogRecord)) / (bytes - GR_LogPack::dataStart(h)));
+  printf(" -> %s\n", ok ? "OK" : "BAD");
+  return ok;
+}
+
+static int flightSim(FakeClock& clock, FakeBlockDevice& card, const Options& opt) {
+  FlightTrace trace;
+  if (opt.trace) {
+    if (!trace.load(opt.trace)) {
+      printf("Couldn't load %s: %s\n", opt.trace, trace.error.c_str());
+      return 1;
+    }
+  } else {
+    trace.synthesize(opt.seed);
+  }
+  printf("Trace: %s, %.1f s, %zu accel / %zu baro / %zu batt samples, %zu events\n", opt.trace ? opt.trace : "synthetic",
+         trace.durationUs() / 1e6, trace.count(GR_SAMPLE_ACCEL), trace.count(GR_SAMPLE_BARO), trace.count(GR_SAMPLE_BATT), trace.events.size());
+
+  // setup(), up to the sampling task. Done again after --reboot, with everything in RAM back how it was at power on
+  FilePrefs prefs(opt.nvsDir);
+  auto bringUp = [&]() {
+    sim_powerOn();
+    cal_zeroXAccel = trace.cal.cal_zeroXAccel; cal_zeroYAccel = trace.cal.cal_zeroYAccel; cal_zeroZAccel = trace.cal.cal_zeroZAccel;
+    cal_xAccelCoef = trace.cal.cal_xAccelCoef; cal_yAccelCoef = trace.cal.cal_yAccelCoef; cal_zAccelCoef = trace.cal.cal_zAccelCoef;
+    GR_Config::LoadStats loaded = sim_loadConfig(prefs);
+    if (loaded.badBlob) printf("%s: stored config was corrupt, using defaults\n", prefs.path().c_str());
+    for (const auto& kv : trace.settings) { // The flight's own settings (ones this build doesn't have are skipped)
+      if (io_config.find(kv.first.c_str()) && !io_config.set(kv.first.c_str(), kv.second.c_str()))
+        printf("Trace setting %s=%s is out of range, ignored\n", kv.first.c_str(), kv.second.c_str());
+    }
+    for (const char * set : opt.sets) {
+      std::string key(set, strcspn(set, "="));
+      if (!set[key.size()] || !io_config.set(key.c_str(), set + key.size() + 1)) {
+        printf("--set %s: no such setting, or the value's out of range\n", set);
+        return false;
+      }
+    }
+    sim_verbose = opt.verbose;
+    // wi_syncTime(): the host's clock stands in for the phone's (and is still set after a reset, like the ESP32's)
+    int64_t hostUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    io_wallOffsetUs = hostUs - int64_t(clock.micros());
+    time_synced = true;
+    io_applyConfig();
+    io_logWriter.syncEvery(io_logSyncBytes);
+    io_logWriter.reserveTail(io_logTailBytes);
+    return true;
+  };
+  if (!bringUp()) return 2;
+  printf("Config: %s%s%s (launch %.1fg x %d or %.0fft x %d)\n", prefs.path().c_str(), trace.settings.empty() ? "" : " + trace",
+         opt.sets.empty() ? "" : " + --set", ld_accelG, ld_accelSamples, ld_altFt, ld_altSamples);
+
+  TraceTime time(clock, clock.micros());
+  ReplayAccel accel(trace, time);
+  ReplayBaro baro(trace, time);
+  ReplayBatt batt(trace, time);
+  std::unique_ptr<GR_Sampler> sampler(new GR_Sampler(clock, accel, baro, batt, io_sampleHandler, io_phaseSettings->rates));
+  const GR_PhaseSettings * applied = io_phaseSettings;
+
+  uint64_t armAt = time.toClock(uint64_t(opt.armS * 1e6));
+  uint64_t endAt = time.toClock(trace.durationUs() + (uint64_t(io_logTailS) + SIM_TAIL_S) * 1000000);
+  uint64_t rebootAt = opt.rebootS >= 0 ? time.toClock(uint64_t(opt.rebootS * 1e6)) : UINT64_MAX;
+  uint64_t nextDrain = clock.micros() + SIM_DRAIN_US;
+  bool armTried = false;
+  SimDecisions before = {}; // From before --reboot
+  LogWriter::Stats beforeLog = {};
+  uint32_t beforeOverflows[2] = {};
+  auto wallStart = std::chrono::steady_clock::now();
+  sampler->reset();
+  while (!sim_shutDown() && clock.micros() < endAt) {
+    if (io_phaseSettings != applied) { // io_samplingTask: new phase, new rates
+      applied = io_phaseSettings;
+      sampler->setRates(applied->rates);
+    }
+    uint64_t due = sampler->poll();
+    if (!armTried && clock.micros() >= armAt) {
+      armTried = true;
+      if (!sim_arm(SIM_LOG_NAME)) {
+        printf("Couldn't create log file\n");
+        return 1;
+      }
+    }
+    if (clock.micros() >= rebootAt) { // Reset: everything in RAM's gone, the card's left as it was
+      rebootAt = UINT64_MAX;
+      before = sim_decisions();
+      beforeLog = io_logWriter.stats();
+      beforeOverflows[0] = io_sampleRing.overflows(); beforeOverflows[1] = io_rawRing.overflows();
+      const GR_ResumeState * saved = GR_Resume::newest(io_resume, 2);
+      GR_ResumeState from = saved ? *saved : GR_ResumeState();
+      uint64_t lostFrom = io_logWriter.synced();
+      card.crash();
+      sampler.reset();
+      clock.advanceUs(SIM_REBOOT_US);
+      printf("Reset at %.3f s (log synced up to %lluKB)%s\n", time.fromClock(clock.micros() - SIM_REBOOT_US) / 1e6,
+             (unsigned long long)(lostFrom / 1024), saved && from.armed ? "" : ", nothing to pick back up");
+      if (!bringUp()) return 2;
+      if (saved && from.armed && !sim_resume(from, SIM_RESET_REASON, SIM_REBOOT_US / 1000.0f)) {
+        printf("Couldn't pick the log back up\n");
+        return 1;
+      }
+      applied = io_phaseSettings;
+      sampler.reset(new GR_Sampler(clock, accel, baro, batt, io_sampleHandler, applied->rates));
+      sampler->reset();
+      nextDrain = clock.micros() + SIM_DRAIN_US;
+      continue;
+    }
+    if (clock.micros() >= nextDrain) { // wi_serverTask + io_logWriterTask
+      sim_drain();
+      while (io_logWriter.service()) {}
+      nextDrain = clock.micros() + SIM_DRAIN_US;
+    }
+    if (nextDrain < due) due = nextDrain;
+    if (!armTried && armAt < due) due = armAt;
+    if (rebootAt < due) due = rebootAt;
+    clock.sleepUntilUs(due);
+  }
+  sim_drain();
+  io_stopLog(); // If it's still open (the trace ran out before shutdown)
+  double wallS = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+  double simS = (clock.micros() - time.toClock(0)) / 1e6;
+
+  // What the trace says happened
+  SimDecisions d = sim_decisions();
+  if (!d.armedUs) d.armedUs = before.armedUs; // Decided before --reboot (the rest come back with the resume record)
+  if (!d.shutdownUs) d.shutdownUs = before.shutdownUs;
+  uint64_t ref[3] = {};
+  float refApogeeM = NAN;
+  const char * refFrom = "none";
+  if (trace.truth.known) {
+    ref[0] = trace.truth.ignitionUs; ref[1] = trace.truth.apogeeUs; ref[2] = trace.truth.landedUs;
+    refApogeeM = trace.truth.apogeeM;
+    refFrom = "true flight";
+  } else {
+    for (const TraceEvent& e : trace.events) {
+      int i = e.code == GR_EVT_LAUNCH ? 0 : e.code == GR_EVT_APOGEE ? 1 : e.code == GR_EVT_LANDED ? 2 : -1;
+      if (i < 0 || ref[i]) continue;
+      ref[i] = e.timeUs ? e.timeUs : 1;
+      if (i == 1) refApogeeM = e.fArg;
+      refFrom = "trace's own events";
+    }
+  }
+
+  // Decision times in trace time
+  const char * names[3] = {"launch (T0)", "apogee", "landed"};
+  const uint64_t got[3] = {d.t0Us, d.apogeeUs, d.landedUs};
+  const double tol[3] = {SIM_TOL_LAUNCH_S, SIM_TOL_APOGEE_S, SIM_TOL_LANDED_S};
+  bool ok = true;
+  printf("Decisions (trace time, s; reference: %s)\n", refFrom);
+  printf("  %-12s %10s %10s %9s\n", "", "sim", "reference", "diff");
+  printf("  %-12s %10.3f\n", "armed", time.fromClock(d.armedUs) / 1e6);
+  for (int i = 0; i < 3; i++) {
+    double g = got[i] ? time.fromClock(got[i]) / 1e6 : NAN, r = ref[i] ? ref[i] / 1e6 : NAN;
+    bool inTol = !ref[i] || (got[i] && fabs(g - r) <= tol[i]);
+    ok &= inTol;
+    printf("  %-12s %10.3f %10.3f %+9.3f %s\n", names[i], g, r, g - r, ref[i] ? (inTol ? "ok" : "OUT OF TOLERANCE") : "");
+  }
+  if (d.launchUs) printf("  launch decided %.3f s after T0 by %s\n", (d.launchUs - d.t0Us) / 1e6, GR_LaunchDetect::reasonName(d.launchReason));
+  if (d.apogeeUs && refApogeeM > 0) printf("  apogee %.1f m above the pad (reference %.1f m)\n", d.apogeeM, refApogeeM);
+  else if (d.apogeeUs) printf("  apogee %.1f m above the pad\n", d.apogeeM);
+  if (d.resumedUs) printf("  %-12s %10.3f (reset at %.3f)\n", "resumed", time.fromClock(d.resumedUs) / 1e6, opt.rebootS);
+  printf("  %-12s %10.3f\n", "shutdown", d.shutdownUs ? time.fromClock(d.shutdownUs) / 1e6 : NAN);
+
+  // The pipeline has to get all the way through, without dropping anything
+  bool complete = d.armedUs && d.launchUs && d.apogeeUs && d.landedUs && d.shutdownUs;
+  uint64_t dropped = beforeLog.bytesDropped + io_logWriter.stats().bytesDropped;
+  uint32_t sampleDrops = beforeOverflows[0] + io_sampleRing.overflows(), rawDrops = beforeOverflows[1] + io_rawRing.overflows();
+  printf("Pipeline: %s; dropped: %u sample queue, %u full rate queue, %llu log bytes; %u baro readings rejected by the filter\n",
+         complete ? "complete" : "INCOMPLETE", sampleDrops, rawDrops, (unsigned long long)dropped, io_altKF.baroRejects());
+  ok &= complete && !sampleDrops && !rawDrops && !dropped;
+  printLogStats(io_logWriter, card, simS);
+  printf("Ran %.1f s of flight in %.2f s (%.0fx, %s time)\n", simS, wallS, wallS > 0 ? simS / wallS : 0.0, clock.realTime ? "real" : "simulated");
+  ok &= checkLog(card.path().c_str(), d, d.resumedUs != 0);
+  printf("%s\n", ok ? "PASS" : "FAIL");
+  return ok ? 0 : 1;
+}
+
+int main(int argc, char ** argv) {
+  Options opt;
+  FakeClock& clock = io_clock; // The logger's (FlightSim.h)
+  FakeBlockDevice& card = io_sdDevice;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--realtime")) clock.realTime = true;
+    else if (!strcmp(argv[i], "--speed") && i + 1 < argc) { clock.realTime = true; clock.speed = atof(argv[++i]); }
+    else if (!strcmp(argv[i], "--log")) opt.logging = true;
+    else if (!strcmp(argv[i], "--slowcard")) card.writeDelayUs = 30000;
+    else if (!strcmp(argv[i], "--load") && i + 1 < argc) opt.loadUs = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--flight")) {
+      opt.flight = true;
+      if (i + 1 < argc && strncmp(argv[i + 1], "--", 2)) opt.trace = argv[++i];
+    }
+    else if (!strcmp(argv[i], "--arm") && i + 1 < argc) opt.armS = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--seed") && i + 1 < argc) opt.seed = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--nvs") && i + 1 < argc) opt.nvsDir = argv[++i];
+    else if (!strcmp(argv[i], "--set") && i + 1 < argc) opt.sets.push_back(argv[++i]);
+    else if (!strcmp(argv[i], "--reboot") && i + 1 < argc) opt.rebootS = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--verbose")) opt.verbose = true;
+    else opt.seconds = atoi(argv[i]);
+  }
+  if (clock.speed <= 0) clock.speed = 1;
+  return opt.flight ? flightSim(clock, card, opt) : samplerCheck(clock, card, opt);
+}
@@ -0,0 +1,167 @@
+/* GraphiteAlignTest.cpp
+    Host-side checks for the sample timestamps + stream alignment (lib/GR_Align/GR_Align.h): GR_SampleClock against a simulated ADC
+    handing over DMA chunks late by a random amount (nominal rate, running slow / fast, samples lost to an overflow), holding readings
+    back in time order, reading a track between samples, and the common time of several streams.
+
+    Doesn't need the ESP toolchain or PlatformIO, just a c++17 compiler:
+      g++ -std=c++17 -O2 -Ilib/GR_Align -Ilib/GR_Sampler tools/GraphiteAlignTest.cpp -o GraphiteAlignTest
+
+    Usage:
+      GraphiteAlignTest            Run the checks, print how far off the timestamps were. Exits with 1 if any check fails
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include <GR_Align.h>
+#include <GR_SampleRecord.h>
+
+#define CHUNK_SAMPLES 64      // Frames per DMA chunk (256 conversions / 4 channels)
+#define READ_EVERY_US 5000    // GR_Sampler's accelerometer period
+#define READ_LATE_US 3000     // Reads land up to this much after the chunk they catch (other tasks, interrupts)
+#define RUN_US 20000000       // 20 s of samples
+#define MAX_ERR_US 1000       // Stamps have to be within one filtered sample (1kHz) of the truth
+
+static int failures = 0;
+#define CHECK(cond) do { if (!(cond)) { printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+static uint32_t rng = 12345;
+static uint32_t next(uint32_t range) {
+  rng = rng * 1664525u + 1013904223u;
+  return (rng >> 8) % range;
+}
+
+struct ClockRun {
+  double maxErrUs = 0;     // Worst timestamp error once settled (after the first second)
+  double maxReadErrUs = 0; // Same, stamping with the read time instead
+  uint32_t resyncs = 0;
+};
+
+/// @brief Conversions every periodNs * (1 + ppm / 1e6) from t = 1 s, read every READ_EVERY_US (+ up to READ_LATE_US) in whole chunks.
+///        lostAtUs: CHUNK_SAMPLES * lostChunks samples never make it to a read from then on (the DMA buffer overflowed)
+static ClockRun runClock(double ppm, uint64_t lostAtUs = 0, int lostChunks = 0) {
+  GR_SampleClock clk;
+  const double periodUs = clk.config().periodNs / 1000.0 * (1 + ppm / 1e6);
+  const double startUs = 1000000;
+  ClockRun r;
+  uint64_t handed = 0; // Samples handed over so far (what the driver counts)
+  uint64_t skipped = 0; // Samples lost before the ones handed over
+  bool lost = false;
+  for (uint64_t readUs = uint64_t(startUs) + READ_EVERY_US; readUs < startUs + RUN_US; readUs += READ_EVERY_US) {
+    uint64_t now = readUs + next(READ_LATE_US);
+    if (lostAtUs && !lost && now >= lostAtUs) { skipped += uint64_t(lostChunks) * CHUNK_SAMPLES; lost = true; }
+    // Whole chunks converted by now (the hardware's count), minus the ones lost
+    uint64_t converted = uint64_t((now - startUs) / periodUs) / CHUNK_SAMPLES * CHUNK_SAMPLES;
+    if (converted <= handed + skipped) continue;
+    uint64_t from = handed;
+    handed = converted - skipped;
+    clk.update(now, handed);
+    if (now < startUs + 1000000) continue; // Let it settle
+    if (lost && now < lostAtUs + 1000000) continue;
+    for (uint64_t n = from; n < handed; n++) {
+      double trueUs = startUs + (n + skipped) * periodUs;
+      r.maxErrUs = fmax(r.maxErrUs, fabs(double(clk.timeUs(n)) - trueUs));
+      r.maxReadErrUs = fmax(r.maxReadErrUs, double(now) - trueUs);
+    }
+  }
+  r.resyncs = clk.resyncs();
+  return r;
+}
+
+static void sampleClock() {
+  printf("Sample clock\n");
+  ClockRun nominal = runClock(0);
+  printf("  nominal rate: stamps off by up to %.0f us (%.0f us stamped at the read)\n", nominal.maxErrUs, nominal.maxReadErrUs);
+  CHECK(nominal.maxErrUs < MAX_ERR_US);
+  CHECK(nominal.maxReadErrUs > 10000); // A chunk's first sample is a chunk old by the time it's read
+  CHECK(nominal.resyncs == 0);
+
+  ClockRun slow = runClock(200);
+  printf("  200 ppm slow: %.0f us\n", slow.maxErrUs);
+  CHECK(slow.maxErrUs < MAX_ERR_US && slow.resyncs == 0); // The anchor creeps later at up to 500 ppm, keeps up
+
+  ClockRun fast = runClock(-200);
+  printf("  200 ppm fast: %.0f us\n", fast.maxErrUs);
+  CHECK(fast.maxErrUs < MAX_ERR_US && fast.resyncs == 0); // Reads pull it earlier straight away
+
+  ClockRun lost = runClock(0, 8000000, 6); // ~100ms of samples gone at 8 s
+  printf("  lost 6 chunks: %.0f us after, %u resync\n", lost.maxErrUs, lost.resyncs);
+  CHECK(lost.resyncs == 1);
+  CHECK(lost.maxErrUs < MAX_ERR_US);
+
+  GR_SampleClock clk;
+  CHECK(!clk.started());
+  clk.update(1000, 0); // Nothing handed over yet
+  CHECK(!clk.started());
+  clk.update(20000, 64);
+  CHECK(clk.started() && clk.timeUs(63) == 20000 && clk.timeUs(0) == 20000 - 63 * 250);
+  clk.reset();
+  CHECK(!clk.started() && clk.resyncs() == 0);
+}
+
+static void holdBack() {
+  printf("Hold back\n");
+  GR_HoldBack<int, 4> h;
+  uint64_t t;
+  int v;
+  CHECK(!h.pop(1000000, t, v));
+  h.push(100, 1); h.push(200, 2); h.push(300, 3);
+  CHECK(!h.pop(99, t, v) && h.size() == 3); // Nothing that old yet
+  CHECK(h.pop(250, t, v) && t == 100 && v == 1);
+  CHECK(h.pop(250, t, v) && t == 200 && v == 2);
+  CHECK(!h.pop(250, t, v));
+  h.push(400, 4); h.push(500, 5); h.push(600, 6); // Full: 300 goes
+  CHECK(h.size() == 4 && h.dropped() == 0);
+  h.push(700, 7);
+  CHECK(h.size() == 4 && h.dropped() == 1);
+  CHECK(h.pop(1000, t, v) && t == 400 && v == 4); // 300 was the one pushed out
+  int n = 0;
+  while (h.pop(1000, t, v)) n++;
+  CHECK(n == 3 && h.size() == 0);
+}
+
+static void track() {
+  printf("Track\n");
+  GR_Track<float, 4> tr;
+  CHECK(tr.empty() && tr.newestUs() == 0 && tr.at(123) == 0);
+  tr.push(1000, 10);
+  CHECK(tr.at(0) == 10 && tr.at(5000) == 10); // One reading: held both ways
+  tr.push(2000, 20);
+  tr.push(2000, 99); // Not newer: dropped
+  tr.push(1500, 99);
+  CHECK(tr.size() == 2 && tr.newestUs() == 2000 && tr.newest() == 20);
+  CHECK(fabsf(tr.at(1500) - 15) < 1e-4f);
+  CHECK(fabsf(tr.at(1250) - 12.5f) < 1e-4f);
+  CHECK(tr.at(1250, false) == 10 && tr.at(1750, false) == 20); // Nearest
+  CHECK(tr.at(1000) == 10 && tr.at(2000) == 20);
+  CHECK(tr.at(500) == 10 && tr.at(9000) == 20);
+  for (int i = 3; i <= 6; i++) tr.push(i * 1000, i * 10.0f); // Wraps: 3000..6000 left
+  CHECK(tr.size() == 4 && tr.at(1000) == 30);
+  CHECK(fabsf(tr.at(5500) - 55) < 1e-4f);
+
+  GR_Track<GR_BaroSample, 2> baro; // A struct of them works the same
+  baro.push(0, {20, 100000, 100});
+  baro.push(1000, {22, 99000, 200});
+  GR_BaroSample b = baro.at(500);
+  CHECK(fabsf(b.tempC - 21) < 1e-3f && fabsf(b.pressPa - 99500) < 0.1f && fabsf(b.altM - 150) < 1e-3f);
+}
+
+static void common() {
+  printf("Common time\n");
+  uint64_t newest[3] = {19000, 10000, 18000};
+  CHECK(GR_Align::commonUs(20000, 100000, newest, 3) == 10000);
+  newest[1] = 0; // Not started: left out
+  CHECK(GR_Align::commonUs(20000, 100000, newest, 3) == 18000);
+  uint64_t stale[3] = {500000, 100000, 480000}; // The second one stopped 400ms ago
+  CHECK(GR_Align::commonUs(500000, 100000, stale, 3) == 480000);
+  uint64_t none[2] = {0, 0};
+  CHECK(GR_Align::commonUs(7000, 100000, none, 2) == 7000);
+}
+
+int main() {
+  sampleClock();
+  holdBack();
+  track();
+  common();
+  printf("%s (%d failed)\n", failures ? "FAIL" : "PASS", failures);
+  return failures ? 1 : 0;
+}
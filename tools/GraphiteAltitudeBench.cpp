@@ -0,0 +1,86 @@
+/* GraphiteAltitudeBench.cpp
+    Host-side accuracy test + benchmark for the altitude table (lib/GR_Altitude/GR_Altitude.h) against the exact pow() formula.
+
+    Doesn't need the ESP toolchain or PlatformIO, just a c++17 compiler:
+      g++ -std=c++17 -O2 -Ilib/GR_Altitude tools/GraphiteAltitudeBench.cpp -o GraphiteAltitudeBench
+
+    For a spread of calibration values (sea level pressure, lapse rate, exponent) it sweeps 0-30km at several air temperatures,
+    compares the table to the exact formula (in double) and to the logger's old float pow() version, and checks the error never
+    goes over what build() claims. Exits non-zero if it does.
+    Note: ns/call is for the dev box, not the ESP32 (where powf() is a lot slower relative to a few multiplies)
+*/
+#include <stdio.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include <GR_Altitude.h>
+
+#define SWEEP_STEP_M 0.5        // Altitude sweep resolution
+#define SWEEP_TOP_M 30000
+#define BENCH_CALLS 4000000
+
+struct Cal { float pAtSea, lapseRate, magicExp; };
+
+// Standard-atmosphere-ish pressure at altitude h (m) for this calibration, by inverting the logger's own formula
+static double pressureAt(const Cal& c, double h, double tempK) {
+  return c.pAtSea / pow(1 + h * c.lapseRate / tempK, 1 / double(c.magicExp));
+}
+
+static double exactAlt(const Cal& c, double p, double tempK) { return (pow(c.pAtSea / p, double(c.magicExp)) - 1) * tempK / c.lapseRate; }
+
+int main() {
+  const Cal cals[] = {
+    {101325, 0.0059f, 0.190266435664f},  // Logger defaults
+    {101325, 0.0065f, 0.190266435664f},  // Textbook lapse rate
+    {95000, 0.0059f, 0.190266435664f},   // Low pressure day / high field
+    {104000, 0.0065f, 0.19f},
+  };
+  const float temps[] = {-40, 0, 20, 45};
+  bool ok = true;
+
+  printf("Table: %d segments (%d per octave), %zu bytes\n", GR_ALT_SEGMENTS, 1 << GR_ALT_TABLE_BITS, sizeof(GR_AltitudeTable));
+  for (const Cal& c : cals) {
+    static GR_AltitudeTable table;
+    auto start = std::chrono::steady_clock::now();
+    table.build(c.pAtSea, c.lapseRate, c.magicExp);
+    double buildUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+    double worstTable = 0, worstPowf = 0;
+    for (float tempC : temps) {
+      double tempK = tempC + 273.15;
+      for (double h = 0; h <= SWEEP_TOP_M; h += SWEEP_STEP_M) {
+        float p = float(pressureAt(c, h, tempK));
+        double ref = exactAlt(c, p, tempK);
+        double et = fabs(table.altitudeM(p, tempC) - ref);
+        float old = (powf(c.pAtSea / p, c.magicExp) - 1) * (tempC + 273.15f) / c.lapseRate; // What onBaro() used to do (in float)
+        double ep = fabs(old - ref);
+        if (et > worstTable) worstTable = et;
+        if (ep > worstPowf) worstPowf = ep;
+      }
+    }
+    // The bound is for GR_ALT_CHECK_TEMP_K; scale it to the hottest temperature swept (error scales with tempK)
+    double bound = table.maxErrorM() * (temps[3] + 273.15) / GR_ALT_CHECK_TEMP_K;
+    bool pass = worstTable <= bound * 1.0001 + 1e-6;
+    ok &= pass;
+    printf("pAtSea %.0f lapse %.4f exp %.6f: build %.0f us, max error table %.4f m (bound %.4f m, %s), float powf %.4f m\n",
+           c.pAtSea, c.lapseRate, c.magicExp, buildUs, worstTable, bound, pass ? "ok" : "EXCEEDED", worstPowf);
+  }
+
+  // Speed
+  GR_AltitudeTable table;
+  table.build(cals[0].pAtSea, cals[0].lapseRate, cals[0].magicExp);
+  std::vector<float> ps(4096);
+  for (size_t i = 0; i < ps.size(); i++) ps[i] = float(pressureAt(cals[0], (i * 7919) % 30000, 288.15));
+  volatile float sink = 0;
+  float acc = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < BENCH_CALLS; i++) acc += table.altitudeM(ps[i & 4095], 15);
+  auto t1 = std::chrono::steady_clock::now();
+  for (int i = 0; i < BENCH_CALLS; i++) acc += (powf(cals[0].pAtSea / ps[i & 4095], cals[0].magicExp) - 1) * 288.15f / cals[0].lapseRate;
+  auto t2 = std::chrono::steady_clock::now();
+  sink = acc;
+  (void)sink;
+  printf("Speed: table %.2f ns/call, powf %.2f ns/call\n", std::chrono::duration<double, std::nano>(t1 - t0).count() / BENCH_CALLS,
+         std::chrono::duration<double, std::nano>(t2 - t1).count() / BENCH_CALLS);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,341 @@
+/* GraphiteConfigTest.cpp
+    Host-side checks for the config registry (lib/GR_Config/GR_Config.h): blob round trips, settings added / removed between firmware
+    versions, out of range and corrupt values falling back to their defaults, moving the old one-key-per-setting NVS layout into a blob,
+    set() / the /config JSON, and what load() costs next to the per-key routine setup() used to have.
+
+    Doesn't need the ESP toolchain or PlatformIO, just a c++17 compiler:
+      g++ -std=c++17 -O2 -Ilib/GR_Config -Ilib/GR_SensorHAL -Isrc/native tools/GraphiteConfigTest.cpp -o GraphiteConfigTest
+
+    Usage:
+      GraphiteConfigTest           Run the checks, print the timings. Exits with 1 if any check fails
+    NVS is FilePrefs with no directory (in memory). It's nothing like flash, so the load comparison counts NVS calls (each one is
+    a lookup in the NVS page table on the logger; setup() prints the real load time) and only times the registry's own parsing.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <GR_Config.h>
+#include "FilePrefs.h"
+
+#define TIMING_LOADS 10000   // fromBlob()s timed
+
+static int failures = 0;
+#define CHECK(cond) do { if (!(cond)) { printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+// main.cpp's settings
+static char wi_ssid[61], wi_pass[61], wi_address[61];
+static int wi_channel, ld_accelSamples, ld_altSamples;
+static float cal_lapseRate, cal_magicExp, cal_pAtSea, ld_accelG, ld_altFt;
+
+static const GR_ConfigItem items[] = {
+  GR_CONFIG_STRING(wi_ssid,         "wi_ssid",       "Graphite",      1,                           GR_CFG_REBOOT,                 "WiFi network name"),
+  GR_CONFIG_STRING(wi_pass,         "wi_pass",       "allthedata",    8,                           GR_CFG_REBOOT | GR_CFG_SECRET, "WiFi password"),
+  GR_CONFIG_STRING(wi_address,      "wi_address",    "graphite",      1,                           GR_CFG_REBOOT,                 "Web address (<this>.local)"),
+  GR_CONFIG_INT(wi_channel,         "wi_channel",    1,               1,       13,      "",        GR_CFG_REBOOT,                 "WiFi channel"),
+  GR_CONFIG_FLOAT(cal_lapseRate,    "cal_lapseRate", 0.0059,          0.001,   0.02,    "K/m",     0,                             "Altimeter: temperature lapse rate"),
+  GR_CONFIG_FLOAT(cal_magicExp,     "cal_magicExp",  0.190266435664,  0.1,     0.3,     "",        0,                             "Altimeter: barometric formula exponent"),
+  GR_CONFIG_FLOAT(cal_pAtSea,       "cal_pAtSea",    101325,          80000,   110000,  "Pa",      0,                             "Altimeter: sea level pressure"),
+  GR_CONFIG_FLOAT(ld_accelG,        "ld_accelG",     3.0,             1.5,     100,     "g",       0,                             "Launch: acceleration"),
+  GR_CONFIG_INT(ld_accelSamples,    "ld_accelN",     30,              1,       1000,    "samples", 0,                             "Launch: for this many accelerometer samples (1kHz)"),
+  GR_CONFIG_FLOAT(ld_altFt,         "ld_altFt",      100,             10,      5000,    "ft",      0,                             "Launch: height above the pad"),
+  GR_CONFIG_INT(ld_altSamples,      "ld_altN",       5,               1,       100,     "samples", 0,                             "Launch: for this many altimeter samples (64Hz)"),
+};
+static GR_Config config(items, sizeof(items) / sizeof(items[0]));
+
+/// @brief Scribble over every setting, so a load that doesn't set something shows up
+static void scramble() {
+  strcpy(wi_ssid, "x"); strcpy(wi_pass, "x"); strcpy(wi_address, "x");
+  wi_channel = ld_accelSamples = ld_altSamples = -1;
+  cal_lapseRate = cal_magicExp = cal_pAtSea = ld_accelG = ld_altFt = -1;
+}
+
+static bool atDefaults() {
+  return !strcmp(wi_ssid, "Graphite") && !strcmp(wi_pass, "allthedata") && !strcmp(wi_address, "graphite") && wi_channel == 1 &&
+         cal_lapseRate == 0.0059f && cal_magicExp == 0.190266435664f && cal_pAtSea == 101325 && ld_accelG == 3 && ld_accelSamples == 30 &&
+         ld_altFt == 100 && ld_altSamples == 5;
+}
+
+static void firstBoot() {
+  printf("First boot (empty NVS)\n");
+  FilePrefs prefs("");
+  prefs.begin("config");
+  scramble();
+  GR_Config::LoadStats st = config.load(prefs);
+  CHECK(st.source == GR_Config::FromDefaults && st.saved && !st.badBlob && st.defaulted == config.count());
+  CHECK(atDefaults());
+  CHECK(prefs.getBytesLength(GR_CONFIG_BLOB_KEY) > 0);
+}
+
+static void roundTrip() {
+  printf("Round trip\n");
+  FilePrefs prefs("");
+  prefs.begin("config");
+  config.setDefaults();
+  strcpy(wi_ssid, "Pad \"3\" \\ test"); wi_channel = 11; ld_accelG = 4.25f; ld_altSamples = 9; cal_pAtSea = 99876.5f;
+  CHECK(config.save(prefs));
+  scramble();
+  GR_Config::LoadStats st = config.load(prefs);
+  CHECK(st.source == GR_Config::FromBlob && !st.saved && st.loaded == config.count() && !st.defaulted && !st.rejected);
+  CHECK(!strcmp(wi_ssid, "Pad \"3\" \\ test") && wi_channel == 11 && ld_accelG == 4.25f && ld_altSamples == 9 && cal_pAtSea == 99876.5f);
+  CHECK(!strcmp(wi_pass, "allthedata") && ld_accelSamples == 30);
+}
+
+static void schemaChange() {
+  printf("Settings added / removed between versions\n");
+  // Old firmware: a subset of the settings plus one that's since been dropped
+  int oldOnly = 7;
+  const GR_ConfigItem oldItems[] = {
+    GR_CONFIG_FLOAT(ld_accelG, "ld_accelG", 3.0, 1.5, 100, "g", 0, ""),
+    GR_CONFIG_INT(oldOnly, "old_setting", 7, 0, 10, "", 0, ""),
+    GR_CONFIG_INT(wi_channel, "wi_channel", 1, 1, 13, "", 0, ""),
+  };
+  GR_Config oldConfig(oldItems, 3);
+  CHECK(oldConfig.schemaHash() != config.schemaHash());
+  FilePrefs prefs("");
+  prefs.begin("config");
+  oldConfig.setDefaults();
+  ld_accelG = 6.5f; wi_channel = 4;
+  CHECK(oldConfig.save(prefs));
+
+  scramble();
+  GR_Config::LoadStats st = config.load(prefs);
+  CHECK(st.source == GR_Config::FromBlob && st.loaded == 2 && st.defaulted == config.count() - 2 && !st.rejected && st.saved);
+  CHECK(ld_accelG == 6.5f && wi_channel == 4 && ld_altFt == 100 && !strcmp(wi_ssid, "Graphite"));
+
+  // Saved back without the dropped one; the next boot is a plain load
+  scramble();
+  st = config.load(prefs);
+  CHECK(st.loaded == config.count() && !st.saved && ld_accelG == 6.5f);
+
+  // And the other way: the old firmware reading the new blob (a downgrade) keeps what it knows
+  oldOnly = -1;
+  st = oldConfig.load(prefs);
+  CHECK(st.source == GR_Config::FromBlob && st.loaded == 2 && st.defaulted == 1 && oldOnly == 7 && ld_accelG == 6.5f);
+}
+
+static void outOfRange() {
+  printf("Out of range / wrong type values\n");
+  // Written by a table with wider ranges (or by hand): ld_altN 500 is over 100, wi_channel 0 under 1
+  int wideAltN = 500, wideChannel = 0;
+  float accelG = 8;
+  const GR_ConfigItem wide[] = {
+    GR_CONFIG_INT(wideAltN, "ld_altN", 5, 0, 10000, "", 0, ""),
+    GR_CONFIG_INT(wideChannel, "wi_channel", 1, 0, 100, "", 0, ""),
+    GR_CONFIG_FLOAT(accelG, "ld_accelN", 3, 0, 100, "", 0, ""),  // Float where an int goes: fine if it's a whole number...
+  };
+  GR_Config wideConfig(wide, 3);
+  FilePrefs prefs("");
+  prefs.begin("config");
+  CHECK(wideConfig.save(prefs));
+  scramble();
+  GR_Config::LoadStats st = config.load(prefs);
+  CHECK(st.rejected == 2 && st.loaded == 1 && st.saved);
+  CHECK(ld_altSamples == 5 && wi_channel == 1 && ld_accelSamples == 8);
+
+  accelG = 8.5f; // ...but not if it isn't
+  CHECK(wideConfig.save(prefs));
+  st = config.load(prefs);
+  CHECK(st.rejected == 3 && ld_accelSamples == 30);
+
+  // Strings too long / short for the buffer
+  char longName[200];
+  memset(longName, 'a', sizeof(longName) - 1);
+  longName[sizeof(longName) - 1] = 0;
+  char shortPass[61] = "short";
+  const GR_ConfigItem strings[] = {
+    GR_CONFIG_STRING(longName, "wi_ssid", "", 0, 0, ""),
+    GR_CONFIG_STRING(shortPass, "wi_pass", "", 0, 0, ""),
+  };
+  GR_Config stringConfig(strings, 2);
+  CHECK(stringConfig.save(prefs));
+  st = config.load(prefs);
+  CHECK(st.rejected == 2 && !strcmp(wi_ssid, "Graphite") && !strcmp(wi_pass, "allthedata"));
+}
+
+static void corrupt() {
+  printf("Corrupt / truncated / newer blobs\n");
+  uint8_t blob[GR_CONFIG_BLOB_MAX];
+  config.setDefaults();
+  ld_accelG = 9;
+  size_t len = config.toBlob(blob, sizeof(blob));
+  CHECK(len > GR_CONFIG_HEADER_SIZE);
+  GR_Config::LoadStats st;
+  CHECK(config.fromBlob(blob, len, st) && ld_accelG == 9);
+
+  // Every single bit flip is caught (by the magic, the version, the lengths or the checksum)
+  int missed = 0;
+  for (size_t i = 0; i < len; i++) {
+    for (int b = 0; b < 8; b++) {
+      blob[i] ^= uint8_t(1 << b);
+      if (config.fromBlob(blob, len, st)) missed++;
+      blob[i] ^= uint8_t(1 << b);
+    }
+  }
+  CHECK(!missed);
+  // Every truncation too
+  missed = 0;
+  for (size_t n = 0; n < len; n++) if (config.fromBlob(blob, n, st)) missed++;
+  CHECK(!missed);
+  // A format from the future
+  blob[2] = GR_CONFIG_BLOB_VERSION + 1;
+  CHECK(!config.fromBlob(blob, len, st));
+  blob[2] = GR_CONFIG_BLOB_VERSION;
+
+  // load() with a bad blob falls back to defaults and rewrites it
+  FilePrefs prefs("");
+  prefs.begin("config");
+  blob[len - 1] ^= 0x55;
+  prefs.putBytes(GR_CONFIG_BLOB_KEY, blob, len);
+  scramble();
+  st = config.load(prefs);
+  CHECK(st.badBlob && st.source == GR_Config::FromDefaults && st.saved && atDefaults());
+  scramble();
+  st = config.load(prefs);
+  CHECK(!st.badBlob && st.source == GR_Config::FromBlob && atDefaults());
+
+  // Too big for the buffer: save() says so instead of writing half of it
+  char huge[255];
+  memset(huge, 'x', sizeof(huge) - 1);
+  huge[sizeof(huge) - 1] = 0;
+  GR_ConfigItem many[8];
+  char keys[8][8];
+  for (int i = 0; i < 8; i++) {
+    snprintf(keys[i], sizeof(keys[i]), "big%d", i);
+    many[i] = GR_CONFIG_STRING(huge, keys[i], "", 0, 0, "");
+  }
+  CHECK(!GR_Config(many, 8).save(prefs));
+}
+
+static void legacyKeys() {
+  printf("Old one-key-per-setting NVS layout\n");
+  FilePrefs prefs("");
+  prefs.begin("config");
+  // What setup() used to write. wi_channel was read + written with getFloat / putFloat, so it's a float
+  prefs.putString("wi_ssid", "OldSSID");
+  prefs.putString("wi_pass", "oldpassword");
+  prefs.putFloat("wi_channel", 6);
+  prefs.putFloat("cal_lapseRate", 0.0061f);
+  prefs.putFloat("cal_pAtSea", 100500);
+  prefs.putFloat("ld_accelG", 4.5f);
+  prefs.putInt("ld_accelN", 20);
+  prefs.putInt("ld_altN", 500);    // Out of range
+  prefs.putInt("unrelated", 42);   // Not ours, left alone
+  scramble();
+  GR_Config::LoadStats st = config.load(prefs);
+  CHECK(st.source == GR_Config::FromKeys && st.saved && st.loaded == 7 && st.rejected == 1 && st.defaulted == 3);
+  CHECK(!strcmp(wi_ssid, "OldSSID") && !strcmp(wi_pass, "oldpassword") && wi_channel == 6 && cal_lapseRate == 0.0061f &&
+        cal_pAtSea == 100500 && ld_accelG == 4.5f && ld_accelSamples == 20 && ld_altSamples == 5 && !strcmp(wi_address, "graphite"));
+  CHECK(!prefs.isKey("wi_ssid") && !prefs.isKey("wi_channel") && !prefs.isKey("ld_altN") && prefs.isKey("unrelated"));
+  scramble();
+  st = config.load(prefs);
+  CHECK(st.source == GR_Config::FromBlob && wi_channel == 6 && ld_accelG == 4.5f);
+}
+
+static void setAndJson() {
+  printf("set() / json()\n");
+  config.setDefaults();
+  CHECK(config.set("ld_accelG", "4.5") && ld_accelG == 4.5f);
+  CHECK(config.set("ld_accelN", " 45 ") && ld_accelSamples == 45);
+  CHECK(!config.set("ld_accelN", "45.5") && !config.set("ld_accelN", "4x") && !config.set("ld_accelN", "") && ld_accelSamples == 45);
+  CHECK(!config.set("ld_accelG", "1.0") && !config.set("ld_accelG", "nan") && !config.set("ld_accelG", "inf") && ld_accelG == 4.5f);
+  CHECK(!config.set("nope", "1") && !config.check("nope", "1"));
+  CHECK(config.check("wi_channel", "13") && !config.check("wi_channel", "14") && wi_channel == 1);
+  CHECK(!config.set("wi_pass", "short") && config.set("wi_pass", "longenough") && !strcmp(wi_pass, "longenough"));
+  char sixty[62];
+  memset(sixty, 'n', 61);
+  sixty[61] = 0;
+  CHECK(!config.set("wi_ssid", sixty));
+  sixty[60] = 0;
+  CHECK(config.set("wi_ssid", sixty) && strlen(wi_ssid) == 60);
+  CHECK(config.set("wi_ssid", "Say \"hi\"\n"));
+
+  static char json[4096];
+  size_t len = config.json(json, sizeof(json));
+  CHECK(len > 0 && len == strlen(json));
+  CHECK(!strstr(json, "longenough"));                        // Secret
+  CHECK(strstr(json, "\"key\":\"wi_pass\",\"type\":\"string\",\"secret\":true"));
+  CHECK(strstr(json, "\"value\":\"Say \\\"hi\\\"\\u000a\"")); // Escaped
+  CHECK(strstr(json, "\"key\":\"ld_accelG\",\"type\":\"float\",\"value\":4.5,\"default\":3,\"min\":1.5,\"max\":100,\"unit\":\"g\""));
+  CHECK(strstr(json, "\"key\":\"wi_channel\",\"type\":\"int\",\"value\":1,") && strstr(json, "\"reboot\":true"));
+  int depth = 0;
+  bool inString = false;
+  for (const char * p = json; *p; p++) {
+    if (inString) { if (*p == '\\') p++; else if (*p == '"') inString = false; continue; }
+    if (*p == '"') inString = true;
+    else if (*p == '{' || *p == '[') depth++;
+    else if (*p == '}' || *p == ']') depth--;
+  }
+  CHECK(!depth && !inString);
+  CHECK(!config.json(json, len)); // One byte short (no room for the terminator)
+  printf("  /config JSON: %zu bytes\n", len);
+}
+
+/// @brief Counts the calls that reach NVS
+class CountingPrefs : public FilePrefs {
+  public:
+    int calls = 0;
+    CountingPrefs() : FilePrefs("") {}
+    bool isKey(const char * key) override { calls++; return FilePrefs::isKey(key); }
+    int32_t getInt(const char * key, int32_t def = 0) override { calls++; return FilePrefs::getInt(key, def); }
+    float getFloat(const char * key, float def = 0) override { calls++; return FilePrefs::getFloat(key, def); }
+    size_t getString(const char * key, char * out, size_t max) override { calls++; return FilePrefs::getString(key, out, max); }
+    size_t getBytes(const char * key, void * out, size_t max) override { calls++; return FilePrefs::getBytes(key, out, max); }
+    size_t getBytesLength(const char * key) override { calls++; return FilePrefs::getBytesLength(key); }
+};
+
+/// @brief setup()'s old routine: isKey + get per setting (what load() replaced)
+static void loadPerKey(GR_Prefs& prefs) {
+  if (prefs.isKey("wi_ssid")) prefs.getString("wi_ssid", wi_ssid, sizeof(wi_ssid));
+  if (prefs.isKey("wi_pass")) prefs.getString("wi_pass", wi_pass, sizeof(wi_pass));
+  if (prefs.isKey("wi_address")) prefs.getString("wi_address", wi_address, sizeof(wi_address));
+  if (prefs.isKey("wi_channel")) wi_channel = prefs.getFloat("wi_channel", wi_channel);
+  if (prefs.isKey("cal_lapseRate")) cal_lapseRate = prefs.getFloat("cal_lapseRate", cal_lapseRate);
+  if (prefs.isKey("cal_magicExp")) cal_magicExp = prefs.getFloat("cal_magicExp", cal_magicExp);
+  if (prefs.isKey("cal_pAtSea")) cal_pAtSea = prefs.getFloat("cal_pAtSea", cal_pAtSea);
+  if (prefs.isKey("ld_accelG")) ld_accelG = prefs.getFloat("ld_accelG", ld_accelG);
+  if (prefs.isKey("ld_accelN")) ld_accelSamples = prefs.getInt("ld_accelN", ld_accelSamples);
+  if (prefs.isKey("ld_altFt")) ld_altFt = prefs.getFloat("ld_altFt", ld_altFt);
+  if (prefs.isKey("ld_altN")) ld_altSamples = prefs.getInt("ld_altN", ld_altSamples);
+}
+
+static void loadCost() {
+  printf("Load cost\n");
+  CountingPrefs blobPrefs, keyPrefs;
+  blobPrefs.begin("config");
+  keyPrefs.begin("config");
+  config.setDefaults();
+  config.save(blobPrefs);
+  keyPrefs.putString("wi_ssid", wi_ssid); keyPrefs.putString("wi_pass", wi_pass); keyPrefs.putString("wi_address", wi_address);
+  keyPrefs.putFloat("wi_channel", wi_channel); keyPrefs.putFloat("cal_lapseRate", cal_lapseRate); keyPrefs.putFloat("cal_magicExp", cal_magicExp);
+  keyPrefs.putFloat("cal_pAtSea", cal_pAtSea); keyPrefs.putFloat("ld_accelG", ld_accelG); keyPrefs.putInt("ld_accelN", ld_accelSamples);
+  keyPrefs.putFloat("ld_altFt", ld_altFt); keyPrefs.putInt("ld_altN", ld_altSamples);
+  scramble();
+  config.load(blobPrefs);
+  CHECK(atDefaults());
+  loadPerKey(keyPrefs);
+  CHECK(blobPrefs.calls == 2);
+  printf("  NVS calls: %d with the blob, %d one key per setting\n", blobPrefs.calls, keyPrefs.calls);
+
+  uint8_t blob[GR_CONFIG_BLOB_MAX];
+  size_t len = config.toBlob(blob, sizeof(blob));
+  GR_Config::LoadStats st;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < TIMING_LOADS; i++) config.fromBlob(blob, len, st);
+  double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count() / TIMING_LOADS;
+  CHECK(st.loaded == config.count());
+  printf("  Parsing the %zu byte blob: %.2f us (%d runs)\n", len, us, TIMING_LOADS);
+}
+
+int main() {
+  firstBoot();
+  roundTrip();
+  schemaChange();
+  outOfRange();
+  corrupt();
+  legacyKeys();
+  setAndJson();
+  loadCost();
+  printf("%s (%d failed)\n", failures ? "FAIL" : "PASS", failures);
+  return failures ? 1 : 0;
+}
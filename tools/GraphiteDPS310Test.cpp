@@ -0,0 +1,261 @@
+/* GraphiteDPS310Test.cpp
+    Host-side checks for the DPS310 driver (lib/GR_DPS310/GR_DPS310.h): the compensation against reference results worked from the
+    datasheet's equations (section 4.9, in double precision), unpacking the coefficients, which configs fit the sensor's time, and the
+    driver on a fake DPS310 (src/native/FakeDPS310.h): values, timestamps, and a FIFO overflow. Then how much of each second the I2C
+    bus spends on the barometer, polled the old way (Adafruit library: MEAS_CFG checks every sampler period and both result registers
+    for each new result, at the default 100kHz) against FIFO bursts.
+
+    Doesn't need the ESP toolchain or PlatformIO, just a c++17 compiler:
+      g++ -std=c++17 -O2 -Ilib/GR_DPS310 -Ilib/GR_SensorHAL -Ilib/GR_Align -Isrc/native tools/GraphiteDPS310Test.cpp -o GraphiteDPS310Test
+
+    Usage:
+      GraphiteDPS310Test           Run the checks, print the timestamp errors and bus time. Exits with 1 if any check fails
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include <GR_DPS310.h>
+#include <FakeDPS310.h>
+
+#define TICK_US 5000          // GR_Sampler's altimeter period
+#define TICK_LATE_US 2000     // Ticks land up to this much late (other tasks)
+#define RUN_S 20
+#define MAX_ERR_US 5000       // Stamps have to be within a sampler period of the middle of the measurement (polled, they were at the end)
+#define BURST 8               // Readings per readBuffered() (GR_Sampler's GR_BARO_BURST)
+
+static int failures = 0;
+#define CHECK(cond) do { if (!(cond)) { printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+static uint32_t rng = 12345;
+static uint32_t next(uint32_t range) {
+  rng = rng * 1664525u + 1013904223u;
+  return (rng >> 8) % range;
+}
+
+/// @brief Reference results for fakeDPS310Coefs: raw results at an oversampling rate, and what the datasheet's equations make of them
+struct Vector {
+  uint32_t tmpOversample, prsOversample;
+  int32_t tmpRaw, prsRaw;
+  double tempC, pressPa;
+};
+static const Vector vectors[] = {
+  {1, 8,    157866, -2517431,  25.008148,  95844.4522},  // Room temperature, ~500m up
+  {1, 8,    157866, -2867431,  25.008148,  98030.7223},
+  {1, 8,    227386, -2517431,  -9.997955,  95421.6217},  // Cold (the temperature terms matter)
+  {1, 8,    -40000, -1500001, 124.641602,  90435.9256},  // Hot
+  {2, 16,   473597,   -81203,  25.008316,  95827.0902},  // Other scale factors (and P_SHIFT territory)
+  {8, 64,  3000001,  -320001,   3.791959,  94967.4530},
+  {1, 128,       0,        0, 104.500000,  79882.0000},  // Zero raw: just c0 / 2 and c00
+  {1, 8,    157866, -8388607,  25.008148, 128421.4433},  // Ends of the 24 bit range
+  {1, 8,    157866,  8388607,  25.008148,   6191.0112},
+};
+
+static void compensation() {
+  printf("Compensation\n");
+  CHECK(GR_DPS310Comp::signExtend(0x800, 12) == -2048 && GR_DPS310Comp::signExtend(0x7FF, 12) == 2047);
+  CHECK(GR_DPS310Comp::signExtend(0xFFFFF, 20) == -1 && GR_DPS310Comp::signExtend(0x80000, 20) == -524288);
+  const uint8_t r[3] = {0xFF, 0xFF, 0xFE};
+  CHECK(GR_DPS310Comp::raw24(r) == -2);
+  CHECK(GR_DPS310Comp::scaleFactor(1) == 524288 && GR_DPS310Comp::scaleFactor(8) == 7864320 && GR_DPS310Comp::scaleFactor(128) == 2088960);
+  CHECK(GR_DPS310Comp::scaleFactor(3) == 0 && GR_DPS310Comp::measureMs(64) == 104.4f);
+
+  GR_DPS310Coefs c = GR_DPS310Comp::decode(fakeDPS310Coefs);
+  CHECK(c.c0 == 209 && c.c1 == -264);
+  CHECK(c.c00 == 79882 && c.c10 == -56040);
+  CHECK(c.c01 == -2829 && c.c11 == 1196 && c.c20 == -10372 && c.c21 == 225 && c.c30 == -1420);
+  const uint8_t neg[GR_DPS310_COEF_BYTES] = {0x80, 0x08, 0x00, 0x80, 0x00, 0x08, 0x00, 0x00}; // Every field at its most negative
+  GR_DPS310Coefs n = GR_DPS310Comp::decode(neg);
+  CHECK(n.c0 == -2048 && n.c1 == -2048 && n.c00 == -524288 && n.c10 == -524288 && n.c01 == 0);
+
+  double worstT = 0, worstP = 0;
+  for (const Vector& v : vectors) {
+    GR_DPS310Comp comp;
+    comp.begin(c, v.prsOversample, v.tmpOversample);
+    CHECK(!comp.hasTemperature());
+    comp.setTemperature(v.tmpRaw);
+    worstT = fmax(worstT, fabs(comp.tempC() - v.tempC));
+    worstP = fmax(worstP, fabs(comp.pressurePa(v.prsRaw) - v.pressPa));
+    int32_t raw[3] = {v.prsRaw, v.prsRaw / 2, -v.prsRaw};
+    float batch[3];
+    comp.pressurePa(raw, batch, 3);
+    CHECK(batch[0] == comp.pressurePa(raw[0]) && batch[1] == comp.pressurePa(raw[1]) && batch[2] == comp.pressurePa(raw[2]));
+  }
+  printf("  worst of %zu vectors: %.5f C, %.4f Pa\n", sizeof(vectors) / sizeof(vectors[0]), worstT, worstP);
+  CHECK(worstT < 1e-3);
+  CHECK(worstP < 0.05); // In float: well under the sensor's 0.5 Pa of noise at 8x
+}
+
+static void fits() {
+  printf("Fits\n");
+  CHECK(GR_DPS310::fits(GR_DPS310::defaults()));
+  CHECK(!GR_DPS310::fits({64, 64, 64, 64, 1}));  // The old config: 64 x 104ms a second, twice
+  CHECK(!GR_DPS310::fits({64, 16, 4, 1, 1}));    // 64 x 27.6ms
+  CHECK(GR_DPS310::fits({128, 2, 1, 1, 4}));
+  CHECK(!GR_DPS310::fits({48, 8, 4, 1, 1}));     // Not a rate it has
+  CHECK(!GR_DPS310::fits({64, 8, 4, 3, 1}));
+  CHECK(!GR_DPS310::fits({64, 8, 4, 1, 0}));
+}
+
+struct Run {
+  uint32_t results = 0;
+  double maxErrUs = 0;     // Worst timestamp error (from 1 s in)
+  double maxPressErr = 0;  // Worst pressure error (Pa)
+  double maxTempErr = 0;
+  bool ordered = true;
+  double busMsPerS = 0;
+  uint32_t resyncs = 0;
+};
+
+/// @brief The driver on a fake at hz, read every TICK_US (+ up to TICK_LATE_US) like GR_Sampler does. pauseAtS: stop reading for a
+///        second from then on (the FIFO fills up and overflows)
+static Run runDriver(GR_DPS310::Config cfg, uint32_t hz, double ppm, int pauseAtS = -1) {
+  FakeClock clock;
+  clock.advanceUs(1000000);
+  FakeDPS310 dev(clock, hz);
+  dev.rateErrorPpm = ppm;
+  dev.pressPa = 97000;
+  dev.tempC = 18;
+  GR_I2CMeter meter(dev);
+  GR_DPS310 baro(meter, clock);
+  Run r;
+  CHECK(baro.begin(cfg));
+  const uint64_t startUs = clock.micros(), endUs = startUs + RUN_S * 1000000ULL;
+  const uint64_t pauseUs = pauseAtS < 0 ? 0 : startUs + pauseAtS * 1000000ULL;
+  uint64_t settleUs = startUs + 1000000, lastUs = 0, busFromUs = 0, busFrom = 0;
+  uint64_t got = 0; // Results handed over (index into the fake's log, less the dropped ones)
+  for (uint64_t tick = startUs; tick < endUs; tick += TICK_US) {
+    if (pauseUs && tick >= pauseUs && tick < pauseUs + 1000000) continue;
+    if (pauseUs && tick >= pauseUs + 1000000 && settleUs <= pauseUs) settleUs = pauseUs + 2000000;
+    clock.sleepUntilUs(tick + next(TICK_LATE_US));
+    if (!busFromUs && clock.micros() >= settleUs) { busFromUs = clock.micros(); busFrom = meter.busUs(); }
+    GR_BaroReading buf[BURST];
+    size_t n;
+    do {
+      n = baro.readBuffered(buf, BURST);
+      for (size_t i = 0; i < n; i++, got++) {
+        const GR_BaroReading& b = buf[i];
+        if (b.timeUs <= lastUs) r.ordered = false;
+        lastUs = b.timeUs;
+        r.results++;
+        r.maxPressErr = fmax(r.maxPressErr, fabs(b.pressPa - dev.pressPa));
+        r.maxTempErr = fmax(r.maxTempErr, fabs(b.tempC - dev.tempC));
+        if (b.timeUs >= settleUs) r.maxErrUs = fmax(r.maxErrUs, fabs(double(b.timeUs) - double(dev.prsTakenUs(got + baro.dropped()))));
+      }
+    } while (n == BURST);
+  }
+  r.busMsPerS = double(meter.busUs() - busFrom) / 1000 / ((clock.micros() - busFromUs) / 1e6);
+  r.resyncs = baro.resyncs();
+  return r;
+}
+
+static void driver() {
+  printf("Driver\n");
+  GR_DPS310::Config cfg = GR_DPS310::defaults();
+  FakeClock clock;
+  FakeDPS310 dev(clock, 400000);
+  GR_DPS310 baro(dev, clock);
+  dev.setClockHz(400000);
+  CHECK(!baro.begin({64, 64, 64, 64, 1})); // Doesn't fit: never touches the sensor
+  CHECK(baro.begin(cfg));
+  CHECK(baro.available()); // Nothing read yet: has to look
+  GR_BaroReading one[4];
+  CHECK(baro.readBuffered(one, 4) == 0); // Not measured yet
+  clock.advanceUs(40000);
+  CHECK(baro.readBuffered(one, 4) == 2 && baro.dropped() == 0); // 14.8ms each, temperature first
+  CHECK(!baro.available()); // Next one's not due for 15ms
+  FakeDPS310 wrong(clock);
+  GR_DPS310 nobody(wrong, clock, 0x76);
+  CHECK(!nobody.begin(cfg));
+
+  Run nominal = runDriver(cfg, 800000, 0);
+  printf("  64Hz: %u results, stamps off by up to %.0f us, %.3f Pa, %.4f C\n", nominal.results, nominal.maxErrUs, nominal.maxPressErr,
+         nominal.maxTempErr);
+  CHECK(nominal.results >= 64 * RUN_S - 2 && nominal.results <= 64 * RUN_S);
+  CHECK(nominal.ordered && nominal.resyncs == 0);
+  CHECK(nominal.maxErrUs < MAX_ERR_US);
+  CHECK(nominal.maxPressErr < 0.1 && nominal.maxTempErr < 0.01);
+
+  Run slow = runDriver(cfg, 800000, 10000);
+  Run fast = runDriver(cfg, 800000, -10000);
+  printf("  timer 1%% slow: %.0f us, 1%% fast: %.0f us\n", slow.maxErrUs, fast.maxErrUs);
+  CHECK(slow.maxErrUs < MAX_ERR_US && slow.resyncs == 0 && slow.ordered);
+  CHECK(fast.maxErrUs < MAX_ERR_US && fast.resyncs == 0 && fast.ordered);
+
+  Run burst = runDriver({64, 8, 4, 1, 4}, 800000, 0);
+  printf("  burst of 4: %u results, %.0f us\n", burst.results, burst.maxErrUs);
+  CHECK(burst.results >= 64 * RUN_S - 8 && burst.ordered);
+  CHECK(burst.maxErrUs < 2 * MAX_ERR_US); // Fewer drains to pin the clock down with
+
+  Run paused = runDriver(cfg, 800000, 0, 8); // ~64 results in a 32 deep FIFO
+  printf("  reads stopped for 1 s: %u resync, %.0f us after\n", paused.resyncs, paused.maxErrUs);
+  CHECK(paused.resyncs == 1);
+  CHECK(paused.maxErrUs < MAX_ERR_US);
+}
+
+/// @brief What the Adafruit library did every sampler period: temperatureAvailable() / pressureAvailable() (a MEAS_CFG read each,
+///        the second only if the first said no), then for new data getEvents() (both result registers)
+class LegacyPoller {
+  public:
+    LegacyPoller(GR_I2CBus& bus) : bus_(bus) {}
+    bool begin() {
+      uint8_t coef[GR_DPS310_COEF_BYTES];
+      if (!bus_.readRegs(GR_DPS310_ADDR, GR_DPS310_COEF, coef, sizeof(coef))) return false;
+      return bus_.writeReg(GR_DPS310_ADDR, GR_DPS310_PRS_CFG, 0x66) && bus_.writeReg(GR_DPS310_ADDR, GR_DPS310_TMP_CFG, 0xE6) &&
+             bus_.writeReg(GR_DPS310_ADDR, GR_DPS310_CFG_REG, GR_DPS310_T_SHIFT | GR_DPS310_P_SHIFT) &&
+             bus_.writeReg(GR_DPS310_ADDR, GR_DPS310_MEAS_CFG, GR_DPS310_MEAS_CONT);
+    }
+    void poll() {
+      uint8_t meas, b[3];
+      bus_.readRegs(GR_DPS310_ADDR, GR_DPS310_MEAS_CFG, &meas, 1);
+      if (!(meas & GR_DPS310_TMP_RDY)) {
+        bus_.readRegs(GR_DPS310_ADDR, GR_DPS310_MEAS_CFG, &meas, 1);
+        if (!(meas & GR_DPS310_PRS_RDY)) return;
+      }
+      bus_.readRegs(GR_DPS310_ADDR, GR_DPS310_TMP_B2, b, 3);
+      bus_.readRegs(GR_DPS310_ADDR, GR_DPS310_PSR_B2, b, 3);
+    }
+  private:
+    GR_I2CBus& bus_;
+};
+
+static double legacyBusMsPerS(uint32_t hz) {
+  FakeClock clock;
+  FakeDPS310 dev(clock, hz);
+  GR_I2CMeter meter(dev);
+  LegacyPoller dps(meter);
+  CHECK(dps.begin());
+  clock.advanceUs(1000000);
+  meter.reset();
+  const uint64_t startUs = clock.micros();
+  for (uint64_t tick = startUs; tick < startUs + RUN_S * 1000000ULL; tick += TICK_US) {
+    clock.sleepUntilUs(tick);
+    dps.poll();
+  }
+  return double(meter.busUs()) / 1000 / RUN_S;
+}
+
+static void busTime() {
+  printf("I2C bus time for the barometer (ms per second)\n");
+  double before = legacyBusMsPerS(100000);
+  double before800 = legacyBusMsPerS(800000);
+  Run fifo100 = runDriver(GR_DPS310::defaults(), 100000, 0);
+  Run fifo = runDriver(GR_DPS310::defaults(), 800000, 0);
+  Run fifo4 = runDriver({64, 8, 4, 1, 4}, 800000, 0);
+  printf("  polled, 100kHz (before):    %6.2f\n", before);
+  printf("  polled, 800kHz:             %6.2f\n", before800);
+  printf("  FIFO, 100kHz:               %6.2f\n", fifo100.busMsPerS);
+  printf("  FIFO, 800kHz (after):       %6.2f\n", fifo.busMsPerS);
+  printf("  FIFO, 800kHz, burst of 4:   %6.2f\n", fifo4.busMsPerS);
+  CHECK(fifo100.busMsPerS < before / 2);
+  CHECK(fifo.busMsPerS < before / 10);
+  CHECK(fifo4.busMsPerS < fifo.busMsPerS);
+}
+
+int main() {
+  compensation();
+  fits();
+  driver();
+  busTime();
+  printf("%s (%d failed)\n", failures ? "FAIL" : "PASS", failures);
+  return failures ? 1 : 0;
+}
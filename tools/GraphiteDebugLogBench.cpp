@@ -0,0 +1,195 @@
+/* GraphiteDebugLogBench.cpp
+    Host-side ordering test + benchmark for the deferred debug queue (lib/GR_DebugLog/GR_DebugLog.h) behind debugMsg().
+
+    Doesn't need the ESP toolchain or PlatformIO, just a c++17 compiler:
+      g++ -std=c++17 -O2 -pthread -Ilib/GR_DebugLog -Ilib/GR_RingBuffer tools/GraphiteDebugLogBench.cpp -o GraphiteDebugLogBench
+
+    A few producer threads (standing in for the sampling / web server / log writer tasks) send numbered messages mixing the
+    argument types debugMsg() uses: literals, copied strings long enough to split over several records, ints and floats. One
+    drain thread writes the text to a fake serial port that takes a fixed time per byte. Run at a few port speeds.
+
+    Checks: every message that comes out is whole and each producer's messages arrive in the order they were sent (dropped ones
+    just leave gaps), and a put() costs the producer about the same however slow the port is: the median queued put() at each port
+    speed has to be within MAX_COST_RATIO (+ MAX_COST_SLACK_NS) of the instant port's, and a dropped one no dearer than a queued one.
+    Exits non-zero if not.
+
+    Queued and dropped put()s are timed separately. Once the port falls behind the queue is full nearly all the time, so almost every
+    put() is a drop, which only checks the free space and counts it; lumped together, the slow ports looked several times cheaper than
+    the instant one (which queues every message, its records landing on cache lines the drain thread is busy reading).
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <GR_DebugLog.h>
+
+#define PRODUCERS 3
+#define MESSAGES 5000             // Per producer, per run
+#define QUEUE_RECORDS 1024        // Same as WL_DEBUG_QUEUE
+#define MESSAGE_GAP_US 100        // Producers send a message this often (way more than any serial port can keep up with)
+#define MAX_COST_RATIO 2.0        // Most a queued put()'s median cost can grow from the instant port's at a slower one...
+#define MAX_COST_SLACK_NS 100     // ...plus this (timer resolution + scheduling noise on a busy dev box)
+
+struct StdLock {
+  std::mutex m;
+  void lock() { m.lock(); }
+  void unlock() { m.unlock(); }
+};
+
+typedef GR_DebugLog<QUEUE_RECORDS, StdLock> DebugLog;
+
+static double nowUs() {
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Fake serial port: collects the text, and makes the caller wait as long as the bytes would take to send
+struct SlowPort {
+  double usPerByte;
+  double busyUntil = 0;
+  std::string text;
+  void write(const char * s, size_t n) {
+    text.append(s, n);
+    if (usPerByte <= 0) return;
+    double t = nowUs();
+    busyUntil = (busyUntil > t ? busyUntil : t) + n * usPerByte;
+    while (nowUs() < busyUntil) std::this_thread::yield();
+  }
+};
+
+struct Result {
+  double queuedNs, queuedP99Ns, droppedNs; // put() cost, median (+ p99) of the ones that were queued / dropped
+  size_t queuedPuts;
+  uint32_t dropped;
+  long lines;
+  bool ok;
+};
+
+/// @brief The p quantile of some timings (sorts them). 0 if there aren't any
+static double quantile(std::vector<uint32_t>& ns, double p) {
+  if (ns.empty()) return 0;
+  std::sort(ns.begin(), ns.end());
+  return ns[size_t(p * (ns.size() - 1))];
+}
+
+static Result run(uint32_t baud) {
+  static DebugLog log; // static: ~16KB of records
+  SlowPort port;
+  port.usPerByte = baud ? 10e6 / baud : 0; // 10 bits per byte (8N1)
+  port.busyUntil = 0;
+  log.drain([](const char *, size_t) {}); // Clean slate (previous run's leftovers / drop warning)
+  uint32_t dropped0 = log.dropped();
+
+  std::atomic<bool> done{false};
+  std::thread consumer([&] {
+    for (;;) {
+      bool last = done.load();
+      if (log.drain([&](const char * s, size_t n) { port.write(s, n); }, 64) == 0) {
+        if (last) break;
+        std::this_thread::sleep_for(std::chrono::microseconds(200)); // WL_DEBUG_TASK_POLL_MS, scaled down
+      }
+    }
+  });
+
+  std::vector<uint32_t> queuedNs[PRODUCERS], droppedNs[PRODUCERS]; // Each put()'s cost, by whether it got queued
+  std::vector<std::thread> producers;
+  for (int p = 0; p < PRODUCERS; p++) {
+    producers.emplace_back([&, p] {
+      char msg[96];
+      double next = nowUs();
+      auto timed = [&](auto&& put) {
+        auto t0 = std::chrono::steady_clock::now();
+        bool queued = put();
+        uint32_t ns = uint32_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count());
+        (queued ? queuedNs[p] : droppedNs[p]).push_back(ns);
+      };
+      for (uint32_t i = 0; i < MESSAGES; i++) {
+        next += MESSAGE_GAP_US;
+        while (nowUs() < next) std::this_thread::yield();
+        snprintf(msg, sizeof(msg), "[P%d %06u producer-%d-with-a-name-long-enough-to-span-records]", p, i, p);
+        // Like one of the logger's chained lines: a copied string (6 records, queued as one), then a literal, an int and a float.
+        // Separate put()s from different producers can interleave (same as Serial.print), a single put() never does
+        timed([&] { return log.put(msg, false); });
+        timed([&] { return log.put(" v=", false, true); });
+        timed([&] { return log.put(i, false); });
+        timed([&] { return log.put(' ', false); });
+        timed([&] { return log.put(i / 2.0, true, 1); });
+      }
+    });
+  }
+  for (auto& t : producers) t.join();
+  done = true;
+  consumer.join();
+
+  Result r;
+  std::vector<uint32_t> queued, dropped;
+  for (int p = 0; p < PRODUCERS; p++) {
+    queued.insert(queued.end(), queuedNs[p].begin(), queuedNs[p].end());
+    dropped.insert(dropped.end(), droppedNs[p].begin(), droppedNs[p].end());
+  }
+  r.queuedPuts = queued.size();
+  r.queuedNs = quantile(queued, 0.5);
+  r.queuedP99Ns = quantile(queued, 0.99);
+  r.droppedNs = quantile(dropped, 0.5);
+  r.dropped = log.dropped() - dropped0;
+
+  // Every "[P..]" string must come out whole, and each producer's must be in the order they were sent (drops leave gaps)
+  r.lines = 0;
+  r.ok = true;
+  long last[PRODUCERS];
+  for (auto& l : last) l = -1;
+  const char * s = port.text.c_str();
+  while ((s = strstr(s, "[P")) != nullptr) {
+    int p = -1, p2 = -1, used = 0;
+    long i = -1;
+    char expect[96];
+    if (sscanf(s, "[P%d %ld producer-%d-%n", &p, &i, &p2, &used) < 3 || p != p2 || p < 0 || p >= PRODUCERS) {
+      printf("    torn message: %.40s\n", s);
+      r.ok = false;
+      break;
+    }
+    int n = snprintf(expect, sizeof(expect), "[P%d %06ld producer-%d-with-a-name-long-enough-to-span-records]", p, i, p);
+    if (strncmp(s, expect, n) != 0) {
+      printf("    torn message: %.*s\n", n, s);
+      r.ok = false;
+      break;
+    }
+    if (i <= last[p]) {
+      printf("    out of order: producer %d sent %ld after %ld\n", p, i, last[p]);
+      r.ok = false;
+    }
+    last[p] = i;
+    r.lines++;
+    s += n;
+  }
+  return r;
+}
+
+int main() {
+  // 0 = instant sink, then the logger's 115200 USB serial, then slower UARTs where the queue overflows
+  const uint32_t bauds[] = {0, 921600, 115200, 9600};
+  bool ok = true;
+  double instantNs = 0;
+  printf("%d producers x %d messages (5 put()s, 9 records each), a message every %d us per producer, queue %d records\n", PRODUCERS,
+         MESSAGES, MESSAGE_GAP_US, QUEUE_RECORDS);
+  printf("  %-10s %22s %14s %10s %10s  %s\n", "port", "queued put() med/p99", "dropped put()", "dropped", "received", "ordering");
+  for (uint32_t baud : bauds) {
+    Result r = run(baud);
+    char name[16];
+    if (baud) snprintf(name, sizeof(name), "%u", baud);
+    else snprintf(name, sizeof(name), "instant");
+    if (!baud) instantNs = r.queuedNs;
+    bool flat = r.queuedNs <= instantNs * MAX_COST_RATIO + MAX_COST_SLACK_NS && r.droppedNs <= r.queuedNs + MAX_COST_SLACK_NS;
+    printf("  %-10s %9.0f / %6.0f ns %11.0f ns %10u %10ld  %s%s\n", name, r.queuedNs, r.queuedP99Ns, r.droppedNs, r.dropped, r.lines,
+           r.ok ? "ok" : "FAILED", flat ? "" : "  (put() cost FAILED)");
+    ok &= r.ok && flat && r.queuedPuts > 0;
+  }
+  printf("(dropped counts put() calls, received counts whole strings that came out)\nA queued put() should cost about the same at every "
+         "port speed, and a dropped one less; drops just mean the port couldn't keep up\n");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,140 @@
+/* GraphiteFilterTest.cpp
+    Host-side checks for the accelerometer's decimating FIR (lib/GR_Filter/GR_Filter.h) with the logger's design (Blackman windowed
+    sinc, 48 taps, 350Hz cutoff at 4kHz, decimated by 4 to 1kHz): unity DC gain, symmetric taps (linear phase, so groupDelay() holds),
+    the streaming filter's impulse response matching the taps at every decimation phase, and how well it keeps out what would alias
+    once the rate's dropped: at the new Nyquist (500Hz) and across everything that folds back onto the 0-350Hz passband (650Hz+).
+
+    Doesn't need the ESP toolchain or PlatformIO, just a c++17 compiler:
+      g++ -std=c++17 -O2 -Ilib/GR_Filter tools/GraphiteFilterTest.cpp -o GraphiteFilterTest
+
+    Usage:
+      GraphiteFilterTest    Run the checks, printing the response at a few frequencies. Exits with 1 if any check fails
+*/
+#include <stdio.h>
+#include <math.h>
+#include <initializer_list>
+#include <GR_Filter.h>
+
+// Same defaults as main.cpp
+#define io_accelDMAHz 4000
+#define io_accelDecimation 4
+#define io_accelFIRTaps 48
+#define io_accelFIRCutoff 0.0875f
+
+#define MIN_NYQUIST_DB 30   // Least attenuation at the decimated Nyquist (the design gives ~32dB; it's only 150Hz past the cutoff)
+#define MIN_ALIAS_DB 70     // Least attenuation over everything that aliases onto the passband (the design gives ~75dB; the ADC's ~12 bits
+                            // only go down ~72dB)
+#define MAX_RIPPLE_DB 0.5   // Most the passband droops below 200Hz
+
+static int failures = 0;
+#define CHECK(cond) do { if (!(cond)) { printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+static const double pi = 3.14159265358979323846;
+
+static double dB(double gain) { return 20 * log10(gain); }
+
+/// @brief Frequency in Hz as a fraction of the ADC rate
+static float frac(double hz) { return float(hz / io_accelDMAHz); }
+
+static void design(float * h, size_t taps, float cutoff) {
+  GR_FIR::designLowPass(h, taps, cutoff);
+  double sum = 0;
+  for (size_t i = 0; i < taps; i++) sum += h[i];
+  CHECK(fabs(sum - 1) < 1e-5);
+  CHECK(fabs(GR_FIR::magnitude(h, taps, 0) - 1) < 1e-5);
+  bool symmetric = true;
+  for (size_t i = 0; i < taps / 2; i++) symmetric &= fabsf(h[i] - h[taps - 1 - i]) <= 1e-7f;
+  CHECK(symmetric);
+}
+
+static void taps() {
+  printf("Taps\n");
+  float h[io_accelFIRTaps];
+  design(h, io_accelFIRTaps, io_accelFIRCutoff);
+  CHECK(h[io_accelFIRTaps / 2] > 0 && h[io_accelFIRTaps / 2] == h[io_accelFIRTaps / 2 - 1]); // Even length: the peak's the middle pair
+  float odd[31], one[1];
+  design(odd, 31, 0.2f);                 // Odd lengths too (a single middle tap)
+  design(one, 1, 0.1f);
+  CHECK(one[0] == 1.0f);
+}
+
+/// @brief A unit impulse through the streaming filter lands on each decimation phase in turn; the outputs must trace out the taps
+static void impulse() {
+  printf("Impulse response\n");
+  float h[io_accelFIRTaps];
+  GR_FIR::designLowPass(h, io_accelFIRTaps, io_accelFIRCutoff);
+  for (size_t offset = 0; offset < io_accelDecimation; offset++) {
+    GR_DecimatingFIR<io_accelFIRTaps, io_accelDecimation> fir(h);
+    float out;
+    size_t n = 0, outputs = 0;
+    bool matches = true;
+    for (; n < offset; n++) fir.push(0, out);
+    size_t at = n++; // Where the impulse went in
+    if (fir.push(1, out)) { matches &= fabsf(out - h[0]) <= 1e-7f; outputs++; }
+    for (; n < at + io_accelFIRTaps + 2 * io_accelDecimation; n++) {
+      if (!fir.push(0, out)) continue;
+      size_t k = n - at; // Samples since the impulse: it's under tap k
+      matches &= fabsf(out - (k < io_accelFIRTaps ? h[k] : 0.0f)) <= 1e-7f;
+      outputs++;
+    }
+    CHECK(matches);
+    CHECK(outputs == (at + io_accelFIRTaps + 2 * io_accelDecimation) / io_accelDecimation);
+  }
+  CHECK((GR_DecimatingFIR<io_accelFIRTaps, io_accelDecimation>::groupDelay() == (io_accelFIRTaps - 1) / 2.0f));
+}
+
+/// @brief Amplitude of the filter's output for a unit tone at hz, once it's settled. Sine and cosine both go through (their mean squares
+///        add up to the amplitude squared whatever the phase, which matters for a tone that lands on the output Nyquist)
+static double streamGain(const float * h, double hz) {
+  double sum = 0;
+  size_t count = 0;
+  for (double phase : {0.0, pi / 2}) {
+    GR_DecimatingFIR<io_accelFIRTaps, io_accelDecimation> fir(h);
+    float out;
+    for (size_t n = 0; n < 40000; n++) {
+      if (!fir.push(float(sin(2 * pi * hz * n / io_accelDMAHz + phase)), out) || n < 4 * io_accelFIRTaps) continue;
+      sum += double(out) * out;
+      count++;
+    }
+  }
+  return sqrt(2 * sum / count);
+}
+
+static void response() {
+  printf("Response (%d taps, cutoff %.0fHz, %dHz in, %dHz out)\n", io_accelFIRTaps, io_accelFIRCutoff * io_accelDMAHz, io_accelDMAHz,
+         io_accelDMAHz / io_accelDecimation);
+  float h[io_accelFIRTaps];
+  GR_FIR::designLowPass(h, io_accelFIRTaps, io_accelFIRCutoff);
+  const double cutoffHz = io_accelFIRCutoff * io_accelDMAHz, outHz = double(io_accelDMAHz) / io_accelDecimation;
+
+  double nyquistDb = -dB(GR_FIR::magnitude(h, io_accelFIRTaps, frac(outHz / 2)));
+  double aliasDb = 1e9, aliasAtHz = 0; // Worst case over everything that lands on 0-cutoffHz once decimated
+  for (double hz = outHz - cutoffHz; hz <= io_accelDMAHz / 2.0; hz += 0.5) {
+    double db = -dB(GR_FIR::magnitude(h, io_accelFIRTaps, frac(hz)));
+    if (db < aliasDb) { aliasDb = db; aliasAtHz = hz; }
+  }
+  double droopDb = 0;
+  for (double hz = 0; hz <= 200; hz += 0.5) droopDb = fmax(droopDb, -dB(GR_FIR::magnitude(h, io_accelFIRTaps, frac(hz))));
+  printf("  %.1fdB down at the output Nyquist (%.0fHz), at least %.1fdB down where it aliases (worst at %.1fHz), %.2fdB droop to 200Hz\n",
+         nyquistDb, outHz / 2, aliasDb, aliasAtHz, droopDb);
+  CHECK(nyquistDb >= MIN_NYQUIST_DB);
+  CHECK(aliasDb >= MIN_ALIAS_DB);
+  CHECK(droopDb <= MAX_RIPPLE_DB);
+  CHECK(fabs(dB(GR_FIR::magnitude(h, io_accelFIRTaps, io_accelFIRCutoff)) + 6.02) < 0.1); // Windowed sinc: half amplitude at the cutoff
+
+  // The same through the streaming filter (tones in, decimated tones / aliases out)
+  double tones[] = {50, 200, outHz / 2, outHz - cutoffHz, 800, 1500};
+  for (double hz : tones) {
+    double got = streamGain(h, hz), want = GR_FIR::magnitude(h, io_accelFIRTaps, frac(hz));
+    printf("  %6.0fHz in: %7.1fdB out\n", hz, dB(got));
+    CHECK(fabs(got - want) <= 1e-5 + want * 0.01);
+  }
+}
+
+int main() {
+  taps();
+  impulse();
+  response();
+  printf("%s (%d failed)\n", failures ? "FAIL" : "PASS", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,264 @@
+/* GraphiteFlightLogTest.cpp
+    Host-side round trip checks for the flight log format (lib/GR_FlightLog/GR_FlightLog.h): headers, sample / event / config records
+    made with the make* helpers, written out as bytes, read back (GR_LogUnpacker, like the decoder) and formatted with formatCsv, then
+    the CSV parsed back and compared with what went in. Plus the number formatting corners (putFixed / putI64) and the records
+    formatCsv has to skip.
+
+    Doesn't need the ESP toolchain or PlatformIO, just a c++17 compiler:
+      g++ -std=c++17 -O2 -Ilib/GR_FlightLog tools/GraphiteFlightLogTest.cpp -o GraphiteFlightLogTest
+
+    Usage:
+      GraphiteFlightLogTest    Run the checks. Exits with 1 if any check fails
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <GR_FlightLog.h>
+#include <GR_LogPack.h>
+
+#define START_US 5000000ULL  // Header startUs (records are stamped relative to it)
+
+static int failures = 0;
+#define CHECK(cond) do { if (!(cond)) { printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+/// @brief A header with made up calibration constants, the way the logger fills one in
+static GR_LogHeader header() {
+  GR_LogHeader h = GR_FlightLog::makeHeader(START_US);
+  h.cal_pAtSea = 101325.0f;
+  h.cal_lapseRate = 0.0065f;
+  h.cal_magicExp = 0.190263f;
+  h.cal_zeroXAccel = 2048; h.cal_zeroYAccel = 2040; h.cal_zeroZAccel = 2056;
+  h.cal_xAccelCoef = 0.0977f; h.cal_yAccelCoef = 0.0979f; h.cal_zAccelCoef = 0.0975f;
+  return h;
+}
+
+/// @brief One record to bytes and back through the unpacker, the way the decoder reads a plain log
+static GR_LogRecord throughFile(const GR_LogHeader& h, const GR_LogRecord& in) {
+  uint8_t unit[sizeof(GR_LogRecord)];
+  memcpy(unit, &in, sizeof(in));
+  GR_LogUnpacker u;
+  GR_LogRecord out;
+  memset(&out, 0xAA, sizeof(out));
+  CHECK(u.begin(h, unit) && u.next(out) && !u.next(out));
+  return out;
+}
+
+/// @brief formatCsv() split into its fields (the trailing newline checked and dropped)
+static std::vector<std::string> csv(const GR_LogHeader& h, const GR_LogRecord& r) {
+  char line[GR_LOG_CSV_MAX_LINE];
+  size_t n = GR_FlightLog::formatCsv(h, r, line);
+  std::vector<std::string> f;
+  CHECK(n > 0 && n < GR_LOG_CSV_MAX_LINE && line[n - 1] == '\n');
+  if (!n) return f;
+  std::string s(line, n - 1);
+  size_t at = 0;
+  for (size_t comma; (comma = s.find(',', at)) != std::string::npos; at = comma + 1) f.push_back(s.substr(at, comma - at));
+  f.push_back(s.substr(at));
+  return f;
+}
+
+static size_t columns() {
+  size_t n = 1;
+  for (const char * p = GR_FlightLog::csvHeader(); *p; p++) n += *p == ',';
+  return n;
+}
+
+// Columns, as in csvHeader()
+enum { C_TIME, C_TYPE, C_XRAW, C_YRAW, C_ZRAW, C_XG, C_YG, C_ZG, C_PRESS, C_TEMP, C_ALTM, C_ALTFT, C_BATT, C_EVENT, C_ARG };
+
+static bool near(const std::string& field, double want, double tol) { return !field.empty() && fabs(atof(field.c_str()) - want) <= tol; }
+
+static void headers() {
+  printf("Header\n");
+  GR_LogHeader h = header();
+  GR_LogHeader back;
+  memcpy(&back, &h, sizeof(h)); // As written / read
+  CHECK(GR_FlightLog::checkHeader(back));
+  CHECK(back.version == 1 && back.packBlock == 0 && back.headerSize == 64 && back.recordSize == 32 && back.startUs == START_US);
+  CHECK(back.cal_pAtSea == h.cal_pAtSea && back.cal_zeroZAccel == 2056 && back.cal_yAccelCoef == h.cal_yAccelCoef);
+  CHECK(GR_FlightLog::checkHeader(GR_FlightLog::makeHeader(0, 512)) && GR_FlightLog::makeHeader(0, 512).version == 2);
+
+  GR_LogHeader bad = h;
+  bad.magic[0] = 'X';
+  CHECK(!GR_FlightLog::checkHeader(bad));
+  bad = h; bad.version = GR_LOG_VERSION + 1;
+  CHECK(!GR_FlightLog::checkHeader(bad));
+  bad = h; bad.version = 0;
+  CHECK(!GR_FlightLog::checkHeader(bad));
+  bad = h; bad.recordSize = 16;
+  CHECK(!GR_FlightLog::checkHeader(bad));
+  bad = h; bad.packBlock = 512; // Packed needs version 2
+  CHECK(!GR_FlightLog::checkHeader(bad));
+  bad = h; bad.recordSize = 48; bad.headerSize = 80; // A newer logger appending fields is still readable
+  CHECK(GR_FlightLog::checkHeader(bad));
+
+  size_t n = columns();
+  CHECK(n == C_ARG + 1);
+}
+
+static void samples() {
+  printf("Samples\n");
+  GR_LogHeader h = header();
+  GR_LogRecord in = GR_FlightLog::makeSample(START_US + 12345678, GR_SAMPLE_ACCEL | GR_SAMPLE_BARO | GR_SAMPLE_BATT, 3000, 1000, 4095,
+                                             89874.56f, -12.34f, 2711);
+  GR_LogRecord r = throughFile(h, in);
+  CHECK(memcmp(&r, &in, sizeof(r)) == 0);
+  std::vector<std::string> f = csv(h, r);
+  CHECK(f.size() == columns());
+  if (f.size() != columns()) return;
+  CHECK(f[C_TIME] == "12.345678" && f[C_TYPE] == "sample");
+  CHECK(f[C_XRAW] == "3000" && f[C_YRAW] == "1000" && f[C_ZRAW] == "4095");
+  CHECK(near(f[C_XG], GR_FlightLog::accelG(3000, 2048, h.cal_xAccelCoef), 0.0005));
+  CHECK(near(f[C_YG], GR_FlightLog::accelG(1000, 2040, h.cal_yAccelCoef), 0.0005) && f[C_YG][0] == '-');
+  CHECK(near(f[C_ZG], GR_FlightLog::accelG(4095, 2056, h.cal_zAccelCoef), 0.0005));
+  CHECK(f[C_PRESS] == "89874.56" && f[C_TEMP] == "-12.34");
+  float altM = GR_FlightLog::altitudeM(h, 89874.56f, -12.34f);
+  CHECK(altM > 900 && altM < 1100); // About a km up at 899 hPa
+  CHECK(near(f[C_ALTM], altM, 0.005) && near(f[C_ALTFT], altM * 3.280839895, 0.01));
+  CHECK(f[C_BATT] == "2711" && f[C_EVENT].empty() && f[C_ARG].empty());
+
+  // Only what was measured: the other columns stay empty
+  r = throughFile(h, GR_FlightLog::makeSample(START_US + 1, GR_SAMPLE_BARO, 1, 2, 3, 101325.0f, 15.0f, 4));
+  f = csv(h, r);
+  CHECK(f.size() == columns());
+  if (f.size() != columns()) return;
+  CHECK(f[C_TIME] == "0.000001");
+  for (int c : {C_XRAW, C_YRAW, C_ZRAW, C_XG, C_YG, C_ZG, C_BATT}) CHECK(f[c].empty());
+  CHECK(f[C_PRESS] == "101325.00" && f[C_TEMP] == "15.00" && near(f[C_ALTM], 0, 0.005));
+
+  r = throughFile(h, GR_FlightLog::makeSample(START_US, GR_SAMPLE_ACCEL, 2048, 2040, 2056, 0, 0, 0));
+  f = csv(h, r);
+  CHECK(f.size() == columns());
+  if (f.size() != columns()) return;
+  CHECK(f[C_TIME] == "0.000000" && f[C_XG] == "0.000" && f[C_YG] == "0.000" && f[C_ZG] == "0.000");
+  for (int c : {C_PRESS, C_TEMP, C_ALTM, C_ALTFT, C_BATT}) CHECK(f[c].empty());
+}
+
+static void times() {
+  printf("Times\n");
+  GR_LogHeader h = header();
+  // Pre-launch history can be stamped before the log was opened
+  struct { uint64_t us; const char * want; } cases[] = {
+    {START_US - 500000, "-0.500000"}, {START_US - 1, "-0.000001"}, {START_US - 1000000, "-1.000000"},
+    {START_US - 2250000, "-2.250000"}, {START_US + 999999, "0.999999"}, {START_US + 3600000000ULL, "3600.000000"},
+  };
+  for (auto& c : cases) {
+    std::vector<std::string> f = csv(h, GR_FlightLog::makeEvent(c.us, GR_EVT_HISTORY, 1));
+    CHECK(!f.empty() && f[C_TIME] == c.want);
+    if (!f.empty() && f[C_TIME] != c.want) printf("    got %s, want %s\n", f[C_TIME].c_str(), c.want);
+  }
+}
+
+static void events() {
+  printf("Events\n");
+  GR_LogHeader h = header();
+  GR_LogRecord in = GR_FlightLog::makeEvent(START_US + 2000000, GR_EVT_OVERFLOW, -42, 1.5f);
+  GR_LogRecord r = throughFile(h, in);
+  CHECK(memcmp(&r, &in, sizeof(r)) == 0 && r.event.fArg == 1.5f);
+  std::vector<std::string> f = csv(h, r);
+  CHECK(f.size() == columns());
+  if (f.size() != columns()) return;
+  CHECK(f[C_TIME] == "2.000000" && f[C_TYPE] == "event" && f[C_EVENT] == "overflow" && f[C_ARG] == "-42");
+  for (int c = C_XRAW; c <= C_BATT; c++) CHECK(f[c].empty());
+
+  for (uint16_t code = GR_EVT_ARMED; code <= GR_EVT_WALL_CLOCK; code++) { // Every code has its own name
+    CHECK(strcmp(GR_FlightLog::eventName(code), "unknown") != 0);
+    for (uint16_t other = GR_EVT_ARMED; other < code; other++) CHECK(strcmp(GR_FlightLog::eventName(code), GR_FlightLog::eventName(other)) != 0);
+  }
+  f = csv(h, GR_FlightLog::makeEvent(START_US, 999, INT32_MIN));
+  CHECK(f.size() == columns() && f[C_EVENT] == "unknown" && f[C_ARG] == "-2147483648");
+
+  // The wall clock event lands on a whole second of the wall clock
+  int64_t offset = 1700000000LL * 1000000 + 250000 - int64_t(START_US); // Wall clock = logger micros() + offset
+  r = throughFile(h, GR_FlightLog::makeWallClock(START_US + 3000000, offset, true));
+  CHECK(r.event.code == GR_EVT_WALL_CLOCK && r.event.iArg == 1700000003 && r.event.fArg == 1.0f);
+  CHECK(int64_t(r.timeUs) + offset == 1700000003LL * 1000000);
+  f = csv(h, r);
+  CHECK(f.size() == columns() && f[C_TIME] == "2.750000" && f[C_EVENT] == "wall_clock" && f[C_ARG] == "1700000003");
+}
+
+static void configs() {
+  printf("Config\n");
+  GR_LogHeader h = header();
+  GR_LogRecord in = GR_FlightLog::makeConfig(START_US, "sample_hz", false, 1000, 0);
+  GR_LogRecord r = throughFile(h, in);
+  CHECK(memcmp(&r, &in, sizeof(r)) == 0);
+  std::vector<std::string> f = csv(h, r);
+  CHECK(f.size() == columns());
+  if (f.size() != columns()) return;
+  CHECK(f[C_TYPE] == "config" && f[C_EVENT] == "sample_hz" && f[C_ARG] == "1000");
+  for (int c = C_XRAW; c <= C_BATT; c++) CHECK(f[c].empty());
+
+  // A key using all 16 chars has no terminator in the record, and a longer one is cut to 16
+  r = throughFile(h, GR_FlightLog::makeConfig(START_US, "abcdefghijklmnop", false, -7, 0));
+  char key[sizeof(r.config.key) + 1];
+  GR_FlightLog::configKey(r, key);
+  CHECK(strcmp(key, "abcdefghijklmnop") == 0);
+  f = csv(h, r);
+  CHECK(f.size() == columns() && f[C_EVENT] == "abcdefghijklmnop" && f[C_ARG] == "-7");
+  r = throughFile(h, GR_FlightLog::makeConfig(START_US, "abcdefghijklmnopqrst", false, 1, 0));
+  GR_FlightLog::configKey(r, key);
+  CHECK(strcmp(key, "abcdefghijklmnop") == 0);
+
+  // Floats keep ~7 significant digits whatever their size
+  float values[] = {0.0065f, -0.190263f, 3.14159f, 12.5f, 101325.0f, 123456.7f, -9876.543f, 0};
+  for (float v : values) {
+    r = throughFile(h, GR_FlightLog::makeConfig(START_US, "f", true, 0, v));
+    CHECK(r.config.isFloat && r.config.fValue == v);
+    f = csv(h, r);
+    CHECK(f.size() == columns() && f[C_EVENT] == "f");
+    if (f.size() != columns()) continue;
+    double got = atof(f[C_ARG].c_str());
+    CHECK(fabs(got - v) <= fabs(v) * 1e-6 + 1e-6);
+    if (fabs(got - v) > fabs(v) * 1e-6 + 1e-6) printf("    %.9g came out as %s\n", v, f[C_ARG].c_str());
+  }
+}
+
+static void numbers() {
+  printf("Number formatting\n");
+  char buf[64];
+  auto fixed = [&](float v, int d) { return std::string(buf, GR_FlightLog::putFixed(buf, v, d) - buf); };
+  auto i64 = [&](int64_t v) { return std::string(buf, GR_FlightLog::putI64(buf, v) - buf); };
+  CHECK(fixed(0, 2) == "0.00" && fixed(1.005f, 0) == "1" && fixed(2.5f, 0) == "3" && fixed(-2.5f, 0) == "-3");
+  CHECK(fixed(-0.004f, 2) == "0.00" && fixed(-0.006f, 2) == "-0.01" && fixed(0.999999f, 3) == "1.000");
+  CHECK(fixed(-12.345f, 1) == "-12.3" && fixed(0.05f, 6) == "0.050000" && fixed(7, 9) == "7.000000" && fixed(7, -1) == "7");
+  CHECK(fixed(NAN, 2) == "nan" && fixed(INFINITY, 2) == "nan" && fixed(-INFINITY, 2) == "nan" && fixed(1e16f, 2) == "nan");
+  CHECK(i64(0) == "0" && i64(-1) == "-1" && i64(INT64_MAX) == "9223372036854775807" && i64(INT64_MIN) == "-9223372036854775808");
+  CHECK(std::string(buf, GR_FlightLog::putU64(buf, UINT64_MAX) - buf) == "18446744073709551615");
+}
+
+static void skipped() {
+  printf("Skipped records\n");
+  GR_LogHeader h = header();
+  char line[GR_LOG_CSV_MAX_LINE];
+  GR_LogRecord r;
+  memset(&r, 0, sizeof(r)); // What GR_LogWriter pads a sector out with
+  CHECK(r.type == GR_REC_PAD && GR_FlightLog::formatCsv(h, r, line) == 0);
+  r = GR_FlightLog::makeEvent(START_US, GR_EVT_ARMED);
+  r.type = 200; // A record type from a newer logger
+  CHECK(GR_FlightLog::formatCsv(h, r, line) == 0);
+
+  // The longest lines there can be still fit
+  r = GR_FlightLog::makeSample(UINT64_MAX, 0xFF, 65535, 65535, 65535, -8.9e15f, -8.9e15f, 65535);
+  GR_LogHeader wide = h;
+  wide.startUs = 0;
+  wide.cal_zeroXAccel = wide.cal_zeroYAccel = wide.cal_zeroZAccel = -32768;
+  CHECK(GR_FlightLog::formatCsv(wide, r, line) < GR_LOG_CSV_MAX_LINE);
+  r = GR_FlightLog::makeConfig(UINT64_MAX, "abcdefghijklmnop", true, 0, -8.9e15f);
+  CHECK(GR_FlightLog::formatCsv(wide, r, line) < GR_LOG_CSV_MAX_LINE);
+}
+
+int main() {
+  headers();
+  samples();
+  times();
+  events();
+  configs();
+  numbers();
+  skipped();
+  printf("%s (%d failed)\n", failures ? "FAIL" : "PASS", failures);
+  return failures ? 1 : 0;
+}
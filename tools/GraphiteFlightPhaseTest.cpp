@@ -0,0 +1,245 @@
+/* GraphiteFlightPhaseTest.cpp
+    Host-side checks for the flight phase state machine (lib/GR_FlightPhase/GR_FlightPhase.h) on a simulated clock: the whole
+    idle -> shutdown walk and how long each phase lasted, burnout debounce + the boost timeout, flags that skip phases, disarming from
+    anywhere, picking the phase back up after a reset, the full rate decimator, and new rates taking hold in a GR_Sampler that keeps
+    running through the change.
+
+    Doesn't need the ESP toolchain or PlatformIO, just a c++17 compiler:
+      g++ -std=c++17 -O2 -Ilib/GR_FlightPhase -Ilib/GR_Sampler -Ilib/GR_SensorHAL -Ilib/GR_FlightLog -Isrc/native tools/GraphiteFlightPhaseTest.cpp -o GraphiteFlightPhaseTest
+
+    Usage:
+      GraphiteFlightPhaseTest      Run the checks. Exits with 1 if any check fails
+    The whole flight through the logger's pipeline (log events included) is the flight sim's job: .pio/build/native/program --flight
+*/
+#include <stdio.h>
+#include <string.h>
+#include <GR_FlightPhase.h>
+#include <GR_Sampler.h>
+#include "FakeSensors.h"
+
+static int failures = 0;
+#define CHECK(cond) do { if (!(cond)) { printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+#define STEP_US 1000 // update() every 1ms, like wi_serverTask
+
+typedef GR_FlightPhase::Inputs Inputs;
+
+/// @brief Keep calling update() every STEP_US until the phase changes or maxUs goes by
+/// @return time of the change (0 = it didn't)
+static uint64_t runUntilChange(GR_FlightPhase& fp, uint64_t& now, const Inputs& in, uint64_t maxUs) {
+  for (uint64_t end = now + maxUs; now <= end; now += STEP_US)
+    if (fp.update(now, in)) return now;
+  return 0;
+}
+
+static void walk() {
+  printf("Full flight\n");
+  GR_FlightPhase fp;
+  const GR_FlightPhase::Config& c = fp.config();
+  uint64_t now = 1000000;
+  fp.reset(now);
+  Inputs in = {false, false, false, false, 0};
+  CHECK(!fp.update(now, in) && fp.phase() == GR_PHASE_IDLE);
+
+  in.armed = true;
+  CHECK(fp.update(now += STEP_US, in) && fp.phase() == GR_PHASE_ARMED);
+  CHECK(fp.last().from == GR_PHASE_IDLE && fp.last().to == GR_PHASE_ARMED);
+  const GR_PhaseSettings * armedSettings = &fp.settings();
+  CHECK(!fp.update(now += 30000000, in) && &fp.settings() == armedSettings); // Half a minute on the pad: nothing moves
+
+  in.launched = true; in.accelMs2 = 80;
+  uint64_t launchUs = now += STEP_US;
+  CHECK(fp.update(launchUs, in) && fp.phase() == GR_PHASE_BOOST);
+  CHECK(fp.last().inPhaseUs == 30000000 + STEP_US);
+  CHECK(&fp.settings() != armedSettings && fp.settings().rawEvery == 1);
+
+  // A dip under the threshold that's shorter than burnoutMs isn't burnout
+  in.accelMs2 = -5;
+  CHECK(!runUntilChange(fp, now, in, uint64_t(c.burnoutMs) * 1000 / 2));
+  in.accelMs2 = 60;
+  CHECK(!fp.update(now += STEP_US, in));
+  in.accelMs2 = -12;
+  uint64_t dipUs = now += STEP_US;
+  CHECK(!fp.update(dipUs, in));
+  uint64_t burnoutUs = runUntilChange(fp, now, in, 1000000);
+  CHECK(fp.phase() == GR_PHASE_COAST && burnoutUs == dipUs + uint64_t(c.burnoutMs) * 1000);
+  CHECK(fp.last().inPhaseUs == burnoutUs - launchUs);
+  in.accelMs2 = 20; // Back over the threshold (a bump in the coast) doesn't un-burn the motor
+  CHECK(!runUntilChange(fp, now, in, 100000) && fp.phase() == GR_PHASE_COAST);
+
+  in.apogee = true;
+  CHECK(fp.update(now += STEP_US, in) && fp.phase() == GR_PHASE_DESCENT && fp.settings().rawEvery == 2);
+  in.landed = true;
+  uint64_t landedUs = now += STEP_US;
+  CHECK(fp.update(landedUs, in) && fp.phase() == GR_PHASE_LANDED && fp.settings().rawEvery == 0);
+  uint64_t shutdownUs = runUntilChange(fp, now, in, uint64_t(c.tailMs) * 1000 + 10000);
+  CHECK(fp.phase() == GR_PHASE_SHUTDOWN && shutdownUs == landedUs + uint64_t(c.tailMs) * 1000);
+  CHECK(fp.last().inPhaseUs == uint64_t(c.tailMs) * 1000);
+  CHECK(!runUntilChange(fp, now, in, 10000000) && fp.phase() == GR_PHASE_SHUTDOWN); // Stays there
+
+  in = {false, false, false, false, 0}; // Disarmed
+  CHECK(fp.update(now += STEP_US, in) && fp.phase() == GR_PHASE_IDLE && fp.last().from == GR_PHASE_SHUTDOWN);
+}
+
+static void shortcuts() {
+  printf("Boost timeout, skipped phases, disarming\n");
+  GR_FlightPhase fp;
+  const GR_FlightPhase::Config& c = fp.config();
+  uint64_t now = 5000;
+  fp.reset(now);
+
+  // Acceleration never drops (sensor stuck / saturated): coast at boostMaxMs anyway
+  Inputs in = {true, true, false, false, 50};
+  CHECK(fp.update(now += STEP_US, in) && fp.last().from == GR_PHASE_IDLE && fp.phase() == GR_PHASE_BOOST); // Armed + launched at once
+  uint64_t boostUs = now;
+  CHECK(runUntilChange(fp, now, in, uint64_t(c.boostMaxMs) * 1000 + 10000) == boostUs + uint64_t(c.boostMaxMs) * 1000);
+  CHECK(fp.phase() == GR_PHASE_COAST);
+
+  // Apogee before burnout was seen goes straight to descent
+  fp.reset(now);
+  in = {true, false, false, false, 0};
+  CHECK(fp.update(now += STEP_US, in) && fp.phase() == GR_PHASE_ARMED);
+  in.launched = true; in.accelMs2 = 30;
+  CHECK(fp.update(now += STEP_US, in) && fp.phase() == GR_PHASE_BOOST);
+  in.apogee = true;
+  CHECK(fp.update(now += STEP_US, in) && fp.last().from == GR_PHASE_BOOST && fp.phase() == GR_PHASE_DESCENT);
+
+  // Disarming from any phase goes back to idle
+  for (uint8_t p = GR_PHASE_ARMED; p < GR_PHASE_COUNT; p++) {
+    Inputs at = {true, p >= GR_PHASE_BOOST, p >= GR_PHASE_DESCENT, p >= GR_PHASE_LANDED, 0};
+    fp.restore(now, at);
+    if (p == GR_PHASE_COAST) { at.accelMs2 = -10; runUntilChange(fp, now, at, 1000000); }
+    if (p == GR_PHASE_SHUTDOWN) runUntilChange(fp, now, at, uint64_t(c.tailMs) * 1000 + 10000);
+    CHECK(fp.phase() == p);
+    Inputs off = {false, at.launched, at.apogee, at.landed, 0}; // Disarming clears the rest a moment later
+    CHECK(fp.update(now += STEP_US, off) && fp.phase() == GR_PHASE_IDLE);
+  }
+}
+
+static void restore() {
+  printf("Picking the phase back up after a reset\n");
+  GR_FlightPhase fp;
+  const GR_FlightPhase::Config& c = fp.config();
+  uint64_t now = 90000000;
+  struct { Inputs in; uint8_t phase; } cases[] = {
+    {{false, false, false, false, 0}, GR_PHASE_IDLE},
+    {{true, false, false, false, 0}, GR_PHASE_ARMED},
+    {{true, true, false, false, 0}, GR_PHASE_BOOST},
+    {{true, true, true, false, 0}, GR_PHASE_DESCENT},
+    {{true, true, true, true, 0}, GR_PHASE_LANDED},
+  };
+  for (auto& k : cases) {
+    fp.restore(now, k.in);
+    CHECK(fp.phase() == k.phase && fp.enteredUs() == now);
+    CHECK(!fp.update(now + STEP_US, k.in)); // No transition for the restore itself
+  }
+
+  // Restored mid-boost after the motor's out: burnout shows up within burnoutMs
+  Inputs in = {true, true, false, false, -11};
+  fp.restore(now, in);
+  uint64_t start = now;
+  CHECK(runUntilChange(fp, now, in, 1000000) == start + uint64_t(c.burnoutMs) * 1000 && fp.phase() == GR_PHASE_COAST);
+
+  // The landed tail starts over, and a shorter one from setConfig() counts from the same start
+  in = {true, true, true, true, 0};
+  fp.restore(now, in);
+  GR_FlightPhase::Config shorter = c;
+  shorter.tailMs = 5000;
+  fp.setConfig(shorter);
+  start = now;
+  CHECK(runUntilChange(fp, now, in, 6000000) == start + 5000000 && fp.phase() == GR_PHASE_SHUTDOWN);
+}
+
+static void decimator() {
+  printf("Full rate decimation\n");
+  GR_RawDecimator d;
+  GR_LogRecord r[40];
+  auto fill = [&](size_t n, uint64_t base) {
+    for (size_t i = 0; i < n; i++) r[i] = GR_FlightLog::makeSample(base + i, GR_SAMPLE_ACCEL, 1, 2, 3, 0, 0, 0);
+  };
+
+  fill(40, 0);
+  CHECK(d.apply(r, 40, 1) == 40 && r[39].timeUs == 39);
+  CHECK(d.apply(r, 40, 0) == 0);
+
+  // Every 4th, the count carrying on across batches of 16 and 24
+  fill(40, 0);
+  size_t kept = d.apply(r, 16, 4);
+  CHECK(kept == 4 && r[0].timeUs == 3 && r[3].timeUs == 15);
+  fill(24, 16);
+  kept = d.apply(r, 24, 4);
+  CHECK(kept == 6 && r[0].timeUs == 19 && r[5].timeUs == 39);
+
+  // Baro / battery readings are never dropped, and don't shift the 1-in-N ones
+  d.reset();
+  fill(12, 100);
+  r[1].flags |= GR_SAMPLE_BARO;
+  r[6].flags |= GR_SAMPLE_BATT;
+  kept = d.apply(r, 12, 4);
+  CHECK(kept == 5);
+  const uint64_t want[] = {101, 103, 106, 107, 111};
+  for (size_t i = 0; i < kept && i < 5; i++) CHECK(r[i].timeUs == want[i]);
+}
+
+/// @brief Counts what the sampler hands over, and when
+class CountingSink : public GR_SampleSink {
+  public:
+    long accel = 0, baro = 0, batt = 0, logTicks = 0;
+    void onAccel(uint64_t, int, int, int) override { accel++; }
+    void onBaro(uint64_t, float, float) override { baro++; }
+    void onBatt(uint64_t, int) override { batt++; }
+    void onLogTick(uint64_t) override { logTicks++; }
+};
+
+static void liveRates() {
+  printf("New rates in a running sampler\n");
+  FakeClock clock;
+  FakeAccel accel;
+  FakeBaro baro(clock);
+  FakeBatt batt;
+  CountingSink sink;
+  GR_FlightPhase fp;
+  GR_Sampler sampler(clock, accel, baro, batt, sink, fp.settings().rates);
+  const GR_PhaseSettings * applied = &fp.settings();
+  Inputs in = {false, false, false, false, 0};
+  uint64_t nextUpdate = clock.micros();
+  auto run = [&](uint64_t us) { // io_samplingTask + wi_serverTask taking turns
+    for (uint64_t end = clock.micros() + us; clock.micros() < end; ) {
+      if (&fp.settings() != applied) { applied = &fp.settings(); sampler.setRates(applied->rates); }
+      uint64_t due = sampler.poll();
+      if (clock.micros() >= nextUpdate) { fp.update(clock.micros(), in); nextUpdate += STEP_US; }
+      clock.sleepUntilUs(due < nextUpdate ? due : nextUpdate);
+    }
+  };
+  sampler.reset();
+  run(1000000);
+  uint32_t idleTicks = sampler.stats().logTicks;
+  CHECK(idleTicks >= 49 && idleTicks <= 51); // 20ms
+
+  in.armed = true; // Armed: 100ms log ticks from the next one on
+  run(1000000);
+  uint32_t armedTicks = sampler.stats().logTicks - idleTicks;
+  CHECK(armedTicks >= 10 && armedTicks <= 11);
+
+  in.launched = true; in.apogee = in.landed = true;
+  run(2000000);
+  in.armed = in.launched = in.apogee = in.landed = false; // Landed -> idle: back to 20ms
+  uint32_t before = sampler.stats().logTicks;
+  run(1000000);
+  uint32_t after = sampler.stats().logTicks - before;
+  CHECK(after >= 49 && after <= 51);
+
+  // The schedule never restarted: every channel's releases + misses still add up to its (changing) periods, nothing skipped
+  for (int ch = 0; ch < GR_CH_COUNT; ch++) CHECK(sampler.stats().ch[ch].missed == 0);
+  printf("  log ticks: %u idle, %u armed, %u back to idle (1 s each)\n", idleTicks, armedTicks, after);
+}
+
+int main() {
+  walk();
+  shortcuts();
+  restore();
+  decimator();
+  liveRates();
+  printf("%s (%d failure%s)\n", failures ? "FAILED" : "All checks passed", failures, failures == 1 ? "" : "s");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,221 @@
+/* GraphiteHistoryTest.cpp
+    Host-side checks for the pre-launch history (lib/GR_History/GR_History.h): what comes out after a freeze is the newest records,
+    oldest first, with no gaps, however many times the buffer wrapped and however the reads are batched; nothing gets in after the
+    freeze; reset() on a frozen history waits for the reader. Then a writer thread and a reader thread doing arm / launch / disarm cycles
+    the way the sampling task and io_drainRaw() do, the writer resetting while the reader's part way through a flush.
+
+    Doesn't need the ESP toolchain or PlatformIO, just a c++17 compiler:
+      g++ -std=c++17 -O2 -pthread -Ilib/GR_History tools/GraphiteHistoryTest.cpp -o GraphiteHistoryTest
+
+    Usage:
+      GraphiteHistoryTest    Run the checks. Exits with 1 if any check fails
+    Build it with -fsanitize=thread as well to have TSan look at the threaded part.
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <random>
+#include <GR_History.h>
+
+#define CAPACITY 64       // Small, so it wraps a lot
+#define CYCLES 20000      // Arm / launch / disarm cycles through the threaded run
+
+static int failures = 0;
+#define CHECK(cond) do { if (!(cond)) { printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+/// @brief A record that shows it if it was read while being overwritten: every word is worked out from the sequence
+struct Item {
+  uint32_t seq;
+  uint32_t words[7];
+  static Item make(uint32_t seq) {
+    Item it;
+    it.seq = seq;
+    for (int i = 0; i < 7; i++) it.words[i] = seq * 2654435761u + i;
+    return it;
+  }
+  bool whole() const {
+    for (int i = 0; i < 7; i++) if (words[i] != seq * 2654435761u + i) return false;
+    return true;
+  }
+};
+
+typedef GR_History<Item> History;
+
+/// @brief Read a frozen history out in batches of batch, checking it's first..first+count-1 in order
+static bool readsBack(const History& h, uint32_t first, size_t count, size_t batch) {
+  if (h.state() != History::Frozen || h.frozenCount() != count) return false;
+  std::vector<Item> out(batch);
+  size_t from = 0, n;
+  while ((n = h.read(from, out.data(), batch)) > 0) {
+    for (size_t i = 0; i < n; i++) if (out[i].seq != first + from + i || !out[i].whole()) return false;
+    from += n;
+  }
+  return from == count;
+}
+
+static void ordering() {
+  printf("Wrap + freeze ordering\n");
+  std::vector<Item> mem(CAPACITY);
+  // Fewer than capacity, exactly capacity, and wrapped by every amount up to a couple of laps
+  for (size_t pushed = 0; pushed <= 3 * CAPACITY; pushed++) {
+    History h;
+    h.attach(mem.data(), CAPACITY);
+    for (uint32_t i = 0; i < pushed; i++) h.push(Item::make(1000 + i));
+    CHECK(h.frozenCount() == 0); // Nothing for the reader before the freeze
+    h.freeze();
+    size_t count = pushed < CAPACITY ? pushed : CAPACITY;
+    uint32_t first = uint32_t(1000 + pushed - count);
+    for (size_t batch : {size_t(1), size_t(7), size_t(CAPACITY), size_t(CAPACITY + 5)}) CHECK(readsBack(h, first, count, batch));
+    Item tail;
+    if (count) CHECK(h.read(count - 1, &tail, 1) == 1 && tail.seq == uint32_t(1000 + pushed - 1)); // Starting part way in
+    CHECK(h.read(count, &tail, 1) == 0);
+    h.push(Item::make(99)); // Ignored once frozen
+    h.freeze();
+    CHECK(readsBack(h, first, count, 5));
+    h.markDrained();
+    CHECK(h.state() == History::Drained && h.frozenCount() == 0 && h.read(0, &tail, 1) == 0);
+  }
+
+  History none; // Never attached (no PSRAM): takes nothing, freezes empty
+  none.push(Item::make(1));
+  none.freeze();
+  CHECK(none.state() == History::Frozen && none.frozenCount() == 0);
+}
+
+static void resets() {
+  printf("Reset\n");
+  std::vector<Item> mem(CAPACITY);
+  History h;
+  h.attach(mem.data(), CAPACITY);
+  Item it;
+
+  // While recording, or once drained, nobody's reading it: reset() empties it there and then
+  for (uint32_t i = 0; i < 10; i++) h.push(Item::make(i));
+  h.reset();
+  CHECK(h.state() == History::Recording);
+  h.push(Item::make(500));
+  h.freeze();
+  CHECK(readsBack(h, 500, 1, 4));
+  h.markDrained();
+  h.reset();
+  CHECK(h.state() == History::Recording);
+  h.freeze();
+  CHECK(h.frozenCount() == 0);
+
+  // Frozen: the reader might be mid read(), so the writer only asks
+  h.reset();
+  h.acknowledgeReset();
+  for (uint32_t i = 0; i < 100; i++) h.push(Item::make(i));
+  h.freeze();
+  CHECK(h.read(0, &it, 1) == 1 && it.seq == 100 - CAPACITY);
+  h.reset();
+  CHECK(h.state() == History::ResetPending);
+  CHECK(h.frozenCount() == 0 && h.read(1, &it, 1) == 0); // The reader sees it's been called off...
+  h.markDrained();                                       // ...and can't mark it drained instead
+  CHECK(h.state() == History::ResetPending);
+  h.push(Item::make(7777)); // Rearmed before the reader got round to it: not recorded yet
+  h.freeze();
+  h.reset();
+  CHECK(h.state() == History::ResetPending);
+  for (uint32_t i = 0; i < CAPACITY; i++) CHECK(mem[i].seq == (i < 100 - CAPACITY ? i + CAPACITY : i)); // Untouched
+  h.acknowledgeReset();
+  CHECK(h.state() == History::Recording);
+  h.acknowledgeReset(); // Only does anything when asked
+  h.push(Item::make(2000)); h.push(Item::make(2001));
+  h.freeze();
+  CHECK(readsBack(h, 2000, 2, 1));
+  h.acknowledgeReset();
+  CHECK(h.state() == History::Frozen);
+}
+
+/// @brief The writer (sampling task) runs arm -> launch -> disarm cycles, disarming at random points of the reader's flush; the reader
+///        (io_drainRaw()) flushes each frozen history in random batches and acknowledges resets. Every flush has to be the newest
+///        records from before that launch (ending with the last one), in order, whole and without gaps, up to wherever a reset cut it off
+static void threads() {
+  printf("Writer + reader threads (%d cycles)\n", CYCLES);
+  std::vector<Item> mem(CAPACITY);
+  History h;
+  h.attach(mem.data(), CAPACITY);
+  std::atomic<uint32_t> lastSeq{0};   // Newest record pushed before the freeze (written before freeze(), which publishes it)
+  std::atomic<uint32_t> minCount{0};  // Records that certainly went in since recording started again
+  std::atomic<bool> done{false};
+  uint64_t pendingResets = 0, directResets = 0, fullFlushes = 0, cutFlushes = 0, flushedRecords = 0;
+  bool ordered = true, whole = true, enough = true;
+
+  std::thread writer([&] {
+    std::mt19937 rng(1);
+    uint32_t seq = 1;
+    for (int c = 0; c < CYCLES; c++) {
+      while (h.state() != History::Recording) { h.push(Item::make(seq++)); std::this_thread::yield(); } // Rearmed early: not recorded
+      uint32_t n = rng() % (3 * CAPACITY);
+      for (uint32_t i = 0; i < n; i++) h.push(Item::make(seq++)); // Armed, waiting for launch
+      lastSeq.store(seq - 1, std::memory_order_relaxed);
+      minCount.store(n < CAPACITY ? n : CAPACITY, std::memory_order_relaxed);
+      h.freeze(); // Launch
+      if (rng() % 2) { // Landed, flushed long ago
+        while (h.state() == History::Frozen) std::this_thread::yield();
+      } else {         // Disarmed whenever
+        for (uint32_t y = rng() % 8; y; y--) std::this_thread::yield();
+      }
+      h.reset();
+      if (h.state() == History::ResetPending) pendingResets++; else directResets++;
+    }
+    done.store(true);
+  });
+
+  std::thread reader([&] {
+    std::mt19937 rng(2);
+    Item batch[CAPACITY];
+    while (!done.load() || h.state() == History::ResetPending) {
+      switch (h.state()) {
+        case History::ResetPending:
+          h.acknowledgeReset();
+          break;
+        case History::Frozen: {
+          uint32_t last = lastSeq.load(std::memory_order_relaxed);
+          size_t count = h.frozenCount(), atLeast = minCount.load(std::memory_order_relaxed), from = 0, n;
+          if (h.state() != History::Frozen) break; // Reset between the two
+          if (count < atLeast) enough = false;
+          while ((n = h.read(from, batch, 1 + rng() % CAPACITY)) > 0) {
+            for (size_t i = 0; i < n; i++) {
+              if (batch[i].seq != last - count + 1 + from + i) ordered = false;
+              if (!batch[i].whole()) whole = false;
+            }
+            from += n;
+            flushedRecords += n;
+            std::this_thread::yield(); // Waiting on the log buffers
+          }
+          if (from == count) {
+            fullFlushes++;
+            h.markDrained();
+          } else {
+            cutFlushes++;
+          }
+          break;
+        }
+        default:
+          std::this_thread::yield();
+      }
+    }
+  });
+  writer.join();
+  reader.join();
+  printf("  %llu flushes done (%llu records), %llu cut off by a reset; %llu resets waited on the reader, %llu didn't need to\n",
+         (unsigned long long)fullFlushes, (unsigned long long)flushedRecords, (unsigned long long)cutFlushes,
+         (unsigned long long)pendingResets, (unsigned long long)directResets);
+  CHECK(ordered);
+  CHECK(whole);
+  CHECK(enough);
+  CHECK(pendingResets > 0 && directResets > 0 && cutFlushes > 0);
+  CHECK(h.state() == History::Recording);
+}
+
+int main() {
+  ordering();
+  resets();
+  threads();
+  printf("%s (%d failed)\n", failures ? "FAIL" : "PASS", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,307 @@
+/* GraphiteHttpLoad.cpp
+    Host-side test for the web server's hardware independent half (lib/GR_Http/GR_Http.h): runs a GR_HttpRouter with the
+    logger's routes on a local poll() server (src/native/HttpServer_Posix.h) and throws real sockets at it.
+
+    Doesn't need the ESP toolchain or PlatformIO, just a c++17 compiler:
+      g++ -std=c++17 -O2 -pthread -Ilib/GR_Http -Isrc/native tools/GraphiteHttpLoad.cpp -o GraphiteHttpLoad
+    Run: ./GraphiteHttpLoad [clients] [requests per client]
+
+    First a set of protocol checks (routing, 404 / 405, query args, POST bodies, pipelining, HTTP/1.0, oversized / garbage requests,
+    the connection limit), then a load test: several keep-alive clients (phones) hammer the status page / XML / perf routes at
+    once while one client sits on a half-sent request and another just holds a connection open, which is what used to wedge
+    WebServer.h. Every response body is checked. Reports throughput and latency percentiles; exits non-zero on any failure.
+
+    The handlers here are stand-ins with the same routes, methods and arm / disarm rules as src/WebFuncs.h (which needs SPIFFS, the
+    RTC and the SD card, so it only runs on the logger).
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <GR_Http.h>
+#include "HttpServer_Posix.h"
+
+#define MAX_CLIENTS 8         // Server's connection limit
+#define PAGE_BYTES 6000       // Size of the fake status page (streamed in 1KB chunks like wi_sendFile)
+
+// Stand-in handlers ----------------------------------------------------------------------------------------------------------------
+
+static bool armed = false, synced = false;
+static uint32_t statusCount = 0;
+static std::string page;
+
+static void sendPage(const GR_HttpRequest&, GR_HttpResponse& res) {
+  res.header("Cache-Control", "max-age=86400");
+  res.begin(200, "text/html");
+  for (size_t i = 0; i < page.size(); i += 1024) res.write(page.data() + i, std::min<size_t>(1024, page.size() - i));
+  res.end();
+}
+static void updateStatus(const GR_HttpRequest&, GR_HttpResponse& res) {
+  if (armed) { res.send(409, "text/plain", "Logger is armed"); return; }
+  char xml[256];
+  snprintf(xml, sizeof(xml), "<data><n>%u</n><altM>%.2f</altM></data>", ++statusCount, 123.45);
+  res.send(200, "text/xml", xml);
+}
+static void syncTime(const GR_HttpRequest& req, GR_HttpResponse& res) {
+  if (armed) { res.send(409, "text/plain", "Logger is armed"); return; }
+  if (req.bodyLen < 19) { res.send(400, "text/plain", "failed"); return; }
+  synced = true;
+  res.send(200, "text/plain", "success");
+}
+static void arm(const GR_HttpRequest&, GR_HttpResponse& res) {
+  if (armed) res.send(409, "text/plain", "Already armed");
+  else if (!synced) res.send(400, "text/plain", "Time not synced");
+  else { armed = true; res.send(200, "text/plain", "success"); }
+}
+static void disarm(const GR_HttpRequest&, GR_HttpResponse& res) {
+  if (!armed) { res.send(409, "text/plain", "Not armed"); return; }
+  armed = false;
+  res.send(200, "text/plain", "success");
+}
+static void perf(const GR_HttpRequest& req, GR_HttpResponse& res) {
+  char reset[16] = "no", out[64];
+  if (req.arg("reset", reset, sizeof(reset)) && !reset[0]) strcpy(reset, "(empty)");
+  snprintf(out, sizeof(out), "{\"reset\":\"%s\"}", reset);
+  res.send(200, "application/json", out);
+}
+static void echo(const GR_HttpRequest& req, GR_HttpResponse& res) { // For checking args / headers make it through
+  char v[64], ua[64];
+  if (!req.arg("v", v, sizeof(v))) strcpy(v, "-");
+  if (!req.header("x-test", ua, sizeof(ua))) strcpy(ua, "-");
+  std::string out = std::string(v) + "|" + ua + "|" + std::string(req.body, req.bodyLen);
+  res.send(200, "text/plain", out.c_str(), out.size());
+}
+static void forgetful(const GR_HttpRequest&, GR_HttpResponse&) {} // Never answers; the router should cover for it
+static void notFound(const GR_HttpRequest&, GR_HttpResponse& res) { res.send(404, "text/plain", "Page / data not found"); }
+
+// Client side --------------------------------------------------------------------------------------------------------------------
+
+static double nowUs() {
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int connectTo(uint16_t port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connect(fd, (sockaddr *)&addr, sizeof(addr)) != 0) { close(fd); return -1; }
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  timeval tv = {5, 0}; // Nothing in here should take anywhere near this long
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  return fd;
+}
+
+static bool sendAll(int fd, const std::string& s) {
+  for (size_t off = 0; off < s.size(); ) {
+    ssize_t n = send(fd, s.data() + off, s.size() - off, MSG_NOSIGNAL);
+    if (n <= 0) return false;
+    off += size_t(n);
+  }
+  return true;
+}
+
+struct Reply { int status = 0; std::string headers, body; bool closed = false; };
+
+/// @brief Read one response (Content-Length or chunked body). buf carries bytes over between responses on the same connection
+static bool readReply(int fd, std::string& buf, Reply& r) {
+  auto fill = [&]() {
+    char tmp[4096];
+    ssize_t n = recv(fd, tmp, sizeof(tmp), 0);
+    if (n <= 0) return false;
+    buf.append(tmp, size_t(n));
+    return true;
+  };
+  size_t hdrEnd;
+  while ((hdrEnd = buf.find("\r\n\r\n")) == std::string::npos) if (!fill()) return false;
+  if (sscanf(buf.c_str(), "HTTP/1.1 %d", &r.status) != 1) return false;
+  r.headers = buf.substr(0, hdrEnd + 2);
+  buf.erase(0, hdrEnd + 4);
+  r.closed = r.headers.find("Connection: close") != std::string::npos;
+  r.body.clear();
+  size_t cl = r.headers.find("Content-Length: ");
+  if (cl != std::string::npos) {
+    size_t len = strtoul(r.headers.c_str() + cl + 16, nullptr, 10);
+    while (buf.size() < len) if (!fill()) return false;
+    r.body = buf.substr(0, len);
+    buf.erase(0, len);
+    return true;
+  }
+  if (r.headers.find("Transfer-Encoding: chunked") == std::string::npos) return false;
+  for (;;) {
+    size_t eol;
+    while ((eol = buf.find("\r\n")) == std::string::npos) if (!fill()) return false;
+    size_t len = strtoul(buf.c_str(), nullptr, 16);
+    while (buf.size() < eol + 2 + len + 2) if (!fill()) return false;
+    r.body.append(buf, eol + 2, len);
+    buf.erase(0, eol + 2 + len + 2);
+    if (len == 0) return true;
+  }
+}
+
+/// @brief One request on a fresh connection
+static Reply request(uint16_t port, const std::string& raw) {
+  Reply r;
+  int fd = connectTo(port);
+  std::string buf;
+  if (fd < 0 || !sendAll(fd, raw) || !readReply(fd, buf, r)) r.status = -1;
+  if (fd >= 0) close(fd);
+  return r;
+}
+
+static int failures = 0;
+static void check(bool ok, const char * what, const Reply& r) {
+  printf("  %-52s %s", what, ok ? "ok\n" : "FAILED");
+  if (!ok) { printf(" (status %d, body \"%.60s\")\n", r.status, r.body.c_str()); failures++; }
+}
+
+// --------------------------------------------------------------------------------------------------------------------------------
+
+int main(int argc, char ** argv) {
+  int clients = argc > 1 ? atoi(argv[1]) : 5;
+  int perClient = argc > 2 ? atoi(argv[2]) : 2000;
+  if (clients > MAX_CLIENTS - 2) clients = MAX_CLIENTS - 2; // Leave room for the slow + idle connections
+  for (int i = 0; i < PAGE_BYTES; i++) page += char('a' + i % 26);
+
+  GR_HttpRouter router; // Same routes / methods as setup() in main.cpp, plus a couple of test ones
+  router.on("/", sendPage, GR_HTTP_GET);
+  router.on("/status", sendPage, GR_HTTP_GET);
+  router.on("/updateStatus", updateStatus, GR_HTTP_GET);
+  router.on("/syncTime", syncTime, GR_HTTP_POST);
+  router.on("/armForLaunch", arm, GR_HTTP_GET | GR_HTTP_POST);
+  router.on("/disarm", disarm, GR_HTTP_GET | GR_HTTP_POST);
+  router.on("/perf", perf, GR_HTTP_GET);
+  router.on("/echo", echo);
+  router.on("/forgetful", forgetful);
+  router.onNotFound(notFound);
+
+  Posix_HttpServer server(router, MAX_CLIENTS);
+  if (!server.begin(0)) { printf("Couldn't start the server\n"); return 1; }
+  uint16_t port = server.port();
+  std::atomic<bool> stop{false};
+  std::thread serverThread([&] { while (!stop) server.poll(5); });
+  printf("Server on 127.0.0.1:%u, %zu routes, %d connections max\n\nProtocol checks:\n", port, router.routes(), MAX_CLIENTS);
+
+  Reply r;
+  r = request(port, "GET / HTTP/1.1\r\nHost: x\r\n\r\n");
+  check(r.status == 200 && r.body == page, "GET / streams the whole page (chunked)", r);
+  r = request(port, "GET /nope HTTP/1.1\r\n\r\n");
+  check(r.status == 404, "unknown path -> 404", r);
+  r = request(port, "GET /syncTime HTTP/1.1\r\n\r\n");
+  check(r.status == 405, "wrong method -> 405", r);
+  r = request(port, "GET /armForLaunch HTTP/1.1\r\n\r\n");
+  check(r.status == 400 && r.body == "Time not synced", "arm before time sync refused", r);
+  std::string when = "01/05/2024 22:00:38 GMT-0500 (Eastern Standard Time)";
+  r = request(port, "POST /syncTime HTTP/1.1\r\nContent-Length: " + std::to_string(when.size()) + "\r\n\r\n" + when);
+  check(r.status == 200 && r.body == "success", "POST /syncTime with a body", r);
+  r = request(port, "GET /armForLaunch HTTP/1.1\r\n\r\n");
+  check(r.status == 200 && r.body == "success", "arm", r);
+  r = request(port, "GET /armForLaunch HTTP/1.1\r\n\r\n");
+  check(r.status == 409, "second phone arming -> 409 (not a hung request)", r);
+  r = request(port, "GET /disarm HTTP/1.1\r\n\r\n");
+  check(r.status == 200, "disarm", r);
+  r = request(port, "GET /perf?reset HTTP/1.1\r\n\r\n");
+  check(r.body == "{\"reset\":\"(empty)\"}", "bare query arg (?reset)", r);
+  r = request(port, "POST /echo?a=1&v=two%20words+here&b HTTP/1.1\r\nX-Test: hello\r\nContent-Length: 4\r\n\r\nbody");
+  check(r.body == "two words here|hello|body", "query decoding, header lookup, body", r);
+  r = request(port, "GET /forgetful HTTP/1.1\r\n\r\n");
+  check(r.status == 500, "handler that doesn't answer -> 500", r);
+  r = request(port, "GET / HTTP/1.0\r\n\r\n");
+  check(r.status == 200 && r.closed, "HTTP/1.0 gets Connection: close", r);
+  r = request(port, "POST /echo HTTP/1.1\r\nContent-Length: 99999\r\n\r\n");
+  check(r.status == 413, "body too big -> 413", r);
+  r = request(port, "GET / HTTP/1.1\r\nX-Junk: " + std::string(GR_HTTP_MAX_REQUEST, 'j') + "\r\n\r\n");
+  check(r.status == 431, "headers too big -> 431", r);
+  r = request(port, "garbage\r\n\r\n");
+  check(r.status == 400, "garbage -> 400", r);
+  r = request(port, "POST /echo HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n0\r\n\r\n");
+  check(r.status == 411, "chunked request body -> 411", r);
+  {
+    int fd = connectTo(port);
+    std::string buf;
+    Reply a, b;
+    bool ok = sendAll(fd, "GET /perf HTTP/1.1\r\n\r\nGET /updateStatus HTTP/1.1\r\n\r\n") && readReply(fd, buf, a) && readReply(fd, buf, b);
+    close(fd);
+    check(ok && a.status == 200 && b.status == 200 && b.body.find("<data>") == 0, "two pipelined requests, answered in order", b);
+  }
+  {
+    std::vector<int> fds;
+    for (int i = 0; i < MAX_CLIENTS; i++) fds.push_back(connectTo(port));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50)); // Let the server accept them all
+    Reply extra = request(port, "GET / HTTP/1.1\r\n\r\n");
+    check(extra.status == 503, "connection over the limit -> 503", extra);
+    for (int fd : fds) close(fd);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+
+  // Load test -------------------------------------------------------------------------------------------------------------------
+  printf("\nLoad: %d keep-alive clients x %d requests, plus one client stuck mid-request and one idle connection\n", clients, perClient);
+  int slow = connectTo(port), idle = connectTo(port);
+  sendAll(slow, "GET /updateStatus HTTP/1.1\r\nHost: slo"); // ...and never finishes
+  std::atomic<int> errors{0};
+  std::vector<std::vector<float>> latencies(clients);
+  double start = nowUs();
+  std::vector<std::thread> threads;
+  for (int c = 0; c < clients; c++) {
+    threads.emplace_back([&, c] {
+      static const char * paths[] = {"/updateStatus", "/updateStatus", "/updateStatus", "/status", "/perf"};
+      int fd = connectTo(port);
+      std::string buf;
+      latencies[c].reserve(perClient);
+      for (int i = 0; i < perClient && fd >= 0; i++) {
+        const char * path = paths[(i + c) % 5];
+        double t0 = nowUs();
+        Reply rr;
+        if (!sendAll(fd, std::string("GET ") + path + " HTTP/1.1\r\nHost: graphite.local\r\n\r\n") || !readReply(fd, buf, rr)) {
+          errors++;
+          break;
+        }
+        latencies[c].push_back(float(nowUs() - t0));
+        bool ok = rr.status == 200 && (path[1] == 's' ? rr.body == page : path[1] == 'u' ? rr.body.find("<data><n>") == 0 : rr.body[0] == '{');
+        if (!ok) errors++;
+      }
+      if (fd >= 0) close(fd);
+    });
+  }
+  for (auto& t : threads) t.join();
+  double elapsed = (nowUs() - start) / 1e6;
+
+  // The stuck client should still be there (not answered, not blocking anyone), and finishing its request should work
+  Reply late;
+  std::string lateBuf;
+  bool lateOk = sendAll(slow, "w\r\n\r\n") && readReply(slow, lateBuf, late) && late.status == 200;
+  close(slow);
+  close(idle);
+  stop = true;
+  serverThread.join();
+
+  std::vector<float> all;
+  for (auto& l : latencies) all.insert(all.end(), l.begin(), l.end());
+  std::sort(all.begin(), all.end());
+  auto pct = [&](double p) { return all.empty() ? 0.0f : all[size_t(p * (all.size() - 1))]; };
+  printf("  %zu requests in %.2f s = %.0f req/s, latency p50 %.0f us / p99 %.0f us / max %.0f us\n", all.size(), elapsed,
+         all.size() / elapsed, pct(0.5), pct(0.99), pct(1.0));
+  const Posix_HttpServer::Stats& st = server.stats();
+  printf("  server: %llu connections, %u open at once at most, %llu requests, %llu rejected, %llu bad\n",
+         (unsigned long long)st.accepted, st.maxOpen, (unsigned long long)st.requests, (unsigned long long)st.rejected,
+         (unsigned long long)st.badRequests);
+  bool loadOk = errors == 0 && all.size() == size_t(clients) * perClient;
+  printf("  every response correct: %s\n", loadOk ? "ok" : "FAILED");
+  printf("  stuck client answered once it finished its request: %s\n", lateOk ? "ok" : "FAILED");
+  if (!loadOk || !lateOk) failures++;
+
+  printf("\n%s\n", failures ? "FAILED" : "All passed");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,162 @@
+/* GraphiteKalmanBench.cpp
+    Host-side benchmark for the altitude Kalman filter + apogee / landing detection (lib/GR_Estimator/GR_Estimator.h).
+    Flies simulated trajectories (boost, drag limited coast, drogue + main descent), feeds noisy accelerometer and baro samples at
+    the logger's rates through the filter, and reports the cost per update and how far off the estimates are from the truth.
+
+    Doesn't need the ESP toolchain or PlatformIO, just a c++17 compiler:
+      g++ -std=c++17 -O2 -Ilib/GR_Estimator tools/GraphiteKalmanBench.cpp -o GraphiteKalmanBench
+
+    Usage:
+      GraphiteKalmanBench [flights] [--transonic]
+        flights      number of random trajectories to fly (default 50)
+        --transonic  add pressure spikes around Mach 1 to the baro (checks the innovation gate keeps them out)
+    Note: ns/update is for the dev box, not the ESP32 (expect it to be a lot slower there)
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <GR_Estimator.h>
+
+#define SIM_STEP_US 1000        // Truth integration step = accelerometer period (1kHz)
+#define SIM_BARO_US 15625       // DPS310 period (64Hz)
+#define SIM_ACCEL_NOISE 3.0f    // m/s^2, 1 sigma (~0.3g)
+#define SIM_BARO_NOISE 0.5f     // m, 1 sigma
+#define SIM_PAD_SEC 2.0         // Time on the pad before ignition
+#define SIM_MAIN_ALT 150.0      // Main chute deploy altitude (m)
+#define SIM_DROGUE_VT 25.0      // Terminal velocity under drogue (m/s)
+#define SIM_MAIN_VT 6.0         // Terminal velocity under main (m/s)
+
+struct Rng {
+  uint64_t s = 0x9E3779B97F4A7C15ull;
+  uint32_t next() { s ^= s << 13; s ^= s >> 7; s ^= s << 17; return uint32_t(s >> 32); }
+  float uniform() { return (next() + 0.5f) / 4294967296.0f; }
+  float gauss() { return sqrtf(-2 * logf(uniform())) * cosf(6.2831853f * uniform()); }
+};
+
+struct Totals {
+  double hErr2 = 0, vErr2 = 0, hErrMax = 0, vErrMax = 0;
+  uint64_t errSamples = 0;
+  double apogeeTimeErr = 0, apogeeTimeErrMax = 0, apogeeAltErr = 0, apogeeAltErrMax = 0;
+  double landTimeErr = 0, landTimeErrMax = 0;
+  int apogees = 0, landings = 0, flights = 0;
+  uint64_t baroRejects = 0;
+};
+
+static void fly(Rng& rng, bool transonic, Totals& t) {
+  double boostG = 5 + rng.uniform() * 15;     // Thrust / weight
+  double burnSec = 1.0 + rng.uniform() * 3.0;
+  double dragK = 0.0005 + rng.uniform() * 0.0015; // Drag deceleration = k v^2 (m^-1)
+
+  GR_AltitudeKF kf;
+  GR_ApogeeLandingDetect events;
+  double h = 0, v = 0, a = 0;
+  double apogeeUs = 0, apogeeH = 0, landUs = 0;
+  bool ignited = false, pastApogee = false, landed = false;
+  uint64_t nextBaro = 0;
+  const uint64_t ignitionUs = uint64_t(SIM_PAD_SEC * 1e6);
+
+  for (uint64_t us = 0; us < 600000000ull; us += SIM_STEP_US) {
+    double dt = SIM_STEP_US / 1e6;
+    // Truth
+    double f; // Specific force along the up axis (what the accelerometer reads)
+    if (us < ignitionUs) { a = 0; f = GR_GRAVITY; }
+    else if (!landed) {
+      ignited = true;
+      double tb = (us - ignitionUs) / 1e6;
+      double thrust = tb < burnSec ? boostG * GR_GRAVITY : 0;
+      double drag;
+      if (!pastApogee) drag = -dragK * v * fabs(v);
+      else { // Under chutes: drag pulls toward terminal velocity
+        double vt = h > SIM_MAIN_ALT ? SIM_DROGUE_VT : SIM_MAIN_VT;
+        drag = GR_GRAVITY * (v * v) / (vt * vt);
+      }
+      a = thrust + drag - GR_GRAVITY;
+      f = thrust + drag;
+      v += a * dt;
+      h += v * dt;
+      if (!pastApogee && tb > burnSec && v <= 0) { pastApogee = true; apogeeUs = us; apogeeH = h; }
+      if (pastApogee && h <= 0) { h = 0; v = 0; a = 0; landed = true; landUs = us; }
+    } else { f = GR_GRAVITY; }
+
+    // Sensors -> filter
+    kf.updateAccel(us, float(f + SIM_ACCEL_NOISE * rng.gauss()));
+    if (us >= nextBaro) {
+      nextBaro += SIM_BARO_US;
+      double z = h + SIM_BARO_NOISE * rng.gauss();
+      if (transonic && v > 300 && v < 360) z += 40 + 20 * rng.gauss(); // Shock passing the static ports reads as a big altitude jump
+      kf.updateBaro(us, float(z));
+    }
+
+    if (ignited && !landed && kf.ready()) {
+      double he = fabs(kf.altitude() - h), ve = fabs(kf.velocity() - v);
+      t.hErr2 += he * he; t.vErr2 += ve * ve; t.errSamples++;
+      if (he > t.hErrMax) t.hErrMax = he;
+      if (ve > t.vErrMax) t.vErrMax = ve;
+    }
+
+    if (us == ignitionUs) events.reset(us); // The launch detector would have fired ~30ms later, close enough here
+    if (ignited && events.onEstimate(us, kf.altitude(), kf.velocity()) == GR_FLIGHT_EVT_LANDED) break;
+  }
+
+  // Compare against the truth once the flight's over (the detector may confirm a hair before the true apogee)
+  if (events.apogee().type) {
+    double te = fabs(double(events.apogee().timeUs) - apogeeUs) / 1e3, ae = fabs(events.apogee().altM - apogeeH);
+    t.apogeeTimeErr += te; t.apogeeAltErr += ae; t.apogees++;
+    if (te > t.apogeeTimeErrMax) t.apogeeTimeErrMax = te;
+    if (ae > t.apogeeAltErrMax) t.apogeeAltErrMax = ae;
+  }
+  if (events.landed().type) {
+    double te = fabs(double(events.landed().timeUs) - landUs) / 1e6;
+    t.landTimeErr += te; t.landings++;
+    if (te > t.landTimeErrMax) t.landTimeErrMax = te;
+  }
+  t.baroRejects += kf.baroRejects();
+  t.flights++;
+}
+
+/// @brief Time updates in bulk (timing each call would mostly measure the clock). Inputs are precomputed so only the filter is timed
+/// @return ns per update
+static double timeUpdates(bool baro, int count) {
+  static float noise[4096];
+  Rng rng;
+  for (float& n : noise) n = rng.gauss();
+  GR_AltitudeKF kf;
+  kf.updateBaro(0, 0);
+  auto start = std::chrono::steady_clock::now();
+  uint64_t us = 0;
+  for (int i = 0; i < count; i++) {
+    us += baro ? SIM_BARO_US : SIM_STEP_US;
+    if (baro) kf.updateBaro(us, SIM_BARO_NOISE * noise[i & 4095]);
+    else kf.updateAccel(us, GR_GRAVITY + SIM_ACCEL_NOISE * noise[i & 4095]);
+  }
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  if (kf.altitude() != kf.altitude()) printf("NaN!\n"); // Uses the result so the loop can't be optimized away
+  return ns / count;
+}
+
+int main(int argc, char ** argv) {
+  int flights = 50;
+  bool transonic = false;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--transonic")) transonic = true;
+    else flights = atoi(argv[i]);
+  }
+  if (flights < 1) { fprintf(stderr, "Usage: GraphiteKalmanBench [flights] [--transonic]\n"); return 2; }
+
+  Rng rng;
+  Totals t;
+  for (int i = 0; i < flights; i++) fly(rng, transonic, t);
+
+  printf("Flights: %d%s\n", t.flights, transonic ? " (with transonic baro spikes)" : "");
+  printf("Cost:    accel update %.1f ns, baro update %.1f ns\n", timeUpdates(false, 2000000), timeUpdates(true, 2000000));
+  printf("Error:   altitude rms %.2f m / max %.2f m, velocity rms %.2f m/s / max %.2f m/s (launch to landing)\n",
+         sqrt(t.hErr2 / t.errSamples), t.hErrMax, sqrt(t.vErr2 / t.errSamples), t.vErrMax);
+  printf("Apogee:  detected %d/%d, time error avg %.1f ms / max %.1f ms, altitude error avg %.2f m / max %.2f m\n", t.apogees, t.flights,
+         t.apogees ? t.apogeeTimeErr / t.apogees : 0, t.apogeeTimeErrMax, t.apogees ? t.apogeeAltErr / t.apogees : 0, t.apogeeAltErrMax);
+  printf("Landing: detected %d/%d, time error avg %.2f s / max %.2f s\n", t.landings, t.flights,
+         t.landings ? t.landTimeErr / t.landings : 0, t.landTimeErrMax);
+  printf("Baro samples rejected by the gate: %llu\n", (unsigned long long)t.baroRejects);
+  return 0;
+}
@@ -0,0 +1,202 @@
+/* GraphiteLaunchReplay.cpp
+    Host-side replay harness for the launch detector (lib/GR_LaunchDetect/GR_LaunchDetect.h). Feeds recorded flight logs or
+    synthetic flights through the exact same detector code the logger runs, and reports detection latency + false triggers.
+
+    Doesn't need the ESP toolchain or PlatformIO, just a c++17 compiler:
+      g++ -std=c++17 -O2 -Ilib/GR_FlightLog -Ilib/GR_LaunchDetect tools/GraphiteLaunchReplay.cpp -o GraphiteLaunchReplay
+
+    Usage:
+      GraphiteLaunchReplay FLIGHT.GRL [...]      Replay recorded logs (packed or not). Prints where the detector fires (and where
+                                                 the logger did, if the log has a launch event)
+      GraphiteLaunchReplay -s 1000               Replay 1000 synthetic flights (random pad time with noise, handling bumps and pressure
+                                                 drift, then a motor burn at a known T0); prints the latency distribution from the true
+                                                 T0, false triggers and misses
+      GraphiteLaunchReplay -p 10                 10 hours of synthetic pad time only (false trigger rate per hour)
+    Threshold overrides (default to GR_LaunchDetect::defaults(), same as the logger):
+      -g accelG  -n accelSamples  -a altRiseM  -m altSamples
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <GR_FlightLog.h>
+#include <GR_LogPack.h>
+#include <GR_LaunchDetect.h>
+
+// Synthetic trace parameters (roughly the logger's real rates + noise levels)
+#define SIM_ACCEL_HZ 1000       // Filtered accelerometer output rate
+#define SIM_BARO_HZ 64          // DPS310 rate
+#define SIM_ACCEL_NOISE_G 0.3f  // 1 sigma
+#define SIM_BARO_NOISE_M 0.5f   // 1 sigma
+#define SIM_BUMPS_PER_MIN 2     // Pad handling bumps (short spikes, should never trigger)
+#define SIM_BUMP_G 8.0f         // Bump peak
+#define SIM_BUMP_MS 10          // Bump length (must stay under the accel debounce to not trigger)
+
+static void usage() {
+  fprintf(stderr, "Usage: GraphiteLaunchReplay <log files...> | -s flights | -p hours  [-g accelG] [-n accelSamples] [-a altRiseM] [-m altSamples]\n");
+  exit(2);
+}
+
+// Small deterministic PRNG so runs are repeatable
+struct Rng {
+  uint64_t s = 0x9E3779B97F4A7C15ull;
+  uint32_t next() { s ^= s << 13; s ^= s >> 7; s ^= s << 17; return uint32_t(s >> 32); }
+  float uniform() { return (next() + 0.5f) / 4294967296.0f; }
+  float gauss() { return sqrtf(-2 * logf(uniform())) * cosf(6.2831853f * uniform()); }
+};
+
+// Recorded logs -----------------------------------------------------------------------------------------------------------------
+
+static int replayFile(const char * path, GR_LaunchDetect& det) {
+  FILE * f = fopen(path, "rb");
+  if (!f) { fprintf(stderr, "%s: can't open\n", path); return 1; }
+  GR_LogHeader h;
+  if (fread(&h, sizeof(h), 1, f) != 1 || !GR_FlightLog::checkHeader(h)) { fprintf(stderr, "%s: not a Graphite log\n", path); fclose(f); return 1; }
+  det.reset();
+  fseek(f, long(GR_LogPack::dataStart(h)), SEEK_SET);
+  std::vector<uint8_t> buf(GR_LogPack::unitBytes(h));
+  GR_LogUnpacker unit;
+  GR_LogRecord r;
+  uint64_t loggedT0 = 0;
+  float loggedLatencyMs = 0;
+  int loggedReason = -1;
+  bool armed = true; // Logs start when the logger is armed; only run the detector while armed, like the logger
+  while (fread(buf.data(), buf.size(), 1, f) == 1) {
+    if (!unit.begin(h, buf.data())) continue;
+    while (unit.next(r)) {
+      if (r.type == GR_REC_EVENT) {
+        if (r.event.code == GR_EVT_ARMED) { armed = true; det.reset(); }
+        if (r.event.code == GR_EVT_DISARMED) armed = false;
+        if (r.event.code == GR_EVT_LAUNCH && loggedReason < 0) { loggedT0 = r.timeUs; loggedReason = r.event.iArg; loggedLatencyMs = r.event.fArg; }
+      } else if (r.type == GR_REC_SAMPLE && armed) {
+        if (r.flags & GR_SAMPLE_ACCEL)
+          det.onAccel(r.timeUs, GR_FlightLog::accelG(r.sample.xAccel, h.cal_zeroXAccel, h.cal_xAccelCoef),
+                      GR_FlightLog::accelG(r.sample.yAccel, h.cal_zeroYAccel, h.cal_yAccelCoef), GR_FlightLog::accelG(r.sample.zAccel, h.cal_zeroZAccel, h.cal_zAccelCoef));
+        if (r.flags & GR_SAMPLE_BARO) det.onAlt(r.timeUs, GR_FlightLog::altitudeM(h, r.sample.pressPa, r.sample.tempC));
+      }
+    }
+  }
+  fclose(f);
+
+  printf("%s:\n", path);
+  if (det.triggered()) {
+    const auto& res = det.result();
+    printf("  replay: %s trigger, T0 %.6f s, decided %.6f s (latency %.1f ms)\n", GR_LaunchDetect::reasonName(res.reason),
+           res.t0Us / 1e6, res.detectUs / 1e6, (res.detectUs - res.t0Us) / 1e3);
+  } else {
+    printf("  replay: no launch detected\n");
+  }
+  if (loggedReason >= 0)
+    printf("  logger: %s trigger, T0 %.6f s (latency %.1f ms)\n", GR_LaunchDetect::reasonName(uint8_t(loggedReason)), loggedT0 / 1e6, loggedLatencyMs);
+  return 0;
+}
+
+// Synthetic flights -------------------------------------------------------------------------------------------------------------
+
+struct SimResult {
+  bool falseTrigger;  // Fired before the motor lit
+  bool missed;        // Never fired
+  double latencyMs;   // From the true T0
+  uint8_t reason;
+};
+
+/// @brief Pad time (noise, bumps, drift) then, if burnG > 0, a motor burn at padSec
+static SimResult simulate(GR_LaunchDetect& det, Rng& rng, double padSec, float burnG, double burnSec) {
+  det.reset();
+  const uint64_t accelStepUs = 1000000 / SIM_ACCEL_HZ;
+  const uint64_t t0Us = uint64_t(padSec * 1e6);
+  const uint64_t endUs = burnG > 0 ? t0Us + uint64_t(burnSec * 1e6) : t0Us;
+  double baroNextUs = 0;
+  double alt = 0, vel = 0;                               // Simple 1D flight
+  float drift = (rng.uniform() - 0.5f) * 20 / 3600;      // Up to +-10 m/hour of pressure drift
+  uint64_t bumpUntil = 0;
+  float bumpAxis[3] = {0, 0, 0};
+  for (uint64_t t = 0; t < endUs; t += accelStepUs) {
+    bool burning = burnG > 0 && t >= t0Us;
+    float g[3] = {0, 0, 1}; // Sitting on the pad, nose up
+    if (burning) {
+      vel += (burnG - 1) * 9.80665 * accelStepUs / 1e6;
+      alt += vel * accelStepUs / 1e6;
+      g[2] = burnG;
+    } else if (t >= bumpUntil && rng.uniform() < SIM_BUMPS_PER_MIN / 60.0f / SIM_ACCEL_HZ) { // Start a bump in a random direction
+      bumpUntil = t + SIM_BUMP_MS * 1000;
+      for (int i = 0; i < 3; i++) bumpAxis[i] = rng.gauss();
+      float n = sqrtf(bumpAxis[0] * bumpAxis[0] + bumpAxis[1] * bumpAxis[1] + bumpAxis[2] * bumpAxis[2]);
+      for (int i = 0; i < 3; i++) bumpAxis[i] *= SIM_BUMP_G / n;
+    }
+    if (!burning && t < bumpUntil) for (int i = 0; i < 3; i++) g[i] += bumpAxis[i];
+    for (int i = 0; i < 3; i++) g[i] += SIM_ACCEL_NOISE_G * rng.gauss();
+    det.onAccel(t, g[0], g[1], g[2]);
+
+    if (t >= baroNextUs) {
+      baroNextUs += 1e6 / SIM_BARO_HZ;
+      det.onAlt(t, float(alt + drift * t / 1e6 + SIM_BARO_NOISE_M * rng.gauss()));
+    }
+    if (det.triggered()) break;
+  }
+
+  SimResult s = {false, false, 0, det.result().reason};
+  if (!det.triggered()) { s.missed = burnG > 0; return s; }
+  if (det.result().detectUs < t0Us) { s.falseTrigger = true; return s; }
+  s.latencyMs = (det.result().detectUs - t0Us) / 1e3;
+  return s;
+}
+
+static double percentile(std::vector<double>& v, double p) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  return v[std::min(v.size() - 1, size_t(p * (v.size() - 1) + 0.5))];
+}
+
+int main(int argc, char ** argv) {
+  GR_LaunchDetect::Config cfg = GR_LaunchDetect::defaults();
+  int flights = 0;
+  double padHours = 0;
+  std::vector<const char *> files;
+  for (int i = 1; i < argc; i++) {
+    bool hasArg = i + 1 < argc;
+    if (!strcmp(argv[i], "-s") && hasArg) flights = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-p") && hasArg) padHours = atof(argv[++i]);
+    else if (!strcmp(argv[i], "-g") && hasArg) cfg.accelG = atof(argv[++i]);
+    else if (!strcmp(argv[i], "-n") && hasArg) cfg.accelSamples = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-a") && hasArg) cfg.altRiseM = atof(argv[++i]);
+    else if (!strcmp(argv[i], "-m") && hasArg) cfg.altSamples = atoi(argv[++i]);
+    else if (argv[i][0] == '-') usage();
+    else files.push_back(argv[i]);
+  }
+  if (files.empty() && flights <= 0 && padHours <= 0) usage();
+
+  GR_LaunchDetect det(cfg);
+  printf("Thresholds: %.2f g for %u samples, %.1f m rise for %u samples\n", cfg.accelG, cfg.accelSamples, cfg.altRiseM, cfg.altSamples);
+  int status = 0;
+  for (const char * f : files) status |= replayFile(f, det);
+
+  Rng rng;
+  if (flights > 0) {
+    std::vector<double> lat;
+    int falseTriggers = 0, missed = 0, byAlt = 0;
+    for (int i = 0; i < flights; i++) {
+      double pad = 30 + rng.uniform() * 270;        // 30 sec to 5 min on the pad
+      float burnG = 2.5f + rng.uniform() * 12.5f;   // Anything from a lazy L motor to a fast K
+      SimResult s = simulate(det, rng, pad, burnG, 3.0);
+      if (s.falseTrigger) falseTriggers++;
+      else if (s.missed) missed++;
+      else { lat.push_back(s.latencyMs); if (s.reason == GR_LAUNCH_ALT) byAlt++; }
+    }
+    printf("Synthetic flights: %d, detected %zu (%d by altitude), missed %d, false triggers %d\n", flights, lat.size(), byAlt, missed, falseTriggers);
+    printf("  latency from true T0 (ms): p50 %.1f  p99 %.1f  max %.1f\n", percentile(lat, 0.5), percentile(lat, 0.99), percentile(lat, 1.0));
+  }
+  if (padHours > 0) {
+    int falseTriggers = 0;
+    double done = 0;
+    while (done < padHours * 3600) { // In 10 minute chunks, restarting after each false trigger like a re-arm would
+      simulate(det, rng, 600, 0, 0);
+      if (det.triggered()) { falseTriggers++; done += det.result().detectUs / 1e6; }
+      else done += 600;
+    }
+    printf("Synthetic pad time: %.1f hours, false triggers %d (%.2f per hour)\n", padHours, falseTriggers, falseTriggers / padHours);
+  }
+  return status;
+}
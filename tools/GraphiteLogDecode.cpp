@@ -0,0 +1,179 @@
+/* GraphiteLogDecode.cpp
+    Host-side decoder for Graphite binary flight logs (see lib/GR_FlightLog/GR_FlightLog.h for the format), plain or packed
+    (GR_LogPack.h)
+
+    Doesn't need the ESP toolchain or PlatformIO, just a c++17 compiler:
+      g++ -std=c++17 -O2 -Ilib/GR_FlightLog tools/GraphiteLogDecode.cpp -o GraphiteLogDecode
+
+    Usage:
+      GraphiteLogDecode FLIGHT.GRL                 CSV to stdout
+      GraphiteLogDecode FLIGHT.GRL -o flight.csv   CSV to a file
+      GraphiteLogDecode FLIGHT.GRL -c outdir       One raw little-endian binary file per column in outdir (timeUs.u64, xAccel.u16,
+                                                   pressPa.f32, ...) for loading straight into numpy / pandas / Arrow without parsing,
+                                                   plus config.txt (the logger's settings, one "key value" per line)
+      GraphiteLogDecode FLIGHT.GRL -i              Print the header, settings, events + record counts only
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <GR_FlightLog.h>
+#include <GR_LogPack.h>
+
+#define READ_CHUNK_BYTES (1 << 20) // Read this much per fread (whole records / blocks)
+#define WRITE_BUF_SIZE (4 << 20)  // CSV output buffer
+
+static void usage() {
+  fprintf(stderr, "Usage: GraphiteLogDecode <log file> [-o out.csv | -c outdir | -i]\n");
+  exit(2);
+}
+
+// Buffered CSV writer; flushes in big chunks so we're limited by the disk and not by fwrite calls
+struct CsvOut {
+  FILE * f;
+  std::vector<char> buf;
+  size_t used = 0;
+  CsvOut(FILE * file) : f(file), buf(WRITE_BUF_SIZE) {}
+  char * reserve(size_t n) { if (used + n > buf.size()) flush(); return buf.data() + used; }
+  void commit(size_t n) { used += n; }
+  void flush() { fwrite(buf.data(), 1, used, f); used = 0; }
+};
+
+// One output file per column
+struct ColumnOut {
+  FILE * timeUs, * xAccel, * yAccel, * zAccel, * pressPa, * tempC, * battRaw, * flags;
+  FILE * evtTimeUs, * evtCode, * evtArg, * config;
+  static FILE * open(const char * dir, const char * name) {
+    std::string path = std::string(dir) + "/" + name;
+    FILE * f = fopen(path.c_str(), "wb");
+    if (!f) { fprintf(stderr, "Couldn't create %s\n", path.c_str()); exit(1); }
+    setvbuf(f, NULL, _IOFBF, 1 << 20);
+    return f;
+  }
+  ColumnOut(const char * dir) {
+    timeUs = open(dir, "timeUs.u64");   flags = open(dir, "flags.u8");
+    xAccel = open(dir, "xAccel.u16");   yAccel = open(dir, "yAccel.u16");   zAccel = open(dir, "zAccel.u16");
+    pressPa = open(dir, "pressPa.f32"); tempC = open(dir, "tempC.f32");     battRaw = open(dir, "battRaw.u16");
+    evtTimeUs = open(dir, "eventTimeUs.u64"); evtCode = open(dir, "eventCode.u16"); evtArg = open(dir, "eventArg.i32");
+    config = open(dir, "config.txt");
+  }
+  void write(const GR_LogRecord& r) {
+    if (r.type == GR_REC_SAMPLE) {
+      fwrite(&r.timeUs, 8, 1, timeUs);  fwrite(&r.flags, 1, 1, flags);
+      fwrite(&r.sample.xAccel, 2, 1, xAccel); fwrite(&r.sample.yAccel, 2, 1, yAccel); fwrite(&r.sample.zAccel, 2, 1, zAccel);
+      fwrite(&r.sample.pressPa, 4, 1, pressPa); fwrite(&r.sample.tempC, 4, 1, tempC); fwrite(&r.sample.battRaw, 2, 1, battRaw);
+    } else if (r.type == GR_REC_EVENT) {
+      fwrite(&r.timeUs, 8, 1, evtTimeUs); fwrite(&r.event.code, 2, 1, evtCode); fwrite(&r.event.iArg, 4, 1, evtArg);
+    } else if (r.type == GR_REC_CONFIG) {
+      char key[sizeof(r.config.key) + 1];
+      GR_FlightLog::configKey(r, key);
+      if (r.config.isFloat) fprintf(config, "%s %.9g\n", key, r.config.fValue);
+      else fprintf(config, "%s %d\n", key, r.config.iValue);
+    }
+  }
+  void close() {
+    FILE * all[] = {timeUs, xAccel, yAccel, zAccel, pressPa, tempC, battRaw, flags, evtTimeUs, evtCode, evtArg, config};
+    for (FILE * f : all) fclose(f);
+  }
+};
+
+int main(int argc, char ** argv) {
+  if (argc < 2) usage();
+  const char * inPath = argv[1];
+  const char * csvPath = NULL;
+  const char * colDir = NULL;
+  bool infoOnly = false;
+  for (int i = 2; i < argc; i++) {
+    if (!strcmp(argv[i], "-o") && i + 1 < argc) csvPath = argv[++i];
+    else if (!strcmp(argv[i], "-c") && i + 1 < argc) colDir = argv[++i];
+    else if (!strcmp(argv[i], "-i")) infoOnly = true;
+    else usage();
+  }
+
+  FILE * in = fopen(inPath, "rb");
+  if (!in) { fprintf(stderr, "Couldn't open %s\n", inPath); return 1; }
+
+  GR_LogHeader h;
+  if (fread(&h, sizeof(h), 1, in) != 1 || !GR_FlightLog::checkHeader(h)) {
+    fprintf(stderr, "%s isn't a Graphite log (or was written by a newer logger version)\n", inPath);
+    return 1;
+  }
+  fseek(in, long(GR_LogPack::dataStart(h)), SEEK_SET); // Skip any header fields added by newer versions (and a packed log's padding)
+
+  fprintf(stderr, "Graphite log v%u: pAtSea=%g lapseRate=%g magicExp=%g accel zero=%d,%d,%d coef=%g,%g,%g\n", h.version,
+          h.cal_pAtSea, h.cal_lapseRate, h.cal_magicExp, h.cal_zeroXAccel, h.cal_zeroYAccel, h.cal_zeroZAccel,
+          h.cal_xAccelCoef, h.cal_yAccelCoef, h.cal_zAccelCoef);
+  if (h.configCount) fprintf(stderr, "%u settings (config layout %08lx)\n", h.configCount, (unsigned long)h.configSchema);
+  if (h.packBlock) fprintf(stderr, "Packed, %u byte blocks\n", h.packBlock);
+
+  FILE * csvFile = NULL;
+  CsvOut * csv = NULL;
+  ColumnOut * cols = NULL;
+  if (colDir) {
+    cols = new ColumnOut(colDir);
+  } else if (!infoOnly) {
+    csvFile = csvPath ? fopen(csvPath, "wb") : stdout;
+    if (!csvFile) { fprintf(stderr, "Couldn't create %s\n", csvPath); return 1; }
+    csv = new CsvOut(csvFile);
+    const char * hdr = GR_FlightLog::csvHeader();
+    size_t len = strlen(hdr);
+    memcpy(csv->reserve(len), hdr, len); csv->commit(len);
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  size_t unitBytes = GR_LogPack::unitBytes(h);
+  std::vector<uint8_t> chunk(READ_CHUNK_BYTES / unitBytes * unitBytes);
+  GR_LogUnpacker unit;
+  GR_LogRecord r;
+  uint64_t samples = 0, events = 0, configs = 0, padding = 0, unknown = 0, units = 0, badBlocks = 0;
+  size_t n;
+  while ((n = fread(chunk.data(), unitBytes, chunk.size() / unitBytes, in)) > 0) {
+    units += n;
+    for (size_t i = 0; i < n; i++) {
+      if (!unit.begin(h, chunk.data() + i * unitBytes)) { badBlocks++; continue; }
+      while (unit.next(r)) {
+        if (r.type == GR_REC_SAMPLE) samples++;
+        else if (r.type == GR_REC_EVENT) {
+          events++;
+          if (infoOnly && r.event.code == GR_EVT_WALL_CLOCK) { // iArg is the wall clock's seconds
+            time_t s = r.event.iArg;
+            struct tm t;
+            char date[32];
+            strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", gmtime_r(&s, &t));
+            fprintf(stderr, "  event %s at %.6fs (%s%s)\n", GR_FlightLog::eventName(r.event.code), int64_t(r.timeUs - h.startUs) / 1e6, date,
+                    r.event.fArg ? "" : ", never synced");
+          } else if (infoOnly) fprintf(stderr, "  event %s at %.6fs (arg %d)\n", GR_FlightLog::eventName(r.event.code), (r.timeUs - h.startUs) / 1e6, r.event.iArg);
+        } else if (r.type == GR_REC_CONFIG) {
+          configs++;
+          if (infoOnly) {
+            char key[sizeof(r.config.key) + 1];
+            GR_FlightLog::configKey(r, key);
+            if (r.config.isFloat) fprintf(stderr, "  config %s = %.9g\n", key, r.config.fValue);
+            else fprintf(stderr, "  config %s = %d\n", key, r.config.iValue);
+          }
+        }
+        else if (r.type == GR_REC_PAD) { padding++; continue; } // Sector filler from a sync / close, not data
+        else { unknown++; continue; }
+        if (csv) csv->commit(GR_FlightLog::formatCsv(h, r, csv->reserve(GR_LOG_CSV_MAX_LINE)));
+        if (cols) cols->write(r);
+      }
+    }
+  }
+  fclose(in);
+  if (csv) { csv->flush(); if (csvFile != stdout) fclose(csvFile); }
+  if (cols) cols->close();
+
+  double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  uint64_t records = samples + events + configs + unknown;
+  double mb = double(records) * h.recordSize / 1e6; // Decoded size, so packed and plain logs compare
+  fprintf(stderr, "%llu samples, %llu events, %llu settings, %llu unknown records (%.1f MB in %.2fs, %.0f MB/s)\n", (unsigned long long)samples,
+          (unsigned long long)events, (unsigned long long)configs, (unsigned long long)unknown, mb, secs, secs > 0 ? mb / secs : 0);
+  if (padding) fprintf(stderr, "%llu padding records (sector filler from syncs)\n", (unsigned long long)padding);
+  if (h.packBlock && units)
+    fprintf(stderr, "Packed %.2fx (%.1f MB on the card)\n", double(records) * h.recordSize / (double(units) * unitBytes), units * unitBytes / 1e6);
+  if (badBlocks) fprintf(stderr, "%llu damaged blocks skipped\n", (unsigned long long)badBlocks);
+  return 0;
+}
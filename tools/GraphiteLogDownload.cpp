@@ -0,0 +1,415 @@
+/* GraphiteLogDownload.cpp
+    Host-side test for flight log downloads (lib/GR_LogDownload/GR_LogDownload.h): serves a log file from a local directory through
+    the poll() server (src/native/HttpServer_Posix.h) the same way the logger does (the handler detach()es the socket and a worker
+    thread, standing in for wi_downloadTask, streams the file), and downloads it with a plain socket client.
+
+    Doesn't need the ESP toolchain or PlatformIO, just a c++17 compiler:
+      g++ -std=c++17 -O2 -pthread -DGR_PERF_ENABLE -Ilib/GR_Http -Ilib/GR_FlightLog -Ilib/GR_LogDownload -Ilib/GR_Perf -Isrc/native tools/GraphiteLogDownload.cpp -o GraphiteLogDownload
+    Run: ./GraphiteLogDownload [log.grl | --packed]   (without a log it writes a synthetic 200k record / 6.4MB log to a temp directory;
+         --packed packs it, see GR_LogPack.h)
+
+    Checks the raw file and the CSV (against GR_FlightLog::formatCsv(), i.e. what GraphiteLogDecode writes) byte for byte: whole
+    downloads, downloads cut off partway and resumed with Range + If-Range, suffix / mid ranges, stale If-Range, 416, bad names,
+    one-at-a-time. Reports loopback throughput and the /perf rate JSON. Exits non-zero on any failure.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <string>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <GR_Http.h>
+#include <GR_FlightLog.h>
+#include <GR_LogPack.h>
+#include <GR_LogDownload.h>
+#include <GR_Perf.h>
+#include "HttpServer_Posix.h"
+#include "FileLogSource.h"
+
+#define SYNTH_RECORDS 200000  // Synthetic log: 200 s at 1kHz
+#define CHUNK 8192            // wi_downloadChunk
+
+static int failures = 0;
+static void check(bool ok, const char * what) {
+  printf("  %-64s %s\n", what, ok ? "ok" : "FAILED");
+  if (!ok) failures++;
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point t) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+}
+
+/// @brief A flight's worth of records: samples at 1kHz with a few events mixed in
+static bool writeSyntheticLog(const std::string& path, uint32_t records, bool packed) {
+  FILE * f = fopen(path.c_str(), "wb");
+  if (!f) return false;
+  GR_LogHeader h = GR_FlightLog::makeHeader(5000000, packed ? GR_PACK_BLOCK : 0);
+  h.cal_pAtSea = 101325; h.cal_lapseRate = 0.0059f; h.cal_magicExp = 0.190266435664f;
+  h.cal_zeroXAccel = 1984; h.cal_zeroYAccel = 1984; h.cal_zeroZAccel = 1992;
+  h.cal_xAccelCoef = 0.03f; h.cal_yAccelCoef = 0.03f; h.cal_zAccelCoef = 0.029f;
+  fwrite(&h, sizeof(h), 1, f);
+  static const uint8_t zeros[GR_PACK_BLOCK] = {};
+  fwrite(zeros, 1, size_t(GR_LogPack::dataStart(h) - sizeof(h)), f);
+  GR_LogPacker packer;
+  const uint8_t * block;
+  uint32_t seed = 1;
+  for (uint32_t i = 0; i < records; i++) {
+    seed = seed * 1664525u + 1013904223u;
+    uint64_t t = h.startUs + uint64_t(i) * 1000;
+    GR_LogRecord r;
+    if (i % 25000 == 100) r = GR_FlightLog::makeEvent(t, GR_EVT_LAUNCH + (i / 25000) % 4, int32_t(i), 1.5f);
+    else r = GR_FlightLog::makeSample(t, (i % 16 == 0 ? GR_SAMPLE_BARO | GR_SAMPLE_BATT : 0) | GR_SAMPLE_ACCEL, uint16_t(1984 + (seed >> 28)),
+                                      uint16_t(1984 + (seed >> 24 & 7)), uint16_t(2005 + (seed >> 20 & 7)), 98000.0f - i * 0.05f,
+                                      21.5f - i * 0.00001f, uint16_t(2300 + (seed >> 16 & 3)));
+    if (!packed) fwrite(&r, sizeof(r), 1, f);
+    else if ((block = packer.add(r))) fwrite(block, 1, GR_PACK_BLOCK, f);
+  }
+  if (packed && (block = packer.flush())) fwrite(block, 1, GR_PACK_BLOCK, f);
+  return fclose(f) == 0;
+}
+
+static std::string readFile(const std::string& path) {
+  std::string s;
+  FILE * f = fopen(path.c_str(), "rb");
+  if (!f) return s;
+  char buf[65536];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) s.append(buf, n);
+  fclose(f);
+  return s;
+}
+
+/// @brief What GraphiteLogDecode would write for this log
+static std::string expectedCsv(const std::string& raw) {
+  std::string csv = GR_FlightLog::csvHeader();
+  GR_LogHeader h;
+  memcpy(&h, raw.data(), sizeof(h));
+  char line[GR_LOG_CSV_MAX_LINE];
+  size_t unitBytes = GR_LogPack::unitBytes(h);
+  GR_LogUnpacker unit;
+  GR_LogRecord r;
+  for (size_t pos = size_t(GR_LogPack::dataStart(h)); pos + unitBytes <= raw.size(); pos += unitBytes) {
+    if (!unit.begin(h, reinterpret_cast<const uint8_t *>(raw.data()) + pos)) continue;
+    while (unit.next(r)) csv.append(line, GR_FlightLog::formatCsv(h, r, line));
+  }
+  return csv;
+}
+
+// Server side: wi_sendDownload() + wi_downloadTask() with a directory instead of the SD card ----------------------------------------
+
+static std::string logDir;
+static Posix_HttpServer * server;
+static GR_PerfRate downloadRate("download");
+static std::mutex jobLock;
+static std::condition_variable jobReady;
+static GR_LogDownloadJob pending;
+static bool havePending = false;
+static std::atomic<bool> downloadActive{false}, quitting{false};
+
+static void download(const GR_HttpRequest& req, GR_HttpResponse& res) {
+  GR_LogDownloadJob job;
+  if (job.parse(req)) { res.send(400, "text/plain", "Expected ?file=<name>.grl and optionally &format=csv"); return; }
+  if (downloadActive || (job.id = res.detach()) < 0) {
+    res.header("Retry-After", "10");
+    res.send(503, "text/plain", "Another download is running");
+    return;
+  }
+  downloadActive = true;
+  std::lock_guard<std::mutex> l(jobLock);
+  pending = job;
+  havePending = true;
+  jobReady.notify_one();
+}
+
+static bool sendAll(int fd, const uint8_t * data, size_t len) {
+  while (len) {
+    ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+    if (n <= 0) return false;
+    data += n;
+    len -= size_t(n);
+  }
+  return true;
+}
+
+static void downloadWorker() {
+  static GR_LogDownload dl;
+  static uint8_t buf[CHUNK];
+  FileLogSource file;
+  for (;;) {
+    GR_LogDownloadJob job;
+    {
+      std::unique_lock<std::mutex> l(jobLock);
+      jobReady.wait(l, [] { return havePending || quitting; });
+      if (!havePending) return;
+      job = pending;
+      havePending = false;
+    }
+    int status = dl.begin(job, file.open(logDir.c_str(), job.name) ? &file : nullptr);
+    bool ok = sendAll(job.id, buf, dl.head((char *)buf, sizeof(buf)));
+    auto start = std::chrono::steady_clock::now();
+    uint64_t sent = 0;
+    size_t n;
+    while (ok && (n = dl.read(buf, sizeof(buf))) > 0) {
+      ok = sendAll(job.id, buf, n);
+      if (ok) sent += n;
+    }
+    file.close();
+    if (status < 300) downloadRate.record(sent, uint64_t(secondsSince(start) * 1e6));
+    server->release(job.id);
+    downloadActive = false;
+  }
+}
+
+// Client side ----------------------------------------------------------------------------------------------------------------------
+
+struct Reply {
+  int status = 0;
+  std::string head, body;
+  uint64_t contentLength = UINT64_MAX;
+  std::string header(const char * name) const {
+    std::string key = std::string("\r\n") + name + ": ";
+    size_t p = head.find(key);
+    if (p == std::string::npos) return "";
+    p += key.size();
+    return head.substr(p, head.find("\r\n", p) - p);
+  }
+};
+
+/// @brief GET path with extra header lines; stops (hangs up) after maxBody body bytes, like a phone walking out of range
+static Reply getOnce(uint16_t port, const std::string& path, const std::string& headers, uint64_t maxBody) {
+  Reply r;
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connect(fd, (sockaddr *)&addr, sizeof(addr)) != 0) { close(fd); return r; }
+  timeval tv = {10, 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  std::string req = "GET " + path + " HTTP/1.1\r\nHost: graphite.local\r\n" + headers + "\r\n";
+  if (send(fd, req.data(), req.size(), MSG_NOSIGNAL) != ssize_t(req.size())) { close(fd); return r; }
+  std::string in;
+  std::vector<char> buf(1 << 16);
+  size_t headEnd = std::string::npos;
+  for (;;) {
+    ssize_t n = recv(fd, buf.data(), buf.size(), 0);
+    if (n <= 0) break;
+    in.append(buf.data(), size_t(n));
+    if (headEnd == std::string::npos && (headEnd = in.find("\r\n\r\n")) != std::string::npos) {
+      r.head = in.substr(0, headEnd + 2);
+      in.erase(0, headEnd + 4);
+    }
+    if (headEnd != std::string::npos && in.size() >= maxBody) { in.resize(maxBody); break; }
+  }
+  close(fd);
+  if (headEnd == std::string::npos) return r;
+  r.body = in;
+  r.status = atoi(r.head.c_str() + 9);
+  std::string cl = r.header("Content-Length");
+  if (!cl.empty()) r.contentLength = strtoull(cl.c_str(), nullptr, 10);
+  return r;
+}
+
+/// @brief getOnce(), but waits out the 503 while the last download is still noticing its client hung up
+static Reply get(uint16_t port, const std::string& path, const std::string& headers = "", uint64_t maxBody = UINT64_MAX) {
+  Reply r;
+  for (int tries = 0; tries < 200; tries++) {
+    r = getOnce(port, path, headers, maxBody);
+    if (r.status != 503) break;
+    usleep(10000);
+  }
+  return r;
+}
+
+static bool complete(const Reply& r) { return r.contentLength == r.body.size(); }
+
+/// @brief Download url, hanging up after each of cuts (body offsets) and resuming from there with Range + If-Range
+/// @return the stitched together body ("" if any piece went wrong)
+static std::string resumed(uint16_t port, const std::string& url, const std::vector<uint64_t>& cuts) {
+  Reply first = get(port, url, "", cuts.empty() ? UINT64_MAX : cuts[0]);
+  if (first.status != 200) return "";
+  std::string etag = first.header("ETag"), got = first.body;
+  for (size_t i = 0; i < cuts.size(); i++) {
+    if (got.size() != cuts[i]) return "";
+    uint64_t stop = i + 1 < cuts.size() ? cuts[i + 1] - cuts[i] : UINT64_MAX;
+    Reply r = get(port, url, "Range: bytes=" + std::to_string(got.size()) + "-\r\nIf-Range: " + etag + "\r\n", stop);
+    if (r.status != 206 || r.header("ETag") != etag) return "";
+    std::string cr = "bytes " + std::to_string(got.size()) + "-" + std::to_string(first.contentLength - 1) + "/" + std::to_string(first.contentLength);
+    if (r.header("Content-Range") != cr) return "";
+    got += r.body;
+  }
+  return got;
+}
+
+int main(int argc, char ** argv) {
+  std::string name = "Flight_2024-05-01_12-00-00.grl";
+  char tmpl[] = "/tmp/GraphiteLogDownloadXXXXXX";
+  bool packed = argc > 1 && !strcmp(argv[1], "--packed");
+  bool synthetic = argc < 2 || packed;
+  if (synthetic) {
+    if (!mkdtemp(tmpl)) { printf("Couldn't make a temp directory\n"); return 1; }
+    logDir = tmpl;
+    if (!writeSyntheticLog(logDir + "/" + name, SYNTH_RECORDS, packed)) { printf("Couldn't write the synthetic log\n"); return 1; }
+  } else {
+    std::string path = argv[1];
+    size_t slash = path.rfind('/');
+    logDir = slash == std::string::npos ? "." : path.substr(0, slash);
+    name = slash == std::string::npos ? path : path.substr(slash + 1);
+    if (!GR_LogDownloadJob::validName(name.c_str())) { printf("%s: needs to be a *.grl file name with no odd characters\n", name.c_str()); return 2; }
+  }
+  std::string raw = readFile(logDir + "/" + name);
+  GR_LogHeader h;
+  if (raw.size() < sizeof(h)) { printf("Couldn't read %s/%s\n", logDir.c_str(), name.c_str()); return 1; }
+  memcpy(&h, raw.data(), sizeof(h));
+  if (!GR_FlightLog::checkHeader(h)) { printf("%s isn't a Graphite log\n", name.c_str()); return 1; }
+  std::string csv = expectedCsv(raw);
+  printf("Log: %s/%s, %zu bytes raw, %zu bytes as CSV\n", logDir.c_str(), name.c_str(), raw.size(), csv.size());
+
+  printf("Range parsing:\n");
+  {
+    uint64_t a = 0, b = 0;
+    check(GR_Http::parseRange("bytes=0-499", 1000, a, b) == 1 && a == 0 && b == 499, "bytes=0-499");
+    check(GR_Http::parseRange("bytes=500-", 1000, a, b) == 1 && a == 500 && b == 999, "bytes=500-");
+    check(GR_Http::parseRange("bytes=-300", 1000, a, b) == 1 && a == 700 && b == 999, "bytes=-300 (suffix)");
+    check(GR_Http::parseRange("bytes=-3000", 1000, a, b) == 1 && a == 0 && b == 999, "suffix longer than the body is all of it");
+    check(GR_Http::parseRange("bytes=900-5000", 1000, a, b) == 1 && a == 900 && b == 999, "end past the body is clamped");
+    check(GR_Http::parseRange("bytes=1000-", 1000, a, b) == -1, "start past the body is 416");
+    check(GR_Http::parseRange("bytes=-0", 1000, a, b) == -1, "empty suffix is 416");
+    check(GR_Http::parseRange("bytes=0-1,5-9", 1000, a, b) == 0, "several ranges are ignored");
+    check(GR_Http::parseRange("bytes=9-1", 1000, a, b) == 0 && GR_Http::parseRange("items=0-1", 1000, a, b) == 0 &&
+          GR_Http::parseRange("bytes=x-1", 1000, a, b) == 0 && GR_Http::parseRange("bytes=-", 1000, a, b) == 0, "junk is ignored");
+    check(GR_Http::parseRange("bytes=99999999999999999999-", 1000, a, b) == 0, "overflow is ignored");
+    check(GR_LogDownloadJob::validName("Flight_2024-05-01_12-00-00.grl") && !GR_LogDownloadJob::validName("../x.grl") &&
+          !GR_LogDownloadJob::validName("a/b.grl") && !GR_LogDownloadJob::validName("x.csv") && !GR_LogDownloadJob::validName(".grl") &&
+          !GR_LogDownloadJob::validName("a\".grl"), "file names");
+  }
+
+  GR_HttpRouter router;
+  router.on("/download", download, GR_HTTP_GET);
+  Posix_HttpServer srv(router);
+  server = &srv;
+  if (!srv.begin(0)) { printf("Couldn't start the server\n"); return 1; }
+  uint16_t port = srv.port();
+  std::atomic<bool> stop{false};
+  std::thread serverThread([&] { while (!stop) srv.poll(20); });
+  std::thread worker(downloadWorker);
+  std::string url = "/download?file=" + name, csvUrl = url + "&format=csv";
+
+  printf("Raw:\n");
+  auto t0 = std::chrono::steady_clock::now();
+  Reply r = get(port, url);
+  double rawSecs = secondsSince(t0);
+  std::string etag = r.header("ETag");
+  check(r.status == 200 && complete(r) && r.body == raw, "whole file, byte for byte");
+  check(r.header("Accept-Ranges") == "bytes" && etag.size() == GR_HTTP_ETAG_LEN - 1, "Accept-Ranges + a strong ETag");
+  check(r.header("Content-Disposition") == "attachment; filename=\"" + name + "\"", "saved under its own name");
+  check(resumed(port, url, {raw.size() / 3, raw.size() / 3 + 777, raw.size() - 1}) == raw, "cut off 3 times, resumed with Range + If-Range");
+  r = get(port, url, "Range: bytes=1000-1999\r\n");
+  check(r.status == 206 && complete(r) && r.body == raw.substr(1000, 1000), "bytes=1000-1999 (starts mid sector)");
+  r = get(port, url, "Range: bytes=-100\r\n");
+  check(r.status == 206 && r.body == raw.substr(raw.size() - 100), "bytes=-100");
+  r = get(port, url, "Range: bytes=100-\r\nIf-Range: \"0000000000000000\"\r\n");
+  check(r.status == 200 && complete(r) && r.body == raw, "stale If-Range gets the whole file");
+  r = get(port, url, "Range: bytes=" + std::to_string(raw.size()) + "-\r\n");
+  check(r.status == 416 && r.header("Content-Range") == "bytes */" + std::to_string(raw.size()), "range past the end is 416");
+  r = get(port, url, "Range: bytes=0-9,20-29\r\n");
+  check(r.status == 200 && r.body == raw, "multiple ranges get the whole file");
+
+  printf("CSV:\n");
+  t0 = std::chrono::steady_clock::now();
+  r = get(port, csvUrl);
+  double csvFirstSecs = secondsSince(t0);
+  std::string csvTag = r.header("ETag");
+  check(r.status == 200 && complete(r) && r.body == csv, "whole CSV matches GraphiteLogDecode's");
+  check(r.header("Content-Type") == "text/csv" && csvTag != etag && csvTag.size() == etag.size(), "text/csv, its own ETag");
+  check(r.header("Content-Disposition") == "attachment; filename=\"" + name.substr(0, name.size() - 4) + ".csv\"", "saved as .csv");
+  t0 = std::chrono::steady_clock::now();
+  r = get(port, csvUrl);
+  double csvSecs = secondsSince(t0);
+  check(r.status == 200 && r.body == csv && r.header("ETag") == csvTag, "again (sizes remembered)");
+  size_t hdrLen = strlen(GR_FlightLog::csvHeader());
+  check(resumed(port, csvUrl, {10, hdrLen, hdrLen + 1, csv.size() / 2, csv.size() / 2 + 4097, csv.size() - 1}) == csv,
+        "cut off 6 times (in the header line, mid line...), resumed");
+  bool ranges = true;
+  uint32_t seed = 7;
+  for (int i = 0; i < 50 && ranges; i++) {
+    seed = seed * 1664525u + 1013904223u;
+    uint64_t a = seed % csv.size(), len = 1 + (seed >> 8) % 20000;
+    uint64_t b = std::min<uint64_t>(a + len, csv.size()) - 1;
+    r = get(port, csvUrl, "Range: bytes=" + std::to_string(a) + "-" + std::to_string(b) + "\r\nIf-Range: " + csvTag + "\r\n");
+    ranges = r.status == 206 && complete(r) && r.body == csv.substr(a, b - a + 1);
+  }
+  check(ranges, "50 random ranges");
+  r = get(port, csvUrl, "Range: bytes=-1\r\n");
+  check(r.status == 206 && r.body == "\n", "last byte");
+  r = get(port, url, "");
+  check(r.status == 200 && r.body == raw, "raw again, after the CSV");
+
+  printf("Errors:\n");
+  check(get(port, "/download?file=Flight_nope.grl").status == 404, "no such log is 404");
+  check(get(port, "/download?file=..%2Fetc%2Fpasswd.grl").status == 400, "path in the name is 400");
+  check(get(port, "/download?file=notes.txt").status == 400 && get(port, "/download").status == 400, "not a .grl / no name is 400");
+  check(get(port, url + "&format=xml").status == 400, "unknown format is 400");
+  {
+    FILE * f = fopen((logDir + "/junk.grl").c_str(), "wb");
+    if (f) { fputs("not a log at all, just some text", f); fclose(f); }
+    r = get(port, "/download?file=junk.grl&format=csv");
+    check(r.status == 400 && get(port, "/download?file=junk.grl").status == 200, "not a log: no CSV, but raw is fine");
+    remove((logDir + "/junk.grl").c_str());
+  }
+  {
+    // Someone else's download stuck behind a client that isn't reading: the next one is turned away, not queued. The stuck one's
+    // the CSV, so there's more than the socket buffers hold even when the raw log is small (packed)
+    int slow = socket(AF_INET, SOCK_STREAM, 0);
+    int small = 4096;
+    setsockopt(slow, SOL_SOCKET, SO_RCVBUF, &small, sizeof(small));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bool ok = connect(slow, (sockaddr *)&addr, sizeof(addr)) == 0;
+    std::string req = "GET " + csvUrl + " HTTP/1.1\r\n\r\n";
+    ok = ok && send(slow, req.data(), req.size(), MSG_NOSIGNAL) == ssize_t(req.size());
+    for (int i = 0; i < 100 && !downloadActive; i++) usleep(1000);
+    r = getOnce(port, url, "", UINT64_MAX);
+    check(ok && r.status == 503 && r.header("Retry-After") == "10", "second download at once is 503");
+    close(slow);
+    for (int i = 0; i < 2000 && downloadActive; i++) usleep(1000);
+    check(!downloadActive && get(port, url).body == raw, "...and the slot frees up when the first client hangs up");
+  }
+
+  stop = true;
+  serverThread.join();
+  {
+    std::lock_guard<std::mutex> l(jobLock);
+    quitting = true;
+    jobReady.notify_one();
+  }
+  worker.join();
+  srv.end();
+
+  printf("Throughput over loopback (the logger is limited by the card and the AP, see /perf there):\n");
+  printf("  raw  %8.1f MB/s\n", raw.size() / rawSecs / 1e6);
+  printf("  csv  %8.1f MB/s (%.1f MB/s the first time, which formats it twice to size it)\n", csv.size() / csvSecs / 1e6,
+         csv.size() / csvFirstSecs / 1e6);
+  static char json[4096];
+  GR_Perf::json(json, sizeof(json));
+  const char * rates = strstr(json, "\"rates\"");
+  printf("/perf: %s\n", rates ? rates : json);
+  check(downloadRate.count() > 0 && rates && strstr(rates, "\"download\""), "download throughput shows up in /perf");
+
+  if (synthetic) {
+    remove((logDir + "/" + name).c_str());
+    rmdir(logDir.c_str());
+  }
+  printf("%s\n", failures ? "FAILED" : "All checks passed");
+  return failures ? 1 : 0;
+}
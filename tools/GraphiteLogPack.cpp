@@ -0,0 +1,169 @@
+/* GraphiteLogPack.cpp
+    Host-side tool + benchmark for packed flight logs (lib/GR_FlightLog/GR_LogPack.h). Packs a plain log (or unpacks a packed one)
+    with the same GR_LogPacker the logger runs, checks that every record comes back out exactly as it went in, and reports how much
+    smaller it got and how fast both directions are.
+
+    Doesn't need the ESP toolchain or PlatformIO, just a c++17 compiler:
+      g++ -std=c++17 -O2 -Ilib/GR_FlightLog tools/GraphiteLogPack.cpp -o GraphiteLogPack
+
+    Usage:
+      GraphiteLogPack FLIGHT.GRL [...]            Ratio, pack / unpack MB/s (of plain records), slowest add(), round trip check
+      GraphiteLogPack FLIGHT.GRL -o OUT.GRL       ...and write it out the other way around (plain -> packed, packed -> plain)
+    A replayed flight to try it on: the flight sim's log (.pio/build/native/program --flight writes sim_flight.grl). Exits non-zero
+    if a round trip doesn't match.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <algorithm>
+#include <vector>
+#include <GR_FlightLog.h>
+#include <GR_LogPack.h>
+
+#define BENCH_MIN_SECONDS 0.5 // Repeat each direction for at least this long
+
+typedef std::chrono::steady_clock Clock;
+
+static void usage() {
+  fprintf(stderr, "Usage: GraphiteLogPack <log files...> [-o out.grl]\n");
+  exit(2);
+}
+
+static double secondsSince(Clock::time_point t) { return std::chrono::duration<double>(Clock::now() - t).count(); }
+
+/// @brief Every record in a log file, packed or not
+static bool readLog(const char * path, GR_LogHeader& h, std::vector<uint8_t>& head, std::vector<GR_LogRecord>& records) {
+  FILE * f = fopen(path, "rb");
+  if (!f) { fprintf(stderr, "%s: can't open\n", path); return false; }
+  if (fread(&h, sizeof(h), 1, f) != 1 || !GR_FlightLog::checkHeader(h)) { fprintf(stderr, "%s: not a Graphite log\n", path); fclose(f); return false; }
+  if (!h.packBlock && h.recordSize != sizeof(GR_LogRecord)) {
+    fprintf(stderr, "%s: records are %u bytes, newer than this tool (%u)\n", path, h.recordSize, unsigned(sizeof(GR_LogRecord)));
+    fclose(f);
+    return false;
+  }
+  head.resize(h.headerSize); // Kept as-is, in case a newer logger added fields
+  fseek(f, 0, SEEK_SET);
+  if (fread(head.data(), 1, head.size(), f) != head.size()) { fprintf(stderr, "%s: short header\n", path); fclose(f); return false; }
+  fseek(f, long(GR_LogPack::dataStart(h)), SEEK_SET);
+  std::vector<uint8_t> unit(GR_LogPack::unitBytes(h));
+  GR_LogUnpacker u;
+  GR_LogRecord r;
+  records.clear();
+  while (fread(unit.data(), unit.size(), 1, f) == 1) {
+    if (!u.begin(h, unit.data())) continue;
+    while (u.next(r)) records.push_back(r);
+  }
+  fclose(f);
+  return true;
+}
+
+/// @brief Pack records the way the logger does: a block at a time, then the last one flushed
+static void pack(const std::vector<GR_LogRecord>& records, std::vector<uint8_t>& out) {
+  GR_LogPacker packer;
+  packer.reset();
+  out.clear();
+  const uint8_t * block;
+  for (const GR_LogRecord& r : records)
+    if ((block = packer.add(r))) out.insert(out.end(), block, block + GR_PACK_BLOCK);
+  if ((block = packer.flush())) out.insert(out.end(), block, block + GR_PACK_BLOCK);
+}
+
+static void unpack(const GR_LogHeader& h, const std::vector<uint8_t>& blocks, std::vector<GR_LogRecord>& out) {
+  GR_LogUnpacker u;
+  GR_LogRecord r;
+  out.clear();
+  for (size_t pos = 0; pos + h.packBlock <= blocks.size(); pos += h.packBlock) {
+    if (!u.begin(h, blocks.data() + pos)) continue;
+    while (u.next(r)) out.push_back(r);
+  }
+}
+
+/// @brief A header for the other format: packed logs say how big their blocks are (version 2), plain ones are written as version 1
+static GR_LogHeader flipped(GR_LogHeader h) {
+  h.packBlock = h.packBlock ? 0 : GR_PACK_BLOCK;
+  if (h.packBlock && h.version < 2) h.version = 2;
+  if (!h.packBlock && h.version == 2) h.version = 1;
+  h.recordSize = sizeof(GR_LogRecord);
+  return h;
+}
+
+static bool writeLog(const char * path, const GR_LogHeader& h, std::vector<uint8_t> head, const std::vector<GR_LogRecord>& records) {
+  memcpy(head.data(), &h, sizeof(h));
+  head.resize(size_t(GR_LogPack::dataStart(h)), 0);
+  std::vector<uint8_t> body;
+  if (h.packBlock) pack(records, body);
+  else body.assign(reinterpret_cast<const uint8_t *>(records.data()), reinterpret_cast<const uint8_t *>(records.data() + records.size()));
+  FILE * f = fopen(path, "wb");
+  if (!f) { fprintf(stderr, "%s: can't create\n", path); return false; }
+  bool ok = fwrite(head.data(), 1, head.size(), f) == head.size() && fwrite(body.data(), 1, body.size(), f) == body.size();
+  return fclose(f) == 0 && ok;
+}
+
+static int packFile(const char * path, const char * outPath) {
+  GR_LogHeader h;
+  std::vector<uint8_t> head;
+  std::vector<GR_LogRecord> records, back;
+  if (!readLog(path, h, head, records)) return 1;
+  if (records.empty()) { fprintf(stderr, "%s: no records\n", path); return 1; }
+  GR_LogHeader ph = h.packBlock ? h : flipped(h);
+  double plainMB = records.size() * sizeof(GR_LogRecord) / 1e6;
+
+  // Throughput: the whole log, over and over
+  std::vector<uint8_t> packed;
+  int passes = 0;
+  auto t = Clock::now();
+  do { pack(records, packed); passes++; } while (secondsSince(t) < BENCH_MIN_SECONDS);
+  double packMBs = plainMB * passes / secondsSince(t);
+  passes = 0;
+  t = Clock::now();
+  do { unpack(ph, packed, back); passes++; } while (secondsSince(t) < BENCH_MIN_SECONDS);
+  double unpackMBs = plainMB * passes / secondsSince(t);
+
+  // The logger's worry is the slowest single add() (it runs between samples), not the average
+  std::vector<double> ns(records.size());
+  GR_LogPacker packer;
+  packer.reset();
+  for (size_t i = 0; i < records.size(); i++) {
+    auto t0 = Clock::now();
+    packer.add(records[i]);
+    ns[i] = std::chrono::duration<double, std::nano>(Clock::now() - t0).count();
+  }
+  std::sort(ns.begin(), ns.end());
+  const GR_LogPacker::Stats& st = packer.stats();
+
+  bool same = back.size() == records.size() && !memcmp(back.data(), records.data(), records.size() * sizeof(GR_LogRecord));
+  printf("%s: %s, %zu records (%u as-is), %.2f MB plain -> %.2f MB packed in %zu blocks, %.2fx\n", path, h.packBlock ? "packed" : "plain",
+         records.size(), st.verbatim, plainMB, packed.size() / 1e6, packed.size() / GR_PACK_BLOCK, plainMB * 1e6 / packed.size());
+  printf("  pack   %7.0f MB/s   add() median %.0f ns, 99.9%% %.0f ns, worst %.0f ns (incl. the clock reads)\n", packMBs, ns[ns.size() / 2],
+         ns[size_t(ns.size() * 0.999)], ns.back());
+  printf("  unpack %7.0f MB/s\n", unpackMBs);
+  printf("  round trip %s\n", same ? "exact" : "MISMATCH");
+  if (!same) return 1;
+
+  if (outPath) {
+    GR_LogHeader oh = flipped(h);
+    if (!writeLog(outPath, oh, head, records)) return 1;
+    std::vector<uint8_t> ohead;
+    GR_LogHeader check;
+    if (!readLog(outPath, check, ohead, back)) return 1;
+    same = back.size() == records.size() && !memcmp(back.data(), records.data(), records.size() * sizeof(GR_LogRecord));
+    printf("  wrote %s (%s), reads back %s\n", outPath, oh.packBlock ? "packed" : "plain", same ? "exact" : "MISMATCH");
+    if (!same) return 1;
+  }
+  return 0;
+}
+
+int main(int argc, char ** argv) {
+  std::vector<const char *> files;
+  const char * outPath = NULL;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-o") && i + 1 < argc) outPath = argv[++i];
+    else if (argv[i][0] == '-') usage();
+    else files.push_back(argv[i]);
+  }
+  if (files.empty() || (outPath && files.size() != 1)) usage();
+  int failed = 0;
+  for (const char * f : files) failed |= packFile(f, outPath);
+  return failed;
+}
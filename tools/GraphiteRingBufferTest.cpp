@@ -0,0 +1,152 @@
+/* GraphiteRingBufferTest.cpp
+    Host-side checks for the SPSC ring buffer (lib/GR_RingBuffer/GR_RingBuffer.h): full / empty edges on one thread, then a producer
+    thread and a consumer thread hammering small buffers with millions of records (so the indices lap the buffer over and over and
+    both sides keep hitting full and empty), checking every record comes out once, in order, and whole.
+
+    Doesn't need the ESP toolchain or PlatformIO, just a c++17 compiler:
+      g++ -std=c++17 -O2 -pthread -Ilib/GR_RingBuffer tools/GraphiteRingBufferTest.cpp -o GraphiteRingBufferTest
+
+    Usage:
+      GraphiteRingBufferTest          Run the checks. Exits with 1 if any check fails
+      GraphiteRingBufferTest --long   Also run the indices all the way round uint32_t (4 billion records on one thread, ~15 s)
+    Build it with -fsanitize=thread as well to have TSan look at the threaded part.
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <GR_RingBuffer.h>
+
+#define STRESS_ITEMS 5000000  // Records through each threaded run
+
+static int failures = 0;
+#define CHECK(cond) do { if (!(cond)) { printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+/// @brief A record big enough to tear if a slot got read while it was being written: every word is worked out from the sequence
+struct Item {
+  uint32_t seq;
+  uint32_t words[7];
+  static Item make(uint32_t seq) {
+    Item it;
+    it.seq = seq;
+    for (int i = 0; i < 7; i++) it.words[i] = seq * 2654435761u + i;
+    return it;
+  }
+  bool whole() const {
+    for (int i = 0; i < 7; i++) if (words[i] != seq * 2654435761u + i) return false;
+    return true;
+  }
+};
+
+static void edges() {
+  printf("Edges\n");
+  GR_RingBuffer<Item, 4> rb;
+  Item it;
+  CHECK(rb.empty() && !rb.pop(it) && rb.popBatch(&it, 1) == 0);
+  for (uint32_t i = 0; i < 4; i++) CHECK(rb.push(Item::make(i))); // Every slot's usable
+  CHECK(rb.size() == 4 && !rb.push(Item::make(99)) && rb.overflows() == 1);
+  CHECK(rb.pop(it) && it.seq == 0);
+  CHECK(rb.push(Item::make(4)) && !rb.push(Item::make(99)) && rb.overflows() == 2); // Room for exactly one again
+  Item out[8];
+  CHECK(rb.popBatch(out, 8) == 4); // Batch across the end of the array
+  for (uint32_t i = 0; i < 4; i++) CHECK(out[i].seq == i + 1 && out[i].whole());
+  CHECK(rb.empty() && rb.pushed() == 5);
+  for (uint32_t lap = 0; lap < 10; lap++) { // Lap the array with batches of 3 (not a divisor of 4)
+    for (uint32_t i = 0; i < 3; i++) CHECK(rb.push(Item::make(100 + lap * 3 + i)));
+    CHECK(rb.popBatch(out, 2) == 2 && out[0].seq == 100 + lap * 3 && out[1].seq == 101 + lap * 3);
+    CHECK(rb.pop(it) && it.seq == 102 + lap * 3);
+  }
+  CHECK(rb.empty() && rb.overflows() == 2);
+}
+
+struct StressResult {
+  uint64_t received = 0, fullRetries = 0, emptyPolls = 0;
+  bool inOrder = true, whole = true;
+};
+
+/// @brief One producer and one consumer thread through a Capacity slot buffer. The producer retries a record the buffer had no room
+///        for (counted), so every sequence number has to come out exactly once. batch: the consumer uses popBatch() with up to that many
+///        (0 = pop() one at a time)
+template <size_t Capacity>
+static StressResult stress(size_t batch) {
+  std::unique_ptr<GR_RingBuffer<Item, Capacity>> buf(new GR_RingBuffer<Item, Capacity>()); // c++17 new keeps its alignas
+  GR_RingBuffer<Item, Capacity>& rb = *buf;
+  StressResult r;
+  std::atomic<bool> go{false};
+  std::thread producer([&] {
+    while (!go.load()) std::this_thread::yield();
+    for (uint32_t seq = 0; seq < STRESS_ITEMS;) {
+      if (rb.push(Item::make(seq))) seq++;
+      else { r.fullRetries++; std::this_thread::yield(); } // Let the consumer in (matters on a one core box)
+    }
+  });
+  std::thread consumer([&] {
+    while (!go.load()) std::this_thread::yield();
+    uint32_t expect = 0;
+    Item out[64];
+    while (expect < STRESS_ITEMS) {
+      size_t n;
+      if (batch) n = rb.popBatch(out, batch);
+      else n = rb.pop(out[0]) ? 1 : 0;
+      if (!n) { r.emptyPolls++; std::this_thread::yield(); continue; }
+      for (size_t i = 0; i < n; i++, expect++) {
+        if (out[i].seq != expect) r.inOrder = false;
+        if (!out[i].whole()) r.whole = false;
+      }
+      r.received += n;
+    }
+  });
+  go.store(true);
+  producer.join();
+  consumer.join();
+  Item extra;
+  CHECK(!rb.pop(extra)); // Nothing left over (no duplicates)
+  CHECK(rb.pushed() == STRESS_ITEMS);
+  CHECK(rb.overflows() == r.fullRetries);
+  return r;
+}
+
+template <size_t Capacity>
+static void stressRun(size_t batch) {
+  StressResult r = stress<Capacity>(batch);
+  printf("  %4zu slots, %s: %llu records, %llu full, %llu empty\n", Capacity, batch ? "popBatch" : "pop     ",
+         (unsigned long long)r.received, (unsigned long long)r.fullRetries, (unsigned long long)r.emptyPolls);
+  CHECK(r.received == STRESS_ITEMS);
+  CHECK(r.inOrder);
+  CHECK(r.whole);
+}
+
+static void threads() {
+  printf("Producer + consumer threads\n");
+  stressRun<2>(0);    // Full and empty nearly every call
+  stressRun<4>(3);
+  stressRun<64>(0);
+  stressRun<64>(64);
+  stressRun<1024>(16); // io_rawRingSize-ish
+}
+
+/// @brief push / pop 2^32 + some records so head and tail wrap uint32_t (the index maths relies on unsigned wraparound)
+static void wrap32() {
+  printf("uint32_t wrap\n");
+  static GR_RingBuffer<uint32_t, 8> rb;
+  uint32_t v;
+  bool ok = true;
+  for (uint64_t i = 0; i < (1ULL << 32) + 16; i++) {
+    if (!rb.push(uint32_t(i)) || !rb.pop(v) || v != uint32_t(i)) { ok = false; break; }
+  }
+  CHECK(ok);
+  for (uint32_t i = 0; i < 8; i++) CHECK(rb.push(i)); // Right across the wrap: still 8 usable, still in order
+  CHECK(!rb.push(8) && rb.size() == 8);
+  uint32_t out[8];
+  CHECK(rb.popBatch(out, 8) == 8 && out[0] == 0 && out[7] == 7 && rb.empty());
+}
+
+int main(int argc, char ** argv) {
+  edges();
+  threads();
+  if (argc > 1 && strcmp(argv[1], "--long") == 0) wrap32();
+  printf("%s (%d failed)\n", failures ? "FAIL" : "PASS", failures);
+  return failures ? 1 : 0;
+}
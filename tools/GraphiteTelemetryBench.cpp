@@ -0,0 +1,366 @@
+/* GraphiteTelemetryBench.cpp
+    Host-side test + benchmark for the live telemetry stream (lib/GR_Telemetry/GR_Telemetry.h) the status pages subscribe to.
+
+    Doesn't need the ESP toolchain or PlatformIO, just a c++17 compiler:
+      g++ -std=c++17 -O2 -pthread -Ilib/GR_Telemetry -Ilib/GR_Http -Isrc/native tools/GraphiteTelemetryBench.cpp -o GraphiteTelemetryBench
+    Run: ./GraphiteTelemetryBench
+
+    Encoder: number formatting, full first frame / changed fields after, frames cost (ns) and size against the old /updateStatus
+    XML, and no heap allocations while pushing.
+    Stream: a /events route like src/WebFuncs.h on the local poll() server (src/native/HttpServer_Posix.h) pushed every 20ms from
+    a simulated sensor, with a few clients at different rates merging the frames like the status page does. Checks each gets about
+    the rate it asked for, nothing gets sent while nothing changes, every client ends up with exactly the latest values, and a
+    client that stops reading gets dropped without holding anyone else up. Exits non-zero on any failure.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <map>
+#include <new>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <GR_Telemetry.h>
+#include <GR_Http.h>
+#include "HttpServer_Posix.h"
+
+// Counts every operator new, to show pushing frames doesn't allocate
+static std::atomic<uint64_t> allocations{0};
+void * operator new(size_t n) {
+  allocations++;
+  if (void * p = malloc(n ? n : 1)) return p;
+  throw std::bad_alloc();
+}
+void operator delete(void * p) noexcept { free(p); }
+void operator delete(void * p, size_t) noexcept { free(p); }
+
+#define TICK_MS 20        // wi_telemetryMinMs: how often the logger pushes
+#define MAX_SUBSCRIBERS 4 // wi_telemetryClients
+
+// Same fields as main.cpp
+enum { tTime, tX, tY, tZ, tPress, tTempC, tAltM, tBatt, tState, tLdAltFt, tLdAltN, tLdG, tLdGN, tFieldCount };
+static const GR_TelemetryField fields[tFieldCount] = {
+  {"t", 0}, {"ax", 1}, {"ay", 1}, {"az", 1}, {"p", 1}, {"tc", 2}, {"am", 2}, {"bv", 2}, {"s", 0},
+  {"ldaf", 1}, {"ldan", 0}, {"ldg", 2}, {"ldgn", 0}};
+
+/// @brief Logger sitting on the pad: noisy accelerometer, slowly drifting baro, battery and thresholds that hardly change
+struct Sim {
+  uint64_t timeMs = 1717000000000ull;
+  uint32_t seed = 12345;
+  double press = 98212.0, tempC = 21.5;
+  float noise() { seed = seed * 1664525u + 1013904223u; return float(seed >> 8) / float(1 << 24) - 0.5f; }
+  void step(int64_t * v) {
+    timeMs += TICK_MS;
+    press += noise() * 0.6;
+    tempC += noise() * 0.002;
+    double altM = ((pow(101325.0 / press, 0.190266435664) - 1) * (tempC + 273.15)) / 0.0059;
+    v[tTime] = int64_t(timeMs);
+    v[tX] = GR_Telemetry::quantize(1984 + noise() * 1.5f, fields[tX].decimals);
+    v[tY] = GR_Telemetry::quantize(1984 + noise() * 1.5f, fields[tY].decimals);
+    v[tZ] = GR_Telemetry::quantize(2005 + noise() * 1.5f, fields[tZ].decimals);
+    v[tPress] = GR_Telemetry::quantize(press, fields[tPress].decimals);
+    v[tTempC] = GR_Telemetry::quantize(tempC, fields[tTempC].decimals);
+    v[tAltM] = GR_Telemetry::quantize(altM, fields[tAltM].decimals);
+    v[tBatt] = GR_Telemetry::quantize(3.91, fields[tBatt].decimals);
+    v[tState] = 0x03;
+    v[tLdAltFt] = GR_Telemetry::quantize(100, fields[tLdAltFt].decimals);
+    v[tLdAltN] = 5;
+    v[tLdG] = GR_Telemetry::quantize(3.0, fields[tLdG].decimals);
+    v[tLdGN] = 30;
+  }
+};
+
+static int failures = 0;
+static void check(bool ok, const char * what) {
+  printf("  %-60s %s\n", what, ok ? "ok" : "FAILED");
+  if (!ok) failures++;
+}
+
+/// @brief "key":number pairs out of one frame's JSON, merged into state the way the status page's Object.assign() does
+static bool merge(const std::string& json, std::map<std::string, std::string>& state) {
+  if (json.size() < 2 || json.front() != '{' || json.back() != '}') return false;
+  size_t i = 1;
+  while (i < json.size() - 1) {
+    if (json[i] != '"') return false;
+    size_t keyEnd = json.find('"', i + 1);
+    if (keyEnd == std::string::npos || json[keyEnd + 1] != ':') return false;
+    size_t valEnd = json.find_first_of(",}", keyEnd + 2);
+    std::string val = json.substr(keyEnd + 2, valEnd - keyEnd - 2);
+    char * end;
+    strtod(val.c_str(), &end);
+    if (val.empty() || *end) return false;
+    state[json.substr(i + 1, keyEnd - i - 1)] = val;
+    i = valEnd + (json[valEnd] == ',');
+  }
+  return true;
+}
+
+static std::string fixed(int64_t q, uint8_t decimals) {
+  char buf[24];
+  return std::string(buf, GR_Telemetry::formatFixed(q, decimals, buf));
+}
+
+// Stream side: the same handler as wi_sendEvents() ---------------------------------------------------------------------------------
+
+static GR_TelemetryHub<tFieldCount, MAX_SUBSCRIBERS> hub(fields);
+static Posix_HttpServer * server;
+static uint32_t nowMs;
+
+static void events(const GR_HttpRequest& req, GR_HttpResponse& res) {
+  char arg[12];
+  unsigned long periodMs = 200;
+  if (req.arg("ms", arg, sizeof(arg))) periodMs = std::min(std::max(strtoul(arg, NULL, 10), (unsigned long)TICK_MS), 5000ul);
+  if (hub.full()) { res.send(503, "text/plain", "Too many live feeds"); return; }
+  int id = res.stream(200, "text/event-stream");
+  if (id < 0) { res.send(500, "text/plain", "Can't stream"); return; }
+  hub.add(id, periodMs, nowMs);
+}
+static bool sendFrame(int id, const char * frame, size_t len) { return server->push(id, frame, len); }
+static void closed(int id) { hub.remove(id); } // Every connection that closes, not just streams
+
+// Client side: EventSource stand-in -----------------------------------------------------------------------------------------------
+
+static int connectTo(uint16_t port, int rcvBuf = 0) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (rcvBuf) setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvBuf, sizeof(rcvBuf)); // Before connect, so the window starts small
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connect(fd, (sockaddr *)&addr, sizeof(addr)) != 0) { close(fd); return -1; }
+  timeval tv = {0, 100000};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  return fd;
+}
+
+struct Subscriber {
+  int periodMs;
+  int fd = -1;
+  std::thread thread;
+  std::atomic<bool> stop{false};
+  std::atomic<int> frames{0};
+  int status = 0;
+  bool eventStream = false, badFrame = false;
+  std::map<std::string, std::string> state;
+
+  void run(uint16_t port) {
+    fd = connectTo(port);
+    std::string req = "GET /events?ms=" + std::to_string(periodMs) + " HTTP/1.1\r\nAccept: text/event-stream\r\n\r\n";
+    if (fd < 0 || send(fd, req.data(), req.size(), MSG_NOSIGNAL) != ssize_t(req.size())) return;
+    std::string buf;
+    bool headers = false;
+    while (!stop) {
+      char tmp[4096];
+      ssize_t n = recv(fd, tmp, sizeof(tmp), 0);
+      if (n == 0) break;
+      if (n < 0) continue; // Timeout, check stop
+      buf.append(tmp, size_t(n));
+      if (!headers) {
+        size_t end = buf.find("\r\n\r\n");
+        if (end == std::string::npos) continue;
+        sscanf(buf.c_str(), "HTTP/1.1 %d", &status);
+        eventStream = buf.find("Content-Type: text/event-stream") < end;
+        buf.erase(0, end + 4);
+        headers = true;
+      }
+      size_t end;
+      while ((end = buf.find("\n\n")) != std::string::npos) {
+        if (buf.compare(0, 5, "data:") != 0 || !merge(buf.substr(5, end - 5), state)) badFrame = true;
+        frames++;
+        buf.erase(0, end + 2);
+      }
+    }
+  }
+};
+
+// --------------------------------------------------------------------------------------------------------------------------------
+
+int main() {
+  // Encoder --------------------------------------------------------------------------------------------------------------------
+  printf("Encoder checks:\n");
+  check(fixed(0, 2) == "0.00" && fixed(5, 2) == "0.05" && fixed(-5, 2) == "-0.05" && fixed(-1234, 1) == "-123.4" &&
+        fixed(1717000000123ll, 0) == "1717000000123" && fixed(INT64_MIN, 0) == "-9223372036854775808",
+        "fixed point formatting");
+  check(GR_Telemetry::quantize(1.005, 1) == 10 && GR_Telemetry::quantize(-2.25, 1) == -23 && GR_Telemetry::quantize(NAN, 2) == 0,
+        "quantize rounds half away from zero, NaN -> 0");
+  {
+    GR_TelemetryEncoder<tFieldCount> enc;
+    Sim sim;
+    int64_t v[tFieldCount];
+    char out[GR_TLM_MAX_FRAME];
+    sim.step(v);
+    std::map<std::string, std::string> state;
+    size_t len = enc.encode(fields, v, out, sizeof(out));
+    bool ok = len && merge(std::string(out + 5, len - 7), state) && state.size() == tFieldCount && !memcmp(out, "data:{", 6) &&
+              !memcmp(out + len - 3, "}\n\n", 3);
+    check(ok, "first frame has every field");
+    check(enc.encode(fields, v, out, sizeof(out)) == 0, "nothing changed -> no frame");
+    v[tBatt]++;
+    len = enc.encode(fields, v, out, sizeof(out));
+    check(std::string(out, len) == "data:{\"bv\":3.92}\n\n", "one field changed -> just that field");
+    enc.reset();
+    check(enc.encode(fields, v, out, 40) == 0 && enc.encode(fields, v, out, sizeof(out)) > 100,
+          "full frame that doesn't fit is dropped, then sent whole");
+  }
+
+  // Cost + size, 4 subscribers like a full AP, pushing every tick
+  {
+    GR_TelemetryHub<tFieldCount, MAX_SUBSCRIBERS> bench(fields);
+    for (int i = 0; i < MAX_SUBSCRIBERS; i++) bench.add(i, TICK_MS, 0);
+    Sim sim;
+    int64_t v[tFieldCount];
+    const int ticks = 200000;
+    double encodeNs = 0;
+    uint64_t allocsBefore = allocations;
+    for (int i = 0; i < ticks; i++) {
+      sim.step(v);
+      auto t0 = std::chrono::steady_clock::now();
+      bench.push(v, uint32_t(i * TICK_MS), [](int, const char *, size_t) { return true; });
+      encodeNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+    }
+    uint64_t allocs = allocations - allocsBefore;
+    check(bench.frames() == uint32_t(ticks * MAX_SUBSCRIBERS), "every subscriber gets a frame every tick");
+    check(allocs == 0, "no heap allocations while pushing");
+
+    // What one /updateStatus answer used to cost (body only; the old page fetched the whole thing + HTTP headers every 200ms)
+    char xml[1024];
+    int xmlLen = snprintf(xml, sizeof(xml),
+             "<data><time>%s:%d</time><date>%s</date>"
+             "<xAccel>%.2f</xAccel><yAccel>%.2f</yAccel><zAccel>%.2f</zAccel>"
+             "<pressPa>%.2f</pressPa><tempC>%.2f</tempC><tempF>%.2f</tempF><altM>%.2f</altM><altFt>%.2f</altFt><battV>%.2f</battV>"
+             "<launchDetectAltFt>%.2f</launchDetectAltFt><launchDetectAltSamples>%d</launchDetectAltSamples>"
+             "<launchDetectAccelG>%.2f</launchDetectAccelG><launchDetectAccelSamples>%d</launchDetectAccelSamples>"
+             "<flightLoggingTimeout>dummy</flightLoggingTimeout><landedLoggingTimeout>dummy</landedLoggingTimeout></data>",
+             "22:00:38", 123, "Fri, Jan 05 2024", 1984.25, 1984.5, 2005.75, 98212.41, 21.5, 70.7, 1445.12, 4741.2, 3.91,
+             100.0, 5, 3.0, 30);
+    GR_TelemetryEncoder<tFieldCount> enc;
+    char full[GR_TLM_MAX_FRAME];
+    size_t fullLen = enc.encode(fields, v, full, sizeof(full));
+    printf("\n  Frame cost: %.0f ns per subscriber (%d subscribers, %d ticks)\n", encodeNs / ticks / MAX_SUBSCRIBERS, MAX_SUBSCRIBERS, ticks);
+    printf("  Frame size: %zu bytes full, %.1f bytes average with changed fields only, vs %d bytes of XML per poll\n\n",
+           fullLen, double(bench.bytes()) / bench.frames(), xmlLen);
+  }
+
+  // Stream -------------------------------------------------------------------------------------------------------------------------
+  printf("Stream checks:\n");
+  GR_HttpRouter router;
+  router.on("/events", events, GR_HTTP_GET);
+  Posix_HttpServer srv(router, 8);
+  server = &srv;
+  srv.onClose(closed);
+  if (!srv.begin(0)) { printf("Couldn't start the server\n"); return 1; }
+
+  auto start = std::chrono::steady_clock::now();
+  auto elapsedMs = [&]() { return uint32_t(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count()); };
+  Sim sim;
+  int64_t v[tFieldCount];
+  sim.step(v);
+  uint32_t lastTick = 0;
+  // Run the server for ms, ticking the simulation (or not) like wi_serverTask + wi_pushTelemetry()
+  auto serve = [&](uint32_t ms, bool changing) {
+    uint32_t until = elapsedMs() + ms;
+    while ((nowMs = elapsedMs()) < until) {
+      srv.poll(1);
+      nowMs = elapsedMs();
+      if (nowMs - lastTick < TICK_MS) continue;
+      lastTick = nowMs;
+      if (changing) sim.step(v);
+      hub.push(v, nowMs, sendFrame);
+    }
+  };
+
+  const int periods[] = {20, 50, 200, 1000};
+  std::vector<Subscriber *> subs;
+  for (int p : periods) {
+    Subscriber * s = new Subscriber();
+    s->periodMs = p;
+    s->thread = std::thread([s, &srv]() { s->run(srv.port()); });
+    subs.push_back(s);
+  }
+  serve(200, true); // Let everyone connect
+  check(hub.count() == 4, "4 subscribers");
+  int busy = connectTo(srv.port());
+  std::string busyReply;
+  if (busy >= 0) {
+    const char req[] = "GET /events HTTP/1.1\r\n\r\n";
+    send(busy, req, sizeof(req) - 1, MSG_NOSIGNAL);
+    char tmp[256];
+    for (int i = 0; i < 50 && busyReply.find("\r\n\r\n") == std::string::npos; i++) {
+      serve(10, true);
+      ssize_t n = recv(busy, tmp, sizeof(tmp), MSG_DONTWAIT);
+      if (n > 0) busyReply.append(tmp, size_t(n));
+    }
+    close(busy);
+  }
+  check(busyReply.compare(0, 12, "HTTP/1.1 503") == 0, "5th subscriber turned away (503)");
+
+  int framesAt[4];
+  for (int i = 0; i < 4; i++) framesAt[i] = subs[i]->frames;
+  const uint32_t runMs = 3000;
+  serve(runMs, true);
+  bool ratesOk = true;
+  printf("  Rates over %ums:", runMs);
+  for (int i = 0; i < 4; i++) {
+    double expected = double(runMs) / periods[i];
+    int got = subs[i]->frames - framesAt[i];
+    printf(" %dms: %d frames (expected ~%.0f)%s", periods[i], got, expected, i < 3 ? "," : "\n");
+    if (got < expected * 0.8 - 1 || got > expected * 1.1 + 1) ratesOk = false;
+  }
+  check(ratesOk, "each subscriber gets frames at about the rate it asked for");
+
+  serve(50, false); // Last changes go out
+  uint32_t framesBefore = hub.frames();
+  serve(500, false);
+  check(hub.frames() == framesBefore, "nothing sent while nothing changes");
+  serve(1100, false); // Slowest subscriber has had its chance to catch up (no-op: nothing changed)
+
+  bool statesOk = true, formatOk = true;
+  for (Subscriber * s : subs) {
+    for (int f = 0; f < tFieldCount; f++) {
+      auto it = s->state.find(fields[f].key);
+      if (it == s->state.end() || it->second != fixed(v[f], fields[f].decimals)) statesOk = false;
+    }
+    if (s->status != 200 || !s->eventStream || s->badFrame) formatOk = false;
+  }
+  check(formatOk, "200 text/event-stream, every frame parses");
+  check(statesOk, "every subscriber's merged state == latest values");
+
+  // Close the readers, then one that subscribes and never reads while the values change as fast as they can
+  for (Subscriber * s : subs) { s->stop = true; s->thread.join(); close(s->fd); }
+  serve(100, false);
+  check(hub.count() == 0, "closed subscribers are forgotten");
+
+  int stuck = connectTo(srv.port(), 2048);
+  const char req[] = "GET /events?ms=20 HTTP/1.1\r\n\r\n";
+  send(stuck, req, sizeof(req) - 1, MSG_NOSIGNAL);
+  serve(100, true);
+  bool subscribed = hub.count() == 1;
+  auto t0 = std::chrono::steady_clock::now();
+  uint32_t fakeMs = nowMs;
+  double worstPushUs = 0;
+  while (hub.count() && std::chrono::steady_clock::now() - t0 < std::chrono::seconds(5)) {
+    sim.step(v);
+    fakeMs += TICK_MS; // Pretend time's flying so every push is due
+    auto p0 = std::chrono::steady_clock::now();
+    hub.push(v, fakeMs, sendFrame);
+    srv.poll(0);
+    worstPushUs = std::max(worstPushUs, std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - p0).count());
+  }
+  close(stuck);
+  printf("  Stuck subscriber dropped after %.0f ms (worst push + poll %.0f us)\n",
+         std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count(), worstPushUs);
+  check(subscribed && hub.count() == 0, "subscriber that stops reading gets dropped");
+  check(worstPushUs < 5000, "...without the server ever waiting on it");
+
+  for (Subscriber * s : subs) delete s;
+  printf("\n%s\n", failures ? "FAILED" : "All checks passed");
+  return failures ? 1 : 0;
+}
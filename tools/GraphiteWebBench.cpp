@@ -0,0 +1,265 @@
+/* GraphiteWebBench.cpp
+    Host-side before / after for the web page pipeline (tools/web_assets.py + GR_Http::sendAsset()): what a phone downloads to open
+    the status page, the old way (data/ as is, streamed in 1KB chunks, no validators) and the new way (minified + gzipped, ETag,
+    304 on reload). Serves both from the local poll() server (src/native/HttpServer_Posix.h) and loads them like a browser would:
+    the page, style.css and favicon.ico over one keep-alive connection, then the same again as a reload (If-None-Match).
+
+    Needs the generated src/WebAssets.h, so run the build step first:
+      python3 tools/web_assets.py
+      g++ -std=c++17 -O2 -pthread -Ilib/GR_Http -Isrc -Isrc/native tools/GraphiteWebBench.cpp -o GraphiteWebBench
+    Run from the repo root (it reads data/): ./GraphiteWebBench [link Mbit/s, default 2]
+
+    Reports bytes on the wire (headers included) and requests per load, the loopback time, and what those bytes take over a
+    link of the given speed (the softAP at wi_power gets a phone a few Mbit/s at best). Also checks the ETag / 304 handling.
+    Exits non-zero on any failure.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <GR_Http.h>
+#include "HttpServer_Posix.h"
+#include "WebAssets.h"
+
+#define LOADS 200 // Page loads timed per case (median reported)
+
+// Old way: the file straight off "SPIFFS" (data/), 1KB at a time, cacheable for a day but no validator ---------------------------------
+
+static std::string readFile(const char * path) {
+  std::string s;
+  FILE * f = fopen(path, "rb");
+  if (!f) return s;
+  char buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) s.append(buf, n);
+  fclose(f);
+  return s;
+}
+
+static std::string rawStatus, rawStyle, rawIcon;
+
+static void sendRaw(GR_HttpResponse& res, const std::string& file, const char * type) {
+  res.header("Cache-Control", "max-age=86400");
+  res.begin(200, type);
+  for (size_t i = 0; i < file.size(); i += 1024) res.write(file.data() + i, std::min<size_t>(1024, file.size() - i));
+  res.end();
+}
+static void oldStatus(const GR_HttpRequest&, GR_HttpResponse& res) { sendRaw(res, rawStatus, "text/html"); }
+static void oldStyle(const GR_HttpRequest&, GR_HttpResponse& res) { sendRaw(res, rawStyle, "text/css"); }
+static void oldIcon(const GR_HttpRequest&, GR_HttpResponse& res) { sendRaw(res, rawIcon, "image/x-icon"); }
+
+// New way: what wi_sendFile() does for an embedded asset -----------------------------------------------------------------------------
+
+static void sendAsset(const GR_HttpRequest& req, GR_HttpResponse& res, const char * path, const char * cache) {
+  const GR_HttpAsset * a = GR_Http::findAsset(wi_assets, wi_assetCount, path);
+  if (a) GR_Http::sendAsset(req, res, *a, cache);
+}
+static void newStatus(const GR_HttpRequest& req, GR_HttpResponse& res) { sendAsset(req, res, "/status.html", "no-cache"); }
+static void newStyle(const GR_HttpRequest& req, GR_HttpResponse& res) { sendAsset(req, res, "/style.css", "max-age=86400"); }
+static void newIcon(const GR_HttpRequest& req, GR_HttpResponse& res) { sendAsset(req, res, "/favicon.ico", "max-age=86400"); }
+
+// Client ----------------------------------------------------------------------------------------------------------------------------
+
+static int connectTo(uint16_t port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connect(fd, (sockaddr *)&addr, sizeof(addr)) != 0) { close(fd); return -1; }
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  timeval tv = {5, 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  return fd;
+}
+
+struct Reply { int status = 0; std::string headers, body; size_t wireBytes = 0; };
+
+static std::string headerValue(const std::string& headers, const char * name) {
+  std::string key = std::string("\r\n") + name + ": ";
+  size_t at = headers.find(key);
+  if (at == std::string::npos) return "";
+  at += key.size();
+  return headers.substr(at, headers.find("\r\n", at) - at);
+}
+
+/// @brief Read one response (Content-Length or chunked). buf carries bytes over between responses on the same connection
+static bool readReply(int fd, std::string& buf, Reply& r) {
+  auto fill = [&]() {
+    char tmp[8192];
+    ssize_t n = recv(fd, tmp, sizeof(tmp), 0);
+    if (n <= 0) return false;
+    buf.append(tmp, size_t(n));
+    return true;
+  };
+  size_t hdrEnd;
+  while ((hdrEnd = buf.find("\r\n\r\n")) == std::string::npos) if (!fill()) return false;
+  if (sscanf(buf.c_str(), "HTTP/1.1 %d", &r.status) != 1) return false;
+  r.headers = buf.substr(0, hdrEnd + 2);
+  size_t used = hdrEnd + 4;
+  r.body.clear();
+  std::string cl = headerValue(r.headers, "Content-Length");
+  if (!cl.empty()) {
+    size_t len = strtoul(cl.c_str(), nullptr, 10);
+    while (buf.size() < used + len) if (!fill()) return false;
+    r.body = buf.substr(used, len);
+    used += len;
+  } else {
+    for (;;) {
+      size_t eol;
+      while ((eol = buf.find("\r\n", used)) == std::string::npos) if (!fill()) return false;
+      size_t len = strtoul(buf.c_str() + used, nullptr, 16);
+      while (buf.size() < eol + 2 + len + 2) if (!fill()) return false;
+      r.body.append(buf, eol + 2, len);
+      used = eol + 2 + len + 2;
+      if (len == 0) break;
+    }
+  }
+  r.wireBytes = used;
+  buf.erase(0, used);
+  return true;
+}
+
+struct Load { size_t requestBytes = 0, replyBytes = 0, bodyBytes = 0; int requests = 0; bool ok = true; };
+
+/// @brief Status page + its two subresources on one connection. etags (one per path, "" for none) go out as If-None-Match
+static Load pageLoad(uint16_t port, const std::string (&etags)[3], Reply (&replies)[3]) {
+  static const char * paths[] = {"/", "/style.css", "/favicon.ico"};
+  Load l;
+  int fd = connectTo(port);
+  if (fd < 0) { l.ok = false; return l; }
+  std::string buf;
+  for (int i = 0; i < 3; i++) {
+    std::string req = std::string("GET ") + paths[i] + " HTTP/1.1\r\nHost: graphite.local\r\nAccept-Encoding: gzip, deflate\r\n";
+    if (!etags[i].empty()) req += "If-None-Match: " + etags[i] + "\r\n";
+    req += "\r\n";
+    if (send(fd, req.data(), req.size(), MSG_NOSIGNAL) != ssize_t(req.size()) || !readReply(fd, buf, replies[i])) { l.ok = false; break; }
+    l.requestBytes += req.size();
+    l.replyBytes += replies[i].wireBytes;
+    l.bodyBytes += replies[i].body.size();
+    l.requests++;
+  }
+  close(fd);
+  return l;
+}
+
+static int failures = 0;
+static void check(bool ok, const char * what) {
+  printf("  %-60s %s\n", what, ok ? "ok" : "FAILED");
+  if (!ok) failures++;
+}
+
+/// @brief Run a router on its own thread for the duration
+struct TestServer {
+  GR_HttpRouter router;
+  Posix_HttpServer server{router, 8};
+  std::atomic<bool> stop{false};
+  std::thread thread;
+  bool start() {
+    if (!server.begin(0)) return false;
+    thread = std::thread([this]() { while (!stop) server.poll(5); });
+    return true;
+  }
+  ~TestServer() { stop = true; if (thread.joinable()) thread.join(); }
+};
+
+int main(int argc, char ** argv) {
+  double linkMbps = argc > 1 ? atof(argv[1]) : 2;
+  rawStatus = readFile("data/status.html");
+  rawStyle = readFile("data/style.css");
+  rawIcon = readFile("data/favicon.ico");
+  if (rawStatus.empty() || rawIcon.empty()) { printf("Run me from the repo root (I need data/)\n"); return 1; }
+
+  TestServer before, after;
+  before.router.on("/", oldStatus, GR_HTTP_GET);
+  before.router.on("/style.css", oldStyle, GR_HTTP_GET);
+  before.router.on("/favicon.ico", oldIcon, GR_HTTP_GET);
+  after.router.on("/", newStatus, GR_HTTP_GET);
+  after.router.on("/style.css", newStyle, GR_HTTP_GET);
+  after.router.on("/favicon.ico", newIcon, GR_HTTP_GET);
+  if (!before.start() || !after.start()) { printf("Couldn't start the servers\n"); return 1; }
+
+  printf("Checks:\n");
+  const std::string none[3];
+  Reply cold[3];
+  Load l = pageLoad(after.server.port(), none, cold);
+  const GR_HttpAsset * status = GR_Http::findAsset(wi_assets, wi_assetCount, "/status.html");
+  check(l.ok && status, "status page is an embedded asset");
+  bool gzOk = l.ok;
+  for (Reply& r : cold) {
+    gzOk = gzOk && r.status == 200 && headerValue(r.headers, "Content-Encoding") == "gzip" && r.body.size() >= 2 &&
+           (uint8_t)r.body[0] == 0x1f && (uint8_t)r.body[1] == 0x8b && !headerValue(r.headers, "ETag").empty();
+  }
+  check(gzOk, "200, gzip, ETag on every first load");
+  check(status && cold[0].body == std::string((const char *)status->gz, status->gzLen) &&
+        headerValue(cold[0].headers, "ETag") == status->etag, "body + ETag are the asset's");
+  char tag[GR_HTTP_ETAG_LEN];
+  GR_Http::etag(GR_Http::fnv1a64(status->gz, status->gzLen), tag);
+  check(!strcmp(tag, status->etag), "web_assets.py's ETag == GR_Http::etag(fnv1a64(gz))");
+  check(headerValue(cold[0].headers, "Cache-Control") == "no-cache" && headerValue(cold[2].headers, "Cache-Control") == "max-age=86400",
+        "pages revalidate, static files cache");
+
+  std::string etags[3];
+  for (int i = 0; i < 3; i++) etags[i] = headerValue(cold[i].headers, "ETag");
+  Reply warm[3];
+  l = pageLoad(after.server.port(), etags, warm);
+  bool notModified = l.ok;
+  for (Reply& r : warm) notModified = notModified && r.status == 304 && r.body.empty() && !headerValue(r.headers, "ETag").empty();
+  check(notModified, "reload with If-None-Match: 304, no body, ETag");
+
+  const std::string variants[][3] = {{"W/" + etags[0], "", ""}, {"\"nope\", " + etags[0], "", ""}, {"*", "", ""}, {"\"nope\"", "", ""}};
+  const int expect[] = {304, 304, 304, 200};
+  bool variantsOk = true;
+  for (int v = 0; v < 4; v++) {
+    Reply r[3];
+    pageLoad(after.server.port(), variants[v], r);
+    if (r[0].status != expect[v]) variantsOk = false;
+  }
+  check(variantsOk, "weak / list / * match, a stale ETag gets the page");
+  check(GR_Http::etagMatches(" \"a\" ,\tW/\"b\" ", "\"b\"") && !GR_Http::etagMatches("\"ab\"", "\"a\""), "If-None-Match parsing");
+
+  // Before / after ---------------------------------------------------------------------------------------------------------------
+  struct Case { const char * name; TestServer * server; bool reload; };
+  const Case cases[] = {{"before, first load", &before, false}, {"before, reload", &before, true},
+                        {"after, first load", &after, false}, {"after, reload", &after, true}};
+  printf("\nOpening the status page (/, style.css, favicon.ico), %d loads each:\n", LOADS);
+  printf("  %-20s %9s %11s %11s %12s %14s\n", "", "requests", "bytes down", "bytes up", "loopback us", "link ms");
+  double firstBefore = 0, firstAfter = 0;
+  for (const Case& c : cases) {
+    Reply r[3];
+    std::string validators[3];
+    if (c.reload) { // Whatever validators the first load handed out (the old way has none)
+      pageLoad(c.server->server.port(), none, r);
+      for (int i = 0; i < 3; i++) validators[i] = headerValue(r[i].headers, "ETag");
+    }
+    std::vector<double> us;
+    Load last;
+    for (int i = 0; i < LOADS; i++) {
+      auto t0 = std::chrono::steady_clock::now();
+      last = pageLoad(c.server->server.port(), validators, r);
+      us.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count());
+      if (!last.ok) break;
+    }
+    std::sort(us.begin(), us.end());
+    double linkMs = (last.requestBytes + last.replyBytes) * 8 / (linkMbps * 1000);
+    if (!c.reload) (c.server == &before ? firstBefore : firstAfter) = linkMs;
+    printf("  %-20s %9d %11zu %11zu %12.0f %14.1f\n", c.name, last.requests, last.replyBytes, last.requestBytes, us[us.size() / 2], linkMs);
+    if (!last.ok) failures++;
+  }
+  printf("  (link ms: bytes up + down at %.1f Mbit/s, not counting round trips)\n", linkMbps);
+  printf("\n  First load is %.1fx smaller\n", firstBefore / firstAfter);
+
+  printf("\n%s\n", failures ? "FAILED" : "All checks passed");
+  return failures ? 1 : 0;
+}
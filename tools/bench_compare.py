@@ -0,0 +1,80 @@
+"""bench_compare.py
+    Compares two benchmark runs (the JSON lines src/bench prints, see lib/GR_Bench/GR_Bench.h).
+
+    Usage: python3 tools/bench_compare.py old.jsonl new.jsonl [--threshold 10]
+    Lines that aren't JSON objects are ignored, so a serial monitor capture from the logger works as-is.
+    Prints each kernel's median and p99 before / after and the change, and exits 1 if any kernel's median got slower by more than
+    --threshold percent (the p99 is shown but not judged: it moves around too much between runs to fail a build on).
+
+    Part of the Graphite Flight Data Logger project, GPL-3.0 (see LICENSE)
+"""
+import json
+import sys
+
+DEFAULT_THRESHOLD = 10.0  # Median slowdown (%) that counts as a regression
+
+
+def load(path):
+    """Header + {name: result} from one run"""
+    header, results = {}, {}
+    with open(path, encoding="utf-8", errors="replace") as f:
+        for line in f:
+            line = line.strip()
+            if not line.startswith("{"):
+                continue
+            try:
+                obj = json.loads(line)
+            except ValueError:
+                continue
+            if "bench" in obj:
+                header = obj
+            elif "name" in obj:
+                results[obj["name"]] = obj
+    return header, results
+
+
+def change(old, new):
+    return (new - old) / old * 100 if old > 0 else 0.0
+
+
+def main(argv):
+    args = [a for a in argv[1:] if not a.startswith("--")]
+    threshold = DEFAULT_THRESHOLD
+    if "--threshold" in argv:
+        threshold = float(argv[argv.index("--threshold") + 1])
+        args.remove(argv[argv.index("--threshold") + 1])
+    if len(args) != 2:
+        print("Usage: bench_compare.py old.jsonl new.jsonl [--threshold percent]")
+        return 2
+
+    (old_header, old), (new_header, new) = load(args[0]), load(args[1])
+    if old_header.get("target") != new_header.get("target"):
+        print("Note: comparing %s with %s, the numbers aren't from the same machine" % (old_header.get("target"), new_header.get("target")))
+    if old_header.get("version") != new_header.get("version"):
+        print("Note: output format version %s vs %s" % (old_header.get("version"), new_header.get("version")))
+
+    regressions = []
+    print("%-16s %10s %10s %8s   %10s %10s %8s" % ("kernel (ns)", "p50 old", "p50 new", "change", "p99 old", "p99 new", "change"))
+    for name in list(old) + [n for n in new if n not in old]:
+        o, n = old.get(name), new.get(name)
+        if not o or not n or o.get("skipped") or n.get("skipped"):
+            print("%-16s %s" % (name, "only in the new run" if not o else "only in the old run" if not n else "skipped"))
+            continue
+        p50 = change(o["p50"], n["p50"])
+        flag = ""
+        if p50 > threshold:
+            flag = "  SLOWER"
+            regressions.append(name)
+        elif p50 < -threshold:
+            flag = "  faster"
+        print("%-16s %10.1f %10.1f %+7.1f%%   %10.1f %10.1f %+7.1f%%%s" % (name, o["p50"], n["p50"], p50, o["p99"], n["p99"],
+                                                                     change(o["p99"], n["p99"]), flag))
+
+    if regressions:
+        print("Median more than %.0f%% slower: %s" % (threshold, ", ".join(regressions)))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
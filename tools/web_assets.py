@@ -0,0 +1,154 @@
+"""web_assets.py
+    Build step for the web pages: minifies + gzips everything in data/ so the logger can send it with Content-Encoding: gzip.
+
+    Runs before every PlatformIO build (extra_scripts in platformio.ini), or by hand: python3 tools/web_assets.py
+    For each file in data/:
+      - .html / .css / .js get their comments and indentation stripped (conservatively: line breaks stay, so JS that leans on
+        automatic semicolons still works), then everything's gzipped (-9, no timestamp, so the output only changes when the
+        source does).
+      - Small ones (gzipped size <= EMBED_MAX) go into src/WebAssets.h as byte arrays, so they're served straight out of flash
+        with no SPIFFS open. The rest go to data_build/<name>.gz, which is what the SPIFFS image is built from (data_dir).
+      - Each gets a strong ETag: FNV-1a 64 of the gzipped bytes, the same thing WebFuncs.h works out for SPIFFS files at boot.
+    Prints a size report (raw / minified / gzipped).
+
+    So comments in data/ are free now, they never make it onto the logger.
+
+    Part of the Graphite Flight Data Logger project, GPL-3.0 (see LICENSE)
+"""
+import gzip
+import os
+import re
+import sys
+
+EMBED_MAX = 4096  # Biggest gzipped file built into the firmware (bytes). Everything the status pages load is under this
+
+TYPES = {".html": "text/html", ".css": "text/css", ".js": "application/javascript", ".ico": "image/x-icon",
+         ".png": "image/png", ".svg": "image/svg+xml", ".json": "application/json", ".txt": "text/plain"}
+
+
+def strip_comments(code, line_comments):
+    """Drop /* */ (and // if line_comments) comments from CSS / JS, leaving anything inside quotes alone"""
+    out = []
+    i, n = 0, len(code)
+    while i < n:
+        c = code[i]
+        if c in "'\"`":
+            j = i + 1
+            while j < n and code[j] != c:
+                j += 2 if code[j] == "\\" else 1
+            out.append(code[i:j + 1])
+            i = j + 1
+        elif code.startswith("/*", i):
+            end = code.find("*/", i + 2)
+            i = n if end < 0 else end + 2
+        elif line_comments and code.startswith("//", i):
+            end = code.find("\n", i)
+            i = n if end < 0 else end
+        else:
+            out.append(c)
+            i += 1
+    return "".join(out)
+
+
+def squeeze(text):
+    """Strip indentation / trailing spaces and drop blank lines"""
+    return "\n".join(line.strip() for line in text.splitlines() if line.strip())
+
+
+def minify_html(html):
+    html = re.sub(r"<!--.*?-->", "", html, flags=re.S)
+    # Scripts and styles get their own comment stripping; the markup in between just loses its indentation
+    parts = re.split(r"(<script[^>]*>.*?</script>|<style[^>]*>.*?</style>)", html, flags=re.S | re.I)
+    out = []
+    for part in parts:
+        m = re.match(r"(<(script|style)[^>]*>)(.*?)(</\2>)", part, flags=re.S | re.I)
+        if m:
+            body = strip_comments(m.group(3), m.group(2).lower() == "script")
+            out.append(m.group(1) + squeeze(body) + m.group(4))
+        else:
+            out.append(squeeze(part))
+    return "\n".join(p for p in out if p)
+
+
+def minify(name, data):
+    ext = os.path.splitext(name)[1].lower()
+    if ext == ".html":
+        return minify_html(data.decode("utf-8")).encode("utf-8")
+    if ext == ".css":
+        return squeeze(strip_comments(data.decode("utf-8"), False)).encode("utf-8")
+    if ext == ".js":
+        return squeeze(strip_comments(data.decode("utf-8"), True)).encode("utf-8")
+    return data
+
+
+def fnv1a64(data):
+    h = 0xcbf29ce484222325
+    for b in data:
+        h = ((h ^ b) * 0x100000001b3) & 0xFFFFFFFFFFFFFFFF
+    return h
+
+
+def build(root):
+    src_dir = os.path.join(root, "data")
+    out_dir = os.path.join(root, "data_build")
+    header = os.path.join(root, "src", "WebAssets.h")
+    os.makedirs(out_dir, exist_ok=True)
+    for stale in os.listdir(out_dir):
+        os.remove(os.path.join(out_dir, stale))
+
+    embedded = []
+    print("web_assets: %-20s %8s %8s %8s" % ("file", "raw", "min", "gzip"))
+    totals = [0, 0, 0]
+    for name in sorted(os.listdir(src_dir)):
+        path = os.path.join(src_dir, name)
+        if not os.path.isfile(path):
+            continue  # SPIFFS is flat anyway
+        with open(path, "rb") as f:
+            raw = f.read()
+        small = minify(name, raw)
+        gz = gzip.compress(small, 9, mtime=0)
+        etag = '"%016x"' % fnv1a64(gz)
+        where = "flash" if len(gz) <= EMBED_MAX else "spiffs"
+        print("web_assets: %-20s %8d %8d %8d  %s" % (name, len(raw), len(small), len(gz), where))
+        for i, v in enumerate((len(raw), len(small), len(gz))):
+            totals[i] += v
+        if where == "flash":
+            ext = os.path.splitext(name)[1].lower()
+            embedded.append((name, TYPES.get(ext, "application/octet-stream"), etag, gz, len(small)))
+        else:
+            with open(os.path.join(out_dir, name + ".gz"), "wb") as f:
+                f.write(gz)
+    print("web_assets: %-20s %8d %8d %8d" % ("total", totals[0], totals[1], totals[2]))
+
+    lines = ["/* WebAssets.h", "    GENERATED by tools/web_assets.py from data/, don't edit (it's rewritten on every build).",
+             "    Gzipped pages built into the firmware, see wi_sendFile() in WebFuncs.h", "*/", "#pragma once",
+             "#include <GR_Http.h>", ""]
+    for i, (name, _, _, gz, _) in enumerate(embedded):
+        lines.append("static const uint8_t wi_asset%d[%d] = { // %s" % (i, len(gz), name))
+        for off in range(0, len(gz), 24):
+            lines.append("  " + ",".join("0x%02x" % b for b in gz[off:off + 24]) + ",")
+        lines.append("};")
+    lines.append("")
+    lines.append("const GR_HttpAsset wi_assets[] = {")
+    for i, (name, ctype, etag, gz, size) in enumerate(embedded):
+        lines.append('  {"/%s", "%s", "\\"%s\\"", wi_asset%d, %d, %d},' % (name, ctype, etag.strip('"'), i, len(gz), size))
+    if not embedded:
+        lines.append('  {"", "", "", nullptr, 0, 0}, // (nothing small enough to embed)')
+    lines.append("};")
+    lines.append("const size_t wi_assetCount = %d;" % len(embedded))
+    text = "\n".join(lines) + "\n"
+    # Only touch the header when it changes, or everything that includes it gets rebuilt every time
+    old = None
+    if os.path.exists(header):
+        with open(header) as f:
+            old = f.read()
+    if old != text:
+        with open(header, "w") as f:
+            f.write(text)
+
+
+try:
+    Import("env")  # Running as a PlatformIO extra script
+    build(env.subst("$PROJECT_DIR"))
+except NameError:
+    build(os.path.dirname(os.path.dirname(os.path.abspath(__file__))))